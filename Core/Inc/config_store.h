@@ -0,0 +1,84 @@
+/**
+  ******************************************************************************
+  * @file           : config_store.h
+  * @brief          : Log-structured key/value store in two flash sectors
+  ******************************************************************************
+  * Values are appended as records to the active sector; the last record of
+  * a key wins. When the sector is full, the live values are copied to the
+  * other sector, which then becomes the active one, so the two sectors wear
+  * evenly. Reads come from a RAM copy of every live value.
+  *
+  * Sector layout, 32-bit words:
+  *   [magic][sequence][record]...[erased]
+  * Record:
+  *   [0x5AA5 << 16 | len << 8 | key][value, padded with 0xFF][CRC-32]
+  * A record of length 0 deletes its key.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __CONFIG_STORE_H
+#define __CONFIG_STORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Flash sectors 6 and 7, the CONFIG region of STM32F411VETX_FLASH.ld */
+#define CONFIG_STORE_ADDR         0x08040000UL
+#define CONFIG_STORE_SECTOR_SIZE  (128U * 1024U)
+#define CONFIG_STORE_FIRST_SECTOR 6U
+
+#define CONFIG_STORE_MAGIC        0x31474643UL    /* "CFG1" */
+
+/* Keys 0 to CONFIG_STORE_KEYS - 1 */
+#ifndef CONFIG_STORE_KEYS
+#define CONFIG_STORE_KEYS         32U
+#endif /* CONFIG_STORE_KEYS */
+
+/* Longest value in bytes, a multiple of 4 */
+#ifndef CONFIG_STORE_VALUE_MAX
+#define CONFIG_STORE_VALUE_MAX    32U
+#endif /* CONFIG_STORE_VALUE_MAX */
+
+#if (CONFIG_STORE_KEYS > 256U) || ((CONFIG_STORE_VALUE_MAX % 4U) != 0U) || (CONFIG_STORE_VALUE_MAX > 255U)
+#error "CONFIG_STORE_KEYS or CONFIG_STORE_VALUE_MAX out of range"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  CONFIG_STORE_OK          = 0x00U,
+  CONFIG_STORE_ERR_KEY     = 0x01U,
+  CONFIG_STORE_ERR_LEN     = 0x02U,
+  CONFIG_STORE_ERR_MISSING = 0x03U,
+  CONFIG_STORE_ERR_FLASH   = 0x04U,       /* erase or program failed */
+} config_store_status_t;
+
+typedef struct
+{
+  uint32_t writes;                /* records appended for config_store_set/delete */
+  uint32_t unchanged;             /* writes skipped, the value was already stored */
+  uint32_t value_bytes;           /* value bytes of the appended records */
+  uint32_t programmed;            /* bytes programmed, records, copies and headers */
+  uint32_t compactions;
+  uint32_t erases[2];             /* per sector */
+  uint32_t recovered;             /* mounts that found an interrupted write */
+} config_store_stats_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+config_store_status_t config_store_init(void);
+config_store_status_t config_store_get(uint8_t key, void *value, uint8_t *len);
+config_store_status_t config_store_set(uint8_t key, const void *value, uint8_t len);
+config_store_status_t config_store_delete(uint8_t key);
+void config_store_get_stats(config_store_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CONFIG_STORE_H */
@@ -0,0 +1,59 @@
+/**
+  ******************************************************************************
+  * @file           : debounce.h
+  * @brief          : Bit-sliced key debouncer working on whole key bitmaps
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DEBOUNCE_H
+#define __DEBOUNCE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Key bitmap size, 32 keys per word */
+#ifndef DEBOUNCE_WORDS
+#define DEBOUNCE_WORDS            3U
+#endif /* DEBOUNCE_WORDS */
+
+/* Width of the per-key counters, thresholds are 1 to DEBOUNCE_COUNTER_MAX scans */
+#ifndef DEBOUNCE_COUNTER_BITS
+#define DEBOUNCE_COUNTER_BITS     6U
+#endif /* DEBOUNCE_COUNTER_BITS */
+
+#define DEBOUNCE_COUNTER_MAX      ((1U << DEBOUNCE_COUNTER_BITS) - 1U)
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  DEBOUNCE_EAGER      = 0U,  /* accept a press at once and ignore the key for threshold scans,
+                                a release once it has been stable for threshold scans */
+  DEBOUNCE_DEFER      = 1U,  /* accept a level once it has been stable for threshold scans */
+  DEBOUNCE_INTEGRATOR = 2U,  /* up/down counter saturating at 0 and threshold */
+} debounce_mode_t;
+
+typedef struct
+{
+  uint32_t state[DEBOUNCE_WORDS];                          /* debounced levels */
+  uint32_t locked[DEBOUNCE_WORDS];                         /* eager: pressed keys in lockout */
+  uint32_t count[DEBOUNCE_COUNTER_BITS][DEBOUNCE_WORDS];   /* counter bit planes */
+  uint8_t  mode;
+  uint8_t  threshold;
+} debounce_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void debounce_init(debounce_t *db, debounce_mode_t mode, uint8_t threshold, const uint32_t *raw);
+void debounce_configure(debounce_t *db, debounce_mode_t mode, uint8_t threshold);
+uint8_t debounce_update(debounce_t *db, const uint32_t *raw, uint32_t *changed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DEBOUNCE_H */
@@ -0,0 +1,80 @@
+/**
+  ******************************************************************************
+  * @file           : hid_config.h
+  * @brief          : Runtime configuration table, exposed as HID feature reports
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __HID_CONFIG_H
+#define __HID_CONFIG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Vendor feature reports (usage page 0xFF01), 7 data bytes after the ID */
+#define HID_CONFIG_PARAM_REPORT_ID    0x04U
+#define HID_CONFIG_CTRL_REPORT_ID     0x05U
+#define HID_CONFIG_REPORT_SIZE        8U
+
+/* Layout version reported by the control report */
+#define HID_CONFIG_VERSION            0x01U
+
+/* Parameter report operation byte (SET_REPORT) */
+#define HID_CONFIG_OP_SELECT          0x00U  /* select the parameter read by GET_REPORT */
+#define HID_CONFIG_OP_WRITE           0x01U  /* select and write */
+
+/* Control report command byte (SET_REPORT) */
+#define HID_CONFIG_CMD_NONE           0x00U
+#define HID_CONFIG_CMD_DEFAULTS       0x01U  /* restore every parameter to its default */
+#define HID_CONFIG_CMD_MACRO_PLAY     0x02U  /* play the macro numbered by the next two bytes */
+#define HID_CONFIG_CMD_MACRO_STOP     0x03U  /* stop the macro playing */
+
+/* Quiet time before changed parameters are saved to flash */
+#ifndef HID_CONFIG_SAVE_DELAY_MS
+#define HID_CONFIG_SAVE_DELAY_MS      1000U
+#endif /* HID_CONFIG_SAVE_DELAY_MS */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  HID_CONFIG_POLL_INTERVAL = 0x01U,   /* ms, 1/2/4/8/10, applies at the next enumeration */
+  HID_CONFIG_DEBOUNCE_MS   = 0x02U,   /* ms */
+  HID_CONFIG_DEBOUNCE_MODE = 0x03U,   /* debounce_mode_t */
+  HID_CONFIG_LAYOUT        = 0x04U,   /* kbd_layout_id_t the host is set to, for typed text */
+} hid_config_id_t;
+
+typedef enum
+{
+  HID_CONFIG_OK          = 0x00U,
+  HID_CONFIG_ERR_ID      = 0x01U,
+  HID_CONFIG_ERR_RANGE   = 0x02U,
+  HID_CONFIG_ERR_REPORT  = 0x03U,
+} hid_config_status_t;
+
+typedef enum
+{
+  HID_CONFIG_TYPE_U8     = 0x01U,
+  HID_CONFIG_TYPE_U16    = 0x02U,
+  HID_CONFIG_TYPE_ENUM   = 0x03U,
+} hid_config_type_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void hid_config_init(void);
+void hid_config_task(void);
+void hid_config_restore_defaults(void);
+hid_config_status_t hid_config_get(uint8_t id, uint16_t *value);
+hid_config_status_t hid_config_set(uint8_t id, uint16_t value);
+int8_t hid_config_get_feature(uint8_t report_id, uint8_t *report, uint16_t *len);
+int8_t hid_config_set_feature(uint8_t report_id, const uint8_t *report, uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HID_CONFIG_H */
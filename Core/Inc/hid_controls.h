@@ -0,0 +1,56 @@
+/**
+  ******************************************************************************
+  * @file           : hid_controls.h
+  * @brief          : Consumer control and system control report senders
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __HID_CONTROLS_H
+#define __HID_CONTROLS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Report ID 2: one 16-bit Consumer page usage, 0 when released */
+#define HID_CONSUMER_REPORT_ID        0x02U
+#define HID_CONSUMER_REPORT_SIZE      3U
+#define HID_CONSUMER_USAGE_MAX        0x023CU
+
+/* Report ID 3: one bit per Generic Desktop system control usage */
+#define HID_SYSTEM_REPORT_ID          0x03U
+#define HID_SYSTEM_REPORT_SIZE        2U
+
+/* Consumer page usages */
+#define HID_CONSUMER_SCAN_NEXT        0x00B5U
+#define HID_CONSUMER_SCAN_PREVIOUS    0x00B6U
+#define HID_CONSUMER_STOP             0x00B7U
+#define HID_CONSUMER_PLAY_PAUSE       0x00CDU
+#define HID_CONSUMER_MUTE             0x00E2U
+#define HID_CONSUMER_VOLUME_UP        0x00E9U
+#define HID_CONSUMER_VOLUME_DOWN      0x00EAU
+#define HID_CONSUMER_AL_CALCULATOR    0x0192U
+#define HID_CONSUMER_AC_SEARCH        0x0221U
+#define HID_CONSUMER_AC_HOME          0x0223U
+
+/* Generic Desktop system control usages */
+#define HID_SYSTEM_POWER_DOWN         0x81U
+#define HID_SYSTEM_SLEEP              0x82U
+#define HID_SYSTEM_WAKE_UP            0x83U
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint8_t hid_consumer_press(uint16_t usage);
+uint8_t hid_consumer_release(void);
+uint8_t hid_system_press(uint8_t usage);
+uint8_t hid_system_release(uint8_t usage);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HID_CONTROLS_H */
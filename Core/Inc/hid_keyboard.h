@@ -0,0 +1,92 @@
+/**
+  ******************************************************************************
+  * @file           : hid_keyboard.h
+  * @brief          : Key state bitmap to HID keyboard report encoders
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __HID_KEYBOARD_H
+#define __HID_KEYBOARD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Report protocol selects the NKRO report when set, the 5-key report ID 1 otherwise */
+#ifndef HID_KBD_NKRO_ENABLED
+#define HID_KBD_NKRO_ENABLED        1U
+#endif /* HID_KBD_NKRO_ENABLED */
+
+#define HID_KBD_PROTOCOL_BOOT       0U
+#define HID_KBD_PROTOCOL_REPORT     1U
+
+#define HID_KBD_6KRO_REPORT_ID      0x01U
+#define HID_KBD_6KRO_REPORT_SIZE    8U    /* report ID, modifiers, OEM, 5 keycodes */
+#define HID_KBD_6KRO_KEYCODES       5U
+
+#define HID_KBD_BOOT_REPORT_SIZE    8U    /* modifiers, reserved, 6 keycodes */
+#define HID_KBD_BOOT_KEYCODES       6U
+
+#define HID_KBD_NKRO_REPORT_ID      0x06U
+#define HID_KBD_NKRO_BITMAP_SIZE    29U   /* usages 0x00..0xE7, one bit each */
+#define HID_KBD_NKRO_REPORT_SIZE    (1U + HID_KBD_NKRO_BITMAP_SIZE)
+
+#define HID_KBD_MAX_REPORT_SIZE     HID_KBD_NKRO_REPORT_SIZE
+
+#define HID_USAGE_ERROR_ROLLOVER    0x01U
+#define HID_USAGE_FIRST_KEY         0x04U
+#define HID_USAGE_MODIFIER_FIRST    0xE0U
+#define HID_USAGE_MODIFIER_LAST     0xE7U
+
+/* LED output report bits (LED page usages 1 to 5) */
+#define HID_KBD_LED_NUM_LOCK        0x01U
+#define HID_KBD_LED_CAPS_LOCK       0x02U
+#define HID_KBD_LED_SCROLL_LOCK     0x04U
+#define HID_KBD_LED_COMPOSE         0x08U
+#define HID_KBD_LED_KANA            0x10U
+
+/* Exported types ------------------------------------------------------------*/
+/* One bit per Keyboard/Keypad page usage: bit n of the bitmap is usage n */
+typedef struct
+{
+  uint32_t bits[8];
+} hid_key_state_t;
+
+/* Exported functions --------------------------------------------------------*/
+/**
+  * @brief  Set or clear one usage in a key state bitmap.
+  * @param  state: key state bitmap
+  * @param  usage: Keyboard/Keypad page usage
+  * @param  pressed: new state of the usage
+  * @retval None
+  */
+static inline void hid_key_state_set(hid_key_state_t *state, uint8_t usage, uint8_t pressed)
+{
+  uint32_t mask = 1UL << (usage & 0x1FU);
+
+  if (pressed != 0U)
+  {
+    state->bits[usage >> 5] |= mask;
+  }
+  else
+  {
+    state->bits[usage >> 5] &= ~mask;
+  }
+}
+
+void     hid_key_state_clear(hid_key_state_t *state);
+uint16_t hid_kbd_encode_nkro(const hid_key_state_t *state, uint8_t *report);
+uint16_t hid_kbd_encode_6kro(const hid_key_state_t *state, uint8_t *report);
+uint16_t hid_kbd_encode_boot(const hid_key_state_t *state, uint8_t *report);
+uint16_t hid_kbd_encode(const hid_key_state_t *state, uint8_t protocol, uint8_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __HID_KEYBOARD_H */
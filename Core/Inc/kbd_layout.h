@@ -0,0 +1,69 @@
+/**
+  ******************************************************************************
+  * @file           : kbd_layout.h
+  * @brief          : Character to keystroke layout tables
+  ******************************************************************************
+  * A keystroke is the Keyboard/Keypad page usage of one key and the modifiers
+  * held while it is pressed, so that the host's keyboard layout turns it back
+  * into the character. A character may take two keystrokes: a dead key, then
+  * the key it combines with. The host must be set to the same layout.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __KBD_LAYOUT_H
+#define __KBD_LAYOUT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Modifier bits, in the order of usages 0xE0 to 0xE7 */
+#define KBD_MOD_LCTRL             0x01U
+#define KBD_MOD_LSHIFT            0x02U
+#define KBD_MOD_LALT              0x04U
+#define KBD_MOD_LGUI              0x08U
+#define KBD_MOD_RCTRL             0x10U
+#define KBD_MOD_RSHIFT            0x20U
+#define KBD_MOD_RALT              0x40U   /* AltGr on the ISO layouts */
+#define KBD_MOD_RGUI              0x80U
+
+/* Keystrokes of one character at most: dead key and base key */
+#define KBD_STROKES_MAX           2U
+
+/* Layout the typing engine starts with */
+#ifndef KBD_LAYOUT_DEFAULT
+#define KBD_LAYOUT_DEFAULT        KBD_LAYOUT_US
+#endif /* KBD_LAYOUT_DEFAULT */
+
+/* Exported types ------------------------------------------------------------*/
+/* Host keyboard layouts, matching the Linux xkb "us", "gb", "de" and "fr" */
+typedef enum
+{
+  KBD_LAYOUT_US = 0U,
+  KBD_LAYOUT_UK,
+  KBD_LAYOUT_DE,
+  KBD_LAYOUT_FR,
+  KBD_LAYOUT_COUNT
+} kbd_layout_id_t;
+
+typedef struct
+{
+  uint8_t usage;                  /* Keyboard/Keypad page usage */
+  uint8_t modifiers;              /* KBD_MOD_xxx held with the key */
+  uint8_t caps;                   /* 1 when Caps Lock swaps the shift state */
+} kbd_stroke_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint8_t kbd_layout_lookup(uint8_t layout, uint32_t codepoint, kbd_stroke_t *strokes);
+const char *kbd_layout_name(uint8_t layout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __KBD_LAYOUT_H */
@@ -0,0 +1,44 @@
+/**
+  ******************************************************************************
+  * @file           : key_events.h
+  * @brief          : ISR-safe queue of timestamped key edges
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __KEY_EVENTS_H
+#define __KEY_EVENTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Number of edges that can wait for the main loop, must be a power of two */
+#ifndef KEY_EVENT_QUEUE_SIZE
+#define KEY_EVENT_QUEUE_SIZE      64U
+#endif /* KEY_EVENT_QUEUE_SIZE */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t timestamp;   /* DWT cycle count of the capture: the EXTI edge or the matrix scan */
+  uint8_t  key;         /* index in the raw key bitmap */
+  uint8_t  pressed;     /* 1: key went down, 0: key went up */
+} key_event_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void     key_events_init(void);
+uint8_t  key_events_push(uint8_t key, uint8_t pressed, uint32_t timestamp);
+uint8_t  key_events_pop(key_event_t *event);
+void     key_events_flush(void);
+uint32_t key_events_dropped(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __KEY_EVENTS_H */
@@ -0,0 +1,42 @@
+/**
+  ******************************************************************************
+  * @file           : keyboard.h
+  * @brief          : Key capture to HID report pipeline
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __KEYBOARD_H
+#define __KEYBOARD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "debounce.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Debounce time, converted to matrix scans */
+#ifndef KEYBOARD_DEBOUNCE_MS
+#define KEYBOARD_DEBOUNCE_MS      5U
+#endif /* KEYBOARD_DEBOUNCE_MS */
+
+/* DEBOUNCE_EAGER, DEBOUNCE_DEFER or DEBOUNCE_INTEGRATOR */
+#ifndef KEYBOARD_DEBOUNCE_MODE
+#define KEYBOARD_DEBOUNCE_MODE    DEBOUNCE_EAGER
+#endif /* KEYBOARD_DEBOUNCE_MODE */
+
+/* Exported functions prototypes ---------------------------------------------*/
+void keyboard_init(void);
+void keyboard_task(void);
+void keyboard_gpio_edge(uint16_t gpio_pin);
+void keyboard_set_debounce(debounce_mode_t mode, uint8_t debounce_ms);
+uint8_t keyboard_get_leds(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __KEYBOARD_H */
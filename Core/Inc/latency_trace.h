@@ -0,0 +1,134 @@
+/**
+  ******************************************************************************
+  * @file           : latency_trace.h
+  * @brief          : Button to wire latency histograms from the DWT cycle counter
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __LATENCY_TRACE_H
+#define __LATENCY_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Bucket b counts intervals of 2^(b + SHIFT) to 2^(b + SHIFT + 1) - 1 cycles;
+   the first bucket also takes shorter ones, the last one longer ones */
+#define LATENCY_TRACE_BUCKETS         16U
+#ifndef LATENCY_TRACE_BUCKET_SHIFT
+#define LATENCY_TRACE_BUCKET_SHIFT    7U      /* 128 cycles, 1.3us at 96MHz */
+#endif /* LATENCY_TRACE_BUCKET_SHIFT */
+
+/* A trace not completed within this time is dropped */
+#define LATENCY_TRACE_TIMEOUT_MS      100U
+
+/* Vendor feature report (usage page 0xFF01), 31 data bytes after the ID:
+   SET [7][op][interval][first bucket]
+   GET [7][interval][first bucket][cycles per us][count32][min32][max32][8 x bucket16] */
+#define LATENCY_TRACE_REPORT_ID       0x07U
+#define LATENCY_TRACE_REPORT_SIZE     32U
+#define LATENCY_TRACE_REPORT_BUCKETS  8U
+
+/* Feature report operation byte (SET_REPORT) */
+#define LATENCY_TRACE_OP_SELECT       0x00U  /* select the histogram read by GET_REPORT */
+#define LATENCY_TRACE_OP_RESET        0x01U  /* clear every histogram */
+
+/* Exported types ------------------------------------------------------------*/
+/* Pipeline points, stamped in this order */
+typedef enum
+{
+  LATENCY_STAMP_EDGE       = 0x00U,   /* EXTI edge or matrix scan */
+  LATENCY_STAMP_DEBOUNCE   = 0x01U,   /* debounced change committed */
+  LATENCY_STAMP_ENCODE     = 0x02U,   /* report encoded */
+  LATENCY_STAMP_TRANSMIT   = 0x03U,   /* USBD_LL_Transmit() on the IN endpoint */
+  LATENCY_STAMP_COMPLETE   = 0x04U,   /* IN transfer completed to the host */
+  LATENCY_STAMPS           = 0x05U,
+} latency_stamp_t;
+
+/* Histogram n is stamp n to stamp n + 1, the last one is edge to complete */
+typedef enum
+{
+  LATENCY_INTERVAL_DEBOUNCE = 0x00U,
+  LATENCY_INTERVAL_ENCODE   = 0x01U,
+  LATENCY_INTERVAL_TRANSMIT = 0x02U,
+  LATENCY_INTERVAL_WIRE     = 0x03U,
+  LATENCY_INTERVAL_TOTAL    = 0x04U,
+  LATENCY_INTERVALS         = 0x05U,
+} latency_interval_t;
+
+/* Interrupt handlers timed from entry to exit */
+typedef enum
+{
+  LATENCY_ISR_USB           = 0x00U,   /* OTG_FS_IRQHandler */
+  LATENCY_ISR_SCAN          = 0x01U,   /* DMA2_Stream1_IRQHandler, the matrix scan */
+  LATENCY_ISRS              = 0x02U,
+} latency_isr_t;
+
+/* Enumeration stages, by the standard request that makes them; the host
+   fetches some descriptors more than once */
+typedef enum
+{
+  LATENCY_ENUM_RESET        = 0x00U,   /* bus reset */
+  LATENCY_ENUM_DEVICE       = 0x01U,   /* GET_DESCRIPTOR(Device) */
+  LATENCY_ENUM_ADDRESS      = 0x02U,   /* SET_ADDRESS */
+  LATENCY_ENUM_CONFIG_DESC  = 0x03U,   /* GET_DESCRIPTOR(Configuration) */
+  LATENCY_ENUM_STRING       = 0x04U,   /* GET_DESCRIPTOR(String) */
+  LATENCY_ENUM_CONFIGURE    = 0x05U,   /* SET_CONFIGURATION, USBD_STATE_CONFIGURED */
+  LATENCY_ENUM_OTHER        = 0x06U,   /* any other request before it */
+  LATENCY_ENUMS             = 0x07U,
+} latency_enum_t;
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t min;                               /* cycles */
+  uint32_t max;                               /* cycles */
+  uint16_t bucket[LATENCY_TRACE_BUCKETS];     /* saturating */
+} latency_hist_t;
+
+typedef struct
+{
+  uint32_t count;                             /* requests, or bus resets */
+  uint32_t first;                             /* cycles from the first reset to the start of the first one */
+  uint32_t last;                              /* to the end of the last one */
+  uint32_t cycles;                            /* device side processing, all of them */
+  uint32_t max;                               /* of the longest request, data stages included */
+} latency_enum_stage_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void latency_trace_init(void);
+void latency_trace_reset(void);
+void latency_trace_begin(uint32_t edge, uint32_t debounce);
+void latency_trace_stamp(latency_stamp_t stamp);
+void latency_trace_add(latency_hist_t *hist, uint32_t cycles);
+uint8_t latency_trace_bucket(uint32_t cycles);
+const latency_hist_t *latency_trace_get(latency_interval_t interval);
+void latency_trace_isr(latency_isr_t isr, uint32_t start);
+const latency_hist_t *latency_trace_get_isr(latency_isr_t isr);
+void latency_trace_enum_reset(uint32_t start);
+void latency_trace_enum_setup(const uint8_t *setup, uint32_t start);
+void latency_trace_enum_data(uint32_t start);
+const latency_enum_stage_t *latency_trace_get_enum(latency_enum_t stage);
+int8_t latency_trace_get_feature(uint8_t *report, uint16_t *len);
+int8_t latency_trace_set_feature(const uint8_t *report, uint16_t len);
+
+/**
+  * @brief  Current cycle count, call sites stamp with it.
+  * @retval DWT cycle counter
+  */
+static inline uint32_t latency_trace_now(void)
+{
+  return DWT->CYCCNT;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LATENCY_TRACE_H */
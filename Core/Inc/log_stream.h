@@ -0,0 +1,64 @@
+/**
+  ******************************************************************************
+  * @file           : log_stream.h
+  * @brief          : Lock-free log and metrics stream to the CDC console
+  ******************************************************************************
+  * Any context may write, thread or interrupt: a record is reserved with an
+  * LDREX/STREX loop on the ring head, filled, then published by its header
+  * word. A writer never waits: when the ring is full the record is dropped
+  * and counted. The only reader is the USB interrupt, which packs published
+  * records into CDC bulk IN packets and stops at the first one still being
+  * written.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __LOG_STREAM_H
+#define __LOG_STREAM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Ring size in 32-bit words, a power of two */
+#ifndef LOG_RING_WORDS
+#define LOG_RING_WORDS            512U
+#endif /* LOG_RING_WORDS */
+
+/* Longest record, one full-speed bulk packet; longer writes are split */
+#define LOG_RECORD_MAX            64U
+
+/* Longest formatted line, kept to one record so that lines never interleave */
+#define LOG_LINE_MAX              LOG_RECORD_MAX
+
+/* Metrics line period, 0 to disable */
+#ifndef LOG_METRICS_PERIOD_MS
+#define LOG_METRICS_PERIOD_MS     1000U
+#endif /* LOG_METRICS_PERIOD_MS */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t records;               /* records handed to the reader */
+  uint32_t bytes;                 /* payload bytes handed to the reader */
+  uint32_t dropped;               /* records lost to a full ring */
+} log_stats_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void log_init(void);
+uint32_t log_write(const void *data, uint32_t len);
+uint32_t log_printf(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+uint32_t log_line(const char *prefix, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+uint32_t log_read(uint8_t *buf, uint32_t max);
+void log_get_stats(log_stats_t *stats);
+void log_metrics_task(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LOG_STREAM_H */
@@ -0,0 +1,102 @@
+/**
+  ******************************************************************************
+  * @file           : macro.h
+  * @brief          : Macro playback from a compressed flash image
+  ******************************************************************************
+  * A macro is a bytecode program: key down/up/tap, delay, text and repeat.
+  * The macros are stored byte pair encoded in their own flash sector and
+  * decoded one byte at a time while they play, so RAM use does not depend on
+  * the size of a macro. The image is built on the host, see Simulator/.
+  *
+  * Image layout, little-endian:
+  *   macro_image_header_t
+  *   uint32_t offset[count + 1]   start of each macro stream, then the end
+  *   macro streams
+  * A byte b with bit b set in pair_used stands for the two bytes pair[b],
+  * each of which may stand for a pair again, up to MACRO_BPE_DEPTH levels.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MACRO_H
+#define __MACRO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "hid_keyboard.h"
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Bytecode; numbers are varints, 7 bits per byte, low bits first, 4 bytes at most */
+#define MACRO_OP_END              0x00U   /* release the keys, stop */
+#define MACRO_OP_DOWN             0x01U   /* usage */
+#define MACRO_OP_UP               0x02U   /* usage */
+#define MACRO_OP_TAP              0x03U   /* usage: down, then up in the next report */
+#define MACRO_OP_RELEASE          0x04U   /* every key the macro holds */
+#define MACRO_OP_DELAY            0x05U   /* ms */
+#define MACRO_OP_TEXT             0x06U   /* length, UTF-8 bytes typed by typing.c */
+#define MACRO_OP_REPEAT           0x07U   /* count >= 1, body up to the matching LOOP */
+#define MACRO_OP_LOOP             0x08U
+
+#define MACRO_IMAGE_MAGIC         0x3152434DUL    /* "MCR1" */
+#define MACRO_IMAGE_VERSION       1U
+#define MACRO_VARINT_MAX          4U
+
+/* Pair expansion stack, bytes */
+#ifndef MACRO_BPE_DEPTH
+#define MACRO_BPE_DEPTH           16U
+#endif /* MACRO_BPE_DEPTH */
+
+/* Nested REPEAT blocks */
+#ifndef MACRO_REPEAT_DEPTH
+#define MACRO_REPEAT_DEPTH        4U
+#endif /* MACRO_REPEAT_DEPTH */
+
+/* Operations run by one macro_step() before it gives the main loop back */
+#ifndef MACRO_OPS_PER_STEP
+#define MACRO_OPS_PER_STEP        16U
+#endif /* MACRO_OPS_PER_STEP */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t count;                 /* macros */
+  uint32_t size;                  /* image bytes, header included */
+  uint8_t  pair_used[32];         /* bit b set: byte b stands for pair[b] */
+  uint8_t  pair[256][2];
+} macro_image_header_t;
+
+typedef enum
+{
+  MACRO_OK        = 0x00U,
+  MACRO_ERR_IMAGE = 0x01U,        /* no valid image in the macro sector */
+  MACRO_ERR_INDEX = 0x02U,
+} macro_status_t;
+
+typedef struct
+{
+  uint32_t played;                /* macros started */
+  uint32_t faults;                /* macros stopped by malformed bytecode */
+  uint32_t ops;                   /* operations run */
+} macro_stats_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+macro_status_t macro_init(const uint8_t *image, uint32_t size);
+uint16_t macro_count(void);
+macro_status_t macro_play(uint16_t index);
+void macro_stop(void);
+uint8_t macro_busy(void);
+uint8_t macro_step(uint32_t now);
+const hid_key_state_t *macro_get_keys(void);
+void macro_get_stats(macro_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MACRO_H */
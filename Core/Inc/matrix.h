@@ -0,0 +1,68 @@
+/**
+  ******************************************************************************
+  * @file           : matrix.h
+  * @brief          : Key matrix geometry and port snapshot decoding
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MATRIX_H
+#define __MATRIX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Columns are strobed one at a time, rows are read together from one port */
+#ifndef MATRIX_COLS
+#define MATRIX_COLS               8U
+#endif /* MATRIX_COLS */
+
+#ifndef MATRIX_ROWS
+#define MATRIX_ROWS               8U
+#endif /* MATRIX_ROWS */
+
+/* Position of row 0 in the row port input data register, rows are contiguous */
+#ifndef MATRIX_ROW_SHIFT
+#define MATRIX_ROW_SHIFT          8U
+#endif /* MATRIX_ROW_SHIFT */
+
+#define MATRIX_ROW_MASK           ((1UL << MATRIX_ROWS) - 1UL)
+#define MATRIX_KEYS               (MATRIX_COLS * MATRIX_ROWS)
+#define MATRIX_WORDS              ((MATRIX_KEYS + 31U) / 32U)
+
+#if (MATRIX_ROWS > 16U) || ((MATRIX_ROW_SHIFT + MATRIX_ROWS) > 16U)
+#error "Matrix rows must fit in one 16-bit GPIO port"
+#endif /* MATRIX_ROWS */
+
+/* Exported types ------------------------------------------------------------*/
+/* Bit (col * MATRIX_ROWS + row) is set while the key at col/row is down */
+typedef struct
+{
+  uint32_t bits[MATRIX_WORDS];
+} matrix_bitmap_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint8_t matrix_decode(const uint16_t *samples, matrix_bitmap_t *state);
+uint8_t matrix_has_ghost(const uint16_t *samples);
+
+/**
+  * @brief  Test one key of a matrix bitmap.
+  * @param  state: matrix bitmap
+  * @param  key: col * MATRIX_ROWS + row
+  * @retval 1 if the key is down
+  */
+static inline uint8_t matrix_key_is_down(const matrix_bitmap_t *state, uint32_t key)
+{
+  return (uint8_t)((state->bits[key >> 5] >> (key & 0x1FU)) & 1U);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MATRIX_H */
@@ -0,0 +1,55 @@
+/**
+  ******************************************************************************
+  * @file           : matrix_scan.h
+  * @brief          : Timer and DMA driven key matrix scanner
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __MATRIX_SCAN_H
+#define __MATRIX_SCAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "matrix.h"
+#include "main.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Full matrix scans per second */
+#ifndef MATRIX_SCAN_HZ
+#define MATRIX_SCAN_HZ            8000U
+#endif /* MATRIX_SCAN_HZ */
+
+/* Delay from column strobe to row sampling, in percent of a strobe period */
+#ifndef MATRIX_SETTLE_PERCENT
+#define MATRIX_SETTLE_PERCENT     75U
+#endif /* MATRIX_SETTLE_PERCENT */
+
+/* Rows: MATRIX_ROWS contiguous inputs with pull-up, from MATRIX_ROW_SHIFT */
+#define MATRIX_ROW_PORT           GPIOE
+/* Columns: open-drain outputs, pulled low one at a time */
+#define MATRIX_COL_PORT           GPIOD
+#define MATRIX_COL_PINS           { GPIO_PIN_0, GPIO_PIN_1, GPIO_PIN_2, GPIO_PIN_3, \
+                                    GPIO_PIN_6, GPIO_PIN_7, GPIO_PIN_8, GPIO_PIN_9 }
+
+/* Exported variables --------------------------------------------------------*/
+extern DMA_HandleTypeDef hdma_tim1_ch1;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void matrix_scan_init(void);
+void matrix_scan_start(void);
+void matrix_scan_stop(void);
+void matrix_scan_wake_arm(void);
+void matrix_scan_wake_disarm(void);
+const matrix_bitmap_t *matrix_scan_get_state(void);
+uint32_t matrix_scan_get_count(void);
+void matrix_scan_complete_callback(const matrix_bitmap_t *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MATRIX_SCAN_H */
@@ -0,0 +1,68 @@
+/**
+  ******************************************************************************
+  * @file           : typing.h
+  * @brief          : UTF-8 text to keystroke typing engine
+  ******************************************************************************
+  * Text written to the engine is typed as fast as the host takes reports:
+  * keyboard_task() asks for one step whenever the HID IN queue is short, and
+  * each step is one report. Keys stay down while the next characters are
+  * pressed, so most characters cost a single report; the held keys are
+  * released when a character needs a key already down, other modifiers, or
+  * when the rollover limit is reached.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TYPING_H
+#define __TYPING_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "hid_keyboard.h"
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Text buffer in bytes, a power of two */
+#ifndef TYPING_BUFFER_SIZE
+#define TYPING_BUFFER_SIZE        256U
+#endif /* TYPING_BUFFER_SIZE */
+
+/* Typed keys held at once under the report protocol; boot allows 6 */
+#ifndef TYPING_ROLLOVER_MAX
+#define TYPING_ROLLOVER_MAX       6U
+#endif /* TYPING_ROLLOVER_MAX */
+
+/* Reports allowed in the HID IN queue when the next step is taken: one on
+   the wire and one ready for the next poll keeps every interval busy */
+#ifndef TYPING_QUEUE_AHEAD
+#define TYPING_QUEUE_AHEAD        1U
+#endif /* TYPING_QUEUE_AHEAD */
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t chars;                 /* characters typed */
+  uint32_t reports;               /* steps that changed the typed keys */
+  uint32_t unmapped;              /* characters the layout cannot type, skipped */
+  uint32_t invalid;               /* malformed UTF-8 sequences, skipped */
+} typing_stats_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void typing_init(void);
+uint32_t typing_write(const void *data, uint32_t len);
+uint32_t typing_free(void);
+uint8_t typing_busy(void);
+uint8_t typing_step(uint8_t max_keys, uint8_t leds);
+void typing_set_layout(uint8_t layout);
+uint8_t typing_get_layout(void);
+const hid_key_state_t *typing_get_keys(void);
+void typing_get_stats(typing_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TYPING_H */
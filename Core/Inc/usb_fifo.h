@@ -0,0 +1,65 @@
+/**
+  ******************************************************************************
+  * @file           : usb_fifo.h
+  * @brief          : OTG_FS FIFO RAM allocation from the endpoint descriptors
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_FIFO_H
+#define __USB_FIFO_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_def.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* OTG_FS FIFO RAM, in 32-bit words: 1.25 KB */
+#define USB_FIFO_WORDS            320U
+/* OTG_FS device endpoints, EP0 included: one TX FIFO each */
+#define USB_FIFO_EPS              4U
+/* Smallest TX FIFO, also given to an unused one below the last used (RM0383) */
+#define USB_FIFO_TX_MIN           16U
+/* Packets a bulk or isochronous IN FIFO holds: one on the wire, one queued */
+#define USB_FIFO_STREAM_PACKETS   2U
+
+/* 1: at start-up, log the cycles USB_WritePacket() and USB_ReadPacket() take
+   against the word loops they had before, see usb_fifo_bench() */
+#ifndef USB_FIFO_BENCH
+#define USB_FIFO_BENCH            0U
+#endif /* USB_FIFO_BENCH */
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  USB_FIFO_OK             = 0x00U,
+  USB_FIFO_BAD_DESCRIPTOR = 0x01U,   /* configuration descriptor malformed or missing */
+  USB_FIFO_BAD_ENDPOINT   = 0x02U,   /* endpoint number or packet size the core cannot take */
+  USB_FIFO_FULL           = 0x03U,   /* the FIFOs do not fit in USB_FIFO_WORDS */
+} usb_fifo_status_t;
+
+typedef struct
+{
+  uint16_t rx_words;                 /* shared RX FIFO, at offset 0 */
+  uint16_t rx_packet;                /* largest OUT packet, EP0 included, in bytes */
+  uint8_t  tx_count;                 /* TX FIFOs to configure: last IN endpoint + 1 */
+  uint16_t tx_words[USB_FIFO_EPS];   /* TX FIFO of each IN endpoint number */
+  uint16_t tx_offset[USB_FIFO_EPS];  /* in words, as HAL_PCDEx_SetTxFiFo() places them */
+  uint16_t used_words;
+} usb_fifo_plan_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+usb_fifo_status_t usb_fifo_plan(const uint8_t *config, uint16_t len, uint8_t ep0_mps, usb_fifo_plan_t *plan);
+usb_fifo_status_t usb_fifo_plan_device(USBD_HandleTypeDef *pdev, usb_fifo_plan_t *plan);
+#if (USB_FIFO_BENCH == 1U)
+void usb_fifo_bench(void);
+#endif /* USB_FIFO_BENCH */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USB_FIFO_H */
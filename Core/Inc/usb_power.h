@@ -0,0 +1,64 @@
+/**
+  ******************************************************************************
+  * @file           : usb_power.h
+  * @brief          : USB suspend, STOP mode and remote wakeup
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USB_POWER_H
+#define __USB_POWER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Resume signalling driven for a remote wakeup, 1 to 15 ms on the bus (USB 2.0 7.1.7.7) */
+#ifndef USB_POWER_SIGNAL_MS
+#define USB_POWER_SIGNAL_MS       10U
+#endif /* USB_POWER_SIGNAL_MS */
+
+/* Bus idle after the suspend interrupt (itself 3 ms of idle) before a remote
+   wakeup may start: 5 ms of idle in all */
+#define USB_POWER_IDLE_MS         2U
+
+#if (USB_POWER_SIGNAL_MS < 2U) || (USB_POWER_SIGNAL_MS > 15U)
+#error "USB_POWER_SIGNAL_MS must be 2 to 15 ms: the tick may start late by up to 1 ms"
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  USB_POWER_ACTIVE     = 0x00U,   /* bus running, keys scanned */
+  USB_POWER_SUSPENDED  = 0x01U,   /* scanner stopped, STOP mode until a wake event */
+  USB_POWER_WAKEUP     = 0x02U,   /* key pressed, waiting for the bus idle time */
+  USB_POWER_SIGNALLING = 0x03U,   /* driving resume signalling */
+} usb_power_state_t;
+
+typedef struct
+{
+  uint32_t suspends;
+  uint32_t resumes;               /* resumed by the host */
+  uint32_t remote_wakeups;        /* resumed by a key */
+  uint32_t stops;                 /* STOP mode entries */
+  uint32_t ignored_wakes;         /* keys pressed while remote wakeup was disabled */
+} usb_power_stats_t;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void usb_power_init(void);
+usb_power_state_t usb_power_task(void);
+void usb_power_suspend(void);
+void usb_power_resume(void);
+void usb_power_key_wake(void);
+usb_power_state_t usb_power_get_state(void);
+void usb_power_get_stats(usb_power_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USB_POWER_H */
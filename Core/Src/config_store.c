@@ -0,0 +1,471 @@
+/**
+  ******************************************************************************
+  * @file           : config_store.c
+  * @brief          : Log-structured key/value store in two flash sectors
+  ******************************************************************************
+  * Power-fail safety follows from the order of the flash writes:
+  *
+  *  - A record is programmed header first and CRC last, so a record cut
+  *    short fails its CRC. Records are only ever appended, so only the last
+  *    one can be cut short; the mount stops there and compacts.
+  *  - Compaction erases the other sector, copies the live values into it,
+  *    then programs its sequence number and, last, its magic. Until the
+  *    magic is whole the old sector is the only valid one; after it, both
+  *    are and the higher sequence number wins.
+  *  - A valid sector is invalidated by programming its magic to 0 before it
+  *    is erased, so a torn erase cannot bring an old sector back.
+  *
+  * The value being written when the power fails is therefore either the
+  * old or the new one after the next mount, and every other value is kept.
+  * A write updates the RAM copy first, and when the active sector is full
+  * the compaction carries the new value, so each compaction costs one erase
+  * and the sectors take turns.
+  *
+  * Main loop only. The CPU stalls on flash reads while a sector is erased,
+  * up to 2 s for 128 KB, interrupts included; that happens once per
+  * compaction. CRC-32 is computed in software so that the host build reads
+  * the same records.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "config_store.h"
+#include "main.h"
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t words[CONFIG_STORE_VALUE_MAX / 4U];
+  uint8_t  len;                   /* 0 when the key has no value */
+} config_store_value_t;
+
+/* Private define ------------------------------------------------------------*/
+#define CONFIG_STORE_WORDS        (CONFIG_STORE_SECTOR_SIZE / 4U)
+#define CONFIG_STORE_FIRST_RECORD 2U            /* after magic and sequence */
+#define CONFIG_STORE_ERASED       0xFFFFFFFFUL
+#define CONFIG_STORE_TAG          0x5AA50000UL
+#define CONFIG_STORE_TAG_MASK     0xFFFF0000UL
+#define CONFIG_STORE_RECORD_MAX   (2U + (CONFIG_STORE_VALUE_MAX / 4U))
+
+/* Private variables ---------------------------------------------------------*/
+static config_store_value_t store_cache[CONFIG_STORE_KEYS];
+static uint8_t  store_active;                 /* sector holding the log, 0 or 1 */
+static uint32_t store_sequence;
+static uint32_t store_pos;                    /* next free word of the active sector */
+static uint8_t  store_dirty;                  /* not erased past store_pos: compact before appending */
+static config_store_stats_t store_stats;
+
+static const uint32_t store_crc_table[16] =
+{
+  0x00000000UL, 0x1DB71064UL, 0x3B6E20C8UL, 0x26D930ACUL, 0x76DC4190UL, 0x6B6B51F4UL, 0x4DB26158UL, 0x5005713CUL,
+  0xEDB88320UL, 0xF00F9344UL, 0xD6D6A3E8UL, 0xCB61B38CUL, 0x9B64C2B0UL, 0x86D3D2D4UL, 0xA00AE278UL, 0xBDBDF21CUL,
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static const uint32_t *config_store_sector(uint8_t sector);
+static uint32_t config_store_record_words(uint32_t header);
+static uint32_t config_store_crc(const uint32_t *words, uint32_t count);
+static config_store_status_t config_store_append(uint8_t key);
+static config_store_status_t config_store_compact(void);
+static uint8_t config_store_write_record(uint8_t sector, uint32_t pos, uint8_t key);
+static uint8_t config_store_program(uint8_t sector, uint32_t pos, uint32_t word);
+static uint8_t config_store_erase(uint8_t sector);
+
+/**
+  * @brief  Mount the store: pick the active sector, replay its log into RAM
+  *         and recover from an interrupted write.
+  * @note   Formats the store when neither sector holds one.
+  * @retval CONFIG_STORE_OK or CONFIG_STORE_ERR_FLASH
+  */
+config_store_status_t config_store_init(void)
+{
+  const uint32_t *sector[2] = { config_store_sector(0U), config_store_sector(1U) };
+  const uint32_t *log;
+  config_store_value_t *value;
+  uint8_t valid[2];
+  uint32_t header;
+  uint32_t words;
+  uint32_t pos;
+  uint8_t key;
+
+  (void)memset(store_cache, 0, sizeof(store_cache));
+  (void)memset(&store_stats, 0, sizeof(store_stats));
+  store_dirty = 0U;
+
+  valid[0] = (sector[0][0] == CONFIG_STORE_MAGIC) ? 1U : 0U;
+  valid[1] = (sector[1][0] == CONFIG_STORE_MAGIC) ? 1U : 0U;
+
+  if ((valid[0] == 0U) && (valid[1] == 0U))
+  {
+    /* Empty store, written to sector 0 */
+    store_active = 1U;
+    store_sequence = 0U;
+    return config_store_compact();
+  }
+
+  if ((valid[0] != 0U) && (valid[1] != 0U))
+  {
+    store_active = ((int32_t)(sector[1][1] - sector[0][1]) > 0) ? 1U : 0U;
+  }
+  else
+  {
+    store_active = valid[1];
+  }
+  log = sector[store_active];
+  store_sequence = log[1];
+
+  for (pos = CONFIG_STORE_FIRST_RECORD; pos < CONFIG_STORE_WORDS; pos += words)
+  {
+    header = log[pos];
+    if (header == CONFIG_STORE_ERASED)
+    {
+      break;
+    }
+
+    words = config_store_record_words(header);
+    if ((words == 0U) || ((pos + words) > CONFIG_STORE_WORDS) ||
+        (config_store_crc(&log[pos], words - 1U) != log[pos + words - 1U]))
+    {
+      store_dirty = 1U;
+      break;
+    }
+
+    key = (uint8_t)header;
+    value = &store_cache[key];
+    value->len = (uint8_t)(header >> 8);
+    (void)memcpy(value->words, &log[pos + 1U], (uint32_t)value->len);
+  }
+  store_pos = pos;
+
+  /* Anything programmed past the log is a record cut short */
+  for (; (store_dirty == 0U) && (pos < CONFIG_STORE_WORDS); pos++)
+  {
+    store_dirty = (log[pos] != CONFIG_STORE_ERASED) ? 1U : 0U;
+  }
+
+  if (store_dirty != 0U)
+  {
+    store_stats.recovered++;
+    return config_store_compact();
+  }
+
+  return CONFIG_STORE_OK;
+}
+
+/**
+  * @brief  Read a value from the RAM copy.
+  * @param  key: 0 to CONFIG_STORE_KEYS - 1
+  * @param  value: receives the value
+  * @param  len: buffer size in, value length out
+  * @retval CONFIG_STORE_OK, CONFIG_STORE_ERR_KEY, CONFIG_STORE_ERR_MISSING
+  *         or CONFIG_STORE_ERR_LEN when the buffer is too small
+  */
+config_store_status_t config_store_get(uint8_t key, void *value, uint8_t *len)
+{
+  const config_store_value_t *cached;
+
+  if (key >= CONFIG_STORE_KEYS)
+  {
+    return CONFIG_STORE_ERR_KEY;
+  }
+
+  cached = &store_cache[key];
+  if (cached->len == 0U)
+  {
+    return CONFIG_STORE_ERR_MISSING;
+  }
+  if (*len < cached->len)
+  {
+    return CONFIG_STORE_ERR_LEN;
+  }
+
+  (void)memcpy(value, cached->words, cached->len);
+  *len = cached->len;
+
+  return CONFIG_STORE_OK;
+}
+
+/**
+  * @brief  Store a value, unless it is the one already stored.
+  * @param  key: 0 to CONFIG_STORE_KEYS - 1
+  * @param  value: value bytes
+  * @param  len: 1 to CONFIG_STORE_VALUE_MAX
+  * @retval CONFIG_STORE_OK, CONFIG_STORE_ERR_KEY, CONFIG_STORE_ERR_LEN or
+  *         CONFIG_STORE_ERR_FLASH; the value reads back from RAM even then
+  */
+config_store_status_t config_store_set(uint8_t key, const void *value, uint8_t len)
+{
+  config_store_value_t *cached;
+
+  if (key >= CONFIG_STORE_KEYS)
+  {
+    return CONFIG_STORE_ERR_KEY;
+  }
+  if ((len == 0U) || (len > CONFIG_STORE_VALUE_MAX))
+  {
+    return CONFIG_STORE_ERR_LEN;
+  }
+
+  cached = &store_cache[key];
+  if ((cached->len == len) && (memcmp(cached->words, value, len) == 0))
+  {
+    store_stats.unchanged++;
+    return CONFIG_STORE_OK;
+  }
+
+  (void)memset(cached->words, 0xFF, sizeof(cached->words));
+  (void)memcpy(cached->words, value, len);
+  cached->len = len;
+
+  return config_store_append(key);
+}
+
+/**
+  * @brief  Remove a value.
+  * @param  key: 0 to CONFIG_STORE_KEYS - 1
+  * @retval CONFIG_STORE_OK, CONFIG_STORE_ERR_KEY, CONFIG_STORE_ERR_MISSING or
+  *         CONFIG_STORE_ERR_FLASH
+  */
+config_store_status_t config_store_delete(uint8_t key)
+{
+  if (key >= CONFIG_STORE_KEYS)
+  {
+    return CONFIG_STORE_ERR_KEY;
+  }
+  if (store_cache[key].len == 0U)
+  {
+    return CONFIG_STORE_ERR_MISSING;
+  }
+
+  store_cache[key].len = 0U;
+
+  return config_store_append(key);
+}
+
+/**
+  * @brief  Store statistics since the last mount.
+  * @param  stats: filled with the counters
+  * @retval None
+  */
+void config_store_get_stats(config_store_stats_t *stats)
+{
+  *stats = store_stats;
+}
+
+/**
+  * @brief  First word of a store sector.
+  * @param  sector: 0 or 1
+  * @retval sector contents
+  */
+static const uint32_t *config_store_sector(uint8_t sector)
+{
+  return (const uint32_t *)(CONFIG_STORE_ADDR + ((uint32_t)sector * CONFIG_STORE_SECTOR_SIZE));
+}
+
+/**
+  * @brief  Size of a record from its header.
+  * @param  header: first word of the record
+  * @retval words including header and CRC, 0 when the header is malformed
+  */
+static uint32_t config_store_record_words(uint32_t header)
+{
+  uint32_t len = (header >> 8) & 0xFFU;
+
+  if (((header & CONFIG_STORE_TAG_MASK) != CONFIG_STORE_TAG) || ((header & 0xFFU) >= CONFIG_STORE_KEYS) ||
+      (len > CONFIG_STORE_VALUE_MAX))
+  {
+    return 0U;
+  }
+
+  return 2U + ((len + 3U) / 4U);
+}
+
+/**
+  * @brief  CRC-32 (IEEE 802.3) of little-endian words, four bits at a time.
+  * @param  words: data
+  * @param  count: words
+  * @retval CRC
+  */
+static uint32_t config_store_crc(const uint32_t *words, uint32_t count)
+{
+  uint32_t crc = 0xFFFFFFFFUL;
+  uint32_t word;
+  uint32_t i;
+  uint32_t n;
+
+  for (i = 0U; i < count; i++)
+  {
+    word = words[i];
+    for (n = 0U; n < 8U; n++)
+    {
+      crc = (crc >> 4) ^ store_crc_table[(crc ^ word) & 0x0FU];
+      word >>= 4;
+    }
+  }
+
+  return ~crc;
+}
+
+/**
+  * @brief  Append the RAM copy of a key, compacting first when it does not fit.
+  * @param  key: key already updated in store_cache
+  * @retval CONFIG_STORE_OK or CONFIG_STORE_ERR_FLASH
+  */
+static config_store_status_t config_store_append(uint8_t key)
+{
+  uint32_t words = 2U + (((uint32_t)store_cache[key].len + 3U) / 4U);
+
+  store_stats.writes++;
+  store_stats.value_bytes += store_cache[key].len;
+
+  /* The compaction copies the new value along with the others */
+  if ((store_dirty != 0U) || ((store_pos + words) > CONFIG_STORE_WORDS))
+  {
+    return config_store_compact();
+  }
+
+  if (config_store_write_record(store_active, store_pos, key) == 0U)
+  {
+    /* The record may be half written: copy everything elsewhere before the next write */
+    store_dirty = 1U;
+    return CONFIG_STORE_ERR_FLASH;
+  }
+  store_pos += words;
+
+  return CONFIG_STORE_OK;
+}
+
+/**
+  * @brief  Copy every live value into the other sector and make it active.
+  * @retval CONFIG_STORE_OK or CONFIG_STORE_ERR_FLASH, the active sector is
+  *         unchanged then and store_dirty is set
+  */
+static config_store_status_t config_store_compact(void)
+{
+  uint8_t target = store_active ^ 1U;
+  const uint32_t *sector = config_store_sector(target);
+  uint32_t pos;
+  uint32_t key;
+
+  store_dirty = 1U;
+  store_stats.compactions++;
+
+  /* Invalidate, then erase unless already blank */
+  if ((sector[0] == CONFIG_STORE_MAGIC) && (config_store_program(target, 0U, 0U) == 0U))
+  {
+    return CONFIG_STORE_ERR_FLASH;
+  }
+  for (pos = 0U; (pos < CONFIG_STORE_WORDS) && (sector[pos] == CONFIG_STORE_ERASED); pos++)
+  {
+  }
+  if ((pos != CONFIG_STORE_WORDS) && (config_store_erase(target) == 0U))
+  {
+    return CONFIG_STORE_ERR_FLASH;
+  }
+
+  pos = CONFIG_STORE_FIRST_RECORD;
+  for (key = 0U; key < CONFIG_STORE_KEYS; key++)
+  {
+    if (store_cache[key].len == 0U)
+    {
+      continue;
+    }
+    if (config_store_write_record(target, pos, (uint8_t)key) == 0U)
+    {
+      return CONFIG_STORE_ERR_FLASH;
+    }
+    pos += 2U + (((uint32_t)store_cache[key].len + 3U) / 4U);
+  }
+
+  /* The magic commits the sector */
+  if ((config_store_program(target, 1U, store_sequence + 1U) == 0U) ||
+      (config_store_program(target, 0U, CONFIG_STORE_MAGIC) == 0U))
+  {
+    return CONFIG_STORE_ERR_FLASH;
+  }
+
+  store_active = target;
+  store_sequence++;
+  store_pos = pos;
+  store_dirty = 0U;
+
+  return CONFIG_STORE_OK;
+}
+
+/**
+  * @brief  Program the record of a key from its RAM copy, CRC last.
+  * @param  sector: 0 or 1
+  * @param  pos: word offset of the record
+  * @param  key: key to write, a deletion when its length is 0
+  * @retval 1 on success
+  */
+static uint8_t config_store_write_record(uint8_t sector, uint32_t pos, uint8_t key)
+{
+  const config_store_value_t *cached = &store_cache[key];
+  uint32_t record[CONFIG_STORE_RECORD_MAX];
+  uint32_t words = 2U + (((uint32_t)cached->len + 3U) / 4U);
+  uint32_t i;
+
+  record[0] = CONFIG_STORE_TAG | ((uint32_t)cached->len << 8) | key;
+  (void)memcpy(&record[1], cached->words, (words - 2U) * 4U);
+  record[words - 1U] = config_store_crc(record, words - 1U);
+
+  for (i = 0U; i < words; i++)
+  {
+    if (config_store_program(sector, pos + i, record[i]) == 0U)
+    {
+      return 0U;
+    }
+  }
+
+  return 1U;
+}
+
+/**
+  * @brief  Program one word and read it back.
+  * @param  sector: 0 or 1
+  * @param  pos: word offset
+  * @param  word: value
+  * @retval 1 on success
+  */
+static uint8_t config_store_program(uint8_t sector, uint32_t pos, uint32_t word)
+{
+  uint32_t addr = CONFIG_STORE_ADDR + ((uint32_t)sector * CONFIG_STORE_SECTOR_SIZE) + (pos * 4U);
+  HAL_StatusTypeDef status;
+
+  (void)HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
+                         FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+  status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_WORD, addr, word);
+  (void)HAL_FLASH_Lock();
+  store_stats.programmed += 4U;
+
+  return ((status == HAL_OK) && (((const volatile uint32_t *)config_store_sector(sector))[pos] == word)) ? 1U : 0U;
+}
+
+/**
+  * @brief  Erase a store sector.
+  * @param  sector: 0 or 1
+  * @retval 1 on success
+  */
+static uint8_t config_store_erase(uint8_t sector)
+{
+  FLASH_EraseInitTypeDef erase = {0};
+  uint32_t error = 0U;
+  HAL_StatusTypeDef status;
+
+  erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+  erase.Sector = CONFIG_STORE_FIRST_SECTOR + sector;
+  erase.NbSectors = 1U;
+  erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;
+
+  (void)HAL_FLASH_Unlock();
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_EOP | FLASH_FLAG_OPERR | FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR |
+                         FLASH_FLAG_PGPERR | FLASH_FLAG_PGSERR);
+  status = HAL_FLASHEx_Erase(&erase, &error);
+  (void)HAL_FLASH_Lock();
+  store_stats.erases[sector]++;
+
+  return ((status == HAL_OK) && (error == 0xFFFFFFFFUL)) ? 1U : 0U;
+}
@@ -0,0 +1,270 @@
+/**
+  ******************************************************************************
+  * @file           : debounce.c
+  * @brief          : Bit-sliced key debouncer working on whole key bitmaps
+  ******************************************************************************
+  * Every key has a small counter. The counters are stored bit-sliced: plane i
+  * holds bit i of the counters of 32 keys, so incrementing, clearing or
+  * comparing the counters of 32 keys costs a few word operations per plane,
+  * and one scan costs the same whatever the number of keys moving.
+  *
+  * The eager mode is eager on press only: a press reaches the host in the
+  * scan that saw it, while a release must be stable for the threshold like in
+  * the deferred mode. A held key that reads up for a scan or two, from a
+  * worn contact or noise on the matrix lines, then does not drop out, and
+  * the release bounce ends well within the threshold anyway.
+  *
+  * Thresholds are counted in scans and do not depend on the scan rate. This
+  * file has no hardware dependency.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "debounce.h"
+
+/* Private define ------------------------------------------------------------*/
+#if (DEBOUNCE_COUNTER_BITS == 0U) || (DEBOUNCE_COUNTER_BITS > 8U)
+#error "DEBOUNCE_COUNTER_BITS must be 1 to 8"
+#endif /* DEBOUNCE_COUNTER_BITS */
+
+/* Private function prototypes -----------------------------------------------*/
+static void debounce_counter_clear(debounce_t *db, uint32_t word, uint32_t mask);
+static void debounce_counter_load(debounce_t *db, uint32_t word, uint32_t mask, uint32_t value);
+static void debounce_counter_inc(debounce_t *db, uint32_t word, uint32_t mask);
+static void debounce_counter_dec(debounce_t *db, uint32_t word, uint32_t mask);
+static uint32_t debounce_counter_equals(const debounce_t *db, uint32_t word, uint32_t value);
+
+/**
+  * @brief  Start debouncing from a known key state.
+  * @param  db: debouncer
+  * @param  mode: algorithm
+  * @param  threshold: debounce time in scans, 1 to DEBOUNCE_COUNTER_MAX
+  * @param  raw: current key levels, DEBOUNCE_WORDS words
+  * @retval None
+  */
+void debounce_init(debounce_t *db, debounce_mode_t mode, uint8_t threshold, const uint32_t *raw)
+{
+  uint32_t word;
+
+  for (word = 0U; word < DEBOUNCE_WORDS; word++)
+  {
+    db->state[word] = raw[word];
+  }
+
+  debounce_configure(db, mode, threshold);
+}
+
+/**
+  * @brief  Change the algorithm or threshold, the debounced state is kept.
+  * @param  db: debouncer
+  * @param  mode: algorithm
+  * @param  threshold: debounce time in scans, clamped to 1..DEBOUNCE_COUNTER_MAX
+  * @retval None
+  */
+void debounce_configure(debounce_t *db, debounce_mode_t mode, uint8_t threshold)
+{
+  uint32_t word;
+
+  if (threshold == 0U)
+  {
+    threshold = 1U;
+  }
+  else if (threshold > DEBOUNCE_COUNTER_MAX)
+  {
+    threshold = (uint8_t)DEBOUNCE_COUNTER_MAX;
+  }
+
+  db->mode = (uint8_t)mode;
+  db->threshold = threshold;
+
+  for (word = 0U; word < DEBOUNCE_WORDS; word++)
+  {
+    db->locked[word] = 0U;
+    debounce_counter_clear(db, word, 0xFFFFFFFFU);
+
+    /* The integrator of a key that is down starts full */
+    if (mode == DEBOUNCE_INTEGRATOR)
+    {
+      debounce_counter_load(db, word, db->state[word], threshold);
+    }
+  }
+}
+
+/**
+  * @brief  Feed one scan of raw key levels.
+  * @param  db: debouncer
+  * @param  raw: sampled key levels, DEBOUNCE_WORDS words
+  * @param  changed: receives the keys whose debounced level flipped
+  * @retval 1 if any key changed
+  */
+uint8_t debounce_update(debounce_t *db, const uint32_t *raw, uint32_t *changed)
+{
+  uint32_t any = 0U;
+  uint32_t word;
+  uint32_t diff;
+  uint32_t done;
+  uint32_t press;
+  uint32_t full;
+  uint32_t empty;
+  uint32_t state;
+
+  for (word = 0U; word < DEBOUNCE_WORDS; word++)
+  {
+    switch (db->mode)
+    {
+      case DEBOUNCE_EAGER:
+        /* Age the lockouts, a key leaving lockout is re-read in the same scan */
+        debounce_counter_inc(db, word, db->locked[word]);
+        done = db->locked[word] & debounce_counter_equals(db, word, db->threshold);
+        debounce_counter_clear(db, word, done);
+        db->locked[word] &= ~done;
+
+        /* A press is taken at once, then the key is locked out */
+        diff = (raw[word] ^ db->state[word]) & ~db->locked[word];
+        press = diff & raw[word];
+        db->locked[word] |= press;
+
+        /* A release waits until the key has read up for threshold scans, as
+           in DEBOUNCE_DEFER; the counters of locked keys count the lockout */
+        diff &= ~raw[word];
+        debounce_counter_clear(db, word, ~diff & ~db->locked[word]);
+        debounce_counter_inc(db, word, diff);
+        done = diff & debounce_counter_equals(db, word, db->threshold);
+        debounce_counter_clear(db, word, done);
+        diff = press | done;
+        break;
+
+      case DEBOUNCE_DEFER:
+        /* Count the scans the raw level has differed, restart on a bounce back */
+        diff = raw[word] ^ db->state[word];
+        debounce_counter_clear(db, word, ~diff);
+        debounce_counter_inc(db, word, diff);
+        done = diff & debounce_counter_equals(db, word, db->threshold);
+        debounce_counter_clear(db, word, done);
+        diff = done;
+        break;
+
+      case DEBOUNCE_INTEGRATOR:
+      default:
+        full = debounce_counter_equals(db, word, db->threshold);
+        empty = debounce_counter_equals(db, word, 0U);
+        debounce_counter_inc(db, word, raw[word] & ~full);
+        debounce_counter_dec(db, word, ~raw[word] & ~empty);
+        full = debounce_counter_equals(db, word, db->threshold);
+        empty = debounce_counter_equals(db, word, 0U);
+        state = (db->state[word] | full) & ~empty;
+        diff = state ^ db->state[word];
+        break;
+    }
+
+    db->state[word] ^= diff;
+    changed[word] = diff;
+    any |= diff;
+  }
+
+  return (any != 0U) ? 1U : 0U;
+}
+
+/**
+  * @brief  Reset the counters of the selected keys to 0.
+  * @param  db: debouncer
+  * @param  word: bitmap word
+  * @param  mask: keys of the word
+  * @retval None
+  */
+static void debounce_counter_clear(debounce_t *db, uint32_t word, uint32_t mask)
+{
+  uint32_t plane;
+
+  for (plane = 0U; plane < DEBOUNCE_COUNTER_BITS; plane++)
+  {
+    db->count[plane][word] &= ~mask;
+  }
+}
+
+/**
+  * @brief  Set the counters of the selected keys to a value.
+  * @param  db: debouncer
+  * @param  word: bitmap word
+  * @param  mask: keys of the word
+  * @param  value: counter value
+  * @retval None
+  */
+static void debounce_counter_load(debounce_t *db, uint32_t word, uint32_t mask, uint32_t value)
+{
+  uint32_t plane;
+
+  for (plane = 0U; plane < DEBOUNCE_COUNTER_BITS; plane++)
+  {
+    if (((value >> plane) & 1U) != 0U)
+    {
+      db->count[plane][word] |= mask;
+    }
+    else
+    {
+      db->count[plane][word] &= ~mask;
+    }
+  }
+}
+
+/**
+  * @brief  Add one to the counters of the selected keys.
+  * @param  db: debouncer
+  * @param  word: bitmap word
+  * @param  mask: keys of the word
+  * @retval None
+  */
+static void debounce_counter_inc(debounce_t *db, uint32_t word, uint32_t mask)
+{
+  uint32_t carry = mask;
+  uint32_t next;
+  uint32_t plane;
+
+  for (plane = 0U; (plane < DEBOUNCE_COUNTER_BITS) && (carry != 0U); plane++)
+  {
+    next = db->count[plane][word] & carry;
+    db->count[plane][word] ^= carry;
+    carry = next;
+  }
+}
+
+/**
+  * @brief  Subtract one from the counters of the selected keys.
+  * @param  db: debouncer
+  * @param  word: bitmap word
+  * @param  mask: keys of the word
+  * @retval None
+  */
+static void debounce_counter_dec(debounce_t *db, uint32_t word, uint32_t mask)
+{
+  uint32_t borrow = mask;
+  uint32_t next;
+  uint32_t plane;
+
+  for (plane = 0U; (plane < DEBOUNCE_COUNTER_BITS) && (borrow != 0U); plane++)
+  {
+    next = ~db->count[plane][word] & borrow;
+    db->count[plane][word] ^= borrow;
+    borrow = next;
+  }
+}
+
+/**
+  * @brief  Find the keys whose counter holds a given value.
+  * @param  db: debouncer
+  * @param  word: bitmap word
+  * @param  value: counter value
+  * @retval mask of the matching keys
+  */
+static uint32_t debounce_counter_equals(const debounce_t *db, uint32_t word, uint32_t value)
+{
+  uint32_t match = 0xFFFFFFFFU;
+  uint32_t plane;
+
+  for (plane = 0U; plane < DEBOUNCE_COUNTER_BITS; plane++)
+  {
+    match &= (((value >> plane) & 1U) != 0U) ? db->count[plane][word] : ~db->count[plane][word];
+  }
+
+  return match;
+}
@@ -0,0 +1,421 @@
+/**
+  ******************************************************************************
+  * @file           : hid_config.c
+  * @brief          : Runtime configuration table, exposed as HID feature reports
+  ******************************************************************************
+  * Every tunable is one typed entry of hid_config_table: range, default and
+  * the function that puts a new value into effect. The host reaches the
+  * table through two vendor feature reports:
+  *
+  *  Report 4, parameter access
+  *   SET_REPORT  [4][param][op][value LSB][value MSB][-][-][-]
+  *               op HID_CONFIG_OP_SELECT only selects the parameter,
+  *               op HID_CONFIG_OP_WRITE selects and writes it.
+  *   GET_REPORT  [4][param][status][value LSB][value MSB][max LSB][max MSB][type]
+  *               for the selected parameter, status of the last SET_REPORT.
+  *
+  *  Report 5, table control and macros
+  *   SET_REPORT  [5][command][macro LSB][macro MSB][-][-][-][-]
+  *   GET_REPORT  [5][version][parameter count][status][macro count LSB]
+  *               [macro count MSB][macro playing][0]
+  *
+  * Both reports are handled from the USB interrupt, which runs at the same
+  * priority as the matrix scan interrupt, so values can be applied at once.
+  * They are saved to the configuration store (config_store.c), keyed by
+  * parameter ID, from the main loop once no parameter has changed for
+  * HID_CONFIG_SAVE_DELAY_MS, and loaded back at start-up.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "hid_config.h"
+#include "config_store.h"
+#include "kbd_layout.h"
+#include "keyboard.h"
+#include "macro.h"
+#include "main.h"
+#include "matrix_scan.h"
+#include "typing.h"
+#include "usbd_hid.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint8_t  id;
+  uint8_t  type;
+  uint16_t min;
+  uint16_t max;
+  uint16_t def;
+  uint8_t  (*valid)(uint16_t value);   /* optional check beyond min/max */
+  void     (*apply)(uint16_t value);
+} hid_config_entry_t;
+
+/* Private define ------------------------------------------------------------*/
+#define HID_CONFIG_NUM_ENTRIES    (sizeof(hid_config_table) / sizeof(hid_config_table[0]))
+
+/* Longest debounce the bit-sliced counters can hold at the scan rate */
+#define HID_CONFIG_DEBOUNCE_MAX_MS ((DEBOUNCE_COUNTER_MAX * 1000U) / MATRIX_SCAN_HZ)
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t hid_config_poll_interval_valid(uint16_t value);
+static void hid_config_apply_poll_interval(uint16_t value);
+static void hid_config_apply_debounce(uint16_t value);
+static void hid_config_apply_layout(uint16_t value);
+static const hid_config_entry_t *hid_config_find(uint8_t id, uint32_t *index);
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+static const hid_config_entry_t hid_config_table[] =
+{
+  {
+    HID_CONFIG_POLL_INTERVAL, HID_CONFIG_TYPE_U8, 1U, 10U, HID_FS_BINTERVAL,
+    hid_config_poll_interval_valid, hid_config_apply_poll_interval
+  },
+  {
+    HID_CONFIG_DEBOUNCE_MS, HID_CONFIG_TYPE_U8, 1U, HID_CONFIG_DEBOUNCE_MAX_MS, KEYBOARD_DEBOUNCE_MS,
+    NULL, hid_config_apply_debounce
+  },
+  {
+    HID_CONFIG_DEBOUNCE_MODE, HID_CONFIG_TYPE_ENUM, DEBOUNCE_EAGER, DEBOUNCE_INTEGRATOR, KEYBOARD_DEBOUNCE_MODE,
+    NULL, hid_config_apply_debounce
+  },
+  {
+    HID_CONFIG_LAYOUT, HID_CONFIG_TYPE_ENUM, KBD_LAYOUT_US, (uint16_t)KBD_LAYOUT_COUNT - 1U, KBD_LAYOUT_DEFAULT,
+    NULL, hid_config_apply_layout
+  },
+};
+
+static uint16_t hid_config_values[HID_CONFIG_NUM_ENTRIES];
+static uint8_t  hid_config_selected;
+static uint8_t  hid_config_status;
+static volatile uint32_t hid_config_dirty;    /* bit per table index, not saved yet */
+static volatile uint32_t hid_config_changed;  /* HAL_GetTick() of the last change */
+
+/**
+  * @brief  Load the stored values over the build-time defaults and apply them.
+  * @note   Call after keyboard_init() and config_store_init(), and before
+  *         MX_USB_DEVICE_Init() so that the host sees the stored polling
+  *         interval. A stored value out of range is left at its default.
+  * @retval None
+  */
+void hid_config_init(void)
+{
+  uint32_t index;
+  uint16_t value;
+  uint8_t len;
+
+  for (index = 0U; index < HID_CONFIG_NUM_ENTRIES; index++)
+  {
+    hid_config_values[index] = hid_config_table[index].def;
+  }
+
+  for (index = 0U; index < HID_CONFIG_NUM_ENTRIES; index++)
+  {
+    len = (uint8_t)sizeof(value);
+    if ((config_store_get(hid_config_table[index].id, &value, &len) == CONFIG_STORE_OK) && (len == sizeof(value)))
+    {
+      (void)hid_config_set(hid_config_table[index].id, value);
+    }
+  }
+
+  hid_config_dirty = 0U;
+  hid_config_selected = hid_config_table[0].id;
+  hid_config_status = (uint8_t)HID_CONFIG_OK;
+}
+
+/**
+  * @brief  Save the parameters changed since the last save, once they have
+  *         been left alone for HID_CONFIG_SAVE_DELAY_MS.
+  * @note   Main loop only, the flash is written from here.
+  * @retval None
+  */
+void hid_config_task(void)
+{
+  uint32_t primask;
+  uint32_t dirty;
+  uint32_t index;
+  uint16_t value;
+
+  if ((hid_config_dirty == 0U) || ((HAL_GetTick() - hid_config_changed) < HID_CONFIG_SAVE_DELAY_MS))
+  {
+    return;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  dirty = hid_config_dirty;
+  hid_config_dirty = 0U;
+  __set_PRIMASK(primask);
+
+  for (index = 0U; index < HID_CONFIG_NUM_ENTRIES; index++)
+  {
+    if (((dirty >> index) & 1U) != 0U)
+    {
+      value = hid_config_values[index];
+      (void)config_store_set(hid_config_table[index].id, &value, (uint8_t)sizeof(value));
+    }
+  }
+}
+
+/**
+  * @brief  Write the default of every parameter and apply it.
+  * @retval None
+  */
+void hid_config_restore_defaults(void)
+{
+  uint32_t index;
+
+  for (index = 0U; index < HID_CONFIG_NUM_ENTRIES; index++)
+  {
+    (void)hid_config_set(hid_config_table[index].id, hid_config_table[index].def);
+  }
+}
+
+/**
+  * @brief  Read a parameter.
+  * @param  id: hid_config_id_t
+  * @param  value: receives the current value
+  * @retval HID_CONFIG_OK or HID_CONFIG_ERR_ID
+  */
+hid_config_status_t hid_config_get(uint8_t id, uint16_t *value)
+{
+  uint32_t index;
+
+  if (hid_config_find(id, &index) == NULL)
+  {
+    return HID_CONFIG_ERR_ID;
+  }
+
+  *value = hid_config_values[index];
+
+  return HID_CONFIG_OK;
+}
+
+/**
+  * @brief  Check, store and apply a parameter.
+  * @note   hid_config_task() saves it to flash later.
+  * @param  id: hid_config_id_t
+  * @param  value: new value
+  * @retval HID_CONFIG_OK, HID_CONFIG_ERR_ID or HID_CONFIG_ERR_RANGE
+  */
+hid_config_status_t hid_config_set(uint8_t id, uint16_t value)
+{
+  const hid_config_entry_t *entry;
+  uint32_t index;
+
+  entry = hid_config_find(id, &index);
+  if (entry == NULL)
+  {
+    return HID_CONFIG_ERR_ID;
+  }
+
+  if ((value < entry->min) || (value > entry->max) ||
+      ((entry->valid != NULL) && (entry->valid(value) == 0U)))
+  {
+    return HID_CONFIG_ERR_RANGE;
+  }
+
+  hid_config_values[index] = value;
+  entry->apply(value);
+  hid_config_changed = HAL_GetTick();
+  hid_config_dirty |= (1UL << index);
+
+  return HID_CONFIG_OK;
+}
+
+/**
+  * @brief  Build a feature report for GET_REPORT.
+  * @param  report_id: requested report ID
+  * @param  report: receives the report, ID included
+  * @param  len: buffer size in, report length out
+  * @retval 0 on success, -1 for an unknown report
+  */
+int8_t hid_config_get_feature(uint8_t report_id, uint8_t *report, uint16_t *len)
+{
+  const hid_config_entry_t *entry;
+  uint32_t index;
+  uint32_t i;
+
+  if (*len < HID_CONFIG_REPORT_SIZE)
+  {
+    return -1;
+  }
+
+  for (i = 0U; i < HID_CONFIG_REPORT_SIZE; i++)
+  {
+    report[i] = 0U;
+  }
+  report[0] = report_id;
+
+  if (report_id == HID_CONFIG_PARAM_REPORT_ID)
+  {
+    entry = hid_config_find(hid_config_selected, &index);
+    report[1] = hid_config_selected;
+    report[2] = hid_config_status;
+    if (entry != NULL)
+    {
+      report[3] = (uint8_t)(hid_config_values[index] & 0xFFU);
+      report[4] = (uint8_t)(hid_config_values[index] >> 8);
+      report[5] = (uint8_t)(entry->max & 0xFFU);
+      report[6] = (uint8_t)(entry->max >> 8);
+      report[7] = entry->type;
+    }
+  }
+  else if (report_id == HID_CONFIG_CTRL_REPORT_ID)
+  {
+    report[1] = HID_CONFIG_VERSION;
+    report[2] = (uint8_t)HID_CONFIG_NUM_ENTRIES;
+    report[3] = hid_config_status;
+    report[4] = (uint8_t)(macro_count() & 0xFFU);
+    report[5] = (uint8_t)(macro_count() >> 8);
+    report[6] = macro_busy();
+  }
+  else
+  {
+    return -1;
+  }
+
+  *len = HID_CONFIG_REPORT_SIZE;
+
+  return 0;
+}
+
+/**
+  * @brief  Execute a feature report received with SET_REPORT.
+  * @param  report_id: report ID from the request
+  * @param  report: report data, ID included
+  * @param  len: report length
+  * @retval 0 on success, -1 if the report was rejected
+  */
+int8_t hid_config_set_feature(uint8_t report_id, const uint8_t *report, uint16_t len)
+{
+  uint32_t index;
+
+  if ((len < HID_CONFIG_REPORT_SIZE) || (report[0] != report_id))
+  {
+    hid_config_status = (uint8_t)HID_CONFIG_ERR_REPORT;
+    return -1;
+  }
+
+  if (report_id == HID_CONFIG_PARAM_REPORT_ID)
+  {
+    hid_config_selected = report[1];
+
+    if (report[2] == HID_CONFIG_OP_WRITE)
+    {
+      hid_config_status = (uint8_t)hid_config_set(report[1], (uint16_t)(report[3] | ((uint16_t)report[4] << 8)));
+    }
+    else if (report[2] == HID_CONFIG_OP_SELECT)
+    {
+      hid_config_status = (uint8_t)((hid_config_find(report[1], &index) != NULL) ? HID_CONFIG_OK : HID_CONFIG_ERR_ID);
+    }
+    else
+    {
+      hid_config_status = (uint8_t)HID_CONFIG_ERR_REPORT;
+    }
+  }
+  else if (report_id == HID_CONFIG_CTRL_REPORT_ID)
+  {
+    if (report[1] == HID_CONFIG_CMD_DEFAULTS)
+    {
+      hid_config_restore_defaults();
+      hid_config_status = (uint8_t)HID_CONFIG_OK;
+    }
+    else if (report[1] == HID_CONFIG_CMD_MACRO_PLAY)
+    {
+      hid_config_status = (uint8_t)((macro_play((uint16_t)(report[2] | ((uint16_t)report[3] << 8))) == MACRO_OK) ?
+                                    HID_CONFIG_OK : HID_CONFIG_ERR_RANGE);
+    }
+    else if (report[1] == HID_CONFIG_CMD_MACRO_STOP)
+    {
+      macro_stop();
+      hid_config_status = (uint8_t)HID_CONFIG_OK;
+    }
+    else if (report[1] == HID_CONFIG_CMD_NONE)
+    {
+      hid_config_status = (uint8_t)HID_CONFIG_OK;
+    }
+    else
+    {
+      hid_config_status = (uint8_t)HID_CONFIG_ERR_REPORT;
+    }
+  }
+  else
+  {
+    hid_config_status = (uint8_t)HID_CONFIG_ERR_REPORT;
+    return -1;
+  }
+
+  return (hid_config_status == (uint8_t)HID_CONFIG_OK) ? 0 : -1;
+}
+
+/**
+  * @brief  Look a parameter up in the table.
+  * @param  id: hid_config_id_t
+  * @param  index: receives the table index
+  * @retval entry, NULL if the ID is unknown
+  */
+static const hid_config_entry_t *hid_config_find(uint8_t id, uint32_t *index)
+{
+  uint32_t i;
+
+  for (i = 0U; i < HID_CONFIG_NUM_ENTRIES; i++)
+  {
+    if (hid_config_table[i].id == id)
+    {
+      *index = i;
+      return &hid_config_table[i];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  * @brief  Full-speed polling intervals the HID class accepts.
+  * @param  value: interval in ms
+  * @retval 1 if valid
+  */
+static uint8_t hid_config_poll_interval_valid(uint16_t value)
+{
+  return HID_FS_BINTERVAL_IS_VALID(value) ? 1U : 0U;
+}
+
+/**
+  * @brief  Patch the endpoint descriptor, the host picks it up on re-enumeration.
+  * @param  value: interval in ms
+  * @retval None
+  */
+static void hid_config_apply_poll_interval(uint16_t value)
+{
+  (void)USBD_HID_SetPollingInterval(&hUsbDeviceFS, (uint8_t)value);
+}
+
+/**
+  * @brief  Push the debounce time and algorithm to the keyboard.
+  * @param  value: unused, both parameters are read back from the table
+  * @retval None
+  */
+static void hid_config_apply_debounce(uint16_t value)
+{
+  uint16_t debounce_ms = KEYBOARD_DEBOUNCE_MS;
+  uint16_t mode = KEYBOARD_DEBOUNCE_MODE;
+
+  UNUSED(value);
+
+  (void)hid_config_get(HID_CONFIG_DEBOUNCE_MS, &debounce_ms);
+  (void)hid_config_get(HID_CONFIG_DEBOUNCE_MODE, &mode);
+
+  keyboard_set_debounce((debounce_mode_t)mode, (uint8_t)debounce_ms);
+}
+
+/**
+  * @brief  Switch the layout the typing engine types text with.
+  * @param  value: kbd_layout_id_t
+  * @retval None
+  */
+static void hid_config_apply_layout(uint16_t value)
+{
+  typing_set_layout((uint8_t)value);
+}
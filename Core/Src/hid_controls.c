@@ -0,0 +1,132 @@
+/**
+  ******************************************************************************
+  * @file           : hid_controls.c
+  * @brief          : Consumer control and system control report senders
+  ******************************************************************************
+  * Consumer (report ID 2) and system (report ID 3) reports share the IN
+  * endpoint with the keyboard reports but go through the high priority
+  * queue of the HID class, so a media key is never held behind a burst of
+  * keyboard reports. These reports only exist under report protocol.
+  *
+  * Call from the main loop, like keyboard_task().
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "hid_controls.h"
+#include "usbd_hid.h"
+#include "usb_device.h"
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+static uint8_t system_state;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t hid_controls_send(uint8_t *report, uint16_t len);
+
+/**
+  * @brief  Report a consumer control as pressed, replacing any other one.
+  * @param  usage: Consumer page usage, 1 to HID_CONSUMER_USAGE_MAX
+  * @retval USBD_OK, USBD_BUSY when the queue is full, USBD_FAIL otherwise
+  */
+uint8_t hid_consumer_press(uint16_t usage)
+{
+  uint8_t report[HID_CONSUMER_REPORT_SIZE];
+
+  if ((usage == 0U) || (usage > HID_CONSUMER_USAGE_MAX))
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  report[0] = HID_CONSUMER_REPORT_ID;
+  report[1] = (uint8_t)(usage & 0xFFU);
+  report[2] = (uint8_t)(usage >> 8);
+
+  return hid_controls_send(report, HID_CONSUMER_REPORT_SIZE);
+}
+
+/**
+  * @brief  Report that no consumer control is pressed.
+  * @retval USBD_OK, USBD_BUSY when the queue is full, USBD_FAIL otherwise
+  */
+uint8_t hid_consumer_release(void)
+{
+  uint8_t report[HID_CONSUMER_REPORT_SIZE] = { HID_CONSUMER_REPORT_ID, 0U, 0U };
+
+  return hid_controls_send(report, HID_CONSUMER_REPORT_SIZE);
+}
+
+/**
+  * @brief  Report a system control as pressed.
+  * @param  usage: HID_SYSTEM_POWER_DOWN, HID_SYSTEM_SLEEP or HID_SYSTEM_WAKE_UP
+  * @retval USBD_OK, USBD_BUSY when the queue is full, USBD_FAIL otherwise
+  */
+uint8_t hid_system_press(uint8_t usage)
+{
+  uint8_t report[HID_SYSTEM_REPORT_SIZE];
+  uint8_t status;
+
+  if ((usage < HID_SYSTEM_POWER_DOWN) || (usage > HID_SYSTEM_WAKE_UP))
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  report[0] = HID_SYSTEM_REPORT_ID;
+  report[1] = system_state | (uint8_t)(1U << (usage - HID_SYSTEM_POWER_DOWN));
+
+  status = hid_controls_send(report, HID_SYSTEM_REPORT_SIZE);
+  if (status == (uint8_t)USBD_OK)
+  {
+    system_state = report[1];
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Report a system control as released.
+  * @param  usage: HID_SYSTEM_POWER_DOWN, HID_SYSTEM_SLEEP or HID_SYSTEM_WAKE_UP
+  * @retval USBD_OK, USBD_BUSY when the queue is full, USBD_FAIL otherwise
+  */
+uint8_t hid_system_release(uint8_t usage)
+{
+  uint8_t report[HID_SYSTEM_REPORT_SIZE];
+  uint8_t status;
+
+  if ((usage < HID_SYSTEM_POWER_DOWN) || (usage > HID_SYSTEM_WAKE_UP))
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  report[0] = HID_SYSTEM_REPORT_ID;
+  report[1] = system_state & (uint8_t)~(1U << (usage - HID_SYSTEM_POWER_DOWN));
+
+  status = hid_controls_send(report, HID_SYSTEM_REPORT_SIZE);
+  if (status == (uint8_t)USBD_OK)
+  {
+    system_state = report[1];
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Queue a control report ahead of the keyboard reports.
+  * @param  report: report, ID included
+  * @param  len: report length
+  * @retval USBD status
+  */
+static uint8_t hid_controls_send(uint8_t *report, uint16_t len)
+{
+  if (USBD_HID_GetProtocol(&hUsbDeviceFS) != HID_REPORT_PROTOCOL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+#ifdef USE_USBD_COMPOSITE
+  return USBD_HID_SendReportPrio(&hUsbDeviceFS, report, len, HID_REPORT_PRIO_HIGH, HID_InstID);
+#else
+  return USBD_HID_SendReportPrio(&hUsbDeviceFS, report, len, HID_REPORT_PRIO_HIGH);
+#endif /* USE_USBD_COMPOSITE */
+}
@@ -0,0 +1,150 @@
+/**
+  ******************************************************************************
+  * @file           : hid_keyboard.c
+  * @brief          : Key state bitmap to HID keyboard report encoders
+  ******************************************************************************
+  * The key state is kept as a bitmap indexed by HID usage, which is exactly
+  * the NKRO report payload: encoding it is a straight byte copy. The boot and
+  * 6KRO array layouts are produced by walking the set bits of the bitmap,
+  * one word at a time, so the cost grows with the number of pressed keys and
+  * not with the size of the usage range.
+  *
+  * The encoders do not depend on the HAL and can be built on a host.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "hid_keyboard.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define HID_KBD_MODIFIER_WORD       (HID_USAGE_MODIFIER_FIRST >> 5)
+#define HID_KBD_MODIFIER_SHIFT      (HID_USAGE_MODIFIER_FIRST & 0x1FU)
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t hid_kbd_encode_array(const hid_key_state_t *state, uint8_t *keys, uint8_t max_keys);
+
+/**
+  * @brief  Release every usage of a key state bitmap.
+  * @param  state: key state bitmap
+  * @retval None
+  */
+void hid_key_state_clear(hid_key_state_t *state)
+{
+  (void)memset(state, 0, sizeof(*state));
+}
+
+/**
+  * @brief  Encode the NKRO report: report ID followed by the usage bitmap.
+  * @param  state: key state bitmap
+  * @param  report: output buffer of HID_KBD_NKRO_REPORT_SIZE bytes
+  * @retval report length
+  */
+uint16_t hid_kbd_encode_nkro(const hid_key_state_t *state, uint8_t *report)
+{
+  uint32_t i;
+
+  report[0] = HID_KBD_NKRO_REPORT_ID;
+
+  for (i = 0U; i < HID_KBD_NKRO_BITMAP_SIZE; i++)
+  {
+    report[1U + i] = (uint8_t)(state->bits[i >> 2] >> ((i & 3U) * 8U));
+  }
+
+  return (uint16_t)HID_KBD_NKRO_REPORT_SIZE;
+}
+
+/**
+  * @brief  Encode the report ID 1 keyboard report (5 keycodes).
+  * @param  state: key state bitmap
+  * @param  report: output buffer of HID_KBD_6KRO_REPORT_SIZE bytes
+  * @retval report length
+  */
+uint16_t hid_kbd_encode_6kro(const hid_key_state_t *state, uint8_t *report)
+{
+  report[0] = HID_KBD_6KRO_REPORT_ID;
+  report[1] = (uint8_t)(state->bits[HID_KBD_MODIFIER_WORD] >> HID_KBD_MODIFIER_SHIFT);
+  report[2] = 0U;
+  (void)hid_kbd_encode_array(state, &report[3], HID_KBD_6KRO_KEYCODES);
+
+  return (uint16_t)HID_KBD_6KRO_REPORT_SIZE;
+}
+
+/**
+  * @brief  Encode the boot protocol keyboard report (6 keycodes, no report ID).
+  * @param  state: key state bitmap
+  * @param  report: output buffer of HID_KBD_BOOT_REPORT_SIZE bytes
+  * @retval report length
+  */
+uint16_t hid_kbd_encode_boot(const hid_key_state_t *state, uint8_t *report)
+{
+  report[0] = (uint8_t)(state->bits[HID_KBD_MODIFIER_WORD] >> HID_KBD_MODIFIER_SHIFT);
+  report[1] = 0U;
+  (void)hid_kbd_encode_array(state, &report[2], HID_KBD_BOOT_KEYCODES);
+
+  return (uint16_t)HID_KBD_BOOT_REPORT_SIZE;
+}
+
+/**
+  * @brief  Encode the keyboard report matching the protocol selected by the host.
+  * @param  state: key state bitmap
+  * @param  protocol: HID_KBD_PROTOCOL_BOOT or HID_KBD_PROTOCOL_REPORT
+  * @param  report: output buffer of HID_KBD_MAX_REPORT_SIZE bytes
+  * @retval report length
+  */
+uint16_t hid_kbd_encode(const hid_key_state_t *state, uint8_t protocol, uint8_t *report)
+{
+  if (protocol == HID_KBD_PROTOCOL_BOOT)
+  {
+    return hid_kbd_encode_boot(state, report);
+  }
+
+#if (HID_KBD_NKRO_ENABLED == 1U)
+  return hid_kbd_encode_nkro(state, report);
+#else
+  return hid_kbd_encode_6kro(state, report);
+#endif /* HID_KBD_NKRO_ENABLED */
+}
+
+/**
+  * @brief  Fill a keycode array from the pressed non-modifier usages.
+  *         When more keys are down than the array holds, every slot reports
+  *         ErrorRollOver as required by the HID usage tables.
+  * @param  state: key state bitmap
+  * @param  keys: keycode array
+  * @param  max_keys: number of slots in the array
+  * @retval number of keys pressed, capped at max_keys + 1
+  */
+static uint8_t hid_kbd_encode_array(const hid_key_state_t *state, uint8_t *keys, uint8_t max_keys)
+{
+  uint8_t count = 0U;
+  uint32_t word;
+  uint32_t w;
+
+  (void)memset(keys, 0, max_keys);
+
+  for (w = 0U; w < HID_KBD_MODIFIER_WORD; w++)
+  {
+    word = state->bits[w];
+    if (w == 0U)
+    {
+      /* Usages 0x00..0x03 are reserved and error codes, never keys */
+      word &= ~((1UL << HID_USAGE_FIRST_KEY) - 1UL);
+    }
+
+    while (word != 0U)
+    {
+      if (count == max_keys)
+      {
+        (void)memset(keys, HID_USAGE_ERROR_ROLLOVER, max_keys);
+        return (uint8_t)(max_keys + 1U);
+      }
+
+      keys[count] = (uint8_t)((w << 5) + (uint32_t)__builtin_ctz(word));
+      count++;
+      word &= word - 1U;
+    }
+  }
+
+  return count;
+}
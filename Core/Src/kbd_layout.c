@@ -0,0 +1,402 @@
+/**
+  ******************************************************************************
+  * @file           : kbd_layout.c
+  * @brief          : Character to keystroke layout tables
+  ******************************************************************************
+  * Every layout is constant data in flash: the keys of the 95 printable
+  * ASCII characters indexed by code (O(1)), and the other characters it can
+  * type in an array sorted by code point, searched by bisection (O(log n)).
+  * A key is 16 bits: usage, Shift, AltGr, whether Caps Lock affects it, and
+  * the dead key pressed first, an index into the layout's dead key list.
+  * A dead key followed by Space types the accent on its own.
+  *
+  * The tables are checked on the host by the simulator, which types every
+  * character of every layout and decodes it with its own key-centric
+  * description of the layouts.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "kbd_layout.h"
+#include <stddef.h>
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint16_t codepoint;
+  uint16_t key;
+} kbd_layout_entry_t;
+
+typedef struct
+{
+  const char               *name;
+  const uint16_t           *ascii;        /* keys of KBD_ASCII_FIRST..KBD_ASCII_LAST, 0 for none */
+  const kbd_layout_entry_t *extra;        /* other code points, ascending */
+  uint16_t                  extra_count;
+  const uint16_t           *dead;         /* key of dead key n at index n - 1 */
+} kbd_layout_t;
+
+/* Private define ------------------------------------------------------------*/
+#define KBD_ASCII_FIRST           0x20U
+#define KBD_ASCII_LAST            0x7EU
+#define KBD_ASCII_COUNT           ((KBD_ASCII_LAST - KBD_ASCII_FIRST) + 1U)
+
+#define KBD_KEY_USAGE_MASK        0x00FFU
+#define KBD_KEY_SHIFT             0x0100U
+#define KBD_KEY_ALTGR             0x0200U
+#define KBD_KEY_CAPS              0x0400U
+#define KBD_KEY_DEAD_POS          11U
+#define KBD_KEY_DEAD_MASK         0x3800U
+
+/* Private macro -------------------------------------------------------------*/
+#define KEY(usage)                ((uint16_t)(usage))
+#define SHIFT(usage)              ((uint16_t)((usage) | KBD_KEY_SHIFT))
+#define ALTGR(usage)              ((uint16_t)((usage) | KBD_KEY_ALTGR))
+#define LETTER(usage)             ((uint16_t)((usage) | KBD_KEY_CAPS))
+#define SHIFT_LETTER(usage)       ((uint16_t)((usage) | KBD_KEY_SHIFT | KBD_KEY_CAPS))
+#define DEAD(n, key)              ((uint16_t)((key) | ((n) << KBD_KEY_DEAD_POS)))
+
+#define KBD_EXTRA(table)          (table), (uint16_t)(sizeof(table) / sizeof((table)[0]))
+
+/* Private variables ---------------------------------------------------------*/
+/* Characters with a key of their own on every layout */
+static const kbd_layout_entry_t kbd_control_keys[] =
+{
+  { 0x0008U, KEY(0x2AU) },                      /* Backspace */
+  { 0x0009U, KEY(0x2BU) },                      /* Tab */
+  { 0x000AU, KEY(0x28U) },                      /* Line feed: Enter */
+  { 0x001BU, KEY(0x29U) },                      /* Escape */
+};
+
+/* US: xkb "us" */
+static const uint16_t kbd_us_ascii[KBD_ASCII_COUNT] =
+{
+  KEY(0x2CU),           SHIFT(0x1EU),         SHIFT(0x34U),         SHIFT(0x20U),           /*   ! " # */
+  SHIFT(0x21U),         SHIFT(0x22U),         SHIFT(0x24U),         KEY(0x34U),             /* $ % & ' */
+  SHIFT(0x26U),         SHIFT(0x27U),         SHIFT(0x25U),         SHIFT(0x2EU),           /* ( ) * + */
+  KEY(0x36U),           KEY(0x2DU),           KEY(0x37U),           KEY(0x38U),             /* , - . / */
+  KEY(0x27U),           KEY(0x1EU),           KEY(0x1FU),           KEY(0x20U),             /* 0 1 2 3 */
+  KEY(0x21U),           KEY(0x22U),           KEY(0x23U),           KEY(0x24U),             /* 4 5 6 7 */
+  KEY(0x25U),           KEY(0x26U),           SHIFT(0x33U),         KEY(0x33U),             /* 8 9 : ; */
+  SHIFT(0x36U),         KEY(0x2EU),           SHIFT(0x37U),         SHIFT(0x38U),           /* < = > ? */
+  SHIFT(0x1FU),         SHIFT_LETTER(0x04U),  SHIFT_LETTER(0x05U),  SHIFT_LETTER(0x06U),    /* @ A B C */
+  SHIFT_LETTER(0x07U),  SHIFT_LETTER(0x08U),  SHIFT_LETTER(0x09U),  SHIFT_LETTER(0x0AU),    /* D E F G */
+  SHIFT_LETTER(0x0BU),  SHIFT_LETTER(0x0CU),  SHIFT_LETTER(0x0DU),  SHIFT_LETTER(0x0EU),    /* H I J K */
+  SHIFT_LETTER(0x0FU),  SHIFT_LETTER(0x10U),  SHIFT_LETTER(0x11U),  SHIFT_LETTER(0x12U),    /* L M N O */
+  SHIFT_LETTER(0x13U),  SHIFT_LETTER(0x14U),  SHIFT_LETTER(0x15U),  SHIFT_LETTER(0x16U),    /* P Q R S */
+  SHIFT_LETTER(0x17U),  SHIFT_LETTER(0x18U),  SHIFT_LETTER(0x19U),  SHIFT_LETTER(0x1AU),    /* T U V W */
+  SHIFT_LETTER(0x1BU),  SHIFT_LETTER(0x1CU),  SHIFT_LETTER(0x1DU),  KEY(0x2FU),             /* X Y Z [ */
+  KEY(0x31U),           KEY(0x30U),           SHIFT(0x23U),         SHIFT(0x2DU),           /* \ ] ^ _ */
+  KEY(0x35U),           LETTER(0x04U),        LETTER(0x05U),        LETTER(0x06U),          /* ` a b c */
+  LETTER(0x07U),        LETTER(0x08U),        LETTER(0x09U),        LETTER(0x0AU),          /* d e f g */
+  LETTER(0x0BU),        LETTER(0x0CU),        LETTER(0x0DU),        LETTER(0x0EU),          /* h i j k */
+  LETTER(0x0FU),        LETTER(0x10U),        LETTER(0x11U),        LETTER(0x12U),          /* l m n o */
+  LETTER(0x13U),        LETTER(0x14U),        LETTER(0x15U),        LETTER(0x16U),          /* p q r s */
+  LETTER(0x17U),        LETTER(0x18U),        LETTER(0x19U),        LETTER(0x1AU),          /* t u v w */
+  LETTER(0x1BU),        LETTER(0x1CU),        LETTER(0x1DU),        SHIFT(0x2FU),           /* x y z { */
+  SHIFT(0x31U),         SHIFT(0x30U),         SHIFT(0x35U),                                 /* | } ~ */
+};
+
+/* UK: xkb "gb", ISO keys 0x32 and 0x64 */
+static const uint16_t kbd_uk_ascii[KBD_ASCII_COUNT] =
+{
+  KEY(0x2CU),           SHIFT(0x1EU),         SHIFT(0x1FU),         KEY(0x32U),             /*   ! " # */
+  SHIFT(0x21U),         SHIFT(0x22U),         SHIFT(0x24U),         KEY(0x34U),             /* $ % & ' */
+  SHIFT(0x26U),         SHIFT(0x27U),         SHIFT(0x25U),         SHIFT(0x2EU),           /* ( ) * + */
+  KEY(0x36U),           KEY(0x2DU),           KEY(0x37U),           KEY(0x38U),             /* , - . / */
+  KEY(0x27U),           KEY(0x1EU),           KEY(0x1FU),           KEY(0x20U),             /* 0 1 2 3 */
+  KEY(0x21U),           KEY(0x22U),           KEY(0x23U),           KEY(0x24U),             /* 4 5 6 7 */
+  KEY(0x25U),           KEY(0x26U),           SHIFT(0x33U),         KEY(0x33U),             /* 8 9 : ; */
+  SHIFT(0x36U),         KEY(0x2EU),           SHIFT(0x37U),         SHIFT(0x38U),           /* < = > ? */
+  SHIFT(0x34U),         SHIFT_LETTER(0x04U),  SHIFT_LETTER(0x05U),  SHIFT_LETTER(0x06U),    /* @ A B C */
+  SHIFT_LETTER(0x07U),  SHIFT_LETTER(0x08U),  SHIFT_LETTER(0x09U),  SHIFT_LETTER(0x0AU),    /* D E F G */
+  SHIFT_LETTER(0x0BU),  SHIFT_LETTER(0x0CU),  SHIFT_LETTER(0x0DU),  SHIFT_LETTER(0x0EU),    /* H I J K */
+  SHIFT_LETTER(0x0FU),  SHIFT_LETTER(0x10U),  SHIFT_LETTER(0x11U),  SHIFT_LETTER(0x12U),    /* L M N O */
+  SHIFT_LETTER(0x13U),  SHIFT_LETTER(0x14U),  SHIFT_LETTER(0x15U),  SHIFT_LETTER(0x16U),    /* P Q R S */
+  SHIFT_LETTER(0x17U),  SHIFT_LETTER(0x18U),  SHIFT_LETTER(0x19U),  SHIFT_LETTER(0x1AU),    /* T U V W */
+  SHIFT_LETTER(0x1BU),  SHIFT_LETTER(0x1CU),  SHIFT_LETTER(0x1DU),  KEY(0x2FU),             /* X Y Z [ */
+  KEY(0x64U),           KEY(0x30U),           SHIFT(0x23U),         SHIFT(0x2DU),           /* \ ] ^ _ */
+  KEY(0x35U),           LETTER(0x04U),        LETTER(0x05U),        LETTER(0x06U),          /* ` a b c */
+  LETTER(0x07U),        LETTER(0x08U),        LETTER(0x09U),        LETTER(0x0AU),          /* d e f g */
+  LETTER(0x0BU),        LETTER(0x0CU),        LETTER(0x0DU),        LETTER(0x0EU),          /* h i j k */
+  LETTER(0x0FU),        LETTER(0x10U),        LETTER(0x11U),        LETTER(0x12U),          /* l m n o */
+  LETTER(0x13U),        LETTER(0x14U),        LETTER(0x15U),        LETTER(0x16U),          /* p q r s */
+  LETTER(0x17U),        LETTER(0x18U),        LETTER(0x19U),        LETTER(0x1AU),          /* t u v w */
+  LETTER(0x1BU),        LETTER(0x1CU),        LETTER(0x1DU),        SHIFT(0x2FU),           /* x y z { */
+  SHIFT(0x64U),         SHIFT(0x30U),         SHIFT(0x32U),                                 /* | } ~ */
+};
+static const kbd_layout_entry_t kbd_uk_extra[] =
+{
+  { 0x00A3U, SHIFT(0x20U) },                    /* £ */
+  { 0x00ACU, SHIFT(0x35U) },                    /* ¬ */
+  { 0x20ACU, ALTGR(0x21U) },                    /* € */
+};
+
+/* German: xkb "de", QWERTZ, dead ^ ´ ` */
+static const uint16_t kbd_de_ascii[KBD_ASCII_COUNT] =
+{
+  KEY(0x2CU),           SHIFT(0x1EU),         SHIFT(0x1FU),         KEY(0x32U),             /*   ! " # */
+  SHIFT(0x21U),         SHIFT(0x22U),         SHIFT(0x23U),         SHIFT(0x32U),           /* $ % & ' */
+  SHIFT(0x25U),         SHIFT(0x26U),         SHIFT(0x30U),         KEY(0x30U),             /* ( ) * + */
+  KEY(0x36U),           KEY(0x38U),           KEY(0x37U),           SHIFT(0x24U),           /* , - . / */
+  KEY(0x27U),           KEY(0x1EU),           KEY(0x1FU),           KEY(0x20U),             /* 0 1 2 3 */
+  KEY(0x21U),           KEY(0x22U),           KEY(0x23U),           KEY(0x24U),             /* 4 5 6 7 */
+  KEY(0x25U),           KEY(0x26U),           SHIFT(0x37U),         SHIFT(0x36U),           /* 8 9 : ; */
+  KEY(0x64U),           SHIFT(0x27U),         SHIFT(0x64U),         SHIFT(0x2DU),           /* < = > ? */
+  ALTGR(0x14U),         SHIFT_LETTER(0x04U),  SHIFT_LETTER(0x05U),  SHIFT_LETTER(0x06U),    /* @ A B C */
+  SHIFT_LETTER(0x07U),  SHIFT_LETTER(0x08U),  SHIFT_LETTER(0x09U),  SHIFT_LETTER(0x0AU),    /* D E F G */
+  SHIFT_LETTER(0x0BU),  SHIFT_LETTER(0x0CU),  SHIFT_LETTER(0x0DU),  SHIFT_LETTER(0x0EU),    /* H I J K */
+  SHIFT_LETTER(0x0FU),  SHIFT_LETTER(0x10U),  SHIFT_LETTER(0x11U),  SHIFT_LETTER(0x12U),    /* L M N O */
+  SHIFT_LETTER(0x13U),  SHIFT_LETTER(0x14U),  SHIFT_LETTER(0x15U),  SHIFT_LETTER(0x16U),    /* P Q R S */
+  SHIFT_LETTER(0x17U),  SHIFT_LETTER(0x18U),  SHIFT_LETTER(0x19U),  SHIFT_LETTER(0x1AU),    /* T U V W */
+  SHIFT_LETTER(0x1BU),  SHIFT_LETTER(0x1DU),  SHIFT_LETTER(0x1CU),  ALTGR(0x25U),           /* X Y Z [ */
+  ALTGR(0x2DU),         ALTGR(0x26U),         DEAD(1, KEY(0x2CU)),  SHIFT(0x38U),           /* \ ] ^ _ */
+  DEAD(3, KEY(0x2CU)),  LETTER(0x04U),        LETTER(0x05U),        LETTER(0x06U),          /* ` a b c */
+  LETTER(0x07U),        LETTER(0x08U),        LETTER(0x09U),        LETTER(0x0AU),          /* d e f g */
+  LETTER(0x0BU),        LETTER(0x0CU),        LETTER(0x0DU),        LETTER(0x0EU),          /* h i j k */
+  LETTER(0x0FU),        LETTER(0x10U),        LETTER(0x11U),        LETTER(0x12U),          /* l m n o */
+  LETTER(0x13U),        LETTER(0x14U),        LETTER(0x15U),        LETTER(0x16U),          /* p q r s */
+  LETTER(0x17U),        LETTER(0x18U),        LETTER(0x19U),        LETTER(0x1AU),          /* t u v w */
+  LETTER(0x1BU),        LETTER(0x1DU),        LETTER(0x1CU),        ALTGR(0x24U),           /* x y z { */
+  ALTGR(0x64U),         ALTGR(0x27U),         ALTGR(0x30U),                                 /* | } ~ */
+};
+static const kbd_layout_entry_t kbd_de_extra[] =
+{
+  { 0x00A7U, SHIFT(0x20U) },                    /* § */
+  { 0x00B0U, SHIFT(0x35U) },                    /* ° */
+  { 0x00B2U, ALTGR(0x1FU) },                    /* ² */
+  { 0x00B3U, ALTGR(0x20U) },                    /* ³ */
+  { 0x00B4U, DEAD(2, KEY(0x2CU)) },             /* ´ */
+  { 0x00B5U, ALTGR(0x10U) },                    /* µ */
+  { 0x00C0U, DEAD(3, SHIFT_LETTER(0x04U)) },    /* À */
+  { 0x00C1U, DEAD(2, SHIFT_LETTER(0x04U)) },    /* Á */
+  { 0x00C2U, DEAD(1, SHIFT_LETTER(0x04U)) },    /* Â */
+  { 0x00C4U, SHIFT_LETTER(0x34U) },             /* Ä */
+  { 0x00C8U, DEAD(3, SHIFT_LETTER(0x08U)) },    /* È */
+  { 0x00C9U, DEAD(2, SHIFT_LETTER(0x08U)) },    /* É */
+  { 0x00CAU, DEAD(1, SHIFT_LETTER(0x08U)) },    /* Ê */
+  { 0x00CCU, DEAD(3, SHIFT_LETTER(0x0CU)) },    /* Ì */
+  { 0x00CDU, DEAD(2, SHIFT_LETTER(0x0CU)) },    /* Í */
+  { 0x00CEU, DEAD(1, SHIFT_LETTER(0x0CU)) },    /* Î */
+  { 0x00D2U, DEAD(3, SHIFT_LETTER(0x12U)) },    /* Ò */
+  { 0x00D3U, DEAD(2, SHIFT_LETTER(0x12U)) },    /* Ó */
+  { 0x00D4U, DEAD(1, SHIFT_LETTER(0x12U)) },    /* Ô */
+  { 0x00D6U, SHIFT_LETTER(0x33U) },             /* Ö */
+  { 0x00D9U, DEAD(3, SHIFT_LETTER(0x18U)) },    /* Ù */
+  { 0x00DAU, DEAD(2, SHIFT_LETTER(0x18U)) },    /* Ú */
+  { 0x00DBU, DEAD(1, SHIFT_LETTER(0x18U)) },    /* Û */
+  { 0x00DCU, SHIFT_LETTER(0x2FU) },             /* Ü */
+  { 0x00DFU, KEY(0x2DU) },                      /* ß */
+  { 0x00E0U, DEAD(3, LETTER(0x04U)) },          /* à */
+  { 0x00E1U, DEAD(2, LETTER(0x04U)) },          /* á */
+  { 0x00E2U, DEAD(1, LETTER(0x04U)) },          /* â */
+  { 0x00E4U, LETTER(0x34U) },                   /* ä */
+  { 0x00E8U, DEAD(3, LETTER(0x08U)) },          /* è */
+  { 0x00E9U, DEAD(2, LETTER(0x08U)) },          /* é */
+  { 0x00EAU, DEAD(1, LETTER(0x08U)) },          /* ê */
+  { 0x00ECU, DEAD(3, LETTER(0x0CU)) },          /* ì */
+  { 0x00EDU, DEAD(2, LETTER(0x0CU)) },          /* í */
+  { 0x00EEU, DEAD(1, LETTER(0x0CU)) },          /* î */
+  { 0x00F2U, DEAD(3, LETTER(0x12U)) },          /* ò */
+  { 0x00F3U, DEAD(2, LETTER(0x12U)) },          /* ó */
+  { 0x00F4U, DEAD(1, LETTER(0x12U)) },          /* ô */
+  { 0x00F6U, LETTER(0x33U) },                   /* ö */
+  { 0x00F9U, DEAD(3, LETTER(0x18U)) },          /* ù */
+  { 0x00FAU, DEAD(2, LETTER(0x18U)) },          /* ú */
+  { 0x00FBU, DEAD(1, LETTER(0x18U)) },          /* û */
+  { 0x00FCU, LETTER(0x2FU) },                   /* ü */
+  { 0x20ACU, ALTGR(0x08U) },                    /* € */
+};
+
+/* French: xkb "fr", AZERTY, dead ^ ¨; ~ and ` are AltGr keys, not dead as on Windows */
+static const uint16_t kbd_fr_ascii[KBD_ASCII_COUNT] =
+{
+  KEY(0x2CU),           KEY(0x38U),           KEY(0x20U),           ALTGR(0x20U),           /*   ! " # */
+  KEY(0x30U),           SHIFT(0x34U),         KEY(0x1EU),           KEY(0x21U),             /* $ % & ' */
+  KEY(0x22U),           KEY(0x2DU),           KEY(0x32U),           SHIFT(0x2EU),           /* ( ) * + */
+  KEY(0x10U),           KEY(0x23U),           SHIFT(0x36U),         SHIFT(0x37U),           /* , - . / */
+  SHIFT(0x27U),         SHIFT(0x1EU),         SHIFT(0x1FU),         SHIFT(0x20U),           /* 0 1 2 3 */
+  SHIFT(0x21U),         SHIFT(0x22U),         SHIFT(0x23U),         SHIFT(0x24U),           /* 4 5 6 7 */
+  SHIFT(0x25U),         SHIFT(0x26U),         KEY(0x37U),           KEY(0x36U),             /* 8 9 : ; */
+  KEY(0x64U),           KEY(0x2EU),           SHIFT(0x64U),         SHIFT(0x10U),           /* < = > ? */
+  ALTGR(0x27U),         SHIFT_LETTER(0x14U),  SHIFT_LETTER(0x05U),  SHIFT_LETTER(0x06U),    /* @ A B C */
+  SHIFT_LETTER(0x07U),  SHIFT_LETTER(0x08U),  SHIFT_LETTER(0x09U),  SHIFT_LETTER(0x0AU),    /* D E F G */
+  SHIFT_LETTER(0x0BU),  SHIFT_LETTER(0x0CU),  SHIFT_LETTER(0x0DU),  SHIFT_LETTER(0x0EU),    /* H I J K */
+  SHIFT_LETTER(0x0FU),  SHIFT_LETTER(0x33U),  SHIFT_LETTER(0x11U),  SHIFT_LETTER(0x12U),    /* L M N O */
+  SHIFT_LETTER(0x13U),  SHIFT_LETTER(0x04U),  SHIFT_LETTER(0x15U),  SHIFT_LETTER(0x16U),    /* P Q R S */
+  SHIFT_LETTER(0x17U),  SHIFT_LETTER(0x18U),  SHIFT_LETTER(0x19U),  SHIFT_LETTER(0x1DU),    /* T U V W */
+  SHIFT_LETTER(0x1BU),  SHIFT_LETTER(0x1CU),  SHIFT_LETTER(0x1AU),  ALTGR(0x22U),           /* X Y Z [ */
+  ALTGR(0x25U),         ALTGR(0x2DU),         ALTGR(0x26U),         KEY(0x25U),             /* \ ] ^ _ */
+  ALTGR(0x24U),         LETTER(0x14U),        LETTER(0x05U),        LETTER(0x06U),          /* ` a b c */
+  LETTER(0x07U),        LETTER(0x08U),        LETTER(0x09U),        LETTER(0x0AU),          /* d e f g */
+  LETTER(0x0BU),        LETTER(0x0CU),        LETTER(0x0DU),        LETTER(0x0EU),          /* h i j k */
+  LETTER(0x0FU),        LETTER(0x33U),        LETTER(0x11U),        LETTER(0x12U),          /* l m n o */
+  LETTER(0x13U),        LETTER(0x04U),        LETTER(0x15U),        LETTER(0x16U),          /* p q r s */
+  LETTER(0x17U),        LETTER(0x18U),        LETTER(0x19U),        LETTER(0x1DU),          /* t u v w */
+  LETTER(0x1BU),        LETTER(0x1CU),        LETTER(0x1AU),        ALTGR(0x21U),           /* x y z { */
+  ALTGR(0x23U),         ALTGR(0x2EU),         ALTGR(0x1FU),                                 /* | } ~ */
+};
+static const kbd_layout_entry_t kbd_fr_extra[] =
+{
+  { 0x00A3U, SHIFT(0x30U) },                    /* £ */
+  { 0x00A4U, ALTGR(0x30U) },                    /* ¤ */
+  { 0x00A7U, SHIFT(0x38U) },                    /* § */
+  { 0x00A8U, DEAD(2, KEY(0x2CU)) },             /* ¨ */
+  { 0x00B0U, SHIFT(0x2DU) },                    /* ° */
+  { 0x00B2U, KEY(0x35U) },                      /* ² */
+  { 0x00B5U, SHIFT(0x32U) },                    /* µ */
+  { 0x00C2U, DEAD(1, SHIFT_LETTER(0x14U)) },    /* Â */
+  { 0x00C4U, DEAD(2, SHIFT_LETTER(0x14U)) },    /* Ä */
+  { 0x00CAU, DEAD(1, SHIFT_LETTER(0x08U)) },    /* Ê */
+  { 0x00CBU, DEAD(2, SHIFT_LETTER(0x08U)) },    /* Ë */
+  { 0x00CEU, DEAD(1, SHIFT_LETTER(0x0CU)) },    /* Î */
+  { 0x00CFU, DEAD(2, SHIFT_LETTER(0x0CU)) },    /* Ï */
+  { 0x00D4U, DEAD(1, SHIFT_LETTER(0x12U)) },    /* Ô */
+  { 0x00D6U, DEAD(2, SHIFT_LETTER(0x12U)) },    /* Ö */
+  { 0x00DBU, DEAD(1, SHIFT_LETTER(0x18U)) },    /* Û */
+  { 0x00DCU, DEAD(2, SHIFT_LETTER(0x18U)) },    /* Ü */
+  { 0x00E0U, KEY(0x27U) },                      /* à */
+  { 0x00E2U, DEAD(1, LETTER(0x14U)) },          /* â */
+  { 0x00E4U, DEAD(2, LETTER(0x14U)) },          /* ä */
+  { 0x00E7U, KEY(0x26U) },                      /* ç */
+  { 0x00E8U, KEY(0x24U) },                      /* è */
+  { 0x00E9U, KEY(0x1FU) },                      /* é */
+  { 0x00EAU, DEAD(1, LETTER(0x08U)) },          /* ê */
+  { 0x00EBU, DEAD(2, LETTER(0x08U)) },          /* ë */
+  { 0x00EEU, DEAD(1, LETTER(0x0CU)) },          /* î */
+  { 0x00EFU, DEAD(2, LETTER(0x0CU)) },          /* ï */
+  { 0x00F4U, DEAD(1, LETTER(0x12U)) },          /* ô */
+  { 0x00F6U, DEAD(2, LETTER(0x12U)) },          /* ö */
+  { 0x00F9U, KEY(0x34U) },                      /* ù */
+  { 0x00FBU, DEAD(1, LETTER(0x18U)) },          /* û */
+  { 0x00FCU, DEAD(2, LETTER(0x18U)) },          /* ü */
+  { 0x00FFU, DEAD(2, LETTER(0x1CU)) },          /* ÿ */
+  { 0x20ACU, ALTGR(0x08U) },                    /* € */
+};
+
+/* Dead keys */
+static const uint16_t kbd_de_dead[] =
+{
+  KEY(0x35U),                                   /* 1: circumflex */
+  KEY(0x2EU),                                   /* 2: acute */
+  SHIFT(0x2EU),                                 /* 3: grave */
+};
+
+static const uint16_t kbd_fr_dead[] =
+{
+  KEY(0x2FU),                                   /* 1: circumflex */
+  SHIFT(0x2FU),                                 /* 2: diaeresis */
+};
+
+static const kbd_layout_t kbd_layouts[KBD_LAYOUT_COUNT] =
+{
+  [KBD_LAYOUT_US] = { "us", kbd_us_ascii, NULL, 0U, NULL },
+  [KBD_LAYOUT_UK] = { "uk", kbd_uk_ascii, KBD_EXTRA(kbd_uk_extra), NULL },
+  [KBD_LAYOUT_DE] = { "de", kbd_de_ascii, KBD_EXTRA(kbd_de_extra), kbd_de_dead },
+  [KBD_LAYOUT_FR] = { "fr", kbd_fr_ascii, KBD_EXTRA(kbd_fr_extra), kbd_fr_dead },
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t kbd_layout_search(const kbd_layout_entry_t *table, uint32_t count, uint32_t codepoint);
+static void kbd_layout_stroke(uint16_t key, kbd_stroke_t *stroke);
+
+/**
+  * @brief  Find the keystrokes that type a character.
+  * @param  layout: kbd_layout_id_t
+  * @param  codepoint: Unicode code point
+  * @param  strokes: receives up to KBD_STROKES_MAX keystrokes, in order
+  * @retval number of keystrokes, 0 when the layout cannot type the character
+  */
+uint8_t kbd_layout_lookup(uint8_t layout, uint32_t codepoint, kbd_stroke_t *strokes)
+{
+  const kbd_layout_t *map;
+  uint16_t key;
+  uint32_t dead;
+  uint8_t count = 0U;
+
+  if (layout >= (uint8_t)KBD_LAYOUT_COUNT)
+  {
+    return 0U;
+  }
+  map = &kbd_layouts[layout];
+
+  if ((codepoint >= KBD_ASCII_FIRST) && (codepoint <= KBD_ASCII_LAST))
+  {
+    key = map->ascii[codepoint - KBD_ASCII_FIRST];
+  }
+  else if (codepoint < KBD_ASCII_FIRST)
+  {
+    key = kbd_layout_search(kbd_control_keys, sizeof(kbd_control_keys) / sizeof(kbd_control_keys[0]), codepoint);
+  }
+  else
+  {
+    key = kbd_layout_search(map->extra, map->extra_count, codepoint);
+  }
+
+  if (key == 0U)
+  {
+    return 0U;
+  }
+
+  dead = ((uint32_t)key & KBD_KEY_DEAD_MASK) >> KBD_KEY_DEAD_POS;
+  if (dead != 0U)
+  {
+    kbd_layout_stroke(map->dead[dead - 1U], &strokes[count++]);
+  }
+  kbd_layout_stroke(key, &strokes[count++]);
+
+  return count;
+}
+
+/**
+  * @brief  Short name of a layout.
+  * @param  layout: kbd_layout_id_t
+  * @retval name, "" for an unknown layout
+  */
+const char *kbd_layout_name(uint8_t layout)
+{
+  return (layout < (uint8_t)KBD_LAYOUT_COUNT) ? kbd_layouts[layout].name : "";
+}
+
+/**
+  * @brief  Bisect a table sorted by code point.
+  * @param  table: entries, ascending code points
+  * @param  count: number of entries
+  * @param  codepoint: code point to find
+  * @retval key, 0 when absent
+  */
+static uint16_t kbd_layout_search(const kbd_layout_entry_t *table, uint32_t count, uint32_t codepoint)
+{
+  uint32_t low = 0U;
+  uint32_t high = count;
+  uint32_t mid;
+
+  while (low < high)
+  {
+    mid = (low + high) / 2U;
+    if (table[mid].codepoint < codepoint)
+    {
+      low = mid + 1U;
+    }
+    else
+    {
+      high = mid;
+    }
+  }
+
+  return ((low < count) && (table[low].codepoint == codepoint)) ? table[low].key : 0U;
+}
+
+/**
+  * @brief  Unpack a key into a keystroke.
+  * @param  key: packed key
+  * @param  stroke: filled with usage and modifiers
+  * @retval None
+  */
+static void kbd_layout_stroke(uint16_t key, kbd_stroke_t *stroke)
+{
+  stroke->usage = (uint8_t)(key & KBD_KEY_USAGE_MASK);
+  stroke->modifiers = (uint8_t)((((key & KBD_KEY_SHIFT) != 0U) ? KBD_MOD_LSHIFT : 0U) |
+                                (((key & KBD_KEY_ALTGR) != 0U) ? KBD_MOD_RALT : 0U));
+  stroke->caps = ((key & KBD_KEY_CAPS) != 0U) ? 1U : 0U;
+}
@@ -0,0 +1,106 @@
+/**
+  ******************************************************************************
+  * @file           : key_events.c
+  * @brief          : ISR-safe queue of timestamped key edges
+  ******************************************************************************
+  * The queue has a single producer (the matrix scan interrupt) and a single
+  * consumer (the main loop), so head and tail each have exactly one writer
+  * and no locking is needed.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "key_events.h"
+#include "main.h"
+
+/* Private define ------------------------------------------------------------*/
+#if ((KEY_EVENT_QUEUE_SIZE & (KEY_EVENT_QUEUE_SIZE - 1U)) != 0U)
+#error "KEY_EVENT_QUEUE_SIZE must be a power of two"
+#endif /* KEY_EVENT_QUEUE_SIZE */
+
+#define KEY_EVENT_QUEUE_MASK      (KEY_EVENT_QUEUE_SIZE - 1U)
+
+/* Private variables ---------------------------------------------------------*/
+static key_event_t key_queue[KEY_EVENT_QUEUE_SIZE];
+static volatile uint32_t key_queue_head;
+static volatile uint32_t key_queue_tail;
+static volatile uint32_t key_queue_dropped;
+
+/**
+  * @brief  Empty the queue.
+  * @retval None
+  */
+void key_events_init(void)
+{
+  key_queue_head = 0U;
+  key_queue_tail = 0U;
+  key_queue_dropped = 0U;
+}
+
+/**
+  * @brief  Append an edge to the queue, called from interrupt context.
+  * @param  key: raw key bitmap index
+  * @param  pressed: new level of the key
+  * @param  timestamp: capture time in DWT cycles
+  * @retval 1 if queued, 0 if the queue was full and the edge was dropped
+  */
+uint8_t key_events_push(uint8_t key, uint8_t pressed, uint32_t timestamp)
+{
+  uint32_t head = key_queue_head;
+  key_event_t *event;
+
+  if ((head - key_queue_tail) >= KEY_EVENT_QUEUE_SIZE)
+  {
+    key_queue_dropped++;
+    return 0U;
+  }
+
+  event = &key_queue[head & KEY_EVENT_QUEUE_MASK];
+  event->timestamp = timestamp;
+  event->key = key;
+  event->pressed = pressed;
+
+  __DMB();
+  key_queue_head = head + 1U;
+
+  return 1U;
+}
+
+/**
+  * @brief  Remove the oldest edge from the queue, called from the main loop.
+  * @param  event: receives the edge
+  * @retval 1 if an edge was returned, 0 if the queue is empty
+  */
+uint8_t key_events_pop(key_event_t *event)
+{
+  uint32_t tail = key_queue_tail;
+
+  if (tail == key_queue_head)
+  {
+    return 0U;
+  }
+
+  __DMB();
+  *event = key_queue[tail & KEY_EVENT_QUEUE_MASK];
+  key_queue_tail = tail + 1U;
+
+  return 1U;
+}
+
+/**
+  * @brief  Drop every queued edge, called from the main loop.
+  * @retval None
+  */
+void key_events_flush(void)
+{
+  key_queue_tail = key_queue_head;
+}
+
+/**
+  * @brief  Number of edges lost because the queue was full.
+  * @retval dropped edge count
+  */
+uint32_t key_events_dropped(void)
+{
+  return key_queue_dropped;
+}
@@ -0,0 +1,408 @@
+/**
+  ******************************************************************************
+  * @file           : keyboard.c
+  * @brief          : Key capture to HID report pipeline
+  ******************************************************************************
+  * Every matrix scan (matrix_scan.c) is merged with the levels of the direct
+  * keys, which EXTI interrupts keep up to date, into one raw key bitmap. The
+  * bitmap runs through the debouncer (debounce.c) and every debounced change
+  * is queued with the cycle count of its capture (key_events.c), all in the
+  * scan interrupt. keyboard_task() runs from the main loop, never blocks,
+  * and turns every queued change into one HID report so that no press or
+  * release is merged away, however fast the keys are hit. When the HID IN
+  * queue is full the edges wait in the event queue until the pending
+  * report has been taken. Should the event queue overflow as well, the
+  * edges in it no longer add up to the key state: they are dropped, and one
+  * report of the debounced state takes their place so that no key is left
+  * down on the host.
+  *
+  * Accepted key states are collected in a usage bitmap which is encoded as
+  * the NKRO report, or as the 6-key boot report when the host has selected
+  * the boot protocol. A protocol switch resends the current state at once.
+  *
+  * Text from the typing engine (typing.c) goes through the same reports: its
+  * keys are merged into the state of the physical ones. It takes one step
+  * whenever the HID IN queue holds TYPING_QUEUE_AHEAD reports or fewer, so
+  * the host gets a typed report at every poll while a key change never
+  * waits behind more than that. A playing macro (macro.c) is paced the same
+  * way, after the typed text, and its keys are merged in as well.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "keyboard.h"
+#include "debounce.h"
+#include "hid_keyboard.h"
+#include "key_events.h"
+#include "latency_trace.h"
+#include "macro.h"
+#include "main.h"
+#include "matrix_scan.h"
+#include "typing.h"
+#include "usbd_hid.h"
+#include "usb_device.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  GPIO_TypeDef *port;
+  uint16_t      pin;
+  uint8_t       usage;   /* HID Keyboard/Keypad page usage */
+} keyboard_key_t;
+
+/* Private define ------------------------------------------------------------*/
+#define KEYBOARD_NUM_DIRECT_KEYS  (sizeof(keyboard_keys) / sizeof(keyboard_keys[0]))
+/* Key n of the raw bitmap is matrix key n, direct keys start at the next word */
+#define KEYBOARD_DIRECT_WORD      MATRIX_WORDS
+#define KEYBOARD_DIRECT_BASE      (KEYBOARD_DIRECT_WORD * 32U)
+
+#define KEYBOARD_DEBOUNCE_SCANS   ((KEYBOARD_DEBOUNCE_MS * MATRIX_SCAN_HZ) / 1000U)
+
+#if (KEYBOARD_DIRECT_WORD >= DEBOUNCE_WORDS)
+#error "DEBOUNCE_WORDS is too small for the matrix and the direct keys"
+#endif /* KEYBOARD_DIRECT_WORD */
+
+#if (KEYBOARD_DEBOUNCE_SCANS == 0U) || (KEYBOARD_DEBOUNCE_SCANS > DEBOUNCE_COUNTER_MAX)
+#error "KEYBOARD_DEBOUNCE_MS does not fit the debounce counters at MATRIX_SCAN_HZ"
+#endif /* KEYBOARD_DEBOUNCE_SCANS */
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+static const keyboard_key_t keyboard_keys[] =
+{
+  { GPIOA, GPIO_PIN_0, 0x4EU },   /* Blue USER button: Page Down */
+};
+
+/* HID usage of each matrix key, one line per column */
+static const uint8_t keyboard_matrix_map[MATRIX_KEYS] =
+{
+  0x29U, 0x1EU, 0x1FU, 0x20U, 0x21U, 0x22U, 0x23U, 0x24U,   /* Esc 1 2 3 4 5 6 7   */
+  0x2BU, 0x14U, 0x1AU, 0x08U, 0x15U, 0x17U, 0x1CU, 0x18U,   /* Tab Q W E R T Y U   */
+  0x39U, 0x04U, 0x16U, 0x07U, 0x09U, 0x0AU, 0x0BU, 0x0DU,   /* Caps A S D F G H J  */
+  0xE1U, 0x1DU, 0x1BU, 0x06U, 0x19U, 0x05U, 0x11U, 0x10U,   /* LShift Z X C V B N M */
+  0xE0U, 0xE3U, 0xE2U, 0x2CU, 0xE6U, 0xE7U, 0x65U, 0xE4U,   /* LCtrl LGui LAlt Space RAlt RGui Menu RCtrl */
+  0x25U, 0x26U, 0x27U, 0x2DU, 0x2EU, 0x2AU, 0x49U, 0x4AU,   /* 8 9 0 - = Backspace Insert Home */
+  0x0CU, 0x12U, 0x13U, 0x2FU, 0x30U, 0x31U, 0x4CU, 0x4DU,   /* I O P [ ] \ Delete End */
+  0x0EU, 0x0FU, 0x33U, 0x34U, 0x28U, 0xE5U, 0x52U, 0x51U,   /* K L ; ' Enter RShift Up Down */
+};
+
+static debounce_t key_debounce;
+static volatile uint32_t direct_raw;
+static volatile uint32_t direct_edge_cycles;
+static hid_key_state_t usage_state;
+static uint8_t  report_protocol;
+static uint8_t  report_pending;
+static volatile uint8_t key_overflow;   /* an edge was dropped on a full event queue */
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t keyboard_read_direct(uint8_t key);
+static uint8_t keyboard_usage(uint8_t key);
+static uint8_t keyboard_typing_room(void);
+static void keyboard_resync(void);
+static void keyboard_send_report(void);
+
+/**
+  * @brief  Reset the key state, the debouncer and the edge queue.
+  * @note   Call before matrix_scan_start().
+  * @retval None
+  */
+void keyboard_init(void)
+{
+  uint32_t raw[DEBOUNCE_WORDS] = {0};
+  uint32_t word;
+  uint8_t key;
+
+  key_events_init();
+  typing_init();
+  hid_key_state_clear(&usage_state);
+
+  direct_raw = 0U;
+  for (key = 0U; key < KEYBOARD_NUM_DIRECT_KEYS; key++)
+  {
+    direct_raw |= (uint32_t)keyboard_read_direct(key) << key;
+  }
+
+  for (word = 0U; word < MATRIX_WORDS; word++)
+  {
+    raw[word] = matrix_scan_get_state()->bits[word];
+  }
+  raw[KEYBOARD_DIRECT_WORD] = direct_raw;
+
+  debounce_init(&key_debounce, KEYBOARD_DEBOUNCE_MODE, (uint8_t)KEYBOARD_DEBOUNCE_SCANS, raw);
+
+  for (key = 0U; key < MATRIX_KEYS; key++)
+  {
+    hid_key_state_set(&usage_state, keyboard_usage(key), matrix_key_is_down(matrix_scan_get_state(), key));
+  }
+  for (key = 0U; key < KEYBOARD_NUM_DIRECT_KEYS; key++)
+  {
+    hid_key_state_set(&usage_state, keyboard_keys[key].usage, (uint8_t)((direct_raw >> key) & 1U));
+  }
+
+  report_protocol = HID_KBD_PROTOCOL_REPORT;
+  report_pending = 0U;
+  key_overflow = 0U;
+}
+
+/**
+  * @brief  Capture an edge on a key line, called from HAL_GPIO_EXTI_Callback.
+  * @param  gpio_pin: EXTI line that fired
+  * @retval None
+  */
+void keyboard_gpio_edge(uint16_t gpio_pin)
+{
+  uint8_t key;
+
+  direct_edge_cycles = latency_trace_now();
+
+  for (key = 0U; key < KEYBOARD_NUM_DIRECT_KEYS; key++)
+  {
+    if (keyboard_keys[key].pin == gpio_pin)
+    {
+      if (keyboard_read_direct(key) != 0U)
+      {
+        direct_raw |= (1UL << key);
+      }
+      else
+      {
+        direct_raw &= ~(1UL << key);
+      }
+    }
+  }
+}
+
+/**
+  * @brief  Change the debounce algorithm and time, the key state is kept.
+  * @note   Call from an interrupt at the matrix scan priority, or with it masked.
+  * @param  mode: debounce algorithm
+  * @param  debounce_ms: debounce time, clamped to what the counters can hold
+  * @retval None
+  */
+void keyboard_set_debounce(debounce_mode_t mode, uint8_t debounce_ms)
+{
+  uint32_t scans = ((uint32_t)debounce_ms * MATRIX_SCAN_HZ) / 1000U;
+
+  if (scans > DEBOUNCE_COUNTER_MAX)
+  {
+    scans = DEBOUNCE_COUNTER_MAX;
+  }
+
+  debounce_configure(&key_debounce, mode, (uint8_t)scans);
+}
+
+/**
+  * @brief  Lock LEDs last set by the host, cached by the HID class.
+  * @retval HID_KBD_LED_xxx bitmap
+  */
+uint8_t keyboard_get_leds(void)
+{
+  return USBD_HID_GetLedState(&hUsbDeviceFS);
+}
+
+/**
+  * @brief  Debounce a scan and queue an edge for every key that changed.
+  * @note   Runs from the matrix DMA interrupt, at the EXTI priority.
+  * @param  state: key bitmap of the completed scan
+  * @retval None
+  */
+void matrix_scan_complete_callback(const matrix_bitmap_t *state)
+{
+  uint32_t scan_cycles = latency_trace_now();
+  uint32_t raw[DEBOUNCE_WORDS] = {0};
+  uint32_t changed[DEBOUNCE_WORDS];
+  uint32_t edge_cycles;
+  uint32_t word;
+  uint32_t diff;
+  uint32_t bit;
+
+  for (word = 0U; word < MATRIX_WORDS; word++)
+  {
+    raw[word] = state->bits[word];
+  }
+  raw[KEYBOARD_DIRECT_WORD] = direct_raw;
+
+  if (debounce_update(&key_debounce, raw, changed) == 0U)
+  {
+    return;
+  }
+
+  /* A direct key change dates from its EXTI edge, a matrix one from this scan */
+  latency_trace_begin((changed[KEYBOARD_DIRECT_WORD] != 0U) ? direct_edge_cycles : scan_cycles,
+                      latency_trace_now());
+
+  for (word = 0U; word < DEBOUNCE_WORDS; word++)
+  {
+    edge_cycles = (word == KEYBOARD_DIRECT_WORD) ? direct_edge_cycles : scan_cycles;
+    diff = changed[word];
+    while (diff != 0U)
+    {
+      bit = (uint32_t)__builtin_ctz(diff);
+      diff &= diff - 1U;
+      if (key_events_push((uint8_t)((word * 32U) + bit), (uint8_t)((key_debounce.state[word] >> bit) & 1U),
+                          edge_cycles) == 0U)
+      {
+        key_overflow = 1U;
+      }
+    }
+  }
+}
+
+/**
+  * @brief  Consume debounced edges and emit HID reports, never blocks.
+  * @retval None
+  */
+void keyboard_task(void)
+{
+  key_event_t event;
+
+  /* Retry a report the HID queue could not take, or switch report layout */
+  if ((report_pending != 0U) || (USBD_HID_GetProtocol(&hUsbDeviceFS) != report_protocol))
+  {
+    keyboard_send_report();
+  }
+
+  /* Edges were lost: report the debounced state instead of the queued ones */
+  if ((report_pending == 0U) && (key_overflow != 0U))
+  {
+    keyboard_resync();
+  }
+
+  /* One report per edge; while a report waits the edges stay queued, as
+     applying them to the state now would merge them into that report */
+  while ((report_pending == 0U) && (key_events_pop(&event) != 0U))
+  {
+    hid_key_state_set(&usage_state, keyboard_usage(event.key), event.pressed);
+    keyboard_send_report();
+  }
+
+  /* Typed text, one report at a time behind the key changes */
+  if ((report_pending == 0U) && (USBD_HID_GetQueueDepth(&hUsbDeviceFS) <= TYPING_QUEUE_AHEAD) &&
+      (typing_step(keyboard_typing_room(), USBD_HID_GetLedState(&hUsbDeviceFS)) != 0U))
+  {
+    keyboard_send_report();
+  }
+
+  /* Macro playback, paced like the typed text */
+  if ((report_pending == 0U) && (USBD_HID_GetQueueDepth(&hUsbDeviceFS) <= TYPING_QUEUE_AHEAD) &&
+      (macro_step(HAL_GetTick()) != 0U))
+  {
+    keyboard_send_report();
+  }
+}
+
+/**
+  * @brief  Read the current level of a direct key.
+  * @param  key: direct key table index
+  * @retval 1 if pressed
+  */
+static uint8_t keyboard_read_direct(uint8_t key)
+{
+  return (HAL_GPIO_ReadPin(keyboard_keys[key].port, keyboard_keys[key].pin) == GPIO_PIN_SET) ? 1U : 0U;
+}
+
+/**
+  * @brief  HID usage reported for a key.
+  * @param  key: raw bitmap index
+  * @retval Keyboard/Keypad page usage
+  */
+static uint8_t keyboard_usage(uint8_t key)
+{
+  if (key >= KEYBOARD_DIRECT_BASE)
+  {
+    return keyboard_keys[key - KEYBOARD_DIRECT_BASE].usage;
+  }
+
+  return keyboard_matrix_map[key];
+}
+
+/**
+  * @brief  Typed keys the next report can hold next to the physical keys down.
+  * @retval number of keys, 0 when the keycode array is full
+  */
+static uint8_t keyboard_typing_room(void)
+{
+  uint32_t held = 0U;
+  uint32_t max;
+  uint32_t w;
+
+  if (USBD_HID_GetProtocol(&hUsbDeviceFS) == HID_KBD_PROTOCOL_BOOT)
+  {
+    max = HID_KBD_BOOT_KEYCODES;
+  }
+  else
+  {
+#if (HID_KBD_NKRO_ENABLED == 1U)
+    max = TYPING_ROLLOVER_MAX;
+#else
+    max = HID_KBD_6KRO_KEYCODES;
+#endif /* HID_KBD_NKRO_ENABLED */
+  }
+
+  /* Modifiers take no slot in the keycode array */
+  for (w = 0U; w < (HID_USAGE_MODIFIER_FIRST >> 5); w++)
+  {
+    held += (uint32_t)__builtin_popcount(usage_state.bits[w]);
+  }
+
+  return (held < max) ? (uint8_t)(max - held) : 0U;
+}
+
+/**
+  * @brief  Drop the queued edges and report the debounced key state.
+  * @note   An edge queued while the state is read is in it already, and
+  *         applying it again changes nothing.
+  * @retval None
+  */
+static void keyboard_resync(void)
+{
+  uint32_t word;
+  uint8_t key;
+
+  key_overflow = 0U;
+  key_events_flush();
+
+  hid_key_state_clear(&usage_state);
+  for (key = 0U; key < MATRIX_KEYS; key++)
+  {
+    word = key_debounce.state[key / 32U];
+    hid_key_state_set(&usage_state, keyboard_usage(key), (uint8_t)((word >> (key % 32U)) & 1U));
+  }
+  for (key = 0U; key < KEYBOARD_NUM_DIRECT_KEYS; key++)
+  {
+    word = key_debounce.state[KEYBOARD_DIRECT_WORD];
+    hid_key_state_set(&usage_state, keyboard_keys[key].usage, (uint8_t)((word >> key) & 1U));
+  }
+
+  keyboard_send_report();
+}
+
+/**
+  * @brief  Encode the key state for the current protocol and queue the report.
+  * @note   The keys held by the typing engine and the macro are merged in.
+  * @retval None
+  */
+static void keyboard_send_report(void)
+{
+  const hid_key_state_t *typed = typing_get_keys();
+  const hid_key_state_t *played = macro_get_keys();
+  hid_key_state_t state;
+  uint8_t report[HID_KBD_MAX_REPORT_SIZE];
+  uint16_t len;
+  uint32_t w;
+
+  for (w = 0U; w < (sizeof(state.bits) / sizeof(state.bits[0])); w++)
+  {
+    state.bits[w] = usage_state.bits[w] | typed->bits[w] | played->bits[w];
+  }
+
+  report_protocol = USBD_HID_GetProtocol(&hUsbDeviceFS);
+  len = hid_kbd_encode(&state, report_protocol, report);
+  latency_trace_stamp(LATENCY_STAMP_ENCODE);
+
+#ifdef USE_USBD_COMPOSITE
+  report_pending = (USBD_HID_SendReport(&hUsbDeviceFS, report, len, HID_InstID) == (uint8_t)USBD_BUSY) ? 1U : 0U;
+#else
+  report_pending = (USBD_HID_SendReport(&hUsbDeviceFS, report, len) == (uint8_t)USBD_BUSY) ? 1U : 0U;
+#endif /* USE_USBD_COMPOSITE */
+}
@@ -0,0 +1,484 @@
+/**
+  ******************************************************************************
+  * @file           : latency_trace.c
+  * @brief          : Button to wire latency histograms from the DWT cycle counter
+  ******************************************************************************
+  * One key change at a time is followed through the pipeline: the scan or
+  * EXTI edge that saw it, the debounce commit, the report encode, the IN
+  * transfer start and its completion. Each stamp is taken only once the
+  * previous one has been, so changes arriving while a trace is in flight are
+  * not traced. When the transfer completes, every interval and the total go
+  * into log2 histograms with their count, min and max.
+  *
+  * Stamps come from the main loop and from interrupts, the state is updated
+  * with interrupts masked. Separate histograms take the cycles of the USB
+  * and key scan interrupt handlers, each written only by its own handler.
+  *
+  * Enumeration is traced from the first bus reset to the SET_CONFIGURATION
+  * that configures the device, by the PCD callbacks: each control request
+  * is counted under its stage, with when it came and how many cycles the
+  * device spent on its setup and data stages. A reset once configured
+  * starts a new trace. The module only needs DWT->CYCCNT and
+  * SystemCoreClock, so the simulator builds it against a virtual counter.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "latency_trace.h"
+#include "usbd_def.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Enumeration trace state */
+#define TRACE_ENUM_IDLE           0x00U   /* no reset yet */
+#define TRACE_ENUM_RUNNING        0x01U
+#define TRACE_ENUM_CONFIGURED     0x02U
+
+/* Private variables ---------------------------------------------------------*/
+static latency_hist_t trace_hist[LATENCY_INTERVALS];
+static latency_hist_t trace_isr[LATENCY_ISRS];
+static uint32_t trace_stamp[LATENCY_STAMPS];
+static latency_stamp_t trace_next;
+static uint8_t trace_selected;
+static uint8_t trace_first_bucket;
+static latency_enum_stage_t trace_enum[LATENCY_ENUMS];
+static uint32_t trace_enum_base;              /* cycle count of the first reset */
+static uint32_t trace_enum_request;           /* cycles of the request in progress */
+static latency_enum_t trace_enum_stage;       /* stage of the request in progress */
+static uint8_t trace_enum_state;
+
+/* Private function prototypes -----------------------------------------------*/
+static void latency_trace_enum_begin(latency_enum_t stage, uint32_t start);
+static void latency_trace_enum_add(uint32_t start);
+static void latency_trace_put32(uint8_t *dst, uint32_t value);
+
+/**
+  * @brief  Start the DWT cycle counter and clear the histograms.
+  * @retval None
+  */
+void latency_trace_init(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0U;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  trace_selected = (uint8_t)LATENCY_INTERVAL_TOTAL;
+  trace_first_bucket = 0U;
+  trace_enum_state = TRACE_ENUM_IDLE;
+  latency_trace_reset();
+}
+
+/**
+  * @brief  Clear the histograms and drop the trace in flight.
+  * @retval None
+  */
+void latency_trace_reset(void)
+{
+  uint32_t primask;
+  uint32_t i;
+  uint32_t b;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  for (i = 0U; i < LATENCY_INTERVALS; i++)
+  {
+    trace_hist[i].count = 0U;
+    trace_hist[i].min = UINT32_MAX;
+    trace_hist[i].max = 0U;
+    for (b = 0U; b < LATENCY_TRACE_BUCKETS; b++)
+    {
+      trace_hist[i].bucket[b] = 0U;
+    }
+  }
+  for (i = 0U; i < LATENCY_ISRS; i++)
+  {
+    trace_isr[i].count = 0U;
+    trace_isr[i].min = UINT32_MAX;
+    trace_isr[i].max = 0U;
+    for (b = 0U; b < LATENCY_TRACE_BUCKETS; b++)
+    {
+      trace_isr[i].bucket[b] = 0U;
+    }
+  }
+  trace_next = LATENCY_STAMP_EDGE;
+
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Start a trace at a debounced change, unless one is in flight.
+  * @note   A trace older than LATENCY_TRACE_TIMEOUT_MS is dropped: its
+  *         report was merged with a later one or never sent.
+  * @param  edge: cycle count of the edge or scan that saw the change
+  * @param  debounce: cycle count of the debounce commit
+  * @retval None
+  */
+void latency_trace_begin(uint32_t edge, uint32_t debounce)
+{
+  uint32_t primask;
+  uint32_t timeout = (SystemCoreClock / 1000U) * LATENCY_TRACE_TIMEOUT_MS;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  if ((trace_next == LATENCY_STAMP_EDGE) || ((debounce - trace_stamp[LATENCY_STAMP_EDGE]) > timeout))
+  {
+    trace_stamp[LATENCY_STAMP_EDGE] = edge;
+    trace_stamp[LATENCY_STAMP_DEBOUNCE] = debounce;
+    trace_next = LATENCY_STAMP_ENCODE;
+  }
+
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Stamp a pipeline point; the completion stamp closes the trace.
+  * @param  stamp: pipeline point reached now
+  * @retval None
+  */
+void latency_trace_stamp(latency_stamp_t stamp)
+{
+  uint32_t primask;
+  uint32_t now = latency_trace_now();
+  uint32_t i;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  if ((stamp == trace_next) && (stamp != LATENCY_STAMP_EDGE))
+  {
+    trace_stamp[stamp] = now;
+
+    if (stamp == LATENCY_STAMP_COMPLETE)
+    {
+      for (i = 0U; i < (uint32_t)LATENCY_INTERVAL_TOTAL; i++)
+      {
+        latency_trace_add(&trace_hist[i], trace_stamp[i + 1U] - trace_stamp[i]);
+      }
+      latency_trace_add(&trace_hist[LATENCY_INTERVAL_TOTAL],
+                        trace_stamp[LATENCY_STAMP_COMPLETE] - trace_stamp[LATENCY_STAMP_EDGE]);
+      trace_next = LATENCY_STAMP_EDGE;
+    }
+    else
+    {
+      trace_next = (latency_stamp_t)(stamp + 1U);
+    }
+  }
+
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Account for one interval in a histogram.
+  * @param  hist: histogram
+  * @param  cycles: interval length
+  * @retval None
+  */
+void latency_trace_add(latency_hist_t *hist, uint32_t cycles)
+{
+  uint8_t b = latency_trace_bucket(cycles);
+
+  hist->count++;
+  if (cycles < hist->min)
+  {
+    hist->min = cycles;
+  }
+  if (cycles > hist->max)
+  {
+    hist->max = cycles;
+  }
+  if (hist->bucket[b] != UINT16_MAX)
+  {
+    hist->bucket[b]++;
+  }
+}
+
+/**
+  * @brief  Histogram bucket of an interval.
+  * @param  cycles: interval length
+  * @retval bucket index, 0 to LATENCY_TRACE_BUCKETS - 1
+  */
+uint8_t latency_trace_bucket(uint32_t cycles)
+{
+  uint32_t b;
+
+  if ((cycles >> LATENCY_TRACE_BUCKET_SHIFT) == 0U)
+  {
+    return 0U;
+  }
+
+  b = 31U - (uint32_t)__builtin_clz(cycles) - LATENCY_TRACE_BUCKET_SHIFT;
+  return (uint8_t)((b < LATENCY_TRACE_BUCKETS) ? b : (LATENCY_TRACE_BUCKETS - 1U));
+}
+
+/**
+  * @brief  Read access to one histogram.
+  * @param  interval: histogram index
+  * @retval histogram, NULL if out of range
+  */
+const latency_hist_t *latency_trace_get(latency_interval_t interval)
+{
+  return (interval < LATENCY_INTERVALS) ? &trace_hist[interval] : NULL;
+}
+
+/**
+  * @brief  Account for one run of an interrupt handler, called at its exit.
+  * @note   Leaves out the 12 cycle exception entry and the exit.
+  * @param  isr: handler
+  * @param  start: latency_trace_now() at the handler entry
+  * @retval None
+  */
+void latency_trace_isr(latency_isr_t isr, uint32_t start)
+{
+  if (isr < LATENCY_ISRS)
+  {
+    latency_trace_add(&trace_isr[isr], latency_trace_now() - start);
+  }
+}
+
+/**
+  * @brief  Read access to the cycles of one interrupt handler.
+  * @param  isr: handler
+  * @retval histogram, NULL if out of range
+  */
+const latency_hist_t *latency_trace_get_isr(latency_isr_t isr)
+{
+  return (isr < LATENCY_ISRS) ? &trace_isr[isr] : NULL;
+}
+
+/**
+  * @brief  Account for a bus reset, called at the end of the reset callback.
+  * @note   The first reset, or the first once configured, clears the trace.
+  * @param  start: latency_trace_now() at the callback entry
+  * @retval None
+  */
+void latency_trace_enum_reset(uint32_t start)
+{
+  uint32_t i;
+
+  if (trace_enum_state != TRACE_ENUM_RUNNING)
+  {
+    for (i = 0U; i < LATENCY_ENUMS; i++)
+    {
+      trace_enum[i].count = 0U;
+      trace_enum[i].first = 0U;
+      trace_enum[i].last = 0U;
+      trace_enum[i].cycles = 0U;
+      trace_enum[i].max = 0U;
+    }
+    trace_enum_base = start;
+    trace_enum_state = TRACE_ENUM_RUNNING;
+  }
+
+  latency_trace_enum_begin(LATENCY_ENUM_RESET, start);
+  latency_trace_enum_add(start);
+}
+
+/**
+  * @brief  Account for a SETUP, called at the end of the setup stage callback.
+  * @note   Standard device requests name their stage, any other one is
+  *         LATENCY_ENUM_OTHER. SET_CONFIGURATION to a non-zero value ends
+  *         the trace.
+  * @param  setup: 8-byte request
+  * @param  start: latency_trace_now() at the callback entry
+  * @retval None
+  */
+void latency_trace_enum_setup(const uint8_t *setup, uint32_t start)
+{
+  latency_enum_t stage = LATENCY_ENUM_OTHER;
+
+  if (trace_enum_state != TRACE_ENUM_RUNNING)
+  {
+    return;
+  }
+
+  /* Standard request to the device: bmRequestType 0x00 or 0x80 */
+  if ((setup[0] & 0x7FU) == 0x00U)
+  {
+    switch (setup[1])
+    {
+      case USB_REQ_GET_DESCRIPTOR:
+        if (setup[3] == USB_DESC_TYPE_DEVICE)
+        {
+          stage = LATENCY_ENUM_DEVICE;
+        }
+        else if (setup[3] == USB_DESC_TYPE_CONFIGURATION)
+        {
+          stage = LATENCY_ENUM_CONFIG_DESC;
+        }
+        else if (setup[3] == USB_DESC_TYPE_STRING)
+        {
+          stage = LATENCY_ENUM_STRING;
+        }
+        else
+        {
+          /* Qualifier, BOS, other speed configuration */
+        }
+        break;
+
+      case USB_REQ_SET_ADDRESS:
+        stage = LATENCY_ENUM_ADDRESS;
+        break;
+
+      case USB_REQ_SET_CONFIGURATION:
+        stage = LATENCY_ENUM_CONFIGURE;
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  latency_trace_enum_begin(stage, start);
+  latency_trace_enum_add(start);
+
+  if ((stage == LATENCY_ENUM_CONFIGURE) && (setup[2] != 0U))
+  {
+    trace_enum_state = TRACE_ENUM_CONFIGURED;
+  }
+}
+
+/**
+  * @brief  Account for a control endpoint data or status stage of the
+  *         request in progress, called at the end of its callback.
+  * @param  start: latency_trace_now() at the callback entry
+  * @retval None
+  */
+void latency_trace_enum_data(uint32_t start)
+{
+  if (trace_enum_state == TRACE_ENUM_RUNNING)
+  {
+    latency_trace_enum_add(start);
+  }
+}
+
+/**
+  * @brief  Read access to one enumeration stage of the last trace.
+  * @param  stage: stage
+  * @retval stage, NULL if out of range
+  */
+const latency_enum_stage_t *latency_trace_get_enum(latency_enum_t stage)
+{
+  return (stage < LATENCY_ENUMS) ? &trace_enum[stage] : NULL;
+}
+
+/**
+  * @brief  Build the histogram report selected by the last SET_REPORT.
+  * @param  report: receives the report, ID included
+  * @param  len: buffer size in, report length out
+  * @retval 0, or -1 if the buffer is too small
+  */
+int8_t latency_trace_get_feature(uint8_t *report, uint16_t *len)
+{
+  latency_hist_t hist;
+  uint32_t primask;
+  uint32_t b;
+
+  if (*len < LATENCY_TRACE_REPORT_SIZE)
+  {
+    return -1;
+  }
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  hist = trace_hist[trace_selected];
+  __set_PRIMASK(primask);
+
+  report[0] = LATENCY_TRACE_REPORT_ID;
+  report[1] = trace_selected;
+  report[2] = trace_first_bucket;
+  report[3] = (uint8_t)(SystemCoreClock / 1000000U);
+  latency_trace_put32(&report[4], hist.count);
+  latency_trace_put32(&report[8], (hist.count != 0U) ? hist.min : 0U);
+  latency_trace_put32(&report[12], hist.max);
+  for (b = 0U; b < LATENCY_TRACE_REPORT_BUCKETS; b++)
+  {
+    report[16U + (2U * b)] = (uint8_t)(hist.bucket[trace_first_bucket + b] & 0xFFU);
+    report[17U + (2U * b)] = (uint8_t)(hist.bucket[trace_first_bucket + b] >> 8);
+  }
+
+  *len = LATENCY_TRACE_REPORT_SIZE;
+  return 0;
+}
+
+/**
+  * @brief  Select a histogram page or clear the histograms.
+  * @param  report: [ID][op][interval][first bucket]
+  * @param  len: report length
+  * @retval 0, or -1 on a malformed report
+  */
+int8_t latency_trace_set_feature(const uint8_t *report, uint16_t len)
+{
+  if ((len < 4U) || (report[0] != LATENCY_TRACE_REPORT_ID))
+  {
+    return -1;
+  }
+
+  if (report[1] == LATENCY_TRACE_OP_RESET)
+  {
+    latency_trace_reset();
+    return 0;
+  }
+
+  if ((report[1] != LATENCY_TRACE_OP_SELECT) || (report[2] >= (uint8_t)LATENCY_INTERVALS) ||
+      ((report[3] % LATENCY_TRACE_REPORT_BUCKETS) != 0U) || (report[3] >= LATENCY_TRACE_BUCKETS))
+  {
+    return -1;
+  }
+
+  trace_selected = report[2];
+  trace_first_bucket = report[3];
+  return 0;
+}
+
+/**
+  * @brief  Start a request, or a reset, of the enumeration trace.
+  * @param  stage: its stage
+  * @param  start: latency_trace_now() at the callback entry
+  * @retval None
+  */
+static void latency_trace_enum_begin(latency_enum_t stage, uint32_t start)
+{
+  latency_enum_stage_t *e = &trace_enum[stage];
+
+  if (e->count == 0U)
+  {
+    e->first = start - trace_enum_base;
+  }
+  e->count++;
+  trace_enum_stage = stage;
+  trace_enum_request = 0U;
+}
+
+/**
+  * @brief  Charge one callback to the request in progress.
+  * @param  start: latency_trace_now() at the callback entry
+  * @retval None
+  */
+static void latency_trace_enum_add(uint32_t start)
+{
+  latency_enum_stage_t *e = &trace_enum[trace_enum_stage];
+  uint32_t now = latency_trace_now();
+
+  trace_enum_request += now - start;
+  e->cycles += now - start;
+  if (trace_enum_request > e->max)
+  {
+    e->max = trace_enum_request;
+  }
+  e->last = now - trace_enum_base;
+}
+
+/**
+  * @brief  Store a word little-endian.
+  * @param  dst: destination
+  * @param  value: word
+  * @retval None
+  */
+static void latency_trace_put32(uint8_t *dst, uint32_t value)
+{
+  dst[0] = (uint8_t)(value & 0xFFU);
+  dst[1] = (uint8_t)((value >> 8) & 0xFFU);
+  dst[2] = (uint8_t)((value >> 16) & 0xFFU);
+  dst[3] = (uint8_t)(value >> 24);
+}
@@ -0,0 +1,340 @@
+/**
+  ******************************************************************************
+  * @file           : log_stream.c
+  * @brief          : Lock-free log and metrics stream to the CDC console
+  ******************************************************************************
+  * The ring is an array of words. A record is a header word followed by its
+  * payload, padded to a word; it may wrap around the end of the array.
+  *
+  * Writers reserve space by moving log_head forward with LDREX/STREX, so an
+  * interrupt that logs while the main loop is between the two instructions
+  * makes the main loop's STREX fail and retry with the new head: no lock, no
+  * masked interrupts, and the retry loop only spins again when it was
+  * preempted by another writer. The writer then copies its payload and stores
+  * the header last, after a barrier; a zero header marks a record that is
+  * reserved but not yet written.
+  *
+  * The single reader takes records in order from log_tail, stops at the first
+  * zero header, and zeroes every word it consumed before giving it back, so
+  * any word can later be read as a header.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "log_stream.h"
+#include "main.h"
+#include "latency_trace.h"
+#include "usbd_hid.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define LOG_RING_MASK             (LOG_RING_WORDS - 1U)
+#define LOG_HEADER_READY          0x80000000U
+#define LOG_HEADER_LEN_MASK       0x0000FFFFU
+
+/* Private macro -------------------------------------------------------------*/
+/* Header and payload words of a record */
+#define LOG_RECORD_WORDS(len)     (1U + (((len) + 3U) / 4U))
+
+#if ((LOG_RING_WORDS & LOG_RING_MASK) != 0U) || (LOG_RING_WORDS < (2U * LOG_RECORD_WORDS(LOG_RECORD_MAX)))
+#error "LOG_RING_WORDS must be a power of two holding at least two records"
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+static uint32_t log_ring[LOG_RING_WORDS];
+static volatile uint32_t log_head;        /* next word to reserve, writers */
+static volatile uint32_t log_tail;        /* next word to read, reader */
+static volatile uint32_t log_dropped;     /* writers, atomic */
+static uint32_t log_records;              /* reader only */
+static uint32_t log_bytes;                /* reader only */
+static uint32_t log_metrics_tick;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t log_put(const uint8_t *data, uint32_t len);
+static void log_count_drop(void);
+static uint32_t log_vline(const char *prefix, const char *fmt, va_list args, const char *suffix);
+
+/**
+  * @brief  Empty the ring and clear the statistics.
+  * @note   Call before any writer runs.
+  * @retval None
+  */
+void log_init(void)
+{
+  memset(log_ring, 0, sizeof(log_ring));
+  log_head = 0U;
+  log_tail = 0U;
+  log_dropped = 0U;
+  log_records = 0U;
+  log_bytes = 0U;
+  log_metrics_tick = HAL_GetTick();
+}
+
+/**
+  * @brief  Queue bytes for the console, from any context, without waiting.
+  * @note   Data longer than LOG_RECORD_MAX goes as several records; each
+  *         one is either queued whole or dropped.
+  * @param  data: bytes to send
+  * @param  len: number of bytes
+  * @retval bytes queued
+  */
+uint32_t log_write(const void *data, uint32_t len)
+{
+  const uint8_t *src = (const uint8_t *)data;
+  uint32_t queued = 0U;
+  uint32_t chunk;
+
+  while (len != 0U)
+  {
+    chunk = (len < LOG_RECORD_MAX) ? len : LOG_RECORD_MAX;
+    queued += log_put(src, chunk);
+    src += chunk;
+    len -= chunk;
+  }
+
+  return queued;
+}
+
+/**
+  * @brief  Format and queue a message as one record.
+  * @param  fmt: printf format
+  * @retval bytes queued
+  */
+uint32_t log_printf(const char *fmt, ...)
+{
+  va_list args;
+  uint32_t queued;
+
+  va_start(args, fmt);
+  queued = log_vline("", fmt, args, "");
+  va_end(args);
+
+  return queued;
+}
+
+/**
+  * @brief  Format and queue one line: prefix, message and newline.
+  * @param  prefix: text put before the message
+  * @param  fmt: printf format
+  * @retval bytes queued
+  */
+uint32_t log_line(const char *prefix, const char *fmt, ...)
+{
+  va_list args;
+  uint32_t queued;
+
+  va_start(args, fmt);
+  queued = log_vline(prefix, fmt, args, "\n");
+  va_end(args);
+
+  return queued;
+}
+
+/**
+  * @brief  Take whole records out of the ring, oldest first.
+  * @note   Single reader: call from one context only, the USB interrupt.
+  * @param  buf: receives the payload bytes of the records
+  * @param  max: buffer size, at least LOG_RECORD_MAX to make progress
+  * @retval bytes copied, 0 when no complete record is waiting
+  */
+uint32_t log_read(uint8_t *buf, uint32_t max)
+{
+  uint32_t tail = log_tail;
+  uint32_t count = 0U;
+  uint32_t header;
+  uint32_t len;
+  uint32_t word;
+  uint32_t i;
+
+  while (tail != log_head)
+  {
+    header = log_ring[tail & LOG_RING_MASK];
+
+    /* Reserved, still being written */
+    if ((header & LOG_HEADER_READY) == 0U)
+    {
+      break;
+    }
+
+    len = header & LOG_HEADER_LEN_MASK;
+    if ((count + len) > max)
+    {
+      break;
+    }
+
+    /* Payload reads after the header read */
+    __DMB();
+
+    log_ring[tail & LOG_RING_MASK] = 0U;
+    for (i = 0U; i < len; i += 4U)
+    {
+      word = log_ring[(tail + 1U + (i / 4U)) & LOG_RING_MASK];
+      log_ring[(tail + 1U + (i / 4U)) & LOG_RING_MASK] = 0U;
+      (void)memcpy(&buf[count + i], &word, ((len - i) < 4U) ? (len - i) : 4U);
+    }
+
+    count += len;
+    tail += LOG_RECORD_WORDS(len);
+    log_records++;
+  }
+
+  /* The zeroed words are released only once written */
+  __DMB();
+  log_tail = tail;
+  log_bytes += count;
+
+  return count;
+}
+
+/**
+  * @brief  Stream statistics.
+  * @param  stats: filled with the counters
+  * @retval None
+  */
+void log_get_stats(log_stats_t *stats)
+{
+  stats->records = log_records;
+  stats->bytes = log_bytes;
+  stats->dropped = log_dropped;
+}
+
+/**
+  * @brief  Main loop hook: log a metrics line every LOG_METRICS_PERIOD_MS.
+  * @note   Reports the HID IN queue high-water mark, the worst button to wire
+  *         latency traced so far and the log records dropped, then the
+  *         longest run of the USB and key scan interrupt handlers, and once
+  *         configured, the time from the first bus reset to
+  *         SET_CONFIGURATION with the device side cycles of the requests.
+  * @retval None
+  */
+void log_metrics_task(void)
+{
+#if (LOG_METRICS_PERIOD_MS > 0U)
+  const latency_hist_t *total;
+  const latency_enum_stage_t *configure;
+  uint32_t latency_us = 0U;
+  uint32_t requests = 0U;
+  uint32_t cycles = 0U;
+  uint32_t stage;
+  uint32_t now = HAL_GetTick();
+
+  if ((now - log_metrics_tick) < LOG_METRICS_PERIOD_MS)
+  {
+    return;
+  }
+  log_metrics_tick = now;
+
+  total = latency_trace_get(LATENCY_INTERVAL_TOTAL);
+  if ((total != NULL) && (total->count != 0U))
+  {
+    latency_us = total->max / (SystemCoreClock / 1000000U);
+  }
+
+  (void)log_line("metrics: ", "hid queue max %lu, latency max %lu us, log dropped %lu",
+                 (unsigned long)USBD_HID_GetQueueHighWater(&hUsbDeviceFS), (unsigned long)latency_us,
+                 (unsigned long)log_dropped);
+  (void)log_line("metrics: ", "isr max usb %lu, scan %lu cycles",
+                 (unsigned long)latency_trace_get_isr(LATENCY_ISR_USB)->max,
+                 (unsigned long)latency_trace_get_isr(LATENCY_ISR_SCAN)->max);
+
+  configure = latency_trace_get_enum(LATENCY_ENUM_CONFIGURE);
+  if (configure->count != 0U)
+  {
+    for (stage = LATENCY_ENUM_DEVICE; stage < LATENCY_ENUMS; stage++)
+    {
+      requests += latency_trace_get_enum((latency_enum_t)stage)->count;
+      cycles += latency_trace_get_enum((latency_enum_t)stage)->cycles;
+    }
+    (void)log_line("metrics: ", "enum %lu us, %lu requests, %lu cycles",
+                   (unsigned long)(configure->last / (SystemCoreClock / 1000000U)), (unsigned long)requests,
+                   (unsigned long)cycles);
+  }
+#endif /* LOG_METRICS_PERIOD_MS */
+}
+
+/**
+  * @brief  Reserve, fill and publish one record.
+  * @param  data: payload
+  * @param  len: payload length, 1 to LOG_RECORD_MAX
+  * @retval len, or 0 when the ring was full and the record dropped
+  */
+static uint32_t log_put(const uint8_t *data, uint32_t len)
+{
+  uint32_t words = LOG_RECORD_WORDS(len);
+  uint32_t head;
+  uint32_t word;
+  uint32_t i;
+
+  do
+  {
+    head = __LDREXW(&log_head);
+    if (((head - log_tail) + words) > LOG_RING_WORDS)
+    {
+      __CLREX();
+      log_count_drop();
+      return 0U;
+    }
+  } while (__STREXW(head + words, &log_head) != 0U);
+
+  for (i = 0U; i < len; i += 4U)
+  {
+    word = 0U;
+    (void)memcpy(&word, &data[i], ((len - i) < 4U) ? (len - i) : 4U);
+    log_ring[(head + 1U + (i / 4U)) & LOG_RING_MASK] = word;
+  }
+
+  /* Publish: the reader must not see the header before the payload */
+  __DMB();
+  log_ring[head & LOG_RING_MASK] = LOG_HEADER_READY | len;
+
+  return len;
+}
+
+/**
+  * @brief  Count a dropped record.
+  * @retval None
+  */
+static void log_count_drop(void)
+{
+  uint32_t dropped;
+
+  do
+  {
+    dropped = __LDREXW(&log_dropped);
+  } while (__STREXW(dropped + 1U, &log_dropped) != 0U);
+}
+
+/**
+  * @brief  Format prefix, message and suffix into one record.
+  * @param  prefix: text before the message
+  * @param  fmt: printf format
+  * @param  args: format arguments
+  * @param  suffix: text after the message, kept when the message is truncated
+  * @retval bytes queued
+  */
+static uint32_t log_vline(const char *prefix, const char *fmt, va_list args, const char *suffix)
+{
+  char line[LOG_LINE_MAX];
+  size_t suffix_len = strlen(suffix);
+  size_t room = sizeof(line) - suffix_len;
+  int ret;
+  size_t len;
+
+  ret = snprintf(line, room, "%s", prefix);
+  len = ((ret > 0) && ((size_t)ret < room)) ? (size_t)ret : 0U;
+
+  ret = vsnprintf(&line[len], room - len, fmt, args);
+  if (ret > 0)
+  {
+    len += ((size_t)ret < (room - len)) ? (size_t)ret : (room - len - 1U);
+  }
+
+  (void)memcpy(&line[len], suffix, suffix_len);
+  len += suffix_len;
+
+  return log_write(line, (uint32_t)len);
+}
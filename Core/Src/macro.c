@@ -0,0 +1,576 @@
+/**
+  ******************************************************************************
+  * @file           : macro.c
+  * @brief          : Macro playback from a compressed flash image
+  ******************************************************************************
+  * The decoder reads the macro stream straight from flash and expands pair
+  * bytes on a small stack, so a macro plays in constant RAM whatever its
+  * size. The pair expansion needs no history, which lets a REPEAT block jump
+  * back by resetting the stream position: the image builder never lets a
+  * pair span the start of a REPEAT body or the end of a LOOP, so the stack
+  * is empty at both and the loop start is a plain stream offset.
+  *
+  * macro_step() runs from the main loop like the typing engine and changes
+  * the macro's keys at most once per call, so every DOWN, UP and TAP reaches
+  * the host in a report of its own. TEXT hands the bytes to the typing
+  * engine as it takes them and the macro goes on once they are typed. DELAY
+  * counts from the step that reads it. The macro keys are merged into the
+  * keyboard report without a rollover check: a macro holding more keys than
+  * the report carries is the macro's own error.
+  *
+  * Malformed bytecode stops the macro, releases its keys and counts a fault.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "macro.h"
+#include "main.h"
+#include "typing.h"
+#include <string.h>
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t pos;                   /* stream offset of the body */
+  uint32_t left;                  /* passes still to run, this one included */
+} macro_repeat_t;
+
+/* Private define ------------------------------------------------------------*/
+#define MACRO_REQUEST_NONE        0UL
+#define MACRO_REQUEST_STOP        0x10000UL     /* otherwise 1 + index */
+#define MACRO_TEXT_CHUNK          16U
+
+/* Private variables ---------------------------------------------------------*/
+static const uint8_t *macro_image;
+static const macro_image_header_t *macro_header;
+static uint16_t macro_total;
+static volatile uint32_t macro_request;
+
+/* Decoder */
+static const uint8_t *macro_stream;
+static uint32_t macro_len;
+static uint32_t macro_pos;
+static uint8_t  macro_stack[MACRO_BPE_DEPTH];
+static uint8_t  macro_sp;
+static uint8_t  macro_fault;
+
+/* Player */
+static uint8_t  macro_playing;
+static macro_repeat_t macro_repeat[MACRO_REPEAT_DEPTH];
+static uint8_t  macro_depth;
+static uint32_t macro_deadline;
+static uint8_t  macro_delaying;
+static uint32_t macro_text_left;
+static uint8_t  macro_typing;
+static uint8_t  macro_tap;                    /* usage to release in the next report, 0 for none */
+static hid_key_state_t macro_keys;
+static uint8_t  macro_held;
+static macro_stats_t macro_stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t macro_read32(const uint8_t *src);
+static void macro_start(uint16_t index);
+static uint8_t macro_finish(void);
+static uint8_t macro_next(void);
+static uint32_t macro_varint(void);
+static uint8_t macro_key(uint8_t usage, uint8_t down);
+static uint8_t macro_feed_text(void);
+static uint8_t macro_run(uint32_t now);
+
+/**
+  * @brief  Check the macro image and stop any playback.
+  * @param  image: start of the macro sector
+  * @param  size: sector size
+  * @retval MACRO_OK, or MACRO_ERR_IMAGE when the sector holds no valid
+  *         image; no macro can be played then
+  */
+macro_status_t macro_init(const uint8_t *image, uint32_t size)
+{
+  const macro_image_header_t *header = (const macro_image_header_t *)image;
+  uint32_t dir;
+  uint32_t prev;
+  uint32_t offset;
+  uint32_t i;
+
+  macro_image = NULL;
+  macro_header = NULL;
+  macro_total = 0U;
+  macro_request = MACRO_REQUEST_NONE;
+  macro_playing = 0U;
+  macro_tap = 0U;
+  macro_held = 0U;
+  hid_key_state_clear(&macro_keys);
+  (void)memset(&macro_stats, 0, sizeof(macro_stats));
+
+  if ((image == NULL) || (size < sizeof(macro_image_header_t)) || (header->magic != MACRO_IMAGE_MAGIC) ||
+      (header->version != MACRO_IMAGE_VERSION) || (header->size > size))
+  {
+    return MACRO_ERR_IMAGE;
+  }
+
+  dir = sizeof(macro_image_header_t) + (((uint32_t)header->count + 1U) * 4U);
+  if (dir > header->size)
+  {
+    return MACRO_ERR_IMAGE;
+  }
+
+  /* Streams in order, between the directory and the end of the image */
+  prev = dir;
+  for (i = 0U; i <= header->count; i++)
+  {
+    offset = macro_read32(&image[sizeof(macro_image_header_t) + (i * 4U)]);
+    if ((offset < prev) || (offset > header->size))
+    {
+      return MACRO_ERR_IMAGE;
+    }
+    prev = offset;
+  }
+
+  macro_image = image;
+  macro_header = header;
+  macro_total = header->count;
+
+  return MACRO_OK;
+}
+
+/**
+  * @brief  Number of macros in the image.
+  * @retval count, 0 without a valid image
+  */
+uint16_t macro_count(void)
+{
+  return macro_total;
+}
+
+/**
+  * @brief  Ask for a macro to play from the next step, replacing the one
+  *         playing.
+  * @note   Any context.
+  * @param  index: macro number
+  * @retval MACRO_OK or MACRO_ERR_INDEX
+  */
+macro_status_t macro_play(uint16_t index)
+{
+  if (index >= macro_total)
+  {
+    return MACRO_ERR_INDEX;
+  }
+
+  macro_request = 1UL + index;
+
+  return MACRO_OK;
+}
+
+/**
+  * @brief  Ask for the macro playing to stop and release its keys.
+  * @note   Any context. Text already handed to the typing engine is still typed.
+  * @retval None
+  */
+void macro_stop(void)
+{
+  macro_request = MACRO_REQUEST_STOP;
+}
+
+/**
+  * @brief  Tell whether a macro is playing or about to.
+  * @retval 1 while busy
+  */
+uint8_t macro_busy(void)
+{
+  return ((macro_playing != 0U) || (macro_held != 0U) || (macro_tap != 0U) ||
+          (macro_request != MACRO_REQUEST_NONE)) ? 1U : 0U;
+}
+
+/**
+  * @brief  Run the macro up to its next key change or wait.
+  * @note   Main loop only. Call when the HID IN queue can take a report and
+  *         send a report with macro_get_keys() merged in when it returns 1.
+  * @param  now: HAL_GetTick()
+  * @retval 1 when the macro keys changed
+  */
+uint8_t macro_step(uint32_t now)
+{
+  uint32_t request = MACRO_REQUEST_NONE;
+  uint32_t primask;
+
+  if (macro_request != MACRO_REQUEST_NONE)
+  {
+    /* Take the request and clear it with no interrupt in between */
+    primask = __get_PRIMASK();
+    __disable_irq();
+    request = macro_request;
+    macro_request = MACRO_REQUEST_NONE;
+    __set_PRIMASK(primask);
+  }
+
+  if (request != MACRO_REQUEST_NONE)
+  {
+    macro_playing = 0U;
+    if (request != MACRO_REQUEST_STOP)
+    {
+      macro_start((uint16_t)(request - 1U));
+    }
+    /* Keys of an interrupted macro go up in a report of their own */
+    if ((macro_held != 0U) || (macro_tap != 0U))
+    {
+      hid_key_state_clear(&macro_keys);
+      macro_held = 0U;
+      macro_tap = 0U;
+      return 1U;
+    }
+  }
+
+  if (macro_tap != 0U)
+  {
+    (void)macro_key(macro_tap, 0U);
+    macro_tap = 0U;
+    return 1U;
+  }
+
+  if (macro_playing == 0U)
+  {
+    return 0U;
+  }
+
+  return macro_run(now);
+}
+
+/**
+  * @brief  Keys the macro holds down, to merge into the keyboard report.
+  * @retval key state bitmap
+  */
+const hid_key_state_t *macro_get_keys(void)
+{
+  return &macro_keys;
+}
+
+/**
+  * @brief  Playback statistics.
+  * @param  stats: filled with the counters
+  * @retval None
+  */
+void macro_get_stats(macro_stats_t *stats)
+{
+  *stats = macro_stats;
+}
+
+/**
+  * @brief  Load a little-endian word from the image.
+  * @param  src: first byte
+  * @retval value
+  */
+static uint32_t macro_read32(const uint8_t *src)
+{
+  return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+/**
+  * @brief  Point the decoder at the start of a macro.
+  * @param  index: macro number, already checked
+  * @retval None
+  */
+static void macro_start(uint16_t index)
+{
+  const uint8_t *dir = &macro_image[sizeof(macro_image_header_t) + ((uint32_t)index * 4U)];
+  uint32_t start = macro_read32(dir);
+
+  macro_stream = &macro_image[start];
+  macro_len = macro_read32(&dir[4]) - start;
+  macro_pos = 0U;
+  macro_sp = 0U;
+  macro_fault = 0U;
+  macro_depth = 0U;
+  macro_delaying = 0U;
+  macro_text_left = 0U;
+  macro_typing = 0U;
+  macro_playing = 1U;
+  macro_stats.played++;
+}
+
+/**
+  * @brief  End the macro and release its keys.
+  * @retval 1 when keys went up
+  */
+static uint8_t macro_finish(void)
+{
+  macro_playing = 0U;
+  if (macro_fault != 0U)
+  {
+    macro_stats.faults++;
+  }
+
+  if (macro_held == 0U)
+  {
+    return 0U;
+  }
+  hid_key_state_clear(&macro_keys);
+  macro_held = 0U;
+
+  return 1U;
+}
+
+/**
+  * @brief  Decode the next bytecode byte, expanding pairs.
+  * @note   Sets macro_fault past the end of the stream or on a pair nested
+  *         deeper than MACRO_BPE_DEPTH.
+  * @retval byte, MACRO_OP_END on a fault
+  */
+static uint8_t macro_next(void)
+{
+  const uint8_t *pair;
+  uint8_t byte;
+
+  for (;;)
+  {
+    if (macro_sp != 0U)
+    {
+      byte = macro_stack[--macro_sp];
+    }
+    else if (macro_pos < macro_len)
+    {
+      byte = macro_stream[macro_pos++];
+    }
+    else
+    {
+      macro_fault = 1U;
+      return MACRO_OP_END;
+    }
+
+    if ((macro_header->pair_used[byte >> 3] & (1U << (byte & 7U))) == 0U)
+    {
+      return byte;
+    }
+
+    if ((macro_sp + 2U) > MACRO_BPE_DEPTH)
+    {
+      macro_fault = 1U;
+      return MACRO_OP_END;
+    }
+    pair = macro_header->pair[byte];
+    macro_stack[macro_sp++] = pair[1];
+    macro_stack[macro_sp++] = pair[0];
+  }
+}
+
+/**
+  * @brief  Decode a varint operand.
+  * @retval value; macro_fault is set when it is longer than MACRO_VARINT_MAX
+  */
+static uint32_t macro_varint(void)
+{
+  uint32_t value = 0U;
+  uint32_t shift;
+  uint8_t byte;
+
+  for (shift = 0U; shift < (7U * MACRO_VARINT_MAX); shift += 7U)
+  {
+    byte = macro_next();
+    value |= (uint32_t)(byte & 0x7FU) << shift;
+    if ((byte & 0x80U) == 0U)
+    {
+      return value;
+    }
+  }
+
+  macro_fault = 1U;
+  return 0U;
+}
+
+/**
+  * @brief  Press or release a macro key.
+  * @param  usage: Keyboard/Keypad page usage
+  * @param  down: 1 to press
+  * @retval 1 when the key changed
+  */
+static uint8_t macro_key(uint8_t usage, uint8_t down)
+{
+  uint8_t is_down = ((macro_keys.bits[usage >> 5] & (1UL << (usage & 0x1FU))) != 0U) ? 1U : 0U;
+
+  if ((usage == 0U) || (is_down == down))
+  {
+    return 0U;
+  }
+
+  hid_key_state_set(&macro_keys, usage, down);
+  if (down != 0U)
+  {
+    macro_held++;
+  }
+  else
+  {
+    macro_held--;
+  }
+
+  return 1U;
+}
+
+/**
+  * @brief  Hand as much of the TEXT operand to the typing engine as it takes.
+  * @retval 1 once the whole text is handed over
+  */
+static uint8_t macro_feed_text(void)
+{
+  uint8_t chunk[MACRO_TEXT_CHUNK];
+  uint32_t n;
+  uint32_t i;
+
+  while (macro_text_left != 0U)
+  {
+    n = typing_free();
+    if (n > MACRO_TEXT_CHUNK)
+    {
+      n = MACRO_TEXT_CHUNK;
+    }
+    if (n > macro_text_left)
+    {
+      n = macro_text_left;
+    }
+    if (n == 0U)
+    {
+      return 0U;
+    }
+
+    for (i = 0U; i < n; i++)
+    {
+      chunk[i] = macro_next();
+    }
+    (void)typing_write(chunk, n);
+    macro_text_left -= n;
+  }
+
+  return 1U;
+}
+
+/**
+  * @brief  Run operations until one changes the keys or has to wait.
+  * @param  now: HAL_GetTick()
+  * @retval 1 when the macro keys changed
+  */
+static uint8_t macro_run(uint32_t now)
+{
+  macro_repeat_t *loop;
+  uint32_t ops;
+  uint8_t usage;
+  uint8_t op;
+
+  if ((macro_delaying != 0U) && ((int32_t)(now - macro_deadline) < 0))
+  {
+    return 0U;
+  }
+  macro_delaying = 0U;
+
+  if (macro_feed_text() == 0U)
+  {
+    return 0U;
+  }
+  if (macro_fault != 0U)
+  {
+    return macro_finish();
+  }
+  if ((macro_typing != 0U) && (typing_busy() != 0U))
+  {
+    return 0U;
+  }
+  macro_typing = 0U;
+
+  for (ops = 0U; ops < MACRO_OPS_PER_STEP; ops++)
+  {
+    op = macro_next();
+    if (macro_fault != 0U)
+    {
+      return macro_finish();
+    }
+    macro_stats.ops++;
+
+    switch (op)
+    {
+      case MACRO_OP_END:
+        return macro_finish();
+
+      case MACRO_OP_DOWN:
+      case MACRO_OP_UP:
+      case MACRO_OP_TAP:
+        usage = macro_next();
+        if ((macro_fault == 0U) && (macro_key(usage, (op != MACRO_OP_UP) ? 1U : 0U) != 0U))
+        {
+          macro_tap = (op == MACRO_OP_TAP) ? usage : 0U;
+          return 1U;
+        }
+        break;
+
+      case MACRO_OP_RELEASE:
+        if (macro_held != 0U)
+        {
+          hid_key_state_clear(&macro_keys);
+          macro_held = 0U;
+          return 1U;
+        }
+        break;
+
+      case MACRO_OP_DELAY:
+        macro_deadline = now + macro_varint();
+        macro_delaying = 1U;
+        return 0U;
+
+      case MACRO_OP_TEXT:
+        macro_text_left = macro_varint();
+        macro_typing = 1U;
+        if (macro_fault == 0U)
+        {
+          (void)macro_feed_text();
+        }
+        if (macro_fault != 0U)
+        {
+          return macro_finish();
+        }
+        return 0U;
+
+      case MACRO_OP_REPEAT:
+        if (macro_depth >= MACRO_REPEAT_DEPTH)
+        {
+          macro_fault = 1U;
+          break;
+        }
+        loop = &macro_repeat[macro_depth];
+        loop->left = macro_varint();
+        loop->pos = macro_pos;
+        /* The body must start on a stream byte, see the file header */
+        if ((loop->left == 0U) || (macro_sp != 0U))
+        {
+          macro_fault = 1U;
+          break;
+        }
+        macro_depth++;
+        break;
+
+      case MACRO_OP_LOOP:
+        if ((macro_depth == 0U) || (macro_sp != 0U))
+        {
+          macro_fault = 1U;
+          break;
+        }
+        loop = &macro_repeat[macro_depth - 1U];
+        loop->left--;
+        if (loop->left != 0U)
+        {
+          macro_pos = loop->pos;
+        }
+        else
+        {
+          macro_depth--;
+        }
+        break;
+
+      default:
+        macro_fault = 1U;
+        break;
+    }
+
+    if (macro_fault != 0U)
+    {
+      return macro_finish();
+    }
+  }
+
+  return 0U;
+}
@@ -19,14 +19,22 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 #include "usb_device.h"
-#include "usbd_hid.h"
+#include "config_store.h"
+#include "hid_config.h"
+#include "keyboard.h"
+#include "latency_trace.h"
+#include "log_stream.h"
+#include "macro.h"
+#include "matrix_scan.h"
+#include "usb_fifo.h"
+#include "usb_power.h"
 
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
 
-
-extern USBD_HandleTypeDef hUsbDeviceFS;
-uint8_t keys_buffer[8];
+/* Macro sector, from the linker script */
+extern const uint8_t __macro_start[];
+extern const uint8_t __macro_end[];
 
 
 
@@ -40,29 +48,35 @@ int main(void)
   SystemClock_Config();
 
   MX_GPIO_Init();
+  log_init();
+  latency_trace_init();
+#if (USB_FIFO_BENCH == 1U)
+  usb_fifo_bench();
+#endif /* USB_FIFO_BENCH */
+  (void)macro_init(__macro_start, (uint32_t)(__macro_end - __macro_start));
+  matrix_scan_init();
+  keyboard_init();
+
+  /* Stored settings over the defaults keyboard_init() set, before the host enumerates */
+  (void)config_store_init();
+  hid_config_init();
+  usb_power_init();
   MX_USB_DEVICE_Init();
 
-  keys_buffer[0] = 1; //report_id
-  keys_buffer[1] = 0; //modifier
-  keys_buffer[2] = 0; //oem
-  keys_buffer[3] = 0; //keycode data
-  keys_buffer[4] = 0; //keycode data
-  keys_buffer[5] = 0; //keycode data
-  keys_buffer[6] = 0; //keycode data
-  keys_buffer[7] = 0; //keycode data
+  matrix_scan_start();
 
   while (1)
   {
-	  if(HAL_GPIO_ReadPin(GPIOA,GPIO_PIN_0) == GPIO_PIN_SET){
-
-	       keys_buffer[3] = 0x4E; //PgDwn press
-	       USBD_HID_SendReport(&hUsbDeviceFS,keys_buffer,8);
-	       HAL_Delay(50);
-
-	       keys_buffer[3] = 0; //PgDwn release
-	       USBD_HID_SendReport(&hUsbDeviceFS,keys_buffer,8);
-	       HAL_Delay(50);
-	      }
+    /* Sleeps in STOP mode while the bus is suspended; queued key changes wait for the resume */
+    if (usb_power_task() == USB_POWER_ACTIVE)
+    {
+      keyboard_task();
+    }
+    log_metrics_task();
+    hid_config_task();
+
+    /* Key edges, matrix scans and USB events are interrupt driven: sleep until the next one */
+    __WFI();
   }
 
 }
@@ -127,10 +141,14 @@ static void MX_GPIO_Init(void)
 
   /*Configure GPIO pin : PA0 */
   GPIO_InitStruct.Pin = GPIO_PIN_0;
-  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
   GPIO_InitStruct.Pull = GPIO_NOPULL;
   HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
+  /* EXTI interrupt init*/
+  HAL_NVIC_SetPriority(EXTI0_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(EXTI0_IRQn);
+
   /* USER CODE BEGIN MX_GPIO_Init_2 */
 
   /* USER CODE END MX_GPIO_Init_2 */
@@ -138,6 +156,19 @@ static void MX_GPIO_Init(void)
 
 /* USER CODE BEGIN 4 */
 
+/**
+  * @brief  EXTI line detection callback.
+  * @param  GPIO_Pin: Specifies the port pin connected to corresponding EXTI line.
+  * @retval None
+  */
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+  keyboard_gpio_edge(GPIO_Pin);
+
+  /* PA0, or a matrix row while the bus is suspended */
+  usb_power_key_wake();
+}
+
 /* USER CODE END 4 */
 
 /**
@@ -0,0 +1,100 @@
+/**
+  ******************************************************************************
+  * @file           : matrix.c
+  * @brief          : Key matrix geometry and port snapshot decoding
+  ******************************************************************************
+  * A scan is MATRIX_COLS snapshots of the row port input data register, one
+  * per strobed column. Rows have pull-ups and the strobed column is driven
+  * low, so a pressed key reads as 0.
+  *
+  * Without a diode per key, three keys on the corners of a rectangle make
+  * the fourth corner read as pressed. Such a scan is ambiguous: it is
+  * reported as ghosted so the caller can keep its previous state.
+  *
+  * This file does not depend on the HAL and can be built on a host.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "matrix.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static inline uint32_t matrix_column_rows(uint16_t sample);
+
+/**
+  * @brief  Convert one scan worth of row port snapshots into a key bitmap.
+  * @param  samples: MATRIX_COLS row port snapshots, column 0 first
+  * @param  state: receives the key bitmap, left untouched for a ghosted scan
+  * @retval 1 if the scan is ghosted and was discarded, 0 otherwise
+  */
+uint8_t matrix_decode(const uint16_t *samples, matrix_bitmap_t *state)
+{
+  matrix_bitmap_t decoded = {0};
+  uint32_t col;
+  uint32_t bit;
+
+  if (matrix_has_ghost(samples) != 0U)
+  {
+    return 1U;
+  }
+
+  for (col = 0U; col < MATRIX_COLS; col++)
+  {
+    bit = col * MATRIX_ROWS;
+    decoded.bits[bit >> 5] |= matrix_column_rows(samples[col]) << (bit & 0x1FU);
+#if (32U % MATRIX_ROWS) != 0U
+    if (((bit & 0x1FU) + MATRIX_ROWS) > 32U)
+    {
+      decoded.bits[(bit >> 5) + 1U] |= matrix_column_rows(samples[col]) >> (32U - (bit & 0x1FU));
+    }
+#endif /* MATRIX_ROWS */
+  }
+
+  *state = decoded;
+  return 0U;
+}
+
+/**
+  * @brief  Detect a ghosting pattern: two columns sharing two or more pressed rows.
+  * @param  samples: MATRIX_COLS row port snapshots, column 0 first
+  * @retval 1 if the scan is ambiguous
+  */
+uint8_t matrix_has_ghost(const uint16_t *samples)
+{
+  uint32_t rows[MATRIX_COLS];
+  uint32_t common;
+  uint32_t col;
+  uint32_t prev;
+
+  for (col = 0U; col < MATRIX_COLS; col++)
+  {
+    rows[col] = matrix_column_rows(samples[col]);
+
+    /* A column with less than two keys down cannot be part of a rectangle */
+    if ((rows[col] & (rows[col] - 1U)) == 0U)
+    {
+      continue;
+    }
+
+    for (prev = 0U; prev < col; prev++)
+    {
+      common = rows[col] & rows[prev];
+      if ((common & (common - 1U)) != 0U)
+      {
+        return 1U;
+      }
+    }
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  Extract the pressed rows of one column snapshot.
+  * @param  sample: row port input data register
+  * @retval pressed rows, bit 0 is row 0
+  */
+static inline uint32_t matrix_column_rows(uint16_t sample)
+{
+  return ((uint32_t)(~sample) >> MATRIX_ROW_SHIFT) & MATRIX_ROW_MASK;
+}
@@ -0,0 +1,319 @@
+/**
+  ******************************************************************************
+  * @file           : matrix_scan.c
+  * @brief          : Timer and DMA driven key matrix scanner
+  ******************************************************************************
+  * TIM1 runs at MATRIX_SCAN_HZ * MATRIX_COLS strobe periods per second and
+  * drives two DMA2 streams (only DMA2 can reach the AHB1 GPIO ports):
+  *  - TIM1_UP  (Stream5/Channel6) writes the next column pattern to the
+  *    column port BSRR at the start of each strobe period,
+  *  - TIM1_CH1 (Stream1/Channel6) copies the row port IDR into a sample
+  *    buffer once the strobed column has settled.
+  * The sample buffer holds two scans; its half and full transfer interrupts
+  * hand a complete scan to matrix_decode() while the other half is filled,
+  * so the CPU only runs once per scan and never waits on the hardware.
+  *
+  * While the USB bus is suspended the scanner is stopped and the matrix
+  * turned into wake-up lines instead: every column driven low, every row a
+  * falling-edge EXTI input, so that any key press wakes the chip from STOP.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "matrix_scan.h"
+
+/* Private define ------------------------------------------------------------*/
+#define MATRIX_ROW_PINS           ((uint16_t)(MATRIX_ROW_MASK << MATRIX_ROW_SHIFT))
+
+/* The wake-up lines use the EXTI9_5 and EXTI15_10 interrupts */
+#if (MATRIX_ROW_SHIFT != 8U) || (MATRIX_ROWS != 8U)
+#error "matrix_scan_wake_arm() expects the rows on pins 8 to 15"
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+DMA_HandleTypeDef hdma_tim1_ch1;
+static DMA_HandleTypeDef hdma_tim1_up;
+
+static const uint16_t matrix_col_pins[MATRIX_COLS] = MATRIX_COL_PINS;
+
+/* Entry p is driven at the end of strobe period p: column p + 1 goes low */
+static uint32_t matrix_strobe[MATRIX_COLS];
+/* Two scans of row port snapshots, entry p samples column p % MATRIX_COLS */
+static uint16_t matrix_samples[2U * MATRIX_COLS];
+
+static matrix_bitmap_t matrix_state;
+static volatile uint32_t matrix_scans;
+static volatile uint32_t matrix_ghosts;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t matrix_column_pattern(uint32_t col);
+static void matrix_scan_half_complete(DMA_HandleTypeDef *hdma);
+static void matrix_scan_complete(DMA_HandleTypeDef *hdma);
+static void matrix_scan_process(const uint16_t *samples);
+
+/**
+  * @brief  Configure the matrix GPIOs, TIM1 and the two DMA streams.
+  * @retval None
+  */
+void matrix_scan_init(void)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+  uint32_t col;
+  uint32_t col_mask = 0U;
+
+  __HAL_RCC_GPIOD_CLK_ENABLE();
+  __HAL_RCC_GPIOE_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+  __HAL_RCC_TIM1_CLK_ENABLE();
+
+  for (col = 0U; col < MATRIX_COLS; col++)
+  {
+    col_mask |= matrix_col_pins[col];
+    matrix_strobe[col] = matrix_column_pattern((col + 1U) % MATRIX_COLS);
+  }
+
+  /* Columns released (open-drain high) until the scan starts */
+  HAL_GPIO_WritePin(MATRIX_COL_PORT, (uint16_t)col_mask, GPIO_PIN_SET);
+  GPIO_InitStruct.Pin = col_mask;
+  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+  GPIO_InitStruct.Pull = GPIO_NOPULL;
+  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+  HAL_GPIO_Init(MATRIX_COL_PORT, &GPIO_InitStruct);
+
+  GPIO_InitStruct.Pin = MATRIX_ROW_PINS;
+  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  HAL_GPIO_Init(MATRIX_ROW_PORT, &GPIO_InitStruct);
+
+  /* TIM1_UP: column pattern, memory to GPIO BSRR */
+  hdma_tim1_up.Instance = DMA2_Stream5;
+  hdma_tim1_up.Init.Channel = DMA_CHANNEL_6;
+  hdma_tim1_up.Init.Direction = DMA_MEMORY_TO_PERIPH;
+  hdma_tim1_up.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_tim1_up.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_tim1_up.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+  hdma_tim1_up.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+  hdma_tim1_up.Init.Mode = DMA_CIRCULAR;
+  hdma_tim1_up.Init.Priority = DMA_PRIORITY_HIGH;
+  hdma_tim1_up.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if (HAL_DMA_Init(&hdma_tim1_up) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /* TIM1_CH1: row snapshot, GPIO IDR to memory */
+  hdma_tim1_ch1.Instance = DMA2_Stream1;
+  hdma_tim1_ch1.Init.Channel = DMA_CHANNEL_6;
+  hdma_tim1_ch1.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  hdma_tim1_ch1.Init.PeriphInc = DMA_PINC_DISABLE;
+  hdma_tim1_ch1.Init.MemInc = DMA_MINC_ENABLE;
+  hdma_tim1_ch1.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  hdma_tim1_ch1.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+  hdma_tim1_ch1.Init.Mode = DMA_CIRCULAR;
+  hdma_tim1_ch1.Init.Priority = DMA_PRIORITY_HIGH;
+  hdma_tim1_ch1.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+  if (HAL_DMA_Init(&hdma_tim1_ch1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  hdma_tim1_ch1.XferHalfCpltCallback = matrix_scan_half_complete;
+  hdma_tim1_ch1.XferCpltCallback = matrix_scan_complete;
+
+  HAL_NVIC_SetPriority(DMA2_Stream1_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA2_Stream1_IRQn);
+}
+
+/**
+  * @brief  Start strobing the matrix.
+  * @retval None
+  */
+void matrix_scan_start(void)
+{
+  uint32_t timer_clock = HAL_RCC_GetPCLK2Freq();
+  uint32_t period;
+
+  if ((RCC->CFGR & RCC_CFGR_PPRE2) != RCC_HCLK_DIV1)
+  {
+    timer_clock *= 2U;
+  }
+  period = timer_clock / (MATRIX_SCAN_HZ * MATRIX_COLS);
+
+  TIM1->CR1 = 0U;
+  TIM1->DIER = 0U;
+  TIM1->PSC = 0U;
+  TIM1->ARR = period - 1U;
+  TIM1->CCR1 = (period * MATRIX_SETTLE_PERCENT) / 100U;
+  TIM1->CCMR1 = 0U;
+  TIM1->CNT = 0U;
+  /* Load PSC and ARR before the DMA requests are enabled */
+  TIM1->EGR = TIM_EGR_UG;
+  TIM1->SR = 0U;
+
+  /* Strobe period 0 scans column 0, the update DMA selects the next ones */
+  MATRIX_COL_PORT->BSRR = matrix_column_pattern(0U);
+
+  (void)HAL_DMA_Start(&hdma_tim1_up, (uint32_t)matrix_strobe, (uint32_t)&MATRIX_COL_PORT->BSRR, MATRIX_COLS);
+  (void)HAL_DMA_Start_IT(&hdma_tim1_ch1, (uint32_t)&MATRIX_ROW_PORT->IDR, (uint32_t)matrix_samples,
+                         2U * MATRIX_COLS);
+
+  TIM1->DIER = TIM_DIER_UDE | TIM_DIER_CC1DE;
+  TIM1->CR1 = TIM_CR1_CEN;
+}
+
+/**
+  * @brief  Stop strobing the matrix and release all columns.
+  * @retval None
+  */
+void matrix_scan_stop(void)
+{
+  uint32_t col;
+
+  TIM1->CR1 = 0U;
+  TIM1->DIER = 0U;
+  (void)HAL_DMA_Abort(&hdma_tim1_up);
+  (void)HAL_DMA_Abort(&hdma_tim1_ch1);
+
+  for (col = 0U; col < MATRIX_COLS; col++)
+  {
+    MATRIX_COL_PORT->BSRR = matrix_col_pins[col];
+  }
+}
+
+/**
+  * @brief  Turn the stopped matrix into wake-up lines: any key press raises
+  *         a row EXTI interrupt, and HAL_GPIO_EXTI_Callback() with its pin.
+  * @note   Call after matrix_scan_stop().
+  * @retval None
+  */
+void matrix_scan_wake_arm(void)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+  uint32_t col;
+
+  for (col = 0U; col < MATRIX_COLS; col++)
+  {
+    MATRIX_COL_PORT->BSRR = (uint32_t)matrix_col_pins[col] << 16U;
+  }
+
+  GPIO_InitStruct.Pin = MATRIX_ROW_PINS;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  HAL_GPIO_Init(MATRIX_ROW_PORT, &GPIO_InitStruct);
+
+  HAL_NVIC_SetPriority(EXTI9_5_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+  HAL_NVIC_SetPriority(EXTI15_10_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
+}
+
+/**
+  * @brief  Back from wake-up lines to plain row inputs.
+  * @note   Call before matrix_scan_start(), which strobes the columns again.
+  * @retval None
+  */
+void matrix_scan_wake_disarm(void)
+{
+  GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+  HAL_NVIC_DisableIRQ(EXTI9_5_IRQn);
+  HAL_NVIC_DisableIRQ(EXTI15_10_IRQn);
+
+  /* Clears the EXTI lines as well */
+  HAL_GPIO_DeInit(MATRIX_ROW_PORT, MATRIX_ROW_PINS);
+  GPIO_InitStruct.Pin = MATRIX_ROW_PINS;
+  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Pull = GPIO_PULLUP;
+  HAL_GPIO_Init(MATRIX_ROW_PORT, &GPIO_InitStruct);
+
+  __HAL_GPIO_EXTI_CLEAR_IT(MATRIX_ROW_PINS);
+  HAL_NVIC_ClearPendingIRQ(EXTI9_5_IRQn);
+  HAL_NVIC_ClearPendingIRQ(EXTI15_10_IRQn);
+}
+
+/**
+  * @brief  Key bitmap of the last unambiguous scan.
+  * @retval matrix bitmap
+  */
+const matrix_bitmap_t *matrix_scan_get_state(void)
+{
+  return &matrix_state;
+}
+
+/**
+  * @brief  Number of scans completed since start-up.
+  * @retval scan count
+  */
+uint32_t matrix_scan_get_count(void)
+{
+  return matrix_scans;
+}
+
+/**
+  * @brief  Called from the DMA interrupt after each unambiguous scan.
+  * @note   This function should not be modified, when the callback is needed,
+  *         the matrix_scan_complete_callback could be implemented in the user file
+  * @param  state: key bitmap of the scan
+  * @retval None
+  */
+__weak void matrix_scan_complete_callback(const matrix_bitmap_t *state)
+{
+  UNUSED(state);
+}
+
+/**
+  * @brief  BSRR word pulling one column low and releasing the others.
+  * @param  col: column index
+  * @retval BSRR value
+  */
+static uint32_t matrix_column_pattern(uint32_t col)
+{
+  uint32_t pattern = 0U;
+  uint32_t i;
+
+  for (i = 0U; i < MATRIX_COLS; i++)
+  {
+    pattern |= (i == col) ? ((uint32_t)matrix_col_pins[i] << 16U) : matrix_col_pins[i];
+  }
+
+  return pattern;
+}
+
+/**
+  * @brief  First scan of the sample buffer is complete.
+  * @param  hdma: row sampling DMA handle
+  * @retval None
+  */
+static void matrix_scan_half_complete(DMA_HandleTypeDef *hdma)
+{
+  UNUSED(hdma);
+  matrix_scan_process(&matrix_samples[0]);
+}
+
+/**
+  * @brief  Second scan of the sample buffer is complete.
+  * @param  hdma: row sampling DMA handle
+  * @retval None
+  */
+static void matrix_scan_complete(DMA_HandleTypeDef *hdma)
+{
+  UNUSED(hdma);
+  matrix_scan_process(&matrix_samples[MATRIX_COLS]);
+}
+
+/**
+  * @brief  Decode one scan and publish it unless it is ghosted.
+  * @param  samples: MATRIX_COLS row port snapshots
+  * @retval None
+  */
+static void matrix_scan_process(const uint16_t *samples)
+{
+  matrix_scans++;
+
+  if (matrix_decode(samples, &matrix_state) != 0U)
+  {
+    matrix_ghosts++;
+    return;
+  }
+
+  matrix_scan_complete_callback(&matrix_state);
+}
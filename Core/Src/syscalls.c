@@ -29,6 +29,7 @@
 #include <time.h>
 #include <sys/time.h>
 #include <sys/times.h>
+#include "log_stream.h"
 
 
 /* Variables */
@@ -77,15 +78,13 @@ __attribute__((weak)) int _read(int file, char *ptr, int len)
   return len;
 }
 
+/* printf output goes to the CDC console, without waiting: what does not fit
+   in the log ring is dropped and counted */
 __attribute__((weak)) int _write(int file, char *ptr, int len)
 {
   (void)file;
-  int DataIdx;
 
-  for (DataIdx = 0; DataIdx < len; DataIdx++)
-  {
-    __io_putchar(*ptr++);
-  }
+  (void)log_write(ptr, (uint32_t)len);
   return len;
 }
 
@@ -0,0 +1,401 @@
+/**
+  ******************************************************************************
+  * @file           : typing.c
+  * @brief          : UTF-8 text to keystroke typing engine
+  ******************************************************************************
+  * The text buffer is a byte ring with one writer, which may be an interrupt
+  * (the CDC console receive callback), and one reader, the main loop. The
+  * reader decodes UTF-8 one byte at a time, so a character split across two
+  * writes is typed whole; code points the layout has no key for, and
+  * malformed sequences, are skipped and counted.
+  *
+  * Every step changes the typed keys once:
+  *  - modifiers differ from the ones down: release the typed keys and switch
+  *    the modifiers. The key follows in the next report, since the NKRO
+  *    bitmap puts the modifiers after the keys and a host reading it in
+  *    order would see the key first;
+  *  - key already down, or rollover limit reached: release the typed keys;
+  *  - otherwise press the key and keep the earlier ones down: the host only
+  *    sees the new key go down, so the characters come out in order;
+  *  - no text left: release everything.
+  * A character typed with a dead key is two keystrokes, each one a step.
+  * A carriage return types Enter, and a line feed right after it is dropped
+  * so that terminal line endings give one Enter.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "typing.h"
+#include "kbd_layout.h"
+#include "main.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define TYPING_BUFFER_MASK        (TYPING_BUFFER_SIZE - 1U)
+#define TYPING_CODEPOINT_MAX      0x10FFFFUL
+#define TYPING_SURROGATE_FIRST    0xD800UL
+#define TYPING_SURROGATE_LAST     0xDFFFUL
+
+#if ((TYPING_BUFFER_SIZE & TYPING_BUFFER_MASK) != 0U)
+#error "TYPING_BUFFER_SIZE must be a power of two"
+#endif
+
+#if (TYPING_ROLLOVER_MAX == 0U)
+#error "TYPING_ROLLOVER_MAX must allow one key"
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t typing_buf[TYPING_BUFFER_SIZE];
+static volatile uint32_t typing_head;     /* next byte to write, writer */
+static volatile uint32_t typing_tail;     /* next byte to decode, reader */
+
+/* UTF-8 decoder */
+static uint32_t typing_codepoint;
+static uint32_t typing_codepoint_min;     /* smallest value of the sequence length, no overlongs */
+static uint8_t  typing_need;              /* continuation bytes still expected */
+static uint8_t  typing_after_cr;
+
+/* Keystrokes of the next character, decoded but not all pressed yet */
+static kbd_stroke_t typing_strokes[KBD_STROKES_MAX];
+static uint8_t typing_stroke_count;
+static uint8_t typing_stroke_next;
+static volatile uint8_t typing_layout;
+
+static hid_key_state_t typing_keys;
+static uint8_t typing_held;               /* typed non-modifier keys down */
+static uint8_t typing_mods;               /* typed modifiers down, KBD_MOD_xxx */
+static typing_stats_t typing_stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t typing_decode(kbd_stroke_t *strokes);
+static uint8_t typing_utf8(uint8_t byte, uint32_t *codepoint);
+static uint8_t typing_lookup(uint32_t codepoint, kbd_stroke_t *strokes);
+static void typing_release(uint8_t mods);
+
+/**
+  * @brief  Drop the buffered text, release the typed keys, clear the statistics.
+  * @retval None
+  */
+void typing_init(void)
+{
+  typing_head = 0U;
+  typing_tail = 0U;
+  typing_need = 0U;
+  typing_after_cr = 0U;
+  typing_stroke_count = 0U;
+  typing_stroke_next = 0U;
+  typing_layout = (uint8_t)KBD_LAYOUT_DEFAULT;
+  hid_key_state_clear(&typing_keys);
+  typing_held = 0U;
+  typing_mods = 0U;
+  (void)memset(&typing_stats, 0, sizeof(typing_stats));
+}
+
+/**
+  * @brief  Queue UTF-8 text to type, without waiting.
+  * @note   One writer context only.
+  * @param  data: text
+  * @param  len: bytes
+  * @retval bytes queued, fewer than len when the buffer is full
+  */
+uint32_t typing_write(const void *data, uint32_t len)
+{
+  const uint8_t *src = (const uint8_t *)data;
+  uint32_t head = typing_head;
+  uint32_t room = TYPING_BUFFER_SIZE - (head - typing_tail);
+  uint32_t i;
+
+  if (len > room)
+  {
+    len = room;
+  }
+
+  for (i = 0U; i < len; i++)
+  {
+    typing_buf[(head + i) & TYPING_BUFFER_MASK] = src[i];
+  }
+
+  /* The reader must not see the head before the bytes */
+  __DMB();
+  typing_head = head + len;
+
+  return len;
+}
+
+/**
+  * @brief  Room left in the text buffer.
+  * @retval bytes
+  */
+uint32_t typing_free(void)
+{
+  return TYPING_BUFFER_SIZE - (typing_head - typing_tail);
+}
+
+/**
+  * @brief  Tell whether text is waiting or typed keys are still down.
+  * @retval 1 while busy
+  */
+uint8_t typing_busy(void)
+{
+  return ((typing_head != typing_tail) || (typing_stroke_next < typing_stroke_count) || (typing_held != 0U) ||
+          (typing_mods != 0U)) ? 1U : 0U;
+}
+
+/**
+  * @brief  Move the typed keys one report forward.
+  * @note   Main loop only. Call when the HID IN queue can take a report and
+  *         send a report with typing_get_keys() merged in when it returns 1.
+  * @param  max_keys: typed non-modifier keys the report can hold on top of
+  *         the keys already down
+  * @param  leds: lock LEDs set by the host, HID_KBD_LED_xxx
+  * @retval 1 when the typed keys changed, 0 when there is nothing to do
+  */
+uint8_t typing_step(uint8_t max_keys, uint8_t leds)
+{
+  const kbd_stroke_t *stroke;
+  uint8_t mods;
+
+  if (typing_stroke_next >= typing_stroke_count)
+  {
+    typing_stroke_count = typing_decode(typing_strokes);
+    typing_stroke_next = 0U;
+  }
+
+  if (typing_stroke_count == 0U)
+  {
+    if ((typing_held == 0U) && (typing_mods == 0U))
+    {
+      return 0U;
+    }
+    typing_release(0U);
+  }
+  else
+  {
+    stroke = &typing_strokes[typing_stroke_next];
+    mods = stroke->modifiers;
+    if ((stroke->caps != 0U) && ((leds & HID_KBD_LED_CAPS_LOCK) != 0U))
+    {
+      mods ^= KBD_MOD_LSHIFT;
+    }
+
+    if (mods != typing_mods)
+    {
+      typing_release(mods);
+    }
+    else if ((typing_held >= max_keys) ||
+             ((typing_keys.bits[stroke->usage >> 5] & (1UL << (stroke->usage & 0x1FU))) != 0U))
+    {
+      if (typing_held == 0U)
+      {
+        /* No room at all: wait for the keys held by hand to go up */
+        return 0U;
+      }
+      typing_release(mods);
+    }
+    else
+    {
+      hid_key_state_set(&typing_keys, stroke->usage, 1U);
+      typing_held++;
+      typing_stroke_next++;
+      if (typing_stroke_next == typing_stroke_count)
+      {
+        typing_stats.chars++;
+      }
+    }
+  }
+
+  typing_stats.reports++;
+  return 1U;
+}
+
+/**
+  * @brief  Select the layout the host is set to.
+  * @note   Takes effect from the next character; any context.
+  * @param  layout: kbd_layout_id_t
+  * @retval None
+  */
+void typing_set_layout(uint8_t layout)
+{
+  if (layout < (uint8_t)KBD_LAYOUT_COUNT)
+  {
+    typing_layout = layout;
+  }
+}
+
+/**
+  * @brief  Layout the text is typed with.
+  * @retval kbd_layout_id_t
+  */
+uint8_t typing_get_layout(void)
+{
+  return typing_layout;
+}
+
+/**
+  * @brief  Keys the engine holds down, to merge into the keyboard report.
+  * @retval key state bitmap
+  */
+const hid_key_state_t *typing_get_keys(void)
+{
+  return &typing_keys;
+}
+
+/**
+  * @brief  Typing statistics.
+  * @param  stats: filled with the counters
+  * @retval None
+  */
+void typing_get_stats(typing_stats_t *stats)
+{
+  *stats = typing_stats;
+}
+
+/**
+  * @brief  Decode buffered text up to the next character the layout can type.
+  * @param  strokes: filled with its keystrokes
+  * @retval number of keystrokes, 0 when the buffer ran out
+  */
+static uint8_t typing_decode(kbd_stroke_t *strokes)
+{
+  uint32_t head = typing_head;
+  uint32_t tail = typing_tail;
+  uint32_t codepoint;
+  uint8_t count = 0U;
+
+  /* Bytes read after the head they were published with */
+  __DMB();
+
+  while ((count == 0U) && (tail != head))
+  {
+    if (typing_utf8(typing_buf[tail & TYPING_BUFFER_MASK], &codepoint) != 0U)
+    {
+      count = typing_lookup(codepoint, strokes);
+    }
+    tail++;
+  }
+
+  /* The writer may reuse the bytes only once they are read */
+  __DMB();
+  typing_tail = tail;
+
+  return count;
+}
+
+/**
+  * @brief  Feed one byte to the UTF-8 decoder.
+  * @note   A sequence cut short is counted invalid and the byte that cut it
+  *         starts over as a lead byte.
+  * @param  byte: next text byte
+  * @param  codepoint: receives the code point when one is complete
+  * @retval 1 when a code point is complete
+  */
+static uint8_t typing_utf8(uint8_t byte, uint32_t *codepoint)
+{
+  if ((typing_need != 0U) && ((byte & 0xC0U) != 0x80U))
+  {
+    typing_stats.invalid++;
+    typing_need = 0U;
+  }
+
+  if (typing_need != 0U)
+  {
+    typing_codepoint = (typing_codepoint << 6) | (byte & 0x3FU);
+    typing_need--;
+    if (typing_need != 0U)
+    {
+      return 0U;
+    }
+    if ((typing_codepoint < typing_codepoint_min) || (typing_codepoint > TYPING_CODEPOINT_MAX) ||
+        ((typing_codepoint >= TYPING_SURROGATE_FIRST) && (typing_codepoint <= TYPING_SURROGATE_LAST)))
+    {
+      typing_stats.invalid++;
+      return 0U;
+    }
+    *codepoint = typing_codepoint;
+    return 1U;
+  }
+
+  if (byte < 0x80U)
+  {
+    *codepoint = byte;
+    return 1U;
+  }
+  if ((byte & 0xE0U) == 0xC0U)
+  {
+    typing_codepoint = byte & 0x1FU;
+    typing_codepoint_min = 0x80UL;
+    typing_need = 1U;
+  }
+  else if ((byte & 0xF0U) == 0xE0U)
+  {
+    typing_codepoint = byte & 0x0FU;
+    typing_codepoint_min = 0x800UL;
+    typing_need = 2U;
+  }
+  else if ((byte & 0xF8U) == 0xF0U)
+  {
+    typing_codepoint = byte & 0x07U;
+    typing_codepoint_min = 0x10000UL;
+    typing_need = 3U;
+  }
+  else
+  {
+    /* Stray continuation byte or invalid lead byte */
+    typing_stats.invalid++;
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  Keystrokes of a code point, with the line ending rules.
+  * @param  codepoint: decoded character
+  * @param  strokes: filled with its keystrokes
+  * @retval number of keystrokes, 0 when the character is skipped
+  */
+static uint8_t typing_lookup(uint32_t codepoint, kbd_stroke_t *strokes)
+{
+  uint8_t after_cr = typing_after_cr;
+  uint8_t count;
+
+  typing_after_cr = (codepoint == (uint32_t)'\r') ? 1U : 0U;
+
+  if (codepoint == (uint32_t)'\r')
+  {
+    codepoint = (uint32_t)'\n';
+  }
+  else if ((codepoint == (uint32_t)'\n') && (after_cr != 0U))
+  {
+    return 0U;
+  }
+  else
+  {
+    /* Typed as it is */
+  }
+
+  count = kbd_layout_lookup(typing_layout, codepoint, strokes);
+  if (count == 0U)
+  {
+    typing_stats.unmapped++;
+  }
+
+  return count;
+}
+
+/**
+  * @brief  Release every typed key and hold the given modifiers instead.
+  * @param  mods: modifiers to hold, KBD_MOD_xxx
+  * @retval None
+  */
+static void typing_release(uint8_t mods)
+{
+  uint8_t bit;
+
+  hid_key_state_clear(&typing_keys);
+  for (bit = 0U; bit < 8U; bit++)
+  {
+    hid_key_state_set(&typing_keys, (uint8_t)(HID_USAGE_MODIFIER_FIRST + bit), (uint8_t)((mods >> bit) & 1U));
+  }
+  typing_held = 0U;
+  typing_mods = mods;
+}
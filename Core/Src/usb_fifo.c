@@ -0,0 +1,335 @@
+/**
+  ******************************************************************************
+  * @file           : usb_fifo.c
+  * @brief          : OTG_FS FIFO RAM allocation from the endpoint descriptors
+  ******************************************************************************
+  * The OTG_FS core has 320 words of FIFO RAM for one shared RX FIFO and a TX
+  * FIFO per IN endpoint. Rather than fixed sizes, the FIFOs are sized from
+  * the configuration descriptor the host will read, so a class added to the
+  * composite device gets its FIFOs without editing usbd_conf.c.
+  *
+  * RX FIFO, RM0383 sizing rule with the packet term doubled so one packet
+  * can arrive while the previous one is read:
+  *   (5 * 1 control EP + 8) + 2 * (largest OUT packet / 4 + 1)
+  *   + (2 * OUT endpoints, EP0 included) + 1 for the global OUT NAK
+  * TX FIFOs: one max packet for EP0 and interrupt endpoints, whose class
+  * never queues a second one, USB_FIFO_STREAM_PACKETS for bulk and
+  * isochronous ones; never under USB_FIFO_TX_MIN, which an unused FIFO
+  * below the last used one also gets. Alternate settings take the largest
+  * packet of each endpoint. What is left past the last TX FIFO stays free.
+  *
+  * With USB_FIFO_BENCH the module also times the FIFO copy routines of the
+  * OTG low layer driver, see usb_fifo_bench().
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_fifo.h"
+#include <string.h>
+#ifdef USE_USBD_COMPOSITE
+#include "usbd_composite_builder.h"
+#endif /* USE_USBD_COMPOSITE */
+#if (USB_FIFO_BENCH == 1U)
+#include "main.h"
+#include "log_stream.h"
+#endif /* USB_FIFO_BENCH */
+
+/* Private define ------------------------------------------------------------*/
+#define USB_FIFO_RX_SETUP_WORDS   (5U * 1U + 8U)    /* SETUP packets of the one control endpoint */
+#define USB_FIFO_ISO_MAX_PACKET   1023U             /* full speed */
+#define USB_FIFO_BENCH_MAX        512U              /* longest packet timed */
+#define USB_FIFO_BENCH_RUNS       16U               /* best of */
+
+/* Private macro -------------------------------------------------------------*/
+#define USB_FIFO_PACKET_WORDS(bytes)   (((uint32_t)(bytes) + 3U) / 4U)
+
+#if (USB_FIFO_BENCH == 1U)
+/* Private variables ---------------------------------------------------------*/
+static uint32_t usb_fifo_bench_window[4];                           /* stands in for a DFIFO window */
+static uint32_t usb_fifo_bench_buf[USB_FIFO_BENCH_MAX / 4U];
+
+/* Private function prototypes -----------------------------------------------*/
+static void usb_fifo_bench_write(const USB_OTG_GlobalTypeDef *USBx, const uint8_t *src, uint16_t len);
+static void usb_fifo_bench_read(const USB_OTG_GlobalTypeDef *USBx, uint8_t *dest, uint16_t len);
+#endif /* USB_FIFO_BENCH */
+
+/**
+  * @brief  Size the FIFOs for a configuration.
+  * @param  config: full speed configuration descriptor, all of wTotalLength
+  * @param  len: bytes available at config
+  * @param  ep0_mps: bMaxPacketSize0 of the device descriptor
+  * @param  plan: filled in, also when the FIFOs do not fit
+  * @retval USB_FIFO_OK, or why the configuration cannot be served
+  */
+usb_fifo_status_t usb_fifo_plan(const uint8_t *config, uint16_t len, uint8_t ep0_mps, usb_fifo_plan_t *plan)
+{
+  uint16_t in_mps[USB_FIFO_EPS];
+  uint8_t in_packets[USB_FIFO_EPS];
+  uint8_t out_used[USB_FIFO_EPS];
+  uint32_t out_count = 0U;
+  uint32_t total;
+  uint32_t words;
+  uint32_t pos;
+  uint16_t mps;
+  uint8_t num;
+  uint8_t type;
+  uint8_t i;
+
+  memset(plan, 0, sizeof(*plan));
+  memset(in_mps, 0, sizeof(in_mps));
+  memset(in_packets, 0, sizeof(in_packets));
+  memset(out_used, 0, sizeof(out_used));
+
+  if ((config == NULL) || (len < USB_LEN_CFG_DESC) || (config[0] < USB_LEN_CFG_DESC) ||
+      (config[1] != USB_DESC_TYPE_CONFIGURATION))
+  {
+    return USB_FIFO_BAD_DESCRIPTOR;
+  }
+  total = (uint32_t)config[2] | ((uint32_t)config[3] << 8);
+  if ((total > len) || (total < USB_LEN_CFG_DESC))
+  {
+    return USB_FIFO_BAD_DESCRIPTOR;
+  }
+  if ((ep0_mps != 8U) && (ep0_mps != 16U) && (ep0_mps != 32U) && (ep0_mps != 64U))
+  {
+    return USB_FIFO_BAD_ENDPOINT;
+  }
+
+  /* EP0 both ways */
+  in_mps[0] = ep0_mps;
+  in_packets[0] = 1U;
+  out_used[0] = 1U;
+  plan->rx_packet = ep0_mps;
+
+  for (pos = 0U; pos < total; pos += config[pos])
+  {
+    if ((config[pos] < 2U) || ((pos + config[pos]) > total))
+    {
+      return USB_FIFO_BAD_DESCRIPTOR;
+    }
+    if (config[pos + 1U] != USB_DESC_TYPE_ENDPOINT)
+    {
+      continue;
+    }
+    if (config[pos] < USB_LEN_EP_DESC)
+    {
+      return USB_FIFO_BAD_DESCRIPTOR;
+    }
+
+    num = config[pos + 2U] & 0x0FU;
+    type = config[pos + 3U] & 0x03U;
+    mps = (uint16_t)(((uint32_t)config[pos + 4U] | ((uint32_t)config[pos + 5U] << 8)) & 0x07FFU);
+    if ((num == 0U) || (num >= USB_FIFO_EPS) || (mps == 0U) || (type == USBD_EP_TYPE_CTRL) ||
+        (mps > ((type == USBD_EP_TYPE_ISOC) ? USB_FIFO_ISO_MAX_PACKET : USB_FS_MAX_PACKET_SIZE)))
+    {
+      return USB_FIFO_BAD_ENDPOINT;
+    }
+
+    if ((config[pos + 2U] & 0x80U) != 0U)
+    {
+      in_mps[num] = MAX(in_mps[num], mps);
+      if ((type == USBD_EP_TYPE_BULK) || (type == USBD_EP_TYPE_ISOC))
+      {
+        in_packets[num] = USB_FIFO_STREAM_PACKETS;
+      }
+      else if (in_packets[num] == 0U)
+      {
+        in_packets[num] = 1U;
+      }
+    }
+    else
+    {
+      out_used[num] = 1U;
+      plan->rx_packet = MAX(plan->rx_packet, mps);
+    }
+  }
+
+  for (i = 0U; i < USB_FIFO_EPS; i++)
+  {
+    out_count += out_used[i];
+    if (in_mps[i] != 0U)
+    {
+      plan->tx_count = (uint8_t)(i + 1U);
+    }
+  }
+
+  plan->rx_words = (uint16_t)(USB_FIFO_RX_SETUP_WORDS + (2U * (USB_FIFO_PACKET_WORDS(plan->rx_packet) + 1U)) +
+                              (2U * out_count) + 1U);
+  words = plan->rx_words;
+  for (i = 0U; i < plan->tx_count; i++)
+  {
+    plan->tx_offset[i] = (uint16_t)words;
+    plan->tx_words[i] = (uint16_t)MAX(USB_FIFO_TX_MIN, USB_FIFO_PACKET_WORDS(in_mps[i]) * in_packets[i]);
+    words += plan->tx_words[i];
+  }
+  plan->used_words = (uint16_t)words;
+
+  return (words <= USB_FIFO_WORDS) ? USB_FIFO_OK : USB_FIFO_FULL;
+}
+
+/**
+  * @brief  Size the FIFOs for the registered classes.
+  * @note   Call once the classes are registered, before the core connects.
+  * @param  pdev: device handle
+  * @param  plan: filled in
+  * @retval usb_fifo_plan() status
+  */
+usb_fifo_status_t usb_fifo_plan_device(USBD_HandleTypeDef *pdev, usb_fifo_plan_t *plan)
+{
+  const uint8_t *config = NULL;
+  const uint8_t *device;
+  uint16_t len = 0U;
+  uint16_t device_len = 0U;
+
+  memset(plan, 0, sizeof(*plan));
+  if ((pdev->pDesc == NULL) || (pdev->pDesc->GetDeviceDescriptor == NULL))
+  {
+    return USB_FIFO_BAD_DESCRIPTOR;
+  }
+
+  /* The same descriptors USBD_GetDescriptor() answers with */
+#ifdef USE_USBD_COMPOSITE
+  if ((uint8_t)(pdev->NumClasses) > 0U)
+  {
+    config = USBD_CMPSIT.GetFSConfigDescriptor(&len);
+  }
+  else
+#endif /* USE_USBD_COMPOSITE */
+  if ((pdev->pClass[0] != NULL) && (pdev->pClass[0]->GetFSConfigDescriptor != NULL))
+  {
+    config = pdev->pClass[0]->GetFSConfigDescriptor(&len);
+  }
+
+  device = pdev->pDesc->GetDeviceDescriptor(USBD_SPEED_FULL, &device_len);
+  if ((config == NULL) || (device == NULL) || (device_len < USB_LEN_DEV_DESC))
+  {
+    return USB_FIFO_BAD_DESCRIPTOR;
+  }
+
+  return usb_fifo_plan(config, len, device[7], plan);
+}
+
+#if (USB_FIFO_BENCH == 1U)
+/**
+  * @brief  Log the cycles the FIFO copy routines take for 8, 64 and 512 byte
+  *         packets, against the word loops they replaced.
+  * @note   Call once the DWT cycle counter runs, before the USB core starts.
+  *         A RAM word array stands in for the DFIFO window, so the figures
+  *         leave out the AHB2 wait states of the FIFO; the old and new counts
+  *         compare the instructions. Best of USB_FIFO_BENCH_RUNS, interrupts
+  *         masked.
+  * @retval None
+  */
+void usb_fifo_bench(void)
+{
+  static const uint16_t lens[3] = { 8U, 64U, USB_FIFO_BENCH_MAX };
+  /* USBx_DFIFO(0) lands on the window */
+  const USB_OTG_GlobalTypeDef *USBx =
+    (const USB_OTG_GlobalTypeDef *)((uint32_t)usb_fifo_bench_window - USB_OTG_FIFO_BASE);
+  uint8_t *buf = (uint8_t *)usb_fifo_bench_buf;
+  uint32_t cycles[4];
+  uint32_t start;
+  uint32_t primask;
+  uint32_t run;
+  uint32_t i;
+  uint32_t k;
+
+  for (i = 0U; i < (sizeof(lens) / sizeof(lens[0])); i++)
+  {
+    for (k = 0U; k < 4U; k++)
+    {
+      cycles[k] = UINT32_MAX;
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    for (run = 0U; run < USB_FIFO_BENCH_RUNS; run++)
+    {
+      start = DWT->CYCCNT;
+      usb_fifo_bench_write(USBx, buf, lens[i]);
+      cycles[0] = MIN(cycles[0], DWT->CYCCNT - start);
+
+      start = DWT->CYCCNT;
+      (void)USB_WritePacket(USBx, buf, 0U, lens[i], 0U);
+      cycles[1] = MIN(cycles[1], DWT->CYCCNT - start);
+
+      start = DWT->CYCCNT;
+      usb_fifo_bench_read(USBx, buf, lens[i]);
+      cycles[2] = MIN(cycles[2], DWT->CYCCNT - start);
+
+      start = DWT->CYCCNT;
+      (void)USB_ReadPacket(USBx, buf, lens[i]);
+      cycles[3] = MIN(cycles[3], DWT->CYCCNT - start);
+    }
+    __set_PRIMASK(primask);
+
+    (void)log_line("usb fifo: ", "%u bytes: write %lu -> %lu cycles, read %lu -> %lu cycles", lens[i],
+                   (unsigned long)cycles[0], (unsigned long)cycles[1], (unsigned long)cycles[2],
+                   (unsigned long)cycles[3]);
+  }
+}
+
+/**
+  * @brief  USB_WritePacket() copy loop before the four word bursts.
+  * @param  USBx: core
+  * @param  src: packet
+  * @param  len: packet length
+  * @retval None
+  */
+static void usb_fifo_bench_write(const USB_OTG_GlobalTypeDef *USBx, const uint8_t *src, uint16_t len)
+{
+  uint32_t USBx_BASE = (uint32_t)USBx;
+  const uint8_t *pSrc = src;
+  uint32_t count32b = USB_FIFO_PACKET_WORDS(len);
+  uint32_t i;
+
+  for (i = 0U; i < count32b; i++)
+  {
+    USBx_DFIFO(0U) = __UNALIGNED_UINT32_READ(pSrc);
+    pSrc++;
+    pSrc++;
+    pSrc++;
+    pSrc++;
+  }
+}
+
+/**
+  * @brief  USB_ReadPacket() copy loop before the four word bursts.
+  * @param  USBx: core
+  * @param  dest: packet buffer
+  * @param  len: packet length
+  * @retval None
+  */
+static void usb_fifo_bench_read(const USB_OTG_GlobalTypeDef *USBx, uint8_t *dest, uint16_t len)
+{
+  uint32_t USBx_BASE = (uint32_t)USBx;
+  uint8_t *pDest = dest;
+  uint32_t pData;
+  uint32_t i;
+  uint32_t count32b = (uint32_t)len >> 2U;
+  uint16_t remaining_bytes = len % 4U;
+
+  for (i = 0U; i < count32b; i++)
+  {
+    __UNALIGNED_UINT32_WRITE(pDest, USBx_DFIFO(0U));
+    pDest++;
+    pDest++;
+    pDest++;
+    pDest++;
+  }
+
+  if (remaining_bytes != 0U)
+  {
+    i = 0U;
+    __UNALIGNED_UINT32_WRITE(&pData, USBx_DFIFO(0U));
+
+    do
+    {
+      *(uint8_t *)pDest = (uint8_t)(pData >> (8U * (uint8_t)(i)));
+      i++;
+      pDest++;
+      remaining_bytes--;
+    } while (remaining_bytes != 0U);
+  }
+}
+#endif /* USB_FIFO_BENCH */
@@ -0,0 +1,237 @@
+/**
+  ******************************************************************************
+  * @file           : usb_power.c
+  * @brief          : USB suspend, STOP mode and remote wakeup
+  ******************************************************************************
+  * The PCD callbacks only raise events; the state machine runs in the main
+  * loop, so STOP mode is never entered from an interrupt handler.
+  *
+  * On suspend the key scanner is stopped, every column is driven low and the
+  * rows become falling-edge EXTI lines (matrix_scan_wake_arm()), so any key,
+  * like the USER button on EXTI0, wakes the chip. The CPU then sleeps in STOP
+  * mode with the low-power regulator and the flash powered down. Every wake
+  * event restores the PLL with SystemClock_Config() before interrupts are
+  * unmasked. Without a resume from the host, or a key while the host has
+  * enabled remote wakeup with SET_FEATURE, the CPU goes back to STOP.
+  *
+  * A key wake drives resume signalling for USB_POWER_SIGNAL_MS once the bus
+  * has been idle for 5 ms. The scanner restarts when the bus resumes, so
+  * the key that woke the host is found by the first scans and reported on
+  * the first polls.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usb_power.h"
+#include "main.h"
+#include "matrix_scan.h"
+#include "usbd_core.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+/* Events raised by the PCD callbacks and the key lines */
+#define USB_POWER_EVENT_SUSPEND   0x01U
+#define USB_POWER_EVENT_RESUME    0x02U
+#define USB_POWER_EVENT_KEY       0x04U
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+static volatile uint32_t usb_power_events;
+static usb_power_state_t usb_power_state;
+static uint32_t usb_power_tick;           /* HAL_GetTick() of the suspend, then of the signalling start */
+static usb_power_stats_t usb_power_stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static void usb_power_stop(void);
+static void usb_power_restore(void);
+
+/**
+  * @brief  Start in the active state.
+  * @note   Call before MX_USB_DEVICE_Init().
+  * @retval None
+  */
+void usb_power_init(void)
+{
+  usb_power_events = 0U;
+  usb_power_state = USB_POWER_ACTIVE;
+  memset(&usb_power_stats, 0, sizeof(usb_power_stats));
+
+  /* Nothing runs from flash in STOP mode: a few us more to wake for less current */
+  HAL_PWREx_EnableFlashPowerDown();
+}
+
+/**
+  * @brief  Run the suspend state machine, sleeping in STOP mode while the
+  *         bus is suspended.
+  * @retval state after the step, key reports are only sent when USB_POWER_ACTIVE
+  */
+usb_power_state_t usb_power_task(void)
+{
+  uint32_t primask;
+  uint32_t events;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  events = usb_power_events;
+  usb_power_events = 0U;
+  __set_PRIMASK(primask);
+
+  switch (usb_power_state)
+  {
+    case USB_POWER_ACTIVE:
+      /* A resume read in the same pass cancels the suspend */
+      if ((events & (USB_POWER_EVENT_SUSPEND | USB_POWER_EVENT_RESUME)) == USB_POWER_EVENT_SUSPEND)
+      {
+        matrix_scan_stop();
+        matrix_scan_wake_arm();
+        usb_power_tick = HAL_GetTick();
+        usb_power_state = USB_POWER_SUSPENDED;
+        usb_power_stats.suspends++;
+      }
+      break;
+
+    case USB_POWER_SUSPENDED:
+      if ((events & USB_POWER_EVENT_RESUME) != 0U)
+      {
+        usb_power_stats.resumes++;
+        usb_power_restore();
+      }
+      else if ((events & USB_POWER_EVENT_KEY) != 0U)
+      {
+        if (hUsbDeviceFS.dev_remote_wakeup != 0U)
+        {
+          usb_power_state = USB_POWER_WAKEUP;
+        }
+        else
+        {
+          usb_power_stats.ignored_wakes++;
+        }
+      }
+      break;
+
+    case USB_POWER_WAKEUP:
+      if ((events & USB_POWER_EVENT_RESUME) != 0U)
+      {
+        usb_power_stats.resumes++;
+        usb_power_restore();
+      }
+      else if ((HAL_GetTick() - usb_power_tick) >= USB_POWER_IDLE_MS)
+      {
+        (void)USBD_LL_RemoteWakeup(&hUsbDeviceFS, 1U);
+        usb_power_tick = HAL_GetTick();
+        usb_power_state = USB_POWER_SIGNALLING;
+      }
+      break;
+
+    case USB_POWER_SIGNALLING:
+      /* The host answers with its own resume signalling: drive the full time regardless */
+      if ((HAL_GetTick() - usb_power_tick) >= USB_POWER_SIGNAL_MS)
+      {
+        (void)USBD_LL_RemoteWakeup(&hUsbDeviceFS, 0U);
+        (void)USBD_LL_Resume(&hUsbDeviceFS);
+        usb_power_stats.remote_wakeups++;
+        usb_power_restore();
+      }
+      break;
+
+    default:
+      break;
+  }
+
+  if (usb_power_state == USB_POWER_SUSPENDED)
+  {
+    usb_power_stop();
+  }
+
+  return usb_power_state;
+}
+
+/**
+  * @brief  The bus has been idle for 3 ms, called from HAL_PCD_SuspendCallback.
+  * @retval None
+  */
+void usb_power_suspend(void)
+{
+  usb_power_events |= USB_POWER_EVENT_SUSPEND;
+}
+
+/**
+  * @brief  The host resumed or reset the bus, called from the PCD callbacks.
+  * @retval None
+  */
+void usb_power_resume(void)
+{
+  usb_power_events |= USB_POWER_EVENT_RESUME;
+}
+
+/**
+  * @brief  A key line fired, called from HAL_GPIO_EXTI_Callback.
+  * @note   Only a wake request while suspended, or about to be.
+  * @retval None
+  */
+void usb_power_key_wake(void)
+{
+  if ((usb_power_state != USB_POWER_ACTIVE) || ((usb_power_events & USB_POWER_EVENT_SUSPEND) != 0U))
+  {
+    usb_power_events |= USB_POWER_EVENT_KEY;
+  }
+}
+
+/**
+  * @brief  Current state.
+  * @retval usb_power_state_t
+  */
+usb_power_state_t usb_power_get_state(void)
+{
+  return usb_power_state;
+}
+
+/**
+  * @brief  Suspend and wake counters since usb_power_init().
+  * @param  stats: filled with the counters
+  * @retval None
+  */
+void usb_power_get_stats(usb_power_stats_t *stats)
+{
+  *stats = usb_power_stats;
+}
+
+/**
+  * @brief  Sleep in STOP mode until the next wake event.
+  * @note   Interrupts stay masked until the clocks are back, WFI still
+  *         wakes on a pending one.
+  * @retval None
+  */
+static void usb_power_stop(void)
+{
+  uint32_t primask;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  /* An event raised since usb_power_task() read them is handled first */
+  if (usb_power_events == 0U)
+  {
+    HAL_SuspendTick();
+    HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+
+    /* Woken up on the HSI */
+    SystemClock_Config();
+    HAL_ResumeTick();
+    usb_power_stats.stops++;
+  }
+
+  __set_PRIMASK(primask);
+}
+
+/**
+  * @brief  Back to scanning the keys.
+  * @retval None
+  */
+static void usb_power_restore(void)
+{
+  matrix_scan_wake_disarm();
+  matrix_scan_start();
+  usb_power_state = USB_POWER_ACTIVE;
+}
@@ -41,6 +41,17 @@ defined in linker script */
 .word _sbss
 /* end address for the .bss section. defined in linker script */
 .word _ebss
+/* start address for the initialization values of the .ram_code section.
+defined in linker script */
+.word _siramcode
+/* start address for the .ram_code section. defined in linker script */
+.word _sramcode
+/* end address for the .ram_code section. defined in linker script */
+.word _eramcode
+/* start address for the SRAM copy of the vector table. defined in linker script */
+.word _sram_vector
+/* end address for the SRAM copy of the vector table. defined in linker script */
+.word _eram_vector
 
 /**
  * @brief  This is the code that gets called when the processor first
@@ -77,6 +88,45 @@ LoopCopyDataInit:
   cmp r4, r1
   bcc CopyDataInit
 
+/* Copy the interrupt hot path from flash to SRAM */
+  ldr r0, =_sramcode
+  ldr r1, =_eramcode
+  ldr r2, =_siramcode
+  movs r3, #0
+  b LoopCopyRamCode
+
+CopyRamCode:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyRamCode:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyRamCode
+
+/* Copy the vector table to SRAM and take exceptions from there */
+  ldr r0, =_sram_vector
+  ldr r1, =_eram_vector
+  ldr r2, =g_pfnVectors
+  movs r3, #0
+  b LoopCopyVectors
+
+CopyVectors:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyVectors:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyVectors
+
+  ldr r1, =0xE000ED08   /* SCB->VTOR */
+  str r0, [r1]
+  dsb
+  isb
+
 /* Zero fill the bss segment. */
   ldr r2, =_sbss
   ldr r4, =_ebss
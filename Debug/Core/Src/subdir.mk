@@ -5,38 +5,86 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 C_SRCS += \
+../Core/Src/config_store.c \
+../Core/Src/debounce.c \
+../Core/Src/hid_config.c \
+../Core/Src/hid_controls.c \
+../Core/Src/hid_keyboard.c \
+../Core/Src/kbd_layout.c \
+../Core/Src/key_events.c \
+../Core/Src/keyboard.c \
+../Core/Src/latency_trace.c \
+../Core/Src/log_stream.c \
+../Core/Src/macro.c \
 ../Core/Src/main.c \
+../Core/Src/matrix.c \
+../Core/Src/matrix_scan.c \
 ../Core/Src/stm32f4xx_hal_msp.c \
 ../Core/Src/stm32f4xx_it.c \
 ../Core/Src/syscalls.c \
 ../Core/Src/sysmem.c \
-../Core/Src/system_stm32f4xx.c 
+../Core/Src/system_stm32f4xx.c \
+../Core/Src/typing.c \
+../Core/Src/usb_fifo.c \
+../Core/Src/usb_power.c 
 
 OBJS += \
+./Core/Src/config_store.o \
+./Core/Src/debounce.o \
+./Core/Src/hid_config.o \
+./Core/Src/hid_controls.o \
+./Core/Src/hid_keyboard.o \
+./Core/Src/kbd_layout.o \
+./Core/Src/key_events.o \
+./Core/Src/keyboard.o \
+./Core/Src/latency_trace.o \
+./Core/Src/log_stream.o \
+./Core/Src/macro.o \
 ./Core/Src/main.o \
+./Core/Src/matrix.o \
+./Core/Src/matrix_scan.o \
 ./Core/Src/stm32f4xx_hal_msp.o \
 ./Core/Src/stm32f4xx_it.o \
 ./Core/Src/syscalls.o \
 ./Core/Src/sysmem.o \
-./Core/Src/system_stm32f4xx.o 
+./Core/Src/system_stm32f4xx.o \
+./Core/Src/typing.o \
+./Core/Src/usb_fifo.o \
+./Core/Src/usb_power.o 
 
 C_DEPS += \
+./Core/Src/config_store.d \
+./Core/Src/debounce.d \
+./Core/Src/hid_config.d \
+./Core/Src/hid_controls.d \
+./Core/Src/hid_keyboard.d \
+./Core/Src/kbd_layout.d \
+./Core/Src/key_events.d \
+./Core/Src/keyboard.d \
+./Core/Src/latency_trace.d \
+./Core/Src/log_stream.d \
+./Core/Src/macro.d \
 ./Core/Src/main.d \
+./Core/Src/matrix.d \
+./Core/Src/matrix_scan.d \
 ./Core/Src/stm32f4xx_hal_msp.d \
 ./Core/Src/stm32f4xx_it.d \
 ./Core/Src/syscalls.d \
 ./Core/Src/sysmem.d \
-./Core/Src/system_stm32f4xx.d 
+./Core/Src/system_stm32f4xx.d \
+./Core/Src/typing.d \
+./Core/Src/usb_fifo.d \
+./Core/Src/usb_power.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
 Core/Src/%.o Core/Src/%.su Core/Src/%.cyclo: ../Core/Src/%.c Core/Src/subdir.mk
-	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g3 -DDEBUG -DUSE_HAL_DRIVER -DSTM32F411xE -c -I../USB_DEVICE/App -I../USB_DEVICE/Target -I../Core/Inc -I../Drivers/STM32F4xx_HAL_Driver/Inc -I../Drivers/STM32F4xx_HAL_Driver/Inc/Legacy -I../Middlewares/ST/STM32_USB_Device_Library/Core/Inc -I../Middlewares/ST/STM32_USB_Device_Library/Class/HID/Inc -I../Drivers/CMSIS/Device/ST/STM32F4xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -fcyclomatic-complexity -MMD -MP -MF"$(@:%.o=%.d)" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
+	arm-none-eabi-gcc "$<" -mcpu=cortex-m4 -std=gnu11 -g3 -DDEBUG -DUSE_HAL_DRIVER -DSTM32F411xE -c -I../USB_DEVICE/App -I../USB_DEVICE/Target -I../Core/Inc -I../Drivers/STM32F4xx_HAL_Driver/Inc -I../Drivers/STM32F4xx_HAL_Driver/Inc/Legacy -I../Middlewares/ST/STM32_USB_Device_Library/Core/Inc -I../Middlewares/ST/STM32_USB_Device_Library/Class/HID/Inc -I../Middlewares/ST/STM32_USB_Device_Library/Class/CDC/Inc -I../Middlewares/ST/STM32_USB_Device_Library/Class/CompositeBuilder/Inc -I../Drivers/CMSIS/Device/ST/STM32F4xx/Include -I../Drivers/CMSIS/Include -O0 -ffunction-sections -fdata-sections -Wall -fstack-usage -fcyclomatic-complexity -MMD -MP -MF"$(@:%.o=%.d)" -MT"$@" --specs=nano.specs -mfpu=fpv4-sp-d16 -mfloat-abi=hard -mthumb -o "$@"
 
 clean: clean-Core-2f-Src
 
 clean-Core-2f-Src:
-	-$(RM) ./Core/Src/main.cyclo ./Core/Src/main.d ./Core/Src/main.o ./Core/Src/main.su ./Core/Src/stm32f4xx_hal_msp.cyclo ./Core/Src/stm32f4xx_hal_msp.d ./Core/Src/stm32f4xx_hal_msp.o ./Core/Src/stm32f4xx_hal_msp.su ./Core/Src/stm32f4xx_it.cyclo ./Core/Src/stm32f4xx_it.d ./Core/Src/stm32f4xx_it.o ./Core/Src/stm32f4xx_it.su ./Core/Src/syscalls.cyclo ./Core/Src/syscalls.d ./Core/Src/syscalls.o ./Core/Src/syscalls.su ./Core/Src/sysmem.cyclo ./Core/Src/sysmem.d ./Core/Src/sysmem.o ./Core/Src/sysmem.su ./Core/Src/system_stm32f4xx.cyclo ./Core/Src/system_stm32f4xx.d ./Core/Src/system_stm32f4xx.o ./Core/Src/system_stm32f4xx.su
+	-$(RM) ./Core/Src/config_store.cyclo ./Core/Src/config_store.d ./Core/Src/config_store.o ./Core/Src/config_store.su ./Core/Src/debounce.cyclo ./Core/Src/debounce.d ./Core/Src/debounce.o ./Core/Src/debounce.su ./Core/Src/hid_config.cyclo ./Core/Src/hid_config.d ./Core/Src/hid_config.o ./Core/Src/hid_config.su ./Core/Src/hid_controls.cyclo ./Core/Src/hid_controls.d ./Core/Src/hid_controls.o ./Core/Src/hid_controls.su ./Core/Src/hid_keyboard.cyclo ./Core/Src/hid_keyboard.d ./Core/Src/hid_keyboard.o ./Core/Src/hid_keyboard.su ./Core/Src/kbd_layout.cyclo ./Core/Src/kbd_layout.d ./Core/Src/kbd_layout.o ./Core/Src/kbd_layout.su ./Core/Src/key_events.cyclo ./Core/Src/key_events.d ./Core/Src/key_events.o ./Core/Src/key_events.su ./Core/Src/keyboard.cyclo ./Core/Src/keyboard.d ./Core/Src/keyboard.o ./Core/Src/keyboard.su ./Core/Src/latency_trace.cyclo ./Core/Src/latency_trace.d ./Core/Src/latency_trace.o ./Core/Src/latency_trace.su ./Core/Src/log_stream.cyclo ./Core/Src/log_stream.d ./Core/Src/log_stream.o ./Core/Src/log_stream.su ./Core/Src/macro.cyclo ./Core/Src/macro.d ./Core/Src/macro.o ./Core/Src/macro.su ./Core/Src/main.cyclo ./Core/Src/main.d ./Core/Src/main.o ./Core/Src/main.su ./Core/Src/matrix.cyclo ./Core/Src/matrix.d ./Core/Src/matrix.o ./Core/Src/matrix.su ./Core/Src/matrix_scan.cyclo ./Core/Src/matrix_scan.d ./Core/Src/matrix_scan.o ./Core/Src/matrix_scan.su ./Core/Src/stm32f4xx_hal_msp.cyclo ./Core/Src/stm32f4xx_hal_msp.d ./Core/Src/stm32f4xx_hal_msp.o ./Core/Src/stm32f4xx_hal_msp.su ./Core/Src/stm32f4xx_it.cyclo ./Core/Src/stm32f4xx_it.d ./Core/Src/stm32f4xx_it.o ./Core/Src/stm32f4xx_it.su ./Core/Src/syscalls.cyclo ./Core/Src/syscalls.d ./Core/Src/syscalls.o ./Core/Src/syscalls.su ./Core/Src/sysmem.cyclo ./Core/Src/sysmem.d ./Core/Src/sysmem.o ./Core/Src/sysmem.su ./Core/Src/system_stm32f4xx.cyclo ./Core/Src/system_stm32f4xx.d ./Core/Src/system_stm32f4xx.o ./Core/Src/system_stm32f4xx.su ./Core/Src/typing.cyclo ./Core/Src/typing.d ./Core/Src/typing.o ./Core/Src/typing.su ./Core/Src/usb_fifo.cyclo ./Core/Src/usb_fifo.d ./Core/Src/usb_fifo.o ./Core/Src/usb_fifo.su ./Core/Src/usb_power.cyclo ./Core/Src/usb_power.d ./Core/Src/usb_power.o ./Core/Src/usb_power.su
 
 .PHONY: clean-Core-2f-Src
 
@@ -55,6 +55,8 @@
 /* Private functions ---------------------------------------------------------*/
 #if defined (USB_OTG_FS) || defined (USB_OTG_HS)
 static HAL_StatusTypeDef USB_CoreReset(USB_OTG_GlobalTypeDef *USBx);
+static inline void USB_FifoPush4(__IO uint32_t *fifo, const uint8_t *src);
+static inline void USB_FifoPop4(uint8_t *dest, __IO uint32_t *fifo);
 
 /* Exported functions --------------------------------------------------------*/
 /** @defgroup USB_LL_Exported_Functions USB Low Layer Exported Functions
@@ -1008,6 +1010,17 @@ HAL_StatusTypeDef USB_WritePacket(const USB_OTG_GlobalTypeDef *USBx, uint8_t *sr
   if (dma == 0U)
   {
     count32b = ((uint32_t)len + 3U) / 4U;
+
+    /* Word aligned buffer: bursts of four words, the rest one word at a time */
+    if (((uint32_t)pSrc & 3U) == 0U)
+    {
+      for (; count32b >= 4U; count32b -= 4U)
+      {
+        USB_FifoPush4(&USBx_DFIFO((uint32_t)ch_ep_num), pSrc);
+        pSrc += 16U;
+      }
+    }
+
     for (i = 0U; i < count32b; i++)
     {
       USBx_DFIFO((uint32_t)ch_ep_num) = __UNALIGNED_UINT32_READ(pSrc);
@@ -1037,6 +1050,16 @@ void *USB_ReadPacket(const USB_OTG_GlobalTypeDef *USBx, uint8_t *dest, uint16_t
   uint32_t count32b = (uint32_t)len >> 2U;
   uint16_t remaining_bytes = len % 4U;
 
+  /* Word aligned buffer: bursts of four words, the rest one word at a time */
+  if (((uint32_t)pDest & 3U) == 0U)
+  {
+    for (; count32b >= 4U; count32b -= 4U)
+    {
+      USB_FifoPop4(pDest, &USBx_DFIFO(0U));
+      pDest += 16U;
+    }
+  }
+
   for (i = 0U; i < count32b; i++)
   {
     __UNALIGNED_UINT32_WRITE(pDest, USBx_DFIFO(0U));
@@ -1442,6 +1465,55 @@ static HAL_StatusTypeDef USB_CoreReset(USB_OTG_GlobalTypeDef *USBx)
   return HAL_OK;
 }
 
+/**
+  * @brief  Push four words from a word aligned buffer into a Tx FIFO
+  * @note   Every word of the 4 KB DFIFO window of a FIFO reaches the FIFO, so
+  *         the four words go to four consecutive addresses in ascending order:
+  *         one LDM and one STM on the Cortex-M4, which continues an interrupted
+  *         STM from the next register rather than pushing a word twice.
+  * @param  fifo  first word of the DFIFO window
+  * @param  src  word aligned source
+  * @retval None
+  */
+static inline void USB_FifoPush4(__IO uint32_t *fifo, const uint8_t *src)
+{
+#if defined (__GNUC__) && defined (__ARM_ARCH_7EM__)
+  __ASM volatile ("ldmia %1, {r4-r7}\n\t"
+                  "stmia %0, {r4-r7}"
+                  : : "r" (fifo), "r" (src) : "r4", "r5", "r6", "r7", "memory");
+#else
+  const uint32_t *pWord = (const uint32_t *)(const void *)src;
+
+  fifo[0] = pWord[0];
+  fifo[1] = pWord[1];
+  fifo[2] = pWord[2];
+  fifo[3] = pWord[3];
+#endif /* __GNUC__ && __ARM_ARCH_7EM__ */
+}
+
+/**
+  * @brief  Pop four words from the Rx FIFO into a word aligned buffer
+  * @note   Same window addressing as USB_FifoPush4()
+  * @param  dest  word aligned destination
+  * @param  fifo  first word of the DFIFO window
+  * @retval None
+  */
+static inline void USB_FifoPop4(uint8_t *dest, __IO uint32_t *fifo)
+{
+#if defined (__GNUC__) && defined (__ARM_ARCH_7EM__)
+  __ASM volatile ("ldmia %1, {r4-r7}\n\t"
+                  "stmia %0, {r4-r7}"
+                  : : "r" (dest), "r" (fifo) : "r4", "r5", "r6", "r7", "memory");
+#else
+  uint32_t *pWord = (uint32_t *)(void *)dest;
+
+  pWord[0] = fifo[0];
+  pWord[1] = fifo[1];
+  pWord[2] = fifo[2];
+  pWord[3] = fifo[3];
+#endif /* __GNUC__ && __ARM_ARCH_7EM__ */
+}
+
 /**
   * @brief  USB_HostInit : Initializes the USB OTG controller registers
   *         for Host mode
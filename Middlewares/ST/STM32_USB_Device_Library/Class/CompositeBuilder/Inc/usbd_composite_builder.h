@@ -0,0 +1,78 @@
+/**
+  ******************************************************************************
+  * @file    usbd_composite_builder.h
+  * @author  MCD Application Team
+  * @brief   Header for the usbd_composite_builder.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2021 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_COMPOSITE_BUILDER_H__
+#define __USBD_COMPOSITE_BUILDER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_ioreq.h"
+
+#if USBD_CMPSIT_ACTIVATE_HID == 1U
+#include "usbd_hid.h"
+#endif /* USBD_CMPSIT_ACTIVATE_HID */
+
+#if USBD_CMPSIT_ACTIVATE_CDC == 1U
+#include "usbd_cdc.h"
+#endif /* USBD_CMPSIT_ACTIVATE_CDC */
+
+/* Private defines -----------------------------------------------------------*/
+/* Only HID and CDC-ACM are built in this tree; the configuration descriptor
+   has room for the two of them */
+#ifndef USBD_CMPST_MAX_CONFDESC_SZ
+#define USBD_CMPST_MAX_CONFDESC_SZ                     128U
+#endif /* USBD_CMPST_MAX_CONFDESC_SZ */
+
+/* Exported types ------------------------------------------------------------*/
+/* Exported macros -----------------------------------------------------------*/
+#ifdef USE_USBD_COMPOSITE
+/* Exported variables --------------------------------------------------------*/
+extern USBD_ClassTypeDef  USBD_CMPSIT;
+
+/* Exported functions prototypes ---------------------------------------------*/
+uint8_t  USBD_CMPSIT_AddClass(USBD_HandleTypeDef *pdev,
+                              USBD_ClassTypeDef *pclass,
+                              USBD_CompositeClassTypeDef class,
+                              uint8_t cfgidx);
+
+uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev);
+
+uint32_t USBD_CMPSIT_SetClassID(USBD_HandleTypeDef *pdev,
+                                USBD_CompositeClassTypeDef Class,
+                                uint32_t Instance);
+
+uint32_t USBD_CMPSIT_GetClassID(USBD_HandleTypeDef *pdev,
+                                USBD_CompositeClassTypeDef Class,
+                                uint32_t Instance);
+
+uint8_t USBD_CMPST_ClearConfDesc(USBD_HandleTypeDef *pdev);
+#endif /* USE_USBD_COMPOSITE */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* __USBD_COMPOSITE_BUILDER_H__ */
+
+/**
+  * @}
+  */
@@ -0,0 +1,750 @@
+/**
+  ******************************************************************************
+  * @file    usbd_composite_builder.c
+  * @author  MCD Application Team
+  * @brief   This file provides all the composite builder functions.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2021 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  * @verbatim
+  *
+  *          ===================================================================
+  *                                Composite Builder  Description
+  *          ===================================================================
+  *
+  *           The composite builder builds the configuration descriptors based on
+  *           the selection of classes by user.
+  *           It includes all USB Device classes in order to instantiate their
+  *           descriptors, but for better management, it is possible to optimize
+  *           footprint by removing unused classes. It is possible to do so by
+  *           commenting the relative define in usbd_conf.h.
+  *
+  *           This trimmed copy knows the two classes built in this tree:
+  *             - HID: one interface, interrupt IN and OUT endpoints
+  *             - CDC-ACM: an interface association, the communication
+  *               interface with its notification endpoint and the data
+  *               interface with bulk IN and OUT endpoints
+  *           Each class registered with USBD_RegisterClassComposite() gets the
+  *           next free interface numbers and the endpoint addresses passed by
+  *           the application, in the order IN, OUT, command.
+  *
+  *  @endverbatim
+  *
+  ******************************************************************************
+  */
+
+/* BSPDependencies
+- None
+EndBSPDependencies */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_composite_builder.h"
+
+#if USBD_CMPSIT_ACTIVATE_HID == 1U
+#include "usbd_hid_report_desc.h"
+#endif /* USBD_CMPSIT_ACTIVATE_HID */
+
+#ifdef USE_USBD_COMPOSITE
+
+/** @addtogroup STM32_USB_DEVICE_LIBRARY
+  * @{
+  */
+
+
+/** @defgroup CMPSIT_CORE
+  * @brief Mass storage core module
+  * @{
+  */
+
+/** @defgroup CMPSIT_CORE_Private_TypesDefinitions
+  * @{
+  */
+/**
+  * @}
+  */
+
+
+/** @defgroup CMPSIT_CORE_Private_Defines
+  * @{
+  */
+#define USBD_CMPSIT_CFG_DESC_SIZ                   0x09U
+#define USBD_CMPSIT_IAD_DESC_SIZ                   0x08U
+#define USBD_CMPSIT_IF_DESC_SIZ                    0x09U
+#define USBD_CMPSIT_EP_DESC_SIZ                    0x07U
+
+/**
+  * @}
+  */
+
+
+/** @defgroup CMPSIT_CORE_Private_Macros
+  * @{
+  */
+
+/**
+  * @}
+  */
+
+
+/** @defgroup CMPSIT_CORE_Private_FunctionPrototypes
+  * @{
+  */
+/* uint8_t  USBD_CMPSIT_Init (USBD_HandleTypeDef *pdev,
+                           uint8_t cfgidx); */ /* Function not used for the moment */
+
+/* uint8_t  USBD_CMPSIT_DeInit (USBD_HandleTypeDef *pdev,
+                             uint8_t cfgidx); */ /* Function not used for the moment */
+
+static uint8_t  *USBD_CMPSIT_GetFSCfgDesc(uint16_t *length);
+static uint8_t  *USBD_CMPSIT_GetHSCfgDesc(uint16_t *length);
+static uint8_t  *USBD_CMPSIT_GetOtherSpeedCfgDesc(uint16_t *length);
+static uint8_t  *USBD_CMPSIT_GetDeviceQualifierDescriptor(uint16_t *length);
+
+static uint8_t USBD_CMPSIT_FindFreeIFNbr(USBD_HandleTypeDef *pdev);
+static void USBD_CMPSIT_AddConfDesc(uintptr_t Conf, __IO uint32_t *pSze);
+static void USBD_CMPSIT_AssignEp(USBD_HandleTypeDef *pdev, uint8_t Add, uint8_t Type, uint32_t Sze);
+static void USBD_CMPSIT_PutByte(uint8_t value, __IO uint32_t *pSze);
+static void USBD_CMPSIT_PutIfDesc(uint8_t IfNum, uint8_t NumEps, uint8_t Class, uint8_t SubClass,
+                                  uint8_t Protocol, __IO uint32_t *pSze);
+static void USBD_CMPSIT_PutEpDesc(uint8_t Add, uint8_t Type, uint16_t Sze, uint8_t Interval,
+                                  __IO uint32_t *pSze);
+
+#if USBD_CMPSIT_ACTIVATE_HID == 1U
+static void USBD_CMPSIT_HIDDesc(USBD_HandleTypeDef *pdev, uintptr_t pConf, __IO uint32_t *Sze);
+#endif /* USBD_CMPSIT_ACTIVATE_HID == 1U */
+
+#if USBD_CMPSIT_ACTIVATE_CDC == 1U
+static void USBD_CMPSIT_CDCDesc(USBD_HandleTypeDef *pdev, uintptr_t pConf, __IO uint32_t *Sze);
+#endif /* USBD_CMPSIT_ACTIVATE_CDC == 1U */
+
+/**
+  * @}
+  */
+
+
+/** @defgroup CMPSIT_CORE_Private_Variables
+  * @{
+  */
+/* This structure is used only for the Configuration descriptors and Device Qualifier */
+USBD_ClassTypeDef  USBD_CMPSIT =
+{
+  NULL, /* Init, */
+  NULL, /* DeInit, */
+  NULL, /* Setup, */
+  NULL, /* EP0_TxSent, */
+  NULL, /* EP0_RxReady, */
+  NULL, /* DataIn, */
+  NULL, /* DataOut, */
+  NULL, /* SOF,  */
+  NULL,
+  NULL,
+  USBD_CMPSIT_GetHSCfgDesc,
+  USBD_CMPSIT_GetFSCfgDesc,
+  USBD_CMPSIT_GetOtherSpeedCfgDesc,
+  USBD_CMPSIT_GetDeviceQualifierDescriptor,
+#if (USBD_SUPPORT_USER_STRING_DESC == 1U)
+  NULL,
+#endif /* USBD_SUPPORT_USER_STRING_DESC */
+};
+
+/* The full Configuration Descriptor for the device, built class by class.
+   The device is full-speed only, so the same descriptor serves every speed */
+__ALIGN_BEGIN static uint8_t USBD_CMPSIT_FSCfgDesc[USBD_CMPST_MAX_CONFDESC_SZ]  __ALIGN_END;
+static __IO uint32_t CurrFSConfDescSz = 0U;
+
+#if USBD_CMPSIT_ACTIVATE_HID == 1U
+/* Device and offset of the HID IN endpoint bInterval, patched on each request
+   so that a polling interval changed at run time shows up at re-enumeration */
+static USBD_HandleTypeDef *USBD_CMPSIT_HIDDev;
+static uint32_t USBD_CMPSIT_HIDIntervalOfs;
+#endif /* USBD_CMPSIT_ACTIVATE_HID == 1U */
+
+/* USB Standard Device Descriptor */
+__ALIGN_BEGIN static const uint8_t USBD_CMPSIT_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIER_DESC]  __ALIGN_END =
+{
+  USB_LEN_DEV_QUALIFIER_DESC,
+  USB_DESC_TYPE_DEVICE_QUALIFIER,
+  0x00,
+  0x02,
+  0xEF,
+  0x02,
+  0x01,
+  0x40,
+  0x01,
+  0x00,
+};
+
+/**
+  * @}
+  */
+
+
+/** @defgroup CMPSIT_CORE_Private_Functions
+  * @{
+  */
+
+/**
+  * @brief  USBD_CMPSIT_AddClass
+  *         Register a class in the class builder
+  * @param  pdev: device instance
+  * @param  pclass: pointer to the class structure to be added
+  * @param  class: type of the class to be added (from USBD_CompositeClassTypeDef)
+  * @param  cfgidx: configuration index
+  * @retval status
+  */
+uint8_t  USBD_CMPSIT_AddClass(USBD_HandleTypeDef *pdev,
+                              USBD_ClassTypeDef *pclass,
+                              USBD_CompositeClassTypeDef class,
+                              uint8_t cfgidx)
+{
+  UNUSED(pclass);
+  UNUSED(cfgidx);
+
+  if ((pdev->classId < USBD_MAX_SUPPORTED_CLASS) && (pdev->tclasslist[pdev->classId].Active == 0U))
+  {
+    /* Store the class parameters in the global tab */
+    pdev->tclasslist[pdev->classId].ClassId = pdev->classId;
+    pdev->tclasslist[pdev->classId].Active = 1U;
+    pdev->tclasslist[pdev->classId].ClassType = class;
+
+    /* Call configuration descriptor builder and endpoint configuration builder */
+    if (USBD_CMPSIT_AddToConfDesc(pdev) != (uint8_t)USBD_OK)
+    {
+      return (uint8_t)USBD_FAIL;
+    }
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+
+/**
+  * @brief  USBD_CMPSIT_AddToConfDesc
+  *         Add a new class to the configuration descriptor
+  * @param  pdev: device instance
+  * @retval status
+  */
+uint8_t  USBD_CMPSIT_AddToConfDesc(USBD_HandleTypeDef *pdev)
+{
+  uint8_t idxIf = 0U;
+  uint8_t iEp = 0U;
+
+  /* For the first class instance, start building the config descriptor common part */
+  if (pdev->classId == 0U)
+  {
+    /* Add configuration and IAD descriptors */
+    USBD_CMPSIT_AddConfDesc((uintptr_t)USBD_CMPSIT_FSCfgDesc, &CurrFSConfDescSz);
+  }
+
+  switch (pdev->tclasslist[pdev->classId].ClassType)
+  {
+#if USBD_CMPSIT_ACTIVATE_HID == 1
+    case CLASS_TYPE_HID:
+      /* Setup Max packet sizes (for HID, no dependency on USB Speed) */
+      pdev->tclasslist[pdev->classId].CurrPcktSze = HID_EPIN_SIZE;
+
+      /* Find the first available interface slot and Assign number of interfaces */
+      idxIf = USBD_CMPSIT_FindFreeIFNbr(pdev);
+      pdev->tclasslist[pdev->classId].NumIf = 1U;
+      pdev->tclasslist[pdev->classId].Ifs[0] = idxIf;
+
+      /* Assign endpoint numbers */
+      pdev->tclasslist[pdev->classId].NumEps = 2U; /* EP_IN, EP_OUT */
+
+      /* Set IN endpoint slot */
+      iEp = pdev->tclasslist[pdev->classId].EpAdd[0];
+
+      /* Assign IN Endpoint */
+      USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_INTR, HID_EPIN_SIZE);
+
+      /* Set OUT endpoint slot */
+      iEp = pdev->tclasslist[pdev->classId].EpAdd[1];
+
+      /* Assign OUT Endpoint */
+      USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_INTR, HID_EPOUT_SIZE);
+
+      /* Configure and Append the Descriptor */
+      USBD_CMPSIT_HIDDesc(pdev, (uintptr_t)USBD_CMPSIT_FSCfgDesc, &CurrFSConfDescSz);
+      break;
+#endif /* USBD_CMPSIT_ACTIVATE_HID */
+
+#if USBD_CMPSIT_ACTIVATE_CDC == 1
+    case CLASS_TYPE_CDC:
+      /* Setup default Max packet size for FS device */
+      pdev->tclasslist[pdev->classId].CurrPcktSze = CDC_DATA_FS_MAX_PACKET_SIZE;
+
+      /* Find the first available interface slot and Assign number of interfaces */
+      idxIf = USBD_CMPSIT_FindFreeIFNbr(pdev);
+      pdev->tclasslist[pdev->classId].NumIf = 2U;
+      pdev->tclasslist[pdev->classId].Ifs[0] = idxIf;
+      pdev->tclasslist[pdev->classId].Ifs[1] = (uint8_t)(idxIf + 1U);
+
+      /* Assign endpoint numbers */
+      pdev->tclasslist[pdev->classId].NumEps = 3U;  /* EP1_IN, EP1_OUT,CMD_EP2 */
+
+      /* Set IN endpoint slot */
+      iEp = pdev->tclasslist[pdev->classId].EpAdd[0];
+
+      /* Assign IN Endpoint */
+      USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_BULK, pdev->tclasslist[pdev->classId].CurrPcktSze);
+
+      /* Set OUT endpoint slot */
+      iEp = pdev->tclasslist[pdev->classId].EpAdd[1];
+
+      /* Assign OUT Endpoint */
+      USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_BULK, pdev->tclasslist[pdev->classId].CurrPcktSze);
+
+      /* Set the second IN endpoint slot */
+      iEp = pdev->tclasslist[pdev->classId].EpAdd[2];
+
+      /* Assign CMD Endpoint */
+      USBD_CMPSIT_AssignEp(pdev, iEp, USBD_EP_TYPE_INTR, CDC_CMD_PACKET_SIZE);
+
+      /* Configure and Append the Descriptor */
+      USBD_CMPSIT_CDCDesc(pdev, (uintptr_t)USBD_CMPSIT_FSCfgDesc, &CurrFSConfDescSz);
+      break;
+#endif /* USBD_CMPSIT_ACTIVATE_CDC */
+
+    default:
+      UNUSED(idxIf);
+      UNUSED(iEp);
+      UNUSED(USBD_CMPSIT_FindFreeIFNbr);
+      UNUSED(USBD_CMPSIT_AssignEp);
+      return (uint8_t)USBD_FAIL;
+  }
+
+  /* The descriptor must never outgrow its buffer */
+  if (CurrFSConfDescSz > USBD_CMPST_MAX_CONFDESC_SZ)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_CMPSIT_GetFSCfgDesc
+  *         return configuration descriptor for FS speed
+  * @param  length : pointer data length
+  * @retval pointer to descriptor buffer
+  */
+static uint8_t  *USBD_CMPSIT_GetFSCfgDesc(uint16_t *length)
+{
+#if USBD_CMPSIT_ACTIVATE_HID == 1U
+  /* Only once the bus reset has set the speed: before it the handle reads high speed */
+  if ((USBD_CMPSIT_HIDDev != NULL) && (USBD_CMPSIT_HIDIntervalOfs != 0U) &&
+      (USBD_CMPSIT_HIDDev->dev_speed != USBD_SPEED_HIGH))
+  {
+    USBD_CMPSIT_FSCfgDesc[USBD_CMPSIT_HIDIntervalOfs] =
+      (uint8_t)USBD_HID_GetPollingInterval(USBD_CMPSIT_HIDDev);
+  }
+#endif /* USBD_CMPSIT_ACTIVATE_HID == 1U */
+
+  *length = (uint16_t)CurrFSConfDescSz;
+
+  return USBD_CMPSIT_FSCfgDesc;
+}
+
+/**
+  * @brief  USBD_CMPSIT_GetHSCfgDesc
+  *         return configuration descriptor for HS speed
+  * @param  length : pointer data length
+  * @retval pointer to descriptor buffer
+  */
+static uint8_t  *USBD_CMPSIT_GetHSCfgDesc(uint16_t *length)
+{
+  return USBD_CMPSIT_GetFSCfgDesc(length);
+}
+
+/**
+  * @brief  USBD_CMPSIT_GetOtherSpeedCfgDesc
+  *         return other speed configuration descriptor
+  * @param  length : pointer data length
+  * @retval pointer to descriptor buffer
+  */
+static uint8_t  *USBD_CMPSIT_GetOtherSpeedCfgDesc(uint16_t *length)
+{
+  return USBD_CMPSIT_GetFSCfgDesc(length);
+}
+
+/**
+  * @brief  DeviceQualifierDescriptor
+  *         return Device Qualifier descriptor
+  * @param  length : pointer data length
+  * @retval pointer to descriptor buffer
+  */
+uint8_t  *USBD_CMPSIT_GetDeviceQualifierDescriptor(uint16_t *length)
+{
+  *length = (uint16_t)(sizeof(USBD_CMPSIT_DeviceQualifierDesc));
+  return (uint8_t *)USBD_CMPSIT_DeviceQualifierDesc;
+}
+
+/**
+  * @brief  USBD_CMPSIT_FindFreeIFNbr
+  *         Find the first interface available slot
+  * @param  pdev: device instance
+  * @retval The interface number to be used
+  */
+static uint8_t USBD_CMPSIT_FindFreeIFNbr(USBD_HandleTypeDef *pdev)
+{
+  uint32_t idx = 0U;
+
+  /* Unroll all already activated classes */
+  for (uint32_t i = 0U; i < pdev->NumClasses; i++)
+  {
+    /* Unroll each class interfaces */
+    for (uint32_t j = 0U; j < pdev->tclasslist[i].NumIf; j++)
+    {
+      /* Increment the interface counter index */
+      idx++;
+    }
+  }
+
+  /* Return the first available interface slot */
+  return (uint8_t)idx;
+}
+
+/**
+  * @brief  USBD_CMPSIT_AddConfDesc
+  *         Add a new class to the configuration descriptor
+  * @param  Conf: configuration descriptor
+  * @param  pSze: pointer to the configuration descriptor size
+  * @retval none
+  */
+static void  USBD_CMPSIT_AddConfDesc(uintptr_t Conf, __IO uint32_t *pSze)
+{
+  UNUSED(Conf);
+
+  *pSze = 0U;
+
+  USBD_CMPSIT_PutByte(USBD_CMPSIT_CFG_DESC_SIZ, pSze);           /* bLength */
+  USBD_CMPSIT_PutByte(USB_DESC_TYPE_CONFIGURATION, pSze);        /* bDescriptorType */
+  USBD_CMPSIT_PutByte(0x00U, pSze);                              /* wTotalLength, set per class */
+  USBD_CMPSIT_PutByte(0x00U, pSze);
+  USBD_CMPSIT_PutByte(0x00U, pSze);                              /* bNumInterfaces, set per class */
+  USBD_CMPSIT_PutByte(0x01U, pSze);                              /* bConfigurationValue */
+  USBD_CMPSIT_PutByte(0x00U, pSze);                              /* iConfiguration */
+#if (USBD_SELF_POWERED == 1U)
+  USBD_CMPSIT_PutByte(0xE0U, pSze);                              /* bmAttributes: self powered, remote wakeup */
+#else
+  USBD_CMPSIT_PutByte(0xA0U, pSze);                              /* bmAttributes: bus powered, remote wakeup */
+#endif /* USBD_SELF_POWERED */
+  USBD_CMPSIT_PutByte(USBD_MAX_POWER, pSze);                     /* MaxPower */
+}
+
+/**
+  * @brief  USBD_CMPSIT_AssignEp
+  *         Assign and endpoint
+  * @param  pdev: device instance
+  * @param  Add: Endpoint address
+  * @param  Type: Endpoint type
+  * @param  Sze: Endpoint max packet size
+  * @retval none
+  */
+static void  USBD_CMPSIT_AssignEp(USBD_HandleTypeDef *pdev, uint8_t Add, uint8_t Type, uint32_t Sze)
+{
+  uint32_t idx = 0U;
+
+  /* Find the first available endpoint slot */
+  while (((idx < (pdev->tclasslist[pdev->classId]).NumEps) && \
+          ((pdev->tclasslist[pdev->classId].Eps[idx].is_used) != 0U)))
+  {
+    /* Increment the index */
+    idx++;
+  }
+
+  /* Configure the endpoint */
+  pdev->tclasslist[pdev->classId].Eps[idx].add = Add;
+  pdev->tclasslist[pdev->classId].Eps[idx].type = Type;
+  pdev->tclasslist[pdev->classId].Eps[idx].size = (uint8_t)Sze;
+  pdev->tclasslist[pdev->classId].Eps[idx].is_used = 1U;
+}
+
+/**
+  * @brief  USBD_CMPSIT_PutByte
+  *         Append one byte to the configuration descriptor
+  * @param  value: byte to append
+  * @param  pSze: pointer to the configuration descriptor size
+  * @retval none
+  */
+static void USBD_CMPSIT_PutByte(uint8_t value, __IO uint32_t *pSze)
+{
+  if (*pSze < USBD_CMPST_MAX_CONFDESC_SZ)
+  {
+    USBD_CMPSIT_FSCfgDesc[*pSze] = value;
+  }
+
+  /* Keep counting past the end so that USBD_CMPSIT_AddToConfDesc fails */
+  *pSze = *pSze + 1U;
+}
+
+/**
+  * @brief  USBD_CMPSIT_PutIfDesc
+  *         Append an interface descriptor
+  * @param  IfNum: bInterfaceNumber
+  * @param  NumEps: bNumEndpoints
+  * @param  Class: bInterfaceClass
+  * @param  SubClass: bInterfaceSubClass
+  * @param  Protocol: bInterfaceProtocol
+  * @param  pSze: pointer to the configuration descriptor size
+  * @retval none
+  */
+static void USBD_CMPSIT_PutIfDesc(uint8_t IfNum, uint8_t NumEps, uint8_t Class, uint8_t SubClass,
+                                  uint8_t Protocol, __IO uint32_t *pSze)
+{
+  USBD_CMPSIT_PutByte(USBD_CMPSIT_IF_DESC_SIZ, pSze);            /* bLength */
+  USBD_CMPSIT_PutByte(USB_DESC_TYPE_INTERFACE, pSze);            /* bDescriptorType */
+  USBD_CMPSIT_PutByte(IfNum, pSze);                              /* bInterfaceNumber */
+  USBD_CMPSIT_PutByte(0x00U, pSze);                              /* bAlternateSetting */
+  USBD_CMPSIT_PutByte(NumEps, pSze);                             /* bNumEndpoints */
+  USBD_CMPSIT_PutByte(Class, pSze);                              /* bInterfaceClass */
+  USBD_CMPSIT_PutByte(SubClass, pSze);                           /* bInterfaceSubClass */
+  USBD_CMPSIT_PutByte(Protocol, pSze);                           /* bInterfaceProtocol */
+  USBD_CMPSIT_PutByte(0x00U, pSze);                              /* iInterface */
+}
+
+/**
+  * @brief  USBD_CMPSIT_PutEpDesc
+  *         Append an endpoint descriptor
+  * @param  Add: bEndpointAddress
+  * @param  Type: bmAttributes
+  * @param  Sze: wMaxPacketSize
+  * @param  Interval: bInterval
+  * @param  pSze: pointer to the configuration descriptor size
+  * @retval none
+  */
+static void USBD_CMPSIT_PutEpDesc(uint8_t Add, uint8_t Type, uint16_t Sze, uint8_t Interval,
+                                  __IO uint32_t *pSze)
+{
+  USBD_CMPSIT_PutByte(USBD_CMPSIT_EP_DESC_SIZ, pSze);            /* bLength */
+  USBD_CMPSIT_PutByte(USB_DESC_TYPE_ENDPOINT, pSze);             /* bDescriptorType */
+  USBD_CMPSIT_PutByte(Add, pSze);                                /* bEndpointAddress */
+  USBD_CMPSIT_PutByte(Type, pSze);                               /* bmAttributes */
+  USBD_CMPSIT_PutByte(LOBYTE(Sze), pSze);                        /* wMaxPacketSize */
+  USBD_CMPSIT_PutByte(HIBYTE(Sze), pSze);
+  USBD_CMPSIT_PutByte(Interval, pSze);                           /* bInterval */
+}
+
+/**
+  * @brief  USBD_CMPSIT_UpdateConfDesc
+  *         Update wTotalLength and bNumInterfaces after a class was appended
+  * @param  pdev: device instance
+  * @param  pSze: pointer to the configuration descriptor size
+  * @retval none
+  */
+static void USBD_CMPSIT_UpdateConfDesc(USBD_HandleTypeDef *pdev, __IO uint32_t *pSze)
+{
+  USBD_CMPSIT_FSCfgDesc[2] = LOBYTE(*pSze);
+  USBD_CMPSIT_FSCfgDesc[3] = HIBYTE(*pSze);
+  USBD_CMPSIT_FSCfgDesc[4] = (uint8_t)(USBD_CMPSIT_FindFreeIFNbr(pdev) + pdev->tclasslist[pdev->classId].NumIf);
+}
+
+#if USBD_CMPSIT_ACTIVATE_HID == 1
+/**
+  * @brief  USBD_CMPSIT_HIDDesc
+  *         Configure and Append the HID keyboard Descriptor
+  * @param  pdev: device instance
+  * @param  pConf: Configuration descriptor pointer
+  * @param  Sze: pointer to the current configuration descriptor size
+  * @retval None
+  */
+static void USBD_CMPSIT_HIDDesc(USBD_HandleTypeDef *pdev, uintptr_t pConf, __IO uint32_t *Sze)
+{
+  UNUSED(pConf);
+
+  /* Interface: boot keyboard */
+  USBD_CMPSIT_PutIfDesc(pdev->tclasslist[pdev->classId].Ifs[0], 2U, 0x03U, 0x01U, 0x01U, Sze);
+
+  /* HID descriptor */
+  USBD_CMPSIT_PutByte(USB_HID_DESC_SIZ, Sze);                    /* bLength */
+  USBD_CMPSIT_PutByte(HID_DESCRIPTOR_TYPE, Sze);                 /* bDescriptorType: HID */
+  USBD_CMPSIT_PutByte(0x11U, Sze);                               /* bcdHID: 1.11 */
+  USBD_CMPSIT_PutByte(0x01U, Sze);
+  USBD_CMPSIT_PutByte(0x00U, Sze);                               /* bCountryCode */
+  USBD_CMPSIT_PutByte(0x01U, Sze);                               /* bNumDescriptors */
+  USBD_CMPSIT_PutByte(HID_REPORT_DESC, Sze);                     /* bDescriptorType: report */
+  USBD_CMPSIT_PutByte(LOBYTE(HID_MOUSE_REPORT_DESC_SIZE), Sze);  /* wItemLength */
+  USBD_CMPSIT_PutByte(HIBYTE(HID_MOUSE_REPORT_DESC_SIZE), Sze);
+
+  /* Interrupt IN, its bInterval patched by USBD_CMPSIT_GetFSCfgDesc */
+  USBD_CMPSIT_PutEpDesc(pdev->tclasslist[pdev->classId].Eps[0].add, USBD_EP_TYPE_INTR, HID_EPIN_SIZE,
+                        HID_FS_BINTERVAL, Sze);
+  USBD_CMPSIT_HIDDev = pdev;
+  USBD_CMPSIT_HIDIntervalOfs = *Sze - 1U;
+
+  /* Interrupt OUT, LED output report */
+  USBD_CMPSIT_PutEpDesc(pdev->tclasslist[pdev->classId].Eps[1].add, USBD_EP_TYPE_INTR, HID_EPOUT_SIZE,
+                        HID_FS_BINTERVAL, Sze);
+
+  USBD_CMPSIT_UpdateConfDesc(pdev, Sze);
+}
+#endif /* USBD_CMPSIT_ACTIVATE_HID == 1 */
+
+#if USBD_CMPSIT_ACTIVATE_CDC == 1
+/**
+  * @brief  USBD_CMPSIT_CDCDesc
+  *         Configure and Append the CDC-ACM Descriptor
+  * @param  pdev: device instance
+  * @param  pConf: Configuration descriptor pointer
+  * @param  Sze: pointer to the current configuration descriptor size
+  * @retval None
+  */
+static void USBD_CMPSIT_CDCDesc(USBD_HandleTypeDef *pdev, uintptr_t pConf, __IO uint32_t *Sze)
+{
+  uint8_t comm_if = pdev->tclasslist[pdev->classId].Ifs[0];
+  uint8_t data_if = pdev->tclasslist[pdev->classId].Ifs[1];
+
+  UNUSED(pConf);
+
+  /* Interface Association: both interfaces bind to one function */
+  USBD_CMPSIT_PutByte(USBD_CMPSIT_IAD_DESC_SIZ, Sze);            /* bLength */
+  USBD_CMPSIT_PutByte(USB_DESC_TYPE_IAD, Sze);                   /* bDescriptorType */
+  USBD_CMPSIT_PutByte(comm_if, Sze);                             /* bFirstInterface */
+  USBD_CMPSIT_PutByte(0x02U, Sze);                               /* bInterfaceCount */
+  USBD_CMPSIT_PutByte(0x02U, Sze);                               /* bFunctionClass: CDC */
+  USBD_CMPSIT_PutByte(0x02U, Sze);                               /* bFunctionSubClass: ACM */
+  USBD_CMPSIT_PutByte(0x01U, Sze);                               /* bFunctionProtocol: AT commands */
+  USBD_CMPSIT_PutByte(0x00U, Sze);                               /* iFunction */
+
+  /* Communication interface */
+  USBD_CMPSIT_PutIfDesc(comm_if, 1U, 0x02U, 0x02U, 0x01U, Sze);
+
+  /* Header functional descriptor */
+  USBD_CMPSIT_PutByte(0x05U, Sze);                               /* bLength */
+  USBD_CMPSIT_PutByte(USBD_FUNC_DESCRIPTOR_TYPE, Sze);           /* bDescriptorType: CS_INTERFACE */
+  USBD_CMPSIT_PutByte(0x00U, Sze);                               /* bDescriptorSubtype: Header */
+  USBD_CMPSIT_PutByte(0x10U, Sze);                               /* bcdCDC: 1.10 */
+  USBD_CMPSIT_PutByte(0x01U, Sze);
+
+  /* Call management functional descriptor */
+  USBD_CMPSIT_PutByte(0x05U, Sze);                               /* bLength */
+  USBD_CMPSIT_PutByte(USBD_FUNC_DESCRIPTOR_TYPE, Sze);           /* bDescriptorType: CS_INTERFACE */
+  USBD_CMPSIT_PutByte(0x01U, Sze);                               /* bDescriptorSubtype: Call Management */
+  USBD_CMPSIT_PutByte(0x00U, Sze);                               /* bmCapabilities: D0+D1 */
+  USBD_CMPSIT_PutByte(data_if, Sze);                             /* bDataInterface */
+
+  /* ACM functional descriptor */
+  USBD_CMPSIT_PutByte(0x04U, Sze);                               /* bLength */
+  USBD_CMPSIT_PutByte(USBD_FUNC_DESCRIPTOR_TYPE, Sze);           /* bDescriptorType: CS_INTERFACE */
+  USBD_CMPSIT_PutByte(0x02U, Sze);                               /* bDescriptorSubtype: ACM */
+  USBD_CMPSIT_PutByte(0x02U, Sze);                               /* bmCapabilities: line coding and state */
+
+  /* Union functional descriptor */
+  USBD_CMPSIT_PutByte(0x05U, Sze);                               /* bLength */
+  USBD_CMPSIT_PutByte(USBD_FUNC_DESCRIPTOR_TYPE, Sze);           /* bDescriptorType: CS_INTERFACE */
+  USBD_CMPSIT_PutByte(0x06U, Sze);                               /* bDescriptorSubtype: Union */
+  USBD_CMPSIT_PutByte(comm_if, Sze);                             /* bMasterInterface */
+  USBD_CMPSIT_PutByte(data_if, Sze);                             /* bSlaveInterface0 */
+
+  /* Notification endpoint */
+  USBD_CMPSIT_PutEpDesc(pdev->tclasslist[pdev->classId].Eps[2].add, USBD_EP_TYPE_INTR, CDC_CMD_PACKET_SIZE,
+                        CDC_FS_BINTERVAL, Sze);
+
+  /* Data interface */
+  USBD_CMPSIT_PutIfDesc(data_if, 2U, 0x0AU, 0x00U, 0x00U, Sze);
+
+  /* Bulk OUT and IN */
+  USBD_CMPSIT_PutEpDesc(pdev->tclasslist[pdev->classId].Eps[1].add, USBD_EP_TYPE_BULK,
+                        CDC_DATA_FS_MAX_PACKET_SIZE, 0x00U, Sze);
+  USBD_CMPSIT_PutEpDesc(pdev->tclasslist[pdev->classId].Eps[0].add, USBD_EP_TYPE_BULK,
+                        CDC_DATA_FS_MAX_PACKET_SIZE, 0x00U, Sze);
+
+  USBD_CMPSIT_UpdateConfDesc(pdev, Sze);
+}
+#endif /* USBD_CMPSIT_ACTIVATE_CDC == 1 */
+
+/**
+  * @brief  Function to set the class ID of the class matching the given type
+  *         and instance: the next calls that use pdev->classId, such as the
+  *         RegisterInterface functions, then apply to that class.
+  * @param  pdev: device instance
+  * @param  Class: class type, can be CLASS_TYPE_NONE if requested to find class from setup request
+  * @param  Instance: Instance number of the class (0 if first/unique instance, >0 otherwise)
+  * @retval The Class ID, The pdev->classId is set with the value of the selected class ID.
+  */
+uint32_t  USBD_CMPSIT_SetClassID(USBD_HandleTypeDef *pdev, USBD_CompositeClassTypeDef Class, uint32_t Instance)
+{
+  uint32_t idx = USBD_CMPSIT_GetClassID(pdev, Class, Instance);
+
+  if (idx != 0xFFU)
+  {
+    pdev->classId = idx;
+  }
+
+  return idx;
+}
+
+/**
+  * @brief  Returns the Class ID for the given class type and instance
+  * @param  pdev: device instance
+  * @param  Class: class type
+  * @param  Instance: Instance counter of the class (0 if first/unique instance, >0 otherwise)
+  * @retval The Class ID, 0xFF if no class of that type and instance is registered.
+  */
+uint32_t  USBD_CMPSIT_GetClassID(USBD_HandleTypeDef *pdev, USBD_CompositeClassTypeDef Class, uint32_t Instance)
+{
+  uint32_t inst = 0U;
+
+  /* Browse all registered classes */
+  for (uint32_t idx = 0U; idx < pdev->NumClasses; idx++)
+  {
+    /* Check if the class type and instance match */
+    if ((pdev->tclasslist[idx].ClassType == Class) && (pdev->tclasslist[idx].Active == 1U))
+    {
+      if (inst == Instance)
+      {
+        return idx;
+      }
+      inst++;
+    }
+  }
+
+  return 0xFFU;
+}
+
+/**
+  * @brief  USBD_CMPST_ClearConfDesc
+  *         Reset the configuration descriptor
+  * @param  pdev: device instance (reserved for future use)
+  * @retval status
+  */
+uint8_t USBD_CMPST_ClearConfDesc(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+
+  /* Reset the configuration descriptor pointer to default value and its size to zero */
+  CurrFSConfDescSz = 0U;
+  (void)USBD_memset(USBD_CMPSIT_FSCfgDesc, 0, sizeof(USBD_CMPSIT_FSCfgDesc));
+
+#if USBD_CMPSIT_ACTIVATE_HID == 1U
+  USBD_CMPSIT_HIDDev = NULL;
+  USBD_CMPSIT_HIDIntervalOfs = 0U;
+#endif /* USBD_CMPSIT_ACTIVATE_HID == 1U */
+
+  /* All done, can't fail */
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @}
+  */
+
+
+/**
+  * @}
+  */
+
+
+/**
+  * @}
+  */
+
+#endif /* USE_USBD_COMPOSITE */
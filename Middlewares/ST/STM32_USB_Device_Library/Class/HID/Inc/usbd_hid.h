@@ -43,11 +43,19 @@ extern "C" {
 #ifndef HID_EPIN_ADDR
 #define HID_EPIN_ADDR                              0x81U
 #endif /* HID_EPIN_ADDR */
-#define HID_EPIN_SIZE                              0x08U  //Change to 0x08 for keyboard
+#define HID_EPIN_SIZE                              0x20U  /* Largest input report: NKRO, 30 bytes */
 
-#define USB_HID_CONFIG_DESC_SIZ                    34U
+#ifndef HID_EPOUT_ADDR
+#define HID_EPOUT_ADDR                             0x01U
+#endif /* HID_EPOUT_ADDR */
+#define HID_EPOUT_SIZE                             0x08U  /* LED output report: ID + 1 byte */
+
+/* Report ID carrying the LED output report under report protocol */
+#define HID_LED_REPORT_ID                          0x01U
+#define HID_LED_REPORT_SIZE                        2U     /* report ID, LED bits */
+
+#define USB_HID_CONFIG_DESC_SIZ                    41U
 #define USB_HID_DESC_SIZ                           9U
-#define HID_MOUSE_REPORT_DESC_SIZE                 187
 
 #define HID_DESCRIPTOR_TYPE                        0x21U
 #define HID_REPORT_DESC                            0x22U
@@ -60,6 +68,13 @@ extern "C" {
 #define HID_FS_BINTERVAL                           0x0AU
 #endif /* HID_FS_BINTERVAL */
 
+/* Full-speed polling intervals (ms) accepted by USBD_HID_SetPollingInterval */
+#define HID_FS_BINTERVAL_IS_VALID(x)               (((x) == 1U) || ((x) == 2U) || ((x) == 4U) || \
+                                                    ((x) == 8U) || ((x) == 10U))
+
+#define HID_BOOT_PROTOCOL                               0x00U
+#define HID_REPORT_PROTOCOL                             0x01U
+
 #define USBD_HID_REQ_SET_PROTOCOL                       0x0BU
 #define USBD_HID_REQ_GET_PROTOCOL                       0x03U
 
@@ -68,6 +83,40 @@ extern "C" {
 
 #define USBD_HID_REQ_SET_REPORT                         0x09U
 #define USBD_HID_REQ_GET_REPORT                         0x01U
+
+/* GET_REPORT / SET_REPORT wValue high byte */
+#define HID_REPORT_TYPE_INPUT                           0x01U
+#define HID_REPORT_TYPE_OUTPUT                          0x02U
+#define HID_REPORT_TYPE_FEATURE                         0x03U
+
+/* Largest report exchanged over EP0, report ID included */
+#ifndef HID_CTRL_REPORT_SIZE
+#define HID_CTRL_REPORT_SIZE                       HID_EPIN_SIZE
+#endif /* HID_CTRL_REPORT_SIZE */
+
+/* Number of reports that can be pending per priority on the IN endpoint, must be a power of two */
+#ifndef HID_REPORT_QUEUE_SIZE
+#define HID_REPORT_QUEUE_SIZE                      16U
+#endif /* HID_REPORT_QUEUE_SIZE */
+
+/* IN report priorities: a pending high priority report is always sent first */
+#define HID_REPORT_PRIO_HIGH                       0U
+#define HID_REPORT_PRIO_NORMAL                     1U
+#define HID_REPORT_PRIORITIES                      2U
+
+/* Number of input report IDs whose last report is kept for idle repeats */
+#ifndef HID_IDLE_REPORT_SLOTS
+#define HID_IDLE_REPORT_SLOTS                      4U
+#endif /* HID_IDLE_REPORT_SLOTS */
+
+/* Report IDs with an idle rate of their own, ID 0 included: SET_IDLE for
+   ID 0 sets every rate and its own one applies under boot protocol */
+#ifndef HID_IDLE_REPORT_IDS
+#define HID_IDLE_REPORT_IDS                        8U
+#endif /* HID_IDLE_REPORT_IDS */
+
+/* SET_IDLE duration unit, in frames (ms) */
+#define HID_IDLE_UNIT_MS                           4U
 /**
   * @}
   */
@@ -83,14 +132,61 @@ typedef enum
 } USBD_HID_StateTypeDef;
 
 
+typedef struct
+{
+  uint8_t  buf[HID_EPIN_SIZE];
+  uint16_t len;
+} USBD_HID_ReportTypeDef;
+
+/* Last report queued for one report ID, repeated when the idle period expires */
+typedef struct
+{
+  uint8_t  buf[HID_EPIN_SIZE];
+  uint16_t len;            /* 0: slot unused */
+  uint8_t  id;             /* report ID, 0 under boot protocol */
+  uint8_t  prio;           /* queue the repeats go to */
+  uint16_t elapsed;        /* frames since the report was last queued */
+} USBD_HID_IdleReportTypeDef;
+
+/*
+ * Pending IN reports form one ring per priority:
+ * QueueHead is advanced by USBD_HID_SendReport (application context) and by
+ * the idle repeats of USBD_HID_SOF (USB interrupt context), with interrupts
+ * masked around the update; QueueTail is only advanced by USBD_HID_DataIn
+ * (USB interrupt context).
+ * While state is BUSY, the slot at the tail of ring InFlight is on the wire.
+ */
 typedef struct
 {
   uint32_t Protocol;
-  uint32_t IdleState;
+  uint8_t  IdleRate[HID_IDLE_REPORT_IDS];          /* SET_IDLE duration per report ID */
   uint32_t AltSetting;
-  USBD_HID_StateTypeDef state;
+  __IO USBD_HID_StateTypeDef state;
+  USBD_HID_ReportTypeDef Queue[HID_REPORT_PRIORITIES][HID_REPORT_QUEUE_SIZE];
+  __IO uint32_t QueueHead[HID_REPORT_PRIORITIES];
+  __IO uint32_t QueueTail[HID_REPORT_PRIORITIES];
+  uint8_t  InFlight;
+  uint32_t QueueHighWater;
+  uint32_t QueueOverflows;
+  USBD_HID_IdleReportTypeDef IdleReport[HID_IDLE_REPORT_SLOTS];
+  uint8_t  CtrlReport[HID_CTRL_REPORT_SIZE];       /* GET_REPORT / SET_REPORT data stage */
+  uint16_t CtrlReportLen;
+  uint8_t  CtrlReportId;
+  uint8_t  CtrlReportPending;                      /* report type of the SET_REPORT data awaited on EP0 */
+  uint8_t  OutReport[HID_EPOUT_SIZE];              /* OUT endpoint buffer */
+  __IO uint8_t LedState;                           /* lock LEDs from the last output report */
 } USBD_HID_HandleTypeDef;
 
+/*
+ * Application side of the feature reports. report[0] holds the report ID;
+ * callbacks run from the USB interrupt and return 0 on success.
+ */
+typedef struct _USBD_HID_Itf
+{
+  int8_t (* GetFeature)(uint8_t report_id, uint8_t *report, uint16_t *len);
+  int8_t (* SetFeature)(uint8_t report_id, uint8_t *report, uint16_t len);
+} USBD_HID_ItfTypeDef;
+
 /*
  * HID Class specification version 1.1
  * 6.2.1 HID Descriptor
@@ -136,10 +232,19 @@ extern USBD_ClassTypeDef USBD_HID;
   */
 #ifdef USE_USBD_COMPOSITE
 uint8_t USBD_HID_SendReport(USBD_HandleTypeDef *pdev, uint8_t *report, uint16_t len, uint8_t ClassId);
+uint8_t USBD_HID_SendReportPrio(USBD_HandleTypeDef *pdev, uint8_t *report, uint16_t len, uint8_t prio,
+                                uint8_t ClassId);
 #else
 uint8_t USBD_HID_SendReport(USBD_HandleTypeDef *pdev, uint8_t *report, uint16_t len);
+uint8_t USBD_HID_SendReportPrio(USBD_HandleTypeDef *pdev, uint8_t *report, uint16_t len, uint8_t prio);
 #endif /* USE_USBD_COMPOSITE */
 uint32_t USBD_HID_GetPollingInterval(USBD_HandleTypeDef *pdev);
+uint8_t USBD_HID_SetPollingInterval(USBD_HandleTypeDef *pdev, uint8_t interval);
+uint32_t USBD_HID_GetQueueHighWater(USBD_HandleTypeDef *pdev);
+uint32_t USBD_HID_GetQueueDepth(USBD_HandleTypeDef *pdev);
+uint8_t USBD_HID_GetProtocol(USBD_HandleTypeDef *pdev);
+uint8_t USBD_HID_RegisterInterface(USBD_HandleTypeDef *pdev, USBD_HID_ItfTypeDef *fops);
+uint8_t USBD_HID_GetLedState(USBD_HandleTypeDef *pdev);
 
 /**
   * @}
@@ -0,0 +1,130 @@
+/**
+  ******************************************************************************
+  * @file           : usbd_hid_desc.h
+  * @brief          : Compile-time HID report descriptor builder
+  ******************************************************************************
+  * A report descriptor is written once as a list macro taking two callbacks:
+  *
+  *   #define MY_REPORT(I, F)                                     \
+  *     I(HID_RD_USAGE_PAGE(HID_RD_PAGE_KEYBOARD))                \
+  *     I(HID_RD_REPORT_ID(1U))                                   \
+  *     F(HID_RD_INPUT, HID_RD_DATA_VAR, 1U, 8U)
+  *
+  * I() carries items that describe no data, F() a main item together with
+  * its report size and count, so the same list yields the descriptor bytes
+  * (HID_RD_BYTES), their number (HID_RD_SIZEOF) and the length of each report
+  * it declares (HID_RD_INPUT_LEN and friends), all as constant expressions.
+  * Every value is range checked when it is encoded: a usage or count that
+  * does not fit its item is a compile error rather than a truncated byte.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_HID_DESC_H
+#define __USBD_HID_DESC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Main item prefixes, one data byte */
+#define HID_RD_INPUT                 0x81U
+#define HID_RD_OUTPUT                0x91U
+#define HID_RD_FEATURE               0xB1U
+
+/* Main item data */
+#define HID_RD_DATA_ARRAY            0x00U
+#define HID_RD_CONST                 0x01U
+#define HID_RD_DATA_VAR              0x02U
+
+/* Collection types */
+#define HID_RD_PHYSICAL              0x00U
+#define HID_RD_APPLICATION           0x01U
+#define HID_RD_LOGICAL               0x02U
+
+/* Usage pages */
+#define HID_RD_PAGE_DESKTOP          0x01U
+#define HID_RD_PAGE_KEYBOARD         0x07U
+#define HID_RD_PAGE_LEDS             0x08U
+#define HID_RD_PAGE_CONSUMER         0x0CU
+
+/* Generic Desktop usages */
+#define HID_RD_USAGE_KEYBOARD        0x06U
+#define HID_RD_USAGE_SYSTEM_CONTROL  0x80U
+
+/* Consumer usages */
+#define HID_RD_USAGE_CONSUMER_CONTROL 0x01U
+
+/* Exported macro ------------------------------------------------------------*/
+/* Item data, with a compile error when the value does not fit */
+#define HID_RD_CHECK(ok)             (0U * sizeof(char[(ok) ? 1 : -1]))
+#define HID_RD_U8(x)                 (uint8_t)(((uint32_t)(x) & 0xFFU) + HID_RD_CHECK((uint32_t)(x) <= 0xFFU))
+#define HID_RD_S8(x)                 (uint8_t)(((uint32_t)(x) & 0xFFU) + \
+                                               HID_RD_CHECK(((int32_t)(x) >= -128) && ((int32_t)(x) <= 127)))
+#define HID_RD_HI(x)                 (uint8_t)(((uint32_t)(x) >> 8) & 0xFFU)
+#define HID_RD_U16(x)                (uint8_t)(((uint32_t)(x) & 0xFFU) + HID_RD_CHECK((uint32_t)(x) <= 0xFFFFU)), \
+                                     HID_RD_HI(x)
+#define HID_RD_S16(x)                (uint8_t)(((uint32_t)(x) & 0xFFU) + \
+                                               HID_RD_CHECK(((int32_t)(x) >= -32768) && ((int32_t)(x) <= 32767))), \
+                                     HID_RD_HI(x)
+
+/* Global items; logical values are signed, use the 16-bit forms above 127 */
+#define HID_RD_USAGE_PAGE(x)         0x05U, HID_RD_U8(x)
+#define HID_RD_USAGE_PAGE16(x)       0x06U, HID_RD_U16(x)
+#define HID_RD_LOGICAL_MIN(x)        0x15U, HID_RD_S8(x)
+#define HID_RD_LOGICAL_MIN16(x)      0x16U, HID_RD_S16(x)
+#define HID_RD_LOGICAL_MAX(x)        0x25U, HID_RD_S8(x)
+#define HID_RD_LOGICAL_MAX16(x)      0x26U, HID_RD_S16(x)
+#define HID_RD_REPORT_SIZE(x)        0x75U, HID_RD_U8(x)
+#define HID_RD_REPORT_ID(x)          0x85U, (uint8_t)(HID_RD_U8(x) + HID_RD_CHECK((x) != 0U))
+#define HID_RD_REPORT_COUNT(x)       0x95U, HID_RD_U8(x)
+
+/* Local items */
+#define HID_RD_USAGE(x)              0x09U, HID_RD_U8(x)
+#define HID_RD_USAGE16(x)            0x0AU, HID_RD_U16(x)
+#define HID_RD_USAGE_MIN(x)          0x19U, HID_RD_U8(x)
+#define HID_RD_USAGE_MIN16(x)        0x1AU, HID_RD_U16(x)
+#define HID_RD_USAGE_MAX(x)          0x29U, HID_RD_U8(x)
+#define HID_RD_USAGE_MAX16(x)        0x2AU, HID_RD_U16(x)
+
+/* Collections */
+#define HID_RD_COLLECTION(x)         0xA1U, HID_RD_U8(x)
+#define HID_RD_END_COLLECTION        0xC0U
+
+/* List callbacks: descriptor bytes */
+#define HID_RD_EMIT(...)             __VA_ARGS__,
+#define HID_RD_EMIT_FIELD(main, data, size, count) \
+  HID_RD_REPORT_SIZE(size), HID_RD_REPORT_COUNT(count), (main), HID_RD_U8(data),
+
+/* List callbacks: report bits of one main item type */
+#define HID_RD_SKIP(...)
+#define HID_RD_INPUT_BITS(main, data, size, count) \
+  + (((main) == HID_RD_INPUT) ? ((uint32_t)(size) * (uint32_t)(count)) : 0U)
+#define HID_RD_OUTPUT_BITS(main, data, size, count) \
+  + (((main) == HID_RD_OUTPUT) ? ((uint32_t)(size) * (uint32_t)(count)) : 0U)
+#define HID_RD_FEATURE_BITS(main, data, size, count) \
+  + (((main) == HID_RD_FEATURE) ? ((uint32_t)(size) * (uint32_t)(count)) : 0U)
+
+/* Descriptor bytes of a list, for an array initializer */
+#define HID_RD_BYTES(LIST)           LIST(HID_RD_EMIT, HID_RD_EMIT_FIELD)
+
+/* Descriptor length of a list */
+#define HID_RD_SIZEOF(LIST)          ((uint16_t)sizeof((const uint8_t[]){ HID_RD_BYTES(LIST) }))
+
+/* Report lengths of a list declaring a single report ID, ID byte included */
+#define HID_RD_INPUT_BITS_OF(LIST)   (0U LIST(HID_RD_SKIP, HID_RD_INPUT_BITS))
+#define HID_RD_OUTPUT_BITS_OF(LIST)  (0U LIST(HID_RD_SKIP, HID_RD_OUTPUT_BITS))
+#define HID_RD_FEATURE_BITS_OF(LIST) (0U LIST(HID_RD_SKIP, HID_RD_FEATURE_BITS))
+#define HID_RD_INPUT_LEN(LIST)       (1U + ((HID_RD_INPUT_BITS_OF(LIST) + 7U) / 8U))
+#define HID_RD_OUTPUT_LEN(LIST)      (1U + ((HID_RD_OUTPUT_BITS_OF(LIST) + 7U) / 8U))
+#define HID_RD_FEATURE_LEN(LIST)     (1U + ((HID_RD_FEATURE_BITS_OF(LIST) + 7U) / 8U))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_HID_DESC_H */
@@ -46,6 +46,7 @@ EndBSPDependencies */
 /* Includes ------------------------------------------------------------------*/
 #include "usbd_hid.h"
 #include "usbd_ctlreq.h"
+#include "usbd_hid_report_desc.h"
 
 
 /** @addtogroup STM32_USB_DEVICE_LIBRARY
@@ -69,6 +70,15 @@ EndBSPDependencies */
 /** @defgroup USBD_HID_Private_Defines
   * @{
   */
+#if ((HID_REPORT_QUEUE_SIZE & (HID_REPORT_QUEUE_SIZE - 1U)) != 0U)
+#error "HID_REPORT_QUEUE_SIZE must be a power of two"
+#endif /* HID_REPORT_QUEUE_SIZE */
+
+#define HID_REPORT_QUEUE_MASK                      (HID_REPORT_QUEUE_SIZE - 1U)
+
+#if !HID_FS_BINTERVAL_IS_VALID(HID_FS_BINTERVAL)
+#error "HID_FS_BINTERVAL must be 1, 2, 4, 8 or 10 ms"
+#endif /* HID_FS_BINTERVAL */
 
 /**
   * @}
@@ -90,7 +100,21 @@ EndBSPDependencies */
 static uint8_t USBD_HID_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
 static uint8_t USBD_HID_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx);
 static uint8_t USBD_HID_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req);
+static uint8_t USBD_HID_EP0_RxReady(USBD_HandleTypeDef *pdev);
 static uint8_t USBD_HID_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum);
+static uint8_t USBD_HID_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum);
+static uint8_t USBD_HID_SOF(USBD_HandleTypeDef *pdev);
+static USBD_StatusTypeDef USBD_HID_Enqueue(USBD_HandleTypeDef *pdev, USBD_HID_HandleTypeDef *hhid,
+                                           uint8_t prio, const uint8_t *report, uint16_t len);
+static void USBD_HID_TransmitNext(USBD_HandleTypeDef *pdev, USBD_HID_HandleTypeDef *hhid);
+static USBD_HID_IdleReportTypeDef *USBD_HID_GetIdleReport(USBD_HID_HandleTypeDef *hhid, uint8_t id);
+static void USBD_HID_ResetIdleReports(USBD_HID_HandleTypeDef *hhid);
+static void USBD_HID_FlushQueues(USBD_HID_HandleTypeDef *hhid);
+static void USBD_HID_SetLedReport(USBD_HID_HandleTypeDef *hhid, const uint8_t *report, uint32_t len);
+static USBD_StatusTypeDef USBD_HID_GetReport(USBD_HandleTypeDef *pdev, USBD_HID_HandleTypeDef *hhid,
+                                             USBD_SetupReqTypedef *req);
+static USBD_StatusTypeDef USBD_HID_SetReport(USBD_HandleTypeDef *pdev, USBD_HID_HandleTypeDef *hhid,
+                                             USBD_SetupReqTypedef *req);
 #ifndef USE_USBD_COMPOSITE
 static uint8_t *USBD_HID_GetFSCfgDesc(uint16_t *length);
 static uint8_t *USBD_HID_GetHSCfgDesc(uint16_t *length);
@@ -111,10 +135,10 @@ USBD_ClassTypeDef USBD_HID =
   USBD_HID_DeInit,
   USBD_HID_Setup,
   NULL,              /* EP0_TxSent */
-  NULL,              /* EP0_RxReady */
+  USBD_HID_EP0_RxReady, /* EP0_RxReady */
   USBD_HID_DataIn,   /* DataIn */
-  NULL,              /* DataOut */
-  NULL,              /* SOF */
+  USBD_HID_DataOut,  /* DataOut */
+  USBD_HID_SOF,      /* SOF */
   NULL,
   NULL,
 #ifdef USE_USBD_COMPOSITE
@@ -131,6 +155,9 @@ USBD_ClassTypeDef USBD_HID =
 };
 
 #ifndef USE_USBD_COMPOSITE
+/* Offset of the IN endpoint bInterval in USBD_HID_CfgDesc, patched without walking it */
+#define HID_CFG_EPIN_INTERVAL_POS                     33U
+
 /* USB HID device FS Configuration Descriptor */
 __ALIGN_BEGIN static uint8_t USBD_HID_CfgDesc[USB_HID_CONFIG_DESC_SIZ] __ALIGN_END =
 {
@@ -143,9 +170,9 @@ __ALIGN_BEGIN static uint8_t USBD_HID_CfgDesc[USB_HID_CONFIG_DESC_SIZ] __ALIGN_E
   0x00,                                               /* iConfiguration: Index of string descriptor
                                                          describing the configuration */
 #if (USBD_SELF_POWERED == 1U)
-  0xE0,                                               /* bmAttributes: Bus Powered according to user configuration */
+  0xE0,                                               /* bmAttributes: self powered, remote wakeup */
 #else
-  0xA0,                                               /* bmAttributes: Bus Powered according to user configuration */
+  0xA0,                                               /* bmAttributes: bus powered, remote wakeup */
 #endif /* USBD_SELF_POWERED */
   USBD_MAX_POWER,                                     /* MaxPower (mA) */
 
@@ -155,7 +182,7 @@ __ALIGN_BEGIN static uint8_t USBD_HID_CfgDesc[USB_HID_CONFIG_DESC_SIZ] __ALIGN_E
   USB_DESC_TYPE_INTERFACE,                            /* bDescriptorType: Interface descriptor type */
   0x00,                                               /* bInterfaceNumber: Number of Interface */
   0x00,                                               /* bAlternateSetting: Alternate setting */
-  0x01,                                               /* bNumEndpoints */
+  0x02,                                               /* bNumEndpoints */
   0x03,                                               /* bInterfaceClass: HID */
   0x01,                                               /* bInterfaceSubClass : 1=BOOT, 0=no boot */
   0x01,                                               /* nInterfaceProtocol : 0=none, 1=keyboard, 2=mouse */
@@ -169,8 +196,8 @@ __ALIGN_BEGIN static uint8_t USBD_HID_CfgDesc[USB_HID_CONFIG_DESC_SIZ] __ALIGN_E
   0x00,                                               /* bCountryCode: Hardware target country */
   0x01,                                               /* bNumDescriptors: Number of HID class descriptors to follow */
   0x22,                                               /* bDescriptorType */
-  HID_MOUSE_REPORT_DESC_SIZE,                         /* wItemLength: Total length of Report descriptor */
-  0x00,
+  LOBYTE(HID_MOUSE_REPORT_DESC_SIZE),                 /* wItemLength: Total length of Report descriptor */
+  HIBYTE(HID_MOUSE_REPORT_DESC_SIZE),
   /******************** Descriptor of Mouse endpoint ********************/
   /* 27 */
   0x07,                                               /* bLength: Endpoint Descriptor size */
@@ -180,13 +207,23 @@ __ALIGN_BEGIN static uint8_t USBD_HID_CfgDesc[USB_HID_CONFIG_DESC_SIZ] __ALIGN_E
   0x03,                                               /* bmAttributes: Interrupt endpoint */
   HID_EPIN_SIZE,                                      /* wMaxPacketSize: 4 Bytes max */
   0x00,
-  HID_FS_BINTERVAL,                                   /* bInterval: Polling Interval */
+  HID_FS_BINTERVAL,                                   /* bInterval: Polling Interval, HID_CFG_EPIN_INTERVAL_POS */
   /* 34 */
+
+  0x07,                                               /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                             /* bDescriptorType:*/
+
+  HID_EPOUT_ADDR,                                     /* bEndpointAddress: Endpoint Address (OUT) */
+  0x03,                                               /* bmAttributes: Interrupt endpoint */
+  HID_EPOUT_SIZE,                                     /* wMaxPacketSize: LED output report */
+  0x00,
+  HID_FS_BINTERVAL,                                   /* bInterval: Polling Interval */
+  /* 41 */
 };
 #endif /* USE_USBD_COMPOSITE  */
 
 /* USB HID device Configuration Descriptor */
-__ALIGN_BEGIN static uint8_t USBD_HID_Desc[USB_HID_DESC_SIZ] __ALIGN_END =
+__ALIGN_BEGIN static const uint8_t USBD_HID_Desc[USB_HID_DESC_SIZ] __ALIGN_END =
 {
   /* 18 */
   0x09,                                               /* bLength: HID Descriptor size */
@@ -196,13 +233,13 @@ __ALIGN_BEGIN static uint8_t USBD_HID_Desc[USB_HID_DESC_SIZ] __ALIGN_END =
   0x00,                                               /* bCountryCode: Hardware target country */
   0x01,                                               /* bNumDescriptors: Number of HID class descriptors to follow */
   0x22,                                               /* bDescriptorType */
-  HID_MOUSE_REPORT_DESC_SIZE,                         /* wItemLength: Total length of Report descriptor */
-  0x00,
+  LOBYTE(HID_MOUSE_REPORT_DESC_SIZE),                 /* wItemLength: Total length of Report descriptor */
+  HIBYTE(HID_MOUSE_REPORT_DESC_SIZE),
 };
 
 #ifndef USE_USBD_COMPOSITE
 /* USB Standard Device Descriptor */
-__ALIGN_BEGIN static uint8_t USBD_HID_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIER_DESC] __ALIGN_END =
+__ALIGN_BEGIN static const uint8_t USBD_HID_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIER_DESC] __ALIGN_END =
 {
   USB_LEN_DEV_QUALIFIER_DESC,
   USB_DESC_TYPE_DEVICE_QUALIFIER,
@@ -217,200 +254,26 @@ __ALIGN_BEGIN static uint8_t USBD_HID_DeviceQualifierDesc[USB_LEN_DEV_QUALIFIER_
 };
 #endif /* USE_USBD_COMPOSITE  */
 
-/*  HID keyboard report descriptor */
-__ALIGN_BEGIN static uint8_t HID_MOUSE_ReportDesc[HID_MOUSE_REPORT_DESC_SIZE]  __ALIGN_END =
-{
-	     0x05    ,//bSize: 0x01, bType: Global, bTag: Usage Page
-	     0x01    ,//Usage Page(Generic Desktop Controls )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x06    ,//Usage(Keyboard)
-	     0xA1    ,//bSize: 0x01, bType: Main, bTag: Collection
-	     0x01    ,//Collection(Application )
-	     0x85    ,//bSize: 0x01, bType: Global, bTag: Report ID
-	     0x01    ,//Report ID(0x1 )
-	     0x05    ,//bSize: 0x01, bType: Global, bTag: Usage Page
-	     0x07    ,//Usage Page(Keyboard/Keypad )
-	     0x19    ,//bSize: 0x01, bType: Local, bTag: Usage Minimum
-	     0xE0    ,//Usage Minimum(0xE0 )
-	     0x29    ,//bSize: 0x01, bType: Local, bTag: Usage Maximum
-	     0xE7    ,//Usage Maximum(0xE7 )
-	     0x15    ,//bSize: 0x01, bType: Global, bTag: Logical Minimum
-	     0x00    ,//Logical Minimum(0x0 )
-	     0x25    ,//bSize: 0x01, bType: Global, bTag: Logical Maximum
-	     0x01    ,//Logical Maximum(0x1 )
-	     0x75    ,//bSize: 0x01, bType: Global, bTag: Report Size
-	     0x01    ,//Report Size(0x1 )
-	     0x95    ,//bSize: 0x01, bType: Global, bTag: Report Count
-	     0x08    ,//Report Count(0x8 )
-	     0x81    ,//bSize: 0x01, bType: Main, bTag: Input
-	     0x02    ,//Input(Data, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Bit Field)
-	     0x75    ,//bSize: 0x01, bType: Global, bTag: Report Size
-	     0x08    ,//Report Size(0x8 )
-	     0x95    ,//bSize: 0x01, bType: Global, bTag: Report Count
-	     0x01    ,//Report Count(0x1 )
-	     0x81    ,//bSize: 0x01, bType: Main, bTag: Input
-	     0x01    ,//Input(Constant, Array, Absolute, No Wrap, Linear, Preferred State, No Null Position, Bit Field)
-	     0x05    ,//bSize: 0x01, bType: Global, bTag: Usage Page
-	     0x07    ,//Usage Page(Keyboard/Keypad )
-	     0x19    ,//bSize: 0x01, bType: Local, bTag: Usage Minimum
-	     0x00    ,//Usage Minimum(0x0 )
-	     0x29    ,//bSize: 0x01, bType: Local, bTag: Usage Maximum
-	     0x65    ,//Usage Maximum(0x65 )
-	     0x15    ,//bSize: 0x01, bType: Global, bTag: Logical Minimum
-	     0x00    ,//Logical Minimum(0x0 )
-	     0x25    ,//bSize: 0x01, bType: Global, bTag: Logical Maximum
-	     0x65    ,//Logical Maximum(0x65 )
-	     0x75    ,//bSize: 0x01, bType: Global, bTag: Report Size
-	     0x08    ,//Report Size(0x8 )
-	     0x95    ,//bSize: 0x01, bType: Global, bTag: Report Count
-	     0x05    ,//Report Count(0x5 )
-	     0x81    ,//bSize: 0x01, bType: Main, bTag: Input
-	     0x00    ,//Input(Data, Array, Absolute, No Wrap, Linear, Preferred State, No Null Position, Bit Field)
-	     0xC0    ,//bSize: 0x00, bType: Main, bTag: End Collection
-	     0x05    ,//bSize: 0x01, bType: Global, bTag: Usage Page
-	     0x0C    ,//Usage Page(Consumer )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x01    ,//Usage(Consumer Control)
-	     0xA1    ,//bSize: 0x01, bType: Main, bTag: Collection
-	     0x01    ,//Collection(Application )
-	     0x85    ,//bSize: 0x01, bType: Global, bTag: Report ID
-	     0x02    ,//Report ID(0x2 )
-	     0x19    ,//bSize: 0x01, bType: Local, bTag: Usage Minimum
-	     0x00    ,//Usage Minimum(0x0 )
-	     0x2A    ,//bSize: 0x02, bType: Local, bTag: Usage Maximum
-	     0x3C,
-	     0x02 ,//Usage Maximum(0x23C )
-	     0x15    ,//bSize: 0x01, bType: Global, bTag: Logical Minimum
-	     0x00    ,//Logical Minimum(0x0 )
-	     0x26    ,//bSize: 0x02, bType: Global, bTag: Logical Maximum
-	     0x3C,
-	     0x02 ,//Logical Maximum(0x23C )
-	     0x95    ,//bSize: 0x01, bType: Global, bTag: Report Count
-	     0x01    ,//Report Count(0x1 )
-	     0x75    ,//bSize: 0x01, bType: Global, bTag: Report Size
-	     0x10    ,//Report Size(0x10 )
-	     0x81    ,//bSize: 0x01, bType: Main, bTag: Input
-	     0x00    ,//Input(Data, Array, Absolute, No Wrap, Linear, Preferred State, No Null Position, Bit Field)
-	     0xC0    ,//bSize: 0x00, bType: Main, bTag: End Collection
-	     0x05    ,//bSize: 0x01, bType: Global, bTag: Usage Page
-	     0x01    ,//Usage Page(Generic Desktop Controls )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x80    ,//Usage(System Control)
-	     0xA1    ,//bSize: 0x01, bType: Main, bTag: Collection
-	     0x01    ,//Collection(Application )
-	     0x85    ,//bSize: 0x01, bType: Global, bTag: Report ID
-	     0x03    ,//Report ID(0x3 )
-	     0x19    ,//bSize: 0x01, bType: Local, bTag: Usage Minimum
-	     0x81    ,//Usage Minimum(0x81 )
-	     0x29    ,//bSize: 0x01, bType: Local, bTag: Usage Maximum
-	     0x83    ,//Usage Maximum(0x83 )
-	     0x15    ,//bSize: 0x01, bType: Global, bTag: Logical Minimum
-	     0x00    ,//Logical Minimum(0x0 )
-	     0x25    ,//bSize: 0x01, bType: Global, bTag: Logical Maximum
-	     0x01    ,//Logical Maximum(0x1 )
-	     0x75    ,//bSize: 0x01, bType: Global, bTag: Report Size
-	     0x01    ,//Report Size(0x1 )
-	     0x95    ,//bSize: 0x01, bType: Global, bTag: Report Count
-	     0x03    ,//Report Count(0x3 )
-	     0x81    ,//bSize: 0x01, bType: Main, bTag: Input
-	     0x02    ,//Input(Data, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Bit Field)
-	     0x95    ,//bSize: 0x01, bType: Global, bTag: Report Count
-	     0x05    ,//Report Count(0x5 )
-	     0x81    ,//bSize: 0x01, bType: Main, bTag: Input
-	     0x01    ,//Input(Constant, Array, Absolute, No Wrap, Linear, Preferred State, No Null Position, Bit Field)
-	     0xC0    ,//bSize: 0x00, bType: Main, bTag: End Collection
-	     0x06    ,//bSize: 0x02, bType: Global, bTag: Usage Page
-	     0x01,
-	     0xFF ,//Usage Page(Undefined )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x01    ,//Usage(1)
-	     0xA1    ,//bSize: 0x01, bType: Main, bTag: Collection
-	     0x01    ,//Collection(Application )
-	     0x85    ,//bSize: 0x01, bType: Global, bTag: Report ID
-	     0x04    ,//Report ID(0x4 )
-	     0x95    ,//bSize: 0x01, bType: Global, bTag: Report Count
-	     0x01    ,//Report Count(0x1 )
-	     0x75    ,//bSize: 0x01, bType: Global, bTag: Report Size
-	     0x08    ,//Report Size(0x8 )
-	     0x15    ,//bSize: 0x01, bType: Global, bTag: Logical Minimum
-	     0x01    ,//Logical Minimum(0x1 )
-	     0x25    ,//bSize: 0x01, bType: Global, bTag: Logical Maximum
-	     0x0A    ,//Logical Maximum(0xA )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x20    ,//Usage(32)
-	     0xB1    ,//bSize: 0x01, bType: Main, bTag: Feature
-	     0x03    ,//Feature(Constant, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Non VolatileBit Field)
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x23    ,//Usage(35)
-	     0xB1    ,//bSize: 0x01, bType: Main, bTag: Feature
-	     0x03    ,//Feature(Constant, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Non VolatileBit Field)
-	     0x25    ,//bSize: 0x01, bType: Global, bTag: Logical Maximum
-	     0x4F    ,//Logical Maximum(0x4F )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x21    ,//Usage(33)
-	     0xB1    ,//bSize: 0x01, bType: Main, bTag: Feature
-	     0x03    ,//Feature(Constant, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Non VolatileBit Field)
-	     0x25    ,//bSize: 0x01, bType: Global, bTag: Logical Maximum
-	     0x30    ,//Logical Maximum(0x30 )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x22    ,//Usage(34)
-	     0xB1    ,//bSize: 0x01, bType: Main, bTag: Feature
-	     0x03    ,//Feature(Constant, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Non VolatileBit Field)
-	     0x95    ,//bSize: 0x01, bType: Global, bTag: Report Count
-	     0x03    ,//Report Count(0x3 )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x24    ,//Usage(36)
-	     0xB1    ,//bSize: 0x01, bType: Main, bTag: Feature
-	     0x03    ,//Feature(Constant, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Non VolatileBit Field)
-	     0xC0    ,//bSize: 0x00, bType: Main, bTag: End Collection
-	     0x06    ,//bSize: 0x02, bType: Global, bTag: Usage Page
-	     0x01,
-	     0xFF ,//Usage Page(Undefined )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x01    ,//Usage(1)
-	     0xA1    ,//bSize: 0x01, bType: Main, bTag: Collection
-	     0x01    ,//Collection(Application )
-	     0x85    ,//bSize: 0x01, bType: Global, bTag: Report ID
-	     0x05    ,//Report ID(0x5 )
-	     0x95    ,//bSize: 0x01, bType: Global, bTag: Report Count
-	     0x01    ,//Report Count(0x1 )
-	     0x75    ,//bSize: 0x01, bType: Global, bTag: Report Size
-	     0x08    ,//Report Size(0x8 )
-	     0x15    ,//bSize: 0x01, bType: Global, bTag: Logical Minimum
-	     0x01    ,//Logical Minimum(0x1 )
-	     0x25    ,//bSize: 0x01, bType: Global, bTag: Logical Maximum
-	     0x0A    ,//Logical Maximum(0xA )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x20    ,//Usage(32)
-	     0xB1    ,//bSize: 0x01, bType: Main, bTag: Feature
-	     0x03    ,//Feature(Constant, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Non VolatileBit Field)
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x23    ,//Usage(35)
-	     0xB1    ,//bSize: 0x01, bType: Main, bTag: Feature
-	     0x03    ,//Feature(Constant, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Non VolatileBit Field)
-	     0x25    ,//bSize: 0x01, bType: Global, bTag: Logical Maximum
-	     0x4F    ,//Logical Maximum(0x4F )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x21    ,//Usage(33)
-	     0xB1    ,//bSize: 0x01, bType: Main, bTag: Feature
-	     0x03    ,//Feature(Constant, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Non VolatileBit Field)
-	     0x25    ,//bSize: 0x01, bType: Global, bTag: Logical Maximum
-	     0x30    ,//Logical Maximum(0x30 )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x22    ,//Usage(34)
-	     0xB1    ,//bSize: 0x01, bType: Main, bTag: Feature
-	     0x03    ,//Feature(Constant, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Non VolatileBit Field)
-	     0x95    ,//bSize: 0x01, bType: Global, bTag: Report Count
-	     0x03    ,//Report Count(0x3 )
-	     0x09    ,//bSize: 0x01, bType: Local, bTag: Usage
-	     0x24    ,//Usage(36)
-	     0xB1    ,//bSize: 0x01, bType: Main, bTag: Feature
-	     0x03    ,//Feature(Constant, Variable, Absolute, No Wrap, Linear, Preferred State, No Null Position, Non VolatileBit Field)
-	     0xC0    //bSize: 0x00, bType: Main, bTag: End Collection
+/* HID keyboard report descriptor, see usbd_hid_report_desc.h */
+__ALIGN_BEGIN static const uint8_t HID_MOUSE_ReportDesc[HID_MOUSE_REPORT_DESC_SIZE]  __ALIGN_END =
+{
+  HID_RD_BYTES(USBD_HID_REPORT_DESC)
 };
-//End Change the HID report descriptor
 
 static uint8_t HIDInEpAdd = HID_EPIN_ADDR;
+static uint8_t HIDOutEpAdd = HID_EPOUT_ADDR;
+
+/* Full-speed bInterval advertised at the next enumeration */
+static uint8_t HIDFsBInterval = HID_FS_BINTERVAL;
+
+#ifdef USE_USBD_COMPOSITE
+/* Class ID of the HID instance, for the functions called from thread context
+   where pdev->classId is whichever class the core served last */
+static uint8_t HIDClassId;
+#define USBD_HID_APP_CLASSID(pdev)    (HIDClassId)
+#else
+#define USBD_HID_APP_CLASSID(pdev)    ((pdev)->classId)
+#endif /* USE_USBD_COMPOSITE */
 
 /**
   * @}
@@ -432,6 +295,8 @@ static uint8_t USBD_HID_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
   UNUSED(cfgidx);
 
   USBD_HID_HandleTypeDef *hhid;
+  uint32_t prio;
+  uint32_t idx;
 
   hhid = (USBD_HID_HandleTypeDef *)USBD_malloc(sizeof(USBD_HID_HandleTypeDef));
 
@@ -445,24 +310,55 @@ static uint8_t USBD_HID_Init(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
   pdev->pClassData = pdev->pClassDataCmsit[pdev->classId];
 
 #ifdef USE_USBD_COMPOSITE
+  HIDClassId = (uint8_t)pdev->classId;
+
   /* Get the Endpoints addresses allocated for this class instance */
   HIDInEpAdd  = USBD_CoreGetEPAdd(pdev, USBD_EP_IN, USBD_EP_TYPE_INTR, (uint8_t)pdev->classId);
+  HIDOutEpAdd = USBD_CoreGetEPAdd(pdev, USBD_EP_OUT, USBD_EP_TYPE_INTR, (uint8_t)pdev->classId);
 #endif /* USE_USBD_COMPOSITE */
 
   if (pdev->dev_speed == USBD_SPEED_HIGH)
   {
     pdev->ep_in[HIDInEpAdd & 0xFU].bInterval = HID_HS_BINTERVAL;
+    pdev->ep_out[HIDOutEpAdd & 0xFU].bInterval = HID_HS_BINTERVAL;
   }
   else   /* LOW and FULL-speed endpoints */
   {
-    pdev->ep_in[HIDInEpAdd & 0xFU].bInterval = HID_FS_BINTERVAL;
+    pdev->ep_in[HIDInEpAdd & 0xFU].bInterval = HIDFsBInterval;
+    pdev->ep_out[HIDOutEpAdd & 0xFU].bInterval = HID_FS_BINTERVAL;
   }
 
   /* Open EP IN */
   (void)USBD_LL_OpenEP(pdev, HIDInEpAdd, USBD_EP_TYPE_INTR, HID_EPIN_SIZE);
   pdev->ep_in[HIDInEpAdd & 0xFU].is_used = 1U;
 
+  /* Open EP OUT */
+  (void)USBD_LL_OpenEP(pdev, HIDOutEpAdd, USBD_EP_TYPE_INTR, HID_EPOUT_SIZE);
+  pdev->ep_out[HIDOutEpAdd & 0xFU].is_used = 1U;
+
+  hhid->Protocol = HID_REPORT_PROTOCOL;
+  for (idx = 0U; idx < HID_IDLE_REPORT_IDS; idx++)
+  {
+    hhid->IdleRate[idx] = 0U;
+  }
+  hhid->AltSetting = 0U;
   hhid->state = USBD_HID_IDLE;
+  for (prio = 0U; prio < HID_REPORT_PRIORITIES; prio++)
+  {
+    hhid->QueueHead[prio] = 0U;
+    hhid->QueueTail[prio] = 0U;
+  }
+  hhid->InFlight = HID_REPORT_PRIO_NORMAL;
+  hhid->QueueHighWater = 0U;
+  hhid->QueueOverflows = 0U;
+  USBD_HID_ResetIdleReports(hhid);
+  hhid->CtrlReportLen = 0U;
+  hhid->CtrlReportId = 0U;
+  hhid->CtrlReportPending = 0U;
+  hhid->LedState = 0U;
+
+  /* Prepare Out endpoint to receive the first LED report */
+  (void)USBD_LL_PrepareReceive(pdev, HIDOutEpAdd, hhid->OutReport, HID_EPOUT_SIZE);
 
   return (uint8_t)USBD_OK;
 }
@@ -481,6 +377,7 @@ static uint8_t USBD_HID_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
 #ifdef USE_USBD_COMPOSITE
   /* Get the Endpoints addresses allocated for this class instance */
   HIDInEpAdd  = USBD_CoreGetEPAdd(pdev, USBD_EP_IN, USBD_EP_TYPE_INTR, (uint8_t)pdev->classId);
+  HIDOutEpAdd = USBD_CoreGetEPAdd(pdev, USBD_EP_OUT, USBD_EP_TYPE_INTR, (uint8_t)pdev->classId);
 #endif /* USE_USBD_COMPOSITE */
 
   /* Close HID EPs */
@@ -488,6 +385,10 @@ static uint8_t USBD_HID_DeInit(USBD_HandleTypeDef *pdev, uint8_t cfgidx)
   pdev->ep_in[HIDInEpAdd & 0xFU].is_used = 0U;
   pdev->ep_in[HIDInEpAdd & 0xFU].bInterval = 0U;
 
+  (void)USBD_LL_CloseEP(pdev, HIDOutEpAdd);
+  pdev->ep_out[HIDOutEpAdd & 0xFU].is_used = 0U;
+  pdev->ep_out[HIDOutEpAdd & 0xFU].bInterval = 0U;
+
   /* Free allocated memory */
   if (pdev->pClassDataCmsit[pdev->classId] != NULL)
   {
@@ -512,6 +413,8 @@ static uint8_t USBD_HID_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *re
   uint16_t len;
   uint8_t *pbuf;
   uint16_t status_info = 0U;
+  uint32_t idx;
+  uint8_t id;
 
   if (hhid == NULL)
   {
@@ -524,7 +427,19 @@ static uint8_t USBD_HID_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *re
       switch (req->bRequest)
       {
         case USBD_HID_REQ_SET_PROTOCOL:
+          if (req->wValue > HID_REPORT_PROTOCOL)
+          {
+            USBD_CtlError(pdev, req);
+            ret = USBD_FAIL;
+            break;
+          }
+          /* Queued and cached reports are in the old layout */
+          if (hhid->Protocol != (uint8_t)(req->wValue))
+          {
+            USBD_HID_FlushQueues(hhid);
+          }
           hhid->Protocol = (uint8_t)(req->wValue);
+          USBD_HID_ResetIdleReports(hhid);
           break;
 
         case USBD_HID_REQ_GET_PROTOCOL:
@@ -532,11 +447,48 @@ static uint8_t USBD_HID_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *re
           break;
 
         case USBD_HID_REQ_SET_IDLE:
-          hhid->IdleState = (uint8_t)(req->wValue >> 8);
+          id = (uint8_t)(req->wValue);
+          if (id >= HID_IDLE_REPORT_IDS)
+          {
+            USBD_CtlError(pdev, req);
+            ret = USBD_FAIL;
+            break;
+          }
+          /* Report ID 0 sets the rate of every report ID */
+          for (idx = 0U; idx < HID_IDLE_REPORT_IDS; idx++)
+          {
+            if ((id == 0U) || (idx == id))
+            {
+              hhid->IdleRate[idx] = (uint8_t)(req->wValue >> 8);
+            }
+          }
+          /* The new period starts now for the report IDs it applies to */
+          for (idx = 0U; idx < HID_IDLE_REPORT_SLOTS; idx++)
+          {
+            if ((id == 0U) || (hhid->IdleReport[idx].id == id))
+            {
+              hhid->IdleReport[idx].elapsed = 0U;
+            }
+          }
           break;
 
         case USBD_HID_REQ_GET_IDLE:
-          (void)USBD_CtlSendData(pdev, (uint8_t *)&hhid->IdleState, 1U);
+          id = (uint8_t)(req->wValue);
+          if (id >= HID_IDLE_REPORT_IDS)
+          {
+            USBD_CtlError(pdev, req);
+            ret = USBD_FAIL;
+            break;
+          }
+          (void)USBD_CtlSendData(pdev, &hhid->IdleRate[id], 1U);
+          break;
+
+        case USBD_HID_REQ_GET_REPORT:
+          ret = USBD_HID_GetReport(pdev, hhid, req);
+          break;
+
+        case USBD_HID_REQ_SET_REPORT:
+          ret = USBD_HID_SetReport(pdev, hhid, req);
           break;
 
         default:
@@ -564,11 +516,11 @@ static uint8_t USBD_HID_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *re
           if ((req->wValue >> 8) == HID_REPORT_DESC)
           {
             len = MIN(HID_MOUSE_REPORT_DESC_SIZE, req->wLength);
-            pbuf = HID_MOUSE_ReportDesc;
+            pbuf = (uint8_t *)HID_MOUSE_ReportDesc;
           }
           else if ((req->wValue >> 8) == HID_DESCRIPTOR_TYPE)
           {
-            pbuf = USBD_HID_Desc;
+            pbuf = (uint8_t *)USBD_HID_Desc;
             len = MIN(USB_HID_DESC_SIZ, req->wLength);
           }
           else
@@ -624,25 +576,94 @@ static uint8_t USBD_HID_Setup(USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *re
 }
 
 
+/**
+  * @brief  USBD_HID_EP0_RxReady
+  *         handle EP0 Rx Ready event: hand the SET_REPORT data to the application
+  * @param  pdev: device instance
+  * @retval status
+  */
+static uint8_t USBD_HID_EP0_RxReady(USBD_HandleTypeDef *pdev)
+{
+  USBD_HID_HandleTypeDef *hhid = (USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+  USBD_HID_ItfTypeDef *fops = (USBD_HID_ItfTypeDef *)pdev->pUserData[pdev->classId];
+
+  if (hhid == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  if (hhid->CtrlReportPending == HID_REPORT_TYPE_OUTPUT)
+  {
+    USBD_HID_SetLedReport(hhid, hhid->CtrlReport, hhid->CtrlReportLen);
+  }
+  else if ((hhid->CtrlReportPending == HID_REPORT_TYPE_FEATURE) && (fops != NULL) && (fops->SetFeature != NULL))
+  {
+    /* The data stage cannot be stalled anymore: errors are reported by GET_REPORT */
+    (void)fops->SetFeature(hhid->CtrlReportId, hhid->CtrlReport, hhid->CtrlReportLen);
+  }
+  else
+  {
+    /* No SET_REPORT data awaited */
+  }
+
+  hhid->CtrlReportPending = 0U;
+
+  return (uint8_t)USBD_OK;
+}
+
 /**
   * @brief  USBD_HID_SendReport
-  *         Send HID Report
+  *         Queue an HID Report at normal priority, see USBD_HID_SendReportPrio.
   * @param  pdev: device instance
   * @param  buff: pointer to report
+  * @param  len: report length, at most HID_EPIN_SIZE
   * @param  ClassId: The Class ID
-  * @retval status
+  * @retval status: USBD_BUSY when the report queue is full
   */
 #ifdef USE_USBD_COMPOSITE
 uint8_t USBD_HID_SendReport(USBD_HandleTypeDef *pdev, uint8_t *report, uint16_t len, uint8_t ClassId)
 {
-  USBD_HID_HandleTypeDef *hhid = (USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[ClassId];
+  return USBD_HID_SendReportPrio(pdev, report, len, HID_REPORT_PRIO_NORMAL, ClassId);
+}
 #else
 uint8_t USBD_HID_SendReport(USBD_HandleTypeDef *pdev, uint8_t *report, uint16_t len)
+{
+  return USBD_HID_SendReportPrio(pdev, report, len, HID_REPORT_PRIO_NORMAL);
+}
+#endif /* USE_USBD_COMPOSITE */
+
+/**
+  * @brief  USBD_HID_SendReportPrio
+  *         Queue an HID Report for transmission on the IN endpoint.
+  *         The report is copied, so the caller may reuse its buffer at once.
+  *         If the endpoint is idle the transfer starts immediately, otherwise
+  *         the report is sent from USBD_HID_DataIn once the previous one completes;
+  *         pending high priority reports always go before normal ones.
+  *         A report equal to the last one queued for its report ID is not sent
+  *         again: it is repeated by USBD_HID_SOF when the idle period expires.
+  * @param  pdev: device instance
+  * @param  buff: pointer to report
+  * @param  len: report length, at most HID_EPIN_SIZE
+  * @param  prio: HID_REPORT_PRIO_HIGH or HID_REPORT_PRIO_NORMAL
+  * @param  ClassId: The Class ID
+  * @retval status: USBD_BUSY when the queue of that priority is full
+  */
+#ifdef USE_USBD_COMPOSITE
+uint8_t USBD_HID_SendReportPrio(USBD_HandleTypeDef *pdev, uint8_t *report, uint16_t len, uint8_t prio,
+                                uint8_t ClassId)
+{
+  USBD_HID_HandleTypeDef *hhid = (USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[ClassId];
+#else
+uint8_t USBD_HID_SendReportPrio(USBD_HandleTypeDef *pdev, uint8_t *report, uint16_t len, uint8_t prio)
 {
   USBD_HID_HandleTypeDef *hhid = (USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
 #endif /* USE_USBD_COMPOSITE */
+  USBD_HID_IdleReportTypeDef *idle;
+  USBD_StatusTypeDef ret;
+  uint32_t primask;
+  uint8_t id;
 
-  if (hhid == NULL)
+  if ((hhid == NULL) || (len == 0U) || (len > HID_EPIN_SIZE) || (prio >= HID_REPORT_PRIORITIES))
   {
     return (uint8_t)USBD_FAIL;
   }
@@ -652,16 +673,41 @@ uint8_t USBD_HID_SendReport(USBD_HandleTypeDef *pdev, uint8_t *report, uint16_t
   HIDInEpAdd = USBD_CoreGetEPAdd(pdev, USBD_EP_IN, USBD_EP_TYPE_INTR, ClassId);
 #endif /* USE_USBD_COMPOSITE */
 
-  if (pdev->dev_state == USBD_STATE_CONFIGURED)
+  if (pdev->dev_state != USBD_STATE_CONFIGURED)
+  {
+    return (uint8_t)USBD_OK;
+  }
+
+  /* Boot protocol reports carry no report ID */
+  id = (hhid->Protocol == HID_REPORT_PROTOCOL) ? report[0] : 0U;
+
+  /* USBD_HID_SOF queues reports from the USB interrupt */
+  primask = __get_PRIMASK();
+  __disable_irq();
+
+  idle = USBD_HID_GetIdleReport(hhid, id);
+
+  if ((idle != NULL) && (idle->len == len) && (memcmp(idle->buf, report, len) == 0))
+  {
+    ret = USBD_OK;
+  }
+  else
   {
-    if (hhid->state == USBD_HID_IDLE)
+    ret = USBD_HID_Enqueue(pdev, hhid, prio, report, len);
+
+    if ((ret == USBD_OK) && (idle != NULL))
     {
-      hhid->state = USBD_HID_BUSY;
-      (void)USBD_LL_Transmit(pdev, HIDInEpAdd, report, len);
+      (void)USBD_memcpy(idle->buf, report, len);
+      idle->len = len;
+      idle->id = id;
+      idle->prio = prio;
+      idle->elapsed = 0U;
     }
   }
 
-  return (uint8_t)USBD_OK;
+  __set_PRIMASK(primask);
+
+  return (uint8_t)ret;
 }
 
 /**
@@ -686,12 +732,138 @@ uint32_t USBD_HID_GetPollingInterval(USBD_HandleTypeDef *pdev)
   {
     /* Sets the data transfer polling interval for low and full
     speed transfers */
-    polling_interval =  HID_FS_BINTERVAL;
+    polling_interval =  HIDFsBInterval;
   }
 
   return ((uint32_t)(polling_interval));
 }
 
+/**
+  * @brief  USBD_HID_GetProtocol
+  *         return the protocol selected by the host with SET_PROTOCOL
+  * @param  pdev: device instance
+  * @retval HID_BOOT_PROTOCOL or HID_REPORT_PROTOCOL
+  */
+uint8_t USBD_HID_GetProtocol(USBD_HandleTypeDef *pdev)
+{
+  USBD_HID_HandleTypeDef *hhid = (USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[USBD_HID_APP_CLASSID(pdev)];
+
+  if (hhid == NULL)
+  {
+    return HID_REPORT_PROTOCOL;
+  }
+
+  return (uint8_t)hhid->Protocol;
+}
+
+/**
+  * @brief  USBD_HID_RegisterInterface
+  *         Register the application feature report callbacks
+  * @param  pdev: device instance
+  * @param  fops: callbacks
+  * @retval status
+  */
+uint8_t USBD_HID_RegisterInterface(USBD_HandleTypeDef *pdev, USBD_HID_ItfTypeDef *fops)
+{
+  if (fops == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  pdev->pUserData[pdev->classId] = fops;
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_HID_GetLedState
+  *         return the lock LEDs last set by the host
+  * @param  pdev: device instance
+  * @retval LED bitmap: bit 0 Num Lock, 1 Caps Lock, 2 Scroll Lock, 3 Compose, 4 Kana
+  */
+uint8_t USBD_HID_GetLedState(USBD_HandleTypeDef *pdev)
+{
+  USBD_HID_HandleTypeDef *hhid = (USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[USBD_HID_APP_CLASSID(pdev)];
+
+  if (hhid == NULL)
+  {
+    return 0U;
+  }
+
+  return hhid->LedState;
+}
+
+/**
+  * @brief  USBD_HID_SetPollingInterval
+  *         select the full-speed polling interval of the IN endpoint.
+  *         The endpoint descriptor is patched at once, the host picks the new
+  *         value up at the next enumeration.
+  * @param  pdev: device instance
+  * @param  interval: polling interval in ms (1, 2, 4, 8 or 10)
+  * @retval status
+  */
+uint8_t USBD_HID_SetPollingInterval(USBD_HandleTypeDef *pdev, uint8_t interval)
+{
+  UNUSED(pdev);
+
+  if (!HID_FS_BINTERVAL_IS_VALID(interval))
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  HIDFsBInterval = interval;
+
+#ifndef USE_USBD_COMPOSITE
+  USBD_HID_CfgDesc[HID_CFG_EPIN_INTERVAL_POS] = HIDFsBInterval;
+#endif /* USE_USBD_COMPOSITE */
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_HID_GetQueueHighWater
+  *         return the highest number of reports ever pending on the IN endpoint
+  * @param  pdev: device instance
+  * @retval queue high-water mark
+  */
+uint32_t USBD_HID_GetQueueHighWater(USBD_HandleTypeDef *pdev)
+{
+  USBD_HID_HandleTypeDef *hhid = (USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[USBD_HID_APP_CLASSID(pdev)];
+
+  if (hhid == NULL)
+  {
+    return 0U;
+  }
+
+  return hhid->QueueHighWater;
+}
+
+/**
+  * @brief  USBD_HID_GetQueueDepth
+  *         return the number of reports pending on the IN endpoint, the one
+  *         on the wire included
+  * @param  pdev: device instance
+  * @retval reports pending in every priority queue
+  */
+uint32_t USBD_HID_GetQueueDepth(USBD_HandleTypeDef *pdev)
+{
+  USBD_HID_HandleTypeDef *hhid = (USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[USBD_HID_APP_CLASSID(pdev)];
+  uint32_t depth = 0U;
+  uint8_t prio;
+
+  if (hhid == NULL)
+  {
+    return 0U;
+  }
+
+  for (prio = 0U; prio < HID_REPORT_PRIORITIES; prio++)
+  {
+    depth += hhid->QueueHead[prio] - hhid->QueueTail[prio];
+  }
+
+  return depth;
+}
+
 #ifndef USE_USBD_COMPOSITE
 /**
   * @brief  USBD_HID_GetCfgFSDesc
@@ -702,12 +874,7 @@ uint32_t USBD_HID_GetPollingInterval(USBD_HandleTypeDef *pdev)
   */
 static uint8_t *USBD_HID_GetFSCfgDesc(uint16_t *length)
 {
-  USBD_EpDescTypeDef *pEpDesc = USBD_GetEpDesc(USBD_HID_CfgDesc, HID_EPIN_ADDR);
-
-  if (pEpDesc != NULL)
-  {
-    pEpDesc->bInterval = HID_FS_BINTERVAL;
-  }
+  USBD_HID_CfgDesc[HID_CFG_EPIN_INTERVAL_POS] = HIDFsBInterval;
 
   *length = (uint16_t)sizeof(USBD_HID_CfgDesc);
   return USBD_HID_CfgDesc;
@@ -722,12 +889,7 @@ static uint8_t *USBD_HID_GetFSCfgDesc(uint16_t *length)
   */
 static uint8_t *USBD_HID_GetHSCfgDesc(uint16_t *length)
 {
-  USBD_EpDescTypeDef *pEpDesc = USBD_GetEpDesc(USBD_HID_CfgDesc, HID_EPIN_ADDR);
-
-  if (pEpDesc != NULL)
-  {
-    pEpDesc->bInterval = HID_HS_BINTERVAL;
-  }
+  USBD_HID_CfgDesc[HID_CFG_EPIN_INTERVAL_POS] = HID_HS_BINTERVAL;
 
   *length = (uint16_t)sizeof(USBD_HID_CfgDesc);
   return USBD_HID_CfgDesc;
@@ -742,12 +904,7 @@ static uint8_t *USBD_HID_GetHSCfgDesc(uint16_t *length)
   */
 static uint8_t *USBD_HID_GetOtherSpeedCfgDesc(uint16_t *length)
 {
-  USBD_EpDescTypeDef *pEpDesc = USBD_GetEpDesc(USBD_HID_CfgDesc, HID_EPIN_ADDR);
-
-  if (pEpDesc != NULL)
-  {
-    pEpDesc->bInterval = HID_FS_BINTERVAL;
-  }
+  USBD_HID_CfgDesc[HID_CFG_EPIN_INTERVAL_POS] = HIDFsBInterval;
 
   *length = (uint16_t)sizeof(USBD_HID_CfgDesc);
   return USBD_HID_CfgDesc;
@@ -756,21 +913,399 @@ static uint8_t *USBD_HID_GetOtherSpeedCfgDesc(uint16_t *length)
 
 /**
   * @brief  USBD_HID_DataIn
-  *         handle data IN Stage
+  *         handle data IN Stage: release the sent report and start the next one
   * @param  pdev: device instance
   * @param  epnum: endpoint index
   * @retval status
   */
 static uint8_t USBD_HID_DataIn(USBD_HandleTypeDef *pdev, uint8_t epnum)
 {
+  USBD_HID_HandleTypeDef *hhid = (USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+
   UNUSED(epnum);
-  /* Ensure that the FIFO is empty before a new transfer, this condition could
-  be caused by  a new transfer before the end of the previous transfer */
-  ((USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId])->state = USBD_HID_IDLE;
+
+  if (hhid == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+  /* Release the report only if one was on the endpoint and is still queued */
+  if ((hhid->state == USBD_HID_BUSY) && (hhid->QueueTail[hhid->InFlight] != hhid->QueueHead[hhid->InFlight]))
+  {
+    hhid->QueueTail[hhid->InFlight]++;
+  }
+  hhid->state = USBD_HID_IDLE;
+  USBD_HID_TransmitNext(pdev, hhid);
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_HID_DataOut
+  *         handle data OUT Stage: cache the LED state and re-arm the endpoint
+  * @param  pdev: device instance
+  * @param  epnum: endpoint index
+  * @retval status
+  */
+static uint8_t USBD_HID_DataOut(USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+  USBD_HID_HandleTypeDef *hhid = (USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+
+  if (hhid == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+#ifdef USE_USBD_COMPOSITE
+  /* Get the Endpoints addresses allocated for this class instance */
+  HIDOutEpAdd = USBD_CoreGetEPAdd(pdev, USBD_EP_OUT, USBD_EP_TYPE_INTR, (uint8_t)pdev->classId);
+#endif /* USE_USBD_COMPOSITE */
+
+  USBD_HID_SetLedReport(hhid, hhid->OutReport, USBD_LL_GetRxDataSize(pdev, epnum));
+
+  (void)USBD_LL_PrepareReceive(pdev, HIDOutEpAdd, hhid->OutReport, HID_EPOUT_SIZE);
+
+  return (uint8_t)USBD_OK;
+}
+
+/**
+  * @brief  USBD_HID_SOF
+  *         handle SOF event: repeat the last report of each report ID once
+  *         the SET_IDLE period of that report ID has elapsed without a new one
+  * @param  pdev: device instance
+  * @retval status
+  */
+static uint8_t USBD_HID_SOF(USBD_HandleTypeDef *pdev)
+{
+  USBD_HID_HandleTypeDef *hhid = (USBD_HID_HandleTypeDef *)pdev->pClassDataCmsit[pdev->classId];
+  USBD_HID_IdleReportTypeDef *idle;
+  uint32_t period;
+  uint32_t idx;
+
+  if (hhid == NULL)
+  {
+    return (uint8_t)USBD_FAIL;
+  }
+
+#ifdef USE_USBD_COMPOSITE
+  /* Get the Endpoints addresses allocated for this class instance */
+  HIDInEpAdd = USBD_CoreGetEPAdd(pdev, USBD_EP_IN, USBD_EP_TYPE_INTR, (uint8_t)pdev->classId);
+#endif /* USE_USBD_COMPOSITE */
+
+  for (idx = 0U; idx < HID_IDLE_REPORT_SLOTS; idx++)
+  {
+    idle = &hhid->IdleReport[idx];
+
+    if (idle->len == 0U)
+    {
+      continue;
+    }
+
+    /* Idle rate 0: report on change only; IDs without a rate of their own use ID 0's */
+    period = (uint32_t)hhid->IdleRate[(idle->id < HID_IDLE_REPORT_IDS) ? idle->id : 0U] * HID_IDLE_UNIT_MS;
+    if (period == 0U)
+    {
+      continue;
+    }
+
+    if (idle->elapsed < period)
+    {
+      idle->elapsed++;
+    }
+
+    /* A full queue is retried on the next frame */
+    if ((idle->elapsed >= period) &&
+        (USBD_HID_Enqueue(pdev, hhid, idle->prio, idle->buf, idle->len) == USBD_OK))
+    {
+      idle->elapsed = 0U;
+    }
+  }
 
   return (uint8_t)USBD_OK;
 }
 
+/**
+  * @brief  USBD_HID_Enqueue
+  *         Copy a report into the IN queue of its priority and start the
+  *         endpoint if idle, called with the USB interrupt masked or from it
+  * @param  pdev: device instance
+  * @param  hhid: HID handle
+  * @param  prio: queue priority
+  * @param  report: pointer to report
+  * @param  len: report length
+  * @retval status: USBD_BUSY when the queue is full
+  */
+static USBD_StatusTypeDef USBD_HID_Enqueue(USBD_HandleTypeDef *pdev, USBD_HID_HandleTypeDef *hhid,
+                                           uint8_t prio, const uint8_t *report, uint16_t len)
+{
+  USBD_HID_ReportTypeDef *slot;
+  uint32_t head;
+  uint32_t used;
+
+  head = hhid->QueueHead[prio];
+  used = head - hhid->QueueTail[prio];
+
+  if (used >= HID_REPORT_QUEUE_SIZE)
+  {
+    hhid->QueueOverflows++;
+    return USBD_BUSY;
+  }
+
+  slot = &hhid->Queue[prio][head & HID_REPORT_QUEUE_MASK];
+  (void)USBD_memcpy(slot->buf, report, len);
+  slot->len = len;
+
+  /* Publish the slot only once its content is written */
+  __DMB();
+  hhid->QueueHead[prio] = head + 1U;
+
+  if ((used + 1U) > hhid->QueueHighWater)
+  {
+    hhid->QueueHighWater = used + 1U;
+  }
+
+  /* An idle endpoint means DataIn has drained every queue */
+  if (hhid->state == USBD_HID_IDLE)
+  {
+    USBD_HID_TransmitNext(pdev, hhid);
+  }
+
+  return USBD_OK;
+}
+
+/**
+  * @brief  USBD_HID_TransmitNext
+  *         Start the oldest report of the highest priority non-empty queue,
+  *         or mark the endpoint idle when all queues are empty
+  * @param  pdev: device instance
+  * @param  hhid: HID handle
+  * @retval None
+  */
+static void USBD_HID_TransmitNext(USBD_HandleTypeDef *pdev, USBD_HID_HandleTypeDef *hhid)
+{
+  USBD_HID_ReportTypeDef *slot;
+  uint32_t tail;
+  uint8_t prio;
+
+  for (prio = 0U; prio < HID_REPORT_PRIORITIES; prio++)
+  {
+    tail = hhid->QueueTail[prio];
+
+    if (tail != hhid->QueueHead[prio])
+    {
+      slot = &hhid->Queue[prio][tail & HID_REPORT_QUEUE_MASK];
+      hhid->InFlight = prio;
+      hhid->state = USBD_HID_BUSY;
+      (void)USBD_LL_Transmit(pdev, HIDInEpAdd, slot->buf, slot->len);
+      return;
+    }
+  }
+
+  hhid->state = USBD_HID_IDLE;
+}
+
+/**
+  * @brief  USBD_HID_GetIdleReport
+  *         Find the idle repeat slot of a report ID, or claim a free one
+  * @param  hhid: HID handle
+  * @param  id: report ID
+  * @retval slot, NULL if all slots hold other report IDs
+  */
+static USBD_HID_IdleReportTypeDef *USBD_HID_GetIdleReport(USBD_HID_HandleTypeDef *hhid, uint8_t id)
+{
+  USBD_HID_IdleReportTypeDef *free_slot = NULL;
+  uint32_t idx;
+
+  for (idx = 0U; idx < HID_IDLE_REPORT_SLOTS; idx++)
+  {
+    if (hhid->IdleReport[idx].len == 0U)
+    {
+      if (free_slot == NULL)
+      {
+        free_slot = &hhid->IdleReport[idx];
+      }
+    }
+    else if (hhid->IdleReport[idx].id == id)
+    {
+      return &hhid->IdleReport[idx];
+    }
+  }
+
+  return free_slot;
+}
+
+/**
+  * @brief  USBD_HID_ResetIdleReports
+  *         Forget the reports kept for idle repeats
+  * @param  hhid: HID handle
+  * @retval None
+  */
+static void USBD_HID_ResetIdleReports(USBD_HID_HandleTypeDef *hhid)
+{
+  uint32_t idx;
+
+  for (idx = 0U; idx < HID_IDLE_REPORT_SLOTS; idx++)
+  {
+    hhid->IdleReport[idx].len = 0U;
+    hhid->IdleReport[idx].elapsed = 0U;
+  }
+}
+
+/**
+  * @brief  USBD_HID_FlushQueues
+  *         Drop every queued report but the one on the endpoint, called
+  *         from the USB interrupt
+  * @param  hhid: HID handle
+  * @retval None
+  */
+static void USBD_HID_FlushQueues(USBD_HID_HandleTypeDef *hhid)
+{
+  uint8_t prio;
+
+  for (prio = 0U; prio < HID_REPORT_PRIORITIES; prio++)
+  {
+    if ((hhid->state == USBD_HID_BUSY) && (prio == hhid->InFlight))
+    {
+      hhid->QueueHead[prio] = hhid->QueueTail[prio] + 1U;
+    }
+    else
+    {
+      hhid->QueueHead[prio] = hhid->QueueTail[prio];
+    }
+  }
+}
+
+/**
+  * @brief  USBD_HID_SetLedReport
+  *         Cache the lock LEDs from an output report
+  * @param  hhid: HID handle
+  * @param  report: output report, led byte after the report ID under report protocol
+  * @param  len: received length
+  * @retval None
+  */
+static void USBD_HID_SetLedReport(USBD_HID_HandleTypeDef *hhid, const uint8_t *report, uint32_t len)
+{
+  if (hhid->Protocol == HID_BOOT_PROTOCOL)
+  {
+    if (len >= 1U)
+    {
+      hhid->LedState = report[0];
+    }
+  }
+  else if ((len >= HID_LED_REPORT_SIZE) && (report[0] == HID_LED_REPORT_ID))
+  {
+    hhid->LedState = report[1];
+  }
+  else
+  {
+    /* Not an LED report */
+  }
+}
+
+/**
+  * @brief  USBD_HID_GetReport
+  *         Answer GET_REPORT: feature reports come from the application,
+  *         input reports from the last report queued for the report ID
+  * @param  pdev: device instance
+  * @param  hhid: HID handle
+  * @param  req: usb request
+  * @retval status
+  */
+static USBD_StatusTypeDef USBD_HID_GetReport(USBD_HandleTypeDef *pdev, USBD_HID_HandleTypeDef *hhid,
+                                             USBD_SetupReqTypedef *req)
+{
+  USBD_HID_ItfTypeDef *fops = (USBD_HID_ItfTypeDef *)pdev->pUserData[pdev->classId];
+  USBD_HID_IdleReportTypeDef *idle;
+  uint8_t type = HIBYTE(req->wValue);
+  uint8_t id = LOBYTE(req->wValue);
+  uint16_t len = 0U;
+
+  if ((type == HID_REPORT_TYPE_FEATURE) && (fops != NULL) && (fops->GetFeature != NULL))
+  {
+    hhid->CtrlReport[0] = id;
+    len = HID_CTRL_REPORT_SIZE;
+
+    if ((fops->GetFeature(id, hhid->CtrlReport, &len) != 0) || (len > HID_CTRL_REPORT_SIZE))
+    {
+      len = 0U;
+    }
+  }
+  else if (type == HID_REPORT_TYPE_INPUT)
+  {
+    idle = USBD_HID_GetIdleReport(hhid, id);
+
+    if ((idle != NULL) && (idle->len != 0U) && (idle->len <= HID_CTRL_REPORT_SIZE))
+    {
+      len = idle->len;
+      (void)USBD_memcpy(hhid->CtrlReport, idle->buf, len);
+    }
+  }
+  else
+  {
+    /* Output reports cannot be read back */
+  }
+
+  if (len == 0U)
+  {
+    USBD_CtlError(pdev, req);
+    return USBD_FAIL;
+  }
+
+  (void)USBD_CtlSendData(pdev, hhid->CtrlReport, MIN(len, req->wLength));
+
+  return USBD_OK;
+}
+
+/**
+  * @brief  USBD_HID_SetReport
+  *         Accept the data stage of a SET_REPORT, delivered in USBD_HID_EP0_RxReady.
+  *         The data stage cannot be refused, so a report the device does not
+  *         have is stalled here: feature report IDs are probed with GetFeature
+  *         into the buffer the data stage then overwrites.
+  * @param  pdev: device instance
+  * @param  hhid: HID handle
+  * @param  req: usb request
+  * @retval status
+  */
+static USBD_StatusTypeDef USBD_HID_SetReport(USBD_HandleTypeDef *pdev, USBD_HID_HandleTypeDef *hhid,
+                                             USBD_SetupReqTypedef *req)
+{
+  USBD_HID_ItfTypeDef *fops = (USBD_HID_ItfTypeDef *)pdev->pUserData[pdev->classId];
+  uint8_t type = HIBYTE(req->wValue);
+  uint8_t id = LOBYTE(req->wValue);
+  uint16_t len = HID_CTRL_REPORT_SIZE;
+  uint8_t known;
+
+  if (type == HID_REPORT_TYPE_FEATURE)
+  {
+    known = ((fops != NULL) && (fops->GetFeature != NULL) && (fops->SetFeature != NULL) &&
+             (fops->GetFeature(id, hhid->CtrlReport, &len) == 0)) ? 1U : 0U;
+  }
+  else if (type == HID_REPORT_TYPE_OUTPUT)
+  {
+    known = ((hhid->Protocol == HID_BOOT_PROTOCOL) || (id == HID_LED_REPORT_ID)) ? 1U : 0U;
+  }
+  else
+  {
+    known = 0U;
+  }
+
+  /* Output reports (LEDs) are handled by the class, feature reports by the application */
+  if ((known == 0U) || (req->wLength == 0U) || (req->wLength > HID_CTRL_REPORT_SIZE))
+  {
+    USBD_CtlError(pdev, req);
+    return USBD_FAIL;
+  }
+
+  hhid->CtrlReportId = id;
+  hhid->CtrlReportLen = req->wLength;
+  hhid->CtrlReportPending = type;
+
+  (void)USBD_CtlPrepareRx(pdev, hhid->CtrlReport, req->wLength);
+
+  return USBD_OK;
+}
+
 #ifndef USE_USBD_COMPOSITE
 /**
   * @brief  DeviceQualifierDescriptor
@@ -782,7 +1317,7 @@ static uint8_t *USBD_HID_GetDeviceQualifierDesc(uint16_t *length)
 {
   *length = (uint16_t)sizeof(USBD_HID_DeviceQualifierDesc);
 
-  return USBD_HID_DeviceQualifierDesc;
+  return (uint8_t *)USBD_HID_DeviceQualifierDesc;
 }
 #endif /* USE_USBD_COMPOSITE  */
 /**
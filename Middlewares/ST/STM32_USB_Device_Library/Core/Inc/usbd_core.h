@@ -145,6 +145,7 @@ USBD_StatusTypeDef USBD_LL_PrepareReceive(USBD_HandleTypeDef *pdev, uint8_t ep_a
 #ifdef USBD_HS_TESTMODE_ENABLE
 USBD_StatusTypeDef USBD_LL_SetTestMode(USBD_HandleTypeDef *pdev, uint8_t testmode);
 #endif /* USBD_HS_TESTMODE_ENABLE */
+USBD_StatusTypeDef USBD_LL_RemoteWakeup(USBD_HandleTypeDef *pdev, uint8_t active);
 
 uint8_t USBD_LL_IsStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr);
 uint32_t USBD_LL_GetRxDataSize(USBD_HandleTypeDef *pdev, uint8_t  ep_addr);
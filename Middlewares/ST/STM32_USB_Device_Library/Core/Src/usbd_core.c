@@ -251,7 +251,7 @@ USBD_StatusTypeDef USBD_RegisterClassComposite(USBD_HandleTypeDef *pdev, USBD_Cl
 
   if ((pdev->classId < USBD_MAX_SUPPORTED_CLASS) && (pdev->NumClasses < USBD_MAX_SUPPORTED_CLASS))
   {
-    if ((uint32_t)pclass != 0U)
+    if (pclass != NULL)
     {
       /* Link the class to the USB Device handle */
       pdev->pClass[pdev->classId] = pclass;
@@ -698,13 +698,17 @@ USBD_StatusTypeDef USBD_LL_DataInStage(USBD_HandleTypeDef *pdev,
     {
       if (pep->rem_length > pep->maxpacket)
       {
+        /* Prepare endpoint for premature end of transfer, once: it stays
+           armed until the host sends the status stage */
+        if (pep->rem_length == pep->total_length)
+        {
+          (void)USBD_LL_PrepareReceive(pdev, 0U, NULL, 0U);
+        }
+
         pep->rem_length -= pep->maxpacket;
         pep->pbuffer += pep->maxpacket;
 
         (void)USBD_CtlContinueSendData(pdev, pep->pbuffer, pep->rem_length);
-
-        /* Prepare endpoint for premature end of transfer */
-        (void)USBD_LL_PrepareReceive(pdev, 0U, NULL, 0U);
       }
       else
       {
@@ -716,8 +720,11 @@ USBD_StatusTypeDef USBD_LL_DataInStage(USBD_HandleTypeDef *pdev,
           (void)USBD_CtlContinueSendData(pdev, NULL, 0U);
           pdev->ep0_data_len = 0U;
 
-          /* Prepare endpoint for premature end of transfer */
-          (void)USBD_LL_PrepareReceive(pdev, 0U, NULL, 0U);
+          /* Prepare endpoint for premature end of transfer, unless armed above */
+          if (pep->total_length == pep->maxpacket)
+          {
+            (void)USBD_LL_PrepareReceive(pdev, 0U, NULL, 0U);
+          }
         }
         else
         {
@@ -792,7 +799,9 @@ USBD_StatusTypeDef USBD_LL_Reset(USBD_HandleTypeDef *pdev)
     /* Check if current class is in use */
     if ((pdev->tclasslist[i].Active) == 1U)
     {
-      if (pdev->pClass[i] != NULL)
+      /* A class is only started by SET_CONFIGURATION: the resets of an
+         enumeration find nothing to close */
+      if ((pdev->pClass[i] != NULL) && (pdev->pClassDataCmsit[i] != NULL))
       {
         pdev->classId = i;
         /* Clear configuration  and De-initialize the Class process*/
@@ -809,7 +818,7 @@ USBD_StatusTypeDef USBD_LL_Reset(USBD_HandleTypeDef *pdev)
   }
 #else
 
-  if (pdev->pClass[0] != NULL)
+  if ((pdev->pClass[0] != NULL) && (pdev->pClassDataCmsit[0] != NULL))
   {
     if (pdev->pClass[0]->DeInit != NULL)
     {
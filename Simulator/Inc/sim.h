@@ -0,0 +1,287 @@
+/**
+  ******************************************************************************
+  * @file           : sim.h
+  * @brief          : Host simulator: virtual clock, inputs, PCD and USB host
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SIM_H
+#define __SIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <setjmp.h>
+#include <stdint.h>
+#include "main.h"
+#include "hid_keyboard.h"
+#include "matrix_scan.h"
+#include "usb_fifo.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* One simulation step is one matrix scan */
+#define SIM_STEP_US               (1000000U / MATRIX_SCAN_HZ)
+#define SIM_FRAME_US              1000U
+
+/* Negative results of a host side endpoint access */
+#define SIM_PCD_NAK               (-1)
+#define SIM_PCD_STALL             (-2)
+#define SIM_PCD_ERROR             (-3)
+
+/* Report descriptor parser limits */
+#define SIM_HID_MAX_FIELDS        64U
+#define SIM_HID_MAX_USAGES        16U
+#define SIM_HID_MAX_REPORT_IDS    256U
+
+/* Report types, as in GET_REPORT wValue */
+#define SIM_HID_INPUT             1U
+#define SIM_HID_OUTPUT            2U
+#define SIM_HID_FEATURE           3U
+
+/* Macro assembler limits */
+#define SIM_MACRO_MAX             64U
+#define SIM_MACRO_CODE_MAX        (256U * 1024U)
+
+/* Requests the scripted enumeration records */
+#define SIM_HOST_ENUM_STEPS       24U
+
+/* Macro events the host expects */
+#define SIM_MACRO_EDGE            1U
+#define SIM_MACRO_TEXT            2U
+
+/* Shared by the checks of sim_<name>_check.c */
+#define SIM_PENDING_SIZE          64U
+#define SIM_DRAIN_MS              20U
+#define SIM_DESC_USAGES           64U
+#define SIM_TYPING_SIZE           4096U
+#define SIM_QUEUE_TAP_MS          10U     /* longer than the longest debounce */
+#define SIM_QUEUE_TIMEOUT_MS      200U
+
+/* Exported types ------------------------------------------------------------*/
+/* What the host learnt while enumerating the device */
+typedef struct
+{
+  uint16_t vid;
+  uint16_t pid;
+  uint8_t  address;
+  uint8_t  configuration;
+  uint8_t  ep_in;
+  uint8_t  ep_out;
+  uint8_t  interval;           /* interrupt IN bInterval, ms */
+  uint16_t ep_in_size;
+  uint8_t  cdc_if;             /* CDC communication interface, console */
+  uint8_t  cdc_in;             /* CDC endpoints, 0 without a console */
+  uint8_t  cdc_out;
+  uint8_t  cdc_notify;
+  uint16_t report_desc_len;
+  uint8_t  report_desc[512];
+} sim_host_device_t;
+
+/* One request of the scripted enumeration, or a bus reset */
+typedef struct
+{
+  char     name[40];
+  uint64_t device_ns;          /* host clock spent in the device's callbacks */
+  uint32_t driver_calls;       /* sim_pcd_driver_calls() they made */
+} sim_host_step_t;
+
+/* One main item of a report descriptor; usages carry their page in bits 31:16 */
+typedef struct
+{
+  uint8_t  report_id;
+  uint8_t  type;               /* SIM_HID_INPUT/OUTPUT/FEATURE */
+  uint8_t  flags;              /* main item data: constant, variable */
+  uint8_t  size;               /* bits per element */
+  uint16_t count;
+  uint16_t offset;             /* bit offset after the report ID byte */
+  int32_t  logical_min;
+  int32_t  logical_max;
+  uint32_t usage_min;
+  uint32_t usage_max;
+  uint8_t  usage_count;        /* explicit usages, usage_min/max unused if not 0 */
+  uint32_t usage[SIM_HID_MAX_USAGES];
+} sim_hid_field_t;
+
+/* Fields of every report, as a host builds them from the descriptor */
+typedef struct
+{
+  uint32_t fields;
+  uint8_t  numbered;           /* report IDs present */
+  sim_hid_field_t field[SIM_HID_MAX_FIELDS];
+  uint16_t bits[SIM_HID_MAX_REPORT_IDS][3];
+} sim_hid_layout_t;
+
+/* Emulated flash operations */
+typedef struct
+{
+  uint32_t programs;                          /* words */
+  uint32_t erases[2];                         /* per store sector */
+  uint32_t conflicts;                         /* programs that needed a bit set */
+} sim_flash_stats_t;
+
+/* What the macro builder made of a source */
+typedef struct
+{
+  uint32_t macros;
+  uint32_t raw_size;                          /* bytecode before compression */
+  uint32_t image_size;
+  uint32_t pairs;                             /* pair codes in use */
+  uint32_t offset[SIM_MACRO_MAX + 1U];        /* bytecode of each macro, then the end */
+} sim_macro_info_t;
+
+/* One step of a macro as the host sees it */
+typedef struct
+{
+  uint8_t        type;                        /* SIM_MACRO_EDGE or SIM_MACRO_TEXT */
+  uint8_t        usage;
+  uint8_t        down;
+  uint32_t       gap_ms;                      /* delay before it */
+  const uint8_t *text;
+  uint32_t       text_len;
+} sim_macro_event_t;
+
+/* Key changes of the script and the failures of every check */
+typedef struct
+{
+  uint64_t pending[SIM_PENDING_SIZE];   /* change times awaiting a report */
+  uint32_t pending_head;
+  uint32_t pending_tail;
+  uint32_t changes;
+  uint32_t reports;
+  uint32_t unexpected;
+  uint32_t duplicates;
+  uint32_t failures;
+  uint64_t latency_min;
+  uint64_t latency_max;
+  uint64_t latency_sum;
+  uint32_t latency_count;
+  uint64_t last_report_us;
+  uint8_t  in_burst;
+  uint8_t  last_report[64];
+  int32_t  last_len;
+} sim_stats_t;
+
+typedef uint16_t (*sim_kbd_encoder_t)(const hid_key_state_t *state, uint8_t *report);
+
+/* Exported variables --------------------------------------------------------*/
+extern sim_host_device_t sim_device;
+extern sim_stats_t sim_stats;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/* Report descriptor parser */
+int32_t sim_hid_parse(const uint8_t *desc, uint32_t len, sim_hid_layout_t *layout);
+uint32_t sim_hid_report_len(const sim_hid_layout_t *layout, uint8_t id, uint8_t type);
+int32_t sim_hid_decode(const sim_hid_layout_t *layout, uint8_t type, const uint8_t *report,
+                       uint32_t len, uint32_t *usage, uint32_t max);
+
+/* Host keyboard layouts, indexed like kbd_layout_id_t */
+uint32_t sim_keymap_count(void);
+const char *sim_keymap_name(uint8_t layout);
+int32_t sim_keymap_press(uint8_t layout, uint8_t usage, uint8_t modifiers, uint32_t *dead, uint32_t *codepoint);
+uint32_t sim_keymap_chars(uint8_t layout, uint32_t *codepoints, uint32_t max);
+uint32_t sim_utf8_encode(uint32_t codepoint, char *out);
+
+/* Macro assembler, image builder and expected events */
+int32_t sim_macro_build(const char *source, uint8_t *image, uint32_t max, uint8_t *code, sim_macro_info_t *info);
+int32_t sim_macro_expect(const uint8_t *code, uint32_t len, sim_macro_event_t *events, uint32_t max);
+
+/* Emulated flash of the configuration store */
+void sim_flash_init(void);
+void sim_flash_power_cut(uint32_t ops, jmp_buf *jmp, uint32_t seed);
+void sim_flash_save(uint8_t *dst);
+void sim_flash_restore(const uint8_t *src);
+void sim_flash_get_stats(sim_flash_stats_t *stats);
+
+/* Firmware start-up, main loop step and key inputs */
+void sim_firmware_init(void);
+int32_t sim_firmware_step(const sim_host_device_t *dev, uint8_t *report, uint32_t max);
+int32_t sim_firmware_key(const char *key, uint8_t pressed);
+
+/* Virtual clock, drives uwTick */
+uint64_t sim_clock_us(void);
+void sim_clock_advance(uint32_t us);
+
+/* STOP mode and its wake-up lines */
+void sim_power_wake(void);
+uint8_t sim_power_stopped(void);
+uint32_t sim_power_clock_configs(void);
+
+/* Inputs: PA0 and the key matrix */
+void sim_gpio_set_input(GPIO_TypeDef *port, uint16_t pin, uint8_t level);
+void sim_matrix_set_key(uint32_t key, uint8_t pressed);
+void sim_matrix_scan_tick(void);
+
+/* Virtual PCD, host side of the bus */
+void sim_pcd_bus_reset(void);
+void sim_pcd_sof(void);
+int32_t sim_pcd_setup(const uint8_t *setup);
+int32_t sim_pcd_in(uint8_t ep_addr, uint8_t *data, uint32_t max);
+int32_t sim_pcd_out(uint8_t ep_addr, const uint8_t *data, uint32_t len);
+uint8_t sim_pcd_get_address(void);
+void sim_pcd_suspend(void);
+void sim_pcd_resume(void);
+uint8_t sim_pcd_remote_wakeup(uint64_t *start_us, uint64_t *len_us);
+void sim_pcd_get_fifo(usb_fifo_plan_t *plan);
+uint32_t sim_pcd_driver_calls(void);
+
+/* Emulated OTG_FS data FIFOs under the target's USB_WritePacket() and USB_ReadPacket() */
+#define SIM_OTG_QUEUE_WORDS       1024U
+int32_t sim_otg_init(void);
+uint32_t sim_otg_write_packet(uint8_t ep, const uint8_t *src, uint16_t len, uint8_t reference, uint8_t *fifo,
+                              uint32_t *wrong);
+uint32_t sim_otg_read_packet(const uint8_t *rx, uint32_t rx_words, uint8_t *dest, uint16_t len,
+                             uint8_t reference, uint32_t *end, uint32_t *wrong);
+
+/* Scripted USB host */
+int32_t sim_host_control(uint8_t bm_request, uint8_t request, uint16_t value, uint16_t index,
+                         uint8_t *data, uint16_t length);
+int32_t sim_host_enumerate(sim_host_device_t *dev);
+uint32_t sim_host_enum_steps(const sim_host_step_t **steps);
+int32_t sim_host_frame(const sim_host_device_t *dev, uint8_t *report, uint32_t max);
+int32_t sim_host_out_report(const sim_host_device_t *dev, const uint8_t *report, uint32_t len);
+int32_t sim_host_bulk_in(const sim_host_device_t *dev, uint8_t *data, uint32_t max);
+int32_t sim_host_bulk_out(const sim_host_device_t *dev, const uint8_t *data, uint32_t len);
+void sim_host_suspend(void);
+void sim_host_resume(void);
+uint8_t sim_host_bus_active(void);
+
+/* Script runner */
+void sim_run_us(uint64_t us);
+
+/* Checks, in the order main() runs them */
+void sim_enum_check(void);
+void sim_descriptor_check(void);
+void sim_string_check(void);
+void sim_fifo_check(void);
+void sim_otg_check(void);
+void sim_encoder_check(void);
+void sim_matrix_check(void);
+void sim_debounce_check(void);
+void sim_latency_trace_check(void);
+void sim_console_check(void);
+void sim_typing_check(void);
+void sim_layout_check(void);
+void sim_macro_check(void);
+void sim_store_check(void);
+void sim_overflow_check(void);
+void sim_queue_check(void);
+void sim_controls_check(void);
+void sim_idle_check(void);
+void sim_protocol_check(void);
+void sim_report_check(void);
+void sim_power_check(void);
+
+/* Helpers the checks share */
+int32_t sim_layout_select(uint8_t layout);
+void sim_typing_run(const char *text, const char *want, uint8_t interval, uint8_t layout, uint32_t unmapped,
+                    uint32_t invalid);
+uint32_t sim_power_run(const sim_hid_layout_t *layout, uint64_t us, uint32_t usage, uint64_t *found_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SIM_H */
@@ -0,0 +1,158 @@
+/**
+  ******************************************************************************
+  * @file           : stm32f4xx.h
+  * @brief          : Simulator stand-in for the CMSIS device header
+  ******************************************************************************
+  * Only the core intrinsics, GPIO ports, DWT cycle counter and unique ID the
+  * firmware sources touch are provided. CYCCNT follows the virtual clock at
+  * SystemCoreClock. Interrupts are delivered by the simulator between main
+  * loop iterations, so PRIMASK is bookkeeping only: sim_irq_masked() lets the
+  * simulator check that no interrupt is injected while the firmware masks them.
+  * The exclusive monitor is modelled too: while sim_preempt is set, LDREX and
+  * DMB with interrupts enabled call it, and when it reports that it ran an
+  * "interrupt" at that instruction the exception entry clears the monitor.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stddef.h>
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define __IO                      volatile
+#define __I                       volatile const
+#define __weak                    __attribute__((weak))
+#define __PACKED                  __attribute__((packed))
+#define __STATIC_INLINE           static inline
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  __IO uint32_t IDR;
+  __IO uint32_t ODR;
+  __IO uint32_t BSRR;
+} GPIO_TypeDef;
+
+typedef struct
+{
+  __IO uint32_t CTRL;
+  __IO uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+  __IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+/* Exported variables --------------------------------------------------------*/
+extern GPIO_TypeDef sim_gpio[5];
+extern const uint32_t sim_uid[3];
+extern uint32_t sim_primask;
+extern DWT_Type sim_dwt;
+extern CoreDebug_Type sim_core_debug;
+extern uint32_t SystemCoreClock;
+extern uint32_t sim_exclusive;
+extern uint32_t (*sim_preempt)(void);
+
+#define GPIOA                     (&sim_gpio[0])
+#define GPIOB                     (&sim_gpio[1])
+#define GPIOC                     (&sim_gpio[2])
+#define GPIOD                     (&sim_gpio[3])
+#define GPIOE                     (&sim_gpio[4])
+
+#define DWT                       (&sim_dwt)
+#define CoreDebug                 (&sim_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk    (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+/* 96-bit unique device ID, read as three words by usbd_desc.c */
+#define UID_BASE                  ((uintptr_t)sim_uid)
+
+/* Exported functions --------------------------------------------------------*/
+static inline uint32_t __get_PRIMASK(void)
+{
+  return sim_primask;
+}
+
+static inline void __set_PRIMASK(uint32_t primask)
+{
+  sim_primask = primask;
+}
+
+static inline void __disable_irq(void)
+{
+  sim_primask = 1U;
+}
+
+static inline void __enable_irq(void)
+{
+  sim_primask = 0U;
+}
+
+static inline void sim_preempt_point(void)
+{
+  uint32_t (*isr)(void) = sim_preempt;
+
+  if ((sim_primask == 0U) && (isr != NULL))
+  {
+    /* Not nested: the "interrupt" runs with the hook disarmed */
+    sim_preempt = NULL;
+    if (isr() != 0U)
+    {
+      sim_exclusive = 0U;
+    }
+    sim_preempt = isr;
+  }
+}
+
+static inline void __DMB(void)
+{
+  __sync_synchronize();
+  sim_preempt_point();
+}
+
+static inline uint32_t __LDREXW(volatile uint32_t *addr)
+{
+  uint32_t value = *addr;
+
+  sim_exclusive = 1U;
+  sim_preempt_point();
+
+  return value;
+}
+
+static inline uint32_t __STREXW(uint32_t value, volatile uint32_t *addr)
+{
+  if (sim_exclusive == 0U)
+  {
+    return 1U;
+  }
+
+  sim_exclusive = 0U;
+  *addr = value;
+
+  return 0U;
+}
+
+static inline void __CLREX(void)
+{
+  sim_exclusive = 0U;
+}
+
+static inline void __WFI(void)
+{
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM32F4xx_H */
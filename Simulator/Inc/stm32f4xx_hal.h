@@ -0,0 +1,110 @@
+/**
+  ******************************************************************************
+  * @file           : stm32f4xx_hal.h
+  * @brief          : Simulator stand-in for the HAL driver header
+  ******************************************************************************
+  * The tick comes from the simulator's virtual clock, GPIO reads come from the
+  * port IDR values the simulator drives. Flash erase and program act on the
+  * emulated sectors of sim_flash.c. STOP mode and the clock set-up are
+  * modelled by sim_hal.c.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM32F4xx_HAL_H
+#define __STM32F4xx_HAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define GPIO_PIN_0                ((uint16_t)0x0001)
+#define GPIO_PIN_1                ((uint16_t)0x0002)
+#define GPIO_PIN_2                ((uint16_t)0x0004)
+#define GPIO_PIN_3                ((uint16_t)0x0008)
+#define GPIO_PIN_4                ((uint16_t)0x0010)
+#define GPIO_PIN_5                ((uint16_t)0x0020)
+#define GPIO_PIN_6                ((uint16_t)0x0040)
+#define GPIO_PIN_7                ((uint16_t)0x0080)
+#define GPIO_PIN_8                ((uint16_t)0x0100)
+#define GPIO_PIN_9                ((uint16_t)0x0200)
+#define GPIO_PIN_10               ((uint16_t)0x0400)
+#define GPIO_PIN_11               ((uint16_t)0x0800)
+#define GPIO_PIN_12               ((uint16_t)0x1000)
+#define GPIO_PIN_13               ((uint16_t)0x2000)
+#define GPIO_PIN_14               ((uint16_t)0x4000)
+#define GPIO_PIN_15               ((uint16_t)0x8000)
+
+#define UNUSED(X)                 (void)X
+
+#define FLASH_TYPEPROGRAM_WORD    0x00000002U
+#define FLASH_TYPEERASE_SECTORS   0x00000000U
+#define FLASH_VOLTAGE_RANGE_3     0x00000002U
+#define FLASH_FLAG_EOP            0x00000001U
+#define FLASH_FLAG_OPERR          0x00000002U
+#define FLASH_FLAG_WRPERR         0x00000010U
+#define FLASH_FLAG_PGAERR         0x00000020U
+#define FLASH_FLAG_PGPERR         0x00000040U
+#define FLASH_FLAG_PGSERR         0x00000080U
+
+#define PWR_LOWPOWERREGULATOR_ON  0x00000001U
+#define PWR_STOPENTRY_WFI         ((uint8_t)0x01)
+
+#define __HAL_FLASH_CLEAR_FLAG(__FLAG__)  ((void)(__FLAG__))
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  HAL_OK       = 0x00U,
+  HAL_ERROR    = 0x01U,
+  HAL_BUSY     = 0x02U,
+  HAL_TIMEOUT  = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+  GPIO_PIN_RESET = 0U,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+typedef struct
+{
+  void *Instance;
+} DMA_HandleTypeDef;
+
+typedef struct
+{
+  uint32_t TypeErase;
+  uint32_t Banks;
+  uint32_t Sector;
+  uint32_t NbSectors;
+  uint32_t VoltageRange;
+} FLASH_EraseInitTypeDef;
+
+/* Exported variables --------------------------------------------------------*/
+extern __IO uint32_t uwTick;
+
+/* Exported functions --------------------------------------------------------*/
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+HAL_StatusTypeDef HAL_FLASH_Unlock(void);
+HAL_StatusTypeDef HAL_FLASH_Lock(void);
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data);
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError);
+void HAL_PWR_EnterSTOPMode(uint32_t Regulator, uint8_t STOPEntry);
+void HAL_PWREx_EnableFlashPowerDown(void);
+void HAL_SuspendTick(void);
+void HAL_ResumeTick(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM32F4xx_HAL_H */
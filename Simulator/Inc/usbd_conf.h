@@ -0,0 +1,81 @@
+/**
+  ******************************************************************************
+  * @file           : usbd_conf.h
+  * @brief          : USB device library configuration for the simulator build
+  ******************************************************************************
+  * Mirrors USB_DEVICE/Target/usbd_conf.h, keep both in step. The low level
+  * driver behind it is the virtual PCD in sim_pcd.c.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_CONF__H__
+#define __USBD_CONF__H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "main.h"
+#include "log_stream.h"
+
+/* Exported constants --------------------------------------------------------*/
+#ifndef USBD_CDC_CONSOLE
+#define USBD_CDC_CONSOLE            1U
+#endif /* USBD_CDC_CONSOLE */
+#if (USBD_CDC_CONSOLE == 1U)
+#define USE_USBD_COMPOSITE
+#define USBD_MAX_SUPPORTED_CLASS    2U
+#define USBD_CMPSIT_ACTIVATE_HID    1U
+#define USBD_CMPSIT_ACTIVATE_CDC    1U
+#define USBD_MAX_NUM_INTERFACES     3U
+#define USBD_DEBUG_LEVEL            2U
+#else
+#define USBD_MAX_NUM_INTERFACES     1U
+#define USBD_DEBUG_LEVEL            0U
+#endif /* USBD_CDC_CONSOLE */
+#define USBD_MAX_NUM_CONFIGURATION  1U
+#define USBD_MAX_STR_DESC_SIZ       512U
+#define USBD_LPM_ENABLED            0U
+#define USBD_SELF_POWERED           1U
+#define HID_FS_BINTERVAL            0x1U
+
+#define DEVICE_FS                   0
+#define DEVICE_HS                   1
+
+/* Exported macro ------------------------------------------------------------*/
+#define USBD_malloc                 (void *)USBD_static_malloc
+#define USBD_free                   USBD_static_free
+#define USBD_memset                 memset
+#define USBD_memcpy                 memcpy
+#define USBD_Delay                  HAL_Delay
+
+#if (USBD_DEBUG_LEVEL > 0)
+#define USBD_UsrLog(...)            (void)log_line("", __VA_ARGS__);
+#else
+#define USBD_UsrLog(...)
+#endif /* (USBD_DEBUG_LEVEL > 0U) */
+#if (USBD_DEBUG_LEVEL > 1)
+#define USBD_ErrLog(...)            (void)log_line("ERROR: ", __VA_ARGS__);
+#else
+#define USBD_ErrLog(...)
+#endif /* (USBD_DEBUG_LEVEL > 1U) */
+#if (USBD_DEBUG_LEVEL > 2)
+#define USBD_DbgLog(...)            (void)log_line("DEBUG : ", __VA_ARGS__);
+#else
+#define USBD_DbgLog(...)
+#endif /* (USBD_DEBUG_LEVEL > 2U) */
+
+/* Exported functions --------------------------------------------------------*/
+void *USBD_static_malloc(uint32_t size);
+void USBD_static_free(void *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_CONF__H__ */
@@ -0,0 +1,378 @@
+/**
+  ******************************************************************************
+  * @file           : sim_console_check.c
+  * @brief          : HID reports under a CDC console log flood
+  ******************************************************************************
+  * When the device has a CDC console, the host opens it and runs the same
+  * key burst twice, the second time under a log flood: the main loop and
+  * interrupts preempting it at every LDREX and DMB of the log writer queue
+  * numbered lines while the host drains the bulk IN endpoint slower than
+  * they come. The HID reports must be identical in content and timing,
+  * every console line whole, and every missing line counted as dropped.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "log_stream.h"
+#include "usbd_cdc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_CONSOLE_TAPS          100U
+#define SIM_CONSOLE_TAP_MS        2U
+#define SIM_CONSOLE_REPORTS       256U
+#define SIM_CONSOLE_PACKETS       1U      /* bulk IN packets read per frame */
+#define SIM_CONSOLE_SIZE          (256U * 1024U)
+
+/* Private typedef -----------------------------------------------------------*/
+/* HID reports of one console phase, time relative to the phase start */
+typedef struct
+{
+  uint32_t count;
+  uint64_t time_us[SIM_CONSOLE_REPORTS];
+  uint8_t  len[SIM_CONSOLE_REPORTS];
+  uint8_t  data[SIM_CONSOLE_REPORTS][16];
+} sim_console_reports_t;
+
+/* Numbered lines of one flood writer: the thread or the preempting interrupt */
+typedef struct
+{
+  uint32_t written;            /* lines attempted */
+  uint32_t dropped;            /* log_line() returned 0 */
+  uint32_t received;
+  uint32_t gaps;               /* numbers missing on the host side */
+  int64_t  last;               /* last number received, -1 before the first */
+} sim_console_source_t;
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t sim_console[SIM_CONSOLE_SIZE];
+static uint32_t sim_console_len;
+static sim_console_source_t sim_console_src[2];
+static uint32_t sim_console_preemptions;
+static sim_console_reports_t sim_console_ref;
+static sim_console_reports_t sim_console_flood;
+
+/* Private function prototypes -----------------------------------------------*/
+static void sim_console_phase(sim_console_reports_t *reports, uint8_t flood);
+static uint32_t sim_console_preempt(void);
+static void sim_console_read(uint32_t packets);
+static void sim_console_parse(void);
+
+/**
+  * @brief  Open the console and check the HID path against a log flood.
+  * @retval None
+  */
+void sim_console_check(void)
+{
+  static const uint8_t line_coding[7] = { 0x00U, 0xC2U, 0x01U, 0x00U, 0x00U, 0x00U, 0x08U };
+  uint8_t readback[7];
+  log_stats_t before;
+  log_stats_t after;
+  uint32_t i;
+
+  if (sim_device.cdc_in == 0U)
+  {
+    return;
+  }
+
+  /* Open the port the way a terminal does: line coding, then DTR */
+  if ((sim_host_control(0x21U, CDC_SET_LINE_CODING, 0U, sim_device.cdc_if, (uint8_t *)line_coding,
+                        sizeof(line_coding)) < 0) ||
+      (sim_host_control(0xA1U, CDC_GET_LINE_CODING, 0U, sim_device.cdc_if, readback,
+                        sizeof(readback)) != (int32_t)sizeof(readback)) ||
+      (memcmp(readback, line_coding, sizeof(readback)) != 0) ||
+      (sim_host_control(0x21U, CDC_SET_CONTROL_LINE_STATE, CDC_CONTROL_LINE_DTR, sim_device.cdc_if,
+                        NULL, 0U) < 0))
+  {
+    printf("sim: console did not open\n");
+    sim_stats.failures++;
+    return;
+  }
+
+  /* What was logged while the port was closed */
+  for (i = 0U; i < 100U; i++)
+  {
+    sim_run_us(SIM_FRAME_US);
+    sim_console_read(8U);
+  }
+
+  sim_console_phase(&sim_console_ref, 0U);
+  log_get_stats(&before);
+  sim_console_phase(&sim_console_flood, 1U);
+  log_get_stats(&after);
+  sim_console_parse();
+
+  printf("sim: console flood: %lu lines from main, %lu from interrupts, %lu preemptions, %lu dropped\n",
+         (unsigned long)sim_console_src[0].written, (unsigned long)sim_console_src[1].written,
+         (unsigned long)sim_console_preemptions, (unsigned long)(after.dropped - before.dropped));
+
+  if ((sim_console_ref.count == 0U) || (sim_console_ref.count != sim_console_flood.count))
+  {
+    printf("sim: console flood changed the HID reports: %lu without, %lu with\n",
+           (unsigned long)sim_console_ref.count, (unsigned long)sim_console_flood.count);
+    sim_stats.failures++;
+  }
+  else
+  {
+    for (i = 0U; i < sim_console_ref.count; i++)
+    {
+      if ((sim_console_ref.time_us[i] != sim_console_flood.time_us[i]) ||
+          (sim_console_ref.len[i] != sim_console_flood.len[i]) ||
+          (memcmp(sim_console_ref.data[i], sim_console_flood.data[i], sim_console_ref.len[i]) != 0))
+      {
+        printf("sim: console flood changed HID report %lu\n", (unsigned long)i);
+        sim_stats.failures++;
+        break;
+      }
+    }
+  }
+
+  for (i = 0U; i < 2U; i++)
+  {
+    if ((sim_console_src[i].gaps != sim_console_src[i].dropped) ||
+        ((sim_console_src[i].received + sim_console_src[i].dropped) != sim_console_src[i].written))
+    {
+      printf("sim: console %s lines: %lu written, %lu received, %lu dropped, %lu missing\n",
+             (i == 0U) ? "main" : "interrupt", (unsigned long)sim_console_src[i].written,
+             (unsigned long)sim_console_src[i].received, (unsigned long)sim_console_src[i].dropped,
+             (unsigned long)sim_console_src[i].gaps);
+      sim_stats.failures++;
+    }
+  }
+
+  if ((sim_console_src[0].dropped == 0U) || (sim_console_src[1].written == 0U) ||
+      ((after.dropped - before.dropped) < (sim_console_src[0].dropped + sim_console_src[1].dropped)))
+  {
+    printf("sim: console flood did not overrun the log or lost count of the drops\n");
+    sim_stats.failures++;
+  }
+}
+
+/**
+  * @brief  Tap keys and record the HID reports, optionally under a log flood.
+  * @note   The phase starts on a polling interval boundary so that both
+  *         phases see the same frame timing.
+  * @param  reports: filled with the reports the host received
+  * @param  flood: 0 for the reference run
+  * @retval None
+  */
+static void sim_console_phase(sim_console_reports_t *reports, uint8_t flood)
+{
+  uint64_t period = (uint64_t)sim_device.interval * SIM_FRAME_US;
+  uint64_t start;
+  uint64_t end;
+  uint8_t report[64];
+  char key[8];
+  uint32_t tap = 0U;
+  int32_t len;
+
+  sim_run_us((uint64_t)SIM_DRAIN_MS * 1000U);
+  while ((sim_clock_us() % period) != 0U)
+  {
+    (void)sim_firmware_step(&sim_device, report, sizeof(report));
+  }
+  sim_console_read(64U);
+
+  memset(reports, 0, sizeof(*reports));
+  start = sim_clock_us();
+  end = start + ((uint64_t)(SIM_CONSOLE_TAPS * SIM_CONSOLE_TAP_MS + SIM_DRAIN_MS) * 1000U);
+
+  while (sim_clock_us() < end)
+  {
+    if (((sim_clock_us() - start) % ((uint64_t)SIM_CONSOLE_TAP_MS * 1000U) == 0U) && (tap <= SIM_CONSOLE_TAPS))
+    {
+      if (tap != 0U)
+      {
+        (void)snprintf(key, sizeof(key), "%lu", (unsigned long)((tap - 1U) % MATRIX_KEYS));
+        (void)sim_firmware_key(key, 0U);
+      }
+      if (tap < SIM_CONSOLE_TAPS)
+      {
+        (void)snprintf(key, sizeof(key), "%lu", (unsigned long)(tap % MATRIX_KEYS));
+        (void)sim_firmware_key(key, 1U);
+      }
+      tap++;
+    }
+
+    if (flood != 0U)
+    {
+      /* Main loop writer, preempted by interrupt writers */
+      sim_preempt = sim_console_preempt;
+      if (log_line("T", "%lu", (unsigned long)sim_console_src[0].written) == 0U)
+      {
+        sim_console_src[0].dropped++;
+      }
+      sim_console_src[0].written++;
+      sim_preempt = NULL;
+    }
+
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+    if ((len > 0) && (reports->count < SIM_CONSOLE_REPORTS))
+    {
+      reports->time_us[reports->count] = sim_clock_us() - start;
+      reports->len[reports->count] = (uint8_t)MIN((uint32_t)len, sizeof(reports->data[0]));
+      memcpy(reports->data[reports->count], report, reports->len[reports->count]);
+      reports->count++;
+    }
+
+    if ((sim_clock_us() % SIM_FRAME_US) == 0U)
+    {
+      sim_console_read(SIM_CONSOLE_PACKETS);
+    }
+  }
+
+  /* Everything queued reaches the host once the flood stops */
+  for (tap = 0U; tap < 200U; tap++)
+  {
+    sim_run_us(SIM_FRAME_US);
+    sim_console_read(8U);
+  }
+}
+
+/**
+  * @brief  Preemption hook of the flood: an interrupt that logs a line and,
+  *         now and then, completes a bulk IN transfer.
+  * @note   Runs at two out of three opportunities so that the writer's
+  *         LDREX/STREX retry loop, which meets a new LDREX on every retry,
+  *         still makes progress.
+  * @retval 1 when the "interrupt" was taken
+  */
+static uint32_t sim_console_preempt(void)
+{
+  static uint32_t opportunity;
+
+  opportunity++;
+  if ((opportunity % 3U) == 0U)
+  {
+    return 0U;
+  }
+
+  sim_console_preemptions++;
+  if (log_line("I", "%lu", (unsigned long)sim_console_src[1].written) == 0U)
+  {
+    sim_console_src[1].dropped++;
+  }
+  sim_console_src[1].written++;
+
+  /* The reader meets records reserved but not yet published */
+  if ((opportunity % 5U) == 0U)
+  {
+    sim_console_read(1U);
+  }
+
+  return 1U;
+}
+
+/**
+  * @brief  Read bulk IN packets from the console into the host buffer.
+  * @param  packets: packets to read at most
+  * @retval None
+  */
+static void sim_console_read(uint32_t packets)
+{
+  uint8_t packet[CDC_DATA_FS_MAX_PACKET_SIZE];
+  int32_t len;
+
+  while (packets-- != 0U)
+  {
+    len = sim_host_bulk_in(&sim_device, packet, sizeof(packet));
+    if (len < 0)
+    {
+      printf("sim: console bulk IN failed (%ld)\n", (long)len);
+      sim_stats.failures++;
+      return;
+    }
+    if (len == 0)
+    {
+      return;
+    }
+    if ((sim_console_len + (uint32_t)len) > sizeof(sim_console))
+    {
+      printf("sim: console output too long\n");
+      sim_stats.failures++;
+      return;
+    }
+    memcpy(&sim_console[sim_console_len], packet, (size_t)len);
+    sim_console_len += (uint32_t)len;
+  }
+}
+
+/**
+  * @brief  Split the console output into lines and account for the flood.
+  * @note   Flood lines are "T<n>" or "I<n>", numbered per writer; other lines
+  *         must be metrics or library messages.
+  * @retval None
+  */
+static void sim_console_parse(void)
+{
+  sim_console_source_t *src;
+  char line[LOG_LINE_MAX + 1U];
+  uint32_t start = 0U;
+  uint32_t pos;
+  uint32_t len;
+  char *end;
+  unsigned long seq;
+
+  sim_console_src[0].last = -1;
+  sim_console_src[1].last = -1;
+
+  for (pos = 0U; pos < sim_console_len; pos++)
+  {
+    if (sim_console[pos] != '\n')
+    {
+      continue;
+    }
+
+    len = pos - start;
+    if (len >= sizeof(line))
+    {
+      printf("sim: console line at byte %lu too long\n", (unsigned long)start);
+      sim_stats.failures++;
+      return;
+    }
+    memcpy(line, &sim_console[start], len);
+    line[len] = '\0';
+    start = pos + 1U;
+
+    if ((line[0] == 'T') || (line[0] == 'I'))
+    {
+      src = &sim_console_src[(line[0] == 'T') ? 0U : 1U];
+      seq = strtoul(&line[1], &end, 10);
+      if ((end == &line[1]) || (*end != '\0') || ((int64_t)seq <= src->last))
+      {
+        printf("sim: console line \"%s\" malformed or out of order\n", line);
+        sim_stats.failures++;
+        return;
+      }
+      src->gaps += (uint32_t)((int64_t)seq - src->last - 1);
+      src->last = (int64_t)seq;
+      src->received++;
+    }
+    else if ((strncmp(line, "metrics: ", 9U) != 0) && (strncmp(line, "ERROR: ", 7U) != 0))
+    {
+      printf("sim: console line \"%s\" malformed\n", line);
+      sim_stats.failures++;
+      return;
+    }
+    else
+    {
+      /* Metrics and library messages */
+    }
+  }
+
+  if (start != sim_console_len)
+  {
+    printf("sim: console output ends in a partial line\n");
+    sim_stats.failures++;
+  }
+
+  /* Lines dropped after the last one received */
+  for (pos = 0U; pos < 2U; pos++)
+  {
+    src = &sim_console_src[pos];
+    src->gaps += (uint32_t)((int64_t)src->written - src->last - 1);
+  }
+}
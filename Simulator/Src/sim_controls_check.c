@@ -0,0 +1,124 @@
+/**
+  ******************************************************************************
+  * @file           : sim_controls_check.c
+  * @brief          : Consumer and system controls behind a full keyboard queue
+  ******************************************************************************
+  * Consumer and system controls sent behind a full keyboard queue must be
+  * taken, and reach the host first, in order and at their own lengths.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "hid_controls.h"
+#include "usbd_hid.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_CONTROLS_TAPS         12U     /* more edges than the keyboard queue holds */
+#define SIM_CONTROLS_REPORTS      4U      /* consumer and system press, then release */
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+/**
+  * @brief  Send consumer and system controls behind a full keyboard queue.
+  * @note   With the host no longer polling, key taps fill the normal
+  *         priority queue; the control reports must still be taken and,
+  *         once polling resumes, reach the host ahead of every keyboard
+  *         report but the one already armed on the endpoint, in the order
+  *         sent and with their declared lengths.
+  * @retval None
+  */
+void sim_controls_check(void)
+{
+  static const uint8_t want[SIM_CONTROLS_REPORTS][HID_CONSUMER_REPORT_SIZE] =
+  {
+    { HID_CONSUMER_REPORT_ID, (uint8_t)(HID_CONSUMER_VOLUME_UP & 0xFFU), (uint8_t)(HID_CONSUMER_VOLUME_UP >> 8) },
+    { HID_SYSTEM_REPORT_ID, (uint8_t)(1U << (HID_SYSTEM_SLEEP - HID_SYSTEM_POWER_DOWN)), 0U },
+    { HID_CONSUMER_REPORT_ID, 0U, 0U },
+    { HID_SYSTEM_REPORT_ID, 0U, 0U },
+  };
+  uint32_t failures = sim_stats.failures;
+  sim_host_device_t stalled = sim_device;
+  uint32_t controls = 0U;
+  uint32_t keys_before = 0U;
+  uint32_t keys = 0U;
+  uint32_t depth;
+  uint32_t want_len;
+  uint64_t end;
+  uint8_t status[SIM_CONTROLS_REPORTS];
+  uint8_t report[64];
+  char key[8];
+  int32_t len;
+  uint32_t i;
+
+  (void)sim_power_run(NULL, (uint64_t)SIM_DRAIN_MS * 1000U, 0U, NULL);
+
+  /* Frames go on, the interrupt IN endpoint is not polled */
+  stalled.interval = 0U;
+  for (i = 0U; i < (2U * SIM_CONTROLS_TAPS); i++)
+  {
+    (void)snprintf(key, sizeof(key), "%lu", (unsigned long)(i / 2U));
+    (void)sim_firmware_key(key, ((i & 1U) == 0U) ? 1U : 0U);
+    end = sim_clock_us() + ((uint64_t)SIM_QUEUE_TAP_MS * 1000U);
+    while (sim_clock_us() < end)
+    {
+      (void)sim_firmware_step(&stalled, report, sizeof(report));
+    }
+  }
+  depth = USBD_HID_GetQueueDepth(&hUsbDeviceFS);
+  status[0] = hid_consumer_press(HID_CONSUMER_VOLUME_UP);
+  status[1] = hid_system_press(HID_SYSTEM_SLEEP);
+  status[2] = hid_consumer_release();
+  status[3] = hid_system_release(HID_SYSTEM_SLEEP);
+  for (i = 0U; i < SIM_CONTROLS_REPORTS; i++)
+  {
+    if (status[i] != (uint8_t)USBD_OK)
+    {
+      printf("sim: controls: report %lu refused behind %lu keyboard reports\n", (unsigned long)i,
+             (unsigned long)depth);
+      sim_stats.failures++;
+    }
+  }
+
+  /* Polling again: the controls first, in order, then the keyboard reports */
+  end = sim_clock_us() + ((uint64_t)SIM_QUEUE_TIMEOUT_MS * 1000U);
+  while (sim_clock_us() < end)
+  {
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+    if (len <= 0)
+    {
+      continue;
+    }
+    if ((report[0] != HID_CONSUMER_REPORT_ID) && (report[0] != HID_SYSTEM_REPORT_ID))
+    {
+      keys++;
+      keys_before += (controls < SIM_CONTROLS_REPORTS) ? 1U : 0U;
+      continue;
+    }
+    want_len = (report[0] == HID_CONSUMER_REPORT_ID) ? HID_CONSUMER_REPORT_SIZE : HID_SYSTEM_REPORT_SIZE;
+    if ((controls >= SIM_CONTROLS_REPORTS) || (len != (int32_t)want_len) ||
+        (memcmp(report, want[controls], want_len) != 0))
+    {
+      printf("sim: controls: report %lu is %ld bytes of report ID %u, not the one sent\n",
+             (unsigned long)controls, (long)len, report[0]);
+      sim_stats.failures++;
+    }
+    controls++;
+  }
+
+  if ((depth != HID_REPORT_QUEUE_SIZE) || (controls != SIM_CONTROLS_REPORTS) || (keys_before > 1U) ||
+      (keys != (2U * SIM_CONTROLS_TAPS)))
+  {
+    printf("sim: controls: %lu keyboard reports queued, %lu controls received after %lu keyboard reports, "
+           "%lu keyboard reports in all\n", (unsigned long)depth, (unsigned long)controls,
+           (unsigned long)keys_before, (unsigned long)keys);
+    sim_stats.failures++;
+  }
+
+  printf("sim: controls: %lu consumer and system reports overtook %lu queued keyboard reports%s\n",
+         (unsigned long)controls, (unsigned long)depth,
+         (sim_stats.failures != failures) ? " (FAILED)" : "");
+}
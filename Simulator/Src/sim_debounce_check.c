@@ -0,0 +1,224 @@
+/**
+  ******************************************************************************
+  * @file           : sim_debounce_check.c
+  * @brief          : Debounce modes over bouncing and noisy key corpora
+  ******************************************************************************
+  * Every debounce mode is run over a corpus of bouncing keys, and over the
+  * same with single-scan glitches, reporting press and release latency and
+  * false triggers.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "keyboard.h"
+#include "debounce.h"
+#include "matrix_scan.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_DEBOUNCE_KEYS         32U     /* one bitmap word */
+#define SIM_DEBOUNCE_SCANS        (20U * MATRIX_SCAN_HZ)
+#define SIM_DEBOUNCE_THRESHOLD    ((KEYBOARD_DEBOUNCE_MS * MATRIX_SCAN_HZ) / 1000U)
+#define SIM_DEBOUNCE_BOUNCE       ((3U * MATRIX_SCAN_HZ) / 1000U)   /* contact bounce, up to 3 ms */
+#define SIM_DEBOUNCE_GAP_MIN      ((20U * MATRIX_SCAN_HZ) / 1000U)  /* between edges of a key */
+#define SIM_DEBOUNCE_GAP_SPAN     ((100U * MATRIX_SCAN_HZ) / 1000U)
+#define SIM_DEBOUNCE_GLITCH       4000U   /* one scan in this many reads wrong in the noisy corpus */
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t sim_debounce_raw[SIM_DEBOUNCE_SCANS];            /* bit k: key k as sampled */
+static uint32_t sim_debounce_true[SIM_DEBOUNCE_SCANS];           /* bit k: key k without bounce */
+
+/* Private function prototypes -----------------------------------------------*/
+static void sim_debounce_corpus(uint8_t noisy);
+static void sim_debounce_run(const char *corpus, uint8_t noisy, debounce_mode_t mode);
+
+/**
+  * @brief  Run every debounce mode over a bouncy and a noisy key corpus.
+  * @note   Latency is counted from the first scan of an edge to the
+  *         debounced change, false triggers are debounced changes away from
+  *         the key's true level. No edge may be missed; on the bouncy corpus
+  *         no mode may trigger falsely, on the noisy one only an eager press.
+  * @retval None
+  */
+void sim_debounce_check(void)
+{
+  static const char *const corpus[2] = { "bouncy", "noisy" };
+  uint8_t noisy;
+  uint8_t mode;
+
+  for (noisy = 0U; noisy < 2U; noisy++)
+  {
+    sim_debounce_corpus(noisy);
+    for (mode = (uint8_t)DEBOUNCE_EAGER; mode <= (uint8_t)DEBOUNCE_INTEGRATOR; mode++)
+    {
+      sim_debounce_run(corpus[noisy], noisy, (debounce_mode_t)mode);
+    }
+  }
+}
+
+/**
+  * @brief  Build the key corpus: every key goes up and down at random, each
+  *         edge bouncing for up to SIM_DEBOUNCE_BOUNCE scans.
+  * @param  noisy: also read a key wrong for single scans between its edges
+  * @retval None
+  */
+static void sim_debounce_corpus(uint8_t noisy)
+{
+  uint32_t seed = (noisy != 0U) ? 0x6E6F6973U : 0x626F756EU;
+  uint32_t next_edge;
+  uint32_t bounce_end;
+  uint32_t toggle;
+  uint32_t scan;
+  uint32_t key;
+  uint8_t level;
+  uint8_t raw;
+
+  memset(sim_debounce_raw, 0, sizeof(sim_debounce_raw));
+  memset(sim_debounce_true, 0, sizeof(sim_debounce_true));
+
+  for (key = 0U; key < SIM_DEBOUNCE_KEYS; key++)
+  {
+    level = 0U;
+    raw = 0U;
+    bounce_end = 0U;
+    toggle = 0U;
+    seed = (seed * 1664525U) + 1013904223U;
+    next_edge = SIM_DEBOUNCE_GAP_MIN + ((seed >> 8) % SIM_DEBOUNCE_GAP_SPAN);
+
+    for (scan = 0U; scan < SIM_DEBOUNCE_SCANS; scan++)
+    {
+      seed = (seed * 1664525U) + 1013904223U;
+      if (scan == next_edge)
+      {
+        /* The contact closes or opens, then bounces */
+        level ^= 1U;
+        raw = level;
+        bounce_end = scan + ((seed >> 8) % (SIM_DEBOUNCE_BOUNCE + 1U));
+        toggle = scan + 1U + ((seed >> 20) % 4U);
+        seed = (seed * 1664525U) + 1013904223U;
+        next_edge = scan + SIM_DEBOUNCE_GAP_MIN + ((seed >> 8) % SIM_DEBOUNCE_GAP_SPAN);
+        /* Every edge settles before the end */
+        if (next_edge >= (SIM_DEBOUNCE_SCANS - SIM_DEBOUNCE_GAP_MIN))
+        {
+          next_edge = UINT32_MAX;
+        }
+      }
+      else if (scan < bounce_end)
+      {
+        if (scan == toggle)
+        {
+          raw ^= 1U;
+          toggle = scan + 1U + ((seed >> 20) % 4U);
+        }
+      }
+      else
+      {
+        raw = level;
+        if ((noisy != 0U) && (((seed >> 8) % SIM_DEBOUNCE_GLITCH) == 0U))
+        {
+          raw ^= 1U;
+        }
+      }
+
+      sim_debounce_raw[scan] |= (uint32_t)raw << key;
+      sim_debounce_true[scan] |= (uint32_t)level << key;
+    }
+  }
+}
+
+/**
+  * @brief  Debounce the corpus in one mode and report latency and false triggers.
+  * @param  corpus: corpus name
+  * @param  noisy: corpus has single scan glitches
+  * @param  mode: debounce mode
+  * @retval None
+  */
+static void sim_debounce_run(const char *corpus, uint8_t noisy, debounce_mode_t mode)
+{
+  static const char *const names[3] = { "eager", "defer", "integrator" };
+  uint32_t raw[DEBOUNCE_WORDS] = {0};
+  uint32_t changed[DEBOUNCE_WORDS];
+  uint32_t start[SIM_DEBOUNCE_KEYS] = {0};
+  uint64_t sum[2] = { 0U, 0U };                  /* release, press */
+  uint32_t max[2] = { 0U, 0U };
+  uint32_t count[2] = { 0U, 0U };
+  uint32_t false_edges[2] = { 0U, 0U };
+  uint32_t edges = 0U;
+  uint32_t missed = 0U;
+  uint32_t waiting = 0U;                         /* keys whose true edge is not debounced yet */
+  uint32_t prev = 0U;
+  uint32_t truth;
+  uint32_t latency;
+  uint32_t scan;
+  uint32_t key;
+  uint32_t down;
+  debounce_t db;
+
+  debounce_init(&db, mode, (uint8_t)SIM_DEBOUNCE_THRESHOLD, raw);
+
+  for (scan = 0U; scan < SIM_DEBOUNCE_SCANS; scan++)
+  {
+    truth = sim_debounce_true[scan];
+    for (key = 0U; key < SIM_DEBOUNCE_KEYS; key++)
+    {
+      if ((((truth ^ prev) >> key) & 1U) != 0U)
+      {
+        /* Not waited for when a false trigger got there first */
+        edges++;
+        missed += (waiting >> key) & 1U;
+        waiting &= ~(1UL << key);
+        waiting |= (db.state[0] ^ truth) & (1UL << key);
+        start[key] = scan;
+      }
+    }
+    prev = truth;
+
+    raw[0] = sim_debounce_raw[scan];
+    if (debounce_update(&db, raw, changed) == 0U)
+    {
+      continue;
+    }
+    for (key = 0U; key < SIM_DEBOUNCE_KEYS; key++)
+    {
+      if (((changed[0] >> key) & 1U) == 0U)
+      {
+        continue;
+      }
+      down = (db.state[0] >> key) & 1U;
+      if (down != ((truth >> key) & 1U))
+      {
+        false_edges[down]++;
+      }
+      else if (((waiting >> key) & 1U) != 0U)
+      {
+        waiting &= ~(1UL << key);
+        latency = scan - start[key];
+        sum[down] += latency;
+        count[down]++;
+        if (latency > max[down])
+        {
+          max[down] = latency;
+        }
+      }
+    }
+  }
+  missed += (uint32_t)__builtin_popcount(waiting);
+
+  printf("sim: debounce %s %s: press us avg %llu max %lu, release us avg %llu max %lu, "
+         "%lu false presses, %lu false releases, %lu of %lu edges missed\n", corpus, names[mode],
+         (unsigned long long)((count[1] != 0U) ? ((sum[1] * SIM_STEP_US) / count[1]) : 0U),
+         (unsigned long)(max[1] * SIM_STEP_US),
+         (unsigned long long)((count[0] != 0U) ? ((sum[0] * SIM_STEP_US) / count[0]) : 0U),
+         (unsigned long)(max[0] * SIM_STEP_US), (unsigned long)false_edges[1], (unsigned long)false_edges[0],
+         (unsigned long)missed, (unsigned long)edges);
+
+  if ((missed != 0U) || (false_edges[0] != 0U) ||
+      ((false_edges[1] != 0U) && ((noisy == 0U) || (mode != DEBOUNCE_EAGER))) ||
+      ((mode == DEBOUNCE_EAGER) && (max[1] != 0U)))
+  {
+    printf("sim: debounce %s %s: edge missed, false trigger or late eager press\n", corpus, names[mode]);
+    sim_stats.failures++;
+  }
+}
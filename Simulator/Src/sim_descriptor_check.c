@@ -0,0 +1,228 @@
+/**
+  ******************************************************************************
+  * @file           : sim_descriptor_check.c
+  * @brief          : Report descriptor against the reports the encoders build
+  ******************************************************************************
+  * The report descriptor the host received is parsed, and every report the
+  * keyboard encoders build and every consumer and system control report is
+  * decoded against it.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "hid_keyboard.h"
+#include "hid_controls.h"
+#include "hid_config.h"
+#include "usbd_hid.h"
+#include "latency_trace.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_DESC_STATES           256U
+
+/* Private function prototypes -----------------------------------------------*/
+static void sim_descriptor_len(const sim_hid_layout_t *layout, uint8_t id, uint8_t type, uint32_t len,
+                               const char *what);
+static void sim_descriptor_kbd(const sim_hid_layout_t *layout, const hid_key_state_t *state,
+                               sim_kbd_encoder_t encode, const char *what);
+static void sim_descriptor_control(const sim_hid_layout_t *layout, uint8_t id, uint32_t usage,
+                                   const char *what);
+
+/**
+  * @brief  Parse the report descriptor the host received and decode every
+  *         report the encoders build against it.
+  * @retval None
+  */
+void sim_descriptor_check(void)
+{
+  static sim_hid_layout_t layout;
+  hid_key_state_t state;
+  uint8_t report[HID_EPIN_SIZE];
+  uint32_t seed = 1U;
+  uint32_t failures = sim_stats.failures;
+  uint32_t reports = 0U;
+  uint32_t max_in = 0U;
+  uint32_t id;
+  uint32_t i;
+  uint32_t k;
+
+  if (sim_hid_parse(sim_device.report_desc, sim_device.report_desc_len, &layout) != 0)
+  {
+    sim_stats.failures++;
+    return;
+  }
+  for (id = 0U; id < SIM_HID_MAX_REPORT_IDS; id++)
+  {
+    for (i = SIM_HID_INPUT; i <= SIM_HID_FEATURE; i++)
+    {
+      if (sim_hid_report_len(&layout, (uint8_t)id, (uint8_t)i) != 0U)
+      {
+        reports++;
+      }
+    }
+    if (sim_hid_report_len(&layout, (uint8_t)id, SIM_HID_INPUT) > max_in)
+    {
+      max_in = sim_hid_report_len(&layout, (uint8_t)id, SIM_HID_INPUT);
+    }
+  }
+
+  /* Lengths: what the host expects against what the firmware sends */
+  hid_key_state_clear(&state);
+  sim_descriptor_len(&layout, HID_KBD_6KRO_REPORT_ID, SIM_HID_INPUT, hid_kbd_encode_6kro(&state, report),
+                     "hid_kbd_encode_6kro()");
+  sim_descriptor_len(&layout, HID_KBD_NKRO_REPORT_ID, SIM_HID_INPUT, hid_kbd_encode_nkro(&state, report),
+                     "hid_kbd_encode_nkro()");
+  sim_descriptor_len(&layout, HID_LED_REPORT_ID, SIM_HID_OUTPUT, HID_LED_REPORT_SIZE, "LED report");
+  sim_descriptor_len(&layout, HID_CONSUMER_REPORT_ID, SIM_HID_INPUT, HID_CONSUMER_REPORT_SIZE, "consumer report");
+  sim_descriptor_len(&layout, HID_SYSTEM_REPORT_ID, SIM_HID_INPUT, HID_SYSTEM_REPORT_SIZE, "system report");
+  sim_descriptor_len(&layout, HID_CONFIG_PARAM_REPORT_ID, SIM_HID_FEATURE, HID_CONFIG_REPORT_SIZE, "hid_config");
+  sim_descriptor_len(&layout, HID_CONFIG_CTRL_REPORT_ID, SIM_HID_FEATURE, HID_CONFIG_REPORT_SIZE, "hid_config");
+  sim_descriptor_len(&layout, LATENCY_TRACE_REPORT_ID, SIM_HID_FEATURE, LATENCY_TRACE_REPORT_SIZE,
+                     "latency_trace");
+  if (max_in > sim_device.ep_in_size)
+  {
+    printf("sim: report descriptor: %lu-byte input report, %u-byte IN endpoint\n",
+           (unsigned long)max_in, sim_device.ep_in_size);
+    sim_stats.failures++;
+  }
+
+  /* Contents: every usage on its own, then random chords of up to 5 keys */
+  for (k = 0U; k <= HID_USAGE_MODIFIER_LAST; k++)
+  {
+    hid_key_state_clear(&state);
+    hid_key_state_set(&state, (uint8_t)k, 1U);
+    sim_descriptor_kbd(&layout, &state, hid_kbd_encode_nkro, "NKRO");
+    sim_descriptor_kbd(&layout, &state, hid_kbd_encode_6kro, "6KRO");
+  }
+  for (i = 0U; i < SIM_DESC_STATES; i++)
+  {
+    hid_key_state_clear(&state);
+    seed = (seed * 1103515245U) + 12345U;
+    state.bits[HID_USAGE_MODIFIER_FIRST >> 5] = (seed >> 8) & 0xFF000000U;
+    for (k = (seed >> 4) % (HID_KBD_6KRO_KEYCODES + 1U); k > 0U; k--)
+    {
+      seed = (seed * 1103515245U) + 12345U;
+      hid_key_state_set(&state, (uint8_t)(HID_USAGE_FIRST_KEY +
+                                          ((seed >> 8) % (HID_USAGE_MODIFIER_FIRST - HID_USAGE_FIRST_KEY))), 1U);
+    }
+    sim_descriptor_kbd(&layout, &state, hid_kbd_encode_nkro, "NKRO");
+    sim_descriptor_kbd(&layout, &state, hid_kbd_encode_6kro, "6KRO");
+  }
+
+  /* Controls go through the firmware and the IN endpoint */
+  (void)hid_consumer_press(HID_CONSUMER_VOLUME_UP);
+  sim_descriptor_control(&layout, HID_CONSUMER_REPORT_ID, 0x000C0000UL | HID_CONSUMER_VOLUME_UP, "consumer press");
+  (void)hid_consumer_release();
+  sim_descriptor_control(&layout, HID_CONSUMER_REPORT_ID, 0U, "consumer release");
+  (void)hid_system_press(HID_SYSTEM_SLEEP);
+  sim_descriptor_control(&layout, HID_SYSTEM_REPORT_ID, 0x00010000UL | HID_SYSTEM_SLEEP, "system press");
+  (void)hid_system_release(HID_SYSTEM_SLEEP);
+  sim_descriptor_control(&layout, HID_SYSTEM_REPORT_ID, 0U, "system release");
+
+  printf("sim: report descriptor: %lu fields, %lu reports, largest input %lu bytes, %s the encoders\n",
+         (unsigned long)layout.fields, (unsigned long)reports, (unsigned long)max_in,
+         (sim_stats.failures == failures) ? "matches" : "differs from");
+}
+
+/**
+  * @brief  Check the length the descriptor declares for one report.
+  * @param  layout: parsed descriptor
+  * @param  id: report ID
+  * @param  type: SIM_HID_INPUT/OUTPUT/FEATURE
+  * @param  len: length the firmware uses
+  * @param  what: firmware side, for the message
+  * @retval None
+  */
+static void sim_descriptor_len(const sim_hid_layout_t *layout, uint8_t id, uint8_t type, uint32_t len,
+                               const char *what)
+{
+  uint32_t declared = sim_hid_report_len(layout, id, type);
+
+  if (declared != len)
+  {
+    printf("sim: report descriptor: report %u type %u is %lu bytes, %s uses %lu\n", id, type,
+           (unsigned long)declared, what, (unsigned long)len);
+    sim_stats.failures++;
+  }
+}
+
+/**
+  * @brief  Encode a key state and check the host decodes the same keys.
+  * @note   Usages below HID_USAGE_FIRST_KEY are never keys in a keycode array.
+  * @param  layout: parsed descriptor
+  * @param  state: pressed usages, at most HID_KBD_6KRO_KEYCODES keys
+  * @param  encode: report encoder
+  * @param  what: encoder name, for the message
+  * @retval None
+  */
+static void sim_descriptor_kbd(const sim_hid_layout_t *layout, const hid_key_state_t *state,
+                               sim_kbd_encoder_t encode, const char *what)
+{
+  uint8_t report[HID_EPIN_SIZE];
+  uint32_t usage[SIM_DESC_USAGES];
+  hid_key_state_t want = *state;
+  hid_key_state_t got;
+  uint16_t len;
+  int32_t n;
+  int32_t i;
+
+  if (encode == hid_kbd_encode_6kro)
+  {
+    want.bits[0] &= ~((1UL << HID_USAGE_FIRST_KEY) - 1UL);
+  }
+
+  len = encode(state, report);
+  n = sim_hid_decode(layout, SIM_HID_INPUT, report, len, usage, SIM_DESC_USAGES);
+  hid_key_state_clear(&got);
+  for (i = 0; (i < n) && (i < (int32_t)SIM_DESC_USAGES); i++)
+  {
+    if ((usage[i] >> 16) != 0x07U)
+    {
+      n = -1;
+      break;
+    }
+    hid_key_state_set(&got, (uint8_t)usage[i], 1U);
+  }
+
+  if ((n < 0) || (memcmp(&got, &want, sizeof(got)) != 0))
+  {
+    printf("sim: report descriptor: %s report of usage bitmap %08lX.. decodes differently\n", what,
+           (unsigned long)want.bits[0]);
+    sim_stats.failures++;
+  }
+}
+
+/**
+  * @brief  Run the firmware until a control report arrives and decode it.
+  * @param  layout: parsed descriptor
+  * @param  id: expected report ID
+  * @param  usage: the one usage expected active, 0 for none
+  * @param  what: action, for the message
+  * @retval None
+  */
+static void sim_descriptor_control(const sim_hid_layout_t *layout, uint8_t id, uint32_t usage,
+                                   const char *what)
+{
+  uint8_t report[64];
+  uint32_t got[SIM_DESC_USAGES];
+  int32_t len = 0;
+  int32_t n = -1;
+  uint32_t t;
+
+  for (t = 0U; (t < (SIM_DRAIN_MS * 1000U)) && (len == 0); t += SIM_STEP_US)
+  {
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+  }
+  if ((len > 0) && (report[0] == id))
+  {
+    n = sim_hid_decode(layout, SIM_HID_INPUT, report, (uint32_t)len, got, SIM_DESC_USAGES);
+  }
+
+  if ((usage == 0U) ? (n != 0) : ((n != 1) || (got[0] != usage)))
+  {
+    printf("sim: report descriptor: %s report does not decode to usage %08lX\n", what, (unsigned long)usage);
+    sim_stats.failures++;
+  }
+}
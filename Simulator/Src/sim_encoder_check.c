@@ -0,0 +1,189 @@
+/**
+  ******************************************************************************
+  * @file           : sim_encoder_check.c
+  * @brief          : Keyboard encoders against a plain reference
+  ******************************************************************************
+  * The keyboard encoders must build the same reports as a plain reference
+  * for random key states past both rollovers, and their cost is reported.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "hid_keyboard.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_ENCODE_STATES         1024U
+#define SIM_ENCODE_KEYS_MAX       10U     /* keys per random state, past both rollovers */
+#define SIM_ENCODE_REPEAT         200U
+
+/* Private variables ---------------------------------------------------------*/
+static hid_key_state_t sim_encode_states[SIM_ENCODE_STATES];
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t sim_encoder_ref(const hid_key_state_t *state, uint8_t id, uint8_t max_keys, uint8_t *report);
+static void sim_encoder_bench(const hid_key_state_t *states, sim_kbd_encoder_t encode, const char *what);
+
+/**
+  * @brief  Check the keyboard encoders against a plain reference, then time them.
+  * @note   Random states hold up to SIM_ENCODE_KEYS_MAX keys and random
+  *         modifiers, so both keycode arrays also roll over; the states
+  *         include usages the NKRO bitmap has no room for.
+  * @retval None
+  */
+void sim_encoder_check(void)
+{
+  uint32_t failures = sim_stats.failures;
+  hid_key_state_t *state;
+  uint8_t report[HID_KBD_MAX_REPORT_SIZE];
+  uint8_t want[HID_KBD_MAX_REPORT_SIZE];
+  uint16_t len[2];
+  uint32_t seed = 0x454E43U;
+  uint32_t i;
+  uint32_t k;
+
+  for (i = 0U; i < SIM_ENCODE_STATES; i++)
+  {
+    state = &sim_encode_states[i];
+    hid_key_state_clear(state);
+    seed = (seed * 1664525U) + 1013904223U;
+    state->bits[7] = seed & 0xFFFF0000U;                   /* modifiers and usages past them */
+    for (k = i % (SIM_ENCODE_KEYS_MAX + 1U); k > 0U; k--)
+    {
+      seed = (seed * 1664525U) + 1013904223U;
+      hid_key_state_set(state, (uint8_t)((seed >> 8) % HID_USAGE_MODIFIER_FIRST), 1U);
+    }
+
+    len[0] = hid_kbd_encode_boot(state, report);
+    len[1] = sim_encoder_ref(state, 0U, HID_KBD_BOOT_KEYCODES, want);
+    if ((len[0] != len[1]) || (memcmp(report, want, len[1]) != 0) ||
+        (hid_kbd_encode(state, HID_KBD_PROTOCOL_BOOT, report) != len[1]) || (memcmp(report, want, len[1]) != 0))
+    {
+      printf("sim: encoder: state %lu: boot report differs from the reference\n", (unsigned long)i);
+      sim_stats.failures++;
+    }
+    len[0] = hid_kbd_encode_6kro(state, report);
+    len[1] = sim_encoder_ref(state, HID_KBD_6KRO_REPORT_ID, HID_KBD_6KRO_KEYCODES, want);
+    if ((len[0] != len[1]) || (memcmp(report, want, len[1]) != 0))
+    {
+      printf("sim: encoder: state %lu: 6KRO report differs from the reference\n", (unsigned long)i);
+      sim_stats.failures++;
+    }
+    len[0] = hid_kbd_encode_nkro(state, report);
+    len[1] = sim_encoder_ref(state, HID_KBD_NKRO_REPORT_ID, 0U, want);
+    if ((len[0] != len[1]) || (memcmp(report, want, len[1]) != 0))
+    {
+      printf("sim: encoder: state %lu: NKRO report differs from the reference\n", (unsigned long)i);
+      sim_stats.failures++;
+    }
+    len[1] = (HID_KBD_NKRO_ENABLED == 1U) ? sim_encoder_ref(state, HID_KBD_NKRO_REPORT_ID, 0U, want) :
+             sim_encoder_ref(state, HID_KBD_6KRO_REPORT_ID, HID_KBD_6KRO_KEYCODES, want);
+    if ((hid_kbd_encode(state, HID_KBD_PROTOCOL_REPORT, report) != len[1]) || (memcmp(report, want, len[1]) != 0))
+    {
+      printf("sim: encoder: state %lu: hid_kbd_encode() picked the wrong report protocol layout\n",
+             (unsigned long)i);
+      sim_stats.failures++;
+    }
+  }
+  printf("sim: encoder: %lu states of up to %lu keys match the reference%s\n", (unsigned long)SIM_ENCODE_STATES,
+         (unsigned long)SIM_ENCODE_KEYS_MAX, (sim_stats.failures != failures) ? " (FAILED)" : "");
+
+  sim_encoder_bench(sim_encode_states, hid_kbd_encode_nkro, "NKRO");
+  sim_encoder_bench(sim_encode_states, hid_kbd_encode_6kro, "6KRO");
+  sim_encoder_bench(sim_encode_states, hid_kbd_encode_boot, "boot");
+}
+
+/**
+  * @brief  Reference keyboard encoder, one usage at a time.
+  * @param  state: key state bitmap
+  * @param  id: report ID, 0 for the boot report
+  * @param  max_keys: keycode array size, 0 for the NKRO bitmap
+  * @param  report: receives the report
+  * @retval report length
+  */
+static uint16_t sim_encoder_ref(const hid_key_state_t *state, uint8_t id, uint8_t max_keys, uint8_t *report)
+{
+  uint32_t pos = 0U;
+  uint32_t keys = 0U;
+  uint32_t usage;
+  uint8_t down;
+
+  if (max_keys == 0U)
+  {
+    report[pos++] = id;
+    memset(&report[pos], 0, HID_KBD_NKRO_BITMAP_SIZE);
+    for (usage = 0U; usage <= HID_USAGE_MODIFIER_LAST; usage++)
+    {
+      down = (uint8_t)((state->bits[usage / 32U] >> (usage % 32U)) & 1U);
+      report[pos + (usage / 8U)] |= (uint8_t)(down << (usage % 8U));
+    }
+    return (uint16_t)(pos + HID_KBD_NKRO_BITMAP_SIZE);
+  }
+
+  if (id != 0U)
+  {
+    report[pos++] = id;
+  }
+  report[pos] = 0U;
+  for (usage = HID_USAGE_MODIFIER_FIRST; usage <= HID_USAGE_MODIFIER_LAST; usage++)
+  {
+    report[pos] |= (uint8_t)(((state->bits[usage / 32U] >> (usage % 32U)) & 1U) << (usage - HID_USAGE_MODIFIER_FIRST));
+  }
+  report[pos + 1U] = 0U;
+  pos += 2U;
+  memset(&report[pos], 0, max_keys);
+  for (usage = HID_USAGE_FIRST_KEY; usage < HID_USAGE_MODIFIER_FIRST; usage++)
+  {
+    if (((state->bits[usage / 32U] >> (usage % 32U)) & 1U) == 0U)
+    {
+      continue;
+    }
+    if (keys == max_keys)
+    {
+      /* One key too many: ErrorRollOver in every slot */
+      memset(&report[pos], HID_USAGE_ERROR_ROLLOVER, max_keys);
+      break;
+    }
+    report[pos + keys] = (uint8_t)usage;
+    keys++;
+  }
+
+  return (uint16_t)(pos + max_keys);
+}
+
+/**
+  * @brief  Time one encoder over the random states.
+  * @param  states: SIM_ENCODE_STATES key states
+  * @param  encode: encoder
+  * @param  what: name in the message
+  * @retval None
+  */
+static void sim_encoder_bench(const hid_key_state_t *states, sim_kbd_encoder_t encode, const char *what)
+{
+  uint8_t report[HID_KBD_MAX_REPORT_SIZE];
+  struct timespec t0;
+  struct timespec t1;
+  volatile uint32_t sink = 0U;
+  uint64_t ns;
+  uint32_t r;
+  uint32_t i;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (r = 0U; r < SIM_ENCODE_REPEAT; r++)
+  {
+    for (i = 0U; i < SIM_ENCODE_STATES; i++)
+    {
+      sink += encode(&states[i], report);
+      sink += report[2];
+    }
+  }
+  (void)clock_gettime(CLOCK_MONOTONIC, &t1);
+  ns = ((uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000U) + (uint64_t)t1.tv_nsec - (uint64_t)t0.tv_nsec;
+  (void)sink;
+
+  printf("sim: encoder %s: %.1f ns per report\n", what,
+         (double)ns / ((double)SIM_ENCODE_STATES * SIM_ENCODE_REPEAT));
+}
@@ -0,0 +1,148 @@
+/**
+  ******************************************************************************
+  * @file           : sim_enum_check.c
+  * @brief          : Enumeration time of every request, device side
+  ******************************************************************************
+  * The device is enumerated again SIM_ENUM_RUNS times. For every bus reset
+  * and request the fastest device side time on the host clock and the driver
+  * calls it made are reported; their totals must stay within
+  * SIM_ENUM_BUDGET_NS and SIM_ENUM_BUDGET_CALLS, and the firmware's own
+  * enumeration trace must count each stage as often as the host made it.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "latency_trace.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_ENUM_RUNS             200U    /* enumerations timed, the fastest of each request kept */
+/* Regression thresholds of one enumeration, device side: the host time allows
+   for a slower machine, the driver calls are exact */
+#ifndef SIM_ENUM_BUDGET_NS
+#define SIM_ENUM_BUDGET_NS        8000U
+#endif /* SIM_ENUM_BUDGET_NS */
+#ifndef SIM_ENUM_BUDGET_CALLS
+#if (USBD_CMPSIT_ACTIVATE_CDC == 1U)
+#define SIM_ENUM_BUDGET_CALLS     53U
+#else
+#define SIM_ENUM_BUDGET_CALLS     44U
+#endif /* USBD_CMPSIT_ACTIVATE_CDC */
+#endif /* SIM_ENUM_BUDGET_CALLS */
+
+/**
+  * @brief  Enumerate the device again and again, report the device side time
+  *         of each request and hold the total to SIM_ENUM_BUDGET_NS.
+  * @note   The fastest of SIM_ENUM_RUNS runs is kept for each request, which
+  *         leaves out most of the host's own scheduling noise. The
+  *         enumeration trace of the last run must count each stage as often
+  *         as the host made it.
+  * @retval None
+  */
+void sim_enum_check(void)
+{
+  static const struct
+  {
+    latency_enum_t stage;
+    const char    *prefix;
+  } stages[] =
+  {
+    { LATENCY_ENUM_RESET, "bus reset" },
+    { LATENCY_ENUM_DEVICE, "GET_DESCRIPTOR(Device)" },
+    { LATENCY_ENUM_ADDRESS, "SET_ADDRESS" },
+    { LATENCY_ENUM_CONFIG_DESC, "GET_DESCRIPTOR(Configuration)" },
+    { LATENCY_ENUM_STRING, "GET_DESCRIPTOR(String" },
+    { LATENCY_ENUM_CONFIGURE, "SET_CONFIGURATION" },
+  };
+  const sim_host_step_t *steps;
+  const latency_enum_stage_t *trace;
+  uint64_t best[SIM_HOST_ENUM_STEPS];
+  uint64_t total = 0U;
+  uint32_t calls = 0U;
+  uint32_t failures = sim_stats.failures;
+  uint32_t count = 0U;
+  uint32_t want;
+  uint32_t configured = 0U;
+  uint32_t n;
+  uint32_t run;
+  uint32_t i;
+
+  for (i = 0U; i < SIM_HOST_ENUM_STEPS; i++)
+  {
+    best[i] = UINT64_MAX;
+  }
+
+  for (run = 0U; run < SIM_ENUM_RUNS; run++)
+  {
+    if (sim_host_enumerate(&sim_device) != 0)
+    {
+      printf("sim: enum: run %lu failed\n", (unsigned long)run);
+      sim_stats.failures++;
+      return;
+    }
+    n = sim_host_enum_steps(&steps);
+    if ((run != 0U) && (n != count))
+    {
+      printf("sim: enum: run %lu made %lu requests, not %lu\n", (unsigned long)run, (unsigned long)n,
+             (unsigned long)count);
+      sim_stats.failures++;
+    }
+    count = n;
+    for (i = 0U; i < n; i++)
+    {
+      best[i] = MIN(best[i], steps[i].device_ns);
+    }
+  }
+
+  for (i = 0U; i < count; i++)
+  {
+    printf("sim: enum: %-34s %6llu ns, %2lu driver calls\n", steps[i].name, (unsigned long long)best[i],
+           (unsigned long)steps[i].driver_calls);
+    total += best[i];
+    calls += steps[i].driver_calls;
+    if (strncmp(steps[i].name, "SET_CONFIGURATION", 17U) == 0)
+    {
+      configured = i + 1U;
+    }
+  }
+
+  /* The trace ends at SET_CONFIGURATION: SET_IDLE and the report descriptor are not in it */
+  for (i = 0U; i < (sizeof(stages) / sizeof(stages[0])); i++)
+  {
+    want = 0U;
+    for (n = 0U; n < configured; n++)
+    {
+      if (strncmp(steps[n].name, stages[i].prefix, strlen(stages[i].prefix)) == 0)
+      {
+        want++;
+      }
+    }
+    trace = latency_trace_get_enum(stages[i].stage);
+    if (trace->count != want)
+    {
+      printf("sim: enum: trace counted %lu %s, the host made %lu\n", (unsigned long)trace->count,
+             stages[i].prefix, (unsigned long)want);
+      sim_stats.failures++;
+    }
+  }
+  if (latency_trace_get_enum(LATENCY_ENUM_OTHER)->count != 0U)
+  {
+    printf("sim: enum: trace counted %lu other requests\n",
+           (unsigned long)latency_trace_get_enum(LATENCY_ENUM_OTHER)->count);
+    sim_stats.failures++;
+  }
+
+  if ((total > SIM_ENUM_BUDGET_NS) || (calls > SIM_ENUM_BUDGET_CALLS))
+  {
+    printf("sim: enum: device side %llu ns and %lu driver calls, over the %lu ns or %lu calls budget\n",
+           (unsigned long long)total, (unsigned long)calls, (unsigned long)SIM_ENUM_BUDGET_NS,
+           (unsigned long)SIM_ENUM_BUDGET_CALLS);
+    sim_stats.failures++;
+  }
+
+  printf("sim: enum: %lu steps, device side %llu ns fastest of %lu runs, %lu driver calls%s\n",
+         (unsigned long)count, (unsigned long long)total, (unsigned long)SIM_ENUM_RUNS, (unsigned long)calls,
+         (sim_stats.failures == failures) ? "" : " (FAILED)");
+}
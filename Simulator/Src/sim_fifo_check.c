@@ -0,0 +1,322 @@
+/**
+  ******************************************************************************
+  * @file           : sim_fifo_check.c
+  * @brief          : OTG_FS FIFO plans of written and random configurations
+  ******************************************************************************
+  * The FIFO layout the device planned from its configuration descriptor, and
+  * the plans for a set of written and random endpoint configurations, must
+  * give every endpoint room for its packets, within the FIFO RAM and without
+  * overlap.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_FIFO_EPS              6U      /* endpoints of a test configuration */
+#define SIM_FIFO_DESC_SIZE        128U
+#define SIM_FIFO_RANDOM           20000U
+
+/* Private typedef -----------------------------------------------------------*/
+/* One endpoint of a FIFO planner test configuration */
+typedef struct
+{
+  uint8_t  addr;
+  uint8_t  type;
+  uint16_t mps;
+  uint8_t  alt;                /* alternate setting of the interface it is in */
+} sim_fifo_ep_t;
+
+typedef struct
+{
+  const char        *name;
+  usb_fifo_status_t  want;
+  uint8_t            ep0_mps;
+  uint32_t           count;
+  sim_fifo_ep_t      ep[SIM_FIFO_EPS];
+} sim_fifo_config_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const sim_fifo_config_t sim_fifo_configs[] =
+{
+  { "HID keyboard", USB_FIFO_OK, 64U, 2U,
+    { { 0x81U, USBD_EP_TYPE_INTR, 32U, 0U }, { 0x01U, USBD_EP_TYPE_INTR, 8U, 0U } } },
+  { "HID + CDC", USB_FIFO_OK, 64U, 5U,
+    { { 0x81U, USBD_EP_TYPE_INTR, 32U, 0U }, { 0x01U, USBD_EP_TYPE_INTR, 8U, 0U },
+      { 0x82U, USBD_EP_TYPE_BULK, 64U, 0U }, { 0x02U, USBD_EP_TYPE_BULK, 64U, 0U },
+      { 0x83U, USBD_EP_TYPE_INTR, 8U, 0U } } },
+  { "CDC on EP3 only", USB_FIFO_OK, 8U, 2U,
+    { { 0x83U, USBD_EP_TYPE_BULK, 64U, 0U }, { 0x03U, USBD_EP_TYPE_BULK, 64U, 0U } } },
+  { "alternate settings", USB_FIFO_OK, 64U, 3U,
+    { { 0x81U, USBD_EP_TYPE_BULK, 16U, 0U }, { 0x81U, USBD_EP_TYPE_BULK, 64U, 1U },
+      { 0x81U, USBD_EP_TYPE_INTR, 8U, 2U } } },
+  { "audio 48 kHz stereo", USB_FIFO_OK, 64U, 3U,
+    { { 0x81U, USBD_EP_TYPE_ISOC, 192U, 1U }, { 0x01U, USBD_EP_TYPE_ISOC, 192U, 1U },
+      { 0x82U, USBD_EP_TYPE_INTR, 8U, 0U } } },
+  { "isochronous 1023", USB_FIFO_FULL, 64U, 1U,
+    { { 0x81U, USBD_EP_TYPE_ISOC, 1023U, 1U } } },
+  { "endpoint 4", USB_FIFO_BAD_ENDPOINT, 64U, 1U,
+    { { 0x84U, USBD_EP_TYPE_INTR, 8U, 0U } } },
+  { "bulk 512", USB_FIFO_BAD_ENDPOINT, 64U, 1U,
+    { { 0x81U, USBD_EP_TYPE_BULK, 512U, 0U } } },
+  { "control endpoint", USB_FIFO_BAD_ENDPOINT, 64U, 1U,
+    { { 0x81U, USBD_EP_TYPE_CTRL, 64U, 0U } } },
+  { "EP0 of 12 bytes", USB_FIFO_BAD_ENDPOINT, 12U, 1U,
+    { { 0x81U, USBD_EP_TYPE_INTR, 8U, 0U } } },
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint16_t sim_fifo_build(const sim_fifo_ep_t *ep, uint32_t count, uint8_t *desc);
+static uint32_t sim_fifo_endpoints(const uint8_t *desc, uint16_t len, sim_fifo_ep_t *ep);
+static int32_t sim_fifo_verify(const usb_fifo_plan_t *plan, const sim_fifo_ep_t *ep, uint32_t count,
+                               uint8_t ep0_mps);
+
+/**
+  * @brief  Check the device's FIFO layout, then plan written and random
+  *         endpoint configurations.
+  * @retval None
+  */
+void sim_fifo_check(void)
+{
+  static const uint8_t types[3] = { USBD_EP_TYPE_ISOC, USBD_EP_TYPE_BULK, USBD_EP_TYPE_INTR };
+  static const uint8_t ep0_sizes[4] = { 8U, 16U, 32U, 64U };
+  sim_fifo_ep_t ep[SIM_FIFO_EPS * 2U];
+  usb_fifo_plan_t device;
+  usb_fifo_plan_t plan;
+  usb_fifo_status_t status;
+  uint8_t desc[SIM_FIFO_DESC_SIZE];
+  uint8_t dev_desc[USB_LEN_DEV_DESC];
+  uint32_t seed = 0x1D872B41U;
+  uint32_t count;
+  uint32_t fit = 0U;
+  uint32_t full = 0U;
+  uint32_t failures = sim_stats.failures;
+  uint32_t i;
+  uint32_t k;
+  int32_t len;
+  uint8_t ep0_mps;
+
+  /* The layout of the device against the descriptors the host reads */
+  sim_pcd_get_fifo(&device);
+  if ((sim_host_control(0x80U, USB_REQ_GET_DESCRIPTOR, 0x0100U, 0U, dev_desc, sizeof(dev_desc)) !=
+       (int32_t)sizeof(dev_desc)) ||
+      ((len = sim_host_control(0x80U, USB_REQ_GET_DESCRIPTOR, 0x0200U, 0U, desc, sizeof(desc))) <= 0) ||
+      (usb_fifo_plan(desc, (uint16_t)len, dev_desc[7], &plan) != USB_FIFO_OK) ||
+      (memcmp(&plan, &device, sizeof(plan)) != 0) ||
+      (sim_fifo_verify(&device, ep, sim_fifo_endpoints(desc, (uint16_t)len, ep), dev_desc[7]) != 0))
+  {
+    printf("sim: fifo: device layout does not match its descriptors\n");
+    sim_stats.failures++;
+  }
+  printf("sim: fifo: device RX %u, TX %u/%u/%u/%u words, %u of %u free\n", device.rx_words,
+         device.tx_words[0], device.tx_words[1], device.tx_words[2], device.tx_words[3],
+         USB_FIFO_WORDS - device.used_words, USB_FIFO_WORDS);
+
+  for (i = 0U; i < (sizeof(sim_fifo_configs) / sizeof(sim_fifo_configs[0])); i++)
+  {
+    len = sim_fifo_build(sim_fifo_configs[i].ep, sim_fifo_configs[i].count, desc);
+    status = usb_fifo_plan(desc, (uint16_t)len, sim_fifo_configs[i].ep0_mps, &plan);
+    if ((status != sim_fifo_configs[i].want) ||
+        ((status == USB_FIFO_OK) &&
+         (sim_fifo_verify(&plan, sim_fifo_configs[i].ep, sim_fifo_configs[i].count,
+                          sim_fifo_configs[i].ep0_mps) != 0)))
+    {
+      printf("sim: fifo: %s: status %u, expected %u\n", sim_fifo_configs[i].name, status,
+             sim_fifo_configs[i].want);
+      sim_stats.failures++;
+    }
+  }
+
+  /* Descriptors the planner must refuse: a zero bLength, too short, truncated */
+  len = sim_fifo_build(sim_fifo_configs[1].ep, sim_fifo_configs[1].count, desc);
+  if ((usb_fifo_plan(desc, (uint16_t)(len - 1), 64U, &plan) != USB_FIFO_BAD_DESCRIPTOR) ||
+      (usb_fifo_plan(desc, USB_LEN_CFG_DESC - 1U, 64U, &plan) != USB_FIFO_BAD_DESCRIPTOR))
+  {
+    printf("sim: fifo: truncated descriptor planned\n");
+    sim_stats.failures++;
+  }
+  desc[USB_LEN_CFG_DESC + USB_LEN_IF_DESC] = 0U;
+  if (usb_fifo_plan(desc, (uint16_t)len, 64U, &plan) != USB_FIFO_BAD_DESCRIPTOR)
+  {
+    printf("sim: fifo: malformed descriptor planned\n");
+    sim_stats.failures++;
+  }
+
+  for (i = 0U; i < SIM_FIFO_RANDOM; i++)
+  {
+    seed = (seed * 1664525U) + 1013904223U;
+    count = 1U + ((seed >> 24) % SIM_FIFO_EPS);
+    ep0_mps = ep0_sizes[(seed >> 8) & 3U];
+    for (k = 0U; k < count; k++)
+    {
+      seed = (seed * 1664525U) + 1013904223U;
+      ep[k].addr = (uint8_t)((1U + ((seed >> 28) % (USB_FIFO_EPS - 1U))) | ((seed >> 20) & 0x80U));
+      ep[k].type = types[(seed >> 16) % 3U];
+      ep[k].alt = (uint8_t)((seed >> 14) & 1U);
+      ep[k].mps = (uint16_t)(1U + ((seed >> 4) % ((ep[k].type == USBD_EP_TYPE_ISOC) ? 400U : 64U)));
+    }
+
+    len = sim_fifo_build(ep, count, desc);
+    status = usb_fifo_plan(desc, (uint16_t)len, ep0_mps, &plan);
+    if (((status != USB_FIFO_OK) && (status != USB_FIFO_FULL)) ||
+        ((status == USB_FIFO_OK) != (plan.used_words <= USB_FIFO_WORDS)) ||
+        (sim_fifo_verify(&plan, ep, count, ep0_mps) != 0))
+    {
+      printf("sim: fifo: random configuration %lu: status %u, %u words\n", (unsigned long)i, status,
+             plan.used_words);
+      sim_stats.failures++;
+      break;
+    }
+    if (status == USB_FIFO_OK)
+    {
+      fit++;
+    }
+    else
+    {
+      full++;
+    }
+  }
+
+  printf("sim: fifo: %lu written configurations, %lu random: %lu fit, %lu over budget, %s\n",
+         (unsigned long)(sizeof(sim_fifo_configs) / sizeof(sim_fifo_configs[0])), (unsigned long)SIM_FIFO_RANDOM,
+         (unsigned long)fit, (unsigned long)full, (sim_stats.failures == failures) ? "no overlap" : "FAILED");
+}
+
+/**
+  * @brief  Write a configuration descriptor, an interface descriptor before
+  *         each change of alternate setting.
+  * @param  ep: endpoints, in order
+  * @param  count: number of endpoints
+  * @param  desc: SIM_FIFO_DESC_SIZE bytes
+  * @retval wTotalLength
+  */
+static uint16_t sim_fifo_build(const sim_fifo_ep_t *ep, uint32_t count, uint8_t *desc)
+{
+  static const uint8_t config[USB_LEN_CFG_DESC] = { USB_LEN_CFG_DESC, USB_DESC_TYPE_CONFIGURATION, 0U, 0U,
+                                                    1U, 1U, 0U, 0xA0U, 50U };
+  uint32_t pos = USB_LEN_CFG_DESC;
+  uint32_t i;
+
+  memcpy(desc, config, sizeof(config));
+  for (i = 0U; i < count; i++)
+  {
+    if ((i == 0U) || (ep[i].alt != ep[i - 1U].alt))
+    {
+      desc[pos++] = USB_LEN_IF_DESC;
+      desc[pos++] = USB_DESC_TYPE_INTERFACE;
+      desc[pos++] = 0U;
+      desc[pos++] = ep[i].alt;
+      desc[pos++] = 1U;
+      desc[pos++] = 0xFFU;
+      desc[pos++] = 0U;
+      desc[pos++] = 0U;
+      desc[pos++] = 0U;
+    }
+    desc[pos++] = USB_LEN_EP_DESC;
+    desc[pos++] = USB_DESC_TYPE_ENDPOINT;
+    desc[pos++] = ep[i].addr;
+    desc[pos++] = ep[i].type;
+    desc[pos++] = (uint8_t)ep[i].mps;
+    desc[pos++] = (uint8_t)(ep[i].mps >> 8);
+    desc[pos++] = 1U;
+  }
+  desc[2] = (uint8_t)pos;
+  desc[3] = (uint8_t)(pos >> 8);
+
+  return (uint16_t)pos;
+}
+
+/**
+  * @brief  List the endpoints of a configuration descriptor.
+  * @param  desc: configuration descriptor
+  * @param  len: its length
+  * @param  ep: SIM_FIFO_EPS * 2 entries
+  * @retval number of endpoints
+  */
+static uint32_t sim_fifo_endpoints(const uint8_t *desc, uint16_t len, sim_fifo_ep_t *ep)
+{
+  uint32_t count = 0U;
+  uint32_t pos;
+
+  for (pos = 0U; ((pos + 2U) <= len) && (desc[pos] >= 2U) && (count < (SIM_FIFO_EPS * 2U)); pos += desc[pos])
+  {
+    if ((desc[pos + 1U] == USB_DESC_TYPE_ENDPOINT) && ((pos + USB_LEN_EP_DESC) <= len))
+    {
+      ep[count].addr = desc[pos + 2U];
+      ep[count].type = desc[pos + 3U] & 0x03U;
+      ep[count].mps = (uint16_t)(desc[pos + 4U] | ((uint16_t)desc[pos + 5U] << 8));
+      ep[count].alt = 0U;
+      count++;
+    }
+  }
+
+  return count;
+}
+
+/**
+  * @brief  Check a plan against the endpoints it was made for: RM0383 RX
+  *         minimum, a TX FIFO per IN endpoint holding its packets, FIFOs
+  *         where HAL_PCDEx_SetTxFiFo() puts them, none overlapping.
+  * @param  plan: plan to check, the FIFO RAM budget excepted
+  * @param  ep: endpoints
+  * @param  count: number of endpoints
+  * @param  ep0_mps: EP0 max packet
+  * @retval 0 when the plan serves every endpoint
+  */
+static int32_t sim_fifo_verify(const usb_fifo_plan_t *plan, const sim_fifo_ep_t *ep, uint32_t count,
+                               uint8_t ep0_mps)
+{
+  uint32_t need[USB_FIFO_EPS] = { 0U };
+  uint8_t outs[USB_FIFO_EPS] = { 1U, 0U, 0U, 0U };
+  uint32_t largest = ep0_mps;
+  uint32_t out_count = 0U;
+  uint32_t end;
+  uint32_t num;
+  uint32_t i;
+
+  need[0] = ((uint32_t)ep0_mps + 3U) / 4U;
+  for (i = 0U; i < count; i++)
+  {
+    num = ep[i].addr & 0x0FU;
+    if ((ep[i].addr & 0x80U) != 0U)
+    {
+      need[num] = MAX(need[num], ((ep[i].mps + 3U) / 4U) *
+                                 ((ep[i].type == USBD_EP_TYPE_INTR) ? 1U : USB_FIFO_STREAM_PACKETS));
+      if (plan->tx_count <= num)
+      {
+        return -1;
+      }
+    }
+    else
+    {
+      outs[num] = 1U;
+      largest = MAX(largest, ep[i].mps);
+    }
+  }
+  for (i = 0U; i < USB_FIFO_EPS; i++)
+  {
+    out_count += outs[i];
+  }
+
+  /* RM0383 minimum, without the planner's second packet */
+  if ((plan->rx_packet < largest) ||
+      (plan->rx_words < ((5U + 8U) + ((largest / 4U) + 1U) + (2U * out_count) + 1U)))
+  {
+    return -1;
+  }
+
+  end = plan->rx_words;
+  for (i = 0U; i < plan->tx_count; i++)
+  {
+    if ((plan->tx_offset[i] != end) || (plan->tx_words[i] < USB_FIFO_TX_MIN) || (plan->tx_words[i] < need[i]))
+    {
+      return -1;
+    }
+    end += plan->tx_words[i];
+  }
+
+  return (plan->used_words == end) ? 0 : -1;
+}
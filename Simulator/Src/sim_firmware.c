@@ -0,0 +1,125 @@
+/**
+  ******************************************************************************
+  * @file           : sim_firmware.c
+  * @brief          : Firmware start-up and one simulation step
+  ******************************************************************************
+  * Shared by the script runner and the uhid bridge. A step is one matrix
+  * scan: the scan "interrupt", then one pass of the main loop, then, on every
+  * 1 ms boundary, the host's SOF and interrupt endpoint poll. While the CPU
+  * sleeps in STOP mode only the host side runs.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "config_store.h"
+#include "hid_config.h"
+#include "keyboard.h"
+#include "latency_trace.h"
+#include "log_stream.h"
+#include "macro.h"
+#include "usb_device.h"
+#include "usb_power.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private variables ---------------------------------------------------------*/
+/* The macro sector, erased until a test loads an image */
+static uint32_t sim_macro_sector[(128U * 1024U) / 4U];
+
+/**
+  * @brief  Run the start-up sequence of main.c.
+  * @note   PA0 idles low, the matrix starts released and the flash store
+  *         starts erased.
+  * @retval None
+  */
+void sim_firmware_init(void)
+{
+  sim_gpio_set_input(GPIOA, GPIO_PIN_0, 0U);
+  log_init();
+  latency_trace_init();
+  memset(sim_macro_sector, 0xFF, sizeof(sim_macro_sector));
+  (void)macro_init((const uint8_t *)sim_macro_sector, sizeof(sim_macro_sector));
+  matrix_scan_init();
+  keyboard_init();
+  sim_flash_init();
+  (void)config_store_init();
+  hid_config_init();
+  usb_power_init();
+  MX_USB_DEVICE_Init();
+  matrix_scan_start();
+}
+
+/**
+  * @brief  Advance one matrix scan: scan interrupt, main loop, host frame.
+  * @param  dev: enumerated device polled by the host
+  * @param  report: buffer for a report received by the host
+  * @param  max: buffer size
+  * @retval report length, 0 when the host received nothing
+  */
+int32_t sim_firmware_step(const sim_host_device_t *dev, uint8_t *report, uint32_t max)
+{
+  int32_t len = 0;
+
+  if (__get_PRIMASK() != 0U)
+  {
+    fprintf(stderr, "sim: interrupts left masked by the main loop\n");
+    exit(1);
+  }
+
+  sim_clock_advance(SIM_STEP_US);
+  if (sim_power_stopped() == 0U)
+  {
+    sim_matrix_scan_tick();
+    if (usb_power_task() == USB_POWER_ACTIVE)
+    {
+      keyboard_task();
+    }
+    log_metrics_task();
+    hid_config_task();
+  }
+
+  if ((sim_clock_us() % SIM_FRAME_US) == 0U)
+  {
+    len = sim_host_frame(dev, report, max);
+    if (len < 0)
+    {
+      fprintf(stderr, "sim: interrupt IN transfer failed (%ld)\n", (long)len);
+      exit(1);
+    }
+  }
+
+  return len;
+}
+
+/**
+  * @brief  Press or release a key the way the hardware reports it.
+  * @param  key: "user" for PA0, or a matrix key number
+  * @param  pressed: new key state
+  * @retval 0, or -1 when the key name is not valid
+  */
+int32_t sim_firmware_key(const char *key, uint8_t pressed)
+{
+  char *end;
+  unsigned long index;
+
+  if (strcmp(key, "user") == 0)
+  {
+    /* PA0 edge, delivered like the EXTI0 interrupt */
+    sim_gpio_set_input(GPIOA, GPIO_PIN_0, pressed);
+    sim_power_wake();
+    keyboard_gpio_edge(GPIO_PIN_0);
+    usb_power_key_wake();
+    return 0;
+  }
+
+  index = strtoul(key, &end, 0);
+  if ((end == key) || (*end != '\0') || (index >= MATRIX_KEYS))
+  {
+    return -1;
+  }
+
+  sim_matrix_set_key((uint32_t)index, pressed);
+  return 0;
+}
@@ -0,0 +1,242 @@
+/**
+  ******************************************************************************
+  * @file           : sim_flash.c
+  * @brief          : Emulated flash sectors of the configuration store
+  ******************************************************************************
+  * The two store sectors are mapped at their target address, so the store
+  * reads them through the same pointers as on the chip. Erase sets a whole
+  * sector to 0xFF; program can only clear bits, like NOR flash, and a
+  * program that would need to set one is counted as a conflict.
+  *
+  * A power cut can be armed after a number of erase and program operations:
+  * the next one is torn, an erase leaving random bytes of the sector erased
+  * and a program clearing a random part of the bits it should, then control
+  * returns to the caller's setjmp() as if the board had been reset.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#define _GNU_SOURCE               /* MAP_FIXED_NOREPLACE */
+#include "sim.h"
+#include "config_store.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_FLASH_SIZE            (2U * CONFIG_STORE_SECTOR_SIZE)
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t *sim_flash;
+static uint8_t sim_flash_locked = 1U;
+static uint32_t sim_flash_cut_ops;            /* operations left before the cut, 0 when not armed */
+static jmp_buf *sim_flash_cut_jmp;
+static uint32_t sim_flash_seed = 1U;
+static sim_flash_stats_t sim_flash_stats;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t sim_flash_torn(void);
+static uint32_t sim_flash_random(void);
+
+/**
+  * @brief  Map the emulated sectors at CONFIG_STORE_ADDR, erased.
+  * @note   Once per process; later calls erase the sectors only.
+  * @retval None
+  */
+void sim_flash_init(void)
+{
+  void *map;
+
+  if (sim_flash == NULL)
+  {
+    map = mmap((void *)(uintptr_t)CONFIG_STORE_ADDR, SIM_FLASH_SIZE, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (map != (void *)(uintptr_t)CONFIG_STORE_ADDR)
+    {
+      fprintf(stderr, "sim: cannot map the flash store at 0x%08lX\n", (unsigned long)CONFIG_STORE_ADDR);
+      exit(1);
+    }
+    sim_flash = (uint8_t *)map;
+  }
+
+  memset(sim_flash, 0xFF, SIM_FLASH_SIZE);
+  memset(&sim_flash_stats, 0, sizeof(sim_flash_stats));
+  sim_flash_cut_ops = 0U;
+}
+
+/**
+  * @brief  Arm or disarm a power cut.
+  * @param  ops: number of the operation to tear, 1 for the next one, 0 to disarm
+  * @param  jmp: where the cut returns to, with value 1
+  * @param  seed: randomises the torn operation
+  * @retval None
+  */
+void sim_flash_power_cut(uint32_t ops, jmp_buf *jmp, uint32_t seed)
+{
+  sim_flash_cut_ops = ops;
+  sim_flash_cut_jmp = jmp;
+  sim_flash_seed = seed | 1U;
+}
+
+/**
+  * @brief  Copy the sectors out.
+  * @param  dst: SIM_FLASH_SIZE bytes
+  * @retval None
+  */
+void sim_flash_save(uint8_t *dst)
+{
+  memcpy(dst, sim_flash, SIM_FLASH_SIZE);
+}
+
+/**
+  * @brief  Copy the sectors back in.
+  * @param  src: SIM_FLASH_SIZE bytes from sim_flash_save()
+  * @retval None
+  */
+void sim_flash_restore(const uint8_t *src)
+{
+  memcpy(sim_flash, src, SIM_FLASH_SIZE);
+}
+
+/**
+  * @brief  Operation counters since sim_flash_init().
+  * @param  stats: filled with the counters
+  * @retval None
+  */
+void sim_flash_get_stats(sim_flash_stats_t *stats)
+{
+  *stats = sim_flash_stats;
+}
+
+/**
+  * @brief  Unlock the flash control register.
+  * @retval HAL_OK
+  */
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+  sim_flash_locked = 0U;
+  return HAL_OK;
+}
+
+/**
+  * @brief  Lock the flash control register.
+  * @retval HAL_OK
+  */
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+  sim_flash_locked = 1U;
+  return HAL_OK;
+}
+
+/**
+  * @brief  Program a word of the emulated sectors.
+  * @param  TypeProgram: FLASH_TYPEPROGRAM_WORD only
+  * @param  Address: word aligned, inside the store
+  * @param  Data: word
+  * @retval HAL_OK, HAL_ERROR when locked or outside the store
+  */
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+  uint32_t offset = Address - CONFIG_STORE_ADDR;
+  uint32_t old;
+  uint32_t word = (uint32_t)Data;
+
+  if ((sim_flash_locked != 0U) || (TypeProgram != FLASH_TYPEPROGRAM_WORD) || (Address < CONFIG_STORE_ADDR) ||
+      (offset >= SIM_FLASH_SIZE) || ((offset & 3U) != 0U))
+  {
+    return HAL_ERROR;
+  }
+
+  memcpy(&old, &sim_flash[offset], 4U);
+  if ((word & ~old) != 0U)
+  {
+    sim_flash_stats.conflicts++;
+  }
+  if (sim_flash_torn() != 0U)
+  {
+    /* Part of the bits to clear */
+    word = old & (word | sim_flash_random());
+    memcpy(&sim_flash[offset], &word, 4U);
+    longjmp(*sim_flash_cut_jmp, 1);
+  }
+
+  word &= old;
+  memcpy(&sim_flash[offset], &word, 4U);
+  sim_flash_stats.programs++;
+
+  return HAL_OK;
+}
+
+/**
+  * @brief  Erase emulated sectors.
+  * @param  pEraseInit: FLASH_TYPEERASE_SECTORS of the store sectors
+  * @param  SectorError: 0xFFFFFFFF on success, else the failing sector
+  * @retval HAL_OK, HAL_ERROR when locked or outside the store
+  */
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *SectorError)
+{
+  uint32_t sector;
+  uint32_t first = CONFIG_STORE_FIRST_SECTOR;
+  uint8_t *base;
+  uint32_t i;
+
+  *SectorError = 0xFFFFFFFFU;
+
+  for (sector = pEraseInit->Sector; sector < (pEraseInit->Sector + pEraseInit->NbSectors); sector++)
+  {
+    if ((sim_flash_locked != 0U) || (pEraseInit->TypeErase != FLASH_TYPEERASE_SECTORS) || (sector < first) ||
+        (sector > (first + 1U)))
+    {
+      *SectorError = sector;
+      return HAL_ERROR;
+    }
+
+    base = &sim_flash[(sector - first) * CONFIG_STORE_SECTOR_SIZE];
+    if (sim_flash_torn() != 0U)
+    {
+      /* Some bytes erased, the others as they were */
+      for (i = 0U; i < CONFIG_STORE_SECTOR_SIZE; i++)
+      {
+        if ((sim_flash_random() & 1U) != 0U)
+        {
+          base[i] = 0xFFU;
+        }
+      }
+      longjmp(*sim_flash_cut_jmp, 1);
+    }
+
+    memset(base, 0xFF, CONFIG_STORE_SECTOR_SIZE);
+    sim_flash_stats.erases[sector - first]++;
+  }
+
+  return HAL_OK;
+}
+
+/**
+  * @brief  Count an operation down to the armed cut.
+  * @retval 1 when this operation is the torn one
+  */
+static uint8_t sim_flash_torn(void)
+{
+  if (sim_flash_cut_ops == 0U)
+  {
+    return 0U;
+  }
+
+  sim_flash_cut_ops--;
+  return (sim_flash_cut_ops == 0U) ? 1U : 0U;
+}
+
+/**
+  * @brief  xorshift32.
+  * @retval next random word
+  */
+static uint32_t sim_flash_random(void)
+{
+  sim_flash_seed ^= sim_flash_seed << 13;
+  sim_flash_seed ^= sim_flash_seed >> 17;
+  sim_flash_seed ^= sim_flash_seed << 5;
+
+  return sim_flash_seed;
+}
@@ -0,0 +1,222 @@
+/**
+  ******************************************************************************
+  * @file           : sim_hal.c
+  * @brief          : Virtual clock, GPIO ports and core state for the simulator
+  ******************************************************************************
+  * The clock only moves when the simulator advances it, so a run is fully
+  * deterministic: uwTick follows the microsecond clock exactly as the SysTick
+  * interrupt would follow the core clock on the target.
+  *
+  * STOP mode only marks the CPU as stopped: sim_firmware_step() then skips
+  * the main loop until a wake-up line, the key EXTIs or the USB resume,
+  * calls sim_power_wake().
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Exported variables --------------------------------------------------------*/
+GPIO_TypeDef sim_gpio[5];
+const uint32_t sim_uid[3] = { 0x00390041U, 0x3131510DU, 0x33303732U };
+uint32_t sim_primask;
+uint32_t sim_exclusive;
+uint32_t (*sim_preempt)(void);
+__IO uint32_t uwTick;
+DWT_Type sim_dwt;
+CoreDebug_Type sim_core_debug;
+uint32_t SystemCoreClock = 96000000U;
+
+/* Private variables ---------------------------------------------------------*/
+static uint64_t sim_time_us;
+static uint8_t sim_stopped;
+static uint8_t sim_tick_suspended;
+static uint32_t sim_clock_configs;
+
+/**
+  * @brief  Current virtual time.
+  * @retval microseconds since start-up
+  */
+uint64_t sim_clock_us(void)
+{
+  return sim_time_us;
+}
+
+/**
+  * @brief  Move the virtual clock forward.
+  * @param  us: microseconds to advance
+  * @retval None
+  */
+void sim_clock_advance(uint32_t us)
+{
+  sim_time_us += us;
+  uwTick = (uint32_t)(sim_time_us / 1000U);
+
+  if ((sim_dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk) != 0U)
+  {
+    sim_dwt.CYCCNT += us * (SystemCoreClock / 1000000U);
+  }
+}
+
+/**
+  * @brief  Drive an input pin from outside the chip.
+  * @param  port: GPIO port
+  * @param  pin: GPIO_PIN_x mask
+  * @param  level: 1 for high
+  * @retval None
+  */
+void sim_gpio_set_input(GPIO_TypeDef *port, uint16_t pin, uint8_t level)
+{
+  if (level != 0U)
+  {
+    port->IDR |= pin;
+  }
+  else
+  {
+    port->IDR &= ~(uint32_t)pin;
+  }
+}
+
+/**
+  * @brief  Milliseconds since start-up, from the virtual clock.
+  * @retval tick
+  */
+uint32_t HAL_GetTick(void)
+{
+  return uwTick;
+}
+
+/**
+  * @brief  Busy waits burn virtual time only.
+  * @param  Delay: milliseconds
+  * @retval None
+  */
+void HAL_Delay(uint32_t Delay)
+{
+  sim_clock_advance(Delay * 1000U);
+}
+
+/**
+  * @brief  Read an input pin.
+  * @param  GPIOx: GPIO port
+  * @param  GPIO_Pin: GPIO_PIN_x mask
+  * @retval pin level
+  */
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+  return ((GPIOx->IDR & GPIO_Pin) != 0U) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+/**
+  * @brief  Write an output pin.
+  * @param  GPIOx: GPIO port
+  * @param  GPIO_Pin: GPIO_PIN_x mask
+  * @param  PinState: new level
+  * @retval None
+  */
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  if (PinState != GPIO_PIN_RESET)
+  {
+    GPIOx->ODR |= GPIO_Pin;
+  }
+  else
+  {
+    GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+  }
+}
+
+/**
+  * @brief  A wake-up line fired: leave STOP mode.
+  * @retval None
+  */
+void sim_power_wake(void)
+{
+  sim_stopped = 0U;
+}
+
+/**
+  * @brief  Whether the CPU sleeps in STOP mode.
+  * @retval 1 when stopped
+  */
+uint8_t sim_power_stopped(void)
+{
+  return sim_stopped;
+}
+
+/**
+  * @brief  Calls to SystemClock_Config() since start-up.
+  * @retval count
+  */
+uint32_t sim_power_clock_configs(void)
+{
+  return sim_clock_configs;
+}
+
+/**
+  * @brief  Enter STOP mode, left by sim_power_wake().
+  * @note   The SysTick must be suspended, as on the target where it would
+  *         wake the CPU at once.
+  * @param  Regulator: regulator state in STOP mode
+  * @param  STOPEntry: WFI or WFE
+  * @retval None
+  */
+void HAL_PWR_EnterSTOPMode(uint32_t Regulator, uint8_t STOPEntry)
+{
+  UNUSED(Regulator);
+  UNUSED(STOPEntry);
+
+  if (sim_tick_suspended == 0U)
+  {
+    fprintf(stderr, "sim: STOP mode entered with the SysTick running\n");
+    exit(1);
+  }
+  sim_stopped = 1U;
+}
+
+/**
+  * @brief  Flash power-down in STOP mode, nothing to do off-target.
+  * @retval None
+  */
+void HAL_PWREx_EnableFlashPowerDown(void)
+{
+}
+
+/**
+  * @brief  Stop the SysTick interrupt.
+  * @retval None
+  */
+void HAL_SuspendTick(void)
+{
+  sim_tick_suspended = 1U;
+}
+
+/**
+  * @brief  Restart the SysTick interrupt.
+  * @retval None
+  */
+void HAL_ResumeTick(void)
+{
+  sim_tick_suspended = 0U;
+}
+
+/**
+  * @brief  Clock tree set-up of main.c, counted only.
+  * @retval None
+  */
+void SystemClock_Config(void)
+{
+  sim_clock_configs++;
+}
+
+/**
+  * @brief  Firmware error: stop the run with a failure status.
+  * @retval None
+  */
+void Error_Handler(void)
+{
+  fprintf(stderr, "sim: Error_Handler at %llu us\n", (unsigned long long)sim_time_us);
+  exit(2);
+}
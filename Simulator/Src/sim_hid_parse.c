@@ -0,0 +1,463 @@
+/**
+  ******************************************************************************
+  * @file           : sim_hid_parse.c
+  * @brief          : Host side HID report descriptor parser for the simulator
+  ******************************************************************************
+  * Reads the descriptor the device serves the way the Linux HID core does:
+  * global and local item state, one field per main item, report lengths per
+  * report ID and type. It shares nothing with the firmware's descriptor
+  * builder, so comparing its view of a report with what the encoders produce
+  * catches a descriptor that no longer describes the reports on the wire.
+  * Push/pop and long items are rejected, the keyboard uses neither.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+/* Item types */
+#define SIM_HID_ITEM_MAIN         0U
+#define SIM_HID_ITEM_GLOBAL       1U
+#define SIM_HID_ITEM_LOCAL        2U
+
+/* Main item tags */
+#define SIM_HID_TAG_INPUT         0x8U
+#define SIM_HID_TAG_OUTPUT        0x9U
+#define SIM_HID_TAG_COLLECTION    0xAU
+#define SIM_HID_TAG_FEATURE       0xBU
+#define SIM_HID_TAG_END           0xCU
+
+/* Global item tags */
+#define SIM_HID_TAG_USAGE_PAGE    0x0U
+#define SIM_HID_TAG_LOGICAL_MIN   0x1U
+#define SIM_HID_TAG_LOGICAL_MAX   0x2U
+#define SIM_HID_TAG_REPORT_SIZE   0x7U
+#define SIM_HID_TAG_REPORT_ID     0x8U
+#define SIM_HID_TAG_REPORT_COUNT  0x9U
+#define SIM_HID_TAG_PUSH          0xAU
+#define SIM_HID_TAG_POP           0xBU
+
+/* Local item tags */
+#define SIM_HID_TAG_USAGE         0x0U
+#define SIM_HID_TAG_USAGE_MIN     0x1U
+#define SIM_HID_TAG_USAGE_MAX     0x2U
+
+/* Main item data bits */
+#define SIM_HID_FLAG_CONSTANT     0x01U
+#define SIM_HID_FLAG_VARIABLE     0x02U
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t usage_page;
+  int32_t  logical_min;
+  uint32_t logical_max;        /* raw, signedness follows logical_min */
+  uint8_t  logical_max_size;
+  uint32_t report_size;
+  uint32_t report_id;
+  uint32_t report_count;
+} sim_hid_global_t;
+
+typedef struct
+{
+  uint32_t usage[SIM_HID_MAX_USAGES];
+  uint8_t  usage_count;
+  uint32_t usage_min;
+  uint32_t usage_max;
+  uint8_t  has_min;
+  uint8_t  has_max;
+} sim_hid_local_t;
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t sim_hid_fail(uint32_t pos, const char *what);
+static uint32_t sim_hid_full_usage(uint32_t usage, uint8_t size, uint32_t page);
+static int32_t sim_hid_sign_extend(uint32_t value, uint8_t bits);
+static int32_t sim_hid_add_field(sim_hid_layout_t *layout, const sim_hid_global_t *global,
+                                 const sim_hid_local_t *local, uint8_t type, uint8_t flags);
+static uint32_t sim_hid_extract(const uint8_t *data, uint32_t offset, uint8_t bits);
+
+/**
+  * @brief  Parse a report descriptor into fields and report lengths.
+  * @param  desc: report descriptor
+  * @param  len: descriptor length
+  * @param  layout: receives the fields
+  * @retval 0, or -1 on a malformed or unsupported descriptor
+  */
+int32_t sim_hid_parse(const uint8_t *desc, uint32_t len, sim_hid_layout_t *layout)
+{
+  sim_hid_global_t global;
+  sim_hid_local_t local;
+  uint32_t pos = 0U;
+  uint32_t depth = 0U;
+  uint32_t value;
+  uint8_t prefix;
+  uint8_t size;
+  uint8_t type;
+  uint8_t tag;
+  uint8_t i;
+
+  memset(layout, 0, sizeof(*layout));
+  memset(&global, 0, sizeof(global));
+  memset(&local, 0, sizeof(local));
+
+  while (pos < len)
+  {
+    prefix = desc[pos];
+    if (prefix == 0xFEU)
+    {
+      return sim_hid_fail(pos, "long item");
+    }
+    size = ((prefix & 0x03U) == 3U) ? 4U : (uint8_t)(prefix & 0x03U);
+    type = (uint8_t)((prefix >> 2) & 0x03U);
+    tag = (uint8_t)(prefix >> 4);
+    if ((pos + 1U + size) > len)
+    {
+      return sim_hid_fail(pos, "item runs past the end");
+    }
+    value = 0U;
+    for (i = 0U; i < size; i++)
+    {
+      value |= (uint32_t)desc[pos + 1U + i] << (8U * i);
+    }
+
+    if (type == SIM_HID_ITEM_MAIN)
+    {
+      switch (tag)
+      {
+        case SIM_HID_TAG_INPUT:
+        case SIM_HID_TAG_OUTPUT:
+        case SIM_HID_TAG_FEATURE:
+          if (sim_hid_add_field(layout, &global, &local,
+                                (tag == SIM_HID_TAG_INPUT) ? SIM_HID_INPUT :
+                                (tag == SIM_HID_TAG_OUTPUT) ? SIM_HID_OUTPUT : SIM_HID_FEATURE,
+                                (uint8_t)value) != 0)
+          {
+            return sim_hid_fail(pos, "field does not fit");
+          }
+          break;
+
+        case SIM_HID_TAG_COLLECTION:
+          depth++;
+          break;
+
+        case SIM_HID_TAG_END:
+          if (depth == 0U)
+          {
+            return sim_hid_fail(pos, "end collection without collection");
+          }
+          depth--;
+          break;
+
+        default:
+          return sim_hid_fail(pos, "unknown main item");
+      }
+      memset(&local, 0, sizeof(local));
+    }
+    else if (type == SIM_HID_ITEM_GLOBAL)
+    {
+      switch (tag)
+      {
+        case SIM_HID_TAG_USAGE_PAGE:
+          global.usage_page = value;
+          break;
+
+        case SIM_HID_TAG_LOGICAL_MIN:
+          global.logical_min = sim_hid_sign_extend(value, (uint8_t)(8U * size));
+          break;
+
+        case SIM_HID_TAG_LOGICAL_MAX:
+          global.logical_max = value;
+          global.logical_max_size = size;
+          break;
+
+        case SIM_HID_TAG_REPORT_SIZE:
+          global.report_size = value;
+          break;
+
+        case SIM_HID_TAG_REPORT_ID:
+          if ((value == 0U) || (value >= SIM_HID_MAX_REPORT_IDS))
+          {
+            return sim_hid_fail(pos, "report ID out of range");
+          }
+          if ((layout->numbered == 0U) && (layout->fields != 0U))
+          {
+            return sim_hid_fail(pos, "report ID after unnumbered fields");
+          }
+          layout->numbered = 1U;
+          global.report_id = value;
+          break;
+
+        case SIM_HID_TAG_REPORT_COUNT:
+          global.report_count = value;
+          break;
+
+        case SIM_HID_TAG_PUSH:
+        case SIM_HID_TAG_POP:
+          return sim_hid_fail(pos, "push/pop not supported");
+
+        default:
+          /* physical range and units do not change the report layout */
+          break;
+      }
+    }
+    else if (type == SIM_HID_ITEM_LOCAL)
+    {
+      switch (tag)
+      {
+        case SIM_HID_TAG_USAGE:
+          if (local.usage_count == SIM_HID_MAX_USAGES)
+          {
+            return sim_hid_fail(pos, "too many usages");
+          }
+          local.usage[local.usage_count] = sim_hid_full_usage(value, size, global.usage_page);
+          local.usage_count++;
+          break;
+
+        case SIM_HID_TAG_USAGE_MIN:
+          local.usage_min = sim_hid_full_usage(value, size, global.usage_page);
+          local.has_min = 1U;
+          break;
+
+        case SIM_HID_TAG_USAGE_MAX:
+          local.usage_max = sim_hid_full_usage(value, size, global.usage_page);
+          local.has_max = 1U;
+          break;
+
+        default:
+          /* designators, strings and delimiters carry no report data */
+          break;
+      }
+    }
+    else
+    {
+      return sim_hid_fail(pos, "reserved item type");
+    }
+
+    pos += 1U + size;
+  }
+
+  if (depth != 0U)
+  {
+    return sim_hid_fail(pos, "collection not closed");
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Length of one report as the host expects it.
+  * @param  layout: parsed descriptor
+  * @param  id: report ID, 0 for an unnumbered descriptor
+  * @param  type: SIM_HID_INPUT/OUTPUT/FEATURE
+  * @retval bytes with the report ID, 0 if the report is not declared
+  */
+uint32_t sim_hid_report_len(const sim_hid_layout_t *layout, uint8_t id, uint8_t type)
+{
+  uint32_t bits = layout->bits[id][type - 1U];
+
+  if (bits == 0U)
+  {
+    return 0U;
+  }
+  return ((bits + 7U) / 8U) + ((layout->numbered != 0U) ? 1U : 0U);
+}
+
+/**
+  * @brief  Decode a report into the usages it reports active.
+  * @note   Variable fields report a usage when their value is not 0, array
+  *         fields report the usage their value selects; values outside the
+  *         logical range and usage 0 mean no usage, as for the Linux HID core.
+  * @param  layout: parsed descriptor
+  * @param  type: SIM_HID_INPUT/OUTPUT/FEATURE
+  * @param  report: report, ID included when the descriptor is numbered
+  * @param  len: report length
+  * @param  usage: receives the active usages, page in bits 31:16
+  * @param  max: size of the usage array
+  * @retval number of usages, or -1 if the length does not match the descriptor
+  */
+int32_t sim_hid_decode(const sim_hid_layout_t *layout, uint8_t type, const uint8_t *report,
+                       uint32_t len, uint32_t *usage, uint32_t max)
+{
+  const sim_hid_field_t *field;
+  const uint8_t *data = report;
+  uint8_t id = 0U;
+  uint32_t found = 0U;
+  uint32_t f;
+  uint32_t n;
+  uint32_t raw;
+  int32_t value;
+  uint32_t u;
+
+  if (layout->numbered != 0U)
+  {
+    if (len == 0U)
+    {
+      return -1;
+    }
+    id = report[0];
+    data = &report[1];
+  }
+  if ((len == 0U) || (sim_hid_report_len(layout, id, type) != len))
+  {
+    return -1;
+  }
+
+  for (f = 0U; f < layout->fields; f++)
+  {
+    field = &layout->field[f];
+    if ((field->report_id != id) || (field->type != type) || ((field->flags & SIM_HID_FLAG_CONSTANT) != 0U))
+    {
+      continue;
+    }
+
+    for (n = 0U; n < field->count; n++)
+    {
+      raw = sim_hid_extract(data, field->offset + (n * field->size), field->size);
+      value = (field->logical_min < 0) ? sim_hid_sign_extend(raw, field->size) : (int32_t)raw;
+
+      if ((field->flags & SIM_HID_FLAG_VARIABLE) != 0U)
+      {
+        if (value == 0)
+        {
+          continue;
+        }
+        u = (field->usage_count != 0U) ? field->usage[(n < field->usage_count) ? n : (field->usage_count - 1U)]
+                                       : field->usage_min + n;
+      }
+      else
+      {
+        if ((value < field->logical_min) || (value > field->logical_max))
+        {
+          continue;
+        }
+        u = (uint32_t)(value - field->logical_min);
+        u = (field->usage_count != 0U) ? ((u < field->usage_count) ? field->usage[u] : 0U)
+                                       : field->usage_min + u;
+        if ((u & 0xFFFFU) == 0U)
+        {
+          continue;
+        }
+      }
+
+      if (found < max)
+      {
+        usage[found] = u;
+      }
+      found++;
+    }
+  }
+
+  return (int32_t)found;
+}
+
+/**
+  * @brief  Report a parse error.
+  * @param  pos: descriptor offset of the offending item
+  * @param  what: description
+  * @retval -1
+  */
+static int32_t sim_hid_fail(uint32_t pos, const char *what)
+{
+  printf("sim: report descriptor offset %lu: %s\n", (unsigned long)pos, what);
+  return -1;
+}
+
+/**
+  * @brief  Combine a usage with the current usage page.
+  * @param  usage: usage item data
+  * @param  size: usage item data size, 4 when the page is included
+  * @param  page: current usage page
+  * @retval page in bits 31:16, usage in bits 15:0
+  */
+static uint32_t sim_hid_full_usage(uint32_t usage, uint8_t size, uint32_t page)
+{
+  return (size == 4U) ? usage : ((page << 16) | (usage & 0xFFFFU));
+}
+
+/**
+  * @brief  Sign extend an item or field value.
+  * @param  value: raw value
+  * @param  bits: significant bits, 0 for an empty item
+  * @retval signed value
+  */
+static int32_t sim_hid_sign_extend(uint32_t value, uint8_t bits)
+{
+  if ((bits == 0U) || (bits >= 32U))
+  {
+    return (int32_t)value;
+  }
+  if ((value & (1UL << (bits - 1U))) != 0U)
+  {
+    value |= ~((1UL << bits) - 1UL);
+  }
+  return (int32_t)value;
+}
+
+/**
+  * @brief  Append a field for a main item and account for its bits.
+  * @param  layout: layout being built
+  * @param  global: global item state
+  * @param  local: local item state
+  * @param  type: SIM_HID_INPUT/OUTPUT/FEATURE
+  * @param  flags: main item data
+  * @retval 0, or -1 when a limit is exceeded
+  */
+static int32_t sim_hid_add_field(sim_hid_layout_t *layout, const sim_hid_global_t *global,
+                                 const sim_hid_local_t *local, uint8_t type, uint8_t flags)
+{
+  sim_hid_field_t *field;
+  uint16_t *bits = &layout->bits[global->report_id][type - 1U];
+  uint32_t total = (uint32_t)*bits + (global->report_size * global->report_count);
+
+  if ((layout->fields == SIM_HID_MAX_FIELDS) || (global->report_size == 0U) ||
+      (global->report_size > 32U) || (total > 0xFFFFU))
+  {
+    return -1;
+  }
+
+  field = &layout->field[layout->fields];
+  layout->fields++;
+
+  field->report_id = (uint8_t)global->report_id;
+  field->type = type;
+  field->flags = flags;
+  field->size = (uint8_t)global->report_size;
+  field->count = (uint16_t)global->report_count;
+  field->offset = *bits;
+  field->logical_min = global->logical_min;
+  field->logical_max = (global->logical_min < 0) ?
+                       sim_hid_sign_extend(global->logical_max, (uint8_t)(8U * global->logical_max_size)) :
+                       (int32_t)global->logical_max;
+  field->usage_min = (local->has_min != 0U) ? local->usage_min : 0U;
+  field->usage_max = (local->has_max != 0U) ? local->usage_max : 0U;
+  field->usage_count = local->usage_count;
+  memcpy(field->usage, local->usage, sizeof(field->usage));
+
+  *bits = (uint16_t)total;
+  return 0;
+}
+
+/**
+  * @brief  Read a little-endian bit field.
+  * @param  data: report data after the report ID
+  * @param  offset: first bit
+  * @param  bits: width, 1 to 32
+  * @retval field value
+  */
+static uint32_t sim_hid_extract(const uint8_t *data, uint32_t offset, uint8_t bits)
+{
+  uint32_t value = 0U;
+  uint32_t i;
+
+  for (i = 0U; i < bits; i++)
+  {
+    if ((data[(offset + i) >> 3] & (1U << ((offset + i) & 7U))) != 0U)
+    {
+      value |= 1UL << i;
+    }
+  }
+  return value;
+}
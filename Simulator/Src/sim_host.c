@@ -0,0 +1,545 @@
+/**
+  ******************************************************************************
+  * @file           : sim_host.c
+  * @brief          : Scripted USB host for the simulator
+  ******************************************************************************
+  * Drives the virtual PCD the way a Linux host drives the real device: bus
+  * reset, GET_DESCRIPTOR(Device) with the 64-byte probe, SET_ADDRESS, the
+  * configuration and string descriptors, SET_CONFIGURATION, then the usbhid
+  * driver's SET_IDLE(0) and report descriptor fetch. Afterwards the interrupt
+  * IN endpoint is polled once every bInterval frames. The endpoints of a CDC
+  * interface, when the configuration has one, are recorded for the console
+  * checks; its bulk IN endpoint is read on demand. Each reset and request
+  * of the enumeration is recorded with the host time spent in the device's
+  * callbacks and the driver calls they made.
+  *
+  * The host can suspend the bus: frames stop, and after 3 ms of idle the
+  * device sees the suspend. It resumes it by driving resume signalling for
+  * 20 ms before the frames start again, on its own or in answer to the
+  * device's remote wakeup signalling.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "usbd_def.h"
+#include <stdio.h>
+#include <time.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_HOST_ADDRESS          1U
+#define SIM_HOST_LANGID           0x0409U
+#define SIM_HOST_CONFIG_MAX       256U
+#define SIM_HOST_SUSPEND_MS       3U      /* bus idle before the device suspends */
+#define SIM_HOST_RESUME_MS        20U     /* TDRSMDN */
+
+/* Bus state */
+#define SIM_HOST_BUS_ACTIVE       0U
+#define SIM_HOST_BUS_SUSPENDED    1U
+#define SIM_HOST_BUS_RESUMING     2U
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t sim_host_frames;
+static uint8_t sim_host_bus;
+static uint32_t sim_host_bus_ms;              /* in the current bus state */
+static sim_host_step_t sim_host_steps[SIM_HOST_ENUM_STEPS];
+static uint32_t sim_host_step_count;
+static uint64_t sim_host_device_ns;           /* since the last recorded step */
+static uint32_t sim_host_driver_calls;        /* sim_pcd_driver_calls() at the last step */
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t sim_host_get_descriptor(uint8_t type, uint8_t index, uint16_t lang, uint8_t *buf, uint16_t len);
+static int32_t sim_host_fail(const char *step, int32_t ret);
+static int32_t sim_host_transfer(uint8_t bm_request, uint8_t request, uint16_t value, uint16_t index,
+                                 uint8_t *data, uint16_t length);
+static void sim_host_reset(void);
+static void sim_host_step(const char *name, int32_t arg);
+static uint64_t sim_host_ns(void);
+
+/**
+  * @brief  Run one control transfer, timing the device side on the host clock.
+  * @note   The host side of the transfer, a few packet copies, is timed too.
+  * @param  bm_request: bmRequestType
+  * @param  request: bRequest
+  * @param  value: wValue
+  * @param  index: wIndex
+  * @param  data: data stage buffer, read or written depending on direction
+  * @param  length: wLength
+  * @retval bytes moved in the data stage, or a negative SIM_PCD_xxx code
+  */
+int32_t sim_host_control(uint8_t bm_request, uint8_t request, uint16_t value, uint16_t index,
+                         uint8_t *data, uint16_t length)
+{
+  uint64_t start = sim_host_ns();
+  int32_t ret;
+
+  ret = sim_host_transfer(bm_request, request, value, index, data, length);
+  sim_host_device_ns += sim_host_ns() - start;
+  return ret;
+}
+
+/**
+  * @brief  Run one control transfer: SETUP, optional data stage, status stage.
+  * @param  bm_request: bmRequestType
+  * @param  request: bRequest
+  * @param  value: wValue
+  * @param  index: wIndex
+  * @param  data: data stage buffer, read or written depending on direction
+  * @param  length: wLength
+  * @retval bytes moved in the data stage, or a negative SIM_PCD_xxx code
+  */
+static int32_t sim_host_transfer(uint8_t bm_request, uint8_t request, uint16_t value, uint16_t index,
+                                 uint8_t *data, uint16_t length)
+{
+  uint8_t setup[8];
+  uint8_t packet[USB_MAX_EP0_SIZE];
+  uint32_t done = 0U;
+  uint32_t chunk;
+  int32_t ret;
+
+  setup[0] = bm_request;
+  setup[1] = request;
+  setup[2] = LOBYTE(value);
+  setup[3] = HIBYTE(value);
+  setup[4] = LOBYTE(index);
+  setup[5] = HIBYTE(index);
+  setup[6] = LOBYTE(length);
+  setup[7] = HIBYTE(length);
+
+  ret = sim_pcd_setup(setup);
+  if (ret < 0)
+  {
+    return ret;
+  }
+
+  if ((bm_request & 0x80U) == 0x80U)
+  {
+    /* Data IN until a short packet or wLength, then a zero-length status OUT */
+    while (done < length)
+    {
+      ret = sim_pcd_in(0x80U, packet, sizeof(packet));
+      if (ret < 0)
+      {
+        return ret;
+      }
+      chunk = MIN((uint32_t)ret, length - done);
+      memcpy(&data[done], packet, chunk);
+      done += chunk;
+      if ((uint32_t)ret < USB_MAX_EP0_SIZE)
+      {
+        break;
+      }
+    }
+
+    ret = sim_pcd_out(0x00U, NULL, 0U);
+    return (ret < 0) ? ret : (int32_t)done;
+  }
+
+  /* Data OUT in max packet chunks, then a zero-length status IN */
+  while (done < length)
+  {
+    chunk = MIN(USB_MAX_EP0_SIZE, length - done);
+    ret = sim_pcd_out(0x00U, &data[done], chunk);
+    if (ret < 0)
+    {
+      return ret;
+    }
+    done += chunk;
+  }
+
+  ret = sim_pcd_in(0x80U, packet, sizeof(packet));
+  if (ret != 0)
+  {
+    return (ret < 0) ? ret : SIM_PCD_ERROR;
+  }
+
+  return (int32_t)done;
+}
+
+/**
+  * @brief  Enumerate the device and bind it like the usbhid driver.
+  * @param  dev: filled with what the host learnt
+  * @retval 0, or a negative SIM_PCD_xxx code of the failing step
+  */
+int32_t sim_host_enumerate(sim_host_device_t *dev)
+{
+  uint8_t desc[USB_LEN_DEV_DESC];
+  uint8_t config[SIM_HOST_CONFIG_MAX];
+  uint8_t string[USBD_MAX_STR_DESC_SIZ];
+  uint16_t total;
+  uint32_t pos;
+  uint8_t if_class = 0U;
+  uint8_t i;
+  int32_t ret;
+
+  memset(dev, 0, sizeof(*dev));
+  sim_host_frames = 0U;
+  sim_host_step_count = 0U;
+  sim_host_device_ns = 0U;
+  sim_host_driver_calls = sim_pcd_driver_calls();
+
+  sim_host_reset();
+  ret = sim_host_get_descriptor(USB_DESC_TYPE_DEVICE, 0U, 0U, config, USB_MAX_EP0_SIZE);
+  sim_host_step("GET_DESCRIPTOR(Device) %ld", USB_MAX_EP0_SIZE);
+  if ((ret < 8) || (config[1] != USB_DESC_TYPE_DEVICE) || (config[7] != USB_MAX_EP0_SIZE))
+  {
+    return sim_host_fail("device descriptor probe", ret);
+  }
+
+  sim_host_reset();
+  ret = sim_host_control(0x00U, USB_REQ_SET_ADDRESS, SIM_HOST_ADDRESS, 0U, NULL, 0U);
+  sim_host_step("SET_ADDRESS(%ld)", SIM_HOST_ADDRESS);
+  if ((ret < 0) || (sim_pcd_get_address() != SIM_HOST_ADDRESS))
+  {
+    return sim_host_fail("SET_ADDRESS", (ret < 0) ? ret : SIM_PCD_ERROR);
+  }
+  dev->address = SIM_HOST_ADDRESS;
+
+  ret = sim_host_get_descriptor(USB_DESC_TYPE_DEVICE, 0U, 0U, desc, sizeof(desc));
+  sim_host_step("GET_DESCRIPTOR(Device) %ld", (int32_t)sizeof(desc));
+  if ((ret != (int32_t)USB_LEN_DEV_DESC) || (desc[0] != USB_LEN_DEV_DESC))
+  {
+    return sim_host_fail("device descriptor", ret);
+  }
+  dev->vid = (uint16_t)(desc[8] | ((uint16_t)desc[9] << 8));
+  dev->pid = (uint16_t)(desc[10] | ((uint16_t)desc[11] << 8));
+
+  ret = sim_host_get_descriptor(USB_DESC_TYPE_CONFIGURATION, 0U, 0U, config, USB_LEN_CFG_DESC);
+  sim_host_step("GET_DESCRIPTOR(Configuration) %ld", USB_LEN_CFG_DESC);
+  if (ret != (int32_t)USB_LEN_CFG_DESC)
+  {
+    return sim_host_fail("configuration descriptor header", ret);
+  }
+  total = (uint16_t)(config[2] | ((uint16_t)config[3] << 8));
+  if (total > sizeof(config))
+  {
+    return sim_host_fail("configuration descriptor size", SIM_PCD_ERROR);
+  }
+  ret = sim_host_get_descriptor(USB_DESC_TYPE_CONFIGURATION, 0U, 0U, config, total);
+  sim_host_step("GET_DESCRIPTOR(Configuration) %ld", total);
+  if (ret != (int32_t)total)
+  {
+    return sim_host_fail("configuration descriptor", ret);
+  }
+  dev->configuration = config[5];
+
+  for (pos = 0U; (pos + 2U) <= total; pos += config[pos])
+  {
+    if (config[pos] < 2U)
+    {
+      return sim_host_fail("configuration descriptor walk", SIM_PCD_ERROR);
+    }
+    if (config[pos + 1U] == USB_DESC_TYPE_INTERFACE)
+    {
+      if_class = config[pos + 5U];
+      if (if_class == 0x02U)
+      {
+        dev->cdc_if = config[pos + 2U];
+      }
+    }
+    else if (config[pos + 1U] == 0x21U)
+    {
+      dev->report_desc_len = (uint16_t)(config[pos + 7U] | ((uint16_t)config[pos + 8U] << 8));
+    }
+    else if ((config[pos + 1U] == USB_DESC_TYPE_ENDPOINT) && (if_class == 0x03U) &&
+             ((config[pos + 3U] & 0x03U) == 0x03U))
+    {
+      if ((config[pos + 2U] & 0x80U) == 0x80U)
+      {
+        dev->ep_in = config[pos + 2U];
+        dev->ep_in_size = (uint16_t)(config[pos + 4U] | ((uint16_t)config[pos + 5U] << 8));
+        dev->interval = config[pos + 6U];
+      }
+      else
+      {
+        dev->ep_out = config[pos + 2U];
+      }
+    }
+    else if ((config[pos + 1U] == USB_DESC_TYPE_ENDPOINT) && (if_class == 0x02U))
+    {
+      dev->cdc_notify = config[pos + 2U];
+    }
+    else if ((config[pos + 1U] == USB_DESC_TYPE_ENDPOINT) && (if_class == 0x0AU))
+    {
+      if ((config[pos + 2U] & 0x80U) == 0x80U)
+      {
+        dev->cdc_in = config[pos + 2U];
+      }
+      else
+      {
+        dev->cdc_out = config[pos + 2U];
+      }
+    }
+    else
+    {
+      /* IAD and class specific descriptors */
+    }
+  }
+  if ((dev->ep_in == 0U) || (dev->interval == 0U) || (dev->report_desc_len == 0U) ||
+      (dev->report_desc_len > sizeof(dev->report_desc)))
+  {
+    return sim_host_fail("HID interface", SIM_PCD_ERROR);
+  }
+
+  ret = sim_host_get_descriptor(USB_DESC_TYPE_STRING, 0U, 0U, string, 255U);
+  sim_host_step("GET_DESCRIPTOR(String %ld)", 0);
+  if ((ret < 4) || (string[1] != USB_DESC_TYPE_STRING))
+  {
+    return sim_host_fail("language ID string", ret);
+  }
+  for (i = 14U; i <= 16U; i++)
+  {
+    if (desc[i] == 0U)
+    {
+      continue;
+    }
+    ret = sim_host_get_descriptor(USB_DESC_TYPE_STRING, desc[i], SIM_HOST_LANGID, string, 255U);
+    sim_host_step("GET_DESCRIPTOR(String %ld)", desc[i]);
+    if ((ret < 2) || (string[1] != USB_DESC_TYPE_STRING) || (string[0] != ret))
+    {
+      return sim_host_fail("string descriptor", ret);
+    }
+  }
+
+  ret = sim_host_control(0x00U, USB_REQ_SET_CONFIGURATION, dev->configuration, 0U, NULL, 0U);
+  sim_host_step("SET_CONFIGURATION(%ld)", dev->configuration);
+  if (ret < 0)
+  {
+    return sim_host_fail("SET_CONFIGURATION", ret);
+  }
+
+  /* usbhid: SET_IDLE(0) is allowed to stall, the report descriptor is not */
+  (void)sim_host_control(0x21U, 0x0AU, 0U, 0U, NULL, 0U);
+  sim_host_step("SET_IDLE(%ld)", 0);
+
+  ret = sim_host_control(0x81U, USB_REQ_GET_DESCRIPTOR, 0x2200U, 0U, dev->report_desc, dev->report_desc_len);
+  sim_host_step("GET_DESCRIPTOR(Report) %ld", dev->report_desc_len);
+  if (ret != (int32_t)dev->report_desc_len)
+  {
+    return sim_host_fail("report descriptor", ret);
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Requests of the last enumeration, with the device side time of each.
+  * @param  steps: receives the recorded steps, bus resets included
+  * @retval number of steps
+  */
+uint32_t sim_host_enum_steps(const sim_host_step_t **steps)
+{
+  *steps = sim_host_steps;
+  return sim_host_step_count;
+}
+
+/**
+  * @brief  One 1 ms frame: SOF, then poll the interrupt IN endpoint when due.
+  * @param  dev: enumerated device
+  * @param  report: buffer for a received report
+  * @param  max: buffer size
+  * @retval report length, 0 when nothing was received, or a negative SIM_PCD_xxx code
+  */
+int32_t sim_host_frame(const sim_host_device_t *dev, uint8_t *report, uint32_t max)
+{
+  uint64_t start_us;
+  uint64_t len_us;
+  int32_t ret;
+
+  sim_host_bus_ms++;
+  if (sim_host_bus == SIM_HOST_BUS_SUSPENDED)
+  {
+    if (sim_host_bus_ms == SIM_HOST_SUSPEND_MS)
+    {
+      sim_pcd_suspend();
+    }
+    /* Remote wakeup: the host drives the resume from here */
+    if (sim_pcd_remote_wakeup(&start_us, &len_us) != 0U)
+    {
+      sim_host_resume();
+    }
+    return 0;
+  }
+  if (sim_host_bus == SIM_HOST_BUS_RESUMING)
+  {
+    if (sim_host_bus_ms < SIM_HOST_RESUME_MS)
+    {
+      return 0;
+    }
+    sim_host_bus = SIM_HOST_BUS_ACTIVE;
+  }
+
+  sim_pcd_sof();
+  sim_host_frames++;
+
+  if ((dev->interval == 0U) || ((sim_host_frames % dev->interval) != 0U))
+  {
+    return 0;
+  }
+
+  ret = sim_pcd_in(dev->ep_in, report, max);
+  return (ret == SIM_PCD_NAK) ? 0 : ret;
+}
+
+/**
+  * @brief  Stop sending frames.
+  * @retval None
+  */
+void sim_host_suspend(void)
+{
+  sim_host_bus = SIM_HOST_BUS_SUSPENDED;
+  sim_host_bus_ms = 0U;
+}
+
+/**
+  * @brief  Drive resume signalling, frames follow after SIM_HOST_RESUME_MS.
+  * @retval None
+  */
+void sim_host_resume(void)
+{
+  if (sim_host_bus == SIM_HOST_BUS_SUSPENDED)
+  {
+    sim_host_bus = SIM_HOST_BUS_RESUMING;
+    sim_host_bus_ms = 0U;
+    sim_pcd_resume();
+  }
+}
+
+/**
+  * @brief  Whether frames are being sent.
+  * @retval 1 when the bus is active
+  */
+uint8_t sim_host_bus_active(void)
+{
+  return (sim_host_bus == SIM_HOST_BUS_ACTIVE) ? 1U : 0U;
+}
+
+/**
+  * @brief  Read one packet from the CDC bulk IN endpoint.
+  * @param  dev: enumerated device
+  * @param  data: buffer for the packet
+  * @param  max: buffer size
+  * @retval packet length, 0 when the device NAKed, or a negative SIM_PCD_xxx code
+  */
+int32_t sim_host_bulk_in(const sim_host_device_t *dev, uint8_t *data, uint32_t max)
+{
+  int32_t ret;
+
+  if (dev->cdc_in == 0U)
+  {
+    return SIM_PCD_ERROR;
+  }
+
+  ret = sim_pcd_in(dev->cdc_in, data, max);
+  return (ret == SIM_PCD_NAK) ? 0 : ret;
+}
+
+/**
+  * @brief  Write one packet to the CDC bulk OUT endpoint.
+  * @param  dev: enumerated device
+  * @param  data: packet
+  * @param  len: packet length, at most the endpoint size
+  * @retval packet length, 0 when the device NAKed, or a negative SIM_PCD_xxx code
+  */
+int32_t sim_host_bulk_out(const sim_host_device_t *dev, const uint8_t *data, uint32_t len)
+{
+  int32_t ret;
+
+  if (dev->cdc_out == 0U)
+  {
+    return SIM_PCD_ERROR;
+  }
+
+  ret = sim_pcd_out(dev->cdc_out, data, len);
+  return (ret == SIM_PCD_NAK) ? 0 : ret;
+}
+
+/**
+  * @brief  Send an output report on the interrupt OUT endpoint.
+  * @param  dev: enumerated device
+  * @param  report: report, ID first
+  * @param  len: report length
+  * @retval report length, or a negative SIM_PCD_xxx code
+  */
+int32_t sim_host_out_report(const sim_host_device_t *dev, const uint8_t *report, uint32_t len)
+{
+  if (dev->ep_out == 0U)
+  {
+    return SIM_PCD_ERROR;
+  }
+
+  return sim_pcd_out(dev->ep_out, report, len);
+}
+
+/**
+  * @brief  Standard GET_DESCRIPTOR request.
+  * @param  type: descriptor type
+  * @param  index: descriptor index
+  * @param  lang: language ID for strings
+  * @param  buf: descriptor buffer
+  * @param  len: wLength
+  * @retval descriptor bytes received, or a negative SIM_PCD_xxx code
+  */
+static int32_t sim_host_get_descriptor(uint8_t type, uint8_t index, uint16_t lang, uint8_t *buf, uint16_t len)
+{
+  return sim_host_control(0x80U, USB_REQ_GET_DESCRIPTOR, (uint16_t)(((uint16_t)type << 8) | index), lang,
+                          buf, len);
+}
+
+/**
+  * @brief  Report a failed enumeration step.
+  * @param  step: what the host was doing
+  * @param  ret: result of the step
+  * @retval ret, or SIM_PCD_ERROR when the step returned a bad length
+  */
+static int32_t sim_host_fail(const char *step, int32_t ret)
+{
+  fprintf(stderr, "sim: enumeration failed at %s (%ld)\n", step, (long)ret);
+  return (ret < 0) ? ret : SIM_PCD_ERROR;
+}
+
+/**
+  * @brief  Bus reset, timed as a step of its own.
+  * @retval None
+  */
+static void sim_host_reset(void)
+{
+  uint64_t start = sim_host_ns();
+
+  sim_pcd_bus_reset();
+  sim_host_device_ns += sim_host_ns() - start;
+  sim_host_step("bus reset", 0);
+}
+
+/**
+  * @brief  Record the device side time and driver calls since the last step.
+  * @param  name: printf format of the step name, taking arg as a long
+  * @param  arg: request value or length in the name
+  * @retval None
+  */
+static void sim_host_step(const char *name, int32_t arg)
+{
+  sim_host_step_t *step;
+
+  if (sim_host_step_count < SIM_HOST_ENUM_STEPS)
+  {
+    step = &sim_host_steps[sim_host_step_count++];
+    (void)snprintf(step->name, sizeof(step->name), name, (long)arg);
+    step->device_ns = sim_host_device_ns;
+    step->driver_calls = sim_pcd_driver_calls() - sim_host_driver_calls;
+  }
+  sim_host_device_ns = 0U;
+  sim_host_driver_calls = sim_pcd_driver_calls();
+}
+
+/**
+  * @brief  Host monotonic clock.
+  * @retval nanoseconds
+  */
+static uint64_t sim_host_ns(void)
+{
+  struct timespec ts;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000U) + (uint64_t)ts.tv_nsec;
+}
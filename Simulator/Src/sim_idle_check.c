@@ -0,0 +1,181 @@
+/**
+  ******************************************************************************
+  * @file           : sim_idle_check.c
+  * @brief          : SET_IDLE repeats per report ID
+  ******************************************************************************
+  * SET_IDLE for the keyboard's report ID must make only that report repeat,
+  * every rate * 4 SOFs to the frame, and SET_IDLE for report ID 0 every
+  * report; at rate 0 a report equal to the last one is not resent.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "hid_controls.h"
+#include "usbd_hid.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_IDLE_RATE             2U      /* SET_IDLE duration, 4 ms units */
+#define SIM_IDLE_RUN_MS           100U
+
+/* Private typedef -----------------------------------------------------------*/
+/* Input reports of one report ID received during an idle run */
+typedef struct
+{
+  uint32_t count;
+  uint32_t changed;            /* reports unlike the previous one */
+  uint64_t gap_min;            /* time between two reports */
+  uint64_t gap_max;
+  uint64_t last_us;
+  uint8_t  last[64];
+} sim_idle_stats_t;
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t sim_idle_set(uint8_t id, uint8_t rate);
+static void sim_idle_run(uint32_t ms, sim_idle_stats_t *stats);
+
+/**
+  * @brief  Set idle rates per report ID and check the repeats the host gets.
+  * @note   The host polls every frame, so a repeat must reach it exactly
+  *         rate * 4 SOFs after the one before; a report equal to the last
+  *         one of its report ID must not be sent again.
+  * @retval None
+  */
+void sim_idle_check(void)
+{
+  uint32_t failures = sim_stats.failures;
+  sim_idle_stats_t stats[HID_IDLE_REPORT_IDS];
+  uint8_t rate[3];
+  uint8_t kbd_id = 0U;
+  uint32_t id;
+
+  /* A key and a consumer control held down */
+  (void)sim_firmware_key("17", 1U);
+  sim_idle_run(SIM_DRAIN_MS, stats);
+  for (id = 1U; id < HID_IDLE_REPORT_IDS; id++)
+  {
+    kbd_id = (stats[id].count != 0U) ? (uint8_t)id : kbd_id;
+  }
+  (void)hid_consumer_press(HID_CONSUMER_VOLUME_UP);
+  sim_idle_run(SIM_DRAIN_MS, stats);
+
+  /* The keyboard's report ID only */
+  if ((kbd_id == 0U) || (sim_idle_set(kbd_id, SIM_IDLE_RATE) < 0) ||
+      (sim_host_control(0xA1U, 0x02U, kbd_id, 0U, &rate[0], 1U) != 1) ||
+      (sim_host_control(0xA1U, 0x02U, HID_CONSUMER_REPORT_ID, 0U, &rate[1], 1U) != 1) ||
+      (sim_host_control(0xA1U, 0x02U, 0U, 0U, &rate[2], 1U) != 1) ||
+      (rate[0] != SIM_IDLE_RATE) || (rate[1] != 0U) || (rate[2] != 0U))
+  {
+    printf("sim: idle: SET_IDLE(%u) for report ID %u not kept apart\n", SIM_IDLE_RATE, kbd_id);
+    sim_stats.failures++;
+  }
+  sim_idle_run(SIM_IDLE_RUN_MS, stats);
+  printf("sim: idle: SET_IDLE(%u) for report ID %u: %lu repeats %llu..%llu us apart, %lu consumer reports\n",
+         SIM_IDLE_RATE, kbd_id, (unsigned long)stats[kbd_id].count,
+         (unsigned long long)stats[kbd_id].gap_min, (unsigned long long)stats[kbd_id].gap_max,
+         (unsigned long)stats[HID_CONSUMER_REPORT_ID].count);
+  if ((stats[kbd_id].count < ((SIM_IDLE_RUN_MS / (SIM_IDLE_RATE * HID_IDLE_UNIT_MS)) - 1U)) ||
+      (stats[kbd_id].changed != 0U) || (stats[HID_CONSUMER_REPORT_ID].count != 0U) ||
+      (stats[kbd_id].gap_min != (SIM_IDLE_RATE * HID_IDLE_UNIT_MS * SIM_FRAME_US)) ||
+      (stats[kbd_id].gap_max != stats[kbd_id].gap_min))
+  {
+    printf("sim: idle: keyboard repeats off the %u ms period, or repeats of another report ID\n",
+           SIM_IDLE_RATE * HID_IDLE_UNIT_MS);
+    sim_stats.failures++;
+  }
+
+  /* Back to report on change: the same report again is dropped */
+  (void)sim_idle_set(kbd_id, 0U);
+  (void)hid_consumer_press(HID_CONSUMER_VOLUME_UP);
+  sim_idle_run(SIM_IDLE_RUN_MS, stats);
+  for (id = 0U; id < HID_IDLE_REPORT_IDS; id++)
+  {
+    if (stats[id].count != 0U)
+    {
+      printf("sim: idle: %lu reports of ID %lu at idle rate 0\n", (unsigned long)stats[id].count,
+             (unsigned long)id);
+      sim_stats.failures++;
+    }
+  }
+
+  /* Report ID 0 sets every report ID */
+  (void)sim_idle_set(0U, 1U);
+  sim_idle_run(SIM_IDLE_RUN_MS, stats);
+  if ((sim_host_control(0xA1U, 0x02U, HID_CONSUMER_REPORT_ID, 0U, &rate[1], 1U) != 1) || (rate[1] != 1U) ||
+      (stats[kbd_id].gap_max != (HID_IDLE_UNIT_MS * SIM_FRAME_US)) ||
+      (stats[HID_CONSUMER_REPORT_ID].gap_max != (HID_IDLE_UNIT_MS * SIM_FRAME_US)) ||
+      (stats[kbd_id].changed != 0U) || (stats[HID_CONSUMER_REPORT_ID].changed != 0U))
+  {
+    printf("sim: idle: SET_IDLE(1) for report ID 0 did not apply to every report ID\n");
+    sim_stats.failures++;
+  }
+
+  /* A report ID the device does not have */
+  if ((sim_idle_set(0U, 0U) < 0) || (sim_idle_set(HID_IDLE_REPORT_IDS, 1U) != SIM_PCD_STALL))
+  {
+    printf("sim: idle: SET_IDLE for report ID %u not stalled\n", HID_IDLE_REPORT_IDS);
+    sim_stats.failures++;
+  }
+
+  (void)sim_firmware_key("17", 0U);
+  (void)hid_consumer_release();
+  sim_idle_run(SIM_DRAIN_MS, stats);
+
+  printf("sim: idle: rates kept per report ID, repeats on the SOF%s\n",
+         (sim_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Send SET_IDLE.
+  * @param  id: report ID, 0 for every one
+  * @param  rate: duration in 4 ms units, 0 to report on change only
+  * @retval result of the control transfer
+  */
+static int32_t sim_idle_set(uint8_t id, uint8_t rate)
+{
+  return sim_host_control(0x21U, 0x0AU, (uint16_t)(((uint16_t)rate << 8) | id), 0U, NULL, 0U);
+}
+
+/**
+  * @brief  Run the firmware and account for the reports of each report ID.
+  * @param  ms: how long
+  * @param  stats: HID_IDLE_REPORT_IDS entries, reset first
+  * @retval None
+  */
+static void sim_idle_run(uint32_t ms, sim_idle_stats_t *stats)
+{
+  uint64_t end = sim_clock_us() + ((uint64_t)ms * 1000U);
+  sim_idle_stats_t *id;
+  uint8_t report[64];
+  uint64_t gap;
+  int32_t len;
+  uint32_t i;
+
+  memset(stats, 0, HID_IDLE_REPORT_IDS * sizeof(*stats));
+  for (i = 0U; i < HID_IDLE_REPORT_IDS; i++)
+  {
+    stats[i].gap_min = UINT64_MAX;
+  }
+
+  while (sim_clock_us() < end)
+  {
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+    if ((len <= 0) || (report[0] >= HID_IDLE_REPORT_IDS))
+    {
+      continue;
+    }
+    id = &stats[report[0]];
+    if (id->count != 0U)
+    {
+      gap = sim_clock_us() - id->last_us;
+      id->gap_min = (gap < id->gap_min) ? gap : id->gap_min;
+      id->gap_max = (gap > id->gap_max) ? gap : id->gap_max;
+      id->changed += (memcmp(id->last, report, (size_t)len) != 0) ? 1U : 0U;
+    }
+    memcpy(id->last, report, (size_t)len);
+    id->last_us = sim_clock_us();
+    id->count++;
+  }
+}
@@ -0,0 +1,446 @@
+/**
+  ******************************************************************************
+  * @file           : sim_keymap.c
+  * @brief          : Host side keyboard layouts for the simulator
+  ******************************************************************************
+  * Turns key presses back into characters the way the host's xkb layouts
+  * "us", "gb", "de" and "fr" do: each key has a base, a Shift and an AltGr
+  * level, a dead key latches until the next key that types something, and
+  * the pair is looked up in the layout's compose list; a dead key followed by
+  * Space types the accent on its own. The tables describe keys, not
+  * characters, and share nothing with the firmware's kbd_layout.c, so typing
+  * a layout's every character and reading it back here checks both.
+  * Caps Lock is taken to be off.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "hid_keyboard.h"
+#include "kbd_layout.h"
+#include <stdlib.h>
+
+/* Private define ------------------------------------------------------------*/
+/* A level that is a dead key holds its spacing accent with this flag */
+#define SIM_DEAD                  0x80000000UL
+#define SIM_DEAD_CIRCUMFLEX       (SIM_DEAD | 0x005EUL)
+#define SIM_DEAD_GRAVE            (SIM_DEAD | 0x0060UL)
+#define SIM_DEAD_DIAERESIS        (SIM_DEAD | 0x00A8UL)
+#define SIM_DEAD_ACUTE            (SIM_DEAD | 0x00B4UL)
+
+#define SIM_KEYMAP_LETTER_FIRST   0x04U
+#define SIM_KEYMAP_LETTER_COUNT   26U
+#define SIM_KEYMAP_COMPOSE_MAX    12U
+
+#define SIM_KEYMAP_SHIFT          (KBD_MOD_LSHIFT | KBD_MOD_RSHIFT)
+#define SIM_KEYMAP_ALTGR          KBD_MOD_RALT
+
+#define SIM_KEYMAP_TABLE(table)   (table), (sizeof(table) / sizeof((table)[0]))
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint8_t  usage;
+  uint32_t level[3];           /* base, Shift, AltGr; 0 for nothing */
+} sim_keymap_key_t;
+
+typedef struct
+{
+  uint32_t    dead;
+  const char *base;            /* letters the dead key combines with */
+  uint16_t    result[SIM_KEYMAP_COMPOSE_MAX];
+} sim_keymap_compose_t;
+
+typedef struct
+{
+  const char                 *name;
+  const char                 *letters;    /* usages 0x04..0x1D, ' ' for a key that is not a letter */
+  const sim_keymap_key_t     *keys;
+  uint32_t                    key_count;
+  const sim_keymap_compose_t *compose;
+  uint32_t                    compose_count;
+} sim_keymap_t;
+
+/* Private variables ---------------------------------------------------------*/
+/* Keys every layout shares */
+static const sim_keymap_key_t sim_keymap_common[] =
+{
+  { 0x28U, { 0x0AU, 0U, 0U } },                  /* Enter */
+  { 0x29U, { 0x1BU, 0U, 0U } },                  /* Escape */
+  { 0x2AU, { 0x08U, 0U, 0U } },                  /* Backspace */
+  { 0x2BU, { 0x09U, 0U, 0U } },                  /* Tab */
+  { 0x2CU, { ' ', 0U, 0U } },                    /* Space */
+};
+
+static const sim_keymap_key_t sim_keymap_us[] =
+{
+  { 0x1EU, { '1', '!', 0U } },   { 0x1FU, { '2', '@', 0U } },   { 0x20U, { '3', '#', 0U } },
+  { 0x21U, { '4', '$', 0U } },   { 0x22U, { '5', '%', 0U } },   { 0x23U, { '6', '^', 0U } },
+  { 0x24U, { '7', '&', 0U } },   { 0x25U, { '8', '*', 0U } },   { 0x26U, { '9', '(', 0U } },
+  { 0x27U, { '0', ')', 0U } },   { 0x2DU, { '-', '_', 0U } },   { 0x2EU, { '=', '+', 0U } },
+  { 0x2FU, { '[', '{', 0U } },   { 0x30U, { ']', '}', 0U } },   { 0x31U, { '\\', '|', 0U } },
+  { 0x33U, { ';', ':', 0U } },   { 0x34U, { '\'', '"', 0U } },  { 0x35U, { '`', '~', 0U } },
+  { 0x36U, { ',', '<', 0U } },   { 0x37U, { '.', '>', 0U } },   { 0x38U, { '/', '?', 0U } },
+};
+
+static const sim_keymap_key_t sim_keymap_gb[] =
+{
+  { 0x1EU, { '1', '!', 0U } },   { 0x1FU, { '2', '"', 0U } },   { 0x20U, { '3', 0xA3U, 0U } },
+  { 0x21U, { '4', '$', 0x20ACU } },                             { 0x22U, { '5', '%', 0U } },
+  { 0x23U, { '6', '^', 0U } },   { 0x24U, { '7', '&', 0U } },   { 0x25U, { '8', '*', 0U } },
+  { 0x26U, { '9', '(', 0U } },   { 0x27U, { '0', ')', 0U } },   { 0x2DU, { '-', '_', 0U } },
+  { 0x2EU, { '=', '+', 0U } },   { 0x2FU, { '[', '{', 0U } },   { 0x30U, { ']', '}', 0U } },
+  { 0x32U, { '#', '~', 0U } },   { 0x33U, { ';', ':', 0U } },   { 0x34U, { '\'', '@', 0U } },
+  { 0x35U, { '`', 0xACU, 0U } }, { 0x36U, { ',', '<', 0U } },   { 0x37U, { '.', '>', 0U } },
+  { 0x38U, { '/', '?', 0U } },   { 0x64U, { '\\', '|', 0U } },
+};
+
+static const sim_keymap_key_t sim_keymap_de[] =
+{
+  { 0x1EU, { '1', '!', 0U } },   { 0x1FU, { '2', '"', 0xB2U } },
+  { 0x20U, { '3', 0xA7U, 0xB3U } },                             { 0x21U, { '4', '$', 0U } },
+  { 0x22U, { '5', '%', 0U } },   { 0x23U, { '6', '&', 0U } },   { 0x24U, { '7', '/', '{' } },
+  { 0x25U, { '8', '(', '[' } },  { 0x26U, { '9', ')', ']' } },  { 0x27U, { '0', '=', '}' } },
+  { 0x2DU, { 0xDFU, '?', '\\' } },
+  { 0x2EU, { SIM_DEAD_ACUTE, SIM_DEAD_GRAVE, 0U } },
+  { 0x2FU, { 0xFCU, 0xDCU, 0U } },                              { 0x30U, { '+', '*', '~' } },
+  { 0x32U, { '#', '\'', 0U } },  { 0x33U, { 0xF6U, 0xD6U, 0U } },
+  { 0x34U, { 0xE4U, 0xC4U, 0U } },
+  { 0x35U, { SIM_DEAD_CIRCUMFLEX, 0xB0U, 0U } },
+  { 0x36U, { ',', ';', 0U } },   { 0x37U, { '.', ':', 0U } },   { 0x38U, { '-', '_', 0U } },
+  { 0x64U, { '<', '>', '|' } },
+  { 0x14U, { 0U, 0U, '@' } },    { 0x08U, { 0U, 0U, 0x20ACU } },
+  { 0x10U, { 0U, 0U, 0xB5U } },
+};
+
+static const sim_keymap_key_t sim_keymap_fr[] =
+{
+  { 0x35U, { 0xB2U, 0U, 0U } },  { 0x1EU, { '&', '1', 0U } },   { 0x1FU, { 0xE9U, '2', '~' } },
+  { 0x20U, { '"', '3', '#' } },  { 0x21U, { '\'', '4', '{' } }, { 0x22U, { '(', '5', '[' } },
+  { 0x23U, { '-', '6', '|' } },  { 0x24U, { 0xE8U, '7', '`' } },
+  { 0x25U, { '_', '8', '\\' } }, { 0x26U, { 0xE7U, '9', '^' } },
+  { 0x27U, { 0xE0U, '0', '@' } },
+  { 0x2DU, { ')', 0xB0U, ']' } },                               { 0x2EU, { '=', '+', '}' } },
+  { 0x2FU, { SIM_DEAD_CIRCUMFLEX, SIM_DEAD_DIAERESIS, 0U } },
+  { 0x30U, { '$', 0xA3U, 0xA4U } },                             { 0x32U, { '*', 0xB5U, 0U } },
+  { 0x34U, { 0xF9U, '%', 0U } }, { 0x10U, { ',', '?', 0U } },   { 0x36U, { ';', '.', 0U } },
+  { 0x37U, { ':', '/', 0U } },   { 0x38U, { '!', 0xA7U, 0U } }, { 0x64U, { '<', '>', 0U } },
+  { 0x33U, { 'm', 'M', 0U } },   { 0x08U, { 0U, 0U, 0x20ACU } },
+};
+
+static const sim_keymap_compose_t sim_keymap_de_compose[] =
+{
+  { SIM_DEAD_CIRCUMFLEX, "aeiouAEIOU",
+    { 0xE2U, 0xEAU, 0xEEU, 0xF4U, 0xFBU, 0xC2U, 0xCAU, 0xCEU, 0xD4U, 0xDBU } },
+  { SIM_DEAD_ACUTE,      "aeiouAEIOU",
+    { 0xE1U, 0xE9U, 0xEDU, 0xF3U, 0xFAU, 0xC1U, 0xC9U, 0xCDU, 0xD3U, 0xDAU } },
+  { SIM_DEAD_GRAVE,      "aeiouAEIOU",
+    { 0xE0U, 0xE8U, 0xECU, 0xF2U, 0xF9U, 0xC0U, 0xC8U, 0xCCU, 0xD2U, 0xD9U } },
+};
+
+static const sim_keymap_compose_t sim_keymap_fr_compose[] =
+{
+  { SIM_DEAD_CIRCUMFLEX, "aeiouAEIOU",
+    { 0xE2U, 0xEAU, 0xEEU, 0xF4U, 0xFBU, 0xC2U, 0xCAU, 0xCEU, 0xD4U, 0xDBU } },
+  { SIM_DEAD_DIAERESIS,  "aeiouyAEIOU",
+    { 0xE4U, 0xEBU, 0xEFU, 0xF6U, 0xFCU, 0xFFU, 0xC4U, 0xCBU, 0xCFU, 0xD6U, 0xDCU } },
+};
+
+/* Indexed by kbd_layout_id_t */
+static const sim_keymap_t sim_keymaps[] =
+{
+  { "us", "abcdefghijklmnopqrstuvwxyz", SIM_KEYMAP_TABLE(sim_keymap_us), NULL, 0U },
+  { "uk", "abcdefghijklmnopqrstuvwxyz", SIM_KEYMAP_TABLE(sim_keymap_gb), NULL, 0U },
+  { "de", "abcdefghijklmnopqrstuvwxzy", SIM_KEYMAP_TABLE(sim_keymap_de), SIM_KEYMAP_TABLE(sim_keymap_de_compose) },
+  { "fr", "qbcdefghijkl noparstuvzxyw", SIM_KEYMAP_TABLE(sim_keymap_fr), SIM_KEYMAP_TABLE(sim_keymap_fr_compose) },
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t sim_keymap_level(const sim_keymap_t *map, uint8_t usage, uint32_t level);
+static uint32_t sim_keymap_compose(const sim_keymap_t *map, uint32_t dead, uint32_t base);
+static void sim_keymap_add(uint32_t *codepoints, uint32_t *count, uint32_t max, uint32_t codepoint);
+static int sim_keymap_cmp(const void *a, const void *b);
+
+/**
+  * @brief  Number of layouts the host knows.
+  * @retval count, the same as KBD_LAYOUT_COUNT when the tables agree
+  */
+uint32_t sim_keymap_count(void)
+{
+  return sizeof(sim_keymaps) / sizeof(sim_keymaps[0]);
+}
+
+/**
+  * @brief  Short name of a host layout.
+  * @param  layout: index
+  * @retval name, "" for an unknown layout
+  */
+const char *sim_keymap_name(uint8_t layout)
+{
+  return (layout < sim_keymap_count()) ? sim_keymaps[layout].name : "";
+}
+
+/**
+  * @brief  Interpret one key going down.
+  * @param  layout: index
+  * @param  usage: Keyboard/Keypad page usage
+  * @param  modifiers: modifiers down, KBD_MOD_xxx
+  * @param  dead: dead key latched, 0 for none; updated
+  * @param  codepoint: receives the character typed
+  * @retval 1 when a character is typed, 0 when a dead key latched,
+  *         -1 when the key types nothing on the layout
+  */
+int32_t sim_keymap_press(uint8_t layout, uint8_t usage, uint8_t modifiers, uint32_t *dead, uint32_t *codepoint)
+{
+  const sim_keymap_t *map;
+  uint32_t level = 0U;
+  uint32_t value;
+
+  if (layout >= sim_keymap_count())
+  {
+    return -1;
+  }
+  map = &sim_keymaps[layout];
+
+  if ((modifiers & SIM_KEYMAP_ALTGR) != 0U)
+  {
+    /* No layout here has a fourth level */
+    if ((modifiers & SIM_KEYMAP_SHIFT) != 0U)
+    {
+      return -1;
+    }
+    level = 2U;
+  }
+  else if ((modifiers & SIM_KEYMAP_SHIFT) != 0U)
+  {
+    level = 1U;
+  }
+  else
+  {
+    /* Base level */
+  }
+
+  value = sim_keymap_level(map, usage, level);
+  if (value == 0U)
+  {
+    return -1;
+  }
+
+  if ((value & SIM_DEAD) != 0U)
+  {
+    if (*dead != 0U)
+    {
+      return -1;
+    }
+    *dead = value;
+    return 0;
+  }
+
+  if (*dead != 0U)
+  {
+    value = sim_keymap_compose(map, *dead, value);
+    *dead = 0U;
+    if (value == 0U)
+    {
+      return -1;
+    }
+  }
+
+  *codepoint = value;
+  return 1;
+}
+
+/**
+  * @brief  List every character a layout types, dead key compositions included.
+  * @param  layout: index
+  * @param  codepoints: receives the characters, ascending
+  * @param  max: room in codepoints
+  * @retval number of characters
+  */
+uint32_t sim_keymap_chars(uint8_t layout, uint32_t *codepoints, uint32_t max)
+{
+  const sim_keymap_t *map;
+  uint32_t count = 0U;
+  uint32_t value;
+  uint32_t level;
+  uint32_t usage;
+  uint32_t i;
+  uint32_t j;
+
+  if (layout >= sim_keymap_count())
+  {
+    return 0U;
+  }
+  map = &sim_keymaps[layout];
+
+  for (usage = HID_USAGE_FIRST_KEY; usage < HID_USAGE_MODIFIER_FIRST; usage++)
+  {
+    for (level = 0U; level < 3U; level++)
+    {
+      value = sim_keymap_level(map, (uint8_t)usage, level);
+      if ((value & SIM_DEAD) != 0U)
+      {
+        value = sim_keymap_compose(map, value, ' ');
+      }
+      sim_keymap_add(codepoints, &count, max, value);
+    }
+  }
+
+  for (i = 0U; i < map->compose_count; i++)
+  {
+    for (j = 0U; map->compose[i].base[j] != '\0'; j++)
+    {
+      sim_keymap_add(codepoints, &count, max, map->compose[i].result[j]);
+    }
+  }
+
+  qsort(codepoints, count, sizeof(codepoints[0]), sim_keymap_cmp);
+  for (i = 0U, j = 0U; i < count; i++)
+  {
+    if ((j == 0U) || (codepoints[i] != codepoints[j - 1U]))
+    {
+      codepoints[j++] = codepoints[i];
+    }
+  }
+
+  return j;
+}
+
+/**
+  * @brief  Encode a code point as UTF-8.
+  * @param  codepoint: Unicode scalar value
+  * @param  out: receives up to 4 bytes
+  * @retval bytes written
+  */
+uint32_t sim_utf8_encode(uint32_t codepoint, char *out)
+{
+  if (codepoint < 0x80U)
+  {
+    out[0] = (char)codepoint;
+    return 1U;
+  }
+  if (codepoint < 0x800U)
+  {
+    out[0] = (char)(0xC0U | (codepoint >> 6));
+    out[1] = (char)(0x80U | (codepoint & 0x3FU));
+    return 2U;
+  }
+  if (codepoint < 0x10000U)
+  {
+    out[0] = (char)(0xE0U | (codepoint >> 12));
+    out[1] = (char)(0x80U | ((codepoint >> 6) & 0x3FU));
+    out[2] = (char)(0x80U | (codepoint & 0x3FU));
+    return 3U;
+  }
+  out[0] = (char)(0xF0U | (codepoint >> 18));
+  out[1] = (char)(0x80U | ((codepoint >> 12) & 0x3FU));
+  out[2] = (char)(0x80U | ((codepoint >> 6) & 0x3FU));
+  out[3] = (char)(0x80U | (codepoint & 0x3FU));
+  return 4U;
+}
+
+/**
+  * @brief  What a key types at one level.
+  * @param  map: layout
+  * @param  usage: Keyboard/Keypad page usage
+  * @param  level: 0 base, 1 Shift, 2 AltGr
+  * @retval character, dead key, or 0 for nothing
+  */
+static uint32_t sim_keymap_level(const sim_keymap_t *map, uint8_t usage, uint32_t level)
+{
+  uint32_t value = 0U;
+  uint32_t letter = 0U;
+  uint32_t i;
+
+  for (i = 0U; i < (sizeof(sim_keymap_common) / sizeof(sim_keymap_common[0])); i++)
+  {
+    if (sim_keymap_common[i].usage == usage)
+    {
+      return sim_keymap_common[i].level[level];
+    }
+  }
+
+  for (i = 0U; i < map->key_count; i++)
+  {
+    if (map->keys[i].usage == usage)
+    {
+      value = map->keys[i].level[level];
+    }
+  }
+
+  if ((usage >= SIM_KEYMAP_LETTER_FIRST) && (usage < (SIM_KEYMAP_LETTER_FIRST + SIM_KEYMAP_LETTER_COUNT)))
+  {
+    letter = (uint8_t)map->letters[usage - SIM_KEYMAP_LETTER_FIRST];
+  }
+  if ((value == 0U) && (letter != (uint32_t)' ') && (letter != 0U) && (level < 2U))
+  {
+    value = (level == 0U) ? letter : (letter - ('a' - 'A'));
+  }
+
+  return value;
+}
+
+/**
+  * @brief  Combine a dead key with the character that follows it.
+  * @param  map: layout
+  * @param  dead: dead key
+  * @param  base: character typed after it
+  * @retval composed character, 0 when the pair means nothing
+  */
+static uint32_t sim_keymap_compose(const sim_keymap_t *map, uint32_t dead, uint32_t base)
+{
+  uint32_t i;
+  uint32_t j;
+
+  if (base == (uint32_t)' ')
+  {
+    return dead & ~SIM_DEAD;
+  }
+
+  for (i = 0U; i < map->compose_count; i++)
+  {
+    if (map->compose[i].dead != dead)
+    {
+      continue;
+    }
+    for (j = 0U; map->compose[i].base[j] != '\0'; j++)
+    {
+      if ((uint32_t)(uint8_t)map->compose[i].base[j] == base)
+      {
+        return map->compose[i].result[j];
+      }
+    }
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  Append a character to a list, ignoring 0.
+  * @param  codepoints: list
+  * @param  count: entries, updated
+  * @param  max: room in the list
+  * @param  codepoint: character
+  * @retval None
+  */
+static void sim_keymap_add(uint32_t *codepoints, uint32_t *count, uint32_t max, uint32_t codepoint)
+{
+  if ((codepoint != 0U) && (*count < max))
+  {
+    codepoints[(*count)++] = codepoint;
+  }
+}
+
+/**
+  * @brief  qsort order of code points.
+  * @param  a: first code point
+  * @param  b: second code point
+  * @retval <0, 0, >0
+  */
+static int sim_keymap_cmp(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
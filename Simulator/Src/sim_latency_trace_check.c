@@ -0,0 +1,110 @@
+/**
+  ******************************************************************************
+  * @file           : sim_latency_trace_check.c
+  * @brief          : Latency trace histograms against the host's latencies
+  ******************************************************************************
+  * Once the script has run, the latency trace histograms are read back
+  * through feature report 7, as a host tool would, and checked against the
+  * latencies the host saw.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "latency_trace.h"
+#include <stdio.h>
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t sim_get32(const uint8_t *src);
+
+/**
+  * @brief  Read the latency trace histograms back and check them.
+  * @note   The firmware traces from the scan or edge that saw a change, the
+  *         host from the change itself, so no traced total may exceed the
+  *         longest latency the host measured.
+  * @retval None
+  */
+void sim_latency_trace_check(void)
+{
+  static const char *const names[LATENCY_INTERVALS] =
+  {
+    "debounce", "encode", "transmit", "wire", "total"
+  };
+  uint8_t report[LATENCY_TRACE_REPORT_SIZE];
+  uint32_t interval;
+  uint32_t first;
+  uint32_t b;
+  uint32_t count;
+  uint32_t min;
+  uint32_t max;
+  uint32_t sum;
+  uint32_t cycles_per_us = 0U;
+
+  if ((latency_trace_bucket(0U) != 0U) ||
+      (latency_trace_bucket((1UL << LATENCY_TRACE_BUCKET_SHIFT) - 1U) != 0U) ||
+      (latency_trace_bucket(1UL << (LATENCY_TRACE_BUCKET_SHIFT + 3U)) != 3U) ||
+      (latency_trace_bucket((1UL << (LATENCY_TRACE_BUCKET_SHIFT + 4U)) - 1U) != 3U) ||
+      (latency_trace_bucket(UINT32_MAX) != (LATENCY_TRACE_BUCKETS - 1U)))
+  {
+    printf("sim: latency trace bucket boundaries wrong\n");
+    sim_stats.failures++;
+  }
+
+  for (interval = 0U; interval < LATENCY_INTERVALS; interval++)
+  {
+    count = 0U;
+    min = 0U;
+    max = 0U;
+    sum = 0U;
+    for (first = 0U; first < LATENCY_TRACE_BUCKETS; first += LATENCY_TRACE_REPORT_BUCKETS)
+    {
+      report[0] = LATENCY_TRACE_REPORT_ID;
+      report[1] = LATENCY_TRACE_OP_SELECT;
+      report[2] = (uint8_t)interval;
+      report[3] = (uint8_t)first;
+      if ((sim_host_control(0x21U, 0x09U, 0x0300U | LATENCY_TRACE_REPORT_ID, 0U, report, 4U) < 0) ||
+          (sim_host_control(0xA1U, 0x01U, 0x0300U | LATENCY_TRACE_REPORT_ID, 0U, report,
+                            sizeof(report)) != (int32_t)sizeof(report)) ||
+          (report[1] != interval) || (report[2] != first))
+      {
+        printf("sim: latency trace report %u not served\n", (unsigned)LATENCY_TRACE_REPORT_ID);
+        sim_stats.failures++;
+        return;
+      }
+      cycles_per_us = report[3];
+      count = sim_get32(&report[4]);
+      min = sim_get32(&report[8]);
+      max = sim_get32(&report[12]);
+      for (b = 0U; b < LATENCY_TRACE_REPORT_BUCKETS; b++)
+      {
+        sum += (uint32_t)report[16U + (2U * b)] | ((uint32_t)report[17U + (2U * b)] << 8);
+      }
+    }
+
+    printf("sim: latency trace %-8s %lu traces, cycles: min %lu max %lu\n", names[interval],
+           (unsigned long)count, (unsigned long)min, (unsigned long)max);
+    if ((count == 0U) || (min > max) || (sum != count) || (cycles_per_us == 0U))
+    {
+      printf("sim: latency trace %s histogram inconsistent\n", names[interval]);
+      sim_stats.failures++;
+    }
+    else if ((interval == (uint32_t)LATENCY_INTERVAL_TOTAL) &&
+             ((uint64_t)(max / cycles_per_us) > sim_stats.latency_max))
+    {
+      printf("sim: latency trace total %lu us exceeds the host maximum\n",
+             (unsigned long)(max / cycles_per_us));
+      sim_stats.failures++;
+    }
+  }
+}
+
+/**
+  * @brief  Load a little-endian word.
+  * @param  src: source
+  * @retval word
+  */
+static uint32_t sim_get32(const uint8_t *src)
+{
+  return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) |
+         ((uint32_t)src[3] << 24);
+}
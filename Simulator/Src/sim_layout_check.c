@@ -0,0 +1,219 @@
+/**
+  ******************************************************************************
+  * @file           : sim_layout_check.c
+  * @brief          : Every character of every layout, typed and read back
+  ******************************************************************************
+  * Every layout is selected through the configuration feature report in
+  * turn and every character the host's own description of it can produce,
+  * dead key compositions included, is typed and read back; the firmware's
+  * table lookup time is reported.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "hid_config.h"
+#include "usbd_hid.h"
+#include "kbd_layout.h"
+#include "typing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_LAYOUT_PASSES         2U
+#define SIM_LAYOUT_CHARS          256U
+#define SIM_LAYOUT_LAST_CHECKED   0x20ACUL  /* firmware lookups tried up to this code point */
+#define SIM_LAYOUT_BENCH_REPEAT   20000U
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+static char sim_layout_text[SIM_TYPING_SIZE];
+
+/* Private function prototypes -----------------------------------------------*/
+static void sim_layout_bench(uint8_t layout, const uint32_t *codepoints, uint32_t count);
+static int sim_layout_cmp(const void *a, const void *b);
+
+/**
+  * @brief  Select the typing layout through the configuration feature report
+  *         and read it back, as a host tool would.
+  * @param  layout: kbd_layout_id_t
+  * @retval 0 on success
+  */
+int32_t sim_layout_select(uint8_t layout)
+{
+  uint8_t report[HID_CONFIG_REPORT_SIZE];
+
+  memset(report, 0, sizeof(report));
+  report[0] = HID_CONFIG_PARAM_REPORT_ID;
+  report[1] = HID_CONFIG_LAYOUT;
+  report[2] = HID_CONFIG_OP_WRITE;
+  report[3] = layout;
+
+  if ((sim_host_control(0x21U, 0x09U, 0x0300U | HID_CONFIG_PARAM_REPORT_ID, 0U, report, sizeof(report)) < 0) ||
+      (sim_host_control(0xA1U, 0x01U, 0x0300U | HID_CONFIG_PARAM_REPORT_ID, 0U, report,
+                        sizeof(report)) != (int32_t)sizeof(report)) ||
+      (report[1] != HID_CONFIG_LAYOUT) || (report[2] != HID_CONFIG_OK) || (report[3] != layout) ||
+      (typing_get_layout() != layout))
+  {
+    printf("sim: layout %u cannot be selected\n", layout);
+    sim_stats.failures++;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Type every character of every layout and read it back.
+  * @note   Both tables must cover printable ASCII, the firmware must type
+  *         every character the host layout produces, and nothing else.
+  * @retval None
+  */
+void sim_layout_check(void)
+{
+  uint32_t codepoints[SIM_LAYOUT_CHARS];
+  kbd_stroke_t strokes[KBD_STROKES_MAX];
+  uint32_t count;
+  uint32_t len;
+  uint32_t dead_keyed;
+  uint32_t extra;
+  uint32_t c;
+  uint32_t i;
+  uint8_t layout;
+  uint8_t n;
+
+  if (sim_keymap_count() != (uint32_t)KBD_LAYOUT_COUNT)
+  {
+    printf("sim: layout: host knows %lu layouts, firmware %u\n", (unsigned long)sim_keymap_count(),
+           (unsigned)KBD_LAYOUT_COUNT);
+    sim_stats.failures++;
+    return;
+  }
+
+  for (layout = 0U; layout < (uint8_t)KBD_LAYOUT_COUNT; layout++)
+  {
+    count = sim_keymap_chars(layout, codepoints, SIM_LAYOUT_CHARS);
+    dead_keyed = 0U;
+    extra = 0U;
+
+    if (strcmp(kbd_layout_name(layout), sim_keymap_name(layout)) != 0)
+    {
+      printf("sim: layout %u is \"%s\" in the firmware, \"%s\" on the host\n", layout, kbd_layout_name(layout),
+             sim_keymap_name(layout));
+      sim_stats.failures++;
+      continue;
+    }
+
+    for (c = ' '; c <= '~'; c++)
+    {
+      if ((bsearch(&c, codepoints, count, sizeof(codepoints[0]), sim_layout_cmp) == NULL) ||
+          (kbd_layout_lookup(layout, c, strokes) == 0U))
+      {
+        printf("sim: layout %s cannot type '%c'\n", sim_keymap_name(layout), (char)c);
+        sim_stats.failures++;
+      }
+    }
+
+    /* Nothing the host would read as another character */
+    for (c = 1U; c <= SIM_LAYOUT_LAST_CHECKED; c++)
+    {
+      n = kbd_layout_lookup(layout, c, strokes);
+      if (n == 0U)
+      {
+        continue;
+      }
+      if (bsearch(&c, codepoints, count, sizeof(codepoints[0]), sim_layout_cmp) == NULL)
+      {
+        printf("sim: layout %s types U+%04lX, which the host layout cannot\n", sim_keymap_name(layout),
+               (unsigned long)c);
+        sim_stats.failures++;
+      }
+      dead_keyed += (n > 1U) ? 1U : 0U;
+      extra += (c > '~') ? 1U : 0U;
+    }
+
+    len = 0U;
+    for (i = 0U; i < (SIM_LAYOUT_PASSES * count); i++)
+    {
+      len += sim_utf8_encode(codepoints[i % count], &sim_layout_text[len]);
+    }
+    sim_layout_text[len] = '\0';
+
+    printf("sim: layout %s: %lu chars, %lu beyond ASCII, %lu through a dead key\n", sim_keymap_name(layout),
+           (unsigned long)count, (unsigned long)extra, (unsigned long)dead_keyed);
+    if (sim_layout_select(layout) == 0)
+    {
+      sim_typing_run(sim_layout_text, sim_layout_text, 1U, layout, 0U, 0U);
+    }
+    sim_layout_bench(layout, codepoints, count);
+  }
+
+  if ((sim_layout_select(KBD_LAYOUT_DEFAULT) != 0) ||
+      (USBD_HID_SetPollingInterval(&hUsbDeviceFS, HID_FS_BINTERVAL) != (uint8_t)USBD_OK) ||
+      (sim_host_enumerate(&sim_device) != 0))
+  {
+    sim_stats.failures++;
+  }
+}
+
+/**
+  * @brief  Time the firmware lookup of a layout's characters on the host.
+  * @param  layout: kbd_layout_id_t
+  * @param  codepoints: characters of the layout
+  * @param  count: number of characters
+  * @retval None
+  */
+static void sim_layout_bench(uint8_t layout, const uint32_t *codepoints, uint32_t count)
+{
+  kbd_stroke_t strokes[KBD_STROKES_MAX];
+  struct timespec t0;
+  struct timespec t1;
+  volatile uint32_t sink = 0U;
+  uint64_t ns[2] = { 0U, 0U };
+  uint32_t first[3] = { 0U, 0U, count };
+  uint32_t kind;
+  uint32_t r;
+  uint32_t i;
+
+  /* ASCII and the rest apart, indexed and bisected; the list is ascending */
+  while ((first[1] < count) && (codepoints[first[1]] <= 0x7FU))
+  {
+    first[1]++;
+  }
+
+  for (kind = 0U; kind < 2U; kind++)
+  {
+    (void)clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (r = 0U; r < SIM_LAYOUT_BENCH_REPEAT; r++)
+    {
+      for (i = first[kind]; i < first[kind + 1U]; i++)
+      {
+        sink += kbd_layout_lookup(layout, codepoints[i], strokes);
+      }
+    }
+    (void)clock_gettime(CLOCK_MONOTONIC, &t1);
+    ns[kind] = ((uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000U) + (uint64_t)t1.tv_nsec - (uint64_t)t0.tv_nsec;
+  }
+  (void)sink;
+
+  printf("sim: layout %s lookup ns: ASCII %.1f, other %.1f\n", sim_keymap_name(layout),
+         (first[1] != 0U) ? (double)ns[0] / ((double)first[1] * SIM_LAYOUT_BENCH_REPEAT) : 0.0,
+         (count != first[1]) ? (double)ns[1] / ((double)(count - first[1]) * SIM_LAYOUT_BENCH_REPEAT) : 0.0);
+}
+
+/**
+  * @brief  bsearch order of code points.
+  * @param  a: first code point
+  * @param  b: second code point
+  * @retval <0, 0, >0
+  */
+static int sim_layout_cmp(const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+
+  return (x > y) - (x < y);
+}
@@ -0,0 +1,687 @@
+/**
+  ******************************************************************************
+  * @file           : sim_macro.c
+  * @brief          : Host side macro assembler and image builder
+  ******************************************************************************
+  * Source, one statement per line, '#' starts a comment:
+  *   macro                   start the next macro
+  *   down <usage>            usages are numbers, 0x04 for A
+  *   up <usage>
+  *   tap <usage>
+  *   release
+  *   delay <ms>
+  *   text "<UTF-8>"          escapes \n \t \\ \" \xHH
+  *   repeat <count>          up to the matching loop
+  *   loop
+  * Every macro ends with an implicit END.
+  *
+  * The bytecode of all the macros is byte pair encoded as one block: the
+  * most frequent adjacent pair is replaced by a byte value the data does not
+  * use, again and again, while free values are left and a pair still occurs
+  * twice. A pair never spans the start of a macro, the start of a REPEAT
+  * body or the byte after a LOOP, and never nests deeper than the firmware's
+  * MACRO_BPE_DEPTH stack allows.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "macro.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_MACRO_LINE_MAX        1024U
+#define SIM_MACRO_JOIN            0U      /* a pair may join this byte to the one before */
+#define SIM_MACRO_CUT             1U      /* no pair across this boundary */
+#define SIM_MACRO_START           2U      /* first byte of a macro, no pair across */
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t  sim_macro_cut[SIM_MACRO_CODE_MAX];
+static uint8_t  sim_macro_tok[SIM_MACRO_CODE_MAX];
+static uint32_t sim_macro_pairs[65536];
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t sim_macro_line(char *line, uint8_t *code, uint32_t *len, uint32_t max, uint32_t *depth);
+static int32_t sim_macro_emit(uint8_t *code, uint32_t *len, uint32_t max, uint8_t byte, uint8_t cut);
+static int32_t sim_macro_varint(uint8_t *code, uint32_t *len, uint32_t max, uint32_t value);
+static int32_t sim_macro_text(const char *src, uint8_t *code, uint32_t *len, uint32_t max);
+static uint32_t sim_macro_compress(uint32_t n, macro_image_header_t *header);
+static uint32_t sim_macro_get_varint(const uint8_t *code, uint32_t *pos);
+static uint8_t sim_macro_need(uint8_t left, uint8_t right);
+static void sim_macro_put32(uint8_t *dst, uint32_t value);
+
+/**
+  * @brief  Assemble macro source and build the flash image.
+  * @param  source: macro source, NUL terminated
+  * @param  image: receives the image
+  * @param  max: room in image
+  * @param  code: receives the bytecode of every macro, uncompressed,
+  *         SIM_MACRO_CODE_MAX bytes
+  * @param  info: receives sizes and the offset of each macro in code
+  * @retval image size, -1 on a source error (printed) or when it does not fit
+  */
+int32_t sim_macro_build(const char *source, uint8_t *image, uint32_t max, uint8_t *code, sim_macro_info_t *info)
+{
+  macro_image_header_t header;
+  char line[SIM_MACRO_LINE_MAX];
+  char work[SIM_MACRO_LINE_MAX];
+  const char *next;
+  const char *word;
+  uint32_t lineno = 0U;
+  uint32_t depth = 0U;
+  uint32_t len = 0U;
+  uint32_t dir;
+  uint32_t n;
+  uint32_t i;
+  uint32_t m;
+  size_t line_len;
+
+  memset(info, 0, sizeof(*info));
+
+  while (*source != '\0')
+  {
+    next = strchr(source, '\n');
+    line_len = (next != NULL) ? (size_t)(next - source) : strlen(source);
+    if (line_len >= sizeof(line))
+    {
+      printf("sim: macro line %lu too long\n", (unsigned long)(lineno + 1U));
+      return -1;
+    }
+    memcpy(line, source, line_len);
+    line[line_len] = '\0';
+    source += line_len + ((next != NULL) ? 1U : 0U);
+    lineno++;
+
+    word = line + strspn(line, " \t");
+    if ((strncmp(word, "macro", 5U) == 0) && (strchr(" \t#", word[5]) != NULL))
+    {
+      if ((info->macros != 0U) && ((depth != 0U) || (sim_macro_emit(code, &len, SIM_MACRO_CODE_MAX,
+                                                                     MACRO_OP_END, SIM_MACRO_JOIN) != 0)))
+      {
+        printf("sim: macro line %lu: %s\n", (unsigned long)lineno, (depth != 0U) ? "repeat without loop" : "too long");
+        return -1;
+      }
+      if (info->macros >= SIM_MACRO_MAX)
+      {
+        printf("sim: macro line %lu: more than %u macros\n", (unsigned long)lineno, (unsigned)SIM_MACRO_MAX);
+        return -1;
+      }
+      info->offset[info->macros++] = len;
+      if (len < SIM_MACRO_CODE_MAX)
+      {
+        sim_macro_cut[len] = SIM_MACRO_START;
+      }
+      continue;
+    }
+
+    if ((info->macros == 0U) && (*word != '\0') && (*word != '#'))
+    {
+      printf("sim: macro line %lu: statement before \"macro\"\n", (unsigned long)lineno);
+      return -1;
+    }
+    memcpy(work, line, line_len + 1U);
+    if (sim_macro_line(work, code, &len, SIM_MACRO_CODE_MAX, &depth) != 0)
+    {
+      printf("sim: macro line %lu: cannot assemble \"%s\"\n", (unsigned long)lineno, line);
+      return -1;
+    }
+  }
+
+  if ((info->macros == 0U) || (depth != 0U) ||
+      (sim_macro_emit(code, &len, SIM_MACRO_CODE_MAX, MACRO_OP_END, SIM_MACRO_JOIN) != 0))
+  {
+    printf("sim: macro source has no macro, or ends inside a repeat\n");
+    return -1;
+  }
+  info->offset[info->macros] = len;
+  info->raw_size = len;
+
+  /* Compress, then lay the image out */
+  memcpy(sim_macro_tok, code, len);
+  memset(&header, 0, sizeof(header));
+  n = sim_macro_compress(len, &header);
+  for (i = 0U; i < 256U; i++)
+  {
+    info->pairs += (header.pair_used[i >> 3] >> (i & 7U)) & 1U;
+  }
+
+  dir = sizeof(header) + ((info->macros + 1U) * 4U);
+  if ((dir + n) > max)
+  {
+    printf("sim: macro image of %lu bytes does not fit %lu\n", (unsigned long)(dir + n), (unsigned long)max);
+    return -1;
+  }
+
+  header.magic = MACRO_IMAGE_MAGIC;
+  header.version = MACRO_IMAGE_VERSION;
+  header.count = (uint16_t)info->macros;
+  header.size = dir + n;
+  memcpy(image, &header, sizeof(header));
+
+  for (i = 0U, m = 0U; i < n; i++)
+  {
+    if (sim_macro_cut[i] == SIM_MACRO_START)
+    {
+      sim_macro_put32(&image[sizeof(header) + (m * 4U)], dir + i);
+      m++;
+    }
+  }
+  sim_macro_put32(&image[sizeof(header) + (m * 4U)], dir + n);
+  memcpy(&image[dir], sim_macro_tok, n);
+
+  info->image_size = dir + n;
+  return (int32_t)info->image_size;
+}
+
+/**
+  * @brief  Walk the bytecode of one macro and list what the host must see.
+  * @note   TEXT is listed as one event, the keys the typing engine uses for
+  *         it are not predicted here.
+  * @param  code: bytecode of the macro
+  * @param  len: its length
+  * @param  events: receives the events
+  * @param  max: room in events
+  * @retval number of events, -1 when they do not fit or the code is malformed
+  */
+int32_t sim_macro_expect(const uint8_t *code, uint32_t len, sim_macro_event_t *events, uint32_t max)
+{
+  uint32_t loop_pos[MACRO_REPEAT_DEPTH];
+  uint32_t loop_left[MACRO_REPEAT_DEPTH];
+  uint8_t held[256];
+  uint32_t depth = 0U;
+  uint32_t gap = 0U;
+  uint32_t count = 0U;
+  uint32_t pos = 0U;
+  uint32_t value;
+  uint32_t u;
+  uint8_t op;
+
+  memset(held, 0, sizeof(held));
+
+  while (pos < len)
+  {
+    op = code[pos++];
+    switch (op)
+    {
+      case MACRO_OP_END:
+      case MACRO_OP_RELEASE:
+        for (u = 0U; u < 256U; u++)
+        {
+          if (held[u] != 0U)
+          {
+            if (count >= max)
+            {
+              return -1;
+            }
+            events[count++] = (sim_macro_event_t){ SIM_MACRO_EDGE, (uint8_t)u, 0U, gap, NULL, 0U };
+            gap = 0U;
+            held[u] = 0U;
+          }
+        }
+        if (op == MACRO_OP_END)
+        {
+          return (int32_t)count;
+        }
+        break;
+
+      case MACRO_OP_DOWN:
+      case MACRO_OP_UP:
+      case MACRO_OP_TAP:
+        u = code[pos++];
+        if ((count + 2U) > max)
+        {
+          return -1;
+        }
+        if (held[u] != ((op == MACRO_OP_UP) ? 1U : 0U))
+        {
+          break;
+        }
+        events[count++] = (sim_macro_event_t){ SIM_MACRO_EDGE, (uint8_t)u, (op != MACRO_OP_UP) ? 1U : 0U, gap, NULL, 0U };
+        gap = 0U;
+        held[u] = (op != MACRO_OP_UP) ? 1U : 0U;
+        if (op == MACRO_OP_TAP)
+        {
+          events[count++] = (sim_macro_event_t){ SIM_MACRO_EDGE, (uint8_t)u, 0U, 0U, NULL, 0U };
+          held[u] = 0U;
+        }
+        break;
+
+      case MACRO_OP_DELAY:
+        gap += sim_macro_get_varint(code, &pos);
+        break;
+
+      case MACRO_OP_TEXT:
+        value = sim_macro_get_varint(code, &pos);
+        if ((count >= max) || ((pos + value) > len))
+        {
+          return -1;
+        }
+        events[count++] = (sim_macro_event_t){ SIM_MACRO_TEXT, 0U, 0U, gap, &code[pos], value };
+        gap = 0U;
+        pos += value;
+        break;
+
+      case MACRO_OP_REPEAT:
+        if (depth >= MACRO_REPEAT_DEPTH)
+        {
+          return -1;
+        }
+        loop_left[depth] = sim_macro_get_varint(code, &pos);
+        loop_pos[depth] = pos;
+        depth++;
+        break;
+
+      case MACRO_OP_LOOP:
+        if (depth == 0U)
+        {
+          return -1;
+        }
+        if (--loop_left[depth - 1U] != 0U)
+        {
+          pos = loop_pos[depth - 1U];
+        }
+        else
+        {
+          depth--;
+        }
+        break;
+
+      default:
+        return -1;
+    }
+  }
+
+  return -1;
+}
+
+/**
+  * @brief  Store a little-endian word.
+  * @param  dst: first byte
+  * @param  value: word
+  * @retval None
+  */
+static void sim_macro_put32(uint8_t *dst, uint32_t value)
+{
+  dst[0] = (uint8_t)value;
+  dst[1] = (uint8_t)(value >> 8);
+  dst[2] = (uint8_t)(value >> 16);
+  dst[3] = (uint8_t)(value >> 24);
+}
+
+/**
+  * @brief  Assemble one source line.
+  * @param  line: source line, modified
+  * @param  code: bytecode
+  * @param  len: bytecode length, updated
+  * @param  max: room in code
+  * @param  depth: open repeat blocks, updated
+  * @retval 0, -1 on a syntax error
+  */
+static int32_t sim_macro_line(char *line, uint8_t *code, uint32_t *len, uint32_t max, uint32_t *depth)
+{
+  static const struct
+  {
+    const char *name;
+    uint8_t     op;
+  } keys[] = { { "down", MACRO_OP_DOWN }, { "up", MACRO_OP_UP }, { "tap", MACRO_OP_TAP } };
+  char *word;
+  char *arg;
+  char *end;
+  unsigned long value = 0UL;
+  uint32_t i;
+
+  word = line + strspn(line, " \t");
+  if ((*word == '\0') || (*word == '#'))
+  {
+    return 0;
+  }
+  arg = word + strcspn(word, " \t");
+  if (*arg != '\0')
+  {
+    *arg++ = '\0';
+    arg += strspn(arg, " \t");
+  }
+
+  if (strcmp(word, "text") == 0)
+  {
+    return sim_macro_text(arg, code, len, max);
+  }
+
+  if (*arg != '\0')
+  {
+    value = strtoul(arg, &end, 0);
+    end += strspn(end, " \t");
+    if ((end == arg) || ((*end != '\0') && (*end != '#')))
+    {
+      return -1;
+    }
+  }
+
+  for (i = 0U; i < (sizeof(keys) / sizeof(keys[0])); i++)
+  {
+    if (strcmp(word, keys[i].name) == 0)
+    {
+      if ((*arg == '\0') || (value == 0UL) || (value > 0xFFUL))
+      {
+        return -1;
+      }
+      return ((sim_macro_emit(code, len, max, keys[i].op, SIM_MACRO_JOIN) == 0) &&
+              (sim_macro_emit(code, len, max, (uint8_t)value, SIM_MACRO_JOIN) == 0)) ? 0 : -1;
+    }
+  }
+
+  if ((strcmp(word, "release") == 0) && (*arg == '\0'))
+  {
+    return sim_macro_emit(code, len, max, MACRO_OP_RELEASE, SIM_MACRO_JOIN);
+  }
+  if ((strcmp(word, "delay") == 0) && (*arg != '\0'))
+  {
+    return ((sim_macro_emit(code, len, max, MACRO_OP_DELAY, SIM_MACRO_JOIN) == 0) &&
+            (sim_macro_varint(code, len, max, (uint32_t)value) == 0)) ? 0 : -1;
+  }
+  if ((strcmp(word, "repeat") == 0) && (*arg != '\0') && (value != 0UL) && (*depth < MACRO_REPEAT_DEPTH))
+  {
+    (*depth)++;
+    if ((sim_macro_emit(code, len, max, MACRO_OP_REPEAT, SIM_MACRO_JOIN) != 0) ||
+        (sim_macro_varint(code, len, max, (uint32_t)value) != 0))
+    {
+      return -1;
+    }
+    /* The body starts on a stream byte */
+    if (*len < max)
+    {
+      sim_macro_cut[*len] = SIM_MACRO_CUT;
+    }
+    return 0;
+  }
+  if ((strcmp(word, "loop") == 0) && (*arg == '\0') && (*depth != 0U))
+  {
+    (*depth)--;
+    if (sim_macro_emit(code, len, max, MACRO_OP_LOOP, SIM_MACRO_JOIN) != 0)
+    {
+      return -1;
+    }
+    /* Nothing after the LOOP may be pending when it jumps back */
+    if (*len < max)
+    {
+      sim_macro_cut[*len] = SIM_MACRO_CUT;
+    }
+    return 0;
+  }
+
+  return -1;
+}
+
+/**
+  * @brief  Append a bytecode byte.
+  * @param  code: bytecode
+  * @param  len: length, updated
+  * @param  max: room in code
+  * @param  byte: byte
+  * @param  cut: SIM_MACRO_JOIN, or a boundary already marked is kept
+  * @retval 0, -1 when full
+  */
+static int32_t sim_macro_emit(uint8_t *code, uint32_t *len, uint32_t max, uint8_t byte, uint8_t cut)
+{
+  if (*len >= max)
+  {
+    return -1;
+  }
+  if ((cut != SIM_MACRO_JOIN) || (sim_macro_cut[*len] == SIM_MACRO_JOIN))
+  {
+    sim_macro_cut[*len] = cut;
+  }
+  code[(*len)++] = byte;
+  if (*len < max)
+  {
+    sim_macro_cut[*len] = SIM_MACRO_JOIN;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Append a varint.
+  * @param  code: bytecode
+  * @param  len: length, updated
+  * @param  max: room in code
+  * @param  value: number, below 2^28
+  * @retval 0, -1 when full or too large
+  */
+static int32_t sim_macro_varint(uint8_t *code, uint32_t *len, uint32_t max, uint32_t value)
+{
+  uint32_t i;
+
+  if (value >= (1UL << (7U * MACRO_VARINT_MAX)))
+  {
+    return -1;
+  }
+
+  for (i = 0U; i < MACRO_VARINT_MAX; i++)
+  {
+    if (sim_macro_emit(code, len, max, (uint8_t)((value & 0x7FU) | ((value > 0x7FU) ? 0x80U : 0U)),
+                       SIM_MACRO_JOIN) != 0)
+    {
+      return -1;
+    }
+    value >>= 7;
+    if (value == 0U)
+    {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Append a TEXT operation from a quoted string.
+  * @param  src: "..." with escapes
+  * @param  code: bytecode
+  * @param  len: length, updated
+  * @param  max: room in code
+  * @retval 0, -1 on a syntax error
+  */
+static int32_t sim_macro_text(const char *src, uint8_t *code, uint32_t *len, uint32_t max)
+{
+  char text[SIM_MACRO_LINE_MAX];
+  uint32_t n = 0U;
+  uint32_t i;
+  char *end;
+
+  if (*src++ != '"')
+  {
+    return -1;
+  }
+  while ((*src != '"') && (*src != '\0'))
+  {
+    if (*src == '\\')
+    {
+      src++;
+      switch (*src)
+      {
+        case 'n':  text[n] = '\n'; break;
+        case 't':  text[n] = '\t'; break;
+        case '\\': text[n] = '\\'; break;
+        case '"':  text[n] = '"';  break;
+        case 'x':
+          text[n] = (char)strtoul(src + 1, &end, 16);
+          if ((end == (src + 1)) || (end > (src + 3)))
+          {
+            return -1;
+          }
+          src = end - 1;
+          break;
+        default:
+          return -1;
+      }
+      src++;
+    }
+    else
+    {
+      text[n] = *src++;
+    }
+    n++;
+  }
+  if ((*src != '"') || (n == 0U))
+  {
+    return -1;
+  }
+
+  if ((sim_macro_emit(code, len, max, MACRO_OP_TEXT, SIM_MACRO_JOIN) != 0) ||
+      (sim_macro_varint(code, len, max, n) != 0))
+  {
+    return -1;
+  }
+  for (i = 0U; i < n; i++)
+  {
+    if (sim_macro_emit(code, len, max, (uint8_t)text[i], SIM_MACRO_JOIN) != 0)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Byte pair encode sim_macro_tok in place.
+  * @param  n: bytes in sim_macro_tok, boundaries in sim_macro_cut
+  * @param  header: receives the pair table
+  * @retval compressed length; sim_macro_cut still marks the macro starts
+  */
+static uint32_t sim_macro_compress(uint32_t n, macro_image_header_t *header)
+{
+  uint8_t need[256];              /* stack bytes the firmware needs to expand each byte */
+  uint8_t taken[256];
+  uint32_t best;
+  uint32_t best_count;
+  uint32_t pair;
+  uint32_t code;
+  uint32_t i;
+  uint32_t j;
+  uint8_t a;
+  uint8_t b;
+  uint8_t depth;
+
+  memset(need, 0, sizeof(need));
+
+  /* Bytes of the bytecode stay taken after their last copy went into a pair */
+  memset(taken, 0, sizeof(taken));
+  for (i = 0U; i < n; i++)
+  {
+    taken[sim_macro_tok[i]] = 1U;
+  }
+
+  for (;;)
+  {
+    /* A free byte value to stand for the pair */
+    for (code = 0U; (code < 256U) && (taken[code] != 0U); code++)
+    {
+    }
+    if (code == 256U)
+    {
+      break;
+    }
+
+    memset(sim_macro_pairs, 0, sizeof(sim_macro_pairs));
+    for (i = 1U; i < n; i++)
+    {
+      if (sim_macro_cut[i] == SIM_MACRO_JOIN)
+      {
+        sim_macro_pairs[((uint32_t)sim_macro_tok[i - 1U] << 8) | sim_macro_tok[i]]++;
+      }
+    }
+
+    best = 0U;
+    best_count = 0U;
+    for (pair = 0U; pair < 65536U; pair++)
+    {
+      a = (uint8_t)(pair >> 8);
+      b = (uint8_t)pair;
+      depth = sim_macro_need(need[a], need[b]);
+      if ((sim_macro_pairs[pair] > best_count) && (depth <= MACRO_BPE_DEPTH))
+      {
+        best = pair;
+        best_count = sim_macro_pairs[pair];
+      }
+    }
+    if (best_count < 2U)
+    {
+      break;
+    }
+
+    a = (uint8_t)(best >> 8);
+    b = (uint8_t)best;
+    for (i = 0U, j = 0U; i < n; i++, j++)
+    {
+      sim_macro_cut[j] = sim_macro_cut[i];
+      if (((i + 1U) < n) && (sim_macro_cut[i + 1U] == SIM_MACRO_JOIN) && (sim_macro_tok[i] == a) &&
+          (sim_macro_tok[i + 1U] == b))
+      {
+        sim_macro_tok[j] = (uint8_t)code;
+        i++;
+      }
+      else
+      {
+        sim_macro_tok[j] = sim_macro_tok[i];
+      }
+    }
+    n = j;
+
+    taken[code] = 1U;
+    header->pair_used[code >> 3] |= (uint8_t)(1U << (code & 7U));
+    header->pair[code][0] = a;
+    header->pair[code][1] = b;
+    need[code] = sim_macro_need(need[a], need[b]);
+  }
+
+  return n;
+}
+
+/**
+  * @brief  Read a varint from bytecode.
+  * @param  code: bytecode
+  * @param  pos: offset, advanced
+  * @retval value
+  */
+static uint32_t sim_macro_get_varint(const uint8_t *code, uint32_t *pos)
+{
+  uint32_t value = 0U;
+  uint32_t shift = 0U;
+  uint8_t byte;
+
+  do
+  {
+    byte = code[(*pos)++];
+    value |= (uint32_t)(byte & 0x7FU) << shift;
+    shift += 7U;
+  } while (((byte & 0x80U) != 0U) && (shift < (7U * MACRO_VARINT_MAX)));
+
+  return value;
+}
+
+/**
+  * @brief  Expansion stack a pair needs: both halves pushed, then the right
+  *         half waits while the left one expands.
+  * @param  left: need of the left byte, 0 for a literal
+  * @param  right: need of the right byte
+  * @retval bytes of stack
+  */
+static uint8_t sim_macro_need(uint8_t left, uint8_t right)
+{
+  uint8_t need = 2U;
+
+  if ((uint8_t)(left + 1U) > need)
+  {
+    need = (uint8_t)(left + 1U);
+  }
+  if (right > need)
+  {
+    need = right;
+  }
+
+  return need;
+}
@@ -0,0 +1,495 @@
+/**
+  ******************************************************************************
+  * @file           : sim_macro_check.c
+  * @brief          : Macros played from an assembled image
+  ******************************************************************************
+  * A macro image is assembled from written and generated macros and loaded
+  * as the macro sector. Macros are played through the configuration control
+  * report; every key edge, every DELAY within a few ms and every TEXT read
+  * back must match what the uncompressed bytecode asks for, a stopped macro
+  * must release its keys, and malformed images and bytecode must be refused
+  * or stopped with a fault.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "hid_keyboard.h"
+#include "hid_config.h"
+#include "usbd_hid.h"
+#include "kbd_layout.h"
+#include "macro.h"
+#include "typing.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_MACRO_IMAGE_SIZE      (128U * 1024U)
+#define SIM_MACRO_SOURCE_SIZE     (512U * 1024U)
+#define SIM_MACRO_GENERATED       24U     /* multi-kilobyte macros after the written ones */
+#define SIM_MACRO_SENTENCES       48U     /* per generated macro */
+#define SIM_MACRO_EVENTS          16384U
+#define SIM_MACRO_EDGES           65536U
+#define SIM_MACRO_SLACK_MS        3U      /* DELAY against the host's report times */
+#define SIM_MACRO_STOP_MS         100U
+#define SIM_MACRO_TIMEOUT_MS      60000U
+
+/* Private typedef -----------------------------------------------------------*/
+/* One key going down or up in a report the host received */
+typedef struct
+{
+  uint64_t time_us;
+  uint8_t  usage;
+  uint8_t  down;
+  uint8_t  mods;               /* modifiers of that report */
+} sim_macro_edge_t;
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+/* Written macros: every operation, nested repeats, text, then a key held
+   until it is stopped. Generated ones follow. */
+static const char sim_macro_written[] =
+  "macro\n"
+  "tap 0x04\n"
+  "delay 50\n"
+  "down 0xE1                 # B\n"
+  "tap 0x05\n"
+  "up 0xE1\n"
+  "text \"Hi there, \\\"macro\\\"!\\n\"\n"
+  "repeat 3\n"
+  "  tap 0x06\n"
+  "  delay 10\n"
+  "  repeat 2\n"
+  "    tap 0x07\n"
+  "  loop\n"
+  "loop\n"
+  "delay 25\n"
+  "down 0xE0\n"
+  "down 0x06\n"
+  "release\n"
+  "tap 0x2C\n"
+  "macro\n"
+  "down 0x04\n"
+  "delay 5000\n";
+static char sim_macro_source[SIM_MACRO_SOURCE_SIZE];
+static uint32_t sim_macro_image[SIM_MACRO_IMAGE_SIZE / 4U];
+static uint8_t sim_macro_code[SIM_MACRO_CODE_MAX];
+static sim_macro_event_t sim_macro_events[SIM_MACRO_EVENTS];
+static sim_macro_edge_t sim_macro_edges[SIM_MACRO_EDGES];
+static uint32_t sim_macro_edge_count;
+static char sim_macro_got[SIM_TYPING_SIZE];                     /* TEXT read back */
+
+/* Private function prototypes -----------------------------------------------*/
+static void sim_macro_generate(void);
+static int32_t sim_macro_command(uint8_t command, uint16_t index);
+static int32_t sim_macro_record(uint32_t stop_after_ms);
+static int32_t sim_macro_verify(uint16_t index, const sim_macro_info_t *info, uint64_t start);
+static void sim_macro_fault(const uint8_t *stream, uint32_t len, uint8_t pair_code, uint32_t edges);
+
+/**
+  * @brief  Build a macro image, play macros from it and check what the host
+  *         receives.
+  * @retval None
+  */
+void sim_macro_check(void)
+{
+  static const uint16_t played[] = { 0U, 1U, 2U, 1U + SIM_MACRO_GENERATED };
+  static const uint8_t truncated[] = { MACRO_OP_DOWN, 0x04U, MACRO_OP_DELAY };
+  static const uint8_t bad_op[] = { MACRO_OP_DOWN, 0x04U, MACRO_OP_TAP, 0x05U, 0x09U };
+  static const uint8_t too_deep[] = { MACRO_OP_TAP, 0x04U, 0x80U };
+  sim_macro_info_t info;
+  macro_stats_t before;
+  macro_stats_t after;
+  uint64_t start;
+  int32_t size;
+  uint32_t i;
+
+  sim_macro_generate();
+  size = sim_macro_build(sim_macro_source, (uint8_t *)sim_macro_image, sizeof(sim_macro_image), sim_macro_code,
+                         &info);
+  if ((size < 0) || (info.macros != (2U + SIM_MACRO_GENERATED)) ||
+      (macro_init((const uint8_t *)sim_macro_image, sizeof(sim_macro_image)) != MACRO_OK) ||
+      (macro_count() != info.macros) || (sim_layout_select(KBD_LAYOUT_US) != 0))
+  {
+    printf("sim: macro: image cannot be built or loaded\n");
+    sim_stats.failures++;
+    return;
+  }
+  printf("sim: macro image: %lu macros, %lu bytes of bytecode in %lu bytes (%.1f%%), %lu pairs\n",
+         (unsigned long)info.macros, (unsigned long)info.raw_size, (unsigned long)info.image_size,
+         (100.0 * (double)info.image_size) / (double)info.raw_size, (unsigned long)info.pairs);
+
+  for (i = 0U; i < (sizeof(played) / sizeof(played[0])); i++)
+  {
+    macro_get_stats(&before);
+    start = sim_clock_us();
+    if ((sim_macro_command(HID_CONFIG_CMD_MACRO_PLAY, played[i]) != 0) ||
+        (sim_macro_record((played[i] == 1U) ? SIM_MACRO_STOP_MS : 0U) != 0))
+    {
+      sim_stats.failures++;
+      continue;
+    }
+    macro_get_stats(&after);
+    if (((after.played - before.played) != 1U) || (after.faults != before.faults) ||
+        (sim_macro_verify(played[i], &info, start) != 0))
+    {
+      printf("sim: macro %u: %lu faults\n", played[i], (unsigned long)(after.faults - before.faults));
+      sim_stats.failures++;
+      continue;
+    }
+    printf("sim: macro %u: %lu bytes of bytecode, %lu ops, %lu key edges, %.3f s\n", played[i],
+           (unsigned long)(info.offset[played[i] + 1U] - info.offset[played[i]]),
+           (unsigned long)(after.ops - before.ops), (unsigned long)sim_macro_edge_count,
+           (sim_macro_edge_count != 0U) ?
+           (double)(sim_macro_edges[sim_macro_edge_count - 1U].time_us - start) / 1e6 : 0.0);
+  }
+
+  /* Past the last macro */
+  if (sim_macro_command(HID_CONFIG_CMD_MACRO_PLAY, (uint16_t)info.macros) == 0)
+  {
+    printf("sim: macro %lu accepted\n", (unsigned long)info.macros);
+    sim_stats.failures++;
+  }
+
+  /* An image that is not one */
+  ((macro_image_header_t *)sim_macro_image)->magic ^= 1U;
+  if ((macro_init((const uint8_t *)sim_macro_image, sizeof(sim_macro_image)) != MACRO_ERR_IMAGE) ||
+      (macro_count() != 0U) || (sim_macro_command(HID_CONFIG_CMD_MACRO_PLAY, 0U) == 0))
+  {
+    printf("sim: macro: corrupt image accepted\n");
+    sim_stats.failures++;
+  }
+
+  sim_macro_fault(truncated, sizeof(truncated), 0U, 2U);
+  sim_macro_fault(bad_op, sizeof(bad_op), 0U, 4U);
+  sim_macro_fault(too_deep, sizeof(too_deep), 0x80U, 2U);
+
+  (void)macro_init(NULL, 0U);
+}
+
+/**
+  * @brief  Append the written macros and SIM_MACRO_GENERATED generated ones
+  *         to sim_macro_source.
+  * @note   Generated macros are sentences of common words, each followed by
+  *         Enter, with delays and a repeated tap between them.
+  * @retval None
+  */
+static void sim_macro_generate(void)
+{
+  static const char *const words[] =
+  {
+    "the", "key", "board", "macro", "flash", "sector", "report", "host", "poll", "every", "millisecond",
+    "typed", "text", "with", "delay", "and", "repeat", "until", "done", "Shift", "layout", "USB", "device",
+  };
+  uint32_t seed = 0x2545F491U;
+  uint32_t len;
+  uint32_t m;
+  uint32_t k;
+  uint32_t w;
+  uint32_t n;
+
+  len = (uint32_t)snprintf(sim_macro_source, sizeof(sim_macro_source), "%s", sim_macro_written);
+  for (m = 0U; m < SIM_MACRO_GENERATED; m++)
+  {
+    len += (uint32_t)snprintf(&sim_macro_source[len], sizeof(sim_macro_source) - len, "macro\n");
+    for (k = 0U; k < SIM_MACRO_SENTENCES; k++)
+    {
+      len += (uint32_t)snprintf(&sim_macro_source[len], sizeof(sim_macro_source) - len, "text \"");
+      n = 6U + ((seed >> 24) % 10U);
+      for (w = 0U; w < n; w++)
+      {
+        seed = (seed * 1664525U) + 1013904223U;
+        len += (uint32_t)snprintf(&sim_macro_source[len], sizeof(sim_macro_source) - len, "%s%s",
+                                  (w == 0U) ? "" : " ", words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))]);
+      }
+      len += (uint32_t)snprintf(&sim_macro_source[len], sizeof(sim_macro_source) - len,
+                                ".\"\ntap 0x28\n%s", ((k % 4U) == 3U) ? "delay 20\nrepeat 3\ntap 0x2B\nloop\n" : "");
+    }
+  }
+}
+
+/**
+  * @brief  Send a macro command through the configuration control report
+  *         and read its status back, as a host tool would.
+  * @param  command: HID_CONFIG_CMD_MACRO_PLAY or HID_CONFIG_CMD_MACRO_STOP
+  * @param  index: macro to play
+  * @retval 0 when the device took it
+  */
+static int32_t sim_macro_command(uint8_t command, uint16_t index)
+{
+  uint8_t report[HID_CONFIG_REPORT_SIZE];
+
+  memset(report, 0, sizeof(report));
+  report[0] = HID_CONFIG_CTRL_REPORT_ID;
+  report[1] = command;
+  report[2] = (uint8_t)index;
+  report[3] = (uint8_t)(index >> 8);
+
+  if ((sim_host_control(0x21U, 0x09U, 0x0300U | HID_CONFIG_CTRL_REPORT_ID, 0U, report, sizeof(report)) < 0) ||
+      (sim_host_control(0xA1U, 0x01U, 0x0300U | HID_CONFIG_CTRL_REPORT_ID, 0U, report,
+                        sizeof(report)) != (int32_t)sizeof(report)) ||
+      (report[3] != HID_CONFIG_OK) || (((uint32_t)report[4] | ((uint32_t)report[5] << 8)) != macro_count()))
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Run until the macro and the text it typed are done, collecting
+  *         the key edges the host receives in sim_macro_edges.
+  * @param  stop_after_ms: send HID_CONFIG_CMD_MACRO_STOP after this long, 0
+  *         to let the macro end by itself
+  * @retval 0, -1 on a timeout or a report that does not decode
+  */
+static int32_t sim_macro_record(uint32_t stop_after_ms)
+{
+  static sim_hid_layout_t desc;
+  uint32_t usage[SIM_DESC_USAGES];
+  uint8_t report[64];
+  hid_key_state_t prev;
+  hid_key_state_t cur;
+  uint64_t start = sim_clock_us();
+  uint64_t idle = 0U;
+  uint8_t mods;
+  uint32_t c;
+  int32_t len;
+  int32_t n;
+  int32_t i;
+
+  if (sim_hid_parse(sim_device.report_desc, sim_device.report_desc_len, &desc) != 0)
+  {
+    return -1;
+  }
+
+  sim_macro_edge_count = 0U;
+  hid_key_state_clear(&prev);
+
+  while ((sim_clock_us() - start) < ((uint64_t)SIM_MACRO_TIMEOUT_MS * 1000U))
+  {
+    if ((stop_after_ms != 0U) && ((sim_clock_us() - start) >= ((uint64_t)stop_after_ms * 1000U)))
+    {
+      stop_after_ms = 0U;
+      if (sim_macro_command(HID_CONFIG_CMD_MACRO_STOP, 0U) != 0)
+      {
+        return -1;
+      }
+    }
+
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+    if (len > 0)
+    {
+      n = sim_hid_decode(&desc, SIM_HID_INPUT, report, (uint32_t)len, usage, SIM_DESC_USAGES);
+      if (n < 0)
+      {
+        printf("sim: macro: report does not decode\n");
+        return -1;
+      }
+      hid_key_state_clear(&cur);
+      for (i = 0; (i < n) && (i < (int32_t)SIM_DESC_USAGES); i++)
+      {
+        hid_key_state_set(&cur, (uint8_t)usage[i], 1U);
+      }
+
+      mods = (uint8_t)(cur.bits[HID_USAGE_MODIFIER_FIRST >> 5] >> (HID_USAGE_MODIFIER_FIRST & 0x1FU));
+      for (c = 0U; c < 256U; c++)
+      {
+        if ((((cur.bits[c >> 5] ^ prev.bits[c >> 5]) >> (c & 0x1FU)) & 1U) == 0U)
+        {
+          continue;
+        }
+        if (sim_macro_edge_count >= SIM_MACRO_EDGES)
+        {
+          printf("sim: macro: more than %u key edges\n", (unsigned)SIM_MACRO_EDGES);
+          return -1;
+        }
+        sim_macro_edges[sim_macro_edge_count++] = (sim_macro_edge_t){
+          sim_clock_us(), (uint8_t)c, (uint8_t)((cur.bits[c >> 5] >> (c & 0x1FU)) & 1U), mods };
+      }
+      prev = cur;
+    }
+
+    /* Done, then a drain for anything that should not come */
+    if ((stop_after_ms == 0U) && (macro_busy() == 0U) && (typing_busy() == 0U) &&
+        (USBD_HID_GetQueueDepth(&hUsbDeviceFS) == 0U))
+    {
+      if (idle == 0U)
+      {
+        idle = sim_clock_us();
+      }
+      else if ((sim_clock_us() - idle) >= ((uint64_t)SIM_DRAIN_MS * 1000U))
+      {
+        return 0;
+      }
+    }
+    else
+    {
+      idle = 0U;
+    }
+  }
+
+  printf("sim: macro: still playing after %u ms\n", (unsigned)SIM_MACRO_TIMEOUT_MS);
+  return -1;
+}
+
+/**
+  * @brief  Check the recorded edges against the macro's bytecode.
+  * @param  index: macro played
+  * @param  info: image the macro came from
+  * @param  start: time the macro was asked for
+  * @retval 0 when they match
+  */
+static int32_t sim_macro_verify(uint16_t index, const sim_macro_info_t *info, uint64_t start)
+{
+  const sim_macro_event_t *ev;
+  const sim_macro_edge_t *edge;
+  uint8_t held[256];
+  uint64_t prev = start;
+  uint64_t gap;
+  uint32_t got_len;
+  uint32_t dead;
+  uint32_t codepoint;
+  uint32_t e = 0U;
+  uint32_t first;
+  int32_t count;
+  int32_t k;
+
+  count = sim_macro_expect(&sim_macro_code[info->offset[index]], info->offset[index + 1U] - info->offset[index],
+                           sim_macro_events, SIM_MACRO_EVENTS);
+  if (count < 0)
+  {
+    printf("sim: macro %u: bytecode does not walk\n", index);
+    return -1;
+  }
+  if (index == 1U)
+  {
+    /* Stopped in its DELAY: the key it held goes up */
+    count = 1;
+    sim_macro_events[count++] = (sim_macro_event_t){ SIM_MACRO_EDGE, 0x04U, 0U, SIM_MACRO_STOP_MS, NULL, 0U };
+  }
+  memset(held, 0, sizeof(held));
+
+  for (k = 0; k < count; k++)
+  {
+    ev = &sim_macro_events[k];
+    first = e;
+
+    if (ev->type == SIM_MACRO_EDGE)
+    {
+      edge = &sim_macro_edges[e];
+      if ((e >= sim_macro_edge_count) || (edge->usage != ev->usage) || (edge->down != ev->down))
+      {
+        printf("sim: macro %u: step %ld wants usage 0x%02X %s\n", index, (long)k, ev->usage,
+               (ev->down != 0U) ? "down" : "up");
+        return -1;
+      }
+      held[ev->usage] = ev->down;
+      e++;
+    }
+    else
+    {
+      /* The typed keys, read with the modifiers of their reports */
+      got_len = 0U;
+      dead = 0U;
+      while ((e < sim_macro_edge_count) && (got_len < ev->text_len))
+      {
+        edge = &sim_macro_edges[e++];
+        if ((edge->down != 0U) && (edge->usage < HID_USAGE_MODIFIER_FIRST) &&
+            (sim_keymap_press(KBD_LAYOUT_US, edge->usage, edge->mods, &dead, &codepoint) > 0) &&
+            (got_len <= (sizeof(sim_macro_got) - 4U)))
+        {
+          got_len += sim_utf8_encode(codepoint, &sim_macro_got[got_len]);
+        }
+      }
+      while ((e < sim_macro_edge_count) && (sim_macro_edges[e].down == 0U) && (held[sim_macro_edges[e].usage] == 0U))
+      {
+        e++;
+      }
+      if ((got_len != ev->text_len) || (memcmp(sim_macro_got, ev->text, got_len) != 0) || (e == first))
+      {
+        printf("sim: macro %u: step %ld types \"%.*s\"\n", index, (long)k, (int)ev->text_len, (const char *)ev->text);
+        return -1;
+      }
+    }
+
+    /* A DELAY counts from the step after the last change went out */
+    gap = sim_macro_edges[first].time_us - prev;
+    if ((ev->gap_ms != 0U) && ((gap + ((uint64_t)SIM_MACRO_SLACK_MS * 1000U) < ((uint64_t)ev->gap_ms * 1000U)) ||
+                               (gap > ((uint64_t)(ev->gap_ms + SIM_MACRO_SLACK_MS) * 1000U))))
+    {
+      printf("sim: macro %u: step %ld comes %.1f ms after the last, wants %lu ms\n", index, (long)k,
+             (double)gap / 1000.0, (unsigned long)ev->gap_ms);
+      return -1;
+    }
+    prev = sim_macro_edges[e - 1U].time_us;
+  }
+
+  if (e != sim_macro_edge_count)
+  {
+    printf("sim: macro %u: %lu key edges more than it asks for\n", index, (unsigned long)(sim_macro_edge_count - e));
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Play a one-macro image with malformed bytecode and check it is
+  *         stopped with a fault and its keys released.
+  * @param  stream: bytecode, stored as is
+  * @param  len: its length
+  * @param  pair_code: byte made a pair of itself, nesting without end; 0 for none
+  * @param  edges: key edges the host should see
+  * @retval None
+  */
+static void sim_macro_fault(const uint8_t *stream, uint32_t len, uint8_t pair_code, uint32_t edges)
+{
+  macro_image_header_t header;
+  macro_stats_t before;
+  macro_stats_t after;
+  uint8_t *image = (uint8_t *)sim_macro_image;
+  uint32_t dir = sizeof(header) + 8U;
+  uint32_t offset;
+
+  memset(&header, 0, sizeof(header));
+  header.magic = MACRO_IMAGE_MAGIC;
+  header.version = MACRO_IMAGE_VERSION;
+  header.count = 1U;
+  header.size = dir + len;
+  if (pair_code != 0U)
+  {
+    header.pair_used[pair_code >> 3] = (uint8_t)(1U << (pair_code & 7U));
+    header.pair[pair_code][0] = pair_code;
+    header.pair[pair_code][1] = pair_code;
+  }
+  memcpy(image, &header, sizeof(header));
+  offset = dir;
+  memcpy(&image[sizeof(header)], &offset, 4U);
+  offset = dir + len;
+  memcpy(&image[sizeof(header) + 4U], &offset, 4U);
+  memcpy(&image[dir], stream, len);
+
+  if (macro_init(image, sizeof(sim_macro_image)) != MACRO_OK)
+  {
+    printf("sim: macro: fault image refused\n");
+    sim_stats.failures++;
+    return;
+  }
+  macro_get_stats(&before);
+  if ((sim_macro_command(HID_CONFIG_CMD_MACRO_PLAY, 0U) != 0) || (sim_macro_record(0U) != 0))
+  {
+    sim_stats.failures++;
+    return;
+  }
+  macro_get_stats(&after);
+
+  if (((after.faults - before.faults) != 1U) || (sim_macro_edge_count != edges) ||
+      ((edges != 0U) && (sim_macro_edges[edges - 1U].down != 0U)))
+  {
+    printf("sim: macro: malformed bytecode gave %lu faults and %lu key edges, want 1 and %lu\n",
+           (unsigned long)(after.faults - before.faults), (unsigned long)sim_macro_edge_count, (unsigned long)edges);
+    sim_stats.failures++;
+  }
+}
@@ -0,0 +1,79 @@
+/**
+  ******************************************************************************
+  * @file           : sim_macroasm.c
+  * @brief          : Build the macro sector image from macro source
+  ******************************************************************************
+  * macroasm <source> <image.bin>
+  *
+  * The source syntax is described in sim_macro.c. The image goes into the
+  * macro sector of STM32F411VETX_FLASH.ld (sector 5, 0x08020000), for
+  * instance with "st-flash write image.bin 0x8020000"; the firmware checks
+  * it at start-up.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Private define ------------------------------------------------------------*/
+#define MACROASM_SECTOR_SIZE      (128U * 1024U)
+
+/* Private variables ---------------------------------------------------------*/
+static char    macroasm_source[SIM_MACRO_CODE_MAX * 4U];
+static uint8_t macroasm_image[MACROASM_SECTOR_SIZE];
+static uint8_t macroasm_code[SIM_MACRO_CODE_MAX];
+
+/**
+  * @brief  Assemble a source file into an image file.
+  * @param  argc: argument count
+  * @param  argv: source and image paths
+  * @retval 0 on success
+  */
+int main(int argc, char **argv)
+{
+  sim_macro_info_t info;
+  FILE *file;
+  size_t len;
+  int32_t size;
+
+  if (argc != 3)
+  {
+    fprintf(stderr, "usage: %s <source> <image.bin>\n", argv[0]);
+    return 2;
+  }
+
+  file = fopen(argv[1], "r");
+  if (file == NULL)
+  {
+    perror(argv[1]);
+    return 2;
+  }
+  len = fread(macroasm_source, 1U, sizeof(macroasm_source) - 1U, file);
+  fclose(file);
+  if (len == (sizeof(macroasm_source) - 1U))
+  {
+    fprintf(stderr, "%s: too large\n", argv[1]);
+    return 1;
+  }
+  macroasm_source[len] = '\0';
+
+  size = sim_macro_build(macroasm_source, macroasm_image, sizeof(macroasm_image), macroasm_code, &info);
+  if (size < 0)
+  {
+    return 1;
+  }
+
+  file = fopen(argv[2], "wb");
+  if ((file == NULL) || (fwrite(macroasm_image, 1U, (size_t)size, file) != (size_t)size) || (fclose(file) != 0))
+  {
+    perror(argv[2]);
+    return 1;
+  }
+
+  printf("%lu macros, %lu bytes of bytecode in a %ld byte image, %lu pairs\n", (unsigned long)info.macros,
+         (unsigned long)info.raw_size, (long)size, (unsigned long)info.pairs);
+
+  return 0;
+}
@@ -0,0 +1,422 @@
+/**
+  ******************************************************************************
+  * @file           : sim_main.c
+  * @brief          : Simulator entry point and script runner
+  ******************************************************************************
+  * Runs the firmware's own start-up sequence and main loop against the
+  * virtual clock, PCD and key matrix. Time advances one matrix scan at a time;
+  * every step runs the scan "interrupt", then the main loop, and every 1 ms
+  * the host issues a SOF and polls the interrupt IN endpoint.
+  *
+  * Script commands, one per line, '#' starts a comment:
+  *   wait <ms>               run for <ms> milliseconds
+  *   step <n>                run for <n> matrix scans
+  *   press <key>             key is "user" (PA0) or a matrix key 0..63
+  *   release <key>
+  *   tap <key> [hold_ms]     press, hold (default 20 ms), release
+  *   burst <taps> <period>   tap matrix keys round robin every <period> ms,
+  *                           each held for one period, and report throughput
+  *   leds <value>            host sends the LED output report
+  *   expect-leds <value>     fail unless keyboard_get_leds() returns value
+  *
+  * Every key change outside a burst must produce exactly one input report;
+  * its latency is the virtual time from the change to the report reaching
+  * the host. Once the device has enumerated, main() runs, in this order,
+  * the checks of sim_<name>_check.c:
+  *   1. enum, descriptor, string, fifo and otg: enumeration time, the
+  *      report and string descriptors, the FIFO plans and FIFO copies;
+  *   2. encoder, matrix and debounce: the key pipeline on its own;
+  *   3. the script, from the file given or the built-in one;
+  *   4. latency_trace, console, typing, layout, macro and store: the
+  *      latency trace of the script, then the features on top of it;
+  *   5. overflow, queue, controls, idle, protocol, report and power: the
+  *      IN queues with the host stalled, then the class requests, and the
+  *      bus suspended last.
+  * Each file describes what its check expects. The exit status is 0 only
+  * when enumeration succeeded and every change and expectation was met.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "keyboard.h"
+#include "usbd_hid.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_LINE_MAX              128U
+#define SIM_TAP_HOLD_MS           20U
+
+/* Exported variables --------------------------------------------------------*/
+sim_host_device_t sim_device;
+sim_stats_t sim_stats;
+
+/* Private variables ---------------------------------------------------------*/
+static const char *const sim_default_script[] =
+{
+  "# Every key change produces exactly one report",
+  "wait 10",
+  "tap 0", "wait 10",
+  "tap 17", "step 3",
+  "tap 34", "step 5",
+  "tap user", "wait 7",
+  "press 32", "step 1",
+  "tap 2", "release 32",
+  "wait 10",
+  "leds 2", "step 1", "expect-leds 2",
+  "leds 0", "step 1", "expect-leds 0",
+  "# Two key changes every 2 ms: one report per 1 ms frame",
+  "burst 200 2",
+  "tap 63",
+  NULL
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void sim_report(const uint8_t *report, int32_t len);
+static int32_t sim_key(const char *key, uint8_t pressed);
+static void sim_burst(uint32_t taps, uint32_t period_ms);
+static int32_t sim_command(const char *line, uint32_t lineno);
+
+/**
+  * @brief  Simulator entry point.
+  * @param  argc: argument count
+  * @param  argv: optional script file, "-" for stdin
+  * @retval 0 when the run met every expectation
+  */
+int main(int argc, char **argv)
+{
+  char line[SIM_LINE_MAX];
+  uint32_t lineno = 0U;
+  FILE *script = NULL;
+  uint32_t i;
+
+  if (argc > 2)
+  {
+    fprintf(stderr, "usage: %s [script|-]\n", argv[0]);
+    return 2;
+  }
+  if (argc == 2)
+  {
+    script = (strcmp(argv[1], "-") == 0) ? stdin : fopen(argv[1], "r");
+    if (script == NULL)
+    {
+      perror(argv[1]);
+      return 2;
+    }
+  }
+
+  sim_firmware_init();
+
+  memset(&sim_stats, 0, sizeof(sim_stats));
+  sim_stats.latency_min = UINT64_MAX;
+  sim_stats.last_len = -1;
+
+  if (sim_host_enumerate(&sim_device) != 0)
+  {
+    return 1;
+  }
+  printf("sim: enumerated at address %u, %u-byte report descriptor, IN 0x%02X every %u ms\n",
+         sim_device.address, sim_device.report_desc_len, sim_device.ep_in, sim_device.interval);
+  sim_enum_check();
+  sim_descriptor_check();
+  sim_string_check();
+  sim_fifo_check();
+  sim_otg_check();
+  sim_encoder_check();
+  sim_matrix_check();
+  sim_debounce_check();
+
+  if (script != NULL)
+  {
+    while (fgets(line, sizeof(line), script) != NULL)
+    {
+      lineno++;
+      if (sim_command(line, lineno) != 0)
+      {
+        return 2;
+      }
+    }
+    if (script != stdin)
+    {
+      fclose(script);
+    }
+  }
+  else
+  {
+    for (i = 0U; sim_default_script[i] != NULL; i++)
+    {
+      (void)sim_command(sim_default_script[i], i + 1U);
+    }
+  }
+  sim_run_us((uint64_t)SIM_DRAIN_MS * 1000U);
+
+  printf("sim: %lu key changes, %lu reports, %lu lost, %lu unexpected, %lu duplicate\n",
+         (unsigned long)sim_stats.changes, (unsigned long)sim_stats.reports,
+         (unsigned long)(sim_stats.pending_head - sim_stats.pending_tail),
+         (unsigned long)sim_stats.unexpected, (unsigned long)sim_stats.duplicates);
+  if (sim_stats.latency_count != 0U)
+  {
+    printf("sim: change to host latency us: min %llu avg %llu max %llu\n",
+           (unsigned long long)sim_stats.latency_min,
+           (unsigned long long)(sim_stats.latency_sum / sim_stats.latency_count),
+           (unsigned long long)sim_stats.latency_max);
+  }
+  sim_latency_trace_check();
+  sim_console_check();
+  sim_typing_check();
+  sim_layout_check();
+  sim_macro_check();
+  sim_store_check();
+  sim_overflow_check();
+  sim_queue_check();
+  sim_controls_check();
+  sim_idle_check();
+  sim_protocol_check();
+  sim_report_check();
+  sim_power_check();
+
+  if ((sim_stats.pending_head != sim_stats.pending_tail) || (sim_stats.unexpected != 0U) ||
+      (sim_stats.duplicates != 0U))
+  {
+    sim_stats.failures++;
+  }
+  printf("sim: %s\n", (sim_stats.failures == 0U) ? "PASS" : "FAIL");
+
+  return (sim_stats.failures == 0U) ? 0 : 1;
+}
+
+/**
+  * @brief  Run the simulation for a while.
+  * @param  us: microseconds, rounded up to whole steps
+  * @retval None
+  */
+void sim_run_us(uint64_t us)
+{
+  uint64_t end = sim_clock_us() + us;
+
+  uint8_t report[64];
+  int32_t len;
+
+  while (sim_clock_us() < end)
+  {
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+    if (len > 0)
+    {
+      sim_report(report, len);
+    }
+  }
+}
+
+/**
+  * @brief  Account for a report received by the host.
+  * @param  report: report bytes
+  * @param  len: report length
+  * @retval None
+  */
+static void sim_report(const uint8_t *report, int32_t len)
+{
+  uint64_t latency;
+
+  sim_stats.reports++;
+  sim_stats.last_report_us = sim_clock_us();
+
+  if ((len == sim_stats.last_len) && (memcmp(report, sim_stats.last_report, (size_t)len) == 0))
+  {
+    sim_stats.duplicates++;
+  }
+  memcpy(sim_stats.last_report, report, (size_t)len);
+  sim_stats.last_len = len;
+
+  if (sim_stats.in_burst != 0U)
+  {
+    return;
+  }
+  if (sim_stats.pending_head == sim_stats.pending_tail)
+  {
+    sim_stats.unexpected++;
+    return;
+  }
+
+  latency = sim_clock_us() - sim_stats.pending[sim_stats.pending_tail % SIM_PENDING_SIZE];
+  sim_stats.pending_tail++;
+
+  sim_stats.latency_sum += latency;
+  sim_stats.latency_count++;
+  if (latency < sim_stats.latency_min)
+  {
+    sim_stats.latency_min = latency;
+  }
+  if (latency > sim_stats.latency_max)
+  {
+    sim_stats.latency_max = latency;
+  }
+}
+
+/**
+  * @brief  Press or release a key and expect one report for it.
+  * @param  key: "user" or a matrix key number
+  * @param  pressed: new key state
+  * @retval 0, or -1 when the key name is not valid
+  */
+static int32_t sim_key(const char *key, uint8_t pressed)
+{
+  if (sim_firmware_key(key, pressed) != 0)
+  {
+    return -1;
+  }
+
+  sim_stats.changes++;
+  if (sim_stats.in_burst == 0U)
+  {
+    if ((sim_stats.pending_head - sim_stats.pending_tail) >= SIM_PENDING_SIZE)
+    {
+      fprintf(stderr, "sim: too many key changes without a report\n");
+      exit(1);
+    }
+    sim_stats.pending[sim_stats.pending_head % SIM_PENDING_SIZE] = sim_clock_us();
+    sim_stats.pending_head++;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Tap matrix keys back to back and report the input report rate.
+  * @param  taps: number of taps
+  * @param  period_ms: time between taps, each key is held for one period
+  * @retval None
+  */
+static void sim_burst(uint32_t taps, uint32_t period_ms)
+{
+  char key[8];
+  uint32_t reports;
+  uint32_t changes;
+  uint64_t start;
+  uint64_t elapsed;
+  uint32_t i;
+
+  sim_run_us((uint64_t)SIM_DRAIN_MS * 1000U);
+  sim_stats.in_burst = 1U;
+  reports = sim_stats.reports;
+  changes = sim_stats.changes;
+  start = sim_clock_us();
+
+  for (i = 0U; i < taps; i++)
+  {
+    if (i != 0U)
+    {
+      (void)snprintf(key, sizeof(key), "%lu", (unsigned long)((i - 1U) % MATRIX_KEYS));
+      (void)sim_key(key, 0U);
+    }
+    (void)snprintf(key, sizeof(key), "%lu", (unsigned long)(i % MATRIX_KEYS));
+    (void)sim_key(key, 1U);
+    sim_run_us((uint64_t)period_ms * 1000U);
+  }
+  if (taps != 0U)
+  {
+    (void)snprintf(key, sizeof(key), "%lu", (unsigned long)((taps - 1U) % MATRIX_KEYS));
+    sim_key(key, 0U);
+  }
+  sim_run_us((uint64_t)SIM_DRAIN_MS * 1000U);
+
+  /* Rate over the time the reports took to reach the host, not the drain */
+  elapsed = (sim_stats.last_report_us > start) ? (sim_stats.last_report_us - start) : 1U;
+  reports = sim_stats.reports - reports;
+  changes = sim_stats.changes - changes;
+  sim_stats.in_burst = 0U;
+
+  printf("sim: burst of %lu changes: %lu reports in %llu ms, %llu reports/s, %lu merged\n",
+         (unsigned long)changes, (unsigned long)reports, (unsigned long long)(elapsed / 1000U),
+         (unsigned long long)(((uint64_t)reports * 1000000U) / elapsed),
+         (unsigned long)(changes - reports));
+}
+
+/**
+  * @brief  Run one script line.
+  * @param  line: script line
+  * @param  lineno: line number for messages
+  * @retval 0, or -1 on a syntax error
+  */
+static int32_t sim_command(const char *line, uint32_t lineno)
+{
+  char cmd[32];
+  char arg[32];
+  unsigned long value = 0U;
+  unsigned long value2 = 0U;
+  uint8_t report[HID_LED_REPORT_SIZE];
+  int fields;
+
+  fields = sscanf(line, "%31s %31s", cmd, arg);
+  if ((fields < 1) || (cmd[0] == '#'))
+  {
+    return 0;
+  }
+  if (fields == 2)
+  {
+    value = strtoul(arg, NULL, 0);
+  }
+
+  if ((strcmp(cmd, "wait") == 0) && (fields == 2))
+  {
+    sim_run_us((uint64_t)value * 1000U);
+  }
+  else if ((strcmp(cmd, "step") == 0) && (fields == 2))
+  {
+    sim_run_us((uint64_t)value * SIM_STEP_US);
+  }
+  else if (((strcmp(cmd, "press") == 0) || (strcmp(cmd, "release") == 0)) && (fields == 2))
+  {
+    if (sim_key(arg, (cmd[0] == 'p') ? 1U : 0U) != 0)
+    {
+      fprintf(stderr, "sim: line %lu: no key \"%s\"\n", (unsigned long)lineno, arg);
+      return -1;
+    }
+  }
+  else if ((strcmp(cmd, "tap") == 0) && (fields == 2))
+  {
+    if (sscanf(line, "%*s %*s %lu", &value2) != 1)
+    {
+      value2 = SIM_TAP_HOLD_MS;
+    }
+    if (sim_key(arg, 1U) != 0)
+    {
+      fprintf(stderr, "sim: line %lu: no key \"%s\"\n", (unsigned long)lineno, arg);
+      return -1;
+    }
+    sim_run_us((uint64_t)value2 * 1000U);
+    (void)sim_key(arg, 0U);
+  }
+  else if ((strcmp(cmd, "burst") == 0) && (fields == 2) &&
+           (sscanf(line, "%*s %*s %lu", &value2) == 1) && (value2 != 0U))
+  {
+    sim_burst((uint32_t)value, (uint32_t)value2);
+  }
+  else if ((strcmp(cmd, "leds") == 0) && (fields == 2))
+  {
+    report[0] = HID_LED_REPORT_ID;
+    report[1] = (uint8_t)value;
+    if (sim_host_out_report(&sim_device, report, sizeof(report)) < 0)
+    {
+      printf("sim: line %lu: LED output report not accepted\n", (unsigned long)lineno);
+      sim_stats.failures++;
+    }
+  }
+  else if ((strcmp(cmd, "expect-leds") == 0) && (fields == 2))
+  {
+    if (keyboard_get_leds() != value)
+    {
+      printf("sim: line %lu: LEDs 0x%02X, expected 0x%02lX\n", (unsigned long)lineno,
+             keyboard_get_leds(), value);
+      sim_stats.failures++;
+    }
+  }
+  else
+  {
+    fprintf(stderr, "sim: line %lu: cannot parse \"%s\"\n", (unsigned long)lineno, cmd);
+    return -1;
+  }
+
+  return 0;
+}
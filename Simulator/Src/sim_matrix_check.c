@@ -0,0 +1,227 @@
+/**
+  ******************************************************************************
+  * @file           : sim_matrix_check.c
+  * @brief          : Key matrix decoding and ghost detection
+  ******************************************************************************
+  * Row port snapshots of single keys, written key sets such as a 3-key L and
+  * a 4-key rectangle, and random sets, modelled with and without diodes,
+  * must decode to the keys held down or be reported as ghosted.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_MATRIX_RANDOM         20000U  /* random key sets of 2 to SIM_MATRIX_KEYS_MAX keys */
+#define SIM_MATRIX_KEYS_MAX       6U
+
+/* Private typedef -----------------------------------------------------------*/
+/* Keys held down together and what a scan of them must give */
+typedef struct
+{
+  const char *name;
+  uint32_t    count;
+  uint8_t     key[4];          /* col * MATRIX_ROWS + row */
+  uint8_t     ghost;           /* scan ghosted without diodes; with them only a full rectangle is */
+} sim_matrix_case_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const sim_matrix_case_t sim_matrix_cases[] =
+{
+  { "three keys in a row", 3U, { 0U, 8U, 16U }, 0U },
+  { "three keys in a column", 3U, { 0U, 1U, 2U }, 0U },
+  { "diagonal", 3U, { 0U, 9U, 18U }, 0U },
+  { "L-shape", 3U, { 0U, 1U, 8U }, 1U },
+  { "L-shape, spread out", 3U, { 19U, 22U, 43U }, 1U },
+  { "rectangle", 4U, { 0U, 1U, 8U, 9U }, 1U },
+  { "rectangle, last corner", 4U, { 54U, 55U, 62U, 63U }, 1U },
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static void sim_matrix_ports(const matrix_bitmap_t *keys, uint8_t diodes, uint32_t noise, uint16_t *samples);
+static uint8_t sim_matrix_rectangle(const uint16_t *samples);
+
+/**
+  * @brief  Decode row port snapshots of written and random key sets.
+  * @note   The ports are modelled with and without a diode per key: without,
+  *         a strobed column pulls low every row joined to it through pressed
+  *         keys, so three corners of a rectangle show the fourth. A scan must
+  *         decode to the keys held down or be reported ghosted, never show a
+  *         phantom key, and matrix_has_ghost() must find exactly the scans
+  *         where two columns share two rows.
+  * @retval None
+  */
+void sim_matrix_check(void)
+{
+  uint32_t failures = sim_stats.failures;
+  const sim_matrix_case_t *c;
+  matrix_bitmap_t keys;
+  matrix_bitmap_t state;
+  uint16_t samples[MATRIX_COLS];
+  uint32_t seed = 0x4D4154U;
+  uint32_t ghosts = 0U;
+  uint32_t count;
+  uint32_t i;
+  uint32_t k;
+  uint8_t diodes;
+  uint8_t want;
+  uint8_t ghost;
+
+  /* Every key on its own, other port pins at random */
+  for (k = 0U; k < MATRIX_KEYS; k++)
+  {
+    memset(&keys, 0, sizeof(keys));
+    keys.bits[k >> 5] |= 1UL << (k & 0x1FU);
+    seed = (seed * 1664525U) + 1013904223U;
+    sim_matrix_ports(&keys, 0U, seed, samples);
+    if ((matrix_decode(samples, &state) != 0U) || (memcmp(&state, &keys, sizeof(state)) != 0))
+    {
+      printf("sim: matrix: key %lu alone not decoded\n", (unsigned long)k);
+      sim_stats.failures++;
+    }
+  }
+
+  /* Written sets: a ghosted scan leaves the previous state alone */
+  for (i = 0U; i < (sizeof(sim_matrix_cases) / sizeof(sim_matrix_cases[0])); i++)
+  {
+    c = &sim_matrix_cases[i];
+    memset(&keys, 0, sizeof(keys));
+    for (k = 0U; k < c->count; k++)
+    {
+      keys.bits[c->key[k] >> 5] |= 1UL << (c->key[k] & 0x1FU);
+    }
+    for (diodes = 0U; diodes < 2U; diodes++)
+    {
+      want = ((diodes == 0U) || (c->count == 4U)) ? c->ghost : 0U;
+      sim_matrix_ports(&keys, diodes, 0xFFFFFFFFU, samples);
+      memset(&state, 0xA5, sizeof(state));
+      ghost = matrix_decode(samples, &state);
+      if ((ghost != want) || (matrix_has_ghost(samples) != want) ||
+          ((ghost == 0U) && (memcmp(&state, &keys, sizeof(state)) != 0)) ||
+          ((ghost != 0U) && ((state.bits[0] != 0xA5A5A5A5U) || (state.bits[MATRIX_WORDS - 1U] != 0xA5A5A5A5U))))
+      {
+        printf("sim: matrix: %s %s diodes: %s, want %s\n", c->name, (diodes != 0U) ? "with" : "without",
+               (ghost != 0U) ? "ghosted" : "decoded", (want != 0U) ? "ghosted" : "the keys held");
+        sim_stats.failures++;
+      }
+    }
+  }
+
+  /* Random sets without diodes */
+  for (i = 0U; i < SIM_MATRIX_RANDOM; i++)
+  {
+    memset(&keys, 0, sizeof(keys));
+    seed = (seed * 1664525U) + 1013904223U;
+    for (count = 2U + ((seed >> 8) % (SIM_MATRIX_KEYS_MAX - 1U)); count > 0U; count--)
+    {
+      seed = (seed * 1664525U) + 1013904223U;
+      k = (seed >> 8) % MATRIX_KEYS;
+      keys.bits[k >> 5] |= 1UL << (k & 0x1FU);
+    }
+    sim_matrix_ports(&keys, 0U, seed, samples);
+    want = sim_matrix_rectangle(samples);
+    ghost = matrix_decode(samples, &state);
+    ghosts += ghost;
+    if ((ghost != want) || (matrix_has_ghost(samples) != want) ||
+        ((ghost == 0U) && (memcmp(&state, &keys, sizeof(state)) != 0)))
+    {
+      printf("sim: matrix: random set %lu: %s, rectangle %s\n", (unsigned long)i,
+             (ghost != 0U) ? "ghosted" : "decoded", (want != 0U) ? "present" : "absent");
+      sim_stats.failures++;
+    }
+  }
+
+  printf("sim: matrix: %lu single keys, %lu written sets, %lu random sets of 2 to %lu keys (%lu ghosted) "
+         "decoded%s\n", (unsigned long)MATRIX_KEYS,
+         (unsigned long)(sizeof(sim_matrix_cases) / sizeof(sim_matrix_cases[0])), (unsigned long)SIM_MATRIX_RANDOM,
+         (unsigned long)SIM_MATRIX_KEYS_MAX, (unsigned long)ghosts,
+         (sim_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Build the row port snapshots of one scan.
+  * @param  keys: keys held down
+  * @param  diodes: one diode per key, else rows join through pressed keys
+  * @param  noise: level of the port pins that are not rows
+  * @param  samples: receives MATRIX_COLS snapshots, column 0 first
+  * @retval None
+  */
+static void sim_matrix_ports(const matrix_bitmap_t *keys, uint8_t diodes, uint32_t noise, uint16_t *samples)
+{
+  uint32_t col_rows[MATRIX_COLS];
+  uint32_t cols;
+  uint32_t rows;
+  uint32_t prev;
+  uint32_t col;
+  uint32_t c;
+
+  for (col = 0U; col < MATRIX_COLS; col++)
+  {
+    col_rows[col] = 0U;
+    for (rows = 0U; rows < MATRIX_ROWS; rows++)
+    {
+      col_rows[col] |= (uint32_t)matrix_key_is_down(keys, (col * MATRIX_ROWS) + rows) << rows;
+    }
+  }
+
+  for (col = 0U; col < MATRIX_COLS; col++)
+  {
+    rows = col_rows[col];
+    if (diodes == 0U)
+    {
+      /* Rows and idle columns joined to the strobed column through pressed keys */
+      cols = 1UL << col;
+      do
+      {
+        prev = cols;
+        for (c = 0U; c < MATRIX_COLS; c++)
+        {
+          rows |= ((cols >> c) & 1U) * col_rows[c];
+        }
+        for (c = 0U; c < MATRIX_COLS; c++)
+        {
+          cols |= ((col_rows[c] & rows) != 0U) ? (1UL << c) : 0U;
+        }
+      } while (cols != prev);
+    }
+
+    /* Pressed rows read low, the other pins whatever they are */
+    samples[col] = (uint16_t)((noise & ~(MATRIX_ROW_MASK << MATRIX_ROW_SHIFT)) |
+                              ((~rows & MATRIX_ROW_MASK) << MATRIX_ROW_SHIFT));
+  }
+}
+
+/**
+  * @brief  Look for two columns sharing two pressed rows, pair by pair.
+  * @param  samples: MATRIX_COLS row port snapshots
+  * @retval 1 if the scan holds a rectangle
+  */
+static uint8_t sim_matrix_rectangle(const uint16_t *samples)
+{
+  uint32_t a;
+  uint32_t b;
+  uint32_t r1;
+  uint32_t r2;
+
+  for (a = 0U; a < MATRIX_COLS; a++)
+  {
+    for (b = a + 1U; b < MATRIX_COLS; b++)
+    {
+      for (r1 = 0U; r1 < MATRIX_ROWS; r1++)
+      {
+        for (r2 = r1 + 1U; r2 < MATRIX_ROWS; r2++)
+        {
+          if ((((samples[a] | samples[b]) >> MATRIX_ROW_SHIFT) & ((1UL << r1) | (1UL << r2))) == 0U)
+          {
+            return 1U;
+          }
+        }
+      }
+    }
+  }
+
+  return 0U;
+}
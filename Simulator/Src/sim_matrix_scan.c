@@ -0,0 +1,184 @@
+/**
+  ******************************************************************************
+  * @file           : sim_matrix_scan.c
+  * @brief          : Simulator replacement for the TIM1/DMA matrix scanner
+  ******************************************************************************
+  * Keeps the matrix_scan.h interface. Instead of DMA filling the sample buffer,
+  * sim_matrix_scan_tick() builds one scan of row port snapshots from the keys
+  * the script holds down and hands it to matrix_decode(), as the DMA half and
+  * full transfer interrupts do on the target. Rows read low on the strobed
+  * column of a pressed key; the matrix is modelled with diodes, so scans never
+  * ghost unless the script presses a ghosting pattern on purpose.
+  *
+  * Armed as wake-up lines, all columns are low and a row falls when its
+  * first key goes down: that is the row's EXTI interrupt, which wakes the
+  * CPU from STOP and reaches usb_power_key_wake() as through main.c.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "usb_power.h"
+
+/* Exported variables --------------------------------------------------------*/
+DMA_HandleTypeDef hdma_tim1_ch1;
+
+/* Private variables ---------------------------------------------------------*/
+static matrix_bitmap_t sim_keys;
+static matrix_bitmap_t matrix_state;
+static uint8_t  matrix_running;
+static uint8_t  matrix_wake_armed;
+static uint32_t matrix_scans;
+static uint32_t matrix_ghosts;
+
+/**
+  * @brief  Nothing to configure off-target.
+  * @retval None
+  */
+void matrix_scan_init(void)
+{
+  matrix_running = 0U;
+}
+
+/**
+  * @brief  Let sim_matrix_scan_tick() produce scans.
+  * @retval None
+  */
+void matrix_scan_start(void)
+{
+  matrix_running = 1U;
+}
+
+/**
+  * @brief  Stop producing scans.
+  * @retval None
+  */
+void matrix_scan_stop(void)
+{
+  matrix_running = 0U;
+}
+
+/**
+  * @brief  Let a key press fire its row's EXTI line.
+  * @retval None
+  */
+void matrix_scan_wake_arm(void)
+{
+  matrix_wake_armed = 1U;
+}
+
+/**
+  * @brief  Back to plain row inputs.
+  * @retval None
+  */
+void matrix_scan_wake_disarm(void)
+{
+  matrix_wake_armed = 0U;
+}
+
+/**
+  * @brief  Key bitmap of the last unambiguous scan.
+  * @retval matrix bitmap
+  */
+const matrix_bitmap_t *matrix_scan_get_state(void)
+{
+  return &matrix_state;
+}
+
+/**
+  * @brief  Number of scans completed since start-up.
+  * @retval scan count
+  */
+uint32_t matrix_scan_get_count(void)
+{
+  return matrix_scans;
+}
+
+/**
+  * @brief  Called after each unambiguous scan.
+  * @param  state: key bitmap of the scan
+  * @retval None
+  */
+__weak void matrix_scan_complete_callback(const matrix_bitmap_t *state)
+{
+  UNUSED(state);
+}
+
+/**
+  * @brief  Press or release a matrix key.
+  * @param  key: col * MATRIX_ROWS + row
+  * @param  pressed: 1 to hold the key down
+  * @retval None
+  */
+void sim_matrix_set_key(uint32_t key, uint8_t pressed)
+{
+  uint32_t row = key % MATRIX_ROWS;
+  uint32_t col;
+  uint8_t row_low = 0U;
+
+  if (key >= MATRIX_KEYS)
+  {
+    return;
+  }
+
+  for (col = 0U; col < MATRIX_COLS; col++)
+  {
+    row_low |= matrix_key_is_down(&sim_keys, (col * MATRIX_ROWS) + row);
+  }
+
+  if (pressed != 0U)
+  {
+    sim_keys.bits[key >> 5] |= 1UL << (key & 0x1FU);
+  }
+  else
+  {
+    sim_keys.bits[key >> 5] &= ~(1UL << (key & 0x1FU));
+  }
+
+  /* Falling edge on the row */
+  if ((matrix_wake_armed != 0U) && (pressed != 0U) && (row_low == 0U))
+  {
+    sim_power_wake();
+    usb_power_key_wake();
+  }
+}
+
+/**
+  * @brief  Run one full matrix scan, as one DMA half/full transfer interrupt.
+  * @retval None
+  */
+void sim_matrix_scan_tick(void)
+{
+  uint16_t samples[MATRIX_COLS];
+  uint32_t col;
+  uint32_t row;
+  uint32_t rows;
+
+  if (matrix_running == 0U)
+  {
+    return;
+  }
+
+  for (col = 0U; col < MATRIX_COLS; col++)
+  {
+    rows = MATRIX_ROW_MASK;
+    for (row = 0U; row < MATRIX_ROWS; row++)
+    {
+      if (matrix_key_is_down(&sim_keys, (col * MATRIX_ROWS) + row) != 0U)
+      {
+        rows &= ~(1UL << row);
+      }
+    }
+    samples[col] = (uint16_t)(rows << MATRIX_ROW_SHIFT);
+  }
+
+  matrix_scans++;
+
+  if (matrix_decode(samples, &matrix_state) != 0U)
+  {
+    matrix_ghosts++;
+    return;
+  }
+
+  matrix_scan_complete_callback(&matrix_state);
+}
@@ -0,0 +1,329 @@
+/**
+  ******************************************************************************
+  * @file           : sim_otg.c
+  * @brief          : Emulated OTG_FS data FIFOs for the FIFO copy routines
+  ******************************************************************************
+  * Built against the target CMSIS and HAL headers, not the Simulator/Inc
+  * stand-ins, together with the target's stm32f4xx_ll_usb.c: it runs the
+  * real USB_WritePacket() and USB_ReadPacket() on the host.
+  *
+  * The OTG_FS block is mapped at its target address with the four 4 KB DFIFO
+  * windows inaccessible. Every access to a window faults; the handler makes
+  * the page accessible, loads the next Rx FIFO word for a read, and single
+  * steps the instruction; the trap that follows takes the word of a write
+  * into the Tx FIFO and closes the page again. Every word goes through the
+  * FIFO in the order of the accesses, like the core's push and pop
+  * registers, and accesses the core would take differently are counted:
+  * misaligned ones, pops of an empty FIFO and accesses to another FIFO.
+  *
+  * The trap needs x86-64 Linux; elsewhere sim_otg_init() fails and the check
+  * is skipped.
+  *
+  * The copy loops the two routines had before the four word bursts are kept
+  * here as the reference they are compared with.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#define _GNU_SOURCE               /* REG_ERR, REG_EFL, MAP_FIXED_NOREPLACE */
+#include "stm32f4xx_hal.h"
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_OTG_BASE              USB_OTG_FS_PERIPH_BASE
+#define SIM_OTG_FIFOS             4U
+#define SIM_OTG_SIZE              (USB_OTG_FIFO_BASE + (SIM_OTG_FIFOS * USB_OTG_FIFO_SIZE))
+#define SIM_OTG_QUEUE             1024U                 /* words of the emulated Tx FIFO */
+#define SIM_OTG_TRAP_FLAG         0x100U                /* EFLAGS.TF */
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t sim_otg_mapped;
+/* Updated by the trap handlers, behind the compiler's back */
+static volatile uint32_t sim_otg_tx[SIM_OTG_QUEUE];
+static volatile uint32_t sim_otg_tx_count;
+static volatile uint8_t sim_otg_fifo;         /* FIFO under test */
+static const uint32_t *volatile sim_otg_rx;
+static volatile uint32_t sim_otg_rx_count;
+static volatile uint32_t sim_otg_rx_next;
+static volatile uint32_t sim_otg_wrong;
+static volatile uintptr_t sim_otg_addr;       /* access being single stepped */
+static volatile uint8_t sim_otg_write;
+
+/* Exported functions prototypes ---------------------------------------------*/
+/* As in sim.h, which the target headers keep out of this file */
+int32_t sim_otg_init(void);
+uint32_t sim_otg_write_packet(uint8_t ep, const uint8_t *src, uint16_t len, uint8_t reference, uint8_t *fifo,
+                              uint32_t *wrong);
+uint32_t sim_otg_read_packet(const uint8_t *rx, uint32_t rx_words, uint8_t *dest, uint16_t len,
+                             uint8_t reference, uint32_t *end, uint32_t *wrong);
+
+/* Private function prototypes -----------------------------------------------*/
+#if defined(__x86_64__) && defined(__linux__)
+static void sim_otg_fault(int sig, siginfo_t *info, void *context);
+static void sim_otg_step(int sig, siginfo_t *info, void *context);
+#endif /* __x86_64__ && __linux__ */
+static void sim_otg_write_reference(const USB_OTG_GlobalTypeDef *USBx, uint8_t *src, uint8_t ch_ep_num,
+                                    uint16_t len);
+static void *sim_otg_read_reference(const USB_OTG_GlobalTypeDef *USBx, uint8_t *dest, uint16_t len);
+
+/**
+  * @brief  Map the OTG_FS block and install the FIFO traps.
+  * @note   Once per process.
+  * @retval 0, or -1 when the host cannot trap the FIFO accesses
+  */
+int32_t sim_otg_init(void)
+{
+#if defined(__x86_64__) && defined(__linux__)
+  struct sigaction action;
+  void *map;
+
+  if (sim_otg_mapped != 0U)
+  {
+    return 0;
+  }
+
+  map = mmap((void *)(uintptr_t)SIM_OTG_BASE, SIM_OTG_SIZE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (map != (void *)(uintptr_t)SIM_OTG_BASE)
+  {
+    return -1;
+  }
+  (void)mprotect((void *)(uintptr_t)(SIM_OTG_BASE + USB_OTG_FIFO_BASE), SIM_OTG_FIFOS * USB_OTG_FIFO_SIZE,
+                 PROT_NONE);
+
+  memset(&action, 0, sizeof(action));
+  action.sa_flags = SA_SIGINFO;
+  action.sa_sigaction = sim_otg_fault;
+  (void)sigaction(SIGSEGV, &action, NULL);
+  action.sa_sigaction = sim_otg_step;
+  (void)sigaction(SIGTRAP, &action, NULL);
+
+  sim_otg_mapped = 1U;
+  return 0;
+#else
+  return -1;
+#endif /* __x86_64__ && __linux__ */
+}
+
+/**
+  * @brief  Write a packet into an emulated Tx FIFO.
+  * @param  ep: endpoint number, its FIFO
+  * @param  src: packet
+  * @param  len: packet length
+  * @param  reference: 1 for the reference loop, 0 for USB_WritePacket()
+  * @param  fifo: receives the words pushed, SIM_OTG_QUEUE * 4 bytes
+  * @param  wrong: accesses the core would take differently
+  * @retval words pushed
+  */
+uint32_t sim_otg_write_packet(uint8_t ep, const uint8_t *src, uint16_t len, uint8_t reference, uint8_t *fifo,
+                              uint32_t *wrong)
+{
+  USB_OTG_GlobalTypeDef *USBx = (USB_OTG_GlobalTypeDef *)(uintptr_t)SIM_OTG_BASE;
+  uint32_t word;
+  uint32_t i;
+
+  sim_otg_fifo = ep;
+  sim_otg_tx_count = 0U;
+  sim_otg_rx_count = 0U;
+  sim_otg_rx_next = 0U;
+  sim_otg_wrong = 0U;
+
+  if (reference != 0U)
+  {
+    sim_otg_write_reference(USBx, (uint8_t *)src, ep, len);
+  }
+  else
+  {
+    (void)USB_WritePacket(USBx, (uint8_t *)src, ep, len, 0U);
+  }
+
+  for (i = 0U; (i < sim_otg_tx_count) && (i < SIM_OTG_QUEUE); i++)
+  {
+    word = sim_otg_tx[i];
+    memcpy(&fifo[i * 4U], &word, 4U);
+  }
+  *wrong = sim_otg_wrong;
+  return sim_otg_tx_count;
+}
+
+/**
+  * @brief  Read a packet from the emulated Rx FIFO.
+  * @param  rx: words in the Rx FIFO
+  * @param  rx_words: number of them
+  * @param  dest: packet buffer
+  * @param  len: packet length
+  * @param  reference: 1 for the reference loop, 0 for USB_ReadPacket()
+  * @param  end: offset from dest of the pointer returned
+  * @param  wrong: accesses the core would take differently
+  * @retval words popped
+  */
+uint32_t sim_otg_read_packet(const uint8_t *rx, uint32_t rx_words, uint8_t *dest, uint16_t len,
+                             uint8_t reference, uint32_t *end, uint32_t *wrong)
+{
+  USB_OTG_GlobalTypeDef *USBx = (USB_OTG_GlobalTypeDef *)(uintptr_t)SIM_OTG_BASE;
+  uint8_t *next;
+
+  sim_otg_fifo = 0U;
+  sim_otg_tx_count = 0U;
+  sim_otg_rx = (const uint32_t *)(const void *)rx;
+  sim_otg_rx_count = rx_words;
+  sim_otg_rx_next = 0U;
+  sim_otg_wrong = 0U;
+
+  if (reference != 0U)
+  {
+    next = sim_otg_read_reference(USBx, dest, len);
+  }
+  else
+  {
+    next = USB_ReadPacket(USBx, dest, len);
+  }
+
+  *end = (uint32_t)(next - dest);
+  *wrong = sim_otg_wrong;
+  return sim_otg_rx_next;
+}
+
+#if defined(__x86_64__) && defined(__linux__)
+/**
+  * @brief  Access to a DFIFO window: open the page and single step it.
+  * @param  sig: SIGSEGV
+  * @param  info: faulting address
+  * @param  context: interrupted context
+  * @retval None
+  */
+static void sim_otg_fault(int sig, siginfo_t *info, void *context)
+{
+  ucontext_t *uc = (ucontext_t *)context;
+  uintptr_t addr = (uintptr_t)info->si_addr;
+  uintptr_t window = SIM_OTG_BASE + USB_OTG_FIFO_BASE;
+  uint32_t fifo;
+
+  if ((addr < window) || (addr >= (window + (SIM_OTG_FIFOS * USB_OTG_FIFO_SIZE))))
+  {
+    /* A real fault: crash on it */
+    (void)signal(SIGSEGV, SIG_DFL);
+    return;
+  }
+
+  fifo = (uint32_t)((addr - window) / USB_OTG_FIFO_SIZE);
+  window += fifo * USB_OTG_FIFO_SIZE;
+  (void)mprotect((void *)window, USB_OTG_FIFO_SIZE, PROT_READ | PROT_WRITE);
+
+  sim_otg_addr = addr;
+  sim_otg_write = ((uc->uc_mcontext.gregs[REG_ERR] & 2) != 0) ? 1U : 0U;
+  if (((addr & 3U) != 0U) || (fifo != sim_otg_fifo))
+  {
+    sim_otg_wrong++;
+  }
+  if ((sim_otg_write == 0U) && ((addr & 3U) == 0U))
+  {
+    /* Pop: the next word, or what an empty FIFO gives */
+    if (sim_otg_rx_next < sim_otg_rx_count)
+    {
+      *(uint32_t *)addr = sim_otg_rx[sim_otg_rx_next];
+    }
+    else
+    {
+      *(uint32_t *)addr = 0xDEADBEEFU;
+      sim_otg_wrong++;
+    }
+    sim_otg_rx_next++;
+  }
+
+  uc->uc_mcontext.gregs[REG_EFL] |= SIM_OTG_TRAP_FLAG;
+  (void)sig;
+}
+
+/**
+  * @brief  The access is done: push a written word and close the page.
+  * @param  sig: SIGTRAP
+  * @param  info: unused
+  * @param  context: interrupted context
+  * @retval None
+  */
+static void sim_otg_step(int sig, siginfo_t *info, void *context)
+{
+  ucontext_t *uc = (ucontext_t *)context;
+  uintptr_t window = sim_otg_addr & ~(uintptr_t)(USB_OTG_FIFO_SIZE - 1U);
+
+  if ((sim_otg_write != 0U) && ((sim_otg_addr & 3U) == 0U))
+  {
+    if (sim_otg_tx_count < SIM_OTG_QUEUE)
+    {
+      sim_otg_tx[sim_otg_tx_count] = *(uint32_t *)sim_otg_addr;
+    }
+    sim_otg_tx_count++;
+  }
+  (void)mprotect((void *)window, USB_OTG_FIFO_SIZE, PROT_NONE);
+
+  uc->uc_mcontext.gregs[REG_EFL] &= ~(greg_t)SIM_OTG_TRAP_FLAG;
+  (void)sig;
+  (void)info;
+}
+#endif /* __x86_64__ && __linux__ */
+
+/**
+  * @brief  USB_WritePacket() loop before the four word bursts.
+  * @param  USBx: core
+  * @param  src: packet
+  * @param  ch_ep_num: endpoint number
+  * @param  len: packet length
+  * @retval None
+  */
+static void sim_otg_write_reference(const USB_OTG_GlobalTypeDef *USBx, uint8_t *src, uint8_t ch_ep_num,
+                                    uint16_t len)
+{
+  uint32_t USBx_BASE = (uint32_t)(uintptr_t)USBx;
+  uint8_t *pSrc = src;
+  uint32_t count32b = ((uint32_t)len + 3U) / 4U;
+  uint32_t i;
+
+  for (i = 0U; i < count32b; i++)
+  {
+    USBx_DFIFO((uint32_t)ch_ep_num) = __UNALIGNED_UINT32_READ(pSrc);
+    pSrc += 4U;
+  }
+}
+
+/**
+  * @brief  USB_ReadPacket() loop before the four word bursts.
+  * @param  USBx: core
+  * @param  dest: packet buffer
+  * @param  len: packet length
+  * @retval pointer past the packet
+  */
+static void *sim_otg_read_reference(const USB_OTG_GlobalTypeDef *USBx, uint8_t *dest, uint16_t len)
+{
+  uint32_t USBx_BASE = (uint32_t)(uintptr_t)USBx;
+  uint8_t *pDest = dest;
+  uint32_t pData;
+  uint32_t i;
+  uint32_t count32b = (uint32_t)len >> 2U;
+  uint16_t remaining_bytes = len % 4U;
+
+  for (i = 0U; i < count32b; i++)
+  {
+    __UNALIGNED_UINT32_WRITE(pDest, USBx_DFIFO(0U));
+    pDest += 4U;
+  }
+
+  if (remaining_bytes != 0U)
+  {
+    i = 0U;
+    __UNALIGNED_UINT32_WRITE(&pData, USBx_DFIFO(0U));
+
+    do
+    {
+      *(uint8_t *)pDest = (uint8_t)(pData >> (8U * (uint8_t)(i)));
+      i++;
+      pDest++;
+      remaining_bytes--;
+    } while (remaining_bytes != 0U);
+  }
+
+  return ((void *)pDest);
+}
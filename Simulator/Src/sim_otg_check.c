@@ -0,0 +1,106 @@
+/**
+  ******************************************************************************
+  * @file           : sim_otg_check.c
+  * @brief          : FIFO copy routines of the OTG low layer driver
+  ******************************************************************************
+  * The target's USB_WritePacket() and USB_ReadPacket() copy packets of every
+  * length from and to every alignment through emulated FIFOs, and must push
+  * and pop the same words as the loops they replaced.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_OTG_LEN_MAX           160U    /* every packet length up to, then a few long ones */
+#define SIM_OTG_GUARD             8U      /* bytes checked on each side of a packet read */
+#define SIM_OTG_BUF_SIZE          (1023U + (2U * SIM_OTG_GUARD) + 4U)
+
+/**
+  * @brief  Run the target's FIFO copy routines against the emulated FIFOs:
+  *         every length up to SIM_OTG_LEN_MAX and a few long ones, from and
+  *         to every byte alignment, against the loops they replaced.
+  * @retval None
+  */
+void sim_otg_check(void)
+{
+  static const uint16_t long_lens[3] = { 512U, 1000U, 1023U };
+  static uint8_t src[SIM_OTG_BUF_SIZE];
+  static uint8_t dest[2U][SIM_OTG_BUF_SIZE];
+  static uint8_t fifo[2U][SIM_OTG_QUEUE_WORDS * 4U];
+  static uint32_t rx[SIM_OTG_QUEUE_WORDS];
+  uint32_t seed = 0x6A09E667U;
+  uint32_t pushed[2];
+  uint32_t popped[2];
+  uint32_t end[2];
+  uint32_t wrong[2];
+  uint32_t words;
+  uint32_t packets = 0U;
+  uint32_t failures = sim_stats.failures;
+  uint32_t n;
+  uint32_t i;
+  uint16_t len;
+  uint8_t align;
+  uint8_t k;
+
+  if (sim_otg_init() != 0)
+  {
+    printf("sim: otg: FIFO accesses cannot be trapped on this host, skipped\n");
+    return;
+  }
+
+  for (i = 0U; i < sizeof(src); i++)
+  {
+    seed = (seed * 1664525U) + 1013904223U;
+    src[i] = (uint8_t)(seed >> 24);
+  }
+  for (i = 0U; i < SIM_OTG_QUEUE_WORDS; i++)
+  {
+    seed = (seed * 1664525U) + 1013904223U;
+    rx[i] = seed;
+  }
+
+  for (n = 0U; n <= (SIM_OTG_LEN_MAX + 3U); n++)
+  {
+    len = (n <= SIM_OTG_LEN_MAX) ? (uint16_t)n : long_lens[n - SIM_OTG_LEN_MAX - 1U];
+    words = ((uint32_t)len + 3U) / 4U;
+    for (align = 0U; align < 4U; align++)
+    {
+      /* Written: every word pushed in order into the endpoint's own FIFO, as before */
+      for (k = 0U; k < 2U; k++)
+      {
+        pushed[k] = sim_otg_write_packet((uint8_t)(n % 4U), &src[align], len, k, fifo[k], &wrong[k]);
+      }
+      if ((pushed[0] != words) || (pushed[1] != words) || (wrong[0] != 0U) ||
+          (memcmp(fifo[0], &src[align], len) != 0) || (memcmp(fifo[0], fifo[1], words * 4U) != 0))
+      {
+        printf("sim: otg: write %u bytes from +%u: %lu words, %lu wrong accesses\n", len, align,
+               (unsigned long)pushed[0], (unsigned long)wrong[0]);
+        sim_stats.failures++;
+      }
+
+      /* Read: exactly the packet's words popped, the bytes around it untouched */
+      for (k = 0U; k < 2U; k++)
+      {
+        memset(dest[k], 0xA5, sizeof(dest[k]));
+        popped[k] = sim_otg_read_packet((const uint8_t *)rx, words + 1U, &dest[k][SIM_OTG_GUARD + align], len,
+                                        k, &end[k], &wrong[k]);
+      }
+      if ((popped[0] != words) || (popped[1] != words) || (end[0] != len) || (wrong[0] != 0U) ||
+          (memcmp(&dest[0][SIM_OTG_GUARD + align], rx, len) != 0) ||
+          (memcmp(dest[0], dest[1], sizeof(dest[0])) != 0))
+      {
+        printf("sim: otg: read %u bytes to +%u: %lu words, end %lu, %lu wrong accesses\n", len, align,
+               (unsigned long)popped[0], (unsigned long)end[0], (unsigned long)wrong[0]);
+        sim_stats.failures++;
+      }
+      packets++;
+    }
+  }
+
+  printf("sim: otg: %lu packets of 0 to 1023 bytes written and read at every alignment, %s\n",
+         (unsigned long)packets, (sim_stats.failures == failures) ? "same FIFO words as before" : "FAILED");
+}
@@ -0,0 +1,155 @@
+/**
+  ******************************************************************************
+  * @file           : sim_overflow_check.c
+  * @brief          : Both IN report queues filled past their size
+  ******************************************************************************
+  * With the host no longer polling, both IN report queues are filled: the
+  * report past HID_REPORT_QUEUE_SIZE must be refused with USBD_BUSY and
+  * counted, the high-water mark must reach the queue size, and every report
+  * taken must reach the host, the high priority ones first.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "hid_controls.h"
+#include "usbd_hid.h"
+#include "usb_device.h"
+#include <stdio.h>
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t sim_overflow_send(uint8_t prio, uint8_t value);
+
+/**
+  * @brief  Fill both IN report queues while the host stops polling.
+  * @note   A queue must take HID_REPORT_QUEUE_SIZE reports, the one on the
+  *         wire included, refuse the next with USBD_BUSY and count it as an
+  *         overflow, and the other queue must still take reports. The host
+  *         must then get every accepted report, the high priority ones first.
+  * @retval None
+  */
+void sim_overflow_check(void)
+{
+  uint32_t failures = sim_stats.failures;
+  sim_host_device_t stalled = sim_device;
+  USBD_HID_HandleTypeDef *hhid;
+  uint8_t busy[HID_REPORT_PRIORITIES];
+  uint8_t report[64];
+  uint32_t high_water[HID_REPORT_PRIORITIES];
+  uint32_t overflows;
+  uint32_t received = 0U;
+  uint32_t order = 0U;
+  uint64_t end;
+  uint32_t prio;
+  uint32_t i;
+  int32_t len;
+
+  /* A fresh configuration clears the counters */
+  if (sim_host_enumerate(&sim_device) != 0)
+  {
+    printf("sim: overflow: no device\n");
+    sim_stats.failures++;
+    return;
+  }
+#ifdef USE_USBD_COMPOSITE
+  hhid = (USBD_HID_HandleTypeDef *)hUsbDeviceFS.pClassDataCmsit[HID_InstID];
+#else
+  hhid = (USBD_HID_HandleTypeDef *)hUsbDeviceFS.pClassDataCmsit[0];
+#endif /* USE_USBD_COMPOSITE */
+  if ((USBD_HID_GetQueueHighWater(&hUsbDeviceFS) != 0U) || (hhid->QueueOverflows != 0U))
+  {
+    printf("sim: overflow: counters not cleared by SET_CONFIGURATION\n");
+    sim_stats.failures++;
+  }
+
+  /* Frames go on, the interrupt IN endpoint is not polled */
+  stalled.interval = 0U;
+  (void)sim_firmware_step(&stalled, report, sizeof(report));
+  for (prio = 0U; prio < HID_REPORT_PRIORITIES; prio++)
+  {
+    for (i = 0U; i < HID_REPORT_QUEUE_SIZE; i++)
+    {
+      if (sim_overflow_send((uint8_t)prio, (uint8_t)(i + 1U)) != (uint8_t)USBD_OK)
+      {
+        printf("sim: overflow: priority %lu queue refused report %lu\n", (unsigned long)prio, (unsigned long)i);
+        sim_stats.failures++;
+      }
+      (void)sim_firmware_step(&stalled, report, sizeof(report));
+    }
+    busy[prio] = sim_overflow_send((uint8_t)prio, (uint8_t)(HID_REPORT_QUEUE_SIZE + 1U));
+    high_water[prio] = USBD_HID_GetQueueHighWater(&hUsbDeviceFS);
+  }
+  overflows = hhid->QueueOverflows;
+
+  /* Polling again: the high priority reports in order, then the others */
+  end = sim_clock_us() + ((uint64_t)SIM_QUEUE_TIMEOUT_MS * 1000U);
+  while (sim_clock_us() < end)
+  {
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+    if (len <= 0)
+    {
+      continue;
+    }
+    prio = (report[0] == HID_CONSUMER_REPORT_ID) ? HID_REPORT_PRIO_HIGH : HID_REPORT_PRIO_NORMAL;
+    if ((report[1] != ((received % HID_REPORT_QUEUE_SIZE) + 1U)) ||
+        (prio != (received / HID_REPORT_QUEUE_SIZE)))
+    {
+      order++;
+    }
+    received++;
+  }
+
+  if ((busy[HID_REPORT_PRIO_HIGH] != (uint8_t)USBD_BUSY) || (busy[HID_REPORT_PRIO_NORMAL] != (uint8_t)USBD_BUSY) ||
+      (high_water[HID_REPORT_PRIO_HIGH] != HID_REPORT_QUEUE_SIZE) ||
+      (high_water[HID_REPORT_PRIO_NORMAL] != HID_REPORT_QUEUE_SIZE) || (overflows != HID_REPORT_PRIORITIES) ||
+      (received != (HID_REPORT_PRIORITIES * HID_REPORT_QUEUE_SIZE)) || (order != 0U))
+  {
+    printf("sim: overflow: full queues returned %u/%u, high-water %lu/%lu, %lu overflows, "
+           "%lu reports received, %lu out of order\n", busy[HID_REPORT_PRIO_HIGH], busy[HID_REPORT_PRIO_NORMAL],
+           (unsigned long)high_water[HID_REPORT_PRIO_HIGH], (unsigned long)high_water[HID_REPORT_PRIO_NORMAL],
+           (unsigned long)overflows, (unsigned long)received, (unsigned long)order);
+    sim_stats.failures++;
+  }
+
+  /* A refused report goes once there is room; then the controls are released */
+  if ((sim_overflow_send(HID_REPORT_PRIO_HIGH, (uint8_t)(HID_REPORT_QUEUE_SIZE + 1U)) != (uint8_t)USBD_OK) ||
+      (sim_overflow_send(HID_REPORT_PRIO_HIGH, 0U) != (uint8_t)USBD_OK) ||
+      (sim_overflow_send(HID_REPORT_PRIO_NORMAL, 0U) != (uint8_t)USBD_OK))
+  {
+    printf("sim: overflow: report refused once the queue drained\n");
+    sim_stats.failures++;
+  }
+  (void)sim_power_run(NULL, (uint64_t)SIM_DRAIN_MS * 1000U, 0U, NULL);
+
+  printf("sim: overflow: %lu reports per priority queued with the host stalled, the next one USBD_BUSY, "
+         "%lu received in order%s\n", (unsigned long)HID_REPORT_QUEUE_SIZE, (unsigned long)received,
+         (sim_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Queue a test report: a consumer one at high priority, a system
+  *         one at normal priority.
+  * @param  prio: HID_REPORT_PRIO_HIGH or HID_REPORT_PRIO_NORMAL
+  * @param  value: usage or control bits, 0 for none
+  * @retval USBD_HID_SendReportPrio() status
+  */
+static uint8_t sim_overflow_send(uint8_t prio, uint8_t value)
+{
+  uint8_t report[HID_CONSUMER_REPORT_SIZE] = { HID_CONSUMER_REPORT_ID, value, 0U };
+  uint16_t len = HID_CONSUMER_REPORT_SIZE;
+
+  if (prio != HID_REPORT_PRIO_HIGH)
+  {
+    report[0] = HID_SYSTEM_REPORT_ID;
+    len = HID_SYSTEM_REPORT_SIZE;
+  }
+
+#ifdef USE_USBD_COMPOSITE
+  return USBD_HID_SendReportPrio(&hUsbDeviceFS, report, len, prio, HID_InstID);
+#else
+  return USBD_HID_SendReportPrio(&hUsbDeviceFS, report, len, prio);
+#endif /* USE_USBD_COMPOSITE */
+}
@@ -0,0 +1,620 @@
+/**
+  ******************************************************************************
+  * @file           : sim_pcd.c
+  * @brief          : Virtual PCD: the USBD_LL_* low level driver off-target
+  ******************************************************************************
+  * Stands in for usbd_conf.c and the OTG_FS core. The device side arms
+  * transfers through USBD_LL_Transmit() and USBD_LL_PrepareReceive() exactly
+  * as it does on the target; nothing moves until the host side asks for a
+  * packet with sim_pcd_in() or delivers one with sim_pcd_out(), which then
+  * raise the data stage callbacks the way HAL_PCD_IRQHandler() does. The
+  * callbacks may arm the next transfer but never complete it, so there is no
+  * recursion between the two sides.
+  *
+  * Like HAL_PCD_EP_Transmit(), USBD_LL_Transmit() always arms the IN side and
+  * USBD_LL_PrepareReceive() the OUT side: the core passes 0x00 for both.
+  * Control endpoint transfers complete after every packet, as the HAL limits
+  * EP0 transfers to one max packet and lets the core continue them; other
+  * endpoints complete after a short packet or the whole armed length.
+  *
+  * Suspend, resume and bus reset raise what the PCD callbacks of usbd_conf.c
+  * do: the core state change and the usb_power.c event, a resume or reset
+  * also waking the CPU from STOP like EXTI line 18. Remote wakeup signalling
+  * is timed so the host can check its length and take over the resume.
+  *
+  * Resets, SETUPs and control endpoint completions feed the enumeration
+  * trace of latency_trace.c as in usbd_conf.c. The virtual cycle counter
+  * stands still while they run, so the host times the device side itself
+  * and counts the driver calls, the register work they would cost.
+  *
+  * USBD_LL_Start() sizes the FIFOs with usb_fifo.c as usbd_conf.c does, and
+  * an endpoint whose max packet does not fit its planned FIFO is not opened.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "usbd_core.h"
+#include "usbd_hid.h"
+#if (USBD_CMPSIT_ACTIVATE_CDC == 1U)
+#include "usbd_cdc.h"
+#endif /* USBD_CMPSIT_ACTIVATE_CDC */
+#include "latency_trace.h"
+#include "usb_power.h"
+#include "usb_fifo.h"
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint8_t  open;
+  uint8_t  stalled;
+  uint8_t  active;        /* transfer armed by the device */
+  uint8_t  type;
+  uint16_t mps;
+  uint8_t *buf;
+  uint32_t len;           /* armed transfer length */
+  uint32_t count;         /* bytes moved so far */
+} sim_ep_t;
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_PCD_EPS               16U
+
+/* Private variables ---------------------------------------------------------*/
+static USBD_HandleTypeDef *sim_dev;
+static sim_ep_t sim_ep_in[SIM_PCD_EPS];
+static sim_ep_t sim_ep_out[SIM_PCD_EPS];
+static uint8_t sim_setup[8];
+static uint8_t sim_address;
+static uint8_t sim_started;
+static uint8_t sim_signalling;                /* remote wakeup driven on the bus */
+static uint64_t sim_signal_start_us;
+static uint64_t sim_signal_len_us;
+static usb_fifo_plan_t sim_fifo;
+static uint32_t sim_driver_calls;             /* USBD_LL_* endpoint and address calls of the core */
+
+/* Private function prototypes -----------------------------------------------*/
+static sim_ep_t *sim_pcd_ep(uint8_t ep_addr);
+
+/**
+  * @brief  Bind the virtual controller to the device handle.
+  * @param  pdev: Device handle
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
+{
+  sim_dev = pdev;
+  memset(sim_ep_in, 0, sizeof(sim_ep_in));
+  memset(sim_ep_out, 0, sizeof(sim_ep_out));
+  sim_address = 0U;
+  sim_started = 0U;
+  return USBD_OK;
+}
+
+/**
+  * @brief  Release the virtual controller.
+  * @param  pdev: Device handle
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_DeInit(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+  sim_dev = NULL;
+  return USBD_OK;
+}
+
+/**
+  * @brief  Connect to the bus.
+  * @param  pdev: Device handle
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_Start(USBD_HandleTypeDef *pdev)
+{
+  if (usb_fifo_plan_device(pdev, &sim_fifo) != USB_FIFO_OK)
+  {
+    return USBD_FAIL;
+  }
+  sim_started = 1U;
+  return USBD_OK;
+}
+
+/**
+  * @brief  Disconnect from the bus.
+  * @param  pdev: Device handle
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_Stop(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+  sim_started = 0U;
+  return USBD_OK;
+}
+
+/**
+  * @brief  Open an endpoint.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint number
+  * @param  ep_type: Endpoint type
+  * @param  ep_mps: Endpoint max packet size
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_OpenEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t ep_type, uint16_t ep_mps)
+{
+  sim_ep_t *ep = sim_pcd_ep(ep_addr);
+  uint8_t num = ep_addr & 0x7FU;
+
+  UNUSED(pdev);
+  sim_driver_calls++;
+  memset(ep, 0, sizeof(*ep));
+  if (((ep_addr & 0x80U) != 0U) ? ((num >= sim_fifo.tx_count) || (ep_mps > (4U * sim_fifo.tx_words[num])))
+                                : (ep_mps > sim_fifo.rx_packet))
+  {
+    return USBD_FAIL;
+  }
+  ep->open = 1U;
+  ep->type = ep_type;
+  ep->mps = ep_mps;
+  return USBD_OK;
+}
+
+/**
+  * @brief  Close an endpoint, dropping any armed transfer.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint number
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_CloseEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  sim_ep_t *ep = sim_pcd_ep(ep_addr);
+
+  UNUSED(pdev);
+  sim_driver_calls++;
+  ep->open = 0U;
+  ep->active = 0U;
+  return USBD_OK;
+}
+
+/**
+  * @brief  Flush an endpoint.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint number
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_FlushEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  UNUSED(pdev);
+  sim_driver_calls++;
+
+  if ((ep_addr & 0x80U) == 0x80U)
+  {
+    sim_pcd_ep(ep_addr)->active = 0U;
+  }
+  return USBD_OK;
+}
+
+/**
+  * @brief  Set a Stall condition on an endpoint.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint number
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_StallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  UNUSED(pdev);
+  sim_driver_calls++;
+  sim_pcd_ep(ep_addr)->stalled = 1U;
+  return USBD_OK;
+}
+
+/**
+  * @brief  Clear a Stall condition on an endpoint.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint number
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_ClearStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  UNUSED(pdev);
+  sim_driver_calls++;
+  sim_pcd_ep(ep_addr)->stalled = 0U;
+  return USBD_OK;
+}
+
+/**
+  * @brief  Return Stall condition.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint number
+  * @retval Stall (1: Yes, 0: No)
+  */
+uint8_t USBD_LL_IsStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  UNUSED(pdev);
+  sim_driver_calls++;
+  return sim_pcd_ep(ep_addr)->stalled;
+}
+
+/**
+  * @brief  Assign a USB address to the device.
+  * @param  pdev: Device handle
+  * @param  dev_addr: Device address
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_SetUSBAddress(USBD_HandleTypeDef *pdev, uint8_t dev_addr)
+{
+  UNUSED(pdev);
+  sim_driver_calls++;
+  sim_address = dev_addr;
+  return USBD_OK;
+}
+
+/**
+  * @brief  Arm an IN transfer, sent when the host polls the endpoint.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint number
+  * @param  pbuf: Pointer to data to be sent
+  * @param  size: Data size
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_Transmit(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size)
+{
+  sim_ep_t *ep = sim_pcd_ep(ep_addr | 0x80U);
+
+  UNUSED(pdev);
+  sim_driver_calls++;
+  if (ep_addr == HID_EPIN_ADDR)
+  {
+    latency_trace_stamp(LATENCY_STAMP_TRANSMIT);
+  }
+  ep->buf = pbuf;
+  ep->len = size;
+  ep->count = 0U;
+  ep->active = 1U;
+  return USBD_OK;
+}
+
+/**
+  * @brief  Arm an OUT transfer, filled when the host sends to the endpoint.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint number
+  * @param  pbuf: Pointer to data to be received
+  * @param  size: Data size
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_PrepareReceive(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size)
+{
+  sim_ep_t *ep = sim_pcd_ep(ep_addr & 0x7FU);
+
+  UNUSED(pdev);
+  sim_driver_calls++;
+  ep->buf = pbuf;
+  ep->len = size;
+  ep->count = 0U;
+  ep->active = 1U;
+  return USBD_OK;
+}
+
+/**
+  * @brief  Size of the last OUT transfer.
+  * @param  pdev: Device handle
+  * @param  ep_addr: Endpoint number
+  * @retval Received data size
+  */
+uint32_t USBD_LL_GetRxDataSize(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  UNUSED(pdev);
+  sim_driver_calls++;
+  return sim_pcd_ep(ep_addr)->count;
+}
+
+/**
+  * @brief  Test modes are not simulated.
+  * @param  pdev: Device handle
+  * @param  testmode: test mode
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_SetTestMode(USBD_HandleTypeDef *pdev, uint8_t testmode)
+{
+  UNUSED(pdev);
+  UNUSED(testmode);
+  return USBD_OK;
+}
+
+/**
+  * @brief  Start or stop remote wakeup signalling.
+  * @note   Like USB_ActivateRemoteWakeup(), only starts on a suspended bus.
+  * @param  pdev: Device handle
+  * @param  active: 1 to start, 0 to stop
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_RemoteWakeup(USBD_HandleTypeDef *pdev, uint8_t active)
+{
+  if ((active != 0U) && (pdev->dev_state == USBD_STATE_SUSPENDED))
+  {
+    sim_signalling = 1U;
+    sim_signal_start_us = sim_clock_us();
+  }
+  else if ((active == 0U) && (sim_signalling != 0U))
+  {
+    sim_signalling = 0U;
+    sim_signal_len_us = sim_clock_us() - sim_signal_start_us;
+  }
+  return USBD_OK;
+}
+
+/**
+  * @brief  Delays burn virtual time.
+  * @param  Delay: Delay in ms
+  * @retval None
+  */
+void USBD_LL_Delay(uint32_t Delay)
+{
+  HAL_Delay(Delay);
+}
+
+/**
+  * @brief  Static allocation, one block per class, as in usbd_conf.c.
+  * @param  size: Size of allocated memory
+  * @retval pointer to the class handle memory
+  */
+void *USBD_static_malloc(uint32_t size)
+{
+  static union
+  {
+    USBD_HID_HandleTypeDef hid;
+#if (USBD_CMPSIT_ACTIVATE_CDC == 1U)
+    USBD_CDC_HandleTypeDef cdc;
+#endif /* USBD_CMPSIT_ACTIVATE_CDC */
+    uint32_t align;
+  } mem[USBD_MAX_SUPPORTED_CLASS];
+
+  if ((sim_dev == NULL) || (sim_dev->classId >= USBD_MAX_SUPPORTED_CLASS) || (size > sizeof(mem[0])))
+  {
+    return NULL;
+  }
+
+  return &mem[sim_dev->classId];
+}
+
+/**
+  * @brief  Dummy memory free.
+  * @param  p: Pointer to allocated memory address
+  * @retval None
+  */
+void USBD_static_free(void *p)
+{
+  UNUSED(p);
+}
+
+/**
+  * @brief  Bus reset from the host: default address, EP0 reopened by the core.
+  * @retval None
+  */
+void sim_pcd_bus_reset(void)
+{
+  uint32_t start = latency_trace_now();
+
+  memset(sim_ep_in, 0, sizeof(sim_ep_in));
+  memset(sim_ep_out, 0, sizeof(sim_ep_out));
+  sim_address = 0U;
+
+  (void)USBD_LL_SetSpeed(sim_dev, USBD_SPEED_FULL);
+  (void)USBD_LL_Reset(sim_dev);
+  latency_trace_enum_reset(start);
+
+  /* A reset also ends a suspend */
+  sim_power_wake();
+  usb_power_resume();
+}
+
+/**
+  * @brief  The bus has been idle for 3 ms.
+  * @retval None
+  */
+void sim_pcd_suspend(void)
+{
+  (void)USBD_LL_Suspend(sim_dev);
+  usb_power_suspend();
+}
+
+/**
+  * @brief  Resume signalling from the host.
+  * @retval None
+  */
+void sim_pcd_resume(void)
+{
+  sim_power_wake();
+  (void)USBD_LL_Resume(sim_dev);
+  usb_power_resume();
+}
+
+/**
+  * @brief  Remote wakeup signalling of the device.
+  * @param  start_us: start of the last signalling
+  * @param  len_us: length of the last completed signalling
+  * @retval 1 while the device drives it
+  */
+uint8_t sim_pcd_remote_wakeup(uint64_t *start_us, uint64_t *len_us)
+{
+  *start_us = sim_signal_start_us;
+  *len_us = sim_signal_len_us;
+  return sim_signalling;
+}
+
+/**
+  * @brief  FIFO layout planned by USBD_LL_Start().
+  * @param  plan: filled with the plan
+  * @retval None
+  */
+void sim_pcd_get_fifo(usb_fifo_plan_t *plan)
+{
+  *plan = sim_fifo;
+}
+
+/**
+  * @brief  Start of frame from the host.
+  * @retval None
+  */
+void sim_pcd_sof(void)
+{
+  if (sim_started != 0U)
+  {
+    (void)USBD_LL_SOF(sim_dev);
+  }
+}
+
+/**
+  * @brief  SETUP packet from the host; clears the EP0 stall like the core does.
+  * @param  setup: 8-byte request
+  * @retval 0, or SIM_PCD_ERROR when the device is not connected
+  */
+int32_t sim_pcd_setup(const uint8_t *setup)
+{
+  uint32_t start = latency_trace_now();
+
+  if ((sim_started == 0U) || (sim_ep_out[0].open == 0U))
+  {
+    return SIM_PCD_ERROR;
+  }
+
+  sim_ep_in[0].stalled = 0U;
+  sim_ep_out[0].stalled = 0U;
+  sim_ep_in[0].active = 0U;
+  sim_ep_out[0].active = 0U;
+
+  memcpy(sim_setup, setup, sizeof(sim_setup));
+  (void)USBD_LL_SetupStage(sim_dev, sim_setup);
+  latency_trace_enum_setup(sim_setup, start);
+  return 0;
+}
+
+/**
+  * @brief  IN token from the host.
+  * @param  ep_addr: IN endpoint address
+  * @param  data: packet buffer
+  * @param  max: packet buffer size
+  * @retval packet length, SIM_PCD_NAK or SIM_PCD_STALL
+  */
+int32_t sim_pcd_in(uint8_t ep_addr, uint8_t *data, uint32_t max)
+{
+  sim_ep_t *ep = sim_pcd_ep(ep_addr | 0x80U);
+  uint32_t start = latency_trace_now();
+  uint32_t len;
+
+  if ((sim_started == 0U) || (ep->open == 0U))
+  {
+    return SIM_PCD_ERROR;
+  }
+  if (ep->stalled != 0U)
+  {
+    return SIM_PCD_STALL;
+  }
+  if (ep->active == 0U)
+  {
+    return SIM_PCD_NAK;
+  }
+
+  len = MIN(ep->len - ep->count, ep->mps);
+  if (len > max)
+  {
+    return SIM_PCD_ERROR;
+  }
+  if (len != 0U)
+  {
+    memcpy(data, &ep->buf[ep->count], len);
+  }
+  ep->count += len;
+
+  if (((ep_addr & 0x7FU) == 0U) || (len < ep->mps) || (ep->count >= ep->len))
+  {
+    ep->active = 0U;
+    if ((ep_addr & 0x7FU) == (HID_EPIN_ADDR & 0x7FU))
+    {
+      latency_trace_stamp(LATENCY_STAMP_COMPLETE);
+    }
+    (void)USBD_LL_DataInStage(sim_dev, ep_addr & 0x7FU, ep->buf);
+    if ((ep_addr & 0x7FU) == 0U)
+    {
+      latency_trace_enum_data(start);
+    }
+  }
+
+  return (int32_t)len;
+}
+
+/**
+  * @brief  OUT packet from the host.
+  * @param  ep_addr: OUT endpoint address
+  * @param  data: packet
+  * @param  len: packet length, at most the endpoint max packet size
+  * @retval packet length, SIM_PCD_NAK, SIM_PCD_STALL or SIM_PCD_ERROR
+  */
+int32_t sim_pcd_out(uint8_t ep_addr, const uint8_t *data, uint32_t len)
+{
+  sim_ep_t *ep = sim_pcd_ep(ep_addr & 0x7FU);
+  uint32_t start = latency_trace_now();
+
+  if ((sim_started == 0U) || (ep->open == 0U) || (len > ep->mps))
+  {
+    return SIM_PCD_ERROR;
+  }
+  if (ep->stalled != 0U)
+  {
+    return SIM_PCD_STALL;
+  }
+  if (ep->active == 0U)
+  {
+    return SIM_PCD_NAK;
+  }
+  if ((ep->count + len) > ep->len)
+  {
+    return SIM_PCD_ERROR;
+  }
+
+  if (len != 0U)
+  {
+    memcpy(&ep->buf[ep->count], data, len);
+  }
+  ep->count += len;
+
+  if (((ep_addr & 0x7FU) == 0U) || (len < ep->mps) || (ep->count >= ep->len))
+  {
+    ep->active = 0U;
+    (void)USBD_LL_DataOutStage(sim_dev, ep_addr & 0x7FU, ep->buf);
+    if ((ep_addr & 0x7FU) == 0U)
+    {
+      latency_trace_enum_data(start);
+    }
+  }
+
+  return (int32_t)len;
+}
+
+/**
+  * @brief  Endpoint and address calls the core made into the driver, each
+  *         one register work on the target.
+  * @retval calls since start-up
+  */
+uint32_t sim_pcd_driver_calls(void)
+{
+  return sim_driver_calls;
+}
+
+/**
+  * @brief  Address assigned by the last SET_ADDRESS.
+  * @retval device address
+  */
+uint8_t sim_pcd_get_address(void)
+{
+  return sim_address;
+}
+
+/**
+  * @brief  Endpoint state from its address.
+  * @param  ep_addr: endpoint address, bit 7 set for IN
+  * @retval endpoint state
+  */
+static sim_ep_t *sim_pcd_ep(uint8_t ep_addr)
+{
+  uint8_t num = ep_addr & 0x0FU;
+
+  return ((ep_addr & 0x80U) == 0x80U) ? &sim_ep_in[num] : &sim_ep_out[num];
+}
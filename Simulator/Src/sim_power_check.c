@@ -0,0 +1,204 @@
+/**
+  ******************************************************************************
+  * @file           : sim_power_check.c
+  * @brief          : Suspend, STOP mode and remote wakeup
+  ******************************************************************************
+  * The host suspends the bus. The device must stop scanning and sleep in
+  * STOP mode, restoring its clocks at every wake. A key pressed while the
+  * host has not enabled remote wakeup must wait for the host to resume the
+  * bus; once enabled, a key must drive resume signalling for 1 to 15 ms, no
+  * sooner than 5 ms after the last frame. Either way the key must be in the
+  * first report after the resume, and that latency is reported.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "usb_power.h"
+#include "matrix_scan.h"
+#include <stdio.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_POWER_SETTLE_MS       50U     /* suspended before the key goes down */
+#define SIM_POWER_EARLY_MS        4U      /* or right after the device suspended */
+#define SIM_POWER_TIMEOUT_MS      200U
+
+/* Private function prototypes -----------------------------------------------*/
+static void sim_power_cycle(const sim_hid_layout_t *layout, const char *key, uint32_t usage, uint8_t remote,
+                            uint32_t press_ms);
+
+/**
+  * @brief  Suspend the bus and wake the device, by the host then by keys.
+  * @retval None
+  */
+void sim_power_check(void)
+{
+  sim_hid_layout_t layout;
+  uint8_t status[2];
+
+  if ((sim_host_enumerate(&sim_device) != 0) ||
+      (sim_hid_parse(sim_device.report_desc, sim_device.report_desc_len, &layout) != 0))
+  {
+    printf("sim: power: no device\n");
+    sim_stats.failures++;
+    return;
+  }
+
+  /* Remote wakeup not enabled: the key waits for the host */
+  sim_power_cycle(&layout, "17", 0x00070004UL, 0U, SIM_POWER_SETTLE_MS);
+
+  if ((sim_host_control(0x00U, USB_REQ_SET_FEATURE, USB_FEATURE_REMOTE_WAKEUP, 0U, NULL, 0U) < 0) ||
+      (sim_host_control(0x80U, USB_REQ_GET_STATUS, 0U, 0U, status, sizeof(status)) != (int32_t)sizeof(status)) ||
+      ((status[0] & 0x02U) == 0U))
+  {
+    printf("sim: power: remote wakeup not enabled\n");
+    sim_stats.failures++;
+    return;
+  }
+
+  /* The USER button right after the device suspended, then a matrix key from STOP */
+  sim_power_cycle(&layout, "user", 0x0007004EUL, 1U, SIM_POWER_EARLY_MS);
+  sim_power_cycle(&layout, "17", 0x00070004UL, 1U, SIM_POWER_SETTLE_MS);
+
+  if (sim_host_control(0x00U, USB_REQ_CLEAR_FEATURE, USB_FEATURE_REMOTE_WAKEUP, 0U, NULL, 0U) < 0)
+  {
+    printf("sim: power: CLEAR_FEATURE failed\n");
+    sim_stats.failures++;
+  }
+}
+
+/**
+  * @brief  Suspend the bus, press a key and wait for it to be reported.
+  * @param  layout: parsed descriptor
+  * @param  key: "user" or a matrix key number
+  * @param  usage: usage the key reports
+  * @param  remote: remote wakeup enabled by the host
+  * @param  press_ms: time from the suspend to the key press
+  * @retval None
+  */
+static void sim_power_cycle(const sim_hid_layout_t *layout, const char *key, uint32_t usage, uint8_t remote,
+                            uint32_t press_ms)
+{
+  usb_power_stats_t before;
+  usb_power_stats_t after;
+  uint32_t clocks;
+  uint32_t scans = 0U;
+  uint32_t early;
+  uint64_t suspend_us;
+  uint64_t key_us;
+  uint64_t resume_us;
+  uint64_t found_us = 0U;
+  uint64_t signal_us;
+  uint64_t signal_len_us;
+  uint8_t asleep = 1U;
+
+  usb_power_get_stats(&before);
+  clocks = sim_power_clock_configs();
+  suspend_us = sim_clock_us();
+  sim_host_suspend();
+
+  early = sim_power_run(layout, (uint64_t)(press_ms / 2U) * 1000U, 0U, NULL);
+  if (press_ms >= SIM_POWER_SETTLE_MS)
+  {
+    /* Well suspended: scanner stopped and CPU in STOP mode */
+    scans = matrix_scan_get_count();
+    asleep = ((usb_power_get_state() == USB_POWER_SUSPENDED) && (sim_power_stopped() != 0U)) ? 1U : 0U;
+  }
+  early += sim_power_run(layout, (uint64_t)(press_ms - (press_ms / 2U)) * 1000U, 0U, NULL);
+  if ((press_ms >= SIM_POWER_SETTLE_MS) && (matrix_scan_get_count() != scans))
+  {
+    asleep = 0U;
+  }
+
+  key_us = sim_clock_us();
+  (void)sim_firmware_key(key, 1U);
+  resume_us = key_us;
+  if (remote == 0U)
+  {
+    early += sim_power_run(layout, (uint64_t)SIM_POWER_SETTLE_MS * 1000U, 0U, NULL);
+    if ((sim_pcd_remote_wakeup(&signal_us, &signal_len_us) != 0U) || (signal_us > suspend_us) ||
+        (sim_power_stopped() == 0U))
+    {
+      asleep = 0U;
+    }
+    resume_us = sim_clock_us();
+    sim_host_resume();
+  }
+  (void)sim_power_run(layout, (uint64_t)SIM_POWER_TIMEOUT_MS * 1000U, usage, &found_us);
+  usb_power_get_stats(&after);
+  (void)sim_pcd_remote_wakeup(&signal_us, &signal_len_us);
+
+  if ((asleep == 0U) || (early != 0U) || (found_us == 0U) || (after.suspends != (before.suspends + 1U)) ||
+      ((after.stops - before.stops) != (sim_power_clock_configs() - clocks)) ||
+      ((remote == 0U) && ((after.resumes != (before.resumes + 1U)) ||
+                          (after.ignored_wakes != (before.ignored_wakes + 1U)))) ||
+      ((remote != 0U) && ((after.remote_wakeups != (before.remote_wakeups + 1U)) ||
+                          (signal_us < (suspend_us + 5000U)) || (signal_len_us < 1000U) ||
+                          (signal_len_us > 15000U))))
+  {
+    printf("sim: power: key %s, remote wakeup %s: wrong sleep or wake (asleep %u, early reports %lu, "
+           "report %s)\n", key, (remote != 0U) ? "on" : "off", asleep, (unsigned long)early,
+           (found_us != 0U) ? "seen" : "missing");
+    sim_stats.failures++;
+  }
+  else if (remote == 0U)
+  {
+    printf("sim: power: key %s while suspended: %lu STOP entries, reported %llu us after the host resumed\n",
+           key, (unsigned long)(after.stops - before.stops), (unsigned long long)(found_us - resume_us));
+  }
+  else
+  {
+    printf("sim: power: key %s %lu ms into the suspend: %lu STOP entries, resume signalling %llu us "
+           "from %llu us after the last frame, reported %llu us after the press\n", key, (unsigned long)press_ms,
+           (unsigned long)(after.stops - before.stops), (unsigned long long)signal_len_us,
+           (unsigned long long)(signal_us - suspend_us), (unsigned long long)(found_us - key_us));
+  }
+
+  (void)sim_firmware_key(key, 0U);
+  (void)sim_power_run(layout, (uint64_t)SIM_DRAIN_MS * 1000U, 0U, NULL);
+}
+
+/**
+  * @brief  Run the firmware outside the script statistics.
+  * @param  layout: parsed descriptor
+  * @param  us: how long
+  * @param  usage: stop at the first report with this usage, 0 to run the whole time
+  * @param  found_us: time of that report, left alone when none
+  * @retval number of reports
+  */
+uint32_t sim_power_run(const sim_hid_layout_t *layout, uint64_t us, uint32_t usage, uint64_t *found_us)
+{
+  uint64_t end = sim_clock_us() + us;
+  uint32_t got[SIM_DESC_USAGES];
+  uint8_t report[64];
+  uint32_t reports = 0U;
+  int32_t len;
+  int32_t n;
+  int32_t i;
+
+  while (sim_clock_us() < end)
+  {
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+    if (len <= 0)
+    {
+      continue;
+    }
+    reports++;
+    if (usage == 0U)
+    {
+      continue;
+    }
+
+    n = sim_hid_decode(layout, SIM_HID_INPUT, report, (uint32_t)len, got, SIM_DESC_USAGES);
+    for (i = 0; (i < n) && (i < (int32_t)SIM_DESC_USAGES); i++)
+    {
+      if (got[i] == usage)
+      {
+        *found_us = sim_clock_us();
+        return reports;
+      }
+    }
+  }
+
+  return reports;
+}
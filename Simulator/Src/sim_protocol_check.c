@@ -0,0 +1,108 @@
+/**
+  ******************************************************************************
+  * @file           : sim_protocol_check.c
+  * @brief          : Boot and report protocol round trip with a key held
+  ******************************************************************************
+  * With a key held the host switches to the boot protocol and back, and must
+  * get the key again at once in the 8-byte boot report, then in the report
+  * protocol layout.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "hid_keyboard.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t sim_protocol_run(uint32_t ms, uint8_t *report, int32_t *len);
+
+/**
+  * @brief  Switch to the boot protocol and back with a key held down.
+  * @note   Each switch must resend the held key at once in the new layout:
+  *         the 8-byte boot report without a report ID, then the report
+  *         protocol one; GET_PROTOCOL must follow.
+  * @retval None
+  */
+void sim_protocol_check(void)
+{
+  uint32_t failures = sim_stats.failures;
+  hid_key_state_t state;
+  uint8_t report[64];
+  uint8_t want[HID_KBD_MAX_REPORT_SIZE];
+  uint8_t protocol;
+  uint16_t want_len;
+  uint32_t reports;
+  uint32_t step;
+  int32_t len = 0;
+
+  hid_key_state_clear(&state);
+  hid_key_state_set(&state, 0x04U, 1U);                  /* key 17 is A */
+  (void)sim_firmware_key("17", 1U);
+  (void)sim_protocol_run(SIM_DRAIN_MS, report, &len);
+
+  for (step = 0U; step < 2U; step++)
+  {
+    /* Boot protocol first, then back to report protocol */
+    protocol = (step == 0U) ? HID_KBD_PROTOCOL_BOOT : HID_KBD_PROTOCOL_REPORT;
+    want_len = hid_kbd_encode(&state, protocol, want);
+    if (sim_host_control(0x21U, 0x0BU, protocol, 0U, NULL, 0U) < 0)
+    {
+      printf("sim: protocol: SET_PROTOCOL(%u) failed\n", protocol);
+      sim_stats.failures++;
+    }
+    reports = sim_protocol_run(SIM_DRAIN_MS, report, &len);
+    if ((reports != 1U) || (len != (int32_t)want_len) || (memcmp(report, want, want_len) != 0) ||
+        ((protocol == HID_KBD_PROTOCOL_BOOT) && (len != (int32_t)HID_KBD_BOOT_REPORT_SIZE)))
+    {
+      printf("sim: protocol: SET_PROTOCOL(%u): %lu reports, the last %ld bytes, want one of %u\n", protocol,
+             (unsigned long)reports, (long)len, want_len);
+      sim_stats.failures++;
+    }
+    if ((sim_host_control(0xA1U, 0x03U, 0U, 0U, report, 1U) != 1) || (report[0] != protocol))
+    {
+      printf("sim: protocol: GET_PROTOCOL does not return %u\n", protocol);
+      sim_stats.failures++;
+    }
+  }
+
+  (void)sim_firmware_key("17", 0U);
+  reports = sim_protocol_run(SIM_DRAIN_MS, report, &len);
+  if ((reports != 1U) || (len != (int32_t)hid_kbd_encode(&state, HID_KBD_PROTOCOL_REPORT, want)))
+  {
+    printf("sim: protocol: release after the round trip not reported\n");
+    sim_stats.failures++;
+  }
+
+  printf("sim: protocol: SET_PROTOCOL(0) resent the held key as an %u-byte boot report, SET_PROTOCOL(1) "
+         "as report %u%s\n", HID_KBD_BOOT_REPORT_SIZE, want[0], (sim_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Run the firmware and keep the last input report.
+  * @param  ms: how long
+  * @param  report: receives the last report
+  * @param  len: receives its length, left alone when none came
+  * @retval number of reports
+  */
+static uint32_t sim_protocol_run(uint32_t ms, uint8_t *report, int32_t *len)
+{
+  uint64_t end = sim_clock_us() + ((uint64_t)ms * 1000U);
+  uint8_t buf[64];
+  uint32_t reports = 0U;
+  int32_t n;
+
+  while (sim_clock_us() < end)
+  {
+    n = sim_firmware_step(&sim_device, buf, sizeof(buf));
+    if (n > 0)
+    {
+      memcpy(report, buf, (size_t)n);
+      *len = n;
+      reports++;
+    }
+  }
+
+  return reports;
+}
@@ -0,0 +1,220 @@
+/**
+  ******************************************************************************
+  * @file           : sim_queue_check.c
+  * @brief          : Key edges while the host stops polling
+  ******************************************************************************
+  * The host stops polling the interrupt IN endpoint while keys are tapped,
+  * until the HID queue is full and more edges wait behind it. Once polling
+  * resumes every press and release must arrive in its own report. Stalled
+  * again for more edges than the edge queue holds, with one key held
+  * throughout and another released last, the host must end up with the held
+  * key alone down.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "key_events.h"
+#include "usbd_hid.h"
+#include <stdio.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_QUEUE_TAPS            24U     /* keys 0..23, none of them a modifier */
+#define SIM_QUEUE_OVERFLOW_TAPS   KEY_EVENT_QUEUE_SIZE   /* twice the edges the edge queue holds */
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+/* Private function prototypes -----------------------------------------------*/
+static void sim_queue_overflow(const sim_hid_layout_t *layout);
+
+/**
+  * @brief  Tap keys while the host stops polling, then check that every
+  *         press and release still reaches the host in its own report.
+  * @note   The HID IN queue fills after HID_REPORT_QUEUE_SIZE edges; the
+  *         others must wait in the edge queue, not be merged into the
+  *         report the HID queue could not take.
+  * @retval None
+  */
+void sim_queue_check(void)
+{
+  uint32_t failures = sim_stats.failures;
+  sim_host_device_t stalled = sim_device;
+  sim_hid_layout_t layout;
+  uint32_t got[SIM_DESC_USAGES];
+  uint32_t last_usage = 0U;
+  uint32_t reports = 0U;
+  uint32_t depth;
+  uint32_t dropped;
+  uint64_t end;
+  uint8_t report[64];
+  char key[8];
+  int32_t len;
+  int32_t n;
+  uint32_t i;
+
+  if (sim_hid_parse(sim_device.report_desc, sim_device.report_desc_len, &layout) != 0)
+  {
+    printf("sim: queue: report descriptor not parsed\n");
+    sim_stats.failures++;
+    return;
+  }
+  (void)sim_power_run(&layout, (uint64_t)SIM_DRAIN_MS * 1000U, 0U, NULL);
+
+  /* Frames go on, the interrupt IN endpoint is not polled */
+  stalled.interval = 0U;
+  dropped = key_events_dropped();
+  for (i = 0U; i < (2U * SIM_QUEUE_TAPS); i++)
+  {
+    (void)snprintf(key, sizeof(key), "%lu", (unsigned long)(i / 2U));
+    (void)sim_firmware_key(key, ((i & 1U) == 0U) ? 1U : 0U);
+    end = sim_clock_us() + ((uint64_t)SIM_QUEUE_TAP_MS * 1000U);
+    while (sim_clock_us() < end)
+    {
+      (void)sim_firmware_step(&stalled, report, sizeof(report));
+    }
+  }
+  depth = USBD_HID_GetQueueDepth(&hUsbDeviceFS);
+
+  /* Polling again: one report per edge, presses and releases alternating */
+  end = sim_clock_us() + ((uint64_t)SIM_QUEUE_TIMEOUT_MS * 1000U);
+  while (sim_clock_us() < end)
+  {
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+    if (len <= 0)
+    {
+      continue;
+    }
+    n = sim_hid_decode(&layout, SIM_HID_INPUT, report, (uint32_t)len, got, SIM_DESC_USAGES);
+    if ((reports % 2U) == 0U)
+    {
+      if ((n != 1) || (got[0] == last_usage))
+      {
+        printf("sim: queue: edge %lu: press not reported on its own (%ld usages)\n",
+               (unsigned long)reports, (long)n);
+        sim_stats.failures++;
+        break;
+      }
+      last_usage = got[0];
+    }
+    else if (n != 0)
+    {
+      printf("sim: queue: edge %lu: release not reported (%ld usages)\n", (unsigned long)reports, (long)n);
+      sim_stats.failures++;
+      break;
+    }
+    reports++;
+  }
+
+  if ((depth != HID_REPORT_QUEUE_SIZE) || (key_events_dropped() != dropped) ||
+      (reports != (2U * SIM_QUEUE_TAPS)))
+  {
+    printf("sim: queue: %lu edges with the IN endpoint stalled: %lu reports queued, %lu received, "
+           "%lu edges dropped\n", (unsigned long)(2U * SIM_QUEUE_TAPS), (unsigned long)depth,
+           (unsigned long)reports, (unsigned long)(key_events_dropped() - dropped));
+    sim_stats.failures++;
+  }
+
+  printf("sim: queue: %lu edges while the host stopped polling, %lu held in the full HID queue, "
+         "%lu reports once it resumed%s\n", (unsigned long)(2U * SIM_QUEUE_TAPS), (unsigned long)depth,
+         (unsigned long)reports, (sim_stats.failures != failures) ? " (FAILED)" : "");
+
+  sim_queue_overflow(&layout);
+}
+
+/**
+  * @brief  Overflow the edge queue while the host stops polling, then check
+  *         that no key is left down on the host.
+  * @note   Keys 0 and 1 go down, keys 2..23 are tapped round robin and key
+  *         1 comes up last. Its release is among the edges the full edge
+  *         queue drops, which are replaced by one report of the debounced
+  *         state: it must hold key 0 alone.
+  * @param  layout: parsed report descriptor
+  * @retval None
+  */
+static void sim_queue_overflow(const sim_hid_layout_t *layout)
+{
+  uint32_t failures = sim_stats.failures;
+  sim_host_device_t stalled = sim_device;
+  uint32_t got[SIM_DESC_USAGES];
+  uint32_t held = 0U;
+  uint32_t reports = 0U;
+  uint32_t dropped;
+  uint64_t end;
+  uint8_t report[64];
+  char key[8];
+  int32_t len;
+  int32_t n = -1;
+  uint32_t i;
+
+  stalled.interval = 0U;
+  dropped = key_events_dropped();
+  for (i = 0U; i < (3U + (2U * SIM_QUEUE_OVERFLOW_TAPS)); i++)
+  {
+    if (i < 2U)
+    {
+      (void)sim_firmware_key((i == 0U) ? "0" : "1", 1U);
+    }
+    else if (i == (2U + (2U * SIM_QUEUE_OVERFLOW_TAPS)))
+    {
+      (void)sim_firmware_key("1", 0U);
+    }
+    else
+    {
+      (void)snprintf(key, sizeof(key), "%lu", (unsigned long)(2U + (((i - 2U) / 2U) % (SIM_QUEUE_TAPS - 2U))));
+      (void)sim_firmware_key(key, ((i & 1U) == 0U) ? 1U : 0U);
+    }
+    end = sim_clock_us() + ((uint64_t)SIM_QUEUE_TAP_MS * 1000U);
+    while (sim_clock_us() < end)
+    {
+      (void)sim_firmware_step(&stalled, report, sizeof(report));
+    }
+  }
+  dropped = key_events_dropped() - dropped;
+
+  /* Polling again: the first report is key 0, the last must be key 0 alone */
+  end = sim_clock_us() + ((uint64_t)SIM_QUEUE_TIMEOUT_MS * 1000U);
+  while (sim_clock_us() < end)
+  {
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+    if (len <= 0)
+    {
+      continue;
+    }
+    n = sim_hid_decode(layout, SIM_HID_INPUT, report, (uint32_t)len, got, SIM_DESC_USAGES);
+    if ((reports == 0U) && (n == 1))
+    {
+      held = got[0];
+    }
+    reports++;
+  }
+
+  if ((dropped == 0U) || (held == 0U) || (n != 1) || (got[0] != held))
+  {
+    printf("sim: queue: overflow: %lu edges dropped, last of %lu reports has %ld usages, 0x%08lX first\n",
+           (unsigned long)dropped, (unsigned long)reports, (long)n, (n > 0) ? (unsigned long)got[0] : 0UL);
+    sim_stats.failures++;
+  }
+
+  /* Key 0 comes up like any other */
+  (void)sim_firmware_key("0", 0U);
+  n = -1;
+  end = sim_clock_us() + ((uint64_t)SIM_QUEUE_TIMEOUT_MS * 1000U);
+  while (sim_clock_us() < end)
+  {
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+    if (len > 0)
+    {
+      n = sim_hid_decode(layout, SIM_HID_INPUT, report, (uint32_t)len, got, SIM_DESC_USAGES);
+    }
+  }
+  if (n != 0)
+  {
+    printf("sim: queue: overflow: %ld usages left down after the last release\n", (long)n);
+    sim_stats.failures++;
+  }
+
+  printf("sim: queue: %lu edges with key 0 held while the host stopped polling, %lu dropped by the full edge "
+         "queue, %lu reports, no key left down%s\n", (unsigned long)(3U + (2U * SIM_QUEUE_OVERFLOW_TAPS)),
+         (unsigned long)dropped, (unsigned long)reports, (sim_stats.failures != failures) ? " (FAILED)" : "");
+}
@@ -0,0 +1,146 @@
+/**
+  ******************************************************************************
+  * @file           : sim_report_check.c
+  * @brief          : GET_REPORT and SET_REPORT at the edges of the control transfer
+  ******************************************************************************
+  * GET_REPORT and SET_REPORT are sent with wLength short of, equal to and
+  * past each report, and for report IDs and types the device does not have,
+  * which must stall and leave the LEDs and the configuration status as they
+  * were.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "hid_controls.h"
+#include "hid_config.h"
+#include "usbd_hid.h"
+#include "latency_trace.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_REPORT_ANY            0xFFU   /* configuration status not checked */
+
+/* Private typedef -----------------------------------------------------------*/
+/* One GET_REPORT or SET_REPORT and how the device must answer it */
+typedef struct
+{
+  const char *name;
+  uint8_t     bm_request;
+  uint16_t    value;           /* report type << 8 | report ID */
+  uint16_t    length;
+  uint8_t     arg;             /* data byte after the report ID */
+  int32_t     want;            /* bytes moved, or SIM_PCD_STALL */
+  uint8_t     status;          /* configuration status afterwards, SIM_REPORT_ANY if not checked */
+} sim_report_case_t;
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+static const sim_report_case_t sim_report_cases[] =
+{
+  /* GET_REPORT: the report is cut at wLength, never padded to it */
+  { "feature, short wLength", 0xA1U, 0x0304U, 3U, 0U, 3, SIM_REPORT_ANY },
+  { "feature, exact wLength", 0xA1U, 0x0304U, HID_CONFIG_REPORT_SIZE, 0U, 8, SIM_REPORT_ANY },
+  { "feature, long wLength", 0xA1U, 0x0304U, HID_CTRL_REPORT_SIZE, 0U, 8, SIM_REPORT_ANY },
+  { "latency trace, long wLength", 0xA1U, 0x0307U, 255U, 0U, (int32_t)LATENCY_TRACE_REPORT_SIZE, SIM_REPORT_ANY },
+  { "input, short wLength", 0xA1U, 0x0102U, 2U, 0U, 2, SIM_REPORT_ANY },
+  { "feature, report ID 0", 0xA1U, 0x0300U, 8U, 0U, SIM_PCD_STALL, SIM_REPORT_ANY },
+  { "feature, keyboard report ID", 0xA1U, 0x0301U, 8U, 0U, SIM_PCD_STALL, SIM_REPORT_ANY },
+  { "feature, unknown report ID", 0xA1U, 0x0308U, 8U, 0U, SIM_PCD_STALL, SIM_REPORT_ANY },
+  { "input, unknown report ID", 0xA1U, 0x0109U, 8U, 0U, SIM_PCD_STALL, SIM_REPORT_ANY },
+  { "output report", 0xA1U, 0x0201U, 2U, 0U, SIM_PCD_STALL, SIM_REPORT_ANY },
+  /* SET_REPORT: short and long data reach the application, which judges them */
+  { "feature, exact wLength", 0x21U, 0x0304U, HID_CONFIG_REPORT_SIZE, HID_CONFIG_DEBOUNCE_MS, 8, HID_CONFIG_OK },
+  { "feature, short wLength", 0x21U, 0x0304U, 4U, HID_CONFIG_DEBOUNCE_MS, 4, HID_CONFIG_ERR_REPORT },
+  { "feature, long wLength", 0x21U, 0x0304U, 16U, HID_CONFIG_DEBOUNCE_MS, 16, HID_CONFIG_OK },
+  { "feature, wLength 0", 0x21U, 0x0304U, 0U, HID_CONFIG_DEBOUNCE_MS, SIM_PCD_STALL, HID_CONFIG_OK },
+  { "feature, past the buffer", 0x21U, 0x0304U, HID_CTRL_REPORT_SIZE + 1U, 0U, SIM_PCD_STALL, HID_CONFIG_OK },
+  { "feature, report ID 0", 0x21U, 0x0300U, 8U, 0U, SIM_PCD_STALL, HID_CONFIG_OK },
+  { "feature, keyboard report ID", 0x21U, 0x0301U, 8U, 0U, SIM_PCD_STALL, HID_CONFIG_OK },
+  { "feature, unknown report ID", 0x21U, 0x0308U, 8U, 0U, SIM_PCD_STALL, HID_CONFIG_OK },
+  { "input report", 0x21U, 0x0101U, 9U, 0U, SIM_PCD_STALL, HID_CONFIG_OK },
+  { "LED report", 0x21U, 0x0201U, HID_LED_REPORT_SIZE, 0x02U, (int32_t)HID_LED_REPORT_SIZE, HID_CONFIG_OK },
+  { "output, unknown report ID", 0x21U, 0x0202U, HID_LED_REPORT_SIZE, 0x05U, SIM_PCD_STALL, HID_CONFIG_OK },
+  { "LED report, cleared", 0x21U, 0x0201U, HID_LED_REPORT_SIZE, 0x00U, (int32_t)HID_LED_REPORT_SIZE, HID_CONFIG_OK },
+};
+
+/**
+  * @brief  Run GET_REPORT and SET_REPORT at the edges of the control transfer.
+  * @note   wLength shorter than a report must cut it and longer must end the
+  *         data stage at it; a report the device does not have, or a type
+  *         it cannot take, must stall without touching any state, and the
+  *         next request must be answered as usual. A feature report read
+  *         with a short wLength must be the start of the whole report.
+  * @retval None
+  */
+void sim_report_check(void)
+{
+  uint32_t failures = sim_stats.failures;
+  const sim_report_case_t *c;
+  uint8_t data[HID_CTRL_REPORT_SIZE + 1U];
+  uint8_t whole[HID_CONFIG_REPORT_SIZE];
+  uint8_t leds = USBD_HID_GetLedState(&hUsbDeviceFS);
+  uint32_t stalls = 0U;
+  uint32_t i;
+  int32_t len;
+
+  /* The consumer report last sent is read back as input report 2 */
+  (void)hid_consumer_press(HID_CONSUMER_VOLUME_UP);
+  (void)sim_power_run(NULL, (uint64_t)SIM_DRAIN_MS * 1000U, 0U, NULL);
+  (void)hid_consumer_release();
+  (void)sim_power_run(NULL, (uint64_t)SIM_DRAIN_MS * 1000U, 0U, NULL);
+  if (sim_host_control(0xA1U, 0x01U, 0x0300U | HID_CONFIG_PARAM_REPORT_ID, 0U, whole, sizeof(whole)) !=
+      (int32_t)sizeof(whole))
+  {
+    printf("sim: report: parameter report not served\n");
+    sim_stats.failures++;
+    return;
+  }
+
+  for (i = 0U; i < (sizeof(sim_report_cases) / sizeof(sim_report_cases[0])); i++)
+  {
+    c = &sim_report_cases[i];
+    memset(data, 0, sizeof(data));
+    data[0] = LOBYTE(c->value);
+    data[1] = c->arg;
+    data[2] = HID_CONFIG_OP_SELECT;
+    len = sim_host_control(c->bm_request, (c->bm_request == 0xA1U) ? 0x01U : 0x09U, c->value, 0U, data,
+                           c->length);
+    if (len != c->want)
+    {
+      printf("sim: report: %s_REPORT %s: %ld, want %ld\n", (c->bm_request == 0xA1U) ? "GET" : "SET", c->name,
+             (long)len, (long)c->want);
+      sim_stats.failures++;
+    }
+    if ((c->value == (0x0300U | HID_CONFIG_PARAM_REPORT_ID)) && (c->bm_request == 0xA1U) && (len > 0) &&
+        (memcmp(data, whole, (size_t)len) != 0))
+    {
+      printf("sim: report: GET_REPORT %s: not the start of the report\n", c->name);
+      sim_stats.failures++;
+    }
+    stalls += (len == SIM_PCD_STALL) ? 1U : 0U;
+
+    /* A stalled SET_REPORT leaves the LEDs and the configuration status alone */
+    if ((HIBYTE(c->value) == HID_REPORT_TYPE_OUTPUT) && (c->bm_request == 0x21U) && (len >= 0))
+    {
+      leds = c->arg;
+    }
+    if (USBD_HID_GetLedState(&hUsbDeviceFS) != leds)
+    {
+      printf("sim: report: %s: LEDs 0x%02X, want 0x%02X\n", c->name, USBD_HID_GetLedState(&hUsbDeviceFS), leds);
+      sim_stats.failures++;
+    }
+    if ((c->status != SIM_REPORT_ANY) &&
+        ((sim_host_control(0xA1U, 0x01U, 0x0300U | HID_CONFIG_PARAM_REPORT_ID, 0U, data, sizeof(whole)) !=
+          (int32_t)sizeof(whole)) || (data[2] != c->status)))
+    {
+      printf("sim: report: SET_REPORT %s: status %u, want %u\n", c->name, data[2], c->status);
+      sim_stats.failures++;
+    }
+  }
+
+  printf("sim: report: %lu GET_REPORT and SET_REPORT edge cases, %lu of them stalled%s\n",
+         (unsigned long)i, (unsigned long)stalls, (sim_stats.failures != failures) ? " (FAILED)" : "");
+}
@@ -0,0 +1,434 @@
+/**
+  ******************************************************************************
+  * @file           : sim_store_check.c
+  * @brief          : Configuration store persistence and power cuts
+  ******************************************************************************
+  * Parameters written through the feature report must reach the flash store
+  * once left alone and come back after a remount. A long mix of writes then
+  * reports write amplification and erases, and the same writes are replayed
+  * across the first compaction with the power cut at every flash operation
+  * in turn, sometimes again during the recovery: after the next mount every
+  * value must be the last one written, the one being written when the power
+  * went old or new.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "config_store.h"
+#include "keyboard.h"
+#include "hid_config.h"
+#include "kbd_layout.h"
+#include "typing.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_STORE_KEYS            12U     /* 2, 4 and 32 byte values, four keys each */
+#define SIM_STORE_OPS             60000U
+#define SIM_STORE_LEAD            100U    /* writes replayed before the first compaction */
+#define SIM_STORE_TAIL            20U     /* and after it */
+#define SIM_STORE_CYCLES          10000U  /* erase cycles a sector is rated for */
+
+/* Private typedef -----------------------------------------------------------*/
+/* One write of the store workload, a deletion when len is 0 */
+typedef struct
+{
+  uint8_t key;
+  uint8_t len;
+  uint8_t value[CONFIG_STORE_VALUE_MAX];
+} sim_store_op_t;
+
+/* Private variables ---------------------------------------------------------*/
+static sim_store_op_t sim_store_ops[SIM_STORE_OPS];
+static sim_store_op_t sim_store_model[CONFIG_STORE_KEYS];     /* value of each key, key field unused */
+static sim_store_op_t sim_store_saved[CONFIG_STORE_KEYS];
+static uint8_t sim_store_snapshot[2U * CONFIG_STORE_SECTOR_SIZE];
+static jmp_buf sim_store_jmp;
+static volatile uint32_t sim_store_op;                           /* write in flight */
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t sim_store_param(uint8_t id, uint16_t value);
+static void sim_store_persist(void);
+static uint32_t sim_store_workload(void);
+static void sim_store_power_cut(uint32_t first_compaction);
+static void sim_store_write(uint32_t op);
+static int32_t sim_store_verify(uint32_t in_flight);
+
+/**
+  * @brief  Check the configuration store: persistence of the parameters,
+  *         write amplification and power cuts.
+  * @retval None
+  */
+void sim_store_check(void)
+{
+  uint32_t first_compaction;
+
+  sim_store_persist();
+  first_compaction = sim_store_workload();
+  if (first_compaction != 0U)
+  {
+    sim_store_power_cut(first_compaction);
+  }
+
+  /* Leave an empty store behind */
+  sim_flash_init();
+  (void)config_store_init();
+}
+
+/**
+  * @brief  Write a parameter through the configuration feature report.
+  * @param  id: hid_config_id_t
+  * @param  value: new value
+  * @retval 0 when the device took it
+  */
+static int32_t sim_store_param(uint8_t id, uint16_t value)
+{
+  uint8_t report[HID_CONFIG_REPORT_SIZE];
+
+  memset(report, 0, sizeof(report));
+  report[0] = HID_CONFIG_PARAM_REPORT_ID;
+  report[1] = id;
+  report[2] = HID_CONFIG_OP_WRITE;
+  report[3] = (uint8_t)value;
+  report[4] = (uint8_t)(value >> 8);
+
+  if ((sim_host_control(0x21U, 0x09U, 0x0300U | HID_CONFIG_PARAM_REPORT_ID, 0U, report, sizeof(report)) < 0) ||
+      (sim_host_control(0xA1U, 0x01U, 0x0300U | HID_CONFIG_PARAM_REPORT_ID, 0U, report,
+                        sizeof(report)) != (int32_t)sizeof(report)) ||
+      (report[2] != HID_CONFIG_OK))
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+  * @brief  Parameters written by the host are saved after the quiet time
+  *         and loaded again by the next start-up.
+  * @retval None
+  */
+static void sim_store_persist(void)
+{
+  config_store_stats_t early;
+  config_store_stats_t late;
+  config_store_stats_t before;
+  uint16_t debounce_ms = 0U;
+
+  /* Let the changes of the earlier checks be saved first */
+  sim_run_us((uint64_t)(HID_CONFIG_SAVE_DELAY_MS + SIM_DRAIN_MS) * 1000U);
+  config_store_get_stats(&before);
+
+  if ((sim_store_param(HID_CONFIG_DEBOUNCE_MS, 3U) != 0) || (sim_store_param(HID_CONFIG_LAYOUT, KBD_LAYOUT_DE) != 0))
+  {
+    printf("sim: store: parameters not taken\n");
+    sim_stats.failures++;
+    return;
+  }
+  sim_run_us((uint64_t)(HID_CONFIG_SAVE_DELAY_MS / 2U) * 1000U);
+  config_store_get_stats(&early);
+  sim_run_us((uint64_t)HID_CONFIG_SAVE_DELAY_MS * 1000U);
+  config_store_get_stats(&late);
+
+  /* Start-up again: mount, then load */
+  typing_set_layout(KBD_LAYOUT_US);
+  if ((config_store_init() != CONFIG_STORE_OK) || (hid_config_init(), 0) ||
+      (hid_config_get(HID_CONFIG_DEBOUNCE_MS, &debounce_ms) != HID_CONFIG_OK) || (debounce_ms != 3U) ||
+      (typing_get_layout() != KBD_LAYOUT_DE) || (early.writes != before.writes) ||
+      (late.writes != (before.writes + 2U)))
+  {
+    printf("sim: store: %lu writes before the quiet time, %lu after, debounce %u ms and layout %s after a restart\n",
+           (unsigned long)(early.writes - before.writes), (unsigned long)(late.writes - before.writes), debounce_ms,
+           sim_keymap_name(typing_get_layout()));
+    sim_stats.failures++;
+  }
+
+  if (sim_layout_select(KBD_LAYOUT_DEFAULT) == 0)
+  {
+    (void)sim_store_param(HID_CONFIG_DEBOUNCE_MS, KEYBOARD_DEBOUNCE_MS);
+    sim_run_us((uint64_t)(HID_CONFIG_SAVE_DELAY_MS + SIM_DRAIN_MS) * 1000U);
+  }
+}
+
+/**
+  * @brief  Generate the workload, run it against a fresh store and report
+  *         write amplification and erases.
+  * @retval index of the write that caused the first compaction, 0 on failure
+  */
+static uint32_t sim_store_workload(void)
+{
+  static const uint8_t lens[3] = { 2U, 4U, CONFIG_STORE_VALUE_MAX };
+  config_store_stats_t stats;
+  sim_flash_stats_t flash;
+  uint32_t seed = 0x9E3779B9U;
+  uint32_t first_compaction = 0U;
+  uint32_t compactions = 0U;
+  sim_store_op_t *op;
+  uint32_t i;
+  uint32_t b;
+
+  /* Random values, one in eight the value already stored, one in 64 a deletion */
+  memset(sim_store_model, 0, sizeof(sim_store_model));
+  for (i = 0U; i < SIM_STORE_OPS; i++)
+  {
+    op = &sim_store_ops[i];
+    seed = (seed * 1664525U) + 1013904223U;
+    op->key = (uint8_t)((seed >> 8) % SIM_STORE_KEYS);
+    op->len = lens[op->key / 4U];
+    if (((seed >> 24) & 0x3FU) == 0U)
+    {
+      op->len = 0U;
+    }
+    else if ((((seed >> 20) & 7U) == 0U) && (sim_store_model[op->key].len != 0U))
+    {
+      memcpy(op->value, sim_store_model[op->key].value, op->len);
+    }
+    else
+    {
+      for (b = 0U; b < op->len; b++)
+      {
+        seed = (seed * 1664525U) + 1013904223U;
+        op->value[b] = (uint8_t)(seed >> 24);
+      }
+    }
+    sim_store_model[op->key].len = op->len;
+    memcpy(sim_store_model[op->key].value, op->value, op->len);
+  }
+
+  sim_flash_init();
+  memset(sim_store_model, 0, sizeof(sim_store_model));
+  if (config_store_init() != CONFIG_STORE_OK)
+  {
+    printf("sim: store: cannot format\n");
+    sim_stats.failures++;
+    return 0U;
+  }
+
+  for (i = 0U; i < SIM_STORE_OPS; i++)
+  {
+    sim_store_write(i);
+    config_store_get_stats(&stats);
+    if ((stats.compactions > compactions) && (first_compaction == 0U) && (i != 0U))
+    {
+      first_compaction = i;
+    }
+    compactions = stats.compactions;
+
+    if ((((i % 997U) == 0U) || (i == (SIM_STORE_OPS - 1U))) && (sim_store_verify(UINT32_MAX) != 0))
+    {
+      printf("sim: store: values differ after write %lu\n", (unsigned long)i);
+      sim_stats.failures++;
+      return 0U;
+    }
+  }
+  config_store_get_stats(&stats);
+  sim_flash_get_stats(&flash);
+
+  if ((config_store_init() != CONFIG_STORE_OK) || (sim_store_verify(UINT32_MAX) != 0) || (flash.conflicts != 0U) ||
+      ((flash.programs * 4U) != stats.programmed) || (first_compaction <= SIM_STORE_LEAD))
+  {
+    printf("sim: store: values lost by a remount, or %lu programs set bits\n", (unsigned long)flash.conflicts);
+    sim_stats.failures++;
+    return 0U;
+  }
+
+  printf("sim: store: %lu writes, %lu unchanged, %lu value bytes, %lu programmed, write amplification %.2f\n",
+         (unsigned long)stats.writes, (unsigned long)stats.unchanged, (unsigned long)stats.value_bytes,
+         (unsigned long)stats.programmed, (double)stats.programmed / (double)stats.value_bytes);
+  printf("sim: store: %lu compactions, erases %lu/%lu, %lu writes per erase, %.1f M writes at %u cycles\n",
+         (unsigned long)stats.compactions, (unsigned long)flash.erases[0], (unsigned long)flash.erases[1],
+         (unsigned long)(stats.writes / (flash.erases[0] + flash.erases[1])),
+         ((double)stats.writes * 2.0 * SIM_STORE_CYCLES) / (double)(flash.erases[0] + flash.erases[1]) / 1e6,
+         (unsigned)SIM_STORE_CYCLES);
+
+  return first_compaction;
+}
+
+/**
+  * @brief  Replay the writes around the first compaction with the power cut
+  *         at each flash operation in turn.
+  * @param  first_compaction: index of the write that compacts
+  * @retval None
+  */
+static void sim_store_power_cut(uint32_t first_compaction)
+{
+  static volatile uint32_t cut;
+  static volatile uint32_t cuts;
+  static volatile uint32_t second_cuts;
+  static uint32_t recovered;
+  static uint32_t kept_new;
+  config_store_stats_t stats;
+  sim_flash_stats_t before;
+  sim_flash_stats_t after;
+  uint32_t start = first_compaction - SIM_STORE_LEAD;
+  uint32_t end = MIN(first_compaction + SIM_STORE_TAIL, SIM_STORE_OPS);
+  uint32_t flash_ops;
+  uint8_t value[CONFIG_STORE_VALUE_MAX];
+  uint8_t len;
+  uint32_t i;
+
+  /* The store as it was before the replayed writes */
+  sim_flash_init();
+  memset(sim_store_model, 0, sizeof(sim_store_model));
+  (void)config_store_init();
+  for (i = 0U; i < start; i++)
+  {
+    sim_store_write(i);
+  }
+  sim_flash_save(sim_store_snapshot);
+  memcpy(sim_store_saved, sim_store_model, sizeof(sim_store_model));
+
+  /* Flash operations to cut at */
+  sim_flash_get_stats(&before);
+  for (i = start; i < end; i++)
+  {
+    sim_store_write(i);
+  }
+  sim_flash_get_stats(&after);
+  flash_ops = (after.programs - before.programs) + (after.erases[0] - before.erases[0]) +
+              (after.erases[1] - before.erases[1]);
+
+  cuts = 0U;
+  second_cuts = 0U;
+  recovered = 0U;
+  kept_new = 0U;
+  for (cut = 1U; cut <= flash_ops; cut++)
+  {
+    sim_flash_restore(sim_store_snapshot);
+    memcpy(sim_store_model, sim_store_saved, sizeof(sim_store_model));
+    (void)config_store_init();
+
+    if (setjmp(sim_store_jmp) == 0)
+    {
+      sim_flash_power_cut(cut, &sim_store_jmp, cut);
+      for (sim_store_op = start; sim_store_op < end; sim_store_op++)
+      {
+        sim_store_write(sim_store_op);
+      }
+    }
+    else
+    {
+      cuts++;
+    }
+    sim_flash_power_cut(0U, NULL, 0U);
+
+    /* Every fourth time, the power goes again during the recovery */
+    if ((cut % 4U) == 0U)
+    {
+      if (setjmp(sim_store_jmp) == 0)
+      {
+        sim_flash_power_cut(1U + (cut % 7U), &sim_store_jmp, ~cut);
+        (void)config_store_init();
+      }
+      else
+      {
+        second_cuts++;
+      }
+      sim_flash_power_cut(0U, NULL, 0U);
+    }
+
+    if ((config_store_init() != CONFIG_STORE_OK) || (sim_store_verify(sim_store_op) != 0))
+    {
+      printf("sim: store: power cut at flash operation %lu of %lu, during write %lu, loses a value\n",
+             (unsigned long)cut, (unsigned long)flash_ops, (unsigned long)sim_store_op);
+      sim_stats.failures++;
+      return;
+    }
+    config_store_get_stats(&stats);
+    recovered += stats.recovered;
+    len = (uint8_t)sizeof(value);
+    if ((sim_store_op < end) && (sim_store_ops[sim_store_op].len != 0U) &&
+        (config_store_get(sim_store_ops[sim_store_op].key, value, &len) == CONFIG_STORE_OK) &&
+        (len == sim_store_ops[sim_store_op].len) && (memcmp(value, sim_store_ops[sim_store_op].value, len) == 0))
+    {
+      kept_new++;
+    }
+
+    /* Still writable */
+    value[0] = (uint8_t)cut;
+    value[1] = (uint8_t)(cut >> 8);
+    len = 2U;
+    if ((config_store_set(0U, value, 2U) != CONFIG_STORE_OK) || (config_store_init() != CONFIG_STORE_OK) ||
+        (config_store_get(0U, value, &len) != CONFIG_STORE_OK) || (len != 2U) || (value[0] != (uint8_t)cut) ||
+        (value[1] != (uint8_t)(cut >> 8)))
+    {
+      printf("sim: store: not writable after a power cut at flash operation %lu\n", (unsigned long)cut);
+      sim_stats.failures++;
+      return;
+    }
+  }
+
+  sim_flash_get_stats(&after);
+  printf("sim: store: %lu power cuts over %lu writes, %lu during recovery, %lu recoveries, %lu new values kept\n",
+         (unsigned long)cuts, (unsigned long)(end - start), (unsigned long)second_cuts, (unsigned long)recovered,
+         (unsigned long)kept_new);
+  if ((cuts != flash_ops) || (after.conflicts != 0U))
+  {
+    printf("sim: store: %lu of %lu cuts happened, %lu programs set bits\n", (unsigned long)cuts,
+           (unsigned long)flash_ops, (unsigned long)after.conflicts);
+    sim_stats.failures++;
+  }
+}
+
+/**
+  * @brief  Apply one workload write to the store, then to the model.
+  * @param  op: index in sim_store_ops
+  * @retval None
+  */
+static void sim_store_write(uint32_t op)
+{
+  const sim_store_op_t *write = &sim_store_ops[op];
+
+  if (write->len == 0U)
+  {
+    (void)config_store_delete(write->key);
+  }
+  else
+  {
+    (void)config_store_set(write->key, write->value, write->len);
+  }
+
+  sim_store_model[write->key].len = write->len;
+  memcpy(sim_store_model[write->key].value, write->value, write->len);
+}
+
+/**
+  * @brief  Compare every key of the store with the model.
+  * @param  in_flight: workload write cut short, whose key may hold the old
+  *         or the new value; UINT32_MAX for none
+  * @retval 0 when they match
+  */
+static int32_t sim_store_verify(uint32_t in_flight)
+{
+  const sim_store_op_t *write = (in_flight < SIM_STORE_OPS) ? &sim_store_ops[in_flight] : NULL;
+  const sim_store_op_t *want;
+  uint8_t value[CONFIG_STORE_VALUE_MAX];
+  config_store_status_t status;
+  uint8_t len;
+  uint32_t key;
+
+  for (key = 0U; key < CONFIG_STORE_KEYS; key++)
+  {
+    len = (uint8_t)sizeof(value);
+    status = config_store_get((uint8_t)key, value, &len);
+    if (status != CONFIG_STORE_OK)
+    {
+      len = 0U;
+    }
+
+    want = &sim_store_model[key];
+    if ((len == want->len) && (memcmp(value, want->value, len) == 0))
+    {
+      continue;
+    }
+    if ((write != NULL) && (write->key == key) && (len == write->len) && (memcmp(value, write->value, len) == 0))
+    {
+      continue;
+    }
+
+    return -1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,83 @@
+/**
+  ******************************************************************************
+  * @file           : sim_string_check.c
+  * @brief          : String descriptors against USBD_GetString()
+  ******************************************************************************
+  * The string descriptors must be byte for byte what USBD_GetString() makes
+  * of their strings and the serial number of the unique ID.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "usbd_ctlreq.h"
+#include "usbd_desc.h"
+#include <stdio.h>
+#include <string.h>
+
+/**
+  * @brief  Check the string descriptors against what USBD_GetString() makes
+  *         of their strings, and of the unique ID for the serial number.
+  * @retval None
+  */
+void sim_string_check(void)
+{
+  static const uint8_t langid[USB_LEN_LANGID_STR_DESC] = { USB_LEN_LANGID_STR_DESC, USB_DESC_TYPE_STRING,
+                                                           0x09U, 0x04U };
+  const struct
+  {
+    uint8_t index;
+    const char *text;
+  } strings[] =
+  {
+    { USBD_IDX_MFC_STR, USBD_MANUFACTURER_STRING },
+    { USBD_IDX_PRODUCT_STR, USBD_PRODUCT_STRING_FS },
+    { USBD_IDX_SERIAL_STR, NULL },
+    { USBD_IDX_CONFIG_STR, USBD_CONFIGURATION_STRING_FS },
+    { USBD_IDX_INTERFACE_STR, USBD_INTERFACE_STRING_FS },
+  };
+  uint8_t got[USBD_MAX_STR_DESC_SIZ];
+  uint8_t want[USBD_MAX_STR_DESC_SIZ];
+  char serial[16];
+  uint16_t want_len;
+  uint32_t failures = sim_stats.failures;
+  uint32_t bytes = 0U;
+  uint32_t i;
+  uint32_t k;
+  int32_t len;
+
+  len = sim_host_control(0x80U, USB_REQ_GET_DESCRIPTOR, USB_DESC_TYPE_STRING << 8, 0U, got, 255U);
+  if ((len != (int32_t)sizeof(langid)) || (memcmp(got, langid, sizeof(langid)) != 0))
+  {
+    printf("sim: strings: language ID descriptor differs\n");
+    sim_stats.failures++;
+  }
+
+  /* The serial number as Get_SerialNum() has always spelt it */
+  (void)snprintf(serial, sizeof(serial), "%08lX%04lX", (unsigned long)(sim_uid[0] + sim_uid[2]),
+                 (unsigned long)(sim_uid[1] >> 16));
+
+  for (i = 0U; i < (sizeof(strings) / sizeof(strings[0])); i++)
+  {
+    USBD_GetString((uint8_t *)((strings[i].text != NULL) ? strings[i].text : serial), want, &want_len);
+
+    /* Twice: the serial number is built on the first request only */
+    for (k = 0U; k < 2U; k++)
+    {
+      len = sim_host_control(0x80U, USB_REQ_GET_DESCRIPTOR, (uint16_t)((USB_DESC_TYPE_STRING << 8) | strings[i].index),
+                             0x0409U, got, 255U);
+      if ((len != (int32_t)want_len) || (memcmp(got, want, want_len) != 0))
+      {
+        printf("sim: strings: string %u differs from USBD_GetString(), %ld bytes for %u\n", strings[i].index,
+               (long)len, want_len);
+        sim_stats.failures++;
+        break;
+      }
+    }
+    bytes += want_len;
+  }
+
+  printf("sim: strings: %lu string descriptors, %lu bytes, %s\n",
+         (unsigned long)(sizeof(strings) / sizeof(strings[0])), (unsigned long)bytes,
+         (sim_stats.failures == failures) ? "same bytes as USBD_GetString()" : "FAILED");
+}
@@ -0,0 +1,232 @@
+/**
+  ******************************************************************************
+  * @file           : sim_typing_check.c
+  * @brief          : Typed text read back by the host
+  ******************************************************************************
+  * A text is typed at a 1 ms and at a 10 ms polling interval, through the
+  * console's bulk OUT endpoint when there is one. The host turns the reports
+  * back into characters with the US layout; the text must come out
+  * unchanged, less the characters the layout cannot type, and the typing
+  * rate is reported in characters per second.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim.h"
+#include "hid_keyboard.h"
+#include "usbd_hid.h"
+#include "kbd_layout.h"
+#include "typing.h"
+#include "usbd_cdc.h"
+#include <stdio.h>
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define SIM_TYPING_REPEAT         16U
+#define SIM_TYPING_TIMEOUT_MS     60000U
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+/* Every printable character, doubled letters, shifted runs, a tab, line
+   endings, two characters the US layout lacks and a malformed byte */
+static const char sim_typing_sample[] =
+  "The quick brown fox jumps over the lazy dog. PACK MY BOX WITH FIVE DOZEN LIQUOR JUGS!\n"
+  "0123456789 `~!@#$%^&*()-_=+[{]}\\|;:'\",<.>/? aabbccdd\tAaBbCc\r\n"
+  "caf\xC3\xA9 \xE2\x82\xAC \xFF ok\n";
+static char sim_typing_text[SIM_TYPING_SIZE];
+static char sim_typing_want[SIM_TYPING_SIZE];
+static char sim_typing_got[SIM_TYPING_SIZE];
+
+/**
+  * @brief  Type the sample text at 1 ms and 10 ms polling intervals.
+  * @note   The expected text keeps the ASCII characters, turns CR LF into one
+  *         line feed and drops the rest: the US layout has no key for them.
+  * @retval None
+  */
+void sim_typing_check(void)
+{
+  uint32_t len = 0U;
+  uint32_t want_len = 0U;
+  uint32_t c;
+  uint32_t i;
+
+  for (i = 0U; i < SIM_TYPING_REPEAT; i++)
+  {
+    memcpy(&sim_typing_text[len], sim_typing_sample, sizeof(sim_typing_sample) - 1U);
+    len += sizeof(sim_typing_sample) - 1U;
+  }
+  sim_typing_text[len] = '\0';
+
+  for (c = 0U; c < len; c++)
+  {
+    if (((uint8_t)sim_typing_text[c] < 0x80U) &&
+        ((sim_typing_text[c] != '\n') || (c == 0U) || (sim_typing_text[c - 1U] != '\r')))
+    {
+      sim_typing_want[want_len++] = (sim_typing_text[c] == '\r') ? '\n' : sim_typing_text[c];
+    }
+  }
+  sim_typing_want[want_len] = '\0';
+
+  if (sim_layout_select(KBD_LAYOUT_US) != 0)
+  {
+    return;
+  }
+  sim_typing_run(sim_typing_text, sim_typing_want, 1U, KBD_LAYOUT_US, 2U * SIM_TYPING_REPEAT, SIM_TYPING_REPEAT);
+  sim_typing_run(sim_typing_text, sim_typing_want, 10U, KBD_LAYOUT_US, 2U * SIM_TYPING_REPEAT, SIM_TYPING_REPEAT);
+
+  /* Back to the default interval */
+  if ((USBD_HID_SetPollingInterval(&hUsbDeviceFS, HID_FS_BINTERVAL) != (uint8_t)USBD_OK) ||
+      (sim_host_enumerate(&sim_device) != 0))
+  {
+    sim_stats.failures++;
+  }
+}
+
+/**
+  * @brief  Re-enumerate at a polling interval, type a text and check what
+  *         the host reads back.
+  * @param  text: UTF-8 text to type
+  * @param  want: text the host must read back
+  * @param  interval: polling interval in ms
+  * @param  layout: layout the host reads the keys with
+  * @param  unmapped: characters the firmware is expected to skip
+  * @param  invalid: malformed sequences the firmware is expected to skip
+  * @retval None
+  */
+void sim_typing_run(const char *text, const char *want, uint8_t interval, uint8_t layout, uint32_t unmapped,
+                    uint32_t invalid)
+{
+  static sim_hid_layout_t desc;
+  uint32_t usage[SIM_DESC_USAGES];
+  uint8_t report[64];
+  hid_key_state_t prev;
+  hid_key_state_t cur;
+  typing_stats_t before;
+  typing_stats_t after;
+  uint32_t text_len = (uint32_t)strlen(text);
+  uint32_t want_len = (uint32_t)strlen(want);
+  uint32_t got_len = 0U;
+  uint32_t chars = 0U;
+  uint32_t sent = 0U;
+  uint32_t reports = 0U;
+  uint32_t dead = 0U;
+  uint32_t codepoint;
+  uint64_t start;
+  uint64_t last;
+  uint64_t end;
+  uint8_t mods;
+  uint32_t c;
+  int32_t len;
+  int32_t n;
+  int32_t i;
+
+  if ((USBD_HID_SetPollingInterval(&hUsbDeviceFS, interval) != (uint8_t)USBD_OK) ||
+      (sim_host_enumerate(&sim_device) != 0) || (sim_device.interval != interval) ||
+      (sim_hid_parse(sim_device.report_desc, sim_device.report_desc_len, &desc) != 0))
+  {
+    printf("sim: typing: no device at a %u ms interval\n", interval);
+    sim_stats.failures++;
+    return;
+  }
+
+  typing_get_stats(&before);
+  hid_key_state_clear(&prev);
+  start = sim_clock_us();
+  last = start;
+  end = start + ((uint64_t)SIM_TYPING_TIMEOUT_MS * 1000U);
+
+  while (sim_clock_us() < end)
+  {
+    /* One bulk OUT packet per frame, NAKed while the text buffer is full */
+    if ((sent < text_len) && ((sim_clock_us() % SIM_FRAME_US) == 0U))
+    {
+      if (sim_device.cdc_out != 0U)
+      {
+        len = sim_host_bulk_out(&sim_device, (const uint8_t *)&text[sent],
+                                MIN(text_len - sent, CDC_DATA_FS_OUT_PACKET_SIZE));
+      }
+      else
+      {
+        len = (int32_t)typing_write(&text[sent], text_len - sent);
+      }
+      if (len < 0)
+      {
+        printf("sim: typing: bulk OUT failed (%ld)\n", (long)len);
+        sim_stats.failures++;
+        return;
+      }
+      sent += (uint32_t)len;
+    }
+
+    len = sim_firmware_step(&sim_device, report, sizeof(report));
+    if (len > 0)
+    {
+      reports++;
+      n = sim_hid_decode(&desc, SIM_HID_INPUT, report, (uint32_t)len, usage, SIM_DESC_USAGES);
+      if (n < 0)
+      {
+        printf("sim: typing: report %lu does not decode\n", (unsigned long)reports);
+        sim_stats.failures++;
+        return;
+      }
+      hid_key_state_clear(&cur);
+      for (i = 0; (i < n) && (i < (int32_t)SIM_DESC_USAGES); i++)
+      {
+        hid_key_state_set(&cur, (uint8_t)usage[i], 1U);
+      }
+
+      /* A character for every key that went down, with the modifiers of the report */
+      mods = (uint8_t)(cur.bits[HID_USAGE_MODIFIER_FIRST >> 5] >> (HID_USAGE_MODIFIER_FIRST & 0x1FU));
+      for (c = HID_USAGE_FIRST_KEY; c < HID_USAGE_MODIFIER_FIRST; c++)
+      {
+        if (((cur.bits[c >> 5] & ~prev.bits[c >> 5]) & (1UL << (c & 0x1FU))) == 0U)
+        {
+          continue;
+        }
+        n = sim_keymap_press(layout, (uint8_t)c, mods, &dead, &codepoint);
+        if ((n < 0) || (got_len > (sizeof(sim_typing_got) - 4U)))
+        {
+          printf("sim: typing: usage 0x%02lX with modifiers 0x%02X types nothing on %s\n", (unsigned long)c,
+                 mods, sim_keymap_name(layout));
+          sim_stats.failures++;
+          return;
+        }
+        if (n > 0)
+        {
+          got_len += sim_utf8_encode(codepoint, &sim_typing_got[got_len]);
+          chars++;
+        }
+        last = sim_clock_us();
+      }
+      prev = cur;
+    }
+
+    if ((sent == text_len) && (typing_busy() == 0U) && (USBD_HID_GetQueueDepth(&hUsbDeviceFS) == 0U))
+    {
+      break;
+    }
+  }
+  typing_get_stats(&after);
+
+  printf("sim: typing %s at %u ms: %lu chars in %lu reports, %.3f s, %.0f chars/s\n", sim_keymap_name(layout),
+         interval, (unsigned long)chars, (unsigned long)reports, (double)(last - start) / 1e6,
+         (last > start) ? ((double)chars * 1e6) / (double)(last - start) : 0.0);
+
+  if ((got_len != want_len) || (memcmp(sim_typing_got, want, want_len) != 0))
+  {
+    for (c = 0U; (c < got_len) && (c < want_len) && (sim_typing_got[c] == want[c]); c++)
+    {
+    }
+    printf("sim: typing: text differs at byte %lu of %lu (%lu typed)\n", (unsigned long)c,
+           (unsigned long)want_len, (unsigned long)got_len);
+    sim_stats.failures++;
+  }
+  if (((after.unmapped - before.unmapped) != unmapped) || ((after.invalid - before.invalid) != invalid) ||
+      (dead != 0U) || (prev.bits[0] != 0U) || (prev.bits[HID_USAGE_MODIFIER_FIRST >> 5] != 0U))
+  {
+    printf("sim: typing: %lu unmapped, %lu invalid, keys left down\n",
+           (unsigned long)(after.unmapped - before.unmapped), (unsigned long)(after.invalid - before.invalid));
+    sim_stats.failures++;
+  }
+}
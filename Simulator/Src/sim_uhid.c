@@ -0,0 +1,512 @@
+/**
+  ******************************************************************************
+  * @file           : sim_uhid.c
+  * @brief          : Bridge the simulated keyboard to Linux through /dev/uhid
+  ******************************************************************************
+  * The firmware runs in real time: the virtual clock is kept in step with
+  * CLOCK_MONOTONIC. After the scripted host has enumerated the device, a uhid
+  * device is created with the report descriptor bytes read back from the
+  * firmware (HID_MOUSE_ReportDesc) and the VID/PID of its device descriptor,
+  * so the kernel HID core parses exactly what a real host would.
+  *
+  *  - input reports polled from the interrupt IN endpoint go to UHID_INPUT2,
+  *  - UHID_OUTPUT (LED) reports go to the interrupt OUT endpoint,
+  *  - UHID_GET_REPORT / UHID_SET_REPORT become GET_REPORT / SET_REPORT
+  *    control transfers, so the feature reports work end to end.
+  *
+  * Keys are driven from stdin ("press <key>", "release <key>", "quit", key
+  * as in the script runner). "uhid bench <n>" toggles PA0 <n> times and
+  * measures the time from the injected edge to the evdev event timestamp.
+  * Needs write access to /dev/uhid and read access to /dev/input.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#define _GNU_SOURCE               /* ppoll() */
+#include "sim.h"
+#include "usbd_def.h"
+#include "usbd_hid.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+#define UHID_NAME                 "STM32F411 DISCO HID Keyboard (sim)"
+#define UHID_BENCH_GAP_US         30000U   /* between bench edges, above the debounce time */
+#define UHID_BENCH_TIMEOUT_US     1000000U
+#define UHID_LINE_MAX             128U
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t remaining;
+  uint8_t  waiting;       /* an edge was injected, its event has not arrived */
+  uint8_t  level;         /* level of the last injected edge */
+  uint64_t edge_us;       /* CLOCK_MONOTONIC time of the edge */
+  uint64_t next_us;       /* earliest time of the next edge */
+  uint64_t min_us;
+  uint64_t max_us;
+  uint64_t sum_us;
+  uint32_t count;
+} uhid_bench_t;
+
+/* Private variables ---------------------------------------------------------*/
+static sim_host_device_t uhid_dev;
+static uhid_bench_t uhid_bench;
+static volatile sig_atomic_t uhid_stop;
+static int uhid_fd = -1;
+static int uhid_evdev_fd = -1;
+static uint8_t uhid_started;
+static uint64_t uhid_epoch_us;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t uhid_now_us(void);
+static void uhid_signal(int sig);
+static int uhid_write(const struct uhid_event *ev);
+static int uhid_create(void);
+static void uhid_input(const uint8_t *report, int32_t len);
+static void uhid_handle_event(void);
+static int uhid_find_evdev(void);
+static void uhid_handle_evdev(void);
+static void uhid_handle_stdin(void);
+static void uhid_bench_poll(void);
+
+/**
+  * @brief  Bridge entry point.
+  * @param  argc: argument count
+  * @param  argv: optional "bench <count>"
+  * @retval 0 on a clean exit
+  */
+int main(int argc, char **argv)
+{
+  struct pollfd fds[3];
+  struct timespec timeout;
+  uint8_t report[64];
+  int32_t len;
+  uint64_t now;
+  uint64_t next;
+  nfds_t nfds;
+
+  if ((argc == 3) && (strcmp(argv[1], "bench") == 0))
+  {
+    uhid_bench.remaining = (uint32_t)strtoul(argv[2], NULL, 0);
+    uhid_bench.min_us = UINT64_MAX;
+  }
+  else if (argc != 1)
+  {
+    fprintf(stderr, "usage: %s [bench <count>]\n", argv[0]);
+    return 2;
+  }
+
+  sim_firmware_init();
+  if (sim_host_enumerate(&uhid_dev) != 0)
+  {
+    return 1;
+  }
+
+  uhid_fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+  if (uhid_fd < 0)
+  {
+    perror("/dev/uhid");
+    return 1;
+  }
+  if (uhid_create() != 0)
+  {
+    return 1;
+  }
+
+  signal(SIGINT, uhid_signal);
+  signal(SIGTERM, uhid_signal);
+  (void)fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+
+  /* Virtual time 0 is now: the firmware runs from here in real time */
+  uhid_epoch_us = uhid_now_us() - sim_clock_us();
+
+  while (uhid_stop == 0)
+  {
+    now = uhid_now_us() - uhid_epoch_us;
+    while ((sim_clock_us() + SIM_STEP_US) <= now)
+    {
+      len = sim_firmware_step(&uhid_dev, report, sizeof(report));
+      if (len > 0)
+      {
+        uhid_input(report, len);
+      }
+    }
+
+    if ((uhid_started != 0U) && (uhid_evdev_fd < 0))
+    {
+      uhid_evdev_fd = uhid_find_evdev();
+    }
+    uhid_bench_poll();
+
+    fds[0].fd = uhid_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = STDIN_FILENO;
+    fds[1].events = POLLIN;
+    fds[2].fd = uhid_evdev_fd;
+    fds[2].events = POLLIN;
+    nfds = (uhid_evdev_fd >= 0) ? 3U : 2U;
+
+    next = sim_clock_us() + SIM_STEP_US;
+    now = uhid_now_us() - uhid_epoch_us;
+    timeout.tv_sec = 0;
+    timeout.tv_nsec = (next > now) ? (long)((next - now) * 1000U) : 0L;
+
+    if (ppoll(fds, nfds, &timeout, NULL) > 0)
+    {
+      if ((fds[0].revents & POLLIN) != 0)
+      {
+        uhid_handle_event();
+      }
+      if ((fds[1].revents & POLLIN) != 0)
+      {
+        uhid_handle_stdin();
+      }
+      if ((nfds == 3U) && ((fds[2].revents & POLLIN) != 0))
+      {
+        uhid_handle_evdev();
+      }
+    }
+  }
+
+  if (uhid_bench.count != 0U)
+  {
+    printf("uhid: edge to evdev latency us over %lu edges: min %llu avg %llu max %llu\n",
+           (unsigned long)uhid_bench.count, (unsigned long long)uhid_bench.min_us,
+           (unsigned long long)(uhid_bench.sum_us / uhid_bench.count),
+           (unsigned long long)uhid_bench.max_us);
+  }
+
+  {
+    struct uhid_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.type = UHID_DESTROY;
+    (void)uhid_write(&ev);
+  }
+  close(uhid_fd);
+
+  return ((uhid_bench.remaining != 0U) || (uhid_bench.waiting != 0U)) ? 1 : 0;
+}
+
+/**
+  * @brief  Wall clock used to pace the firmware and time the benchmark.
+  * @retval CLOCK_MONOTONIC in microseconds
+  */
+static uint64_t uhid_now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000U) + ((uint64_t)ts.tv_nsec / 1000U);
+}
+
+/**
+  * @brief  Stop the bridge on SIGINT/SIGTERM.
+  * @param  sig: signal number
+  * @retval None
+  */
+static void uhid_signal(int sig)
+{
+  (void)sig;
+  uhid_stop = 1;
+}
+
+/**
+  * @brief  Write one event to /dev/uhid.
+  * @param  ev: event
+  * @retval 0, or -1 on error
+  */
+static int uhid_write(const struct uhid_event *ev)
+{
+  ssize_t ret = write(uhid_fd, ev, sizeof(*ev));
+
+  if (ret != (ssize_t)sizeof(*ev))
+  {
+    fprintf(stderr, "uhid: write failed: %s\n", (ret < 0) ? strerror(errno) : "short write");
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  Register the uhid device with the descriptor read from the firmware.
+  * @retval 0, or -1 on error
+  */
+static int uhid_create(void)
+{
+  struct uhid_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.type = UHID_CREATE2;
+  (void)snprintf((char *)ev.u.create2.name, sizeof(ev.u.create2.name), "%s", UHID_NAME);
+  (void)snprintf((char *)ev.u.create2.phys, sizeof(ev.u.create2.phys), "sim-usb-%u", uhid_dev.address);
+  ev.u.create2.rd_size = uhid_dev.report_desc_len;
+  ev.u.create2.bus = BUS_USB;
+  ev.u.create2.vendor = uhid_dev.vid;
+  ev.u.create2.product = uhid_dev.pid;
+  memcpy(ev.u.create2.rd_data, uhid_dev.report_desc, uhid_dev.report_desc_len);
+
+  return uhid_write(&ev);
+}
+
+/**
+  * @brief  Forward an input report polled from the interrupt IN endpoint.
+  * @param  report: report, ID first
+  * @param  len: report length
+  * @retval None
+  */
+static void uhid_input(const uint8_t *report, int32_t len)
+{
+  struct uhid_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.type = UHID_INPUT2;
+  ev.u.input2.size = (uint16_t)len;
+  memcpy(ev.u.input2.data, report, (size_t)len);
+  (void)uhid_write(&ev);
+}
+
+/**
+  * @brief  Handle one event from the kernel side of uhid.
+  * @retval None
+  */
+static void uhid_handle_event(void)
+{
+  static const uint8_t report_type[] = { 3U, 2U, 1U };   /* UHID_xxx_REPORT to HID report type */
+  struct uhid_event ev;
+  struct uhid_event reply;
+  uint8_t data[HID_CTRL_REPORT_SIZE];
+  ssize_t ret;
+  int32_t len;
+
+  ret = read(uhid_fd, &ev, sizeof(ev));
+  if (ret <= 0)
+  {
+    return;
+  }
+
+  memset(&reply, 0, sizeof(reply));
+  switch (ev.type)
+  {
+    case UHID_START:
+      uhid_started = 1U;
+      break;
+
+    case UHID_OUTPUT:
+      if ((ev.u.output.rtype == UHID_OUTPUT_REPORT) &&
+          (sim_host_out_report(&uhid_dev, ev.u.output.data, ev.u.output.size) < 0))
+      {
+        /* No interrupt OUT endpoint free: fall back to SET_REPORT(Output) */
+        (void)sim_host_control(0x21U, 0x09U, (uint16_t)(0x0200U | ev.u.output.data[0]), 0U,
+                               ev.u.output.data, ev.u.output.size);
+      }
+      break;
+
+    case UHID_GET_REPORT:
+      len = sim_host_control(0xA1U, 0x01U,
+                             (uint16_t)(((uint16_t)report_type[ev.u.get_report.rtype % 3U] << 8) |
+                                        ev.u.get_report.rnum),
+                             0U, data, sizeof(data));
+      reply.type = UHID_GET_REPORT_REPLY;
+      reply.u.get_report_reply.id = ev.u.get_report.id;
+      reply.u.get_report_reply.err = (len < 0) ? EIO : 0U;
+      reply.u.get_report_reply.size = (len < 0) ? 0U : (uint16_t)len;
+      if (len > 0)
+      {
+        memcpy(reply.u.get_report_reply.data, data, (size_t)len);
+      }
+      (void)uhid_write(&reply);
+      break;
+
+    case UHID_SET_REPORT:
+      len = sim_host_control(0x21U, 0x09U,
+                             (uint16_t)(((uint16_t)report_type[ev.u.set_report.rtype % 3U] << 8) |
+                                        ev.u.set_report.rnum),
+                             0U, ev.u.set_report.data, ev.u.set_report.size);
+      reply.type = UHID_SET_REPORT_REPLY;
+      reply.u.set_report_reply.id = ev.u.set_report.id;
+      reply.u.set_report_reply.err = (len < 0) ? EIO : 0U;
+      (void)uhid_write(&reply);
+      break;
+
+    default:
+      break;
+  }
+}
+
+/**
+  * @brief  Find the event device the kernel created for the uhid device.
+  * @retval open file descriptor, or -1 while it does not exist yet
+  */
+static int uhid_find_evdev(void)
+{
+  struct input_id id;
+  char path[280];
+  char name[128];
+  struct dirent *entry;
+  DIR *dir;
+  int clock = CLOCK_MONOTONIC;
+  int fd;
+
+  dir = opendir("/dev/input");
+  if (dir == NULL)
+  {
+    return -1;
+  }
+
+  while ((entry = readdir(dir)) != NULL)
+  {
+    if (strncmp(entry->d_name, "event", 5) != 0)
+    {
+      continue;
+    }
+    (void)snprintf(path, sizeof(path), "/dev/input/%s", entry->d_name);
+    fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+    {
+      continue;
+    }
+    memset(name, 0, sizeof(name));
+    /* hid-input splits the collections: skip the Consumer/System Control inputs */
+    if ((ioctl(fd, EVIOCGID, &id) == 0) && (id.vendor == uhid_dev.vid) && (id.product == uhid_dev.pid) &&
+        (ioctl(fd, EVIOCGNAME(sizeof(name) - 1U), name) >= 0) &&
+        (strncmp(name, UHID_NAME, strlen(UHID_NAME)) == 0) && (strstr(name, "Control") == NULL))
+    {
+      /* Event timestamps on the same clock as the injected edges */
+      (void)ioctl(fd, EVIOCSCLOCKID, &clock);
+      closedir(dir);
+      printf("uhid: keyboard events on /dev/input/%s\n", entry->d_name);
+      return fd;
+    }
+    close(fd);
+  }
+
+  closedir(dir);
+  return -1;
+}
+
+/**
+  * @brief  Read key events and time the benchmark edges.
+  * @retval None
+  */
+static void uhid_handle_evdev(void)
+{
+  struct input_event ev;
+  uint64_t stamp;
+  uint64_t latency;
+
+  while (read(uhid_evdev_fd, &ev, sizeof(ev)) == (ssize_t)sizeof(ev))
+  {
+    if ((ev.type != EV_KEY) || (ev.value == 2) || (uhid_bench.waiting == 0U) ||
+        ((uint8_t)ev.value != uhid_bench.level))
+    {
+      continue;
+    }
+
+    stamp = ((uint64_t)ev.input_event_sec * 1000000U) + (uint64_t)ev.input_event_usec;
+    latency = (stamp > uhid_bench.edge_us) ? (stamp - uhid_bench.edge_us) : 0U;
+    uhid_bench.waiting = 0U;
+    uhid_bench.count++;
+    uhid_bench.sum_us += latency;
+    uhid_bench.min_us = (latency < uhid_bench.min_us) ? latency : uhid_bench.min_us;
+    uhid_bench.max_us = (latency > uhid_bench.max_us) ? latency : uhid_bench.max_us;
+    uhid_bench.next_us = uhid_now_us() + UHID_BENCH_GAP_US;
+  }
+}
+
+/**
+  * @brief  Run key commands typed on stdin.
+  * @retval None
+  */
+static void uhid_handle_stdin(void)
+{
+  static char line[UHID_LINE_MAX];
+  static size_t used;
+  char cmd[32];
+  char key[32];
+  char *nl;
+  ssize_t ret;
+
+  ret = read(STDIN_FILENO, &line[used], sizeof(line) - 1U - used);
+  if (ret <= 0)
+  {
+    return;
+  }
+  used += (size_t)ret;
+  line[used] = '\0';
+
+  while ((nl = strchr(line, '\n')) != NULL)
+  {
+    *nl = '\0';
+    if (sscanf(line, "%31s %31s", cmd, key) == 2)
+    {
+      if (((strcmp(cmd, "press") != 0) && (strcmp(cmd, "release") != 0)) ||
+          (sim_firmware_key(key, (cmd[0] == 'p') ? 1U : 0U) != 0))
+      {
+        fprintf(stderr, "uhid: cannot run \"%s\"\n", line);
+      }
+    }
+    else if (strcmp(line, "quit") == 0)
+    {
+      uhid_stop = 1;
+    }
+    used -= (size_t)(nl + 1 - line);
+    memmove(line, nl + 1, used + 1U);
+  }
+
+  if (used == (sizeof(line) - 1U))
+  {
+    used = 0U;
+  }
+}
+
+/**
+  * @brief  Inject the next benchmark edge on PA0 when it is due.
+  * @retval None
+  */
+static void uhid_bench_poll(void)
+{
+  uint64_t now = uhid_now_us();
+
+  if (uhid_bench.waiting != 0U)
+  {
+    if ((now - uhid_bench.edge_us) > UHID_BENCH_TIMEOUT_US)
+    {
+      fprintf(stderr, "uhid: no evdev event for the PA0 edge\n");
+      uhid_stop = 1;
+    }
+    return;
+  }
+
+  if (uhid_bench.remaining == 0U)
+  {
+    if (uhid_bench.count != 0U)
+    {
+      uhid_stop = 1;
+    }
+    return;
+  }
+
+  if ((uhid_evdev_fd < 0) || (now < uhid_bench.next_us))
+  {
+    return;
+  }
+
+  uhid_bench.level ^= 1U;
+  uhid_bench.edge_us = now;
+  uhid_bench.waiting = 1U;
+  uhid_bench.remaining--;
+  (void)sim_firmware_key("user", uhid_bench.level);
+}
@@ -0,0 +1,77 @@
+/**
+  ******************************************************************************
+  * @file           : stm32f4xx.h
+  * @brief          : CMSIS stand-in for the host unit tests
+  ******************************************************************************
+  * Only what the sources under test use, the barrier intrinsics are full
+  * barriers of the host compiler and the interrupt masking ones do nothing.
+  * The DWT cycle counter is a plain variable the tests advance themselves.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM32F4xx_H
+#define __STM32F4xx_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define __IO                      volatile
+#define __I                       volatile const
+#define __weak                    __attribute__((weak))
+#define __PACKED                  __attribute__((packed))
+#define __STATIC_INLINE           static inline
+
+#define DWT                       (&test_dwt)
+#define CoreDebug                 (&test_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk    (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  __IO uint32_t CTRL;
+  __IO uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct
+{
+  __IO uint32_t DEMCR;
+} CoreDebug_Type;
+
+/* Exported variables --------------------------------------------------------*/
+extern DWT_Type test_dwt;
+extern CoreDebug_Type test_core_debug;
+extern uint32_t SystemCoreClock;
+
+/* Exported functions --------------------------------------------------------*/
+static inline void __DMB(void)
+{
+  __sync_synchronize();
+}
+
+/* The tests run on one thread: there is no interrupt to mask */
+static inline uint32_t __get_PRIMASK(void)
+{
+  return 0U;
+}
+
+static inline void __set_PRIMASK(uint32_t priMask)
+{
+  (void)priMask;
+}
+
+static inline void __disable_irq(void)
+{
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM32F4xx_H */
@@ -0,0 +1,56 @@
+/**
+  ******************************************************************************
+  * @file           : stm32f4xx_hal.h
+  * @brief          : HAL stand-in for the host unit tests
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STM32F4xx_HAL_H
+#define __STM32F4xx_HAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f4xx.h"
+#include <stddef.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  __IO uint32_t IDR;           /* input levels, written by the test */
+} GPIO_TypeDef;
+
+typedef struct
+{
+  void *Instance;
+} DMA_HandleTypeDef;
+
+typedef enum
+{
+  GPIO_PIN_RESET = 0,
+  GPIO_PIN_SET
+} GPIO_PinState;
+
+/* Exported constants --------------------------------------------------------*/
+#define GPIO_PIN_0                ((uint16_t)0x0001)
+
+#define GPIOA                     (&test_gpioa)
+
+/* Exported macro ------------------------------------------------------------*/
+#define UNUSED(X)                 (void)(X)
+
+/* Exported variables --------------------------------------------------------*/
+extern GPIO_TypeDef test_gpioa;
+
+/* Exported functions --------------------------------------------------------*/
+uint32_t HAL_GetTick(void);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STM32F4xx_HAL_H */
@@ -0,0 +1,74 @@
+/**
+  ******************************************************************************
+  * @file           : test.h
+  * @brief          : Host unit tests: stub low level driver and test suites
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TEST_H
+#define __TEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+#include "usbd_core.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define TEST_LL_STALL             (-2)    /* the device stalled the request */
+#define TEST_LL_NAK               (-1)    /* nothing armed on the endpoint */
+
+/* Exported types ------------------------------------------------------------*/
+/* One endpoint direction as the stub driver sees it */
+typedef struct
+{
+  uint8_t  open;
+  uint8_t  stalled;
+  uint8_t  armed;              /* a transfer waits for the host */
+  uint8_t  type;
+  uint16_t mps;
+  uint32_t len;
+  uint32_t transfers;          /* USBD_LL_Transmit/PrepareReceive calls */
+  uint8_t  *rx;                /* OUT: buffer given to USBD_LL_PrepareReceive */
+  uint8_t  buf[USB_MAX_EP0_SIZE];
+} test_ep_t;
+
+typedef struct
+{
+  uint32_t failures;
+} test_stats_t;
+
+/* Exported variables --------------------------------------------------------*/
+extern test_stats_t test_stats;
+extern test_ep_t test_ep_in[16];
+extern test_ep_t test_ep_out[16];
+
+/* Exported functions --------------------------------------------------------*/
+void test_ll_reset(void);
+int32_t test_ll_in(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *data, uint32_t max);
+int32_t test_ll_out(USBD_HandleTypeDef *pdev, uint8_t ep_addr, const uint8_t *data, uint32_t len);
+int32_t test_ll_control(USBD_HandleTypeDef *pdev, uint8_t bm_request, uint8_t request, uint16_t value,
+                        uint16_t index, uint8_t *data, uint16_t length);
+int32_t test_ll_control_out(USBD_HandleTypeDef *pdev, uint8_t bm_request, uint8_t request, uint16_t value,
+                            uint16_t index, const uint8_t *data, uint16_t length);
+int32_t test_ll_enumerate(USBD_HandleTypeDef *pdev, USBD_ClassTypeDef *pclass);
+
+void test_controls(void);
+void test_debounce(void);
+void test_feature(void);
+void test_hid_keyboard(void);
+void test_hid_queue(void);
+void test_idle(void);
+void test_keyboard(void);
+void test_led(void);
+void test_matrix(void);
+void test_poll_interval(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TEST_H */
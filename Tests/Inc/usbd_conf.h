@@ -0,0 +1,57 @@
+/**
+  ******************************************************************************
+  * @file           : usbd_conf.h
+  * @brief          : USB device library configuration for the host unit tests
+  ******************************************************************************
+  * Mirrors USB_DEVICE/Target/usbd_conf.h, keep both in step. The low level
+  * driver behind it is the stub in test_ll.c.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_CONF__H__
+#define __USBD_CONF__H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stm32f4xx.h"
+#include "stm32f4xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define USBD_MAX_NUM_INTERFACES     1U
+#define USBD_MAX_NUM_CONFIGURATION  1U
+#define USBD_MAX_STR_DESC_SIZ       512U
+#define USBD_DEBUG_LEVEL            0U
+#define USBD_LPM_ENABLED            0U
+#define USBD_SELF_POWERED           1U
+#define HID_FS_BINTERVAL            0x1U
+
+#define DEVICE_FS                   0
+#define DEVICE_HS                   1
+
+/* Exported macro ------------------------------------------------------------*/
+#define USBD_malloc                 (void *)USBD_static_malloc
+#define USBD_free                   USBD_static_free
+#define USBD_memset                 memset
+#define USBD_memcpy                 memcpy
+#define USBD_Delay                  USBD_LL_Delay
+
+#define USBD_UsrLog(...)
+#define USBD_ErrLog(...)
+#define USBD_DbgLog(...)
+
+/* Exported functions --------------------------------------------------------*/
+void *USBD_static_malloc(uint32_t size);
+void USBD_static_free(void *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_CONF__H__ */
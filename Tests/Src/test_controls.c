@@ -0,0 +1,258 @@
+/**
+  ******************************************************************************
+  * @file           : test_controls.c
+  * @brief          : Unit test of the consumer and system control reports
+  ******************************************************************************
+  * The input report lengths are taken from the report descriptor the host
+  * reads back, and each sender must produce exactly that length for its
+  * report ID. With keyboard reports queued behind a busy endpoint, the
+  * control reports must still go out next, ahead of them, and the keyboard
+  * reports after in their own order. Usages outside the descriptor ranges
+  * and any control report under boot protocol must be refused.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+#include "hid_controls.h"
+#include "hid_keyboard.h"
+#include "usbd_hid.h"
+#include "usbd_hid_report_desc.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_CONTROLS_DESC_MAX    512U
+#define TEST_CONTROLS_IDS         8U
+#define TEST_CONTROLS_KBD_QUEUED  6U
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+/* Input report length in bytes per report ID, ID byte included, from the descriptor */
+static uint32_t test_controls_len[TEST_CONTROLS_IDS];
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t test_controls_parse(void);
+static uint8_t test_controls_kbd(uint8_t seq);
+static int32_t test_controls_take(uint8_t *report);
+
+/**
+  * @brief  Check the report lengths, the priority order and the refusals.
+  * @retval None
+  */
+void test_controls(void)
+{
+  uint32_t failures = test_stats.failures;
+  uint8_t report[HID_EPIN_SIZE];
+  uint32_t seq;
+  int32_t n;
+
+  if (test_ll_enumerate(&hUsbDeviceFS, &USBD_HID) != 0)
+  {
+    printf("test: controls: enumeration failed\n");
+    test_stats.failures++;
+    return;
+  }
+
+  /* The descriptor is the reference for every input report length */
+  if ((test_controls_parse() != 0U) ||
+      (test_controls_len[HID_CONSUMER_REPORT_ID] != HID_CONSUMER_REPORT_SIZE) ||
+      (test_controls_len[HID_SYSTEM_REPORT_ID] != HID_SYSTEM_REPORT_SIZE) ||
+      (test_controls_len[HID_KBD_6KRO_REPORT_ID] != HID_KBD_6KRO_REPORT_SIZE) ||
+      (test_controls_len[HID_KBD_NKRO_REPORT_ID] != HID_KBD_NKRO_REPORT_SIZE))
+  {
+    printf("test: controls: descriptor input lengths: consumer %lu, system %lu, 5-key %lu, NKRO %lu\n",
+           (unsigned long)test_controls_len[HID_CONSUMER_REPORT_ID],
+           (unsigned long)test_controls_len[HID_SYSTEM_REPORT_ID],
+           (unsigned long)test_controls_len[HID_KBD_6KRO_REPORT_ID],
+           (unsigned long)test_controls_len[HID_KBD_NKRO_REPORT_ID]);
+    test_stats.failures++;
+  }
+
+  /* Keyboard reports wait behind a busy endpoint, then the controls are pressed */
+  for (seq = 0U; seq < TEST_CONTROLS_KBD_QUEUED; seq++)
+  {
+    (void)test_controls_kbd((uint8_t)seq);
+  }
+  if ((hid_consumer_press(HID_CONSUMER_VOLUME_UP) != (uint8_t)USBD_OK) ||
+      (hid_system_press(HID_SYSTEM_SLEEP) != (uint8_t)USBD_OK) ||
+      (hid_system_press(HID_SYSTEM_WAKE_UP) != (uint8_t)USBD_OK))
+  {
+    printf("test: controls: control report refused\n");
+    test_stats.failures++;
+  }
+
+  /* The report on the wire completes first, the controls overtake the rest */
+  n = test_controls_take(report);
+  if ((n != (int32_t)HID_KBD_6KRO_REPORT_SIZE) || (report[3] != HID_USAGE_FIRST_KEY))
+  {
+    printf("test: controls: report in flight not sent first\n");
+    test_stats.failures++;
+  }
+  n = test_controls_take(report);
+  if ((n != (int32_t)test_controls_len[HID_CONSUMER_REPORT_ID]) || (report[0] != HID_CONSUMER_REPORT_ID) ||
+      (report[1] != LOBYTE(HID_CONSUMER_VOLUME_UP)) || (report[2] != HIBYTE(HID_CONSUMER_VOLUME_UP)))
+  {
+    printf("test: controls: consumer report: %ld bytes, ID %u\n", (long)n, report[0]);
+    test_stats.failures++;
+  }
+  n = test_controls_take(report);
+  if ((n != (int32_t)test_controls_len[HID_SYSTEM_REPORT_ID]) || (report[0] != HID_SYSTEM_REPORT_ID) ||
+      (report[1] != 0x02U))
+  {
+    printf("test: controls: system sleep: %ld bytes, bits 0x%02X\n", (long)n, report[1]);
+    test_stats.failures++;
+  }
+  n = test_controls_take(report);
+  if ((n != (int32_t)HID_SYSTEM_REPORT_SIZE) || (report[1] != 0x06U))
+  {
+    printf("test: controls: system sleep and wake up: bits 0x%02X\n", report[1]);
+    test_stats.failures++;
+  }
+  for (seq = 1U; seq < TEST_CONTROLS_KBD_QUEUED; seq++)
+  {
+    n = test_controls_take(report);
+    if ((n != (int32_t)HID_KBD_6KRO_REPORT_SIZE) || (report[0] != HID_KBD_6KRO_REPORT_ID) ||
+        (report[3] != (uint8_t)(HID_USAGE_FIRST_KEY + seq)))
+    {
+      printf("test: controls: keyboard report %lu out of order after the controls\n", (unsigned long)seq);
+      test_stats.failures++;
+      break;
+    }
+  }
+
+  /* Releases keep the other bits, and the queue is drained */
+  if ((hid_system_release(HID_SYSTEM_SLEEP) != (uint8_t)USBD_OK) || (test_controls_take(report) != 2) ||
+      (report[1] != 0x04U) || (hid_consumer_release() != (uint8_t)USBD_OK) || (test_controls_take(report) != 3) ||
+      (report[1] != 0U) || (report[2] != 0U) || (test_controls_take(report) != TEST_LL_NAK))
+  {
+    printf("test: controls: release reports\n");
+    test_stats.failures++;
+  }
+  (void)hid_system_release(HID_SYSTEM_WAKE_UP);
+  (void)test_controls_take(report);
+
+  /* Usages outside the descriptor ranges */
+  if ((hid_consumer_press(0U) != (uint8_t)USBD_FAIL) ||
+      (hid_consumer_press(HID_CONSUMER_USAGE_MAX + 1U) != (uint8_t)USBD_FAIL) ||
+      (hid_system_press(HID_SYSTEM_POWER_DOWN - 1U) != (uint8_t)USBD_FAIL) ||
+      (hid_system_press(HID_SYSTEM_WAKE_UP + 1U) != (uint8_t)USBD_FAIL) ||
+      (hid_system_release(HID_SYSTEM_WAKE_UP + 1U) != (uint8_t)USBD_FAIL) ||
+      (test_controls_take(report) != TEST_LL_NAK))
+  {
+    printf("test: controls: usage out of range accepted\n");
+    test_stats.failures++;
+  }
+
+  /* Boot protocol has no control reports */
+  (void)test_ll_control(&hUsbDeviceFS, 0x21U, USBD_HID_REQ_SET_PROTOCOL, HID_BOOT_PROTOCOL, 0U, NULL, 0U);
+  if ((hid_consumer_press(HID_CONSUMER_MUTE) != (uint8_t)USBD_FAIL) ||
+      (hid_system_press(HID_SYSTEM_POWER_DOWN) != (uint8_t)USBD_FAIL) ||
+      (test_controls_take(report) != TEST_LL_NAK))
+  {
+    printf("test: controls: control report sent under boot protocol\n");
+    test_stats.failures++;
+  }
+  (void)test_ll_control(&hUsbDeviceFS, 0x21U, USBD_HID_REQ_SET_PROTOCOL, HID_REPORT_PROTOCOL, 0U, NULL, 0U);
+
+  printf("test: controls: lengths match the descriptor, controls overtake %lu queued keyboard reports%s\n",
+         (unsigned long)(TEST_CONTROLS_KBD_QUEUED - 1U), (test_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Read the report descriptor as the host and add up the input items of each report ID.
+  * @retval 0 if the descriptor parsed
+  */
+static uint32_t test_controls_parse(void)
+{
+  uint8_t desc[TEST_CONTROLS_DESC_MAX];
+  uint32_t bits[TEST_CONTROLS_IDS] = {0};
+  uint32_t report_size = 0U;
+  uint32_t report_count = 0U;
+  uint32_t report_id = 0U;
+  uint32_t value;
+  uint32_t size;
+  uint32_t id;
+  int32_t len;
+  int32_t pos;
+
+  len = test_ll_control(&hUsbDeviceFS, 0x81U, USB_REQ_GET_DESCRIPTOR, (uint16_t)(HID_REPORT_DESC << 8), 0U, desc,
+                        sizeof(desc));
+  if (len != HID_MOUSE_REPORT_DESC_SIZE)
+  {
+    return 1U;
+  }
+
+  /* Short items only: bSize in bits 0-1 (3 means 4 bytes), bType and bTag above */
+  for (pos = 0; pos < len; pos += 1 + (int32_t)size)
+  {
+    size = desc[pos] & 0x03U;
+    size = (size == 3U) ? 4U : size;
+    if ((pos + 1 + (int32_t)size) > len)
+    {
+      return 1U;
+    }
+
+    value = 0U;
+    for (id = 0U; id < size; id++)
+    {
+      value |= (uint32_t)desc[pos + 1 + (int32_t)id] << (8U * id);
+    }
+
+    switch (desc[pos] & 0xFCU)
+    {
+      case 0x74U:   /* Report Size */
+        report_size = value;
+        break;
+
+      case 0x94U:   /* Report Count */
+        report_count = value;
+        break;
+
+      case 0x84U:   /* Report ID */
+        report_id = value;
+        break;
+
+      case 0x80U:   /* Input */
+        if (report_id >= TEST_CONTROLS_IDS)
+        {
+          return 1U;
+        }
+        bits[report_id] += report_size * report_count;
+        break;
+
+      default:
+        break;
+    }
+  }
+
+  for (id = 1U; id < TEST_CONTROLS_IDS; id++)
+  {
+    /* A report that does not fill whole bytes reads as length 0 */
+    test_controls_len[id] = (((bits[id] % 8U) != 0U) || (bits[id] == 0U)) ? 0U : (1U + (bits[id] / 8U));
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  Queue a 5-key keyboard report at normal priority.
+  * @param  seq: sequence number, sent as the first keycode
+  * @retval USBD_HID_SendReport status
+  */
+static uint8_t test_controls_kbd(uint8_t seq)
+{
+  uint8_t report[HID_KBD_6KRO_REPORT_SIZE] = { HID_KBD_6KRO_REPORT_ID };
+
+  report[3] = (uint8_t)(HID_USAGE_FIRST_KEY + seq);
+  return USBD_HID_SendReport(&hUsbDeviceFS, report, sizeof(report));
+}
+
+/**
+  * @brief  Poll the IN endpoint once.
+  * @param  report: receives the report
+  * @retval report length or TEST_LL_NAK
+  */
+static int32_t test_controls_take(uint8_t *report)
+{
+  return test_ll_in(&hUsbDeviceFS, HID_EPIN_ADDR, report, HID_EPIN_SIZE);
+}
@@ -0,0 +1,441 @@
+/**
+  ******************************************************************************
+  * @file           : test_debounce.c
+  * @brief          : Unit test, trace corpus and benchmark of the debouncer
+  ******************************************************************************
+  * debounce.c has no hardware dependency and is tested on its own, with the
+  * threshold the keyboard uses (KEYBOARD_DEBOUNCE_MS in matrix scans).
+  *
+  * - Every algorithm is run against a plain per-key model of it on random
+  *   raw bitmaps: the bit-sliced counters must give the same debounced
+  *   state and the same changes, scan after scan.
+  * - A corpus of bouncy traces is played on every key at once: clean taps
+  *   whose edges bounce for up to TEST_DB_BOUNCE_MAX scans, and one-scan
+  *   glitches in the stable periods. Each algorithm must report every tap
+  *   exactly once; its latency and its false triggers on the glitches are
+  *   printed. Eager must take a press on the first scan and only trip on
+  *   the glitches of a released key, defer and integrator must ignore the
+  *   glitches.
+  * - The benchmark times one debounce_update() of the whole bitmap. Its
+  *   figures are for the host CPU and only printed.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+#include "debounce.h"
+#include "keyboard.h"
+#include "matrix_scan.h"
+#include <time.h>
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_DB_THRESHOLD         ((KEYBOARD_DEBOUNCE_MS * MATRIX_SCAN_HZ) / 1000U)
+#define TEST_DB_KEYS              (DEBOUNCE_WORDS * 32U)
+#define TEST_DB_MODEL_SCANS       200000U
+#define TEST_DB_MODES             3U
+
+/* Trace corpus: taps of TEST_DB_HOLD scans down then up, per key */
+#define TEST_DB_TAPS              50U
+#define TEST_DB_HOLD              (6U * TEST_DB_THRESHOLD)
+#define TEST_DB_BOUNCE_MAX        (TEST_DB_THRESHOLD / 2U)
+/* Glitches start once every algorithm has settled on the edge, and end early
+   enough for an eager lockout to run out before the next edge */
+#define TEST_DB_GLITCH_FIRST      ((2U * TEST_DB_BOUNCE_MAX) + TEST_DB_THRESHOLD + 1U)
+#define TEST_DB_GLITCH_SPAN       (TEST_DB_HOLD - (2U * TEST_DB_THRESHOLD) - 1U - TEST_DB_GLITCH_FIRST)
+#define TEST_DB_TRACE_SCANS       ((TEST_DB_TAPS * 2U * TEST_DB_HOLD) + TEST_DB_HOLD)
+
+#define TEST_DB_BENCH_SCANS       1000000U
+
+/* Private typedef -----------------------------------------------------------*/
+/* Per-key model of the three algorithms */
+typedef struct
+{
+  uint8_t state;
+  uint8_t locked;
+  uint8_t count;
+} test_db_key_t;
+
+/* Corpus results of one algorithm */
+typedef struct
+{
+  uint32_t edges;          /* debounced changes that match a clean edge */
+  uint32_t missed;         /* clean edges never reported */
+  uint32_t false_changes;  /* debounced changes with no clean edge */
+  uint32_t latency_sum;    /* scans from clean edge to debounced change */
+  uint32_t latency_max;
+  uint32_t press_latency_max;
+  uint32_t glitches[2];    /* one-scan glitches played, per clean level */
+} test_db_result_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const char *const test_db_names[TEST_DB_MODES] = { "eager", "defer", "integrator" };
+
+static uint32_t test_db_seed = 1U;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t test_db_random(void);
+static uint8_t test_db_model(test_db_key_t *key, debounce_mode_t mode, uint8_t raw);
+static uint32_t test_db_check_model(debounce_mode_t mode);
+static void test_db_corpus(debounce_mode_t mode, test_db_result_t *result);
+static void test_db_bench(debounce_mode_t mode, uint32_t moving);
+
+/**
+  * @brief  Check the debouncer against its model, play the corpus and time it.
+  * @retval None
+  */
+void test_debounce(void)
+{
+  uint32_t failures = test_stats.failures;
+  test_db_result_t result;
+  uint32_t glitches;
+  uint32_t mode;
+
+  for (mode = 0U; mode < TEST_DB_MODES; mode++)
+  {
+    if (test_db_check_model((debounce_mode_t)mode) != 0U)
+    {
+      test_stats.failures++;
+    }
+  }
+
+  for (mode = 0U; mode < TEST_DB_MODES; mode++)
+  {
+    test_db_corpus((debounce_mode_t)mode, &result);
+    glitches = result.glitches[0] + result.glitches[1];
+
+    /* An eager false press on a released key is released again once stable */
+    if ((result.missed != 0U) || (result.edges != (TEST_DB_KEYS * TEST_DB_TAPS * 2U)) ||
+        (result.latency_max > ((2U * TEST_DB_BOUNCE_MAX) + TEST_DB_THRESHOLD)) ||
+        ((mode == DEBOUNCE_EAGER) &&
+         ((result.press_latency_max != 0U) || (result.false_changes != (2U * result.glitches[0])))) ||
+        ((mode != DEBOUNCE_EAGER) && (result.false_changes != 0U)))
+    {
+      printf("test: debounce: %s: %lu edges reported, %lu missed, %lu false, latency max %lu scans\n",
+             test_db_names[mode], (unsigned long)result.edges, (unsigned long)result.missed,
+             (unsigned long)result.false_changes, (unsigned long)result.latency_max);
+      test_stats.failures++;
+    }
+
+    printf("test: debounce: corpus: %-10s latency mean %3lu, max %3lu scans, press max %3lu scans, "
+           "%4lu false triggers on %lu glitches\n",
+           test_db_names[mode], (unsigned long)(result.latency_sum / ((result.edges != 0U) ? result.edges : 1U)),
+           (unsigned long)result.latency_max, (unsigned long)result.press_latency_max,
+           (unsigned long)result.false_changes, (unsigned long)glitches);
+  }
+
+  printf("test: debounce: 3 algorithms match their model over %lu scans of %lu keys, "
+         "%lu taps per key with bounce, threshold %lu scans%s\n",
+         (unsigned long)TEST_DB_MODEL_SCANS, (unsigned long)TEST_DB_KEYS, (unsigned long)TEST_DB_TAPS,
+         (unsigned long)TEST_DB_THRESHOLD, (test_stats.failures != failures) ? " (FAILED)" : "");
+
+  for (mode = 0U; mode < TEST_DB_MODES; mode++)
+  {
+    test_db_bench((debounce_mode_t)mode, 0U);
+    test_db_bench((debounce_mode_t)mode, TEST_DB_KEYS);
+  }
+}
+
+/**
+  * @brief  Run one algorithm and its model on the same random raw bitmaps.
+  * @param  mode: algorithm
+  * @retval 0 if they agree on every scan
+  */
+static uint32_t test_db_check_model(debounce_mode_t mode)
+{
+  static test_db_key_t keys[TEST_DB_KEYS];
+  uint32_t raw[DEBOUNCE_WORDS] = {0};
+  uint32_t changed[DEBOUNCE_WORDS];
+  debounce_t db;
+  uint32_t scan;
+  uint32_t key;
+  uint32_t bit;
+  uint32_t flip;
+  uint8_t any;
+
+  /* Start with some keys down */
+  for (key = 0U; key < TEST_DB_KEYS; key++)
+  {
+    bit = test_db_random() & 1U;
+    raw[key >> 5] |= bit << (key & 0x1FU);
+    keys[key].state = (uint8_t)bit;
+    keys[key].locked = 0U;
+    keys[key].count = (mode == DEBOUNCE_INTEGRATOR) ? (uint8_t)(bit * TEST_DB_THRESHOLD) : 0U;
+  }
+  debounce_init(&db, mode, (uint8_t)TEST_DB_THRESHOLD, raw);
+
+  for (scan = 0U; scan < TEST_DB_MODEL_SCANS; scan++)
+  {
+    /* Quiet stretches and noisy ones, so that every counter reaches the threshold */
+    flip = ((scan / 1000U) % 2U == 0U) ? 64U : 4U;
+    for (key = 0U; key < TEST_DB_KEYS; key++)
+    {
+      if ((test_db_random() % 256U) < flip)
+      {
+        raw[key >> 5] ^= 1UL << (key & 0x1FU);
+      }
+    }
+
+    any = debounce_update(&db, raw, changed);
+
+    for (key = 0U; key < TEST_DB_KEYS; key++)
+    {
+      bit = test_db_model(&keys[key], mode, (uint8_t)((raw[key >> 5] >> (key & 0x1FU)) & 1U));
+      if ((((changed[key >> 5] >> (key & 0x1FU)) & 1U) != bit) ||
+          (((db.state[key >> 5] >> (key & 0x1FU)) & 1U) != keys[key].state) ||
+          ((bit != 0U) && (any == 0U)))
+      {
+        printf("test: debounce: %s: key %lu differs from its model at scan %lu\n", test_db_names[mode],
+               (unsigned long)key, (unsigned long)scan);
+        return 1U;
+      }
+    }
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  One scan of the per-key model.
+  * @param  key: model state of the key
+  * @param  mode: algorithm
+  * @param  raw: sampled level
+  * @retval 1 if the debounced level changed
+  */
+static uint8_t test_db_model(test_db_key_t *key, debounce_mode_t mode, uint8_t raw)
+{
+  uint8_t state = key->state;
+
+  switch (mode)
+  {
+    case DEBOUNCE_EAGER:
+      /* A press is taken at once and locks the key out, a release is deferred */
+      if (key->locked != 0U)
+      {
+        key->count++;
+        if (key->count == TEST_DB_THRESHOLD)
+        {
+          key->count = 0U;
+          key->locked = 0U;
+        }
+      }
+      if (key->locked != 0U)
+      {
+        break;
+      }
+      if ((raw != 0U) && (key->state == 0U))
+      {
+        key->locked = 1U;
+        key->state = 1U;
+      }
+      else
+      {
+        key->count = (raw != key->state) ? (uint8_t)(key->count + 1U) : 0U;
+        if (key->count == TEST_DB_THRESHOLD)
+        {
+          key->count = 0U;
+          key->state = raw;
+        }
+      }
+      break;
+
+    case DEBOUNCE_DEFER:
+      key->count = (raw != key->state) ? (uint8_t)(key->count + 1U) : 0U;
+      if (key->count == TEST_DB_THRESHOLD)
+      {
+        key->count = 0U;
+        key->state = raw;
+      }
+      break;
+
+    case DEBOUNCE_INTEGRATOR:
+    default:
+      if ((raw != 0U) && (key->count < TEST_DB_THRESHOLD))
+      {
+        key->count++;
+      }
+      else if ((raw == 0U) && (key->count > 0U))
+      {
+        key->count--;
+      }
+      if (key->count == TEST_DB_THRESHOLD)
+      {
+        key->state = 1U;
+      }
+      else if (key->count == 0U)
+      {
+        key->state = 0U;
+      }
+      break;
+  }
+
+  return (key->state != state) ? 1U : 0U;
+}
+
+/**
+  * @brief  Play the bouncy trace corpus through one algorithm.
+  * @note   Every key taps TEST_DB_TAPS times with its own bounce and glitch
+  *         pattern. A clean edge is matched to the first debounced change of
+  *         that key in the same direction; any other change is false.
+  * @param  mode: algorithm
+  * @param  result: receives the counts
+  * @retval None
+  */
+static void test_db_corpus(debounce_mode_t mode, test_db_result_t *result)
+{
+  static uint16_t bounce[TEST_DB_KEYS];      /* bounce length of the current edge */
+  static uint16_t glitch_at[TEST_DB_KEYS];   /* phase of the glitch of the current half tap, 0 for none */
+  static uint32_t edge_at[TEST_DB_KEYS];     /* scan of the pending clean edge */
+  static uint8_t  pending[TEST_DB_KEYS];
+  uint32_t raw[DEBOUNCE_WORDS] = {0};
+  uint32_t changed[DEBOUNCE_WORDS];
+  uint32_t latency;
+  uint32_t phase;
+  uint32_t scan;
+  uint32_t key;
+  uint8_t clean;
+  uint8_t level;
+  debounce_t db;
+
+  memset(result, 0, sizeof(*result));
+  memset(pending, 0, sizeof(pending));
+  test_db_seed = 12345U;
+  debounce_init(&db, mode, (uint8_t)TEST_DB_THRESHOLD, raw);
+
+  for (scan = 0U; scan < TEST_DB_TRACE_SCANS; scan++)
+  {
+    phase = scan % TEST_DB_HOLD;
+    clean = (scan < (TEST_DB_TAPS * 2U * TEST_DB_HOLD)) ? (uint8_t)((scan / TEST_DB_HOLD) % 2U == 0U) : 0U;
+
+    for (key = 0U; key < TEST_DB_KEYS; key++)
+    {
+      if (phase == 0U)
+      {
+        if ((scan / TEST_DB_HOLD) <= (TEST_DB_TAPS * 2U - 1U))
+        {
+          bounce[key] = (uint16_t)(test_db_random() % (TEST_DB_BOUNCE_MAX + 1U));
+          edge_at[key] = scan;
+          if (pending[key] != 0U)
+          {
+            result->missed++;
+          }
+          pending[key] = 1U;
+        }
+        else
+        {
+          bounce[key] = 0U;
+        }
+
+        /* One key in four glitches once in the stable period */
+        glitch_at[key] = ((test_db_random() % 4U) == 0U) ?
+                         (uint16_t)(TEST_DB_GLITCH_FIRST + (test_db_random() % TEST_DB_GLITCH_SPAN)) : 0U;
+        result->glitches[clean] += (glitch_at[key] != 0U) ? 1U : 0U;
+      }
+
+      /* The level toggles every scan while it bounces, starting on the new level */
+      level = clean;
+      if ((phase < bounce[key]) && ((phase % 2U) != 0U))
+      {
+        level ^= 1U;
+      }
+      if ((glitch_at[key] != 0U) && (phase == glitch_at[key]))
+      {
+        level ^= 1U;
+      }
+
+      raw[key >> 5] = (raw[key >> 5] & ~(1UL << (key & 0x1FU))) | ((uint32_t)level << (key & 0x1FU));
+    }
+
+    if (debounce_update(&db, raw, changed) == 0U)
+    {
+      continue;
+    }
+
+    for (key = 0U; key < TEST_DB_KEYS; key++)
+    {
+      if (((changed[key >> 5] >> (key & 0x1FU)) & 1U) == 0U)
+      {
+        continue;
+      }
+
+      level = (uint8_t)((db.state[key >> 5] >> (key & 0x1FU)) & 1U);
+      if ((pending[key] != 0U) && (level == clean))
+      {
+        latency = scan - edge_at[key];
+        result->edges++;
+        result->latency_sum += latency;
+        result->latency_max = (latency > result->latency_max) ? latency : result->latency_max;
+        if ((clean != 0U) && (latency > result->press_latency_max))
+        {
+          result->press_latency_max = latency;
+        }
+        pending[key] = 0U;
+      }
+      else
+      {
+        result->false_changes++;
+      }
+    }
+  }
+
+  for (key = 0U; key < TEST_DB_KEYS; key++)
+  {
+    result->missed += pending[key];
+  }
+}
+
+/**
+  * @brief  Time debounce_update() over the whole bitmap.
+  * @param  mode: algorithm
+  * @param  moving: number of keys whose raw level toggles every scan
+  * @retval None
+  */
+static void test_db_bench(debounce_mode_t mode, uint32_t moving)
+{
+  uint32_t raw[DEBOUNCE_WORDS] = {0};
+  uint32_t changed[DEBOUNCE_WORDS];
+  uint32_t toggle[DEBOUNCE_WORDS] = {0};
+  volatile uint32_t sink = 0U;
+  struct timespec start;
+  struct timespec end;
+  debounce_t db;
+  uint64_t ns;
+  uint32_t scan;
+  uint32_t key;
+  uint32_t word;
+
+  for (key = 0U; key < moving; key++)
+  {
+    toggle[key >> 5] |= 1UL << (key & 0x1FU);
+  }
+  debounce_init(&db, mode, (uint8_t)TEST_DB_THRESHOLD, raw);
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &start);
+  for (scan = 0U; scan < TEST_DB_BENCH_SCANS; scan++)
+  {
+    /* Keys move in bursts, so that counters run up as well as restart */
+    if ((scan % (TEST_DB_THRESHOLD * 2U)) < 3U)
+    {
+      for (word = 0U; word < DEBOUNCE_WORDS; word++)
+      {
+        raw[word] ^= toggle[word];
+      }
+    }
+    sink += debounce_update(&db, raw, changed);
+  }
+  (void)clock_gettime(CLOCK_MONOTONIC, &end);
+
+  ns = ((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL) + (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+  printf("test: debounce: bench: %-10s %2lu of %lu keys moving: %lu ns per scan\n", test_db_names[mode],
+         (unsigned long)moving, (unsigned long)TEST_DB_KEYS, (unsigned long)(ns / TEST_DB_BENCH_SCANS));
+  (void)sink;
+}
+
+/**
+  * @brief  Linear congruential generator, repeatable across runs.
+  * @retval next pseudo-random value
+  */
+static uint32_t test_db_random(void)
+{
+  test_db_seed = (test_db_seed * 1664525U) + 1013904223U;
+  return test_db_seed >> 8;
+}
@@ -0,0 +1,258 @@
+/**
+  ******************************************************************************
+  * @file           : test_feature.c
+  * @brief          : Unit test of GET_REPORT / SET_REPORT on the control pipe
+  ******************************************************************************
+  * The host reads and writes the vendor feature reports 4 and 5 through the
+  * EP0 state machine of usbd_ioreq.c, with usbd_hid_if.c and hid_config.c
+  * behind the class as on the target. A write must take effect and be read
+  * back with its status, an out of range value must be refused and leave
+  * the parameter as it was, and report 5 must restore the defaults. An
+  * input report is read back as last queued. Reading an output report,
+  * unknown report IDs and unknown requests must stall.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+#include "config_store.h"
+#include "hid_config.h"
+#include "keyboard.h"
+#include "usbd_hid_if.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_FEATURE_GET          0xA1U   /* class, interface, device to host */
+#define TEST_FEATURE_SET          0x21U   /* class, interface, host to device */
+#define TEST_FEATURE_VALUE(type, id)  ((uint16_t)(((uint16_t)(type) << 8) | (id)))
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t test_feature_get(uint8_t type, uint8_t id, uint8_t *report, uint16_t len);
+static int32_t test_feature_set(uint8_t type, uint8_t id, const uint8_t *report, uint16_t len);
+static int32_t test_feature_param(uint8_t param, uint8_t op, uint16_t value, uint8_t *report);
+
+/**
+  * @brief  Read and write the configuration table as the host.
+  * @retval None
+  */
+void test_feature(void)
+{
+  uint32_t failures = test_stats.failures;
+  uint8_t report[HID_CONFIG_REPORT_SIZE];
+  uint8_t input[HID_EPIN_SIZE] = { 0x01U, 0x02U, 0x00U, 0x40U };
+  uint8_t buf[HID_EPIN_SIZE];
+  uint32_t params = 0U;
+  uint16_t value;
+  uint32_t param;
+  int32_t n;
+
+  if ((test_ll_enumerate(&hUsbDeviceFS, &USBD_HID) != 0) ||
+      (USBD_HID_RegisterInterface(&hUsbDeviceFS, &USBD_HID_fops_FS) != (uint8_t)USBD_OK))
+  {
+    printf("test: feature: enumeration failed\n");
+    test_stats.failures++;
+    return;
+  }
+  hid_config_init();
+
+  /* Report 5 describes the table: as many parameters as report 4 can select */
+  for (param = 1U; param < 0x80U; param++)
+  {
+    params += ((test_feature_param(param, HID_CONFIG_OP_SELECT, 0U, report) == (int32_t)HID_CONFIG_REPORT_SIZE) &&
+               (report[2] == (uint8_t)HID_CONFIG_OK)) ? 1U : 0U;
+  }
+  n = test_feature_get(HID_REPORT_TYPE_FEATURE, HID_CONFIG_CTRL_REPORT_ID, report, sizeof(report));
+  if ((n != (int32_t)HID_CONFIG_REPORT_SIZE) || (report[0] != HID_CONFIG_CTRL_REPORT_ID) ||
+      (report[1] != HID_CONFIG_VERSION) || (report[2] != params) || (params == 0U))
+  {
+    printf("test: feature: report 5: %ld bytes, version %u, %u parameters, %lu selectable\n", (long)n, report[1],
+           report[2], (unsigned long)params);
+    test_stats.failures++;
+  }
+
+  /* A write is applied and read back with its range and type */
+  n = test_feature_param(HID_CONFIG_DEBOUNCE_MS, HID_CONFIG_OP_WRITE, 2U, report);
+  if ((n != (int32_t)HID_CONFIG_REPORT_SIZE) || (report[1] != HID_CONFIG_DEBOUNCE_MS) ||
+      (report[2] != (uint8_t)HID_CONFIG_OK) || (report[3] != 2U) || (report[4] != 0U) ||
+      (report[7] != HID_CONFIG_TYPE_U8) || (hid_config_get(HID_CONFIG_DEBOUNCE_MS, &value) != HID_CONFIG_OK) ||
+      (value != 2U))
+  {
+    printf("test: feature: debounce write: status %u, value %u\n", report[2], report[3]);
+    test_stats.failures++;
+  }
+
+  n = test_feature_param(HID_CONFIG_POLL_INTERVAL, HID_CONFIG_OP_WRITE, 4U, report);
+  if ((n != (int32_t)HID_CONFIG_REPORT_SIZE) || (report[2] != (uint8_t)HID_CONFIG_OK) || (report[3] != 4U) ||
+      (USBD_HID_GetPollingInterval(&hUsbDeviceFS) != 4U))
+  {
+    printf("test: feature: polling interval write: status %u, interval %lu\n", report[2],
+           (unsigned long)USBD_HID_GetPollingInterval(&hUsbDeviceFS));
+    test_stats.failures++;
+  }
+
+  /* Out of range values are refused and leave the parameter in place */
+  n = test_feature_param(HID_CONFIG_POLL_INTERVAL, HID_CONFIG_OP_WRITE, 3U, report);
+  if ((n != (int32_t)HID_CONFIG_REPORT_SIZE) || (report[2] != (uint8_t)HID_CONFIG_ERR_RANGE) || (report[3] != 4U) ||
+      (USBD_HID_GetPollingInterval(&hUsbDeviceFS) != 4U))
+  {
+    printf("test: feature: polling interval 3 ms: status %u, value %u\n", report[2], report[3]);
+    test_stats.failures++;
+  }
+  n = test_feature_param(HID_CONFIG_DEBOUNCE_MODE, HID_CONFIG_OP_WRITE, 0x100U, report);
+  if ((n != (int32_t)HID_CONFIG_REPORT_SIZE) || (report[2] != (uint8_t)HID_CONFIG_ERR_RANGE) ||
+      (report[3] != (uint8_t)KEYBOARD_DEBOUNCE_MODE) || (report[7] != HID_CONFIG_TYPE_ENUM))
+  {
+    printf("test: feature: debounce mode 0x100: status %u, value %u\n", report[2], report[3]);
+    test_stats.failures++;
+  }
+
+  /* Unknown parameters and operations, and a report of the wrong ID in the data stage */
+  n = test_feature_param(0x7FU, HID_CONFIG_OP_SELECT, 0U, report);
+  if ((n != (int32_t)HID_CONFIG_REPORT_SIZE) || (report[1] != 0x7FU) || (report[2] != (uint8_t)HID_CONFIG_ERR_ID))
+  {
+    printf("test: feature: unknown parameter: status %u\n", report[2]);
+    test_stats.failures++;
+  }
+  n = test_feature_param(HID_CONFIG_DEBOUNCE_MS, 0x55U, 0U, report);
+  if ((n != (int32_t)HID_CONFIG_REPORT_SIZE) || (report[2] != (uint8_t)HID_CONFIG_ERR_REPORT))
+  {
+    printf("test: feature: unknown operation: status %u\n", report[2]);
+    test_stats.failures++;
+  }
+  memset(report, 0, sizeof(report));
+  report[0] = HID_CONFIG_CTRL_REPORT_ID;
+  if ((test_feature_set(HID_REPORT_TYPE_FEATURE, HID_CONFIG_PARAM_REPORT_ID, report, sizeof(report)) !=
+       (int32_t)HID_CONFIG_REPORT_SIZE) ||
+      (test_feature_get(HID_REPORT_TYPE_FEATURE, HID_CONFIG_CTRL_REPORT_ID, report, sizeof(report)) !=
+       (int32_t)HID_CONFIG_REPORT_SIZE) || (report[3] != (uint8_t)HID_CONFIG_ERR_REPORT))
+  {
+    printf("test: feature: mismatched report ID: status %u\n", report[3]);
+    test_stats.failures++;
+  }
+
+  /* Report 5 restores the defaults */
+  memset(report, 0, sizeof(report));
+  report[0] = HID_CONFIG_CTRL_REPORT_ID;
+  report[1] = HID_CONFIG_CMD_DEFAULTS;
+  n = test_feature_set(HID_REPORT_TYPE_FEATURE, HID_CONFIG_CTRL_REPORT_ID, report, sizeof(report));
+  if ((n != (int32_t)HID_CONFIG_REPORT_SIZE) || (USBD_HID_GetPollingInterval(&hUsbDeviceFS) != HID_FS_BINTERVAL) ||
+      (hid_config_get(HID_CONFIG_DEBOUNCE_MS, &value) != HID_CONFIG_OK) || (value != KEYBOARD_DEBOUNCE_MS))
+  {
+    printf("test: feature: defaults: interval %lu, debounce %u ms\n",
+           (unsigned long)USBD_HID_GetPollingInterval(&hUsbDeviceFS), value);
+    test_stats.failures++;
+  }
+
+  /* A short wLength truncates the data stage */
+  if (test_feature_get(HID_REPORT_TYPE_FEATURE, HID_CONFIG_CTRL_REPORT_ID, report, 4U) != 4)
+  {
+    printf("test: feature: wLength 4 not honoured\n");
+    test_stats.failures++;
+  }
+
+  /* An input report reads back as last queued */
+  (void)USBD_HID_SendReport(&hUsbDeviceFS, input, 4U);
+  n = test_feature_get(HID_REPORT_TYPE_INPUT, 0x01U, buf, sizeof(buf));
+  if ((n != 4) || (memcmp(buf, input, 4U) != 0))
+  {
+    printf("test: feature: input report 1: %ld bytes\n", (long)n);
+    test_stats.failures++;
+  }
+
+  /* Everything else stalls */
+  if ((test_feature_get(HID_REPORT_TYPE_INPUT, 0x03U, buf, sizeof(buf)) != TEST_LL_STALL) ||
+      (test_feature_get(HID_REPORT_TYPE_FEATURE, 0x06U, buf, sizeof(buf)) != TEST_LL_STALL) ||
+      (test_feature_get(HID_REPORT_TYPE_OUTPUT, 0x01U, buf, sizeof(buf)) != TEST_LL_STALL) ||
+      (test_feature_set(HID_REPORT_TYPE_FEATURE, HID_CONFIG_CTRL_REPORT_ID, input, 0U) != TEST_LL_STALL) ||
+      (test_feature_set(HID_REPORT_TYPE_FEATURE, HID_CONFIG_CTRL_REPORT_ID, input, HID_CTRL_REPORT_SIZE + 1U) !=
+       TEST_LL_STALL) ||
+      (test_ll_control(&hUsbDeviceFS, TEST_FEATURE_GET, 0x05U, 0U, 0U, buf, 1U) != TEST_LL_STALL))
+  {
+    printf("test: feature: a request that should stall did not\n");
+    test_stats.failures++;
+  }
+
+  /* The control pipe still works after the stalls */
+  if (test_feature_get(HID_REPORT_TYPE_FEATURE, HID_CONFIG_CTRL_REPORT_ID, report, sizeof(report)) !=
+      (int32_t)HID_CONFIG_REPORT_SIZE)
+  {
+    printf("test: feature: control pipe dead after a stall\n");
+    test_stats.failures++;
+  }
+
+  printf("test: feature: reports 4 and 5 read, written and reset over EP0, other reports stall%s\n",
+         (test_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Write report 4 and read it back.
+  * @param  param: hid_config_id_t
+  * @param  op: HID_CONFIG_OP_SELECT or HID_CONFIG_OP_WRITE
+  * @param  value: value written
+  * @param  report: receives report 4 as read back
+  * @retval GET_REPORT length, or TEST_LL_STALL
+  */
+static int32_t test_feature_param(uint8_t param, uint8_t op, uint16_t value, uint8_t *report)
+{
+  memset(report, 0, HID_CONFIG_REPORT_SIZE);
+  report[0] = HID_CONFIG_PARAM_REPORT_ID;
+  report[1] = param;
+  report[2] = op;
+  report[3] = LOBYTE(value);
+  report[4] = HIBYTE(value);
+
+  if (test_feature_set(HID_REPORT_TYPE_FEATURE, HID_CONFIG_PARAM_REPORT_ID, report, HID_CONFIG_REPORT_SIZE) !=
+      (int32_t)HID_CONFIG_REPORT_SIZE)
+  {
+    return TEST_LL_STALL;
+  }
+
+  return test_feature_get(HID_REPORT_TYPE_FEATURE, HID_CONFIG_PARAM_REPORT_ID, report, HID_CONFIG_REPORT_SIZE);
+}
+
+/**
+  * @brief  GET_REPORT.
+  * @param  type: HID_REPORT_TYPE_*
+  * @param  id: report ID
+  * @param  report: receives the data stage
+  * @param  len: wLength
+  * @retval data stage length, or TEST_LL_STALL
+  */
+static int32_t test_feature_get(uint8_t type, uint8_t id, uint8_t *report, uint16_t len)
+{
+  return test_ll_control(&hUsbDeviceFS, TEST_FEATURE_GET, USBD_HID_REQ_GET_REPORT, TEST_FEATURE_VALUE(type, id), 0U,
+                         report, len);
+}
+
+/**
+  * @brief  SET_REPORT.
+  * @param  type: HID_REPORT_TYPE_*
+  * @param  id: report ID
+  * @param  report: data stage
+  * @param  len: wLength
+  * @retval data stage length, or TEST_LL_STALL
+  */
+static int32_t test_feature_set(uint8_t type, uint8_t id, const uint8_t *report, uint16_t len)
+{
+  return test_ll_control_out(&hUsbDeviceFS, TEST_FEATURE_SET, USBD_HID_REQ_SET_REPORT, TEST_FEATURE_VALUE(type, id),
+                             0U, report, len);
+}
+
+/* Configuration store stand-in: nothing is stored, the defaults stay --------*/
+config_store_status_t config_store_get(uint8_t key, void *value, uint8_t *len)
+{
+  UNUSED(key);
+  UNUSED(value);
+  UNUSED(len);
+  return CONFIG_STORE_ERR_MISSING;
+}
+
+config_store_status_t config_store_set(uint8_t key, const void *value, uint8_t len)
+{
+  UNUSED(key);
+  UNUSED(value);
+  UNUSED(len);
+  return CONFIG_STORE_OK;
+}
@@ -0,0 +1,241 @@
+/**
+  ******************************************************************************
+  * @file           : test_hid_keyboard.c
+  * @brief          : Unit test and benchmark of the keyboard report encoder
+  ******************************************************************************
+  * hid_keyboard.c has no hardware dependency and is tested on its own. The
+  * NKRO report must carry every usage of the bitmap, the 5-key and boot
+  * reports must list the pressed keys in usage order with the modifiers in
+  * their own byte, and switch every slot to ErrorRollOver when more keys are
+  * down than they hold. Random key states check the three layouts against
+  * each other.
+  *
+  * The benchmark times each encoder for 0, 6 and 32 keys down. Its figures
+  * are for the host CPU and only printed, as a relative cost per scan.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+#include "hid_keyboard.h"
+#include <string.h>
+#include <time.h>
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_KBD_RANDOM_RUNS      10000U
+#define TEST_KBD_BENCH_RUNS       1000000U
+#define TEST_KBD_USAGE_LAST       HID_USAGE_MODIFIER_LAST
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t test_kbd_seed = 1U;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t test_kbd_random(void);
+static void test_kbd_random_state(hid_key_state_t *state, uint32_t keys);
+static uint32_t test_kbd_check_state(const hid_key_state_t *state);
+static void test_kbd_bench(const char *name, uint16_t (*encode)(const hid_key_state_t *, uint8_t *), uint32_t keys);
+
+/**
+  * @brief  Check the encoders on fixed and random key states, then time them.
+  * @retval None
+  */
+void test_hid_keyboard(void)
+{
+  uint32_t failures = test_stats.failures;
+  uint8_t report[HID_KBD_MAX_REPORT_SIZE];
+  hid_key_state_t state;
+  uint32_t usage;
+  uint32_t run;
+
+  /* Every usage alone, including the modifiers and the reserved ones */
+  for (usage = 0U; usage <= TEST_KBD_USAGE_LAST; usage++)
+  {
+    hid_key_state_clear(&state);
+    hid_key_state_set(&state, (uint8_t)usage, 1U);
+    if (test_kbd_check_state(&state) != 0U)
+    {
+      printf("test: hid keyboard: usage 0x%02lX alone\n", (unsigned long)usage);
+      test_stats.failures++;
+    }
+  }
+
+  /* Exactly as many keys as the arrays hold, then one more */
+  for (usage = 0U; usage <= (HID_KBD_BOOT_KEYCODES + 1U); usage++)
+  {
+    test_kbd_random_state(&state, usage);
+    if (test_kbd_check_state(&state) != 0U)
+    {
+      printf("test: hid keyboard: %lu keys down\n", (unsigned long)usage);
+      test_stats.failures++;
+    }
+  }
+
+  for (run = 0U; run < TEST_KBD_RANDOM_RUNS; run++)
+  {
+    test_kbd_random_state(&state, test_kbd_random() % 16U);
+    if (test_kbd_check_state(&state) != 0U)
+    {
+      printf("test: hid keyboard: random state %lu\n", (unsigned long)run);
+      test_stats.failures++;
+      break;
+    }
+  }
+
+  /* The protocol selects the layout */
+  hid_key_state_clear(&state);
+  if ((hid_kbd_encode(&state, HID_KBD_PROTOCOL_BOOT, report) != HID_KBD_BOOT_REPORT_SIZE) ||
+      (hid_kbd_encode(&state, HID_KBD_PROTOCOL_REPORT, report) != HID_KBD_NKRO_REPORT_SIZE) ||
+      (report[0] != HID_KBD_NKRO_REPORT_ID))
+  {
+    printf("test: hid keyboard: hid_kbd_encode picks the wrong layout\n");
+    test_stats.failures++;
+  }
+
+  printf("test: hid keyboard: NKRO, 5-key and boot encoders on %lu key states%s\n",
+         (unsigned long)(TEST_KBD_USAGE_LAST + 1U + HID_KBD_BOOT_KEYCODES + 2U + TEST_KBD_RANDOM_RUNS),
+         (test_stats.failures != failures) ? " (FAILED)" : "");
+
+  test_kbd_bench("nkro", hid_kbd_encode_nkro, 0U);
+  test_kbd_bench("nkro", hid_kbd_encode_nkro, 6U);
+  test_kbd_bench("nkro", hid_kbd_encode_nkro, 32U);
+  test_kbd_bench("boot", hid_kbd_encode_boot, 0U);
+  test_kbd_bench("boot", hid_kbd_encode_boot, 6U);
+  test_kbd_bench("boot", hid_kbd_encode_boot, 32U);
+}
+
+/**
+  * @brief  Check the three layouts of one key state against the bitmap.
+  * @param  state: key state bitmap
+  * @retval 0 if every layout matches
+  */
+static uint32_t test_kbd_check_state(const hid_key_state_t *state)
+{
+  uint8_t nkro[HID_KBD_NKRO_REPORT_SIZE];
+  uint8_t kro[HID_KBD_6KRO_REPORT_SIZE];
+  uint8_t boot[HID_KBD_BOOT_REPORT_SIZE];
+  uint8_t keys[HID_KBD_BOOT_KEYCODES + 1U];
+  uint8_t modifiers = 0U;
+  uint32_t count = 0U;
+  uint32_t usage;
+  uint32_t down;
+  uint32_t i;
+
+  if ((hid_kbd_encode_nkro(state, nkro) != HID_KBD_NKRO_REPORT_SIZE) ||
+      (hid_kbd_encode_6kro(state, kro) != HID_KBD_6KRO_REPORT_SIZE) ||
+      (hid_kbd_encode_boot(state, boot) != HID_KBD_BOOT_REPORT_SIZE) ||
+      (nkro[0] != HID_KBD_NKRO_REPORT_ID) || (kro[0] != HID_KBD_6KRO_REPORT_ID) || (kro[2] != 0U) ||
+      (boot[1] != 0U))
+  {
+    return 1U;
+  }
+
+  /* The NKRO bitmap is the key state, the arrays list keys in usage order */
+  for (usage = 0U; usage <= TEST_KBD_USAGE_LAST; usage++)
+  {
+    down = (state->bits[usage >> 5] >> (usage & 0x1FU)) & 1U;
+    if (((nkro[1U + (usage >> 3)] >> (usage & 7U)) & 1U) != down)
+    {
+      return 1U;
+    }
+    if (down == 0U)
+    {
+      continue;
+    }
+    if (usage >= HID_USAGE_MODIFIER_FIRST)
+    {
+      modifiers |= (uint8_t)(1U << (usage - HID_USAGE_MODIFIER_FIRST));
+    }
+    else if ((usage >= HID_USAGE_FIRST_KEY) && (count <= HID_KBD_BOOT_KEYCODES))
+    {
+      keys[count++] = (uint8_t)usage;
+    }
+  }
+
+  if ((kro[1] != modifiers) || (boot[0] != modifiers))
+  {
+    return 1U;
+  }
+
+  for (i = 0U; i < HID_KBD_BOOT_KEYCODES; i++)
+  {
+    if (boot[2U + i] != ((count > HID_KBD_BOOT_KEYCODES) ? HID_USAGE_ERROR_ROLLOVER : ((i < count) ? keys[i] : 0U)))
+    {
+      return 1U;
+    }
+  }
+  for (i = 0U; i < HID_KBD_6KRO_KEYCODES; i++)
+  {
+    if (kro[3U + i] != ((count > HID_KBD_6KRO_KEYCODES) ? HID_USAGE_ERROR_ROLLOVER : ((i < count) ? keys[i] : 0U)))
+    {
+      return 1U;
+    }
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  Time one encoder over a fixed key state.
+  * @param  name: printed name of the encoder
+  * @param  encode: encoder under test
+  * @param  keys: number of non-modifier keys down
+  * @retval None
+  */
+static void test_kbd_bench(const char *name, uint16_t (*encode)(const hid_key_state_t *, uint8_t *), uint32_t keys)
+{
+  uint8_t report[HID_KBD_MAX_REPORT_SIZE];
+  volatile uint32_t sink = 0U;
+  hid_key_state_t state;
+  struct timespec start;
+  struct timespec end;
+  uint64_t ns;
+  uint32_t run;
+
+  test_kbd_random_state(&state, keys);
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &start);
+  for (run = 0U; run < TEST_KBD_BENCH_RUNS; run++)
+  {
+    sink += encode(&state, report);
+    sink += report[run % HID_KBD_BOOT_REPORT_SIZE];
+  }
+  (void)clock_gettime(CLOCK_MONOTONIC, &end);
+
+  ns = ((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL) + (uint64_t)end.tv_nsec - (uint64_t)start.tv_nsec;
+  printf("test: hid keyboard: bench: %s, %2lu keys down: %lu ns per encode\n", name, (unsigned long)keys,
+         (unsigned long)(ns / TEST_KBD_BENCH_RUNS));
+  (void)sink;
+}
+
+/**
+  * @brief  Press a number of distinct keys picked at random, and random modifiers.
+  * @param  state: receives the key state
+  * @param  keys: number of non-modifier keys down
+  * @retval None
+  */
+static void test_kbd_random_state(hid_key_state_t *state, uint32_t keys)
+{
+  uint8_t usage;
+
+  hid_key_state_clear(state);
+  while (keys > 0U)
+  {
+    usage = (uint8_t)(HID_USAGE_FIRST_KEY + (test_kbd_random() % (HID_USAGE_MODIFIER_FIRST - HID_USAGE_FIRST_KEY)));
+    if (((state->bits[usage >> 5] >> (usage & 0x1FU)) & 1U) == 0U)
+    {
+      hid_key_state_set(state, usage, 1U);
+      keys--;
+    }
+  }
+  state->bits[HID_USAGE_MODIFIER_FIRST >> 5] |= (test_kbd_random() & 0xFFU) << (HID_USAGE_MODIFIER_FIRST & 0x1FU);
+}
+
+/**
+  * @brief  Linear congruential generator, repeatable across runs.
+  * @retval next pseudo-random value
+  */
+static uint32_t test_kbd_random(void)
+{
+  test_kbd_seed = (test_kbd_seed * 1664525U) + 1013904223U;
+  return test_kbd_seed >> 8;
+}
@@ -0,0 +1,186 @@
+/**
+  ******************************************************************************
+  * @file           : test_hid_queue.c
+  * @brief          : Unit test of the HID IN report queue
+  ******************************************************************************
+  * The HID class runs on the USB device core with the stub driver, the test
+  * completes the IN transfers itself. Reports queued while the endpoint is
+  * busy must go out in order, one per completion, a full queue must refuse
+  * the next report with USBD_BUSY and count it, and the high-water mark must
+  * follow the deepest the queue has been. A SET_PROTOCOL that changes the
+  * protocol must drop every queued report but the one on the endpoint, and
+  * one for a protocol other than boot and report must stall. A completion
+  * with no report on the endpoint must leave the queue as it was.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+#include "usbd_hid.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_QUEUE_REPORT_LEN     8U
+#define TEST_QUEUE_RUNS           1000U   /* bursts of random length, across index wrap-around */
+#define TEST_QUEUE_FLUSHED        4U      /* reports queued before a protocol change */
+
+/* Private variables ---------------------------------------------------------*/
+static USBD_HandleTypeDef test_dev;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint8_t test_queue_send(uint32_t seq);
+static uint32_t test_queue_take(uint32_t *seq, uint32_t max);
+
+/**
+  * @brief  Fill, overflow and drain the report queue.
+  * @retval None
+  */
+void test_hid_queue(void)
+{
+  uint32_t failures = test_stats.failures;
+  USBD_HID_HandleTypeDef *hhid;
+  uint32_t sent = 0U;
+  uint32_t seq = 0U;
+  uint32_t seed = 1U;
+  uint32_t burst;
+  uint32_t run;
+  uint32_t i;
+
+  if (test_ll_enumerate(&test_dev, &USBD_HID) != 0)
+  {
+    printf("test: hid queue: enumeration failed\n");
+    test_stats.failures++;
+    return;
+  }
+  hhid = (USBD_HID_HandleTypeDef *)test_dev.pClassDataCmsit[0];
+
+  /* An idle endpoint takes the first report at once */
+  if ((test_queue_send(sent++) != (uint8_t)USBD_OK) || (test_ep_in[HID_EPIN_ADDR & 0xFU].armed == 0U))
+  {
+    printf("test: hid queue: first report not transmitted at once\n");
+    test_stats.failures++;
+  }
+
+  /* The rest of the queue fills while the host does not poll, then it refuses */
+  for (i = 1U; i < HID_REPORT_QUEUE_SIZE; i++)
+  {
+    if (test_queue_send(sent++) != (uint8_t)USBD_OK)
+    {
+      printf("test: hid queue: report %lu refused below the queue size\n", (unsigned long)i);
+      test_stats.failures++;
+    }
+  }
+  if ((test_queue_send(sent) != (uint8_t)USBD_BUSY) || (hhid->QueueOverflows != 1U) ||
+      (USBD_HID_GetQueueHighWater(&test_dev) != HID_REPORT_QUEUE_SIZE) ||
+      (test_ep_in[HID_EPIN_ADDR & 0xFU].transfers != 1U))
+  {
+    printf("test: hid queue: full queue: overflows %lu, high water %lu, %lu transfers started\n",
+           (unsigned long)hhid->QueueOverflows, (unsigned long)USBD_HID_GetQueueHighWater(&test_dev),
+           (unsigned long)test_ep_in[HID_EPIN_ADDR & 0xFU].transfers);
+    test_stats.failures++;
+  }
+
+  /* One report per completion, in order, then the endpoint goes idle */
+  if ((test_queue_take(&seq, UINT32_MAX) != HID_REPORT_QUEUE_SIZE) || (seq != sent) || (hhid->state != USBD_HID_IDLE))
+  {
+    printf("test: hid queue: %lu of %lu reports drained in order\n", (unsigned long)seq, (unsigned long)sent);
+    test_stats.failures++;
+  }
+
+  /* Bursts of 1 to the queue size, each drained part way, many times around the ring */
+  for (run = 0U; (run < TEST_QUEUE_RUNS) && (test_stats.failures == failures); run++)
+  {
+    seed = (seed * 1664525U) + 1013904223U;
+    burst = 1U + ((seed >> 8) % HID_REPORT_QUEUE_SIZE);
+    for (i = 0U; i < burst; i++)
+    {
+      if (test_queue_send(sent) == (uint8_t)USBD_OK)
+      {
+        sent++;
+      }
+    }
+    (void)test_queue_take(&seq, (seed >> 20) % (burst + 1U));
+  }
+  (void)test_queue_take(&seq, UINT32_MAX);
+  if (seq != sent)
+  {
+    printf("test: hid queue: %lu runs: %lu reports received, %lu sent\n", (unsigned long)run,
+           (unsigned long)seq, (unsigned long)sent);
+    test_stats.failures++;
+  }
+
+  /* Only a change of protocol drops the queued reports, an unknown one stalls */
+  for (i = 0U; i < TEST_QUEUE_FLUSHED; i++)
+  {
+    (void)test_queue_send(sent++);
+  }
+  if ((test_ll_control(&test_dev, 0x21U, USBD_HID_REQ_SET_PROTOCOL, 2U, 0U, NULL, 0U) != TEST_LL_STALL) ||
+      (test_ll_control(&test_dev, 0x21U, USBD_HID_REQ_SET_PROTOCOL, HID_REPORT_PROTOCOL, 0U, NULL, 0U) != 0) ||
+      (USBD_HID_GetQueueDepth(&test_dev) != TEST_QUEUE_FLUSHED) ||
+      (test_ll_control(&test_dev, 0x21U, USBD_HID_REQ_SET_PROTOCOL, HID_BOOT_PROTOCOL, 0U, NULL, 0U) != 0) ||
+      (USBD_HID_GetProtocol(&test_dev) != HID_BOOT_PROTOCOL) || (USBD_HID_GetQueueDepth(&test_dev) != 1U) ||
+      (test_queue_take(&seq, UINT32_MAX) != 1U) || (hhid->state != USBD_HID_IDLE))
+  {
+    printf("test: hid queue: SET_PROTOCOL: protocol %u, %lu reports left queued\n", USBD_HID_GetProtocol(&test_dev),
+           (unsigned long)USBD_HID_GetQueueDepth(&test_dev));
+    test_stats.failures++;
+  }
+  seq = sent;
+  (void)test_ll_control(&test_dev, 0x21U, USBD_HID_REQ_SET_PROTOCOL, HID_REPORT_PROTOCOL, 0U, NULL, 0U);
+
+  /* A completion the idle endpoint did not start releases nothing */
+  (void)USBD_LL_DataInStage(&test_dev, HID_EPIN_ADDR & 0x7FU, NULL);
+  if ((USBD_HID_GetQueueDepth(&test_dev) != 0U) || (test_queue_send(sent++) != (uint8_t)USBD_OK) ||
+      (test_queue_take(&seq, UINT32_MAX) != 1U) || (hhid->state != USBD_HID_IDLE))
+  {
+    printf("test: hid queue: spurious completion: %lu reports queued\n",
+           (unsigned long)USBD_HID_GetQueueDepth(&test_dev));
+    test_stats.failures++;
+  }
+
+  printf("test: hid queue: %lu reports through a %u-slot queue, refused with USBD_BUSY when full, "
+         "high water %lu%s\n", (unsigned long)sent, HID_REPORT_QUEUE_SIZE,
+         (unsigned long)USBD_HID_GetQueueHighWater(&test_dev), (test_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Queue a report numbered seq.
+  * @param  seq: sequence number, carried in the report
+  * @retval USBD_HID_SendReport status
+  */
+static uint8_t test_queue_send(uint32_t seq)
+{
+  uint8_t report[TEST_QUEUE_REPORT_LEN] = { 0U };
+
+  memcpy(&report[2], &seq, sizeof(seq));
+
+  return USBD_HID_SendReport(&test_dev, report, sizeof(report));
+}
+
+/**
+  * @brief  Poll the IN endpoint until it has nothing more to send.
+  * @param  seq: next sequence number expected, advanced per report
+  * @param  max: most reports to take
+  * @retval reports taken
+  */
+static uint32_t test_queue_take(uint32_t *seq, uint32_t max)
+{
+  uint8_t report[USB_MAX_EP0_SIZE];
+  uint32_t got;
+  uint32_t n = 0U;
+
+  while ((n < max) &&
+         (test_ll_in(&test_dev, HID_EPIN_ADDR, report, sizeof(report)) == (int32_t)TEST_QUEUE_REPORT_LEN))
+  {
+    n++;
+    memcpy(&got, &report[2], sizeof(got));
+    if (got != *seq)
+    {
+      printf("test: hid queue: report %lu received, %lu expected\n", (unsigned long)got, (unsigned long)*seq);
+      test_stats.failures++;
+      break;
+    }
+    (*seq)++;
+  }
+
+  return n;
+}
@@ -0,0 +1,207 @@
+/**
+  ******************************************************************************
+  * @file           : test_idle.c
+  * @brief          : Unit test of the SET_IDLE repeats on a simulated SOF stream
+  ******************************************************************************
+  * The device core receives one USBD_LL_SOF() per 1 ms frame and the host
+  * polls the IN endpoint in every frame. With an idle rate of 0 the device
+  * must only send on change, so a report sent again unchanged makes no IN
+  * traffic. With a SET_IDLE duration it must repeat the last report of each
+  * report ID once the period has run out without a new one, restart the
+  * period on a new report, and forget the kept reports on SET_PROTOCOL.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+#include "usbd_hid.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_IDLE_FRAMES          1000U
+#define TEST_IDLE_DURATION        25U                                    /* 4 ms units */
+#define TEST_IDLE_PERIOD          (TEST_IDLE_DURATION * HID_IDLE_UNIT_MS)  /* frames */
+#define TEST_IDLE_MAX_REPORTS     64U
+#define TEST_IDLE_CHANGE_AT       50U
+
+/* Private typedef -----------------------------------------------------------*/
+/* Reports the host received during a run of frames */
+typedef struct
+{
+  uint32_t count;
+  uint32_t frame[TEST_IDLE_MAX_REPORTS];   /* 1 for the first frame of the run */
+  uint8_t  id[TEST_IDLE_MAX_REPORTS];
+  uint8_t  data[TEST_IDLE_MAX_REPORTS];    /* byte 1 of the report */
+} test_idle_log_t;
+
+/* Private variables ---------------------------------------------------------*/
+static USBD_HandleTypeDef test_dev;
+static test_idle_log_t test_idle_log;
+
+/* Private function prototypes -----------------------------------------------*/
+static void test_idle_run(uint32_t frames, uint32_t change_at, const uint8_t *report, uint16_t len);
+static uint8_t test_idle_send(uint8_t id, uint8_t data, uint16_t len);
+static int32_t test_idle_request(uint8_t request, uint16_t value);
+
+/**
+  * @brief  Play the SOF stream with and without an idle rate.
+  * @retval None
+  */
+void test_idle(void)
+{
+  uint32_t failures = test_stats.failures;
+  uint8_t changed[8] = { 0x01U, 0x22U };
+  uint32_t transfers;
+  uint32_t i;
+
+  if (test_ll_enumerate(&test_dev, &USBD_HID) != 0)
+  {
+    printf("test: idle: enumeration failed\n");
+    test_stats.failures++;
+    return;
+  }
+
+  /* Idle rate 0: the first report goes out, the same one again does not */
+  (void)test_idle_send(0x01U, 0x11U, 8U);
+  test_idle_run(TEST_IDLE_FRAMES, 0U, NULL, 0U);
+  transfers = test_ep_in[HID_EPIN_ADDR & 0xFU].transfers;
+  for (i = 0U; i < TEST_IDLE_FRAMES; i++)
+  {
+    (void)test_idle_send(0x01U, 0x11U, 8U);
+  }
+  if ((test_idle_log.count != 1U) || (test_ep_in[HID_EPIN_ADDR & 0xFU].transfers != transfers))
+  {
+    printf("test: idle: rate 0: %lu reports, %lu transfers for unchanged reports\n",
+           (unsigned long)test_idle_log.count,
+           (unsigned long)(test_ep_in[HID_EPIN_ADDR & 0xFU].transfers - transfers));
+    test_stats.failures++;
+  }
+
+  /* Idle duration: the kept report repeats every period, counted from SET_IDLE */
+  (void)test_idle_request(USBD_HID_REQ_SET_IDLE, (uint16_t)(TEST_IDLE_DURATION << 8));
+  test_idle_run(TEST_IDLE_FRAMES, 0U, NULL, 0U);
+  if (test_idle_log.count != (TEST_IDLE_FRAMES / TEST_IDLE_PERIOD))
+  {
+    printf("test: idle: %lu repeats in %lu frames\n", (unsigned long)test_idle_log.count,
+           (unsigned long)TEST_IDLE_FRAMES);
+    test_stats.failures++;
+  }
+  for (i = 0U; i < test_idle_log.count; i++)
+  {
+    if ((test_idle_log.frame[i] != ((i + 1U) * TEST_IDLE_PERIOD)) || (test_idle_log.id[i] != 0x01U) ||
+        (test_idle_log.data[i] != 0x11U))
+    {
+      printf("test: idle: repeat %lu at frame %lu, ID %u, data 0x%02X\n", (unsigned long)i,
+             (unsigned long)test_idle_log.frame[i], test_idle_log.id[i], test_idle_log.data[i]);
+      test_stats.failures++;
+      break;
+    }
+  }
+
+  /* A new report goes out at once and restarts the period */
+  (void)test_idle_request(USBD_HID_REQ_SET_IDLE, (uint16_t)(TEST_IDLE_DURATION << 8));
+  test_idle_run(TEST_IDLE_PERIOD * 3U, TEST_IDLE_CHANGE_AT, changed, sizeof(changed));
+  if ((test_idle_log.count != 3U) || (test_idle_log.frame[0] != TEST_IDLE_CHANGE_AT) ||
+      (test_idle_log.frame[1] != (TEST_IDLE_CHANGE_AT + TEST_IDLE_PERIOD)) ||
+      (test_idle_log.frame[2] != (TEST_IDLE_CHANGE_AT + (2U * TEST_IDLE_PERIOD))) ||
+      (test_idle_log.data[1] != 0x22U) || (test_idle_log.data[2] != 0x22U))
+  {
+    printf("test: idle: change at frame %lu: %lu reports, first at %lu\n", (unsigned long)TEST_IDLE_CHANGE_AT,
+           (unsigned long)test_idle_log.count, (unsigned long)test_idle_log.frame[0]);
+    test_stats.failures++;
+  }
+
+  /* Each report ID repeats on its own */
+  (void)test_idle_send(0x02U, 0x33U, 3U);
+  test_idle_run(1U, 0U, NULL, 0U);
+  (void)test_idle_request(USBD_HID_REQ_SET_IDLE, (uint16_t)(TEST_IDLE_DURATION << 8));
+  test_idle_run(TEST_IDLE_FRAMES + 1U, 0U, NULL, 0U);   /* both expire together, one IN per frame */
+  transfers = 0U;
+  for (i = 0U; i < test_idle_log.count; i++)
+  {
+    transfers += (test_idle_log.id[i] == 0x02U) ? 1U : 0U;
+  }
+  if ((test_idle_log.count != (2U * (TEST_IDLE_FRAMES / TEST_IDLE_PERIOD))) ||
+      (transfers != (TEST_IDLE_FRAMES / TEST_IDLE_PERIOD)))
+  {
+    printf("test: idle: two report IDs: %lu repeats, %lu of ID 2\n", (unsigned long)test_idle_log.count,
+           (unsigned long)transfers);
+    test_stats.failures++;
+  }
+
+  /* SET_PROTOCOL forgets the kept reports: their layout has changed */
+  (void)test_idle_request(USBD_HID_REQ_SET_PROTOCOL, HID_BOOT_PROTOCOL);
+  test_idle_run(TEST_IDLE_FRAMES, 0U, NULL, 0U);
+  if (test_idle_log.count != 0U)
+  {
+    printf("test: idle: %lu repeats after SET_PROTOCOL\n", (unsigned long)test_idle_log.count);
+    test_stats.failures++;
+  }
+
+  printf("test: idle: on change only at rate 0, repeats every %lu frames per report ID at duration %lu%s\n",
+         (unsigned long)TEST_IDLE_PERIOD, (unsigned long)TEST_IDLE_DURATION,
+         (test_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Run 1 ms frames: SOF, then the host polls the IN endpoint.
+  * @param  frames: number of frames
+  * @param  change_at: frame at which report is sent, 0 for none
+  * @param  report: report sent at change_at
+  * @param  len: its length
+  * @retval None, the reports received are in test_idle_log
+  */
+static void test_idle_run(uint32_t frames, uint32_t change_at, const uint8_t *report, uint16_t len)
+{
+  uint8_t packet[HID_EPIN_SIZE];
+  uint8_t buf[HID_EPIN_SIZE];
+  uint32_t frame;
+
+  memset(&test_idle_log, 0, sizeof(test_idle_log));
+
+  for (frame = 1U; frame <= frames; frame++)
+  {
+    (void)USBD_LL_SOF(&test_dev);
+
+    if ((frame == change_at) && (report != NULL))
+    {
+      memcpy(buf, report, len);
+      (void)USBD_HID_SendReport(&test_dev, buf, len);
+    }
+
+    if ((test_ll_in(&test_dev, HID_EPIN_ADDR, packet, sizeof(packet)) > 0) &&
+        (test_idle_log.count < TEST_IDLE_MAX_REPORTS))
+    {
+      test_idle_log.frame[test_idle_log.count] = frame;
+      test_idle_log.id[test_idle_log.count] = packet[0];
+      test_idle_log.data[test_idle_log.count] = packet[1];
+      test_idle_log.count++;
+    }
+  }
+}
+
+/**
+  * @brief  Send a report of the application.
+  * @param  id: report ID
+  * @param  data: byte 1 of the report
+  * @param  len: report length
+  * @retval USBD_HID_SendReport status
+  */
+static uint8_t test_idle_send(uint8_t id, uint8_t data, uint16_t len)
+{
+  uint8_t report[HID_EPIN_SIZE] = {0};
+
+  report[0] = id;
+  report[1] = data;
+  return USBD_HID_SendReport(&test_dev, report, len);
+}
+
+/**
+  * @brief  Send a HID class request with no data stage to the interface.
+  * @param  request: bRequest
+  * @param  value: wValue
+  * @retval test_ll_control status
+  */
+static int32_t test_idle_request(uint8_t request, uint16_t value)
+{
+  return test_ll_control(&test_dev, 0x21U, request, value, 0U, NULL, 0U);
+}
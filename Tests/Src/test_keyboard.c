@@ -0,0 +1,271 @@
+/**
+  ******************************************************************************
+  * @file           : test_keyboard.c
+  * @brief          : Unit test of the key capture to HID report pipeline
+  ******************************************************************************
+  * keyboard.c, debounce.c and key_events.c run on the HID class with the
+  * stub driver. A synthetic trace drives the PA0 level one matrix scan at a
+  * time: every edge of the trace bounces over the first scans, and each
+  * level change raises the EXTI callback the way the interrupt would. The
+  * test completes every scan in place of the DMA interrupt, the main loop
+  * runs keyboard_task() every tick and the host polls the IN endpoint every
+  * bInterval.
+  *
+  * Every tap of the trace must come out as exactly one press report followed
+  * by one release report, in order, and the trace is hit far faster than the
+  * ten keystrokes a second the blocking loop allowed. Reports use the NKRO
+  * layout until the host selects boot protocol, which must resend the key
+  * state in the boot layout at once, and back. A queued edge must carry the
+  * cycle count of its last EXTI edge, not the time debounce accepted it.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+#include "keyboard.h"
+#include "key_events.h"
+#include "hid_keyboard.h"
+#include "matrix_scan.h"
+#include "usbd_hid.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_KEYBOARD_TAPS        100U    /* taps of the trace */
+#define TEST_KEYBOARD_HOLD_MS     20U     /* key down, then key up, per tap */
+#define TEST_KEYBOARD_BOUNCES     3U      /* times each edge bounces back */
+#define TEST_KEYBOARD_USAGE       0x4EU   /* PA0: Page Down */
+#define TEST_KEYBOARD_TAIL_MS     100U    /* host polling after the trace */
+#define TEST_KEYBOARD_MATRIX_KEY  0U      /* column 0 row 0: Esc */
+#define TEST_KEYBOARD_MATRIX_USAGE 0x29U
+#define TEST_KEYBOARD_SCANS_PER_MS (MATRIX_SCAN_HZ / 1000U)
+
+/* Exported variables --------------------------------------------------------*/
+USBD_HandleTypeDef hUsbDeviceFS;
+GPIO_TypeDef test_gpioa;
+DWT_Type test_dwt;
+CoreDebug_Type test_core_debug;
+uint32_t SystemCoreClock = 96000000U;
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t test_tick;
+static matrix_bitmap_t test_matrix_state;
+
+/* Private function prototypes -----------------------------------------------*/
+static void test_keyboard_ms(int32_t edge);
+static void test_keyboard_settle(void);
+static int32_t test_keyboard_poll(uint8_t protocol, uint8_t usage);
+
+/**
+  * @brief  Play the trace and check the report sequence and its rate.
+  * @retval None
+  */
+void test_keyboard(void)
+{
+  uint32_t failures = test_stats.failures;
+  uint32_t trace_ms = TEST_KEYBOARD_TAPS * 2U * TEST_KEYBOARD_HOLD_MS;
+  uint32_t reports = 0U;
+  uint32_t interval;
+  uint32_t last_ms = 0U;
+  key_event_t event = {0};
+  uint32_t edge_cycles;
+  int32_t pressed;
+  uint32_t ms;
+
+  test_gpioa.IDR = 0U;
+  memset(&test_matrix_state, 0, sizeof(test_matrix_state));
+  test_tick = 0U;
+  if (test_ll_enumerate(&hUsbDeviceFS, &USBD_HID) != 0)
+  {
+    printf("test: keyboard: enumeration failed\n");
+    test_stats.failures++;
+    return;
+  }
+  interval = USBD_HID_GetPollingInterval(&hUsbDeviceFS);
+  keyboard_init();
+
+  for (ms = 0U; ms < (trace_ms + TEST_KEYBOARD_TAIL_MS); ms++)
+  {
+    test_tick = ms;
+
+    /* Press at the start of each tap, release half way */
+    if ((ms < trace_ms) && ((ms % TEST_KEYBOARD_HOLD_MS) == 0U))
+    {
+      test_keyboard_ms(((ms / TEST_KEYBOARD_HOLD_MS) % 2U == 0U) ? 1 : 0);
+    }
+    else
+    {
+      test_keyboard_ms(-1);
+    }
+
+    keyboard_task();
+
+    if ((ms % interval) != 0U)
+    {
+      continue;
+    }
+
+    pressed = test_keyboard_poll(HID_KBD_PROTOCOL_REPORT, TEST_KEYBOARD_USAGE);
+    if (pressed == TEST_LL_NAK)
+    {
+      continue;
+    }
+
+    /* Press and release alternate, starting with a press */
+    if (pressed != (((reports % 2U) == 0U) ? 1 : 0))
+    {
+      printf("test: keyboard: report %lu at %lu ms: key state %ld\n", (unsigned long)reports, (unsigned long)ms,
+             (long)pressed);
+      test_stats.failures++;
+    }
+    reports++;
+    last_ms = ms;
+  }
+
+  if ((reports != (2U * TEST_KEYBOARD_TAPS)) || (key_events_dropped() != 0U))
+  {
+    printf("test: keyboard: %lu reports for %lu taps, %lu edges dropped\n", (unsigned long)reports,
+           (unsigned long)TEST_KEYBOARD_TAPS, (unsigned long)key_events_dropped());
+    test_stats.failures++;
+  }
+
+  /* The last release leaves within the debounce time and one polling interval of the trace end */
+  if (last_ms > (trace_ms + KEYBOARD_DEBOUNCE_MS + interval))
+  {
+    printf("test: keyboard: last report at %lu ms, trace ends at %lu ms\n", (unsigned long)last_ms,
+           (unsigned long)trace_ms);
+    test_stats.failures++;
+  }
+
+  /* Boot protocol resends the held key in the boot layout, report protocol goes back to NKRO */
+  test_tick++;
+  test_keyboard_ms(1);
+  test_keyboard_settle();
+  (void)test_keyboard_poll(HID_KBD_PROTOCOL_REPORT, TEST_KEYBOARD_USAGE);
+  (void)test_ll_control(&hUsbDeviceFS, 0x21U, USBD_HID_REQ_SET_PROTOCOL, HID_BOOT_PROTOCOL, 0U, NULL, 0U);
+  keyboard_task();
+  if (test_keyboard_poll(HID_KBD_PROTOCOL_BOOT, TEST_KEYBOARD_USAGE) != 1)
+  {
+    printf("test: keyboard: no boot report after SET_PROTOCOL boot\n");
+    test_stats.failures++;
+  }
+  (void)test_ll_control(&hUsbDeviceFS, 0x21U, USBD_HID_REQ_SET_PROTOCOL, HID_REPORT_PROTOCOL, 0U, NULL, 0U);
+  keyboard_task();
+  if (test_keyboard_poll(HID_KBD_PROTOCOL_REPORT, TEST_KEYBOARD_USAGE) != 1)
+  {
+    printf("test: keyboard: no NKRO report after SET_PROTOCOL report\n");
+    test_stats.failures++;
+  }
+
+  /* A matrix scan queues its edges next to the direct keys */
+  test_matrix_state.bits[TEST_KEYBOARD_MATRIX_KEY >> 5] |= 1UL << (TEST_KEYBOARD_MATRIX_KEY & 0x1FU);
+  test_keyboard_settle();
+  if (test_keyboard_poll(HID_KBD_PROTOCOL_REPORT, TEST_KEYBOARD_MATRIX_USAGE) != 1)
+  {
+    printf("test: keyboard: no NKRO report for the matrix key\n");
+    test_stats.failures++;
+  }
+
+  /* PA0 comes up; the edge is dated from the EXTI edge that ended its bounce */
+  edge_cycles = test_dwt.CYCCNT + ((2U * TEST_KEYBOARD_BOUNCES) * (SystemCoreClock / MATRIX_SCAN_HZ));
+  test_keyboard_ms(0);
+  for (ms = 0U; ms <= KEYBOARD_DEBOUNCE_MS; ms++)
+  {
+    test_keyboard_ms(-1);
+  }
+  if ((key_events_pop(&event) == 0U) || (event.pressed != 0U) || (event.timestamp != edge_cycles))
+  {
+    printf("test: keyboard: PA0 release queued at cycle %lu, last EXTI edge at %lu\n",
+           (unsigned long)event.timestamp, (unsigned long)edge_cycles);
+    test_stats.failures++;
+  }
+
+  printf("test: keyboard: %lu taps with %u bounces per edge, %lu reports in %lu ms (%lu keystrokes/s), "
+         "boot protocol fallback, matrix key, edge timestamps%s\n",
+         (unsigned long)TEST_KEYBOARD_TAPS, TEST_KEYBOARD_BOUNCES, (unsigned long)reports,
+         (unsigned long)last_ms, (unsigned long)((TEST_KEYBOARD_TAPS * 1000U) / trace_ms),
+         (test_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Run one millisecond of matrix scans, moving PA0 with contact bounce on request.
+  * @param  edge: level PA0 settles at, or -1 to leave it alone
+  * @retval None
+  */
+static void test_keyboard_ms(int32_t edge)
+{
+  uint32_t scan;
+
+  for (scan = 0U; scan < TEST_KEYBOARD_SCANS_PER_MS; scan++)
+  {
+    /* The level goes back to the old one every other scan and ends on the new one */
+    if ((edge >= 0) && (scan < ((2U * TEST_KEYBOARD_BOUNCES) + 1U)))
+    {
+      test_gpioa.IDR = (((scan % 2U) == 0U) == (edge != 0)) ? GPIO_PIN_0 : 0U;
+      keyboard_gpio_edge(GPIO_PIN_0);
+    }
+    matrix_scan_complete_callback(&test_matrix_state);
+    test_dwt.CYCCNT += SystemCoreClock / MATRIX_SCAN_HZ;
+  }
+}
+
+/**
+  * @brief  Scan past the debounce time and run the main loop every tick.
+  * @retval None
+  */
+static void test_keyboard_settle(void)
+{
+  uint32_t ms;
+
+  for (ms = 0U; ms <= KEYBOARD_DEBOUNCE_MS; ms++)
+  {
+    test_tick++;
+    test_keyboard_ms(-1);
+    keyboard_task();
+  }
+}
+
+/**
+  * @brief  Take the next report as the host and decode one key from it.
+  * @param  protocol: layout the report must have, HID_KBD_PROTOCOL_BOOT or HID_KBD_PROTOCOL_REPORT
+  * @param  usage: usage of the key
+  * @retval 1 if the key is down, 0 if up, TEST_LL_NAK if no report, -2 if the layout is wrong
+  */
+static int32_t test_keyboard_poll(uint8_t protocol, uint8_t usage)
+{
+  uint8_t report[HID_KBD_MAX_REPORT_SIZE];
+  int32_t n;
+
+  n = test_ll_in(&hUsbDeviceFS, HID_EPIN_ADDR, report, sizeof(report));
+  if (n == TEST_LL_NAK)
+  {
+    return TEST_LL_NAK;
+  }
+
+  if (protocol == HID_KBD_PROTOCOL_BOOT)
+  {
+    return (n == (int32_t)HID_KBD_BOOT_REPORT_SIZE) ? ((report[2] == usage) ? 1 : 0) : -2;
+  }
+
+  if ((n != (int32_t)HID_KBD_NKRO_REPORT_SIZE) || (report[0] != HID_KBD_NKRO_REPORT_ID))
+  {
+    return -2;
+  }
+
+  return ((report[1U + (usage >> 3)] & (1U << (usage & 7U))) != 0U) ? 1 : 0;
+}
+
+/* Matrix scanner stand-in: the test calls matrix_scan_complete_callback() ---*/
+const matrix_bitmap_t *matrix_scan_get_state(void)
+{
+  return &test_matrix_state;
+}
+
+/* HAL stand-ins -------------------------------------------------------------*/
+uint32_t HAL_GetTick(void)
+{
+  return test_tick;
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+  return ((GPIOx->IDR & GPIO_Pin) != 0U) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
@@ -0,0 +1,169 @@
+/**
+  ******************************************************************************
+  * @file           : test_led.c
+  * @brief          : Unit test of the LED output report
+  ******************************************************************************
+  * The host sends the lock LEDs the two ways hosts do: on the interrupt OUT
+  * endpoint and with SET_REPORT(Output) on EP0. Under report protocol the
+  * LED byte follows report ID 1 and a report of another ID is ignored;
+  * under boot protocol the LED byte is the whole report. The endpoint must
+  * be re-armed after every report, the configuration descriptor must
+  * declare it, and keyboard_get_leds() must return the cached state.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+#include "hid_keyboard.h"
+#include "keyboard.h"
+#include "usbd_hid.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_LED_CFG_MAX          255U
+#define TEST_LED_OUTPUT           ((uint16_t)(HID_REPORT_TYPE_OUTPUT << 8) | HID_LED_REPORT_ID)
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t test_led_desc(void);
+static uint32_t test_led_out(const uint8_t *report, uint32_t len, uint8_t leds);
+
+/**
+  * @brief  Set the LEDs on the OUT endpoint and on EP0, in both protocols.
+  * @retval None
+  */
+void test_led(void)
+{
+  uint32_t failures = test_stats.failures;
+  uint8_t report[2];
+
+  if (test_ll_enumerate(&hUsbDeviceFS, &USBD_HID) != 0)
+  {
+    printf("test: led: enumeration failed\n");
+    test_stats.failures++;
+    return;
+  }
+
+  if (test_led_desc() != 0U)
+  {
+    printf("test: led: no interrupt OUT endpoint 0x%02X in the configuration descriptor\n", HID_EPOUT_ADDR);
+    test_stats.failures++;
+  }
+
+  if ((keyboard_get_leds() != 0U) || (test_ep_out[HID_EPOUT_ADDR].armed == 0U))
+  {
+    printf("test: led: LEDs 0x%02X after enumeration, OUT endpoint %s\n", keyboard_get_leds(),
+           (test_ep_out[HID_EPOUT_ADDR].armed != 0U) ? "armed" : "not armed");
+    test_stats.failures++;
+  }
+
+  /* Report protocol: ID 1 then the LED byte */
+  report[0] = HID_LED_REPORT_ID;
+  report[1] = HID_KBD_LED_CAPS_LOCK;
+  if (test_led_out(report, 2U, HID_KBD_LED_CAPS_LOCK) != 0U)
+  {
+    printf("test: led: Caps Lock on the OUT endpoint\n");
+    test_stats.failures++;
+  }
+  report[1] = HID_KBD_LED_NUM_LOCK | HID_KBD_LED_SCROLL_LOCK | HID_KBD_LED_KANA;
+  if (test_led_out(report, 2U, HID_KBD_LED_NUM_LOCK | HID_KBD_LED_SCROLL_LOCK | HID_KBD_LED_KANA) != 0U)
+  {
+    printf("test: led: Num, Scroll Lock and Kana on the OUT endpoint\n");
+    test_stats.failures++;
+  }
+  report[0] = 0x02U;
+  report[1] = 0x00U;
+  if ((test_led_out(report, 2U, HID_KBD_LED_NUM_LOCK | HID_KBD_LED_SCROLL_LOCK | HID_KBD_LED_KANA) != 0U) ||
+      (test_led_out(report, 1U, HID_KBD_LED_NUM_LOCK | HID_KBD_LED_SCROLL_LOCK | HID_KBD_LED_KANA) != 0U))
+  {
+    printf("test: led: a report of another ID or too short changed the LEDs\n");
+    test_stats.failures++;
+  }
+
+  /* SET_REPORT(Output) on EP0 goes through the same parser */
+  report[0] = HID_LED_REPORT_ID;
+  report[1] = HID_KBD_LED_COMPOSE;
+  if ((test_ll_control_out(&hUsbDeviceFS, 0x21U, USBD_HID_REQ_SET_REPORT, TEST_LED_OUTPUT, 0U, report, 2U) != 2) ||
+      (keyboard_get_leds() != HID_KBD_LED_COMPOSE))
+  {
+    printf("test: led: SET_REPORT(Output): LEDs 0x%02X\n", keyboard_get_leds());
+    test_stats.failures++;
+  }
+
+  /* Boot protocol: the LED byte alone */
+  (void)test_ll_control(&hUsbDeviceFS, 0x21U, USBD_HID_REQ_SET_PROTOCOL, HID_BOOT_PROTOCOL, 0U, NULL, 0U);
+  report[0] = HID_KBD_LED_NUM_LOCK | HID_KBD_LED_CAPS_LOCK;
+  if (test_led_out(report, 1U, HID_KBD_LED_NUM_LOCK | HID_KBD_LED_CAPS_LOCK) != 0U)
+  {
+    printf("test: led: boot protocol output report\n");
+    test_stats.failures++;
+  }
+  (void)test_ll_control(&hUsbDeviceFS, 0x21U, USBD_HID_REQ_SET_PROTOCOL, HID_REPORT_PROTOCOL, 0U, NULL, 0U);
+
+  /* A new configuration starts with the LEDs off */
+  if ((test_ll_enumerate(&hUsbDeviceFS, &USBD_HID) != 0) || (keyboard_get_leds() != 0U))
+  {
+    printf("test: led: LEDs 0x%02X after re-enumeration\n", keyboard_get_leds());
+    test_stats.failures++;
+  }
+
+  printf("test: led: output reports on the OUT endpoint and on EP0, report and boot protocol%s\n",
+         (test_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Send an output report on the OUT endpoint.
+  * @param  report: output report
+  * @param  len: its length
+  * @param  leds: LED state expected afterwards
+  * @retval 0 if the state matches and the endpoint was re-armed
+  */
+static uint32_t test_led_out(const uint8_t *report, uint32_t len, uint8_t leds)
+{
+  if (test_ll_out(&hUsbDeviceFS, HID_EPOUT_ADDR, report, len) != (int32_t)len)
+  {
+    return 1U;
+  }
+
+  return ((keyboard_get_leds() == leds) && (test_ep_out[HID_EPOUT_ADDR].armed != 0U) &&
+          (test_ep_out[HID_EPOUT_ADDR].len == HID_EPOUT_SIZE)) ? 0U : 1U;
+}
+
+/**
+  * @brief  Read the configuration descriptor as the host and find the OUT endpoint.
+  * @retval 0 if the interface declares 2 endpoints, one of them interrupt OUT HID_EPOUT_ADDR
+  */
+static uint32_t test_led_desc(void)
+{
+  uint8_t cfg[TEST_LED_CFG_MAX];
+  uint32_t found = 0U;
+  int32_t len;
+  int32_t pos;
+
+  len = test_ll_control(&hUsbDeviceFS, 0x80U, USB_REQ_GET_DESCRIPTOR, (uint16_t)(USB_DESC_TYPE_CONFIGURATION << 8),
+                        0U, cfg, sizeof(cfg));
+  if ((len < 4) || (len != (int32_t)(cfg[2] | ((uint16_t)cfg[3] << 8))))
+  {
+    return 1U;
+  }
+
+  for (pos = 0; (pos + 1) < len; pos += cfg[pos])
+  {
+    if (cfg[pos] == 0U)
+    {
+      return 1U;
+    }
+    if ((cfg[pos + 1] == USB_DESC_TYPE_INTERFACE) && ((pos + 4) < len) && (cfg[pos + 4] != 2U))
+    {
+      return 1U;
+    }
+    if ((cfg[pos + 1] == USB_DESC_TYPE_ENDPOINT) && ((pos + 6) < len) && (cfg[pos + 2] == HID_EPOUT_ADDR) &&
+        (cfg[pos + 3] == USBD_EP_TYPE_INTR) && (cfg[pos + 4] == HID_EPOUT_SIZE))
+    {
+      found = 1U;
+    }
+  }
+
+  return (found != 0U) ? 0U : 1U;
+}
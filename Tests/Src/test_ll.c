@@ -0,0 +1,409 @@
+/**
+  ******************************************************************************
+  * @file           : test_ll.c
+  * @brief          : Stub USBD_LL_* driver for the host unit tests
+  ******************************************************************************
+  * Every transfer the device starts is only recorded: the test plays the host
+  * and completes it with test_ll_in(), test_ll_out(), test_ll_control() or
+  * test_ll_control_out(), which raise the same data stage callbacks as
+  * HAL_PCD_IRQHandler(). Nothing is timed, a transfer stays armed until the
+  * test takes it.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+#include "usbd_ctlreq.h"
+
+/* Exported variables --------------------------------------------------------*/
+test_stats_t test_stats;
+test_ep_t test_ep_in[16];
+test_ep_t test_ep_out[16];
+
+/* Private variables ---------------------------------------------------------*/
+/* One class handle at a time, like USBD_static_malloc in usbd_conf.c */
+static uint32_t test_mem[(4096U / 4U)];
+
+/**
+  * @brief  Forget every endpoint.
+  * @retval None
+  */
+void test_ll_reset(void)
+{
+  memset(test_ep_in, 0, sizeof(test_ep_in));
+  memset(test_ep_out, 0, sizeof(test_ep_out));
+}
+
+/**
+  * @brief  Take the transfer armed on an IN endpoint, as the host's IN token.
+  * @param  pdev: device instance
+  * @param  ep_addr: endpoint address
+  * @param  data: receives the packet
+  * @param  max: size of data
+  * @retval packet length, TEST_LL_NAK or TEST_LL_STALL
+  */
+int32_t test_ll_in(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *data, uint32_t max)
+{
+  test_ep_t *ep = &test_ep_in[ep_addr & 0xFU];
+  uint32_t len;
+
+  if (ep->stalled != 0U)
+  {
+    return TEST_LL_STALL;
+  }
+  if (ep->armed == 0U)
+  {
+    return TEST_LL_NAK;
+  }
+
+  len = MIN(ep->len, max);
+  memcpy(data, ep->buf, len);
+  ep->armed = 0U;
+  (void)USBD_LL_DataInStage(pdev, ep_addr & 0x7FU, ep->buf);
+
+  return (int32_t)len;
+}
+
+/**
+  * @brief  Fill the transfer armed on an OUT endpoint, as the host's OUT token.
+  * @param  pdev: device instance
+  * @param  ep_addr: endpoint address
+  * @param  data: the packet
+  * @param  len: packet length
+  * @retval bytes the device took, TEST_LL_NAK or TEST_LL_STALL
+  */
+int32_t test_ll_out(USBD_HandleTypeDef *pdev, uint8_t ep_addr, const uint8_t *data, uint32_t len)
+{
+  test_ep_t *ep = &test_ep_out[ep_addr & 0xFU];
+
+  if (ep->stalled != 0U)
+  {
+    return TEST_LL_STALL;
+  }
+  if (ep->armed == 0U)
+  {
+    return TEST_LL_NAK;
+  }
+
+  len = MIN(len, ep->len);
+  memcpy(ep->rx, data, len);
+  ep->len = len;
+  ep->armed = 0U;
+  (void)USBD_LL_DataOutStage(pdev, ep_addr & 0x7FU, ep->rx);
+
+  return (int32_t)len;
+}
+
+/**
+  * @brief  Run one control transfer without an OUT data stage.
+  * @param  pdev: device instance
+  * @param  bm_request: bmRequestType
+  * @param  request: bRequest
+  * @param  value: wValue
+  * @param  index: wIndex
+  * @param  data: receives the IN data stage, may be NULL when length is 0
+  * @param  length: wLength
+  * @retval bytes of the data stage, or TEST_LL_STALL
+  */
+int32_t test_ll_control(USBD_HandleTypeDef *pdev, uint8_t bm_request, uint8_t request, uint16_t value,
+                        uint16_t index, uint8_t *data, uint16_t length)
+{
+  uint8_t setup[8];
+  uint8_t packet[USB_MAX_EP0_SIZE];
+  uint32_t done = 0U;
+  int32_t n;
+
+  setup[0] = bm_request;
+  setup[1] = request;
+  setup[2] = LOBYTE(value);
+  setup[3] = HIBYTE(value);
+  setup[4] = LOBYTE(index);
+  setup[5] = HIBYTE(index);
+  setup[6] = LOBYTE(length);
+  setup[7] = HIBYTE(length);
+
+  /* A SETUP token clears the EP0 stall */
+  test_ep_in[0].stalled = 0U;
+  test_ep_out[0].stalled = 0U;
+  (void)USBD_LL_SetupStage(pdev, setup);
+  if ((test_ep_in[0].stalled != 0U) && (test_ep_in[0].armed == 0U))
+  {
+    return TEST_LL_STALL;
+  }
+
+  if (((bm_request & 0x80U) != 0U) && (length != 0U))
+  {
+    /* Data stage: packets until a short one or wLength */
+    do
+    {
+      n = test_ll_in(pdev, 0x80U, packet, sizeof(packet));
+      if (n < 0)
+      {
+        return n;
+      }
+      memcpy(&data[done], packet, MIN((uint32_t)n, (uint32_t)length - done));
+      done += (uint32_t)n;
+    } while ((n == (int32_t)USB_MAX_EP0_SIZE) && (done < length));
+
+    /* Status stage: zero-length OUT */
+    (void)USBD_LL_DataOutStage(pdev, 0U, NULL);
+  }
+  else
+  {
+    /* Status stage: zero-length IN */
+    n = test_ll_in(pdev, 0x80U, packet, sizeof(packet));
+    if (n < 0)
+    {
+      return TEST_LL_STALL;
+    }
+  }
+
+  return (int32_t)done;
+}
+
+/**
+  * @brief  Run one control transfer with an OUT data stage.
+  * @param  pdev: device instance
+  * @param  bm_request: bmRequestType
+  * @param  request: bRequest
+  * @param  value: wValue
+  * @param  index: wIndex
+  * @param  data: the OUT data stage
+  * @param  length: wLength
+  * @retval bytes the device took, or TEST_LL_STALL
+  */
+int32_t test_ll_control_out(USBD_HandleTypeDef *pdev, uint8_t bm_request, uint8_t request, uint16_t value,
+                            uint16_t index, const uint8_t *data, uint16_t length)
+{
+  uint8_t setup[8];
+  uint8_t packet[USB_MAX_EP0_SIZE];
+  test_ep_t *ep = &test_ep_out[0];
+  uint32_t done = 0U;
+  uint32_t n;
+
+  setup[0] = bm_request;
+  setup[1] = request;
+  setup[2] = LOBYTE(value);
+  setup[3] = HIBYTE(value);
+  setup[4] = LOBYTE(index);
+  setup[5] = HIBYTE(index);
+  setup[6] = LOBYTE(length);
+  setup[7] = HIBYTE(length);
+
+  test_ep_in[0].stalled = 0U;
+  test_ep_out[0].stalled = 0U;
+  ep->armed = 0U;
+  (void)USBD_LL_SetupStage(pdev, setup);
+  if (ep->stalled != 0U)
+  {
+    return TEST_LL_STALL;
+  }
+
+  /* Data stage: one packet per PrepareReceive, into the buffer the device gave */
+  while ((done < length) && (ep->armed != 0U))
+  {
+    n = MIN((uint32_t)length - done, (uint32_t)USB_MAX_EP0_SIZE);
+    n = MIN(n, ep->len);
+    memcpy(ep->rx, &data[done], n);
+    done += n;
+    ep->armed = 0U;
+    ep->len = n;
+    (void)USBD_LL_DataOutStage(pdev, 0U, ep->rx);
+    if (ep->stalled != 0U)
+    {
+      return TEST_LL_STALL;
+    }
+  }
+
+  /* Status stage: zero-length IN */
+  if (test_ll_in(pdev, 0x80U, packet, sizeof(packet)) < 0)
+  {
+    return TEST_LL_STALL;
+  }
+
+  return (int32_t)done;
+}
+
+/**
+  * @brief  Bring a device up to the configured state like a host would.
+  * @param  pdev: device instance
+  * @param  pclass: class to register
+  * @retval 0, or -1 when a request failed
+  */
+int32_t test_ll_enumerate(USBD_HandleTypeDef *pdev, USBD_ClassTypeDef *pclass)
+{
+  test_ll_reset();
+  memset(pdev, 0, sizeof(*pdev));
+  if ((USBD_Init(pdev, NULL, DEVICE_FS) != USBD_OK) || (USBD_RegisterClass(pdev, pclass) != USBD_OK) ||
+      (USBD_Start(pdev) != USBD_OK))
+  {
+    return -1;
+  }
+
+  (void)USBD_LL_SetSpeed(pdev, USBD_SPEED_FULL);
+  (void)USBD_LL_Reset(pdev);
+  if ((test_ll_control(pdev, 0x00U, USB_REQ_SET_ADDRESS, 1U, 0U, NULL, 0U) < 0) ||
+      (test_ll_control(pdev, 0x00U, USB_REQ_SET_CONFIGURATION, 1U, 0U, NULL, 0U) < 0) ||
+      (pdev->dev_state != USBD_STATE_CONFIGURED))
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+/* USB device library low level driver ---------------------------------------*/
+USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_DeInit(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_Start(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_Stop(USBD_HandleTypeDef *pdev)
+{
+  UNUSED(pdev);
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_OpenEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t ep_type, uint16_t ep_mps)
+{
+  test_ep_t *ep = ((ep_addr & 0x80U) != 0U) ? &test_ep_in[ep_addr & 0xFU] : &test_ep_out[ep_addr & 0xFU];
+
+  UNUSED(pdev);
+  ep->open = 1U;
+  ep->armed = 0U;
+  ep->stalled = 0U;
+  ep->type = ep_type;
+  ep->mps = ep_mps;
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_CloseEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  test_ep_t *ep = ((ep_addr & 0x80U) != 0U) ? &test_ep_in[ep_addr & 0xFU] : &test_ep_out[ep_addr & 0xFU];
+
+  UNUSED(pdev);
+  ep->open = 0U;
+  ep->armed = 0U;
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_FlushEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  UNUSED(pdev);
+  UNUSED(ep_addr);
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_StallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  UNUSED(pdev);
+  if ((ep_addr & 0x80U) != 0U)
+  {
+    test_ep_in[ep_addr & 0xFU].stalled = 1U;
+  }
+  else
+  {
+    test_ep_out[ep_addr & 0xFU].stalled = 1U;
+  }
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_ClearStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  UNUSED(pdev);
+  if ((ep_addr & 0x80U) != 0U)
+  {
+    test_ep_in[ep_addr & 0xFU].stalled = 0U;
+  }
+  else
+  {
+    test_ep_out[ep_addr & 0xFU].stalled = 0U;
+  }
+  return USBD_OK;
+}
+
+uint8_t USBD_LL_IsStallEP(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  UNUSED(pdev);
+  return ((ep_addr & 0x80U) != 0U) ? test_ep_in[ep_addr & 0xFU].stalled : test_ep_out[ep_addr & 0xFU].stalled;
+}
+
+USBD_StatusTypeDef USBD_LL_SetUSBAddress(USBD_HandleTypeDef *pdev, uint8_t dev_addr)
+{
+  UNUSED(pdev);
+  UNUSED(dev_addr);
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_Transmit(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf, uint32_t size)
+{
+  test_ep_t *ep = &test_ep_in[ep_addr & 0xFU];
+  uint32_t len = MIN(size, (uint32_t)sizeof(ep->buf));
+
+  UNUSED(pdev);
+  if (len != 0U)
+  {
+    memcpy(ep->buf, pbuf, len);
+  }
+  ep->len = len;
+  ep->armed = 1U;
+  ep->transfers++;
+  return USBD_OK;
+}
+
+USBD_StatusTypeDef USBD_LL_PrepareReceive(USBD_HandleTypeDef *pdev, uint8_t ep_addr, uint8_t *pbuf,
+                                          uint32_t size)
+{
+  test_ep_t *ep = &test_ep_out[ep_addr & 0xFU];
+
+  UNUSED(pdev);
+  ep->rx = pbuf;
+  ep->len = size;
+  ep->armed = 1U;
+  ep->transfers++;
+  return USBD_OK;
+}
+
+uint32_t USBD_LL_GetRxDataSize(USBD_HandleTypeDef *pdev, uint8_t ep_addr)
+{
+  UNUSED(pdev);
+  return test_ep_out[ep_addr & 0xFU].len;
+}
+
+void USBD_LL_Delay(uint32_t Delay)
+{
+  UNUSED(Delay);
+}
+
+/**
+  * @brief  Static single allocation, as in usbd_conf.c.
+  * @param  size: size of allocated memory
+  * @retval None
+  */
+void *USBD_static_malloc(uint32_t size)
+{
+  return (size <= sizeof(test_mem)) ? test_mem : NULL;
+}
+
+/**
+  * @brief  Dummy memory free, as in usbd_conf.c.
+  * @param  p: pointer to allocated memory address
+  * @retval None
+  */
+void USBD_static_free(void *p)
+{
+  UNUSED(p);
+}
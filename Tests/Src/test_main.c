@@ -0,0 +1,35 @@
+/**
+  ******************************************************************************
+  * @file           : test_main.c
+  * @brief          : Host unit test runner
+  ******************************************************************************
+  * Runs every suite in turn. Each suite prints one line of results, and a
+  * line per failed expectation; the exit status is 0 only when every
+  * expectation was met.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+
+/**
+  * @brief  Run the suites.
+  * @retval 0 on success, 1 if any expectation failed
+  */
+int main(void)
+{
+  test_hid_queue();
+  test_keyboard();
+  test_poll_interval();
+  test_hid_keyboard();
+  test_matrix();
+  test_debounce();
+  test_idle();
+  test_feature();
+  test_led();
+  test_controls();
+
+  printf("test: %s\n", (test_stats.failures == 0U) ? "PASS" : "FAIL");
+
+  return (test_stats.failures == 0U) ? 0 : 1;
+}
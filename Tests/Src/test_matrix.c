@@ -0,0 +1,192 @@
+/**
+  ******************************************************************************
+  * @file           : test_matrix.c
+  * @brief          : Unit test of the matrix snapshot decoding
+  ******************************************************************************
+  * matrix.c is fed recorded row port snapshots, one per strobed column, as
+  * the DMA leaves them in the sample buffer: rows read low when pressed and
+  * the port bits outside the rows carry noise. Fixed scans pin down the
+  * bitmap layout and the ghosting rule, random scans are checked against a
+  * plain reference: a scan is ghosted when two columns share two pressed
+  * rows, and a ghosted scan leaves the previous bitmap untouched.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+#include "matrix.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_MATRIX_RANDOM_RUNS   100000U
+#define TEST_MATRIX_NOISE         ((uint16_t)~(MATRIX_ROW_MASK << MATRIX_ROW_SHIFT))
+
+/* Private typedef -----------------------------------------------------------*/
+/* A recorded scan: pressed rows of each column, and the expected verdict */
+typedef struct
+{
+  const char *name;
+  uint8_t     rows[MATRIX_COLS];
+  uint8_t     ghosted;
+} test_matrix_case_t;
+
+/* Private variables ---------------------------------------------------------*/
+static const test_matrix_case_t test_matrix_cases[] =
+{
+  { "no key",                       { 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U }, 0U },
+  { "col 3 row 5",                  { 0x00U, 0x00U, 0x00U, 0x20U, 0x00U, 0x00U, 0x00U, 0x00U }, 0U },
+  { "first and last key",           { 0x01U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x80U }, 0U },
+  { "whole column",                 { 0x00U, 0x00U, 0xFFU, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U }, 0U },
+  { "whole row",                    { 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U, 0x10U }, 0U },
+  { "one shared row",               { 0x00U, 0x14U, 0x00U, 0x00U, 0x00U, 0x00U, 0x05U, 0x00U }, 0U },
+  { "diagonal",                     { 0x01U, 0x02U, 0x04U, 0x08U, 0x10U, 0x20U, 0x40U, 0x80U }, 0U },
+  { "rectangle",                    { 0x00U, 0x14U, 0x00U, 0x00U, 0x00U, 0x00U, 0x14U, 0x00U }, 1U },
+  { "rectangle in a wider chord",   { 0x00U, 0x15U, 0x00U, 0x01U, 0x00U, 0x00U, 0x54U, 0x00U }, 1U },
+  { "adjacent columns",             { 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0x00U, 0xC0U, 0xC0U }, 1U },
+  { "all keys",                     { 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU }, 1U },
+};
+
+static uint32_t test_matrix_seed = 1U;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t test_matrix_random(void);
+static void test_matrix_snapshots(const uint8_t *rows, uint16_t *samples, uint16_t noise);
+static uint32_t test_matrix_check(const uint8_t *rows, uint16_t noise, int32_t ghosted);
+
+/**
+  * @brief  Decode the recorded scans, then random ones.
+  * @retval None
+  */
+void test_matrix(void)
+{
+  uint32_t failures = test_stats.failures;
+  uint8_t rows[MATRIX_COLS];
+  uint32_t ghosted = 0U;
+  uint32_t keys;
+  uint32_t run;
+  uint32_t col;
+  uint32_t i;
+
+  for (i = 0U; i < (sizeof(test_matrix_cases) / sizeof(test_matrix_cases[0])); i++)
+  {
+    if ((test_matrix_check(test_matrix_cases[i].rows, 0U, (int32_t)test_matrix_cases[i].ghosted) != 0U) ||
+        (test_matrix_check(test_matrix_cases[i].rows, TEST_MATRIX_NOISE, (int32_t)test_matrix_cases[i].ghosted) != 0U))
+    {
+      printf("test: matrix: %s\n", test_matrix_cases[i].name);
+      test_stats.failures++;
+    }
+  }
+
+  /* Chords of 1 to 8 keys, the reference decides on ghosting */
+  for (run = 0U; run < TEST_MATRIX_RANDOM_RUNS; run++)
+  {
+    for (col = 0U; col < MATRIX_COLS; col++)
+    {
+      rows[col] = 0U;
+    }
+    for (keys = 1U + (test_matrix_random() % 8U); keys > 0U; keys--)
+    {
+      rows[test_matrix_random() % MATRIX_COLS] |= (uint8_t)(1U << (test_matrix_random() % MATRIX_ROWS));
+    }
+
+    if (test_matrix_check(rows, (uint16_t)test_matrix_random(), -1) != 0U)
+    {
+      printf("test: matrix: random scan %lu\n", (unsigned long)run);
+      test_stats.failures++;
+      break;
+    }
+    for (col = 1U; col < MATRIX_COLS; col++)
+    {
+      for (i = 0U; i < col; i++)
+      {
+        keys = (uint32_t)(rows[col] & rows[i]);
+        ghosted += (((keys & (keys - 1U)) != 0U) ? 1U : 0U);
+      }
+    }
+  }
+
+  printf("test: matrix: %lu recorded and %lu random scans, %lu column pairs ghosted%s\n",
+         (unsigned long)(sizeof(test_matrix_cases) / sizeof(test_matrix_cases[0])),
+         (unsigned long)TEST_MATRIX_RANDOM_RUNS, (unsigned long)ghosted,
+         (test_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Decode one scan and compare it with the reference.
+  * @param  rows: pressed rows of each column, bit 0 is row 0
+  * @param  noise: levels of the port bits outside the rows
+  * @param  ghosted: expected verdict, or -1 to let the reference decide
+  * @retval 0 if the decoder agrees
+  */
+static uint32_t test_matrix_check(const uint8_t *rows, uint16_t noise, int32_t ghosted)
+{
+  uint16_t samples[MATRIX_COLS];
+  matrix_bitmap_t state;
+  uint32_t common;
+  uint32_t key;
+  uint32_t col;
+  uint32_t i;
+
+  if (ghosted < 0)
+  {
+    ghosted = 0;
+    for (col = 1U; col < MATRIX_COLS; col++)
+    {
+      for (i = 0U; i < col; i++)
+      {
+        common = (uint32_t)(rows[col] & rows[i]);
+        ghosted |= ((common & (common - 1U)) != 0U) ? 1 : 0;
+      }
+    }
+  }
+
+  test_matrix_snapshots(rows, samples, noise);
+  for (i = 0U; i < MATRIX_WORDS; i++)
+  {
+    state.bits[i] = 0xA5A5A5A5U;
+  }
+
+  if ((matrix_has_ghost(samples) != (uint8_t)ghosted) || (matrix_decode(samples, &state) != (uint8_t)ghosted))
+  {
+    return 1U;
+  }
+
+  for (key = 0U; key < MATRIX_KEYS; key++)
+  {
+    col = key / MATRIX_ROWS;
+    if (matrix_key_is_down(&state, key) !=
+        ((ghosted != 0) ? ((0xA5A5A5A5U >> (key & 0x1FU)) & 1U) : ((rows[col] >> (key % MATRIX_ROWS)) & 1U)))
+    {
+      return 1U;
+    }
+  }
+
+  return 0U;
+}
+
+/**
+  * @brief  Build the row port snapshots of a scan: pressed rows read low.
+  * @param  rows: pressed rows of each column
+  * @param  samples: receives MATRIX_COLS snapshots
+  * @param  noise: levels of the port bits outside the rows
+  * @retval None
+  */
+static void test_matrix_snapshots(const uint8_t *rows, uint16_t *samples, uint16_t noise)
+{
+  uint32_t col;
+
+  for (col = 0U; col < MATRIX_COLS; col++)
+  {
+    samples[col] = (uint16_t)((noise & TEST_MATRIX_NOISE) |
+                              (((~(uint32_t)rows[col]) & MATRIX_ROW_MASK) << MATRIX_ROW_SHIFT));
+  }
+}
+
+/**
+  * @brief  Linear congruential generator, repeatable across runs.
+  * @retval next pseudo-random value
+  */
+static uint32_t test_matrix_random(void)
+{
+  test_matrix_seed = (test_matrix_seed * 1664525U) + 1013904223U;
+  return test_matrix_seed >> 8;
+}
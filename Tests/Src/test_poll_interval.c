@@ -0,0 +1,145 @@
+/**
+  ******************************************************************************
+  * @file           : test_poll_interval.c
+  * @brief          : Unit test of the selectable HID polling interval
+  ******************************************************************************
+  * For each interval the device is set up with USBD_HID_SetPollingInterval()
+  * and enumerated again. The configuration descriptor the host reads back
+  * must carry it in the IN endpoint bInterval, USBD_HID_GetPollingInterval()
+  * must return it, and a host polling at that interval with one report
+  * always pending must see 1000 / bInterval reports a second.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "test.h"
+#include "usbd_hid.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TEST_POLL_REPORT_LEN      8U
+#define TEST_POLL_RUN_MS          1000U
+#define TEST_POLL_CFG_MAX         255U
+
+/* Private variables ---------------------------------------------------------*/
+static USBD_HandleTypeDef test_dev;
+
+static const uint8_t test_poll_valid[] = { 1U, 2U, 4U, 8U, 10U };
+static const uint8_t test_poll_invalid[] = { 0U, 3U, 5U, 16U, 255U };
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t test_poll_desc_interval(void);
+static uint32_t test_poll_rate(uint32_t interval);
+
+/**
+  * @brief  Enumerate at every supported interval and refuse the others.
+  * @retval None
+  */
+void test_poll_interval(void)
+{
+  uint32_t failures = test_stats.failures;
+  uint32_t interval;
+  uint32_t reports;
+  int32_t desc;
+  uint32_t i;
+
+  for (i = 0U; i < sizeof(test_poll_valid); i++)
+  {
+    interval = test_poll_valid[i];
+    if ((USBD_HID_SetPollingInterval(&test_dev, (uint8_t)interval) != (uint8_t)USBD_OK) ||
+        (test_ll_enumerate(&test_dev, &USBD_HID) != 0))
+    {
+      printf("test: poll interval: %lu ms: not accepted\n", (unsigned long)interval);
+      test_stats.failures++;
+      continue;
+    }
+
+    desc = test_poll_desc_interval();
+    if ((desc != (int32_t)interval) || (USBD_HID_GetPollingInterval(&test_dev) != interval))
+    {
+      printf("test: poll interval: %lu ms: descriptor bInterval %ld, USBD_HID_GetPollingInterval %lu\n",
+             (unsigned long)interval, (long)desc, (unsigned long)USBD_HID_GetPollingInterval(&test_dev));
+      test_stats.failures++;
+    }
+
+    reports = test_poll_rate(interval);
+    if (reports != (TEST_POLL_RUN_MS / interval))
+    {
+      printf("test: poll interval: %lu ms: %lu reports a second\n", (unsigned long)interval,
+             (unsigned long)reports);
+      test_stats.failures++;
+    }
+  }
+
+  /* Any other interval is refused and leaves the last one in place */
+  for (i = 0U; i < sizeof(test_poll_invalid); i++)
+  {
+    if ((USBD_HID_SetPollingInterval(&test_dev, test_poll_invalid[i]) != (uint8_t)USBD_FAIL) ||
+        (USBD_HID_GetPollingInterval(&test_dev) != interval))
+    {
+      printf("test: poll interval: %u ms accepted\n", test_poll_invalid[i]);
+      test_stats.failures++;
+    }
+  }
+
+  (void)USBD_HID_SetPollingInterval(&test_dev, HID_FS_BINTERVAL);
+
+  printf("test: poll interval: 1, 2, 4, 8 and 10 ms enumerated at 1000 / bInterval reports a second, "
+         "other intervals refused%s\n", (test_stats.failures != failures) ? " (FAILED)" : "");
+}
+
+/**
+  * @brief  Read the configuration descriptor as the host and find the IN endpoint.
+  * @retval bInterval of the HID IN endpoint, or -1 if it is missing
+  */
+static int32_t test_poll_desc_interval(void)
+{
+  uint8_t cfg[TEST_POLL_CFG_MAX];
+  int32_t len;
+  int32_t pos;
+
+  len = test_ll_control(&test_dev, 0x80U, USB_REQ_GET_DESCRIPTOR, (uint16_t)(USB_DESC_TYPE_CONFIGURATION << 8),
+                        0U, cfg, sizeof(cfg));
+
+  for (pos = 0; (pos + 1) < len; pos += cfg[pos])
+  {
+    if (cfg[pos] == 0U)
+    {
+      break;
+    }
+    if ((cfg[pos + 1] == USB_DESC_TYPE_ENDPOINT) && ((pos + 6) < len) && (cfg[pos + 2] == HID_EPIN_ADDR))
+    {
+      return (int32_t)cfg[pos + 6];
+    }
+  }
+
+  return -1;
+}
+
+/**
+  * @brief  Keep a report pending and poll the IN endpoint every interval for one second.
+  * @param  interval: host polling interval in ms
+  * @retval reports the host received
+  */
+static uint32_t test_poll_rate(uint32_t interval)
+{
+  uint8_t report[TEST_POLL_REPORT_LEN] = { 0x01U };
+  uint8_t packet[TEST_POLL_REPORT_LEN];
+  uint32_t reports = 0U;
+  uint32_t ms;
+
+  for (ms = 0U; ms < TEST_POLL_RUN_MS; ms++)
+  {
+    /* The application always has the next report ready, a new one every time */
+    report[1] = (uint8_t)ms;
+    report[2] = (uint8_t)(ms >> 8);
+    (void)USBD_HID_SendReport(&test_dev, report, sizeof(report));
+
+    if (((ms % interval) == 0U) &&
+        (test_ll_in(&test_dev, HID_EPIN_ADDR, packet, sizeof(packet)) == (int32_t)TEST_POLL_REPORT_LEN))
+    {
+      reports++;
+    }
+  }
+
+  return reports;
+}
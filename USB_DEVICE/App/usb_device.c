@@ -24,6 +24,12 @@
 #include "usbd_core.h"
 #include "usbd_desc.h"
 #include "usbd_hid.h"
+#include "usbd_hid_if.h"
+#if (USBD_CDC_CONSOLE == 1U)
+#include "usbd_cdc.h"
+#include "usbd_cdc_if.h"
+#include "usbd_composite_builder.h"
+#endif /* USBD_CDC_CONSOLE */
 
 /* USER CODE BEGIN Includes */
 
@@ -42,6 +48,16 @@
 /* USB Device Core handle declaration. */
 USBD_HandleTypeDef hUsbDeviceFS;
 
+#if (USBD_CDC_CONSOLE == 1U)
+/* Class IDs of the composite device, for the calls that take one */
+uint8_t HID_InstID = 0U;
+uint8_t CDC_InstID = 0U;
+
+/* Endpoints of each class, in the order IN, OUT, command */
+static uint8_t HID_EpAdd_Inst[2] = {HID_EPIN_ADDR, HID_EPOUT_ADDR};
+static uint8_t CDC_EpAdd_Inst[3] = {CDC_IN_EP, CDC_OUT_EP, CDC_CMD_EP};
+#endif /* USBD_CDC_CONSOLE */
+
 /*
  * -- Insert your variables declaration here --
  */
@@ -71,10 +87,46 @@ void MX_USB_DEVICE_Init(void)
   {
     Error_Handler();
   }
+#if (USBD_CDC_CONSOLE == 1U)
+  /* Store the HID class ID and register it */
+  HID_InstID = (uint8_t)hUsbDeviceFS.classId;
+  if (USBD_RegisterClassComposite(&hUsbDeviceFS, USBD_HID_CLASS, CLASS_TYPE_HID, HID_EpAdd_Inst) != USBD_OK)
+  {
+    Error_Handler();
+  }
+
+  /* Store the CDC class ID and register it */
+  CDC_InstID = (uint8_t)hUsbDeviceFS.classId;
+  if (USBD_RegisterClassComposite(&hUsbDeviceFS, USBD_CDC_CLASS, CLASS_TYPE_CDC, CDC_EpAdd_Inst) != USBD_OK)
+  {
+    Error_Handler();
+  }
+
+  /* Each interface callback table goes to the class selected just before */
+  if (USBD_CMPSIT_SetClassID(&hUsbDeviceFS, CLASS_TYPE_HID, 0) != 0xFFU)
+  {
+    if (USBD_HID_RegisterInterface(&hUsbDeviceFS, &USBD_HID_fops_FS) != USBD_OK)
+    {
+      Error_Handler();
+    }
+  }
+  if (USBD_CMPSIT_SetClassID(&hUsbDeviceFS, CLASS_TYPE_CDC, 0) != 0xFFU)
+  {
+    if (USBD_CDC_RegisterInterface(&hUsbDeviceFS, &USBD_CDC_fops_FS) != USBD_OK)
+    {
+      Error_Handler();
+    }
+  }
+#else
   if (USBD_RegisterClass(&hUsbDeviceFS, &USBD_HID) != USBD_OK)
   {
     Error_Handler();
   }
+  if (USBD_HID_RegisterInterface(&hUsbDeviceFS, &USBD_HID_fops_FS) != USBD_OK)
+  {
+    Error_Handler();
+  }
+#endif /* USBD_CDC_CONSOLE */
   if (USBD_Start(&hUsbDeviceFS) != USBD_OK)
   {
     Error_Handler();
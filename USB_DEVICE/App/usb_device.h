@@ -63,6 +63,11 @@
  * -- Insert your variables declaration here --
  */
 /* USER CODE BEGIN VARIABLES */
+#if (USBD_CDC_CONSOLE == 1U)
+/** Class IDs of the composite device */
+extern uint8_t HID_InstID;
+extern uint8_t CDC_InstID;
+#endif /* USBD_CDC_CONSOLE */
 
 /* USER CODE END VARIABLES */
 /**
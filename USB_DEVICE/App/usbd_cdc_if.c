@@ -0,0 +1,228 @@
+/**
+  ******************************************************************************
+  * @file           : usbd_cdc_if.c
+  * @brief          : USB Device CDC interface: the log stream console
+  ******************************************************************************
+  * The bulk IN endpoint carries log_stream.c to the host. Transfers start
+  * from the USB interrupt only, on the SOF after the endpoint went idle and
+  * again as soon as a transfer completes, so writers never wait on USB and
+  * the log never takes the HID IN endpoint's turn. Nothing is sent until a
+  * terminal opens the port (DTR set); until then the ring fills and newer
+  * records are dropped and counted.
+  *
+  * Data received on the bulk OUT endpoint is UTF-8 text typed on the HID
+  * keyboard by typing.c. The endpoint is only armed while the text buffer
+  * has room for a whole packet; otherwise the host is NAKed until the
+  * typing has caught up, checked again on the same SOF and IN completion
+  * events that drive the transmit side.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_cdc_if.h"
+#include "usb_device.h"
+#include "log_stream.h"
+#include "typing.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t CDC_Init_FS(void);
+static int8_t CDC_DeInit_FS(void);
+static int8_t CDC_Control_FS(uint8_t cmd, uint8_t *pbuf, uint16_t length);
+static int8_t CDC_Receive_FS(uint8_t *Buf, uint32_t *Len);
+static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum);
+static void CDC_TransmitIdle_FS(void);
+static void CDC_Transmit_Next(void);
+static int8_t CDC_Receive_Next(void);
+
+/* Private variables ---------------------------------------------------------*/
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+static uint8_t CDC_RxBuffer[CDC_DATA_FS_OUT_PACKET_SIZE];
+static uint8_t CDC_TxBuffer[CDC_DATA_FS_IN_PACKET_SIZE];
+
+/* Only echoed back by GET_LINE_CODING: the stream has no baud rate */
+static USBD_CDC_LineCodingTypeDef CDC_LineCoding =
+{
+  115200U,
+  0x00U,
+  0x00U,
+  0x08U,
+};
+
+static uint8_t CDC_LineState;
+static uint8_t CDC_RxParked;             /* OUT endpoint left unarmed, buffer full */
+
+/* Exported variables --------------------------------------------------------*/
+USBD_CDC_ItfTypeDef USBD_CDC_fops_FS =
+{
+  CDC_Init_FS,
+  CDC_DeInit_FS,
+  CDC_Control_FS,
+  CDC_Receive_FS,
+  CDC_TransmitCplt_FS,
+  CDC_TransmitIdle_FS,
+};
+
+/**
+  * @brief  Initialize the interface when the host selects the configuration.
+  * @retval USBD_OK if all operations are OK else USBD_FAIL
+  */
+static int8_t CDC_Init_FS(void)
+{
+  CDC_LineState = 0U;
+  CDC_RxParked = 0U;
+
+  return (int8_t)USBD_CDC_SetRxBuffer(&hUsbDeviceFS, CDC_RxBuffer);
+}
+
+/**
+  * @brief  DeInitialize the interface.
+  * @retval USBD_OK if all operations are OK else USBD_FAIL
+  */
+static int8_t CDC_DeInit_FS(void)
+{
+  CDC_LineState = 0U;
+
+  return (int8_t)USBD_OK;
+}
+
+/**
+  * @brief  Handle the CDC class requests.
+  * @param  cmd: request code
+  * @param  pbuf: data stage, or the setup request itself when there is none
+  * @param  length: data stage length
+  * @retval USBD_OK if all operations are OK else USBD_FAIL
+  */
+static int8_t CDC_Control_FS(uint8_t cmd, uint8_t *pbuf, uint16_t length)
+{
+  switch (cmd)
+  {
+    case CDC_SET_LINE_CODING:
+      if (length >= 7U)
+      {
+        CDC_LineCoding.bitrate = (uint32_t)pbuf[0] | ((uint32_t)pbuf[1] << 8) |
+                                 ((uint32_t)pbuf[2] << 16) | ((uint32_t)pbuf[3] << 24);
+        CDC_LineCoding.format = pbuf[4];
+        CDC_LineCoding.paritytype = pbuf[5];
+        CDC_LineCoding.datatype = pbuf[6];
+      }
+      break;
+
+    case CDC_GET_LINE_CODING:
+      pbuf[0] = (uint8_t)(CDC_LineCoding.bitrate);
+      pbuf[1] = (uint8_t)(CDC_LineCoding.bitrate >> 8);
+      pbuf[2] = (uint8_t)(CDC_LineCoding.bitrate >> 16);
+      pbuf[3] = (uint8_t)(CDC_LineCoding.bitrate >> 24);
+      pbuf[4] = CDC_LineCoding.format;
+      pbuf[5] = CDC_LineCoding.paritytype;
+      pbuf[6] = CDC_LineCoding.datatype;
+      break;
+
+    case CDC_SET_CONTROL_LINE_STATE:
+      CDC_LineState = (uint8_t)(((USBD_SetupReqTypedef *)(void *)pbuf)->wValue);
+      break;
+
+    default:
+      break;
+  }
+
+  return (int8_t)USBD_OK;
+}
+
+/**
+  * @brief  Data received on the bulk OUT endpoint: text to type.
+  * @note   The endpoint was armed with a packet of room in the text buffer,
+  *         so the whole packet fits.
+  * @param  Buf: received data
+  * @param  Len: received length
+  * @retval USBD_OK if all operations are OK else USBD_FAIL
+  */
+static int8_t CDC_Receive_FS(uint8_t *Buf, uint32_t *Len)
+{
+  (void)typing_write(Buf, *Len);
+  (void)USBD_CDC_SetRxBuffer(&hUsbDeviceFS, Buf);
+
+  return CDC_Receive_Next();
+}
+
+/**
+  * @brief  Bulk IN transfer complete: rearm a parked OUT endpoint, send the
+  *         next records at once.
+  * @param  Buf: sent data
+  * @param  Len: sent length
+  * @param  epnum: endpoint number
+  * @retval USBD_OK if all operations are OK else USBD_FAIL
+  */
+static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
+{
+  UNUSED(Buf);
+  UNUSED(Len);
+  UNUSED(epnum);
+
+  if (CDC_RxParked != 0U)
+  {
+    (void)CDC_Receive_Next();
+  }
+  CDC_Transmit_Next();
+
+  return (int8_t)USBD_OK;
+}
+
+/**
+  * @brief  SOF with the bulk IN endpoint idle: rearm a parked OUT endpoint,
+  *         send what was logged since.
+  * @retval None
+  */
+static void CDC_TransmitIdle_FS(void)
+{
+  if (CDC_RxParked != 0U)
+  {
+    (void)CDC_Receive_Next();
+  }
+  CDC_Transmit_Next();
+}
+
+/**
+  * @brief  Move whole records into one packet and start it.
+  * @note   USB interrupt only: it is the single reader of the log ring.
+  * @retval None
+  */
+static void CDC_Transmit_Next(void)
+{
+  uint32_t len;
+
+  if ((CDC_LineState & CDC_CONTROL_LINE_DTR) == 0U)
+  {
+    return;
+  }
+
+  len = log_read(CDC_TxBuffer, sizeof(CDC_TxBuffer));
+  if (len == 0U)
+  {
+    return;
+  }
+
+#ifdef USE_USBD_COMPOSITE
+  (void)USBD_CDC_SetTxBuffer(&hUsbDeviceFS, CDC_TxBuffer, len, CDC_InstID);
+  (void)USBD_CDC_TransmitPacket(&hUsbDeviceFS, CDC_InstID);
+#else
+  (void)USBD_CDC_SetTxBuffer(&hUsbDeviceFS, CDC_TxBuffer, len);
+  (void)USBD_CDC_TransmitPacket(&hUsbDeviceFS);
+#endif /* USE_USBD_COMPOSITE */
+}
+
+/**
+  * @brief  Arm the bulk OUT endpoint if the text buffer can take a packet.
+  * @retval USBD_OK if all operations are OK else USBD_FAIL
+  */
+static int8_t CDC_Receive_Next(void)
+{
+  if (typing_free() < CDC_DATA_FS_OUT_PACKET_SIZE)
+  {
+    CDC_RxParked = 1U;
+    return (int8_t)USBD_OK;
+  }
+
+  CDC_RxParked = 0U;
+  return (int8_t)USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+}
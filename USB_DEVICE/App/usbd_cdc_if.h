@@ -0,0 +1,26 @@
+/**
+  ******************************************************************************
+  * @file           : usbd_cdc_if.h
+  * @brief          : Header for usbd_cdc_if.c file.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_CDC_IF_H__
+#define __USBD_CDC_IF_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_cdc.h"
+
+/** CDC interface callbacks. */
+extern USBD_CDC_ItfTypeDef USBD_CDC_fops_FS;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_CDC_IF_H__ */
@@ -53,6 +53,12 @@
 
 /* USER CODE BEGIN EXPORTED_CONSTANTS */
 
+/* Strings the string descriptors are built from at compile time */
+#define USBD_MANUFACTURER_STRING          "STMicroelectronics"
+#define USBD_PRODUCT_STRING_FS            "STM32 Human interface"
+#define USBD_CONFIGURATION_STRING_FS      "HID Config"
+#define USBD_INTERFACE_STRING_FS          "HID Interface"
+
 /* USER CODE END EXPORTED_CONSTANTS */
 
 /**
@@ -0,0 +1,57 @@
+/**
+  ******************************************************************************
+  * @file           : usbd_hid_if.c
+  * @brief          : USB Device HID interface: feature reports to the
+  *                   runtime configuration table and the latency histograms
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_hid_if.h"
+#include "hid_config.h"
+#include "latency_trace.h"
+
+/* Private function prototypes -----------------------------------------------*/
+static int8_t HID_GetFeature_FS(uint8_t report_id, uint8_t *report, uint16_t *len);
+static int8_t HID_SetFeature_FS(uint8_t report_id, uint8_t *report, uint16_t len);
+
+/* Exported variables --------------------------------------------------------*/
+USBD_HID_ItfTypeDef USBD_HID_fops_FS =
+{
+  HID_GetFeature_FS,
+  HID_SetFeature_FS,
+};
+
+/**
+  * @brief  Build the feature report requested by GET_REPORT.
+  * @param  report_id: requested report ID
+  * @param  report: receives the report, ID included
+  * @param  len: buffer size in, report length out
+  * @retval USBD_OK if all operations are OK else USBD_FAIL
+  */
+static int8_t HID_GetFeature_FS(uint8_t report_id, uint8_t *report, uint16_t *len)
+{
+  if (report_id == LATENCY_TRACE_REPORT_ID)
+  {
+    return (latency_trace_get_feature(report, len) == 0) ? (int8_t)USBD_OK : (int8_t)USBD_FAIL;
+  }
+
+  return (hid_config_get_feature(report_id, report, len) == 0) ? (int8_t)USBD_OK : (int8_t)USBD_FAIL;
+}
+
+/**
+  * @brief  Handle the feature report received with SET_REPORT.
+  * @param  report_id: report ID from the request
+  * @param  report: report data, ID included
+  * @param  len: report length
+  * @retval USBD_OK if all operations are OK else USBD_FAIL
+  */
+static int8_t HID_SetFeature_FS(uint8_t report_id, uint8_t *report, uint16_t len)
+{
+  if (report_id == LATENCY_TRACE_REPORT_ID)
+  {
+    return (latency_trace_set_feature(report, len) == 0) ? (int8_t)USBD_OK : (int8_t)USBD_FAIL;
+  }
+
+  return (hid_config_set_feature(report_id, report, len) == 0) ? (int8_t)USBD_OK : (int8_t)USBD_FAIL;
+}
@@ -0,0 +1,26 @@
+/**
+  ******************************************************************************
+  * @file           : usbd_hid_if.h
+  * @brief          : Header for usbd_hid_if.c file.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_HID_IF_H__
+#define __USBD_HID_IF_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_hid.h"
+
+/** HID interface callbacks. */
+extern USBD_HID_ItfTypeDef USBD_HID_fops_FS;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_HID_IF_H__ */
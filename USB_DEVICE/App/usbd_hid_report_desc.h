@@ -0,0 +1,182 @@
+/**
+  ******************************************************************************
+  * @file           : usbd_hid_report_desc.h
+  * @brief          : Report descriptor of the keyboard, built at compile time
+  ******************************************************************************
+  * One list per report ID, written with the usbd_hid_desc.h builder. The
+  * descriptor served to the host, its length in the HID descriptors and the
+  * report lengths checked below all come from these lists, so a report
+  * encoder and the descriptor cannot drift apart without a build error.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __USBD_HID_REPORT_DESC_H__
+#define __USBD_HID_REPORT_DESC_H__
+
+#ifdef __cplusplus
+ extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "usbd_hid.h"
+#include "usbd_hid_desc.h"
+#include "hid_keyboard.h"
+#include "hid_controls.h"
+#include "hid_config.h"
+#include "latency_trace.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Vendor usage page of the configuration and latency trace reports */
+#define USBD_HID_VENDOR_PAGE          0xFF01U
+
+/* Last Keyboard/Keypad usage the keycode arrays carry, modifiers excluded */
+#define USBD_HID_KEYCODE_MAX          (HID_USAGE_MODIFIER_FIRST - 1U)
+
+/* Report ID 1: modifiers, OEM byte, 5 keycodes in, lock LEDs out */
+#define USBD_HID_KBD_6KRO_DESC(I, F)                                          \
+  I(HID_RD_USAGE_PAGE(HID_RD_PAGE_DESKTOP))                                   \
+  I(HID_RD_USAGE(HID_RD_USAGE_KEYBOARD))                                      \
+  I(HID_RD_COLLECTION(HID_RD_APPLICATION))                                    \
+  I(HID_RD_REPORT_ID(HID_KBD_6KRO_REPORT_ID))                                 \
+  I(HID_RD_USAGE_PAGE(HID_RD_PAGE_KEYBOARD))                                  \
+  I(HID_RD_USAGE_MIN(HID_USAGE_MODIFIER_FIRST))                               \
+  I(HID_RD_USAGE_MAX(HID_USAGE_MODIFIER_LAST))                                \
+  I(HID_RD_LOGICAL_MIN(0))                                                    \
+  I(HID_RD_LOGICAL_MAX(1))                                                    \
+  F(HID_RD_INPUT, HID_RD_DATA_VAR, 1U, 8U)                                    \
+  F(HID_RD_INPUT, HID_RD_CONST, 8U, 1U)                                       \
+  I(HID_RD_USAGE_PAGE(HID_RD_PAGE_LEDS))                                      \
+  I(HID_RD_USAGE_MIN(1U))                                                     \
+  I(HID_RD_USAGE_MAX(5U))                                                     \
+  F(HID_RD_OUTPUT, HID_RD_DATA_VAR, 1U, 5U)                                   \
+  F(HID_RD_OUTPUT, HID_RD_CONST, 3U, 1U)                                      \
+  I(HID_RD_USAGE_PAGE(HID_RD_PAGE_KEYBOARD))                                  \
+  I(HID_RD_USAGE_MIN(0U))                                                     \
+  I(HID_RD_USAGE_MAX(USBD_HID_KEYCODE_MAX))                                   \
+  I(HID_RD_LOGICAL_MAX16(USBD_HID_KEYCODE_MAX))                               \
+  F(HID_RD_INPUT, HID_RD_DATA_ARRAY, 8U, HID_KBD_6KRO_KEYCODES)               \
+  I(HID_RD_END_COLLECTION)
+
+/* Report ID 2: one Consumer page usage */
+#define USBD_HID_CONSUMER_DESC(I, F)                                          \
+  I(HID_RD_USAGE_PAGE(HID_RD_PAGE_CONSUMER))                                  \
+  I(HID_RD_USAGE(HID_RD_USAGE_CONSUMER_CONTROL))                              \
+  I(HID_RD_COLLECTION(HID_RD_APPLICATION))                                    \
+  I(HID_RD_REPORT_ID(HID_CONSUMER_REPORT_ID))                                 \
+  I(HID_RD_USAGE_MIN(0U))                                                     \
+  I(HID_RD_USAGE_MAX16(HID_CONSUMER_USAGE_MAX))                               \
+  I(HID_RD_LOGICAL_MIN(0))                                                    \
+  I(HID_RD_LOGICAL_MAX16(HID_CONSUMER_USAGE_MAX))                             \
+  F(HID_RD_INPUT, HID_RD_DATA_ARRAY, 16U, 1U)                                 \
+  I(HID_RD_END_COLLECTION)
+
+/* Report ID 3: power down, sleep, wake up bits */
+#define USBD_HID_SYSTEM_DESC(I, F)                                            \
+  I(HID_RD_USAGE_PAGE(HID_RD_PAGE_DESKTOP))                                   \
+  I(HID_RD_USAGE(HID_RD_USAGE_SYSTEM_CONTROL))                                \
+  I(HID_RD_COLLECTION(HID_RD_APPLICATION))                                    \
+  I(HID_RD_REPORT_ID(HID_SYSTEM_REPORT_ID))                                   \
+  I(HID_RD_USAGE_MIN(HID_SYSTEM_POWER_DOWN))                                  \
+  I(HID_RD_USAGE_MAX(HID_SYSTEM_WAKE_UP))                                     \
+  I(HID_RD_LOGICAL_MIN(0))                                                    \
+  I(HID_RD_LOGICAL_MAX(1))                                                    \
+  F(HID_RD_INPUT, HID_RD_DATA_VAR, 1U, 3U)                                    \
+  F(HID_RD_INPUT, HID_RD_CONST, 1U, 5U)                                       \
+  I(HID_RD_END_COLLECTION)
+
+/* Report IDs 4 and 5: configuration parameter and control, 7 bytes each */
+#define USBD_HID_CONFIG_DESC(I, F, id)                                        \
+  I(HID_RD_USAGE_PAGE16(USBD_HID_VENDOR_PAGE))                                \
+  I(HID_RD_USAGE(0x01U))                                                      \
+  I(HID_RD_COLLECTION(HID_RD_APPLICATION))                                    \
+  I(HID_RD_REPORT_ID(id))                                                     \
+  I(HID_RD_LOGICAL_MIN(0))                                                    \
+  I(HID_RD_LOGICAL_MAX16(0xFF))                                               \
+  I(HID_RD_USAGE(0x20U))                                                      \
+  I(HID_RD_USAGE(0x23U))                                                      \
+  I(HID_RD_USAGE(0x21U))                                                      \
+  I(HID_RD_USAGE(0x22U))                                                      \
+  F(HID_RD_FEATURE, HID_RD_DATA_VAR, 8U, 4U)                                  \
+  I(HID_RD_USAGE(0x24U))                                                      \
+  F(HID_RD_FEATURE, HID_RD_DATA_VAR, 8U, 3U)                                  \
+  I(HID_RD_END_COLLECTION)
+#define USBD_HID_CONFIG_PARAM_DESC(I, F) USBD_HID_CONFIG_DESC(I, F, HID_CONFIG_PARAM_REPORT_ID)
+#define USBD_HID_CONFIG_CTRL_DESC(I, F)  USBD_HID_CONFIG_DESC(I, F, HID_CONFIG_CTRL_REPORT_ID)
+
+/* Report ID 6: one bit per Keyboard/Keypad usage */
+#define USBD_HID_KBD_NKRO_DESC(I, F)                                          \
+  I(HID_RD_USAGE_PAGE(HID_RD_PAGE_DESKTOP))                                   \
+  I(HID_RD_USAGE(HID_RD_USAGE_KEYBOARD))                                      \
+  I(HID_RD_COLLECTION(HID_RD_APPLICATION))                                    \
+  I(HID_RD_REPORT_ID(HID_KBD_NKRO_REPORT_ID))                                 \
+  I(HID_RD_USAGE_PAGE(HID_RD_PAGE_KEYBOARD))                                  \
+  I(HID_RD_USAGE_MIN(0U))                                                     \
+  I(HID_RD_USAGE_MAX(HID_USAGE_MODIFIER_LAST))                                \
+  I(HID_RD_LOGICAL_MIN(0))                                                    \
+  I(HID_RD_LOGICAL_MAX(1))                                                    \
+  F(HID_RD_INPUT, HID_RD_DATA_VAR, 1U, HID_USAGE_MODIFIER_LAST + 1U)          \
+  I(HID_RD_END_COLLECTION)
+
+/* Report ID 7: latency trace histograms */
+#define USBD_HID_LATENCY_DESC(I, F)                                           \
+  I(HID_RD_USAGE_PAGE16(USBD_HID_VENDOR_PAGE))                                \
+  I(HID_RD_USAGE(0x02U))                                                      \
+  I(HID_RD_COLLECTION(HID_RD_APPLICATION))                                    \
+  I(HID_RD_REPORT_ID(LATENCY_TRACE_REPORT_ID))                                \
+  I(HID_RD_LOGICAL_MIN(0))                                                    \
+  I(HID_RD_LOGICAL_MAX16(0xFF))                                               \
+  I(HID_RD_USAGE(0x30U))                                                      \
+  F(HID_RD_FEATURE, HID_RD_DATA_VAR, 8U, LATENCY_TRACE_REPORT_SIZE - 1U)      \
+  I(HID_RD_END_COLLECTION)
+
+/* The whole report descriptor */
+#define USBD_HID_REPORT_DESC(I, F)                                            \
+  USBD_HID_KBD_6KRO_DESC(I, F)                                                \
+  USBD_HID_CONSUMER_DESC(I, F)                                                \
+  USBD_HID_SYSTEM_DESC(I, F)                                                  \
+  USBD_HID_CONFIG_PARAM_DESC(I, F)                                            \
+  USBD_HID_CONFIG_CTRL_DESC(I, F)                                             \
+  USBD_HID_KBD_NKRO_DESC(I, F)                                                \
+  USBD_HID_LATENCY_DESC(I, F)
+
+#define HID_MOUSE_REPORT_DESC_SIZE    HID_RD_SIZEOF(USBD_HID_REPORT_DESC)
+
+/* Report lengths declared by the descriptor, report ID included */
+#define USBD_HID_LED_REPORT_LEN       HID_RD_OUTPUT_LEN(USBD_HID_KBD_6KRO_DESC)
+
+/* Every report the firmware builds matches its declaration ------------------*/
+_Static_assert(HID_RD_INPUT_LEN(USBD_HID_KBD_6KRO_DESC) == HID_KBD_6KRO_REPORT_SIZE,
+               "report ID 1 input length differs from hid_kbd_encode_6kro()");
+_Static_assert(HID_LED_REPORT_ID == HID_KBD_6KRO_REPORT_ID,
+               "the LED output report shares report ID 1 with the keyboard");
+_Static_assert(USBD_HID_LED_REPORT_LEN == HID_LED_REPORT_SIZE,
+               "report ID 1 output length differs from the LED report parser");
+_Static_assert(HID_RD_INPUT_LEN(USBD_HID_CONSUMER_DESC) == HID_CONSUMER_REPORT_SIZE,
+               "report ID 2 length differs from hid_consumer_press()");
+_Static_assert(HID_RD_INPUT_LEN(USBD_HID_SYSTEM_DESC) == HID_SYSTEM_REPORT_SIZE,
+               "report ID 3 length differs from hid_system_press()");
+_Static_assert(HID_RD_FEATURE_LEN(USBD_HID_CONFIG_PARAM_DESC) == HID_CONFIG_REPORT_SIZE,
+               "report ID 4 length differs from hid_config");
+_Static_assert(HID_RD_FEATURE_LEN(USBD_HID_CONFIG_CTRL_DESC) == HID_CONFIG_REPORT_SIZE,
+               "report ID 5 length differs from hid_config");
+_Static_assert(HID_RD_INPUT_LEN(USBD_HID_KBD_NKRO_DESC) == HID_KBD_NKRO_REPORT_SIZE,
+               "report ID 6 length differs from hid_kbd_encode_nkro()");
+_Static_assert(HID_RD_FEATURE_LEN(USBD_HID_LATENCY_DESC) == LATENCY_TRACE_REPORT_SIZE,
+               "report ID 7 length differs from latency_trace_get_feature()");
+
+/* ... and fits the endpoint or control buffer it travels through */
+_Static_assert((HID_KBD_MAX_REPORT_SIZE <= HID_EPIN_SIZE) && (HID_KBD_BOOT_REPORT_SIZE <= HID_EPIN_SIZE) &&
+               (HID_CONSUMER_REPORT_SIZE <= HID_EPIN_SIZE) && (HID_SYSTEM_REPORT_SIZE <= HID_EPIN_SIZE),
+               "an input report does not fit HID_EPIN_SIZE");
+_Static_assert(HID_EPIN_SIZE <= 64U, "full speed interrupt packets are at most 64 bytes");
+_Static_assert(USBD_HID_LED_REPORT_LEN <= HID_EPOUT_SIZE, "the LED report does not fit HID_EPOUT_SIZE");
+_Static_assert((HID_CONFIG_REPORT_SIZE <= HID_CTRL_REPORT_SIZE) &&
+               (LATENCY_TRACE_REPORT_SIZE <= HID_CTRL_REPORT_SIZE),
+               "a feature report does not fit HID_CTRL_REPORT_SIZE");
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __USBD_HID_REPORT_DESC_H__ */
@@ -25,6 +25,12 @@
 #include "usbd_core.h"
 
 #include "usbd_hid.h"
+#if (USBD_CMPSIT_ACTIVATE_CDC == 1U)
+#include "usbd_cdc.h"
+#endif /* USBD_CMPSIT_ACTIVATE_CDC */
+#include "latency_trace.h"
+#include "usb_power.h"
+#include "usb_fifo.h"
 
 /* USER CODE BEGIN Includes */
 
@@ -94,6 +100,15 @@ void HAL_PCD_MspInit(PCD_HandleTypeDef* pcdHandle)
     HAL_NVIC_SetPriority(OTG_FS_IRQn, 0, 0);
     HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
   /* USER CODE BEGIN USB_OTG_FS_MspInit 1 */
+    if (pcdHandle->Init.low_power_enable == 1U)
+    {
+      /* Resume or reset on the bus wakes the chip from STOP mode through EXTI line 18 */
+      __HAL_USB_OTG_FS_WAKEUP_EXTI_CLEAR_FLAG();
+      __HAL_USB_OTG_FS_WAKEUP_EXTI_ENABLE_RISING_EDGE();
+      __HAL_USB_OTG_FS_WAKEUP_EXTI_ENABLE_IT();
+      HAL_NVIC_SetPriority(OTG_FS_WKUP_IRQn, 0, 0);
+      HAL_NVIC_EnableIRQ(OTG_FS_WKUP_IRQn);
+    }
 
   /* USER CODE END USB_OTG_FS_MspInit 1 */
   }
@@ -117,6 +132,8 @@ void HAL_PCD_MspDeInit(PCD_HandleTypeDef* pcdHandle)
 
     /* Peripheral interrupt Deinit*/
     HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+    HAL_NVIC_DisableIRQ(OTG_FS_WKUP_IRQn);
+    __HAL_USB_OTG_FS_WAKEUP_EXTI_DISABLE_IT();
 
   /* USER CODE BEGIN USB_OTG_FS_MspDeInit 1 */
 
@@ -135,7 +152,10 @@ static void PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd)
 void HAL_PCD_SetupStageCallback(PCD_HandleTypeDef *hpcd)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+  uint32_t start = latency_trace_now();
+
   USBD_LL_SetupStage((USBD_HandleTypeDef*)hpcd->pData, (uint8_t *)hpcd->Setup);
+  latency_trace_enum_setup((const uint8_t *)hpcd->Setup, start);
 }
 
 /**
@@ -150,7 +170,13 @@ static void PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 void HAL_PCD_DataOutStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+  uint32_t start = latency_trace_now();
+
   USBD_LL_DataOutStage((USBD_HandleTypeDef*)hpcd->pData, epnum, hpcd->OUT_ep[epnum].xfer_buff);
+  if (epnum == 0U)
+  {
+    latency_trace_enum_data(start);
+  }
 }
 
 /**
@@ -165,7 +191,17 @@ static void PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 void HAL_PCD_DataInStageCallback(PCD_HandleTypeDef *hpcd, uint8_t epnum)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+  uint32_t start = latency_trace_now();
+
+  if (epnum == (HID_EPIN_ADDR & 0x7FU))
+  {
+    latency_trace_stamp(LATENCY_STAMP_COMPLETE);
+  }
   USBD_LL_DataInStage((USBD_HandleTypeDef*)hpcd->pData, epnum, hpcd->IN_ep[epnum].xfer_buff);
+  if (epnum == 0U)
+  {
+    latency_trace_enum_data(start);
+  }
 }
 
 /**
@@ -193,6 +229,7 @@ static void PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
 void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
+   uint32_t start = latency_trace_now();
    USBD_SpeedTypeDef speed = USBD_SPEED_FULL;
 
   if ( hpcd->Init.speed != PCD_SPEED_FULL)
@@ -204,6 +241,14 @@ void HAL_PCD_ResetCallback(PCD_HandleTypeDef *hpcd)
 
   /* Reset Device. */
   USBD_LL_Reset((USBD_HandleTypeDef*)hpcd->pData);
+  latency_trace_enum_reset(start);
+
+  /* A reset also ends a suspend */
+  if (hpcd->Init.low_power_enable)
+  {
+    __HAL_PCD_UNGATE_PHYCLOCK(hpcd);
+    usb_power_resume();
+  }
 }
 
 /**
@@ -225,8 +270,8 @@ void HAL_PCD_SuspendCallback(PCD_HandleTypeDef *hpcd)
   /* USER CODE BEGIN 2 */
   if (hpcd->Init.low_power_enable)
   {
-    /* Set SLEEPDEEP bit and SleepOnExit of Cortex System Control Register. */
-    SCB->SCR |= (uint32_t)((uint32_t)(SCB_SCR_SLEEPDEEP_Msk | SCB_SCR_SLEEPONEXIT_Msk));
+    /* Entered from the main loop, see usb_power.c */
+    usb_power_suspend();
   }
   /* USER CODE END 2 */
 }
@@ -244,7 +289,12 @@ void HAL_PCD_ResumeCallback(PCD_HandleTypeDef *hpcd)
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
 {
   /* USER CODE BEGIN 3 */
-
+  if (hpcd->Init.low_power_enable)
+  {
+    /* usb_power.c has restored the clocks before unmasking this interrupt */
+    __HAL_PCD_UNGATE_PHYCLOCK(hpcd);
+    usb_power_resume();
+  }
   /* USER CODE END 3 */
   USBD_LL_Resume((USBD_HandleTypeDef*)hpcd->pData);
 }
@@ -329,8 +379,8 @@ USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
   hpcd_USB_OTG_FS.Init.speed = PCD_SPEED_FULL;
   hpcd_USB_OTG_FS.Init.dma_enable = DISABLE;
   hpcd_USB_OTG_FS.Init.phy_itface = PCD_PHY_EMBEDDED;
-  hpcd_USB_OTG_FS.Init.Sof_enable = DISABLE;
-  hpcd_USB_OTG_FS.Init.low_power_enable = DISABLE;
+  hpcd_USB_OTG_FS.Init.Sof_enable = ENABLE;
+  hpcd_USB_OTG_FS.Init.low_power_enable = ENABLE;
   hpcd_USB_OTG_FS.Init.lpm_enable = DISABLE;
   hpcd_USB_OTG_FS.Init.vbus_sensing_enable = DISABLE;
   hpcd_USB_OTG_FS.Init.use_dedicated_ep1 = DISABLE;
@@ -354,9 +404,7 @@ USBD_StatusTypeDef USBD_LL_Init(USBD_HandleTypeDef *pdev)
   HAL_PCD_RegisterIsoOutIncpltCallback(&hpcd_USB_OTG_FS, PCD_ISOOUTIncompleteCallback);
   HAL_PCD_RegisterIsoInIncpltCallback(&hpcd_USB_OTG_FS, PCD_ISOINIncompleteCallback);
 #endif /* USE_HAL_PCD_REGISTER_CALLBACKS */
-  HAL_PCDEx_SetRxFiFo(&hpcd_USB_OTG_FS, 0x80);
-  HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 0, 0x40);
-  HAL_PCDEx_SetTxFiFo(&hpcd_USB_OTG_FS, 1, 0x80);
+  /* FIFO RAM is sized in USBD_LL_Start(), once the classes are registered */
   }
   return USBD_OK;
 }
@@ -387,6 +435,23 @@ USBD_StatusTypeDef USBD_LL_Start(USBD_HandleTypeDef *pdev)
 {
   HAL_StatusTypeDef hal_status = HAL_OK;
   USBD_StatusTypeDef usb_status = USBD_OK;
+  usb_fifo_plan_t plan;
+  uint8_t i;
+
+  /* FIFOs sized from the configuration descriptor, before the core connects */
+  if (usb_fifo_plan_device(pdev, &plan) != USB_FIFO_OK)
+  {
+    USBD_ErrLog("USB FIFO: %u of %u words needed", plan.used_words, USB_FIFO_WORDS);
+    return USBD_FAIL;
+  }
+  HAL_PCDEx_SetRxFiFo(pdev->pData, plan.rx_words);
+  for (i = 0U; i < plan.tx_count; i++)
+  {
+    HAL_PCDEx_SetTxFiFo(pdev->pData, i, plan.tx_words[i]);
+  }
+  USBD_UsrLog("USB FIFO: RX %u, TX %u/%u/%u/%u, %u of %u words free", plan.rx_words, plan.tx_words[0],
+              plan.tx_words[1], plan.tx_words[2], plan.tx_words[3], USB_FIFO_WORDS - plan.used_words,
+              USB_FIFO_WORDS);
 
   hal_status = HAL_PCD_Start(pdev->pData);
 
@@ -555,6 +620,10 @@ USBD_StatusTypeDef USBD_LL_Transmit(USBD_HandleTypeDef *pdev, uint8_t ep_addr, u
   HAL_StatusTypeDef hal_status = HAL_OK;
   USBD_StatusTypeDef usb_status = USBD_OK;
 
+  if (ep_addr == HID_EPIN_ADDR)
+  {
+    latency_trace_stamp(LATENCY_STAMP_TRANSMIT);
+  }
   hal_status = HAL_PCD_EP_Transmit(pdev->pData, ep_addr, pbuf, size);
 
   usb_status =  USBD_Get_USB_Status(hal_status);
@@ -610,14 +679,56 @@ USBD_StatusTypeDef USBD_LL_SetTestMode(USBD_HandleTypeDef *pdev, uint8_t testmod
 #endif /* USBD_HS_TESTMODE_ENABLE */
 
 /**
-  * @brief  Static single allocation.
+  * @brief  Start or stop resume signalling on the suspended bus (remote wakeup).
+  * @note   The host must have enabled remote wakeup with SET_FEATURE.
+  * @param  pdev: Device handle
+  * @param  active: 1 to start, 0 to stop
+  * @retval USBD status
+  */
+USBD_StatusTypeDef USBD_LL_RemoteWakeup(USBD_HandleTypeDef *pdev, uint8_t active)
+{
+  PCD_HandleTypeDef *hpcd = (PCD_HandleTypeDef *)pdev->pData;
+  HAL_StatusTypeDef hal_status;
+
+  if (active != 0U)
+  {
+    /* The core needs its clock to drive the bus */
+    __HAL_PCD_UNGATE_PHYCLOCK(hpcd);
+    hal_status = HAL_PCD_ActivateRemoteWakeup(hpcd);
+  }
+  else
+  {
+    hal_status = HAL_PCD_DeActivateRemoteWakeup(hpcd);
+  }
+
+  return USBD_Get_USB_Status(hal_status);
+}
+
+/**
+  * @brief  Static allocation, one block per class.
+  * @note   Each class allocates its handle in Init, while the core has
+  *         pdev->classId set to that class.
   * @param  size: Size of allocated memory
-  * @retval None
+  * @retval pointer to the class handle memory
   */
 void *USBD_static_malloc(uint32_t size)
 {
-  static uint32_t mem[(sizeof(USBD_HID_HandleTypeDef)/4)+1];/* On 32-bit boundary */
-  return mem;
+  static union
+  {
+    USBD_HID_HandleTypeDef hid;
+#if (USBD_CMPSIT_ACTIVATE_CDC == 1U)
+    USBD_CDC_HandleTypeDef cdc;
+#endif /* USBD_CMPSIT_ACTIVATE_CDC */
+    uint32_t align;                                   /* On 32-bit boundary */
+  } mem[USBD_MAX_SUPPORTED_CLASS];
+  uint32_t classId = ((USBD_HandleTypeDef *)hpcd_USB_OTG_FS.pData)->classId;
+
+  if ((classId >= USBD_MAX_SUPPORTED_CLASS) || (size > sizeof(mem[0])))
+  {
+    return NULL;
+  }
+
+  return &mem[classId];
 }
 
 /**
@@ -35,7 +35,7 @@
 #include "stm32f4xx_hal.h"
 
 /* USER CODE BEGIN INCLUDE */
-
+#include "log_stream.h"
 /* USER CODE END INCLUDE */
 
 /** @addtogroup USBD_OTG_DRIVER
@@ -62,20 +62,38 @@
   * @{
   */
 
+/*---------- -----------*/
+/* 1: composite HID + CDC-ACM device, the CDC interface streams log_stream.c */
+#ifndef USBD_CDC_CONSOLE
+#define USBD_CDC_CONSOLE     1U
+#endif /* USBD_CDC_CONSOLE */
+#if (USBD_CDC_CONSOLE == 1U)
+#define USE_USBD_COMPOSITE
+#define USBD_MAX_SUPPORTED_CLASS     2U
+#define USBD_CMPSIT_ACTIVATE_HID     1U
+#define USBD_CMPSIT_ACTIVATE_CDC     1U
+/*---------- -----------*/
+#define USBD_MAX_NUM_INTERFACES     3U
+#else
 /*---------- -----------*/
 #define USBD_MAX_NUM_INTERFACES     1U
+#endif /* USBD_CDC_CONSOLE */
 /*---------- -----------*/
 #define USBD_MAX_NUM_CONFIGURATION     1U
 /*---------- -----------*/
 #define USBD_MAX_STR_DESC_SIZ     512U
 /*---------- -----------*/
+#if (USBD_CDC_CONSOLE == 1U)
+#define USBD_DEBUG_LEVEL     2U
+#else
 #define USBD_DEBUG_LEVEL     0U
+#endif /* USBD_CDC_CONSOLE */
 /*---------- -----------*/
 #define USBD_LPM_ENABLED     0U
 /*---------- -----------*/
 #define USBD_SELF_POWERED     1U
 /*---------- -----------*/
-#define HID_FS_BINTERVAL     0xAU
+#define HID_FS_BINTERVAL     0x1U
 
 /****************************************/
 /* #define for FS and HS identification */
@@ -109,26 +127,22 @@
 
 /* DEBUG macros */
 
+/* The library messages go to the console as whole lines, from any context */
 #if (USBD_DEBUG_LEVEL > 0)
-#define USBD_UsrLog(...)    printf(__VA_ARGS__);\
-                            printf("\n");
+#define USBD_UsrLog(...)    (void)log_line("", __VA_ARGS__);
 #else
 #define USBD_UsrLog(...)
 #endif /* (USBD_DEBUG_LEVEL > 0U) */
 
 #if (USBD_DEBUG_LEVEL > 1)
 
-#define USBD_ErrLog(...)    printf("ERROR: ");\
-                            printf(__VA_ARGS__);\
-                            printf("\n");
+#define USBD_ErrLog(...)    (void)log_line("ERROR: ", __VA_ARGS__);
 #else
 #define USBD_ErrLog(...)
 #endif /* (USBD_DEBUG_LEVEL > 1U) */
 
 #if (USBD_DEBUG_LEVEL > 2)
-#define USBD_DbgLog(...)    printf("DEBUG : ");\
-                            printf(__VA_ARGS__);\
-                            printf("\n");
+#define USBD_DbgLog(...)    (void)log_line("DEBUG : ", __VA_ARGS__);
 #else
 #define USBD_DbgLog(...)
 #endif /* (USBD_DEBUG_LEVEL > 2U) */